@@ -0,0 +1,147 @@
+import sys
+import time
+
+from DecodeAciTrace import ACI_EVENTS
+
+# PC side of aci_gateway.h, for the ble_aci_gateway sketch: frames ACI commands to the gateway and
+# decodes the frames of ACI events it sends back. Needs pyserial for the serial port.
+#
+# Frame, before COBS and the 0x00 at the end, CRC-16-CCITT of the bytes before it, MSB first:
+#   PC to gateway : [packet] [packet] ... [CRC 2 bytes]
+#   gateway to PC : [grant]  [packet] [packet] ... [CRC 2 bytes]
+# where a packet is the length then the opcode and parameters of an ACI command or event.
+#
+# Usage: python AciGateway.py <serial port> [baud rate]
+#   prints the events of the nRF8001, the first is the DeviceStartedEvent after the reset.
+
+GRANT_RESET = 0x80
+
+
+def crc16_ccitt(data, crc=0xFFFF):
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_encode(data):
+    out = bytearray()
+    block = bytearray()
+    for byte in data:
+        if 0 == byte:
+            out.append(len(block) + 1)
+            out += block
+            block = bytearray()
+        else:
+            block.append(byte)
+            if 254 == len(block):
+                out.append(0xFF)
+                out += block
+                block = bytearray()
+    out.append(len(block) + 1)
+    out += block
+    out.append(0)
+    return bytes(out)
+
+
+def cobs_decode(data):
+    out = bytearray()
+    offset = 0
+    while offset < len(data):
+        code = data[offset]
+        block = data[offset + 1:offset + code]
+        if 0 == code or len(block) != code - 1:
+            raise ValueError("COBS block cut short")
+        out += block
+        offset += code
+        if code < 0xFF and offset < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def encode_frame(packets):
+    frame = bytearray()
+    for packet in packets:
+        frame.append(len(packet))
+        frame += packet
+    crc = crc16_ccitt(frame)
+    frame += bytearray((crc >> 8, crc & 0xFF))
+    return cobs_encode(frame)
+
+
+def decode_frame(data):
+    """Returns (grant, packets) of a frame without its 0x00, None when the CRC does not match"""
+    frame = bytearray(cobs_decode(data))
+    if len(frame) < 3 or crc16_ccitt(frame[:-2]) != ((frame[-2] << 8) | frame[-1]):
+        return None
+    packets = []
+    offset = 1
+    while offset < len(frame) - 2:
+        length = frame[offset]
+        packets.append(bytes(frame[offset + 1:offset + 1 + length]))
+        offset += 1 + length
+    return frame[0], packets
+
+
+class Gateway(object):
+    def __init__(self, port):
+        self.port = port
+        self.credits = 0
+        self.rx = bytearray()
+
+    def _grant(self, grant):
+        if grant & GRANT_RESET:
+            self.credits = grant & ~GRANT_RESET
+        else:
+            self.credits += grant
+
+    def reset(self):
+        """Asks for the credits, the frames in flight before are dropped"""
+        self.port.write(b"\x00" + encode_frame([]))
+
+    def send(self, packets):
+        """Sends as many of the packets as there are credits, returns the number sent"""
+        count = min(self.credits, len(packets))
+        if count:
+            self.port.write(encode_frame(packets[:count]))
+            self.credits -= count
+        return count
+
+    def events(self):
+        """The events of the frames received so far"""
+        self.rx += self.port.read(self.port.in_waiting or 1)
+        events = []
+        while 0 in self.rx:
+            end = self.rx.index(0)
+            data, self.rx = bytes(self.rx[:end]), self.rx[end + 1:]
+            if not data:
+                continue
+            try:
+                decoded = decode_frame(data)
+            except ValueError:
+                decoded = None
+            if decoded is None:
+                print("Bad frame dropped")
+                continue
+            grant, packets = decoded
+            self._grant(grant)
+            events += packets
+        return events
+
+
+if __name__ == "__main__":
+    if len(sys.argv) not in (2, 3):
+        print("Usage: python AciGateway.py <serial port> [baud rate]")
+        sys.exit(1)
+    import serial
+    port = serial.Serial(sys.argv[1], int(sys.argv[2]) if len(sys.argv) == 3 else 1000000,
+                         timeout=0.1)
+    time.sleep(2)  # The board resets when the port opens
+    gateway = Gateway(port)
+    gateway.reset()
+    while True:
+        for event in gateway.events():
+            name = ACI_EVENTS.get(event[0], "Unknown") if event else "Empty"
+            print("%-22s %s" % (name, " ".join("%02X" % b for b in event)))
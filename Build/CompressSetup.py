@@ -0,0 +1,104 @@
+import os
+import re
+import sys
+
+# Compresses the setup messages of a services.h generated by nRFgo Studio for ACI_SETUP_COMPRESSED.
+# The output has SETUP_MESSAGES_COMPRESSED_CONTENT and SETUP_MESSAGES_COMPRESSED_SIZE, use it
+# along with services.h, see aci_setup.h.
+#
+# Record format, one per setup message [length][0x06 Setup][target][offset][data]:
+#   [header: bit 5 new target, bits 0-4 data length n]
+#   [target][offset]                               only with the new target bit
+#   per 8 data bytes: [mask, bit i set for a non zero byte i][the non zero bytes]
+# Without the new target bit, the target is the one of the previous message and the offset
+# follows on from the data of the previous message.
+#
+# Usage: python CompressSetup.py <services.h> [output file, default services_compressed.h]
+
+ACI_CMD_SETUP = 0x06
+NEW_TARGET = 0x20
+MAX_DATA_LENGTH = 0x1F
+
+
+def read_setup_messages(text):
+    start = text.find("#define SETUP_MESSAGES_CONTENT")
+    if start < 0:
+        raise ValueError("SETUP_MESSAGES_CONTENT not found")
+    body = text[start:]
+    # The macro ends at the first line that is not continued
+    end = 0
+    for line in body.splitlines(True):
+        end += len(line)
+        if not line.rstrip().endswith("\\"):
+            break
+    messages = []
+    for record in re.findall(r"\{\s*0x[0-9a-fA-F]+\s*,\\?\s*\{([^}]*)\}", body[:end]):
+        messages.append([int(b, 16) for b in re.findall(r"0x([0-9a-fA-F]{1,2})", record)])
+    return messages
+
+
+def compress(messages):
+    out = []
+    target = None
+    offset = 0
+    for message in messages:
+        length = message[0]
+        if (length < 3) or (message[1] != ACI_CMD_SETUP) or (len(message) < length + 1):
+            raise ValueError("Not a setup message: %s" % message)
+        data = message[4:length + 1]
+        if len(data) > MAX_DATA_LENGTH:
+            raise ValueError("Setup message too long: %s" % message)
+
+        if (message[2] == target) and (message[3] == offset):
+            out.append(len(data))
+        else:
+            out.extend([NEW_TARGET | len(data), message[2], message[3]])
+        target = message[2]
+        offset = (message[3] + len(data)) & 0xFF
+
+        for i in range(0, len(data), 8):
+            group = data[i:i + 8]
+            mask = 0
+            for bit, value in enumerate(group):
+                if value != 0:
+                    mask |= 1 << bit
+            out.append(mask)
+            out.extend([value for value in group if value != 0])
+    return out
+
+
+def write_header(name, messages, data, output):
+    lines = []
+    lines.append("/* Generated by CompressSetup.py from %s, %d setup messages in %d bytes"
+                 % (name, len(messages), len(data)))
+    lines.append(" * (%d bytes as hal_aci_data_t). To be used with ACI_SETUP_COMPRESSED. */" % (len(messages) * 33))
+    lines.append("")
+    lines.append("#ifndef SETUP_MESSAGES_COMPRESSED_H__")
+    lines.append("#define SETUP_MESSAGES_COMPRESSED_H__")
+    lines.append("")
+    lines.append("#define SETUP_MESSAGES_COMPRESSED_SIZE %d" % len(data))
+    lines.append("")
+    lines.append("#define SETUP_MESSAGES_COMPRESSED_CONTENT {\\")
+    for i in range(0, len(data), 16):
+        lines.append("    " + "".join("0x%02x," % b for b in data[i:i + 16]) + "\\")
+    lines.append("}")
+    lines.append("")
+    lines.append("#endif")
+    output.write("\n".join(lines) + "\n")
+
+
+if __name__ == "__main__":
+    if len(sys.argv) not in (2, 3):
+        print("Usage: python CompressSetup.py <services.h> [output file]")
+        sys.exit(1)
+    with open(sys.argv[1]) as services:
+        messages = read_setup_messages(services.read())
+    data = compress(messages)
+    if len(sys.argv) == 3:
+        output_name = sys.argv[2]
+    else:
+        output_name = os.path.join(os.path.dirname(sys.argv[1]), "services_compressed.h")
+    with open(output_name, "w") as output:
+        write_header(os.path.basename(sys.argv[1]), messages, data, output)
+    print("%d setup messages, %d bytes compressed, %d bytes as hal_aci_data_t"
+          % (len(messages), len(data), len(messages) * 33))
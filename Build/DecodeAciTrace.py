@@ -0,0 +1,81 @@
+import sys
+
+# Decodes the binary ACI trace written by hal_aci_tl_trace_drain() / hal_aci_tl_trace_read()
+# when the BLE library is built with HAL_ACI_TL_TRACE set to 1, or written to the Serial when it
+# is built with ACI_LOG_LEVEL set to 3.
+#
+# Record format, multi-byte fields little endian:
+#   [type 'C' or 'E'][micros() 4 bytes][length n][n bytes: opcode, parameters]
+#   [type 'L'][micros() 4 bytes][length 3][log ID][value 2 bytes]
+#
+# Usage: python DecodeAciTrace.py <capture file>
+
+ACI_COMMANDS = {
+    0x01: "Test", 0x02: "Echo", 0x03: "DtmCommand", 0x04: "Sleep", 0x05: "Wakeup",
+    0x06: "Setup", 0x07: "ReadDynamicData", 0x08: "WriteDynamicData",
+    0x09: "GetDeviceVersion", 0x0A: "GetDeviceAddress", 0x0B: "GetBatteryLevel",
+    0x0C: "GetTemperature", 0x0D: "SetLocalData", 0x0E: "RadioReset", 0x0F: "Connect",
+    0x10: "Bond", 0x11: "Disconnect", 0x12: "SetTxPower", 0x13: "ChangeTiming",
+    0x14: "OpenRemotePipe", 0x15: "SendData", 0x16: "SendDataAck", 0x17: "RequestData",
+    0x18: "SendDataNack", 0x19: "SetApplLatency", 0x1A: "SetKey", 0x1B: "OpenAdvPipe",
+    0x1C: "Broadcast", 0x1D: "BondSecurityRequest", 0x1E: "ConnectDirect",
+    0x1F: "CloseRemotePipe",
+}
+
+ACI_EVENTS = {
+    0x81: "DeviceStartedEvent", 0x82: "EchoEvent", 0x83: "HardwareErrorEvent",
+    0x84: "CommandResponseEvent", 0x85: "ConnectedEvent", 0x86: "DisconnectedEvent",
+    0x87: "BondStatusEvent", 0x88: "PipeStatusEvent", 0x89: "TimingEvent",
+    0x8A: "DataCreditEvent", 0x8B: "DataAckEvent", 0x8C: "DataReceivedEvent",
+    0x8D: "PipeErrorEvent", 0x8E: "DisplayPasskeyEvent", 0x8F: "KeyRequestEvent",
+}
+
+# aci_log_id_t of aci_log.h
+ACI_LOG_IDS = {
+    0x01: "Assert", 0x02: "CommandTooLong", 0x03: "CommandQueueFull", 0x04: "BoardInit",
+    0x05: "BoardInitDiscard",
+}
+
+HEADER_LENGTH = 6
+
+
+def decode(data):
+    offset = 0
+    last_time = None
+    while offset + HEADER_LENGTH <= len(data):
+        record_type = chr(data[offset])
+        if record_type not in ("C", "E", "L"):
+            # Not at a record boundary, resynchronise on the next type byte
+            offset += 1
+            continue
+
+        time_us = (data[offset + 1] | (data[offset + 2] << 8) |
+                   (data[offset + 3] << 16) | (data[offset + 4] << 24))
+        length = data[offset + 5]
+        payload = data[offset + HEADER_LENGTH:offset + HEADER_LENGTH + length]
+        if len(payload) < length:
+            print("Truncated record at offset %d" % offset)
+            break
+        offset += HEADER_LENGTH + length
+
+        delta = "" if last_time is None else "(+%d us)" % ((time_us - last_time) & 0xFFFFFFFF)
+        last_time = time_us
+
+        if record_type == "L":
+            name = ACI_LOG_IDS.get(payload[0], "Unknown") if length > 0 else "Empty"
+            value = (payload[1] | (payload[2] << 8)) if length >= 3 else 0
+            print("%10d us %-12s %s %-22s 0x%04X" % (time_us, delta, record_type, name, value))
+            continue
+
+        names = ACI_COMMANDS if record_type == "C" else ACI_EVENTS
+        name = names.get(payload[0], "Unknown") if length > 0 else "Empty"
+        print("%10d us %-12s %s %-22s %s" % (time_us, delta, record_type, name,
+                                             " ".join("%02X" % b for b in payload)))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        print("Usage: python DecodeAciTrace.py <capture file>")
+        sys.exit(1)
+    with open(sys.argv[1], "rb") as capture:
+        decode(bytearray(capture.read()))
@@ -0,0 +1,103 @@
+import sys
+
+# Decodes the reports of aci_diag, notified on the Report characteristic of the Diagnostics
+# service of ble_diagnostics_template.
+#
+# Notification: [packet number, 0x80 in the last one of the report] [record stream...]
+# Record:       [tag] [length n] [n bytes of payload], the counters LEB128 encoded
+#
+# Usage: python DecodeDiagnostics.py <log file>
+#   the log has a notification per line in hex, e.g. "01-03-01-D8-17" or "0103 01D8 17", lines
+#   that are not hex are skipped.
+
+FIELDS = {
+    0x01: ("Header", ["format", "millis"]),
+    0x02: ("Transport", ["spi_transfers", "bytes_out", "bytes_in", "empty_transfers",
+                         "isr_transfers", "poll_transfers", "rx_full_stalls",
+                         "tx_enqueue_failures", "tx_coalesced", "rx_credit_coalesced",
+                         "tx_q_high_water", "rx_q_high_water", "hybrid_switches"]),
+    0x03: ("Latency", ["count", "min_us", "max_us", "avg_us", "below_64us", "below_256us",
+                       "below_1ms", "below_4ms", "below_16ms", "above_16ms"]),
+    0x04: ("Link", ["connected_ms", "duration_ms", "starved_ms", "starved_max_ms",
+                    "starved_count", "interval", "interval_min", "interval_max", "slave_latency",
+                    "slave_latency_max", "supervision_timeout", "timing_changes", "pipe_errors",
+                    "aci_status", "btle_status"]),
+    0x05: ("Energy", ["elapsed_ms", "awake_ms", "sleep_ms", "radio_active_ms", "sleeps",
+                      "events", "bytes", "packets", "mcu_uc", "radio_uc", "average_ua",
+                      "nc_per_byte", "nc_per_packet", "nc_per_event"]),
+}
+
+PACKET_LAST = 0x80
+
+
+def read_leb128(data, offset):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, offset
+
+
+def decode_record(tag, payload):
+    name, fields = FIELDS.get(tag, ("Unknown 0x%02X" % tag, []))
+    values = []
+    offset = 0
+    if 0x03 == tag:
+        values.append(("opcode", "0x%02X" % payload[0]))
+        offset = 1
+    while offset < len(payload):
+        value, offset = read_leb128(payload, offset)
+        index = len(values) - (1 if 0x03 == tag else 0)
+        values.append((fields[index] if index < len(fields) else "field_%d" % index, value))
+    print("%-10s %s" % (name, " ".join("%s=%s" % pair for pair in values)))
+
+
+def decode_report(stream):
+    offset = 0
+    while offset + 2 <= len(stream):
+        tag, length = stream[offset], stream[offset + 1]
+        payload = stream[offset + 2:offset + 2 + length]
+        if len(payload) < length:
+            print("Record 0x%02X cut short" % tag)
+            return
+        decode_record(tag, payload)
+        offset += 2 + length
+
+
+def decode(lines):
+    stream = bytearray()
+    expected = 0
+    for line in lines:
+        text = line.strip().replace("-", "").replace(" ", "").replace(":", "")
+        try:
+            packet = bytearray.fromhex(text)
+        except ValueError:
+            continue
+        if not packet:
+            continue
+        number = packet[0] & ~PACKET_LAST
+        if 0 == number:
+            stream = bytearray()
+            expected = 0
+        if number != expected:
+            print("Packet %d missing, report dropped" % expected)
+            expected = -1
+            continue
+        stream += packet[1:]
+        expected += 1
+        if packet[0] & PACKET_LAST:
+            decode_report(stream)
+            print("")
+            expected = -1
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        print("Usage: python DecodeDiagnostics.py <log file>")
+        sys.exit(1)
+    with open(sys.argv[1]) as log:
+        decode(log.readlines())
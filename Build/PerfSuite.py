@@ -0,0 +1,89 @@
+import os
+import re
+import shlex
+import subprocess
+import sys
+
+# Runs the emu_ programs of the host build (Build/host, make all) and checks their figures against a
+# limits file, for the regressions of throughput, setup, connect and reconnect times, RAM and stack.
+#
+# Limits file, one figure per line, # starts a comment:
+#   <name> <program> "<row>" <field> <check> <limit>
+# The figure is field <field> (from 0, split on white space) of the first output line of <program>
+# that starts with <row>, white space runs taken as one space. <check> is >= or <=.
+# A program that exits with an error, a row not found or a row that ends in FAILED fails its figures.
+#
+# Prints each figure against its limit. The exit code is 1 when a figure is off its limit.
+#
+# Usage: python PerfSuite.py <limits file> <folder of the emu_ programs>
+
+CHECKS = {
+    ">=": lambda value, limit: value >= limit,
+    "<=": lambda value, limit: value <= limit,
+}
+
+
+def read_limits(path):
+    limits = []
+    with open(path) as limits_file:
+        for number, line in enumerate(limits_file, 1):
+            fields = shlex.split(line, comments=True)
+            if not fields:
+                continue
+            if len(fields) != 6 or fields[4] not in CHECKS:
+                raise ValueError("%s:%d: expected <name> <program> \"<row>\" <field> <check> <limit>"
+                                 % (path, number))
+            limits.append((fields[0], fields[1], " ".join(fields[2].split()), int(fields[3]),
+                           fields[4], float(fields[5])))
+    return limits
+
+
+def run_program(folder, program):
+    process = subprocess.Popen([os.path.join(folder, program)], stdout=subprocess.PIPE,
+                               stderr=subprocess.STDOUT, universal_newlines=True)
+    output = process.communicate()[0]
+    rows = [" ".join(line.split()) for line in output.splitlines()]
+    return process.returncode, rows
+
+
+def read_figure(rows, row, field):
+    for line in rows:
+        if line == row or line.startswith(row + " "):
+            fields = line.split(" ")
+            if fields[-1] == "FAILED":
+                return None, "FAILED"
+            if field >= len(fields):
+                return None, "no field %d" % field
+            if not re.match(r"^-?[0-9.]+$", fields[field]):
+                return None, "'%s' not a figure" % fields[field]
+            return float(fields[field]), None
+    return None, "row not found"
+
+
+def check(limits, folder):
+    outputs = {}
+    failures = 0
+    print("%-22s %10s %-2s %10s" % ("figure", "value", "", "limit"))
+    for name, program, row, field, check_name, limit in limits:
+        if program not in outputs:
+            outputs[program] = run_program(folder, program)
+        returncode, rows = outputs[program]
+        if returncode != 0:
+            value, error = None, "%s exited with %d" % (program, returncode)
+        else:
+            value, error = read_figure(rows, row, field)
+        if error is None and not CHECKS[check_name](value, limit):
+            error = "off limit"
+        if error is not None:
+            failures += 1
+        print("%-22s %10s %-2s %10g %s" % (name, "-" if value is None else "%g" % value, check_name,
+                                           limit, "ok" if error is None else error))
+    print("%d of %d figures within their limits" % (len(limits) - failures, len(limits)))
+    return failures
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        print("Usage: python PerfSuite.py <limits file> <folder of the emu_ programs>")
+        sys.exit(1)
+    sys.exit(1 if check(read_limits(sys.argv[1]), sys.argv[2]) else 0)
@@ -0,0 +1,112 @@
+import os
+import re
+import sys
+
+from SetupProfiles import read_pipe_map, read_pipes
+
+# Writes typed accessors for the pipes of a services.h generated by nRFgo Studio. The pipe type
+# and the size of the value are checked at compile time, the accessors call
+# lib_aci_send_data_unchecked() and lib_aci_set_local_data_unchecked() which leave the checks out.
+#
+# The output has, per pipe PIPE_<SERVICE>_<CHARACTERISTIC>_<TYPE>:
+#   pipe_<service>_<characteristic>_send(value)             ACI_TX and ACI_TX_ACK pipes
+#   pipe_<service>_<characteristic>_set(aci_stat, value)    ACI_SET pipes
+# where value is a uint8_t array of at most PIPE_..._MAX_SIZE bytes, a larger array does not
+# compile. Characteristics of one byte also take a uint8_t.
+#
+# Usage: python PipeAccessors.py <output file> <services.h>
+
+SEND_TYPES = ("ACI_TX", "ACI_TX_ACK")
+SET_TYPES = ("ACI_SET",)
+TYPE_SUFFIXES = ("_TX_ACK", "_TX", "_SET")
+
+
+def read_max_sizes(text):
+    return dict(re.findall(r"^#define\s+PIPE_(\w+)_MAX_SIZE\s+(\d+)\s*$", text, re.MULTILINE))
+
+
+def accessor_name(pipe):
+    for suffix in TYPE_SUFFIXES:
+        if pipe.endswith(suffix):
+            return "pipe_" + pipe[:-len(suffix)].lower()
+    return "pipe_" + pipe.lower()
+
+
+def write_accessor(lines, pipe, pipe_type, max_size, kind):
+    name = "%s_%s" % (accessor_name(pipe), kind)
+    macro = "PIPE_" + pipe
+    if "send" == kind:
+        params = ""
+        call = "lib_aci_send_data_unchecked(%s, " % macro
+    else:
+        params = "aci_state_t *aci_stat, "
+        call = "lib_aci_set_local_data_unchecked(aci_stat, %s, " % macro
+
+    lines.append("")
+    size = "1 byte" if 1 == max_size else "%d bytes" % max_size
+    lines.append("/* %s, %s, at most %s */" % (macro, pipe_type, size))
+    lines.append("template <size_t N>")
+    lines.append("static inline bool %s(%sconst uint8_t (&value)[N])" % (name, params))
+    lines.append("{")
+    lines.append("  static_assert(N <= %s_MAX_SIZE, \"%s holds at most %s\");"
+                 % (macro, macro, size))
+    lines.append("  return %s&value[0], N);" % call)
+    lines.append("}")
+    if 1 == max_size:
+        lines.append("")
+        lines.append("static inline bool %s(%suint8_t value)" % (name, params))
+        lines.append("{")
+        lines.append("  return %s&value, 1);" % call)
+        lines.append("}")
+    return name
+
+
+def write_header(name, text, output):
+    pipe_map = read_pipe_map(text)
+    max_sizes = read_max_sizes(text)
+    names = {}
+    lines = []
+    lines.append("/* Generated by PipeAccessors.py from %s. Typed accessors of the pipes, see"
+                 % name)
+    lines.append(" * lib_aci_send_data_unchecked() and lib_aci_set_local_data_unchecked(). */")
+    lines.append("")
+    lines.append("#ifndef PIPE_ACCESSORS_H__")
+    lines.append("#define PIPE_ACCESSORS_H__")
+    lines.append("")
+    lines.append("#include <lib_aci.h>")
+    lines.append("#include \"%s\"" % name)
+
+    for pipe, number in read_pipes(text):
+        if pipe.endswith("_MAX_SIZE") or pipe not in max_sizes:
+            continue
+        number = int(number)
+        if not 1 <= number <= len(pipe_map):
+            raise ValueError("PIPE_%s %d is not in the pipe map" % (pipe, number))
+        pipe_type = pipe_map[number - 1][1]
+        max_size = int(max_sizes[pipe])
+        if pipe_type in SEND_TYPES:
+            kind = "send"
+        elif pipe_type in SET_TYPES:
+            kind = "set"
+        else:
+            continue
+        accessor = write_accessor(lines, pipe, pipe_type, max_size, kind)
+        if accessor in names:
+            raise ValueError("PIPE_%s and PIPE_%s both give %s" % (names[accessor], pipe, accessor))
+        names[accessor] = pipe
+
+    lines.append("")
+    lines.append("#endif")
+    output.write("\n".join(lines) + "\n")
+    return len(names)
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        print("Usage: python PipeAccessors.py <output file> <services.h>")
+        sys.exit(1)
+    with open(sys.argv[2]) as services:
+        text = services.read()
+    with open(sys.argv[1], "w") as output:
+        count = write_header(os.path.basename(sys.argv[2]), text, output)
+    print("%d pipe accessors" % count)
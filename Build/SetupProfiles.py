@@ -0,0 +1,114 @@
+import os
+import re
+import sys
+
+from CompressSetup import read_setup_messages
+
+# Merges the setup messages of several services.h generated by nRFgo Studio into setup profiles
+# for ACI_SETUP_PROFILES. A setup message that several profiles have the same is stored once,
+# each profile is a table of pointers to its messages. See aci_setup_profile_select().
+#
+# The output has, for N profiles:
+#   SETUP_PROFILES_RECORD_COUNT, SETUP_PROFILES_RECORDS_CONTENT   the setup messages, each once
+#   SETUP_PROFILE_<n>_MSG_COUNT, SETUP_PROFILE_<n>_TABLE(records)  the messages of profile n
+#   SETUP_PROFILE_<n>_NUMBER_OF_PIPES, SETUP_PROFILE_<n>_PIPE_MAP_CONTENT
+#   SETUP_PROFILE_<n>_PIPE_...                                     the pipes of profile n
+# in place of the SETUP_MESSAGES_CONTENT, SERVICES_PIPE_TYPE_MAPPING_CONTENT and PIPE_ defines
+# of the services.h files, which clash when more than one is included.
+#
+# Usage: python SetupProfiles.py <output file> <services.h> <services.h> [...]
+
+
+def read_macro(text, name):
+    start = text.find("#define " + name)
+    if start < 0:
+        raise ValueError("%s not found" % name)
+    end = start
+    for line in text[start:].splitlines(True):
+        end += len(line)
+        if not line.rstrip().endswith("\\"):
+            break
+    return text[start:end]
+
+
+def read_pipe_map(text):
+    body = read_macro(text, "SERVICES_PIPE_TYPE_MAPPING_CONTENT")
+    return re.findall(r"\{\s*(ACI_\w+)\s*,\s*(ACI_\w+)\s*\}", body)
+
+
+def read_pipes(text):
+    return re.findall(r"^#define\s+PIPE_(\w+)\s+(\d+)\s*$", text, re.MULTILINE)
+
+
+def merge(profiles):
+    records = []
+    index = {}
+    tables = []
+    for messages in profiles:
+        table = []
+        for message in messages:
+            key = tuple(message)
+            if key not in index:
+                index[key] = len(records)
+                records.append(message)
+            table.append(index[key])
+        tables.append(table)
+    return records, tables
+
+
+def write_header(names, texts, records, tables, output):
+    total = sum(len(table) for table in tables)
+    lines = []
+    lines.append("/* Generated by SetupProfiles.py from %s, %d setup messages in %d records"
+                 % (", ".join(names), total, len(records)))
+    lines.append(" * (%d bytes of hal_aci_data_t saved). To be used with ACI_SETUP_PROFILES. */"
+                 % ((total - len(records)) * 33))
+    lines.append("")
+    lines.append("#ifndef SETUP_PROFILES_H__")
+    lines.append("#define SETUP_PROFILES_H__")
+    lines.append("")
+    lines.append("#define SETUP_PROFILES_COUNT %d" % len(tables))
+    lines.append("#define SETUP_PROFILES_RECORD_COUNT %d" % len(records))
+    lines.append("")
+    lines.append("#define SETUP_PROFILES_RECORDS_CONTENT {\\")
+    for record in records:
+        lines.append("    {0x00, {" + ",".join("0x%02x" % b for b in record[:record[0] + 1]) + "}},\\")
+    lines.append("}")
+
+    for n, (name, text, table) in enumerate(zip(names, texts, tables)):
+        pipe_map = read_pipe_map(text)
+        lines.append("")
+        lines.append("/* Profile %d, from %s */" % (n, name))
+        for pipe, number in read_pipes(text):
+            lines.append("#define SETUP_PROFILE_%d_PIPE_%s %s" % (n, pipe, number))
+        lines.append("#define SETUP_PROFILE_%d_NUMBER_OF_PIPES %d" % (n, len(pipe_map)))
+        lines.append("#define SETUP_PROFILE_%d_PIPE_MAP_CONTENT {\\" % n)
+        for location, pipe_type in pipe_map:
+            lines.append("  {%s, %s},\\" % (location, pipe_type))
+        lines.append("}")
+        lines.append("#define SETUP_PROFILE_%d_MSG_COUNT %d" % (n, len(table)))
+        lines.append("#define SETUP_PROFILE_%d_TABLE(records) {\\" % n)
+        for i in range(0, len(table), 8):
+            lines.append("    " + " ".join("&records[%d]," % r for r in table[i:i + 8]) + "\\")
+        lines.append("}")
+
+    lines.append("")
+    lines.append("#endif")
+    output.write("\n".join(lines) + "\n")
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 4:
+        print("Usage: python SetupProfiles.py <output file> <services.h> <services.h> [...]")
+        sys.exit(1)
+    names = []
+    texts = []
+    for path in sys.argv[2:]:
+        with open(path) as services:
+            texts.append(services.read())
+        names.append(os.path.basename(path))
+    records, tables = merge([read_setup_messages(text) for text in texts])
+    with open(sys.argv[1], "w") as output:
+        write_header(names, texts, records, tables, output)
+    print("%d profiles, %d setup messages in %d records"
+          % (len(tables), sum(len(table) for table in tables), len(records)))
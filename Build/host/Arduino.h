@@ -0,0 +1,120 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/** @file
+ * @brief Mock of the Arduino core for the host build of the BLE library
+ *
+ * Only what the BLE library uses. The pins, the clock and the interrupts are driven by
+ * arduino_mock.cpp, see arduino_mock.h for the hooks used by the benchmarks.
+ */
+
+#ifndef ARDUINO_H__
+#define ARDUINO_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+typedef bool    boolean;
+typedef uint8_t byte;
+
+#define HIGH          1
+#define LOW           0
+
+#define INPUT         0
+#define OUTPUT        1
+#define INPUT_PULLUP  2
+
+#define CHANGE        1
+#define FALLING       2
+#define RISING        3
+
+//The SPI pins of the Arduino UNO
+#define MOSI          11
+#define MISO          12
+#define SCK           13
+
+#define DEC           10
+#define HEX           16
+
+//There is no flash on the host, the constants are read in place
+#define PROGMEM
+#define PSTR(s)                 (s)
+#define F(s)                    (s)
+#define pgm_read_byte(x)        (*(const uint8_t *)(x))
+#define pgm_read_byte_near(x)   (*(const uint8_t *)(x))
+#define pgm_read_word(x)        (*(const uint16_t *)(x))
+#define pgm_read_word_near(x)   (*(const uint16_t *)(x))
+#define memcpy_P                memcpy
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int  digitalRead(uint8_t pin);
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void attachInterrupt(uint8_t interrupt_number, void (*p_isr)(void), int mode);
+void detachInterrupt(uint8_t interrupt_number);
+void noInterrupts(void);
+void interrupts(void);
+
+class Print
+{
+public:
+  size_t print(const char *p_str);
+  size_t print(char value);
+  size_t print(unsigned char value, int base = DEC);
+  size_t print(int value, int base = DEC);
+  size_t print(unsigned int value, int base = DEC);
+  size_t print(long value, int base = DEC);
+  size_t print(unsigned long value, int base = DEC);
+  size_t println(const char *p_str);
+  size_t println(char value);
+  size_t println(unsigned char value, int base = DEC);
+  size_t println(int value, int base = DEC);
+  size_t println(unsigned int value, int base = DEC);
+  size_t println(long value, int base = DEC);
+  size_t println(unsigned long value, int base = DEC);
+  size_t println(void);
+  size_t write(uint8_t value);
+  size_t write(const uint8_t *p_buffer, size_t size);
+};
+
+class HardwareSerial : public Print
+{
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  int  available(void) { return 0; }
+  int  read(void) { return -1; }
+  operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif /* ARDUINO_H__ */
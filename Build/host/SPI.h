@@ -0,0 +1,74 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/** @file
+ * @brief Mock of the Arduino SPI library for the host build of the BLE library
+ *
+ * Every byte is handed to the SPI hook of arduino_mock.h, which answers for the nRF8001.
+ */
+
+#ifndef SPI_H__
+#define SPI_H__
+
+#include "Arduino.h"
+
+#define SPI_HAS_TRANSACTION 1
+
+#define LSBFIRST            0
+#define MSBFIRST            1
+#define SPI_MODE0           0x00
+
+#define SPI_CLOCK_DIV4      0x00
+#define SPI_CLOCK_DIV16     0x01
+#define SPI_CLOCK_DIV64     0x02
+#define SPI_CLOCK_DIV128    0x03
+#define SPI_CLOCK_DIV2      0x04
+#define SPI_CLOCK_DIV8      0x05
+#define SPI_CLOCK_DIV32     0x06
+
+class SPISettings
+{
+public:
+  SPISettings() {}
+  SPISettings(uint32_t clock_hz, uint8_t bit_order, uint8_t data_mode)
+  {
+    (void)clock_hz; (void)bit_order; (void)data_mode;
+  }
+};
+
+class SPIClass
+{
+public:
+  static void    begin(void) {}
+  static void    end(void) {}
+  static uint8_t transfer(uint8_t data);
+  static void    transfer(void *p_buffer, size_t count);
+  static void    setBitOrder(uint8_t bit_order) { (void)bit_order; }
+  static void    setClockDivider(uint8_t divider) { (void)divider; }
+  static void    setDataMode(uint8_t data_mode) { (void)data_mode; }
+  static void    beginTransaction(SPISettings settings) { (void)settings; }
+  static void    endTransaction(void) {}
+  static void    usingInterrupt(uint8_t interrupt_number) { (void)interrupt_number; }
+};
+
+extern SPIClass SPI;
+
+#endif /* SPI_H__ */
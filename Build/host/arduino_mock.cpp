@@ -0,0 +1,319 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/** @file
+ * @brief Mock of the Arduino core for the host build of the BLE library
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "Arduino.h"
+#include "SPI.h"
+#include "arduino_mock.h"
+#include "aci_bond_store.h"
+
+HardwareSerial Serial;
+SPIClass       SPI;
+
+uint32_t mock_spi_bytes;
+uint32_t mock_interrupts_disabled;
+uint32_t mock_eeprom_writes;
+
+static uint8_t         mock_pins[MOCK_PIN_COUNT];
+static void          (*mock_isr[MOCK_INTERRUPT_COUNT])(void);
+static int             mock_isr_mode[MOCK_INTERRUPT_COUNT];
+static uint8_t         mock_isr_pin[MOCK_INTERRUPT_COUNT];
+static bool            mock_isr_edge[MOCK_INTERRUPT_COUNT];
+static bool            mock_irq_enabled = true;
+static uint32_t        mock_time_us;
+static uint8_t         mock_eeprom[MOCK_EEPROM_SIZE];
+static mock_spi_hook_t mock_spi_hook;
+static mock_pin_hook_t mock_pin_hook;
+static mock_pin_read_hook_t mock_pin_read_hook;
+
+/*
+  Runs the handlers of the pin interrupts that are due, a LOW level one for as long as its
+  pin stays low and its handler stays attached.
+*/
+static void mock_interrupt_check(void)
+{
+  uint16_t guard = 1024;
+  bool     again = true;
+  uint8_t  i;
+
+  while (again && mock_irq_enabled && (0 != --guard))
+  {
+    again = false;
+    for (i = 0; i < MOCK_INTERRUPT_COUNT; i++)
+    {
+      if ((NULL == mock_isr[i]) || (0xFF == mock_isr_pin[i]))
+      {
+        continue;
+      }
+      if (((LOW == mock_isr_mode[i]) && (LOW == mock_pins[mock_isr_pin[i] % MOCK_PIN_COUNT])) ||
+          ((FALLING == mock_isr_mode[i]) && mock_isr_edge[i]))
+      {
+        mock_isr_edge[i] = false;
+        mock_interrupt_raise(i);
+        again = true;
+      }
+    }
+  }
+}
+
+void mock_reset(void)
+{
+  memset(mock_pins, HIGH, sizeof(mock_pins));
+  memset(mock_isr, 0, sizeof(mock_isr));
+  memset(mock_isr_pin, 0xFF, sizeof(mock_isr_pin));
+  memset(mock_isr_edge, 0, sizeof(mock_isr_edge));
+  mock_irq_enabled         = true;
+  mock_time_us             = 0;
+  mock_spi_hook            = NULL;
+  mock_pin_hook            = NULL;
+  mock_pin_read_hook       = NULL;
+  mock_spi_bytes           = 0;
+  mock_interrupts_disabled = 0;
+}
+
+void mock_spi_hook_set(mock_spi_hook_t hook)
+{
+  mock_spi_hook = hook;
+}
+
+void mock_pin_hook_set(mock_pin_hook_t hook)
+{
+  mock_pin_hook = hook;
+}
+
+void mock_pin_read_hook_set(mock_pin_read_hook_t hook)
+{
+  mock_pin_read_hook = hook;
+}
+
+void mock_pin_set(uint8_t pin, uint8_t level)
+{
+  const uint8_t previous = mock_pins[pin % MOCK_PIN_COUNT];
+  uint8_t       i;
+
+  mock_pins[pin % MOCK_PIN_COUNT] = level;
+  for (i = 0; i < MOCK_INTERRUPT_COUNT; i++)
+  {
+    if ((mock_isr_pin[i] == pin) && (HIGH == previous) && (LOW == level))
+    {
+      mock_isr_edge[i] = true;
+    }
+  }
+  mock_interrupt_check();
+}
+
+void mock_interrupt_pin_set(uint8_t interrupt_number, uint8_t pin)
+{
+  if (interrupt_number < MOCK_INTERRUPT_COUNT)
+  {
+    mock_isr_pin[interrupt_number] = pin;
+  }
+}
+
+bool mock_interrupts_are_enabled(void)
+{
+  return mock_irq_enabled;
+}
+
+uint8_t mock_pin_get(uint8_t pin)
+{
+  return mock_pins[pin % MOCK_PIN_COUNT];
+}
+
+bool mock_interrupt_raise(uint8_t interrupt_number)
+{
+  if ((interrupt_number >= MOCK_INTERRUPT_COUNT) || (NULL == mock_isr[interrupt_number]) || !mock_irq_enabled)
+  {
+    return false;
+  }
+  mock_irq_enabled = false;
+  mock_isr[interrupt_number]();
+  mock_irq_enabled = true;
+  return true;
+}
+
+void mock_time_advance_us(uint32_t us)
+{
+  mock_time_us += us;
+}
+
+uint32_t mock_time_now_us(void)
+{
+  return mock_time_us;
+}
+
+void mock_eeprom_erase(void)
+{
+  memset(mock_eeprom, 0xFF, sizeof(mock_eeprom));
+  mock_eeprom_writes = 0;
+}
+
+uint8_t *mock_eeprom_byte(uint16_t address)
+{
+  return &mock_eeprom[address % MOCK_EEPROM_SIZE];
+}
+
+/*
+  The EEPROM of aci_bond_store.cpp
+*/
+uint8_t aci_bond_store_nv_read(uint16_t address)
+{
+  return mock_eeprom[address % MOCK_EEPROM_SIZE];
+}
+
+void aci_bond_store_nv_write(uint16_t address, uint8_t value)
+{
+  mock_eeprom[address % MOCK_EEPROM_SIZE] = value;
+  mock_eeprom_writes++;
+  mock_time_us += MOCK_EEPROM_WRITE_US;
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  if (INPUT_PULLUP == mode)
+  {
+    mock_pins[pin % MOCK_PIN_COUNT] = HIGH;
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t level)
+{
+  mock_pins[pin % MOCK_PIN_COUNT] = level;
+  if (NULL != mock_pin_hook)
+  {
+    mock_pin_hook(pin, level);
+  }
+}
+
+int digitalRead(uint8_t pin)
+{
+  const uint8_t level = mock_pins[pin % MOCK_PIN_COUNT];
+
+  if (NULL != mock_pin_read_hook)
+  {
+    mock_pin_read_hook(pin);
+  }
+  return level;
+}
+
+unsigned long millis(void)
+{
+  return ++mock_time_us / 1000;
+}
+
+unsigned long micros(void)
+{
+  return ++mock_time_us;
+}
+
+void delay(unsigned long ms)
+{
+  mock_time_us += ms * 1000;
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  mock_time_us += us;
+}
+
+void attachInterrupt(uint8_t interrupt_number, void (*p_isr)(void), int mode)
+{
+  if (interrupt_number < MOCK_INTERRUPT_COUNT)
+  {
+    mock_isr[interrupt_number]      = p_isr;
+    mock_isr_mode[interrupt_number] = mode;
+    mock_isr_edge[interrupt_number] = false;
+    mock_interrupt_check();
+  }
+}
+
+void detachInterrupt(uint8_t interrupt_number)
+{
+  if (interrupt_number < MOCK_INTERRUPT_COUNT)
+  {
+    mock_isr[interrupt_number] = NULL;
+  }
+}
+
+void noInterrupts(void)
+{
+  mock_interrupts_disabled++;
+  mock_irq_enabled = false;
+}
+
+void interrupts(void)
+{
+  mock_irq_enabled = true;
+  mock_interrupt_check();
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+  mock_spi_bytes++;
+  return (NULL != mock_spi_hook) ? mock_spi_hook(data) : 0;
+}
+
+void SPIClass::transfer(void *p_buffer, size_t count)
+{
+  uint8_t *p_data = (uint8_t *)p_buffer;
+
+  while (count--)
+  {
+    *p_data = transfer(*p_data);
+    p_data++;
+  }
+}
+
+static size_t mock_print_number(unsigned long value, int base)
+{
+  return (size_t)printf((HEX == base) ? "%lX" : "%lu", value);
+}
+
+size_t Print::print(const char *p_str)               { return (size_t)printf("%s", p_str); }
+size_t Print::print(char value)                      { return (size_t)printf("%c", value); }
+size_t Print::print(unsigned char value, int base)   { return mock_print_number(value, base); }
+size_t Print::print(unsigned int value, int base)    { return mock_print_number(value, base); }
+size_t Print::print(unsigned long value, int base)   { return mock_print_number(value, base); }
+size_t Print::print(int value, int base)             { return (DEC == base) ? (size_t)printf("%d", value) : mock_print_number((unsigned int)value, base); }
+size_t Print::print(long value, int base)            { return (DEC == base) ? (size_t)printf("%ld", value) : mock_print_number((unsigned long)value, base); }
+size_t Print::println(void)                          { return (size_t)printf("\n"); }
+size_t Print::println(const char *p_str)             { return print(p_str) + println(); }
+size_t Print::println(char value)                    { return print(value) + println(); }
+size_t Print::println(unsigned char value, int base) { return print(value, base) + println(); }
+size_t Print::println(int value, int base)           { return print(value, base) + println(); }
+size_t Print::println(unsigned int value, int base)  { return print(value, base) + println(); }
+size_t Print::println(long value, int base)          { return print(value, base) + println(); }
+size_t Print::println(unsigned long value, int base) { return print(value, base) + println(); }
+size_t Print::write(uint8_t value)                   { return fwrite(&value, 1, 1, stdout); }
+size_t Print::write(const uint8_t *p_buffer, size_t size) { return fwrite(p_buffer, 1, size, stdout); }
+
+/* Defined by the sketches on the board */
+void __ble_assert(const char *file, uint16_t line)
+{
+  fprintf(stderr, "ble_assert: %s:%u\n", file, line);
+  abort();
+}
@@ -0,0 +1,103 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/** @file
+ * @brief Hooks of the mock Arduino core used by the host build of the BLE library
+ *
+ * The mock has a virtual clock: it moves on with delay(), delayMicroseconds(),
+ * mock_time_advance_us() and by one microsecond on every millis() or micros() call, so busy
+ * waits on the clock end and a run is the same every time.
+ */
+
+#ifndef ARDUINO_MOCK_H__
+#define ARDUINO_MOCK_H__
+
+#include "Arduino.h"
+
+#define MOCK_PIN_COUNT        64
+#define MOCK_INTERRUPT_COUNT  8
+#define MOCK_EEPROM_SIZE      1024
+#define MOCK_EEPROM_WRITE_US  3300   // An EEPROM byte write of the ATmega328
+
+/** Answers one SPI byte, mosi is the byte clocked out by the library */
+typedef uint8_t (*mock_spi_hook_t)(uint8_t mosi);
+
+/** Called on every digitalWrite() */
+typedef void (*mock_pin_hook_t)(uint8_t pin, uint8_t level);
+
+/** Called on every digitalRead(), after the level has been read */
+typedef void (*mock_pin_read_hook_t)(uint8_t pin);
+
+/** @brief Sets the SPI hook, NULL answers 0 to every byte */
+void mock_spi_hook_set(mock_spi_hook_t hook);
+
+/** @brief Sets the digitalWrite() hook, NULL for none */
+void mock_pin_hook_set(mock_pin_hook_t hook);
+
+/** @brief Sets the digitalRead() hook, NULL for none */
+void mock_pin_read_hook_set(mock_pin_read_hook_t hook);
+
+/** @brief Drives an input pin, e.g. RDYN, as seen by digitalRead()
+ *  @details The handler attached to an interrupt of the pin is run as the interrupt mode
+ *  says, as soon as the interrupts are enabled.
+ */
+void mock_pin_set(uint8_t pin, uint8_t level);
+
+/** @brief Level last written to or driven on the pin */
+uint8_t mock_pin_get(uint8_t pin);
+
+/** @brief Connects an interrupt to a pin driven with mock_pin_set(), LOW and FALLING are modelled */
+void mock_interrupt_pin_set(uint8_t interrupt_number, uint8_t pin);
+
+/** @brief Runs the handler attached to the interrupt, unless the interrupts are disabled
+ *  @return True if a handler was run.
+ */
+bool mock_interrupt_raise(uint8_t interrupt_number);
+
+/** @brief False between noInterrupts() and interrupts(), and in the handlers */
+bool mock_interrupts_are_enabled(void);
+
+/** @brief Moves the virtual clock on */
+void mock_time_advance_us(uint32_t us);
+
+/** @brief Reads the virtual clock without moving it on */
+uint32_t mock_time_now_us(void);
+
+/** @brief Erases the mock EEPROM to 0xFF, it is kept through mock_reset() as through a power cycle */
+void mock_eeprom_erase(void);
+
+/** @brief Byte of the mock EEPROM, to corrupt a record as a reset in the middle of a write would */
+uint8_t *mock_eeprom_byte(uint16_t address);
+
+/** @brief Resets the pins, hooks, handlers and the clock */
+void mock_reset(void);
+
+/** @brief Number of SPI bytes clocked since the last mock_reset() */
+extern uint32_t mock_spi_bytes;
+
+/** @brief Number of EEPROM bytes written, each moves the clock on by MOCK_EEPROM_WRITE_US */
+extern uint32_t mock_eeprom_writes;
+
+/** @brief Number of noInterrupts() calls since the last mock_reset() */
+extern uint32_t mock_interrupts_disabled;
+
+#endif /* ARDUINO_MOCK_H__ */
@@ -0,0 +1,315 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/** @file
+ * @brief Micro-benchmarks of the ACI core on the host
+ *
+ * Reports the time per operation and the bytes the operation moves through memory: the
+ * encoded command, the decoded event, the queue copies and the SPI bytes of an event.
+ * The numbers are for comparing two builds on the same machine, not for the boards.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "arduino_mock.h"
+#include "SPI.h"
+#include "hal_platform.h"
+#include "aci.h"
+#include "aci_cmds.h"
+#include "aci_evts.h"
+#include "aci_protocol_defines.h"
+#include "acilib_defs.h"
+#include "acilib_if.h"
+#include "aci_queue.h"
+#include "hal_aci_tl.h"
+#include "lib_aci.h"
+#include "aci_crc.h"
+
+#define BENCH_RUNS        200000UL
+
+#define BENCH_REQN_PIN    9
+#define BENCH_RDYN_PIN    8
+
+static volatile uint8_t bench_sink;
+
+static uint64_t bench_now_ns(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec;
+}
+
+static void bench_report(const char *p_name, uint64_t start_ns, unsigned long runs, unsigned long bytes_per_op)
+{
+  const double ns_per_op = (double)(bench_now_ns() - start_ns) / (double)runs;
+
+  printf("%-28s %10.1f ns/op %6lu bytes/op\n", p_name, ns_per_op, bytes_per_op);
+}
+
+/*
+  Encoding of a full 20 byte SendData and of a ChangeTiming.
+*/
+static void bench_encode(void)
+{
+  static const uint8_t           data[ACI_PIPE_TX_DATA_MAX_LEN] = { 0 };
+  aci_cmd_params_change_timing_t timing;
+  hal_aci_data_t                 msg;
+  unsigned long                  i;
+  uint64_t                       start;
+
+  start = bench_now_ns();
+  for (i = 0; i < BENCH_RUNS; i++)
+  {
+    acil_encode_cmd_send_data_raw(&msg.buffer[0], (uint8_t)(i & 0x1F), data, sizeof(data));
+    bench_sink = msg.buffer[2];
+  }
+  bench_report("encode send_data", start, BENCH_RUNS, msg.buffer[0] + 1);
+
+  timing.conn_params.min_conn_interval = 11;
+  timing.conn_params.max_conn_interval = 18;
+  timing.conn_params.slave_latency     = 0;
+  timing.conn_params.timeout_mult      = 600;
+  start = bench_now_ns();
+  for (i = 0; i < BENCH_RUNS; i++)
+  {
+    timing.conn_params.slave_latency = (uint16_t)i;
+    acil_encode_cmd_change_timing_req(&msg.buffer[0], &timing);
+    bench_sink = msg.buffer[6];
+  }
+  bench_report("encode change_timing", start, BENCH_RUNS, msg.buffer[0] + 1);
+}
+
+/*
+  Full decode of a DataReceived event against validating it and reading a field in place.
+*/
+static void bench_decode(void)
+{
+  uint8_t       evt[ACI_PACKET_MAX_LEN] = { 2 + ACI_PIPE_RX_DATA_MAX_LEN, ACI_EVT_DATA_RECEIVED, 5 };
+  aci_evt_t     decoded;
+  unsigned long i;
+  uint64_t      start;
+
+  start = bench_now_ns();
+  for (i = 0; i < BENCH_RUNS; i++)
+  {
+    evt[3] = (uint8_t)i;
+    bench_sink = acil_decode_evt(evt, &decoded);
+    bench_sink = decoded.params.data_received.rx_data.aci_data[0];
+  }
+  bench_report("decode data_received", start, BENCH_RUNS, evt[0] + 1);
+
+  start = bench_now_ns();
+  for (i = 0; i < BENCH_RUNS; i++)
+  {
+    evt[3] = (uint8_t)i;
+    if (acil_evt_is_valid(evt))
+    {
+      bench_sink = ACIL_EVT_PARAM_U8(evt, OFFSET_ACI_EVT_PARAMS_DATA_RECEIVED_T_RX_DATA + 1);
+    }
+  }
+  bench_report("validate+read data_received", start, BENCH_RUNS, 0);
+}
+
+/*
+  Copying queue accessors against the in-place ones, one 20 byte SendData per operation.
+*/
+static void bench_queue(void)
+{
+  uint8_t         storage[ACI_TX_QUEUE_BYTES];
+  aci_queue_t     queue;
+  hal_aci_data_t  msg;
+  hal_aci_data_t *p_slot;
+  unsigned long   i;
+  uint64_t        start;
+  static const uint8_t data[ACI_PIPE_TX_DATA_MAX_LEN] = { 0 };
+
+  aci_queue_init(&queue, storage, sizeof(storage));
+  msg.status_byte = 0;
+  acil_encode_cmd_send_data_raw(&msg.buffer[0], 1, data, sizeof(data));
+
+  start = bench_now_ns();
+  for (i = 0; i < BENCH_RUNS; i++)
+  {
+    msg.buffer[2] = (uint8_t)i;
+    aci_queue_enqueue(&queue, &msg);
+    aci_queue_dequeue(&queue, &msg);
+  }
+  bench_report("queue enqueue+dequeue", start, BENCH_RUNS, 2 * (msg.buffer[0] + 2));
+
+  start = bench_now_ns();
+  for (i = 0; i < BENCH_RUNS; i++)
+  {
+    p_slot = aci_queue_reserve(&queue);
+    acil_encode_cmd_send_data_raw(&p_slot->buffer[0], 1, data, sizeof(data));
+    aci_queue_commit(&queue);
+    bench_sink = aci_queue_peek_ptr(&queue)->buffer[2];
+    aci_queue_consume(&queue);
+  }
+  bench_report("queue encode in place", start, BENCH_RUNS, msg.buffer[0] + 1);
+}
+
+/*
+  The nRF8001 side of the event benchmark: RDYN stays low and every transfer clocks out the
+  same DataReceived event.
+*/
+static const uint8_t bench_evt_frame[] = { 0x00, 2 + ACI_PIPE_RX_DATA_MAX_LEN, ACI_EVT_DATA_RECEIVED, 5 };
+static uint8_t       bench_evt_index;
+static unsigned long bench_handled;
+
+static void bench_pin_hook(uint8_t pin, uint8_t level)
+{
+  if ((BENCH_REQN_PIN == pin) && (LOW == level))
+  {
+    bench_evt_index = 0;
+  }
+}
+
+static uint8_t bench_spi_hook(uint8_t mosi)
+{
+  (void)mosi;
+  return (bench_evt_index < sizeof(bench_evt_frame)) ? bench_evt_frame[bench_evt_index++] : 0;
+}
+
+static void bench_on_data(aci_state_t *aci_stat, const aci_evt_t *p_evt)
+{
+  (void)aci_stat;
+  bench_sink = p_evt->params.data_received.rx_data.pipe_number;
+  bench_handled++;
+}
+
+static const lib_aci_evt_handler_t bench_evt_handlers[LIB_ACI_EVT_HANDLER_COUNT] PROGMEM =
+{
+  NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+  bench_on_data /* ACI_EVT_DATA_RECEIVED */, NULL, NULL, NULL
+};
+
+/*
+  An event clocked in over the mock SPI, queued, taken with lib_aci_event_get() and given to
+  its handler.
+*/
+static void bench_event_dispatch(void)
+{
+  static aci_state_t aci_state;
+  hal_aci_evt_t      aci_data;
+  unsigned long      i;
+  unsigned long      spi_bytes;
+  uint64_t           start;
+
+  mock_reset();
+  memset(&aci_state, 0, sizeof(aci_state));
+  aci_state.aci_pins.board_name             = BOARD_DEFAULT;
+  aci_state.aci_pins.reqn_pin               = BENCH_REQN_PIN;
+  aci_state.aci_pins.rdyn_pin               = BENCH_RDYN_PIN;
+  aci_state.aci_pins.mosi_pin               = MOSI;
+  aci_state.aci_pins.miso_pin               = MISO;
+  aci_state.aci_pins.sck_pin                = SCK;
+  aci_state.aci_pins.spi_clock_divider      = SPI_CLOCK_DIV8;
+  aci_state.aci_pins.reset_pin              = UNUSED;
+  aci_state.aci_pins.active_pin             = UNUSED;
+  aci_state.aci_pins.optional_chip_sel_pin  = UNUSED;
+  aci_state.aci_pins.interface_is_interrupt = false;
+  aci_state.aci_pins.interrupt_number       = 1;
+  lib_aci_init(&aci_state, false);
+
+  mock_pin_hook_set(bench_pin_hook);
+  mock_spi_hook_set(bench_spi_hook);
+  mock_pin_set(BENCH_RDYN_PIN, LOW);
+#if LIB_ACI_DISPATCH
+  lib_aci_dispatch_set(&aci_state, bench_evt_handlers, NULL, 0);
+#endif
+
+  bench_handled = 0;
+  spi_bytes     = mock_spi_bytes;
+  start = bench_now_ns();
+  for (i = 0; i < BENCH_RUNS; i++)
+  {
+    lib_aci_event_get(&aci_state, &aci_data);
+  }
+  bench_report("event get+dispatch", start, BENCH_RUNS,
+               ((mock_spi_bytes - spi_bytes) / BENCH_RUNS) + 2 * (bench_evt_frame[1] + 2));
+  if (bench_handled != BENCH_RUNS)
+  {
+    printf("  %lu of %lu events reached the handler\n", bench_handled, BENCH_RUNS);
+  }
+}
+
+/*
+  CRC of 512 bytes, about the size of a setup, from RAM and from program memory.
+*/
+static void bench_crc(void)
+{
+  static uint8_t data[512];
+  unsigned long  i;
+  uint64_t       start;
+
+  for (i = 0; i < sizeof(data); i++)
+  {
+    data[i] = (uint8_t)(i * 7);
+  }
+
+  start = bench_now_ns();
+  for (i = 0; i < BENCH_RUNS / 100; i++)
+  {
+    data[0] = (uint8_t)i;
+    bench_sink = (uint8_t)aci_crc16_ccitt(ACI_CRC16_CCITT_INIT, data, sizeof(data));
+  }
+  bench_report("crc16 ram", start, BENCH_RUNS / 100, sizeof(data));
+
+  start = bench_now_ns();
+  for (i = 0; i < BENCH_RUNS / 100; i++)
+  {
+    data[0] = (uint8_t)i;
+    bench_sink = (uint8_t)aci_crc16_ccitt_P(ACI_CRC16_CCITT_INIT, data, sizeof(data));
+  }
+  bench_report("crc16 progmem", start, BENCH_RUNS / 100, sizeof(data));
+}
+
+/*
+  Static RAM of the library as built, for a setup with 8 pipes. The sizes are the host ones,
+  pointers and enums make them larger than on the boards but the saving of ACI_LOW_MEMORY
+  in the queues and buffers is the same.
+*/
+static void bench_ram(void)
+{
+  aci_state_t   aci_state;
+  lib_aci_ram_t ram;
+
+  aci_state.aci_setup_info.number_of_pipes = 8;
+  lib_aci_ram_get(&aci_state, &ram);
+
+  printf("ram transport %u library %u setup %u state %u pipe map %u total %u bytes, %u saved\n",
+         ram.transport, ram.library, ram.setup, ram.state, ram.pipe_map, ram.total, ram.saved);
+}
+
+int main(void)
+{
+  mock_reset();
+
+  bench_encode();
+  bench_decode();
+  bench_queue();
+  bench_event_dispatch();
+  bench_crc();
+  bench_ram();
+  return 0;
+}
@@ -0,0 +1,303 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+ 
+/** @file
+ * @brief Packing of the heart rate samples with aci_aggregator against the nRF8001 model
+ *
+ * ble_heart_rate_template takes a 2 byte sample every so many milliseconds, numbered from 0, and
+ * sends it on the heart rate measurement pipe. The loop of the template sends each sample in its
+ * own SendData when there is a credit and loses it otherwise. aci_aggregator packs the samples
+ * with their timestamp, 5 records in a packet, and sends the packet when it is full or when its
+ * oldest record is deadline_ms old. Sampled faster than the credits come back, lib_aci_send_data()
+ * fails, the full packet is kept and sent again by the next sample, and the samples that find no
+ * room are lost.
+ *
+ * The peer checks that the samples taken arrive, once each and in order, and measures the records
+ * per packet and the age of the oldest record of a packet when it is sent to the peer.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "arduino_mock.h"
+#include "SPI.h"
+#include "hal_platform.h"
+#include "lib_aci.h"
+#include "aci_aggregator.h"
+#include "nrf8001_model.h"
+#include "../../libraries/BLE/examples/ble_heart_rate_template/services.h"
+
+#define EMU_LOOP_US       20          // Time taken by one pass of loop() outside the library
+#define EMU_TIMEOUT_US    10000000UL  // Connecting that takes longer stops there
+#define EMU_INTERVAL      40          // Connection interval, 50 ms
+#define EMU_SAMPLES_US    2000000UL   // Sampling time of a run
+#define EMU_DRAIN_US      500000UL    // Time after the sampling for the last packets
+#define EMU_SAMPLE_LEN    2
+#define EMU_SAMPLES_MAX   1000
+#define EMU_PIPE          PIPE_HEART_RATE_HEART_RATE_MEASUREMENT_TX
+
+static services_pipe_type_mapping_t services_pipe_type_mapping[NUMBER_OF_PIPES] = SERVICES_PIPE_TYPE_MAPPING_CONTENT;
+static const hal_aci_data_t setup_msgs[NB_SETUP_MESSAGES] PROGMEM = SETUP_MESSAGES_CONTENT;
+
+static aci_state_t      aci_state;
+static hal_aci_evt_t    aci_data;
+static aci_aggregator_t aggregator;
+static bool             emu_failed;  // A run printed FAILED, main() returns 1
+
+typedef struct
+{
+  const char *name;
+  bool        legacy;            // The loop of the template, one sample per SendData
+  uint16_t    sample_ms;         // Between the samples
+  uint16_t    deadline_ms;
+} emu_config_t;
+
+/* The sensor */
+static struct
+{
+  uint16_t samples;              // Taken
+  uint16_t lost;                 // Not sent or refused by aci_aggregator_add()
+  bool     accepted[EMU_SAMPLES_MAX];
+  uint32_t next_us;
+  bool     held;                 // A full packet is waiting for a credit
+  uint16_t failed_sends;         // Full packets that lib_aci_send_data() did not take
+} sensor;
+
+/* The peer */
+static struct
+{
+  bool     in_order;
+  uint16_t samples;
+  int32_t  last;                 // Last sample number, -1 for none
+  uint16_t packets;
+  uint16_t records_max;
+  uint16_t age_max_ms;
+} peer;
+
+static void emu_peer_read(uint8_t pipe, const uint8_t *p_data, uint8_t length)
+{
+  const uint8_t record = EMU_SAMPLE_LEN + ACI_AGGREGATOR_TIMESTAMP_LEN;
+  const bool    legacy = (EMU_SAMPLE_LEN == length);
+  uint16_t      age_ms;
+  uint16_t      number;
+  uint8_t       i;
+
+  if (EMU_PIPE != pipe)
+  {
+    return;
+  }
+  if (!legacy)
+  {
+    if ((0 == length) || (0 != (length % record)))
+    {
+      peer.in_order = false;
+      return;
+    }
+    age_ms = (uint16_t)(millis() - (p_data[0] | (p_data[1] << 8)));
+    if (age_ms > peer.age_max_ms)
+    {
+      peer.age_max_ms = age_ms;
+    }
+    if ((length / record) > peer.records_max)
+    {
+      peer.records_max = length / record;
+    }
+  }
+  peer.packets++;
+
+  if (legacy)
+  {
+    peer.records_max = 1;
+  }
+  for (i = 0; i < length; i += legacy ? EMU_SAMPLE_LEN : record)
+  {
+    number = legacy ? (uint16_t)(p_data[i] | (p_data[i + 1] << 8)) :
+                      (uint16_t)(p_data[i + 2] | (p_data[i + 3] << 8));
+    // The samples lost in between must be the ones not taken
+    while ((int32_t)number > ++peer.last)
+    {
+      if ((peer.last >= EMU_SAMPLES_MAX) || sensor.accepted[peer.last])
+      {
+        peer.in_order = false;
+      }
+    }
+    if (((int32_t)number != peer.last) || (number >= EMU_SAMPLES_MAX) || !sensor.accepted[number])
+    {
+      peer.in_order = false;
+      return;
+    }
+    peer.samples++;
+  }
+}
+
+static void emu_aci_loop(void)
+{
+  aci_evt_t *aci_evt;
+
+  if (lib_aci_event_get(&aci_state, &aci_data))
+  {
+    aci_evt = &aci_data.evt;
+    if ((ACI_EVT_DEVICE_STARTED == aci_evt->evt_opcode) &&
+        (ACI_DEVICE_STANDBY == aci_evt->params.device_started.device_mode))
+    {
+      aci_state.data_credit_total = aci_evt->params.device_started.credit_available;
+      lib_aci_connect(180, 0x0050);
+    }
+  }
+}
+
+/* True when the packet is full and was not sent */
+static bool emu_is_held(void)
+{
+  return ((aggregator.length + aggregator.record_size) > ACI_PIPE_TX_DATA_MAX_LEN);
+}
+
+static void emu_sample(const emu_config_t *p_config, bool sampling)
+{
+  uint8_t sample[EMU_SAMPLE_LEN];
+  bool    taken;
+
+  if (sampling && (sensor.samples < EMU_SAMPLES_MAX) && ((int32_t)(mock_time_now_us() - sensor.next_us) >= 0))
+  {
+    sample[0] = (uint8_t)sensor.samples;
+    sample[1] = (uint8_t)(sensor.samples >> 8);
+    if (p_config->legacy)
+    {
+      taken = (aci_state.data_credit_available > 0) && lib_aci_send_data(EMU_PIPE, &sample[0], EMU_SAMPLE_LEN);
+    }
+    else
+    {
+      taken = aci_aggregator_add(&aggregator, &aci_state, &sample[0]);
+    }
+    sensor.accepted[sensor.samples] = taken;
+    if (!taken)
+    {
+      sensor.lost++;
+    }
+    sensor.samples++;
+    sensor.next_us += p_config->sample_ms * 1000UL;
+  }
+
+  if (!p_config->legacy)
+  {
+    aci_aggregator_poll(&aggregator, &aci_state);
+    // A full packet left after adding is one lib_aci_send_data() refused
+    if (emu_is_held() && !sensor.held)
+    {
+      sensor.failed_sends++;
+    }
+    sensor.held = emu_is_held();
+  }
+}
+
+static void emu_run(const nrf8001_model_config_t *p_model, const emu_config_t *p_config)
+{
+  const uint16_t        records_full = ACI_PIPE_TX_DATA_MAX_LEN / (EMU_SAMPLE_LEN + ACI_AGGREGATOR_TIMESTAMP_LEN);
+  uint32_t              start_us;
+  char                  age[8];
+  bool                  ok;
+
+  mock_reset();
+  nrf8001_model_init(p_model);
+  nrf8001_model_peer_read_set(emu_peer_read);
+  nrf8001_model_aci_state_fill(&aci_state, p_model, &services_pipe_type_mapping[0], NUMBER_OF_PIPES,
+                               setup_msgs, NB_SETUP_MESSAGES);
+  aci_aggregator_init(&aggregator, EMU_PIPE, EMU_SAMPLE_LEN, true, p_config->deadline_ms);
+  memset(&sensor, 0, sizeof(sensor));
+  memset(&peer, 0, sizeof(peer));
+  peer.in_order = true;
+  peer.last     = -1;
+
+  lib_aci_init(&aci_state, false);
+  while (!(nrf8001_model_is_connected() && lib_aci_is_pipe_available(&aci_state, EMU_PIPE)) &&
+         (mock_time_now_us() < EMU_TIMEOUT_US))
+  {
+    nrf8001_model_run();
+    emu_aci_loop();
+    mock_time_advance_us(EMU_LOOP_US);
+  }
+
+  start_us       = mock_time_now_us();
+  sensor.next_us = start_us;
+  while ((mock_time_now_us() - start_us) < (EMU_SAMPLES_US + EMU_DRAIN_US))
+  {
+    nrf8001_model_run();
+    emu_aci_loop();
+    emu_sample(p_config, (mock_time_now_us() - start_us) < EMU_SAMPLES_US);
+    mock_time_advance_us(EMU_LOOP_US);
+  }
+
+  /*
+    Every sample taken is at the peer. The aggregator fills its packets when the samples come
+    faster than the deadline, and sends a packet no later than a connection interval after it.
+  */
+  ok = peer.in_order && (peer.samples == (sensor.samples - sensor.lost));
+  if (!p_config->legacy)
+  {
+    const uint32_t per_deadline = p_config->deadline_ms / p_config->sample_ms;
+
+    ok = ok && (peer.records_max == ((per_deadline >= records_full) ? records_full : per_deadline + 1)) &&
+         (peer.age_max_ms <= (p_config->deadline_ms + p_model->conn_interval * 5 / 4 + 1)) &&
+         ((0 != sensor.lost) == (0 != sensor.failed_sends));
+  }
+
+  if (p_config->legacy)
+  {
+    snprintf(age, sizeof(age), "%6s", "-");
+  }
+  else
+  {
+    snprintf(age, sizeof(age), "%6u", peer.age_max_ms);
+  }
+  emu_failed = emu_failed || !ok;
+  printf("  %-10s %5u %5u %5u %5u %7.2f %7u %s %6u %s\n",
+         p_config->name, p_config->sample_ms, sensor.samples, peer.samples, sensor.lost,
+         (0 != peer.packets) ? (double)peer.samples / peer.packets : 0.0, peer.records_max,
+         age, sensor.failed_sends, ok ? "ok" : "FAILED");
+}
+
+int main(void)
+{
+  static const emu_config_t configs[] =
+  {
+    { "legacy",    true,  10,   0 },
+    { "agg",       false, 10, 100 },
+    { "agg slow",  false, 40, 100 },
+    { "agg fast",  false,  3, 100 },
+  };
+  nrf8001_model_config_t model;
+  uint8_t                i;
+
+  nrf8001_model_config_default(&model);
+  model.setup_done    = true;
+  model.reset_pin     = 4;
+  model.conn_interval = EMU_INTERVAL;
+
+  printf("%u byte samples for %lu s, %.2f ms connection interval, %u credits\n",
+         EMU_SAMPLE_LEN, EMU_SAMPLES_US / 1000000, model.conn_interval * 1.25, model.credits);
+  printf("  run        every taken  sent  lost per pkt records age ms failed\n");
+  for (i = 0; i < sizeof(configs) / sizeof(configs[0]); i++)
+  {
+    emu_run(&model, &configs[i]);
+  }
+  return emu_failed ? 1 : 0;
+}
@@ -0,0 +1,351 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+ * @brief EEPROM writes of the bond store against the nRF8001 model
+ *
+ * Reads the dynamic data out of the nRF8001 model as the examples do on a disconnect, stores it
+ * with aci_bond_store and gives it back to the model after a power cycle. Prints the EEPROM bytes
+ * written and the time taken by each step, on the virtual clock where an EEPROM byte write takes
+ * MOCK_EEPROM_WRITE_US. A second peer is then bonded and each peer finds its own bond.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "arduino_mock.h"
+#include "SPI.h"
+#include "hal_platform.h"
+#include "lib_aci.h"
+#include "aci_bond_store.h"
+#include "nrf8001_model.h"
+#include "../../libraries/BLE/examples/ble_bandwidth_test/services.h"
+
+#define EMU_LOOP_US     20          // Time taken by one pass of loop() outside the library
+#define EMU_TIMEOUT_US  2000000UL   // A step that takes longer fails
+
+static services_pipe_type_mapping_t services_pipe_type_mapping[NUMBER_OF_PIPES] = SERVICES_PIPE_TYPE_MAPPING_CONTENT;
+static const hal_aci_data_t setup_msgs[NB_SETUP_MESSAGES] PROGMEM = SETUP_MESSAGES_CONTENT;
+
+static const uint8_t peer_a[BTLE_DEVICE_ADDRESS_SIZE] = {0x11, 0x22, 0x33, 0x44, 0x55, 0xC6};
+static const uint8_t peer_b[BTLE_DEVICE_ADDRESS_SIZE] = {0xA1, 0xB2, 0xC3, 0xD4, 0xE5, 0xC6};
+
+static uint32_t       emu_ready_us;   // End of the last save, before its EEPROM commit
+
+static aci_state_t    aci_state;
+static hal_aci_evt_t  aci_data;
+static hal_aci_data_t aci_cmd;
+static bool           emu_failed;  // A run printed FAILED, main() returns 1
+
+/*
+  Powers the MCU and the model on and runs until the nRF8001 is in Standby. The EEPROM is kept.
+*/
+static bool emu_power_on(const nrf8001_model_config_t *p_model)
+{
+  uint32_t start_us;
+
+  mock_reset();
+  start_us     = mock_time_now_us();
+  emu_ready_us = 0;
+  nrf8001_model_init(p_model);
+
+  nrf8001_model_aci_state_fill(&aci_state, p_model, &services_pipe_type_mapping[0], NUMBER_OF_PIPES,
+                               setup_msgs, NB_SETUP_MESSAGES);
+
+  lib_aci_init(&aci_state, false);
+  aci_bond_store_init();
+
+  while ((mock_time_now_us() - start_us) < EMU_TIMEOUT_US)
+  {
+    nrf8001_model_run();
+    if (lib_aci_event_get(&aci_state, &aci_data) &&
+        (ACI_EVT_DEVICE_STARTED == aci_data.evt.evt_opcode) &&
+        (ACI_DEVICE_STANDBY == aci_data.evt.params.device_started.device_mode))
+    {
+      return true;
+    }
+    mock_time_advance_us(EMU_LOOP_US);
+  }
+  return false;
+}
+
+/*
+  Waits for the command response of a dynamic data command.
+*/
+static aci_evt_t *emu_cmd_rsp_wait(void)
+{
+  const uint32_t start_us = mock_time_now_us();
+
+  while ((mock_time_now_us() - start_us) < EMU_TIMEOUT_US)
+  {
+    nrf8001_model_run();
+    if (lib_aci_event_get(&aci_state, &aci_data))
+    {
+      return (ACI_EVT_CMD_RSP == aci_data.evt.evt_opcode) ? &aci_data.evt : NULL;
+    }
+    mock_time_advance_us(EMU_LOOP_US);
+  }
+  return NULL;
+}
+
+/*
+  Runs aci_bond_store_commit_poll() from the loop until the record is in the EEPROM.
+*/
+static void emu_bond_commit(void)
+{
+  while (aci_bond_store_commit_poll())
+  {
+    mock_time_advance_us(EMU_LOOP_US);
+  }
+}
+
+/*
+  bond_data_read_store() of the examples, into the bond selected, then the commit from the loop.
+  emu_ready_us is the time the example can advertise again.
+*/
+static bool emu_bond_save(const uint8_t *p_peer_address)
+{
+  aci_evt_t *aci_evt;
+  bool       ok = false;
+
+  aci_bond_store_save_start();
+  aci_bond_store_save_peer(p_peer_address);
+  lib_aci_read_dynamic_data();
+  while (NULL != (aci_evt = emu_cmd_rsp_wait()))
+  {
+    if (ACI_STATUS_TRANSACTION_COMPLETE == aci_evt->params.cmd_rsp.cmd_status)
+    {
+      ok = aci_bond_store_save_msg(aci_evt) && aci_bond_store_save_end();
+      break;
+    }
+    if ((ACI_STATUS_TRANSACTION_CONTINUE != aci_evt->params.cmd_rsp.cmd_status) ||
+        !aci_bond_store_save_msg(aci_evt))
+    {
+      break;
+    }
+    lib_aci_read_dynamic_data();
+  }
+  emu_ready_us = mock_time_now_us();
+  emu_bond_commit();
+  return ok;
+}
+
+/*
+  bond_data_restore() of the examples before aci_bond_store_restore_poll(): one command at a time,
+  each sent once the response of the one before has been handled.
+*/
+static bool emu_bond_restore_each(void)
+{
+  aci_evt_t *aci_evt;
+  uint16_t   cursor = 0;
+
+  while (aci_bond_store_msg_read(&cursor, &aci_cmd))
+  {
+    if (!hal_aci_tl_send(&aci_cmd) || (NULL == (aci_evt = emu_cmd_rsp_wait())))
+    {
+      return false;
+    }
+    if (ACI_STATUS_TRANSACTION_COMPLETE == aci_evt->params.cmd_rsp.cmd_status)
+    {
+      return true;
+    }
+    if (ACI_STATUS_TRANSACTION_CONTINUE != aci_evt->params.cmd_rsp.cmd_status)
+    {
+      return false;
+    }
+  }
+  return false;
+}
+
+static bool emu_dynamic_is(const uint8_t *p_expected);
+
+/*
+  aci_bond_store_restore_poll() called from the loop, from the bond selected.
+*/
+static bool emu_bond_restore(void)
+{
+  const uint32_t start_us = mock_time_now_us();
+  uint8_t        result;
+
+  while ((mock_time_now_us() - start_us) < EMU_TIMEOUT_US)
+  {
+    nrf8001_model_run();
+    result = aci_bond_store_restore_poll(&aci_state);
+    if (ACI_BOND_STORE_RESTORE_IN_PROGRESS != result)
+    {
+      return (ACI_BOND_STORE_RESTORE_SUCCESS == result);
+    }
+    mock_time_advance_us(EMU_LOOP_US);
+  }
+  return false;
+}
+
+/*
+  Restores the bond selected after a power cycle with p_restore, prints the SPI transfers taken.
+*/
+static void emu_restore_compare(const nrf8001_model_config_t *p_model, const char *p_step,
+                                bool (*p_restore)(void), const uint8_t *p_expected)
+{
+  nrf8001_model_stats_t stats;
+  uint32_t              start_us;
+  uint32_t              transfers;
+  bool                  ok;
+
+  ok        = emu_power_on(p_model);
+  nrf8001_model_stats_get(&stats);
+  transfers = stats.transfers;
+  start_us  = mock_time_now_us();
+  ok        = ok && p_restore() && emu_dynamic_is(p_expected);
+  nrf8001_model_stats_get(&stats);
+  emu_failed = emu_failed || !ok;
+  printf("%-26s %6lu %9.2f %s\n", p_step, (unsigned long)(stats.transfers - transfers),
+         (double)(mock_time_now_us() - start_us) / 1000.0, ok ? "ok" : "FAILED");
+}
+
+static bool emu_dynamic_is(const uint8_t *p_expected)
+{
+  uint16_t       length;
+  const uint8_t *p_dynamic = nrf8001_model_dynamic_get(&length);
+
+  return (0 == memcmp(p_dynamic, p_expected, length));
+}
+
+/*
+  The ready column is the time until the save returned, for the steps that save.
+*/
+static void emu_report(const char *p_step, uint32_t start_us, uint32_t writes_start, bool ok)
+{
+  char ready[16] = "-";
+
+  if ((int32_t)(emu_ready_us - start_us) >= 0)
+  {
+    snprintf(ready, sizeof(ready), "%.1f", (double)(emu_ready_us - start_us) / 1000.0);
+  }
+  emu_failed = emu_failed || !ok;
+  printf("%-26s %6lu %9.1f %9s %s\n", p_step, (unsigned long)(mock_eeprom_writes - writes_start),
+         (double)(mock_time_now_us() - start_us) / 1000.0, ready, ok ? "ok" : "FAILED");
+}
+
+int main(void)
+{
+  nrf8001_model_config_t model;
+  uint8_t                before[NRF8001_MODEL_DYNAMIC_MAX];
+  uint8_t                second[NRF8001_MODEL_DYNAMIC_MAX];
+  const uint8_t         *p_dynamic;
+  uint16_t               length;
+  uint32_t               start_us;
+  uint32_t               writes;
+  bool                   ok;
+  uint8_t                i;
+
+  nrf8001_model_config_default(&model);
+  model.setup_done = true;
+  model.reset_pin  = 4;
+
+  mock_eeprom_erase();
+  printf("%-26s %6s %9s %9s\n", "step", "writes", "ms", "ready ms");
+  /* The examples wrote [length][opcode][sequence number] and the data of each message, and a flag */
+  writes = model.dynamic_length + ((model.dynamic_length + 25) / 26) * 3 + 1;
+  printf("%-26s %6lu %9.1f %9.1f\n", "every byte, as before", (unsigned long)writes,
+         writes * MOCK_EEPROM_WRITE_US / 1000.0, writes * MOCK_EEPROM_WRITE_US / 1000.0);
+
+  ok = emu_power_on(&model);
+  start_us = mock_time_now_us();
+  writes   = mock_eeprom_writes;
+  ok       = ok && emu_bond_save(peer_a);
+  emu_report("first bond", start_us, writes, ok);
+
+  for (i = 0; i < 3; i++)
+  {
+    start_us = mock_time_now_us();
+    writes   = mock_eeprom_writes;
+    emu_report("same bond", start_us, writes, emu_bond_save(peer_a));
+  }
+
+  /* The bond changes, e.g. the peer writes a CCCD. The first change goes to the empty slot 1,
+   * the second one to slot 0 over the first record. */
+  for (i = 0; i < 2; i++)
+  {
+    nrf8001_model_dynamic_set(40, 0x01);
+    nrf8001_model_dynamic_set(41, i);
+    start_us = mock_time_now_us();
+    writes   = mock_eeprom_writes;
+    emu_report("bond changed", start_us, writes, emu_bond_save(peer_a));
+  }
+  start_us = mock_time_now_us();
+  writes   = mock_eeprom_writes;
+  emu_report("same bond", start_us, writes, emu_bond_save(peer_a));
+
+  /* After a power cycle the nRF8001 has lost the bond */
+  p_dynamic = nrf8001_model_dynamic_get(&length);
+  memcpy(before, p_dynamic, length);
+  ok       = emu_power_on(&model);
+  start_us = mock_time_now_us();
+  writes   = mock_eeprom_writes;
+  ok       = ok && !emu_dynamic_is(before) && emu_bond_restore() && emu_dynamic_is(before);
+  emu_report("restore after power cycle", start_us, writes, ok);
+
+  /* A reset while the next record is written, in slot 1 after the five saves that wrote one.
+   * The record before it, in slot 0, is restored. */
+  nrf8001_model_dynamic_set(100, 0x55);
+  ok = emu_bond_save(peer_a);
+  *mock_eeprom_byte(ACI_BOND_STORE_START + ACI_BOND_STORE_SLOT_SIZE + ACI_BOND_STORE_HEADER_SIZE + 50) ^= 0x01;
+  ok       = ok && emu_power_on(&model);
+  start_us = mock_time_now_us();
+  writes   = mock_eeprom_writes;
+  ok       = ok && emu_bond_restore() && emu_dynamic_is(before);
+  emu_report("restore after torn record", start_us, writes, ok);
+
+  /* A second peer bonds and goes to the free bond */
+  nrf8001_model_dynamic_set(10, 0xB0);
+  nrf8001_model_dynamic_set(11, 0xB1);
+  p_dynamic = nrf8001_model_dynamic_get(&length);
+  memcpy(second, p_dynamic, length);
+  start_us = mock_time_now_us();
+  writes   = mock_eeprom_writes;
+  ok       = (1 == aci_bond_store_free());
+  aci_bond_store_select(aci_bond_store_free());
+  ok       = ok && emu_bond_save(peer_b) && (0x03 == aci_bond_store_bonds());
+  emu_report("second peer bond", start_us, writes, ok);
+
+  /* After a power cycle each peer address leads straight to its bond */
+  ok       = emu_power_on(&model);
+  start_us = mock_time_now_us();
+  writes   = mock_eeprom_writes;
+  ok       = ok && (0x03 == aci_bond_store_bonds()) && (0 == aci_bond_store_find(peer_a));
+  aci_bond_store_select(aci_bond_store_find(peer_b));
+  ok       = ok && emu_bond_restore() && emu_dynamic_is(second);
+  emu_report("restore second peer", start_us, writes, ok);
+
+  ok       = emu_power_on(&model);
+  start_us = mock_time_now_us();
+  writes   = mock_eeprom_writes;
+  aci_bond_store_select(aci_bond_store_find(peer_a));
+  ok       = ok && (ACI_BOND_STORE_NO_BOND == aci_bond_store_free()) && emu_bond_restore() && emu_dynamic_is(before);
+  emu_report("restore first peer", start_us, writes, ok);
+
+  /* Write Dynamic Data sent one at a time against the command queue kept filled */
+  printf("\n%-26s %6s %9s\n", "restore", "xfers", "ms");
+  emu_restore_compare(&model, "one at a time, as before", emu_bond_restore_each, before);
+  emu_restore_compare(&model, "command queue filled", emu_bond_restore, before);
+  return emu_failed ? 1 : 0;
+}
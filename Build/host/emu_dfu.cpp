@@ -0,0 +1,334 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+ * @brief Image transfer of aci_dfu against the nRF8001 model
+ *
+ * The model peer runs the DFU controller side: START_DFU and the image size, the init packet with
+ * the CRC, PACKET_RECEIPT_NOTIFICATION_REQUEST, RECEIVE_FIRMWARE_IMAGE and VALIDATE. It sends the
+ * image in 20 byte packets and, as the phone applications do, stops after N packets until a
+ * receipt notification comes back. Pages are copied to a RAM "flash" and each page_write takes
+ * the time given for the run. The image written is compared with the one sent.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "arduino_mock.h"
+#include "SPI.h"
+#include "hal_platform.h"
+#include "lib_aci.h"
+#include "aci_crc.h"
+#include "aci_dfu.h"
+#include "nrf8001_model.h"
+#include "../../libraries/BLE/examples/ble_uart_project_with_dfu_template/services.h"
+
+#define EMU_LOOP_US     20          // Time taken by one pass of loop() outside the library
+#define EMU_TIMEOUT_US  60000000UL  // A run that takes longer fails
+#define EMU_IMAGE_SIZE  16384
+#define EMU_PACKET_LEN  ACI_DFU_PACKET_LEN
+
+#define EMU_PACKET_PIPE  PIPE_NORDIC_DEVICE_FIRMWARE_UPDATE_SERVICE_DFU_PACKET_RX
+#define EMU_CP_RX_PIPE   PIPE_NORDIC_DEVICE_FIRMWARE_UPDATE_SERVICE_DFU_CONTROL_POINT_RX_ACK_AUTO
+#define EMU_CP_TX_PIPE   PIPE_NORDIC_DEVICE_FIRMWARE_UPDATE_SERVICE_DFU_CONTROL_POINT_TX
+
+static services_pipe_type_mapping_t services_pipe_type_mapping[NUMBER_OF_PIPES] = SERVICES_PIPE_TYPE_MAPPING_CONTENT;
+static const hal_aci_data_t setup_msgs[NB_SETUP_MESSAGES] PROGMEM = SETUP_MESSAGES_CONTENT;
+
+static aci_state_t    aci_state;
+static hal_aci_evt_t  aci_data;
+static aci_dfu_t      dfu;
+static bool           emu_failed;  // A run printed FAILED, main() returns 1
+
+static uint8_t        image[EMU_IMAGE_SIZE];
+static uint8_t        flash[EMU_IMAGE_SIZE];
+static uint32_t       emu_write_us;   // Time taken by a page_write
+
+static bool emu_page_write(uint32_t offset, const uint8_t *p_page, uint16_t length);
+
+static const aci_dfu_params_t dfu_params =
+{
+  EMU_PACKET_PIPE,
+  EMU_CP_TX_PIPE,
+  EMU_CP_RX_PIPE,
+  EMU_IMAGE_SIZE,
+  emu_page_write
+};
+
+typedef enum
+{
+  EMU_PEER_CONNECT,
+  EMU_PEER_START,
+  EMU_PEER_INIT,
+  EMU_PEER_IMAGE,
+  EMU_PEER_VALIDATE,
+  EMU_PEER_DONE,
+  EMU_PEER_FAILED
+} emu_peer_step_t;
+
+/* The DFU controller on the phone */
+typedef struct
+{
+  uint8_t  step;
+  uint16_t prn;              // N, packets sent between two receipt notifications at most
+  uint32_t sent;             // Image bytes sent
+  uint16_t since_prn;        // Packets sent since the last receipt notification
+  bool     rsp;              // A response came
+  uint8_t  rsp_op;
+  uint8_t  rsp_result;
+  uint32_t image_start_us;
+  uint32_t image_end_us;
+} emu_peer_t;
+
+static emu_peer_t peer;
+
+static bool emu_page_write(uint32_t offset, const uint8_t *p_page, uint16_t length)
+{
+  memcpy(&flash[offset], p_page, length);
+  mock_time_advance_us(emu_write_us);
+  return true;
+}
+
+static void emu_peer_read(uint8_t pipe, const uint8_t *p_data, uint8_t length)
+{
+  if ((EMU_CP_TX_PIPE != pipe) || (0 == length))
+  {
+    return;
+  }
+  if (ACI_DFU_OP_PKT_RCPT_NOTIF == p_data[0])
+  {
+    peer.since_prn = 0;
+  }
+  else if ((ACI_DFU_OP_RESPONSE == p_data[0]) && (3 == length))
+  {
+    peer.rsp        = true;
+    peer.rsp_op     = p_data[1];
+    peer.rsp_result = p_data[2];
+  }
+}
+
+static bool emu_peer_write_cp(uint8_t op, uint8_t param)
+{
+  const uint8_t data[2] = { op, param };
+
+  return nrf8001_model_peer_write(EMU_CP_RX_PIPE, data, (0xFF == param) ? 1 : 2);
+}
+
+/*
+  Takes the response to op, the controller gives up on any other.
+*/
+static bool emu_peer_rsp(uint8_t op)
+{
+  if (!peer.rsp)
+  {
+    return false;
+  }
+  peer.rsp = false;
+  if ((op != peer.rsp_op) || (ACI_DFU_RESULT_SUCCESS != peer.rsp_result))
+  {
+    printf("  response 0x%02X 0x%02X to 0x%02X\n", peer.rsp_op, peer.rsp_result, op);
+    peer.step = EMU_PEER_FAILED;
+    return false;
+  }
+  return true;
+}
+
+static void emu_peer_poll(void)
+{
+  switch (peer.step)
+  {
+    case EMU_PEER_CONNECT:
+      if (nrf8001_model_is_connected() && lib_aci_is_pipe_available(&aci_state, EMU_CP_TX_PIPE))
+      {
+        const uint8_t size[4] = { (uint8_t)EMU_IMAGE_SIZE, (uint8_t)(EMU_IMAGE_SIZE >> 8), 0, 0 };
+
+        emu_peer_write_cp(ACI_DFU_OP_START_DFU, 0xFF);
+        nrf8001_model_peer_write(EMU_PACKET_PIPE, size, sizeof(size));
+        peer.step = EMU_PEER_START;
+      }
+      break;
+
+    case EMU_PEER_START:
+      if (emu_peer_rsp(ACI_DFU_OP_START_DFU))
+      {
+        const uint16_t crc    = aci_crc16_ccitt(ACI_CRC16_CCITT_INIT, image, EMU_IMAGE_SIZE);
+        const uint8_t  init[] = { (uint8_t)crc, (uint8_t)(crc >> 8) };
+        const uint8_t  prn[]  = { ACI_DFU_OP_PKT_RCPT_NOTIF_REQ, (uint8_t)peer.prn, (uint8_t)(peer.prn >> 8) };
+
+        nrf8001_model_peer_write(EMU_CP_RX_PIPE, prn, sizeof(prn));
+        emu_peer_write_cp(ACI_DFU_OP_INITIALIZE_DFU, 0);
+        nrf8001_model_peer_write(EMU_PACKET_PIPE, init, sizeof(init));
+        emu_peer_write_cp(ACI_DFU_OP_INITIALIZE_DFU, 1);
+        peer.step = EMU_PEER_INIT;
+      }
+      break;
+
+    case EMU_PEER_INIT:
+      if (emu_peer_rsp(ACI_DFU_OP_INITIALIZE_DFU))
+      {
+        emu_peer_write_cp(ACI_DFU_OP_RECEIVE_FIRMWARE_IMAGE, 0xFF);
+        peer.image_start_us = mock_time_now_us();
+        peer.step           = EMU_PEER_IMAGE;
+      }
+      break;
+
+    case EMU_PEER_IMAGE:
+      while ((peer.sent < EMU_IMAGE_SIZE) && ((0 == peer.prn) || (peer.since_prn < peer.prn)))
+      {
+        const uint32_t left   = EMU_IMAGE_SIZE - peer.sent;
+        const uint8_t  length = (left < EMU_PACKET_LEN) ? (uint8_t)left : EMU_PACKET_LEN;
+
+        if (!nrf8001_model_peer_write(EMU_PACKET_PIPE, &image[peer.sent], length))
+        {
+          break;
+        }
+        peer.sent += length;
+        peer.since_prn++;
+      }
+      if (emu_peer_rsp(ACI_DFU_OP_RECEIVE_FIRMWARE_IMAGE))
+      {
+        peer.image_end_us = mock_time_now_us();
+        emu_peer_write_cp(ACI_DFU_OP_VALIDATE, 0xFF);
+        peer.step = EMU_PEER_VALIDATE;
+      }
+      break;
+
+    case EMU_PEER_VALIDATE:
+      if (emu_peer_rsp(ACI_DFU_OP_VALIDATE))
+      {
+        emu_peer_write_cp(ACI_DFU_OP_ACTIVATE_N_RESET, 0xFF);
+        peer.step = EMU_PEER_DONE;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+static void emu_aci_loop(void)
+{
+  aci_evt_t *aci_evt;
+
+  if (lib_aci_event_get(&aci_state, &aci_data))
+  {
+    aci_evt = &aci_data.evt;
+    aci_dfu_event(&dfu, &aci_state, aci_evt);
+
+    if ((ACI_EVT_DEVICE_STARTED == aci_evt->evt_opcode) &&
+        (ACI_DEVICE_STANDBY == aci_evt->params.device_started.device_mode))
+    {
+      aci_state.data_credit_total = aci_evt->params.device_started.credit_available;
+      lib_aci_connect(180, 0x0050);
+    }
+  }
+  aci_dfu_poll(&dfu, &aci_state);
+}
+
+/*
+  Transfers the image with the peer asking for a notification every prn packets, aci_dfu
+  notifying at most every interval packets and page_write taking write_us.
+*/
+static void emu_run(const nrf8001_model_config_t *p_model, uint16_t prn, uint8_t interval, uint32_t write_us)
+{
+  uint32_t        start_us;
+  aci_dfu_stats_t stats;
+  uint32_t        image_us;
+  bool            ok;
+
+  mock_reset();
+  start_us = mock_time_now_us();
+  nrf8001_model_init(p_model);
+  nrf8001_model_peer_read_set(emu_peer_read);
+
+  nrf8001_model_aci_state_fill(&aci_state, p_model, &services_pipe_type_mapping[0], NUMBER_OF_PIPES,
+                               setup_msgs, NB_SETUP_MESSAGES);
+
+  memset(&peer, 0, sizeof(peer));
+  peer.prn     = prn;
+  emu_write_us = write_us;
+  memset(flash, 0xFF, sizeof(flash));
+  aci_dfu_init(&dfu, &dfu_params);
+  aci_dfu_prn_interval_set(&dfu, interval);
+
+  lib_aci_init(&aci_state, false);
+
+  while ((EMU_PEER_DONE != peer.step) && (EMU_PEER_FAILED != peer.step) &&
+         ((mock_time_now_us() - start_us) < EMU_TIMEOUT_US))
+  {
+    nrf8001_model_run();
+    emu_aci_loop();
+    emu_peer_poll();
+    mock_time_advance_us(EMU_LOOP_US);
+  }
+  // The ACTIVATE_N_RESET written last
+  while ((ACI_DFU_STATE_ACTIVATE != aci_dfu_state(&dfu)) && ((mock_time_now_us() - start_us) < EMU_TIMEOUT_US))
+  {
+    nrf8001_model_run();
+    emu_aci_loop();
+    mock_time_advance_us(EMU_LOOP_US);
+  }
+
+  aci_dfu_stats_get(&dfu, &stats);
+  ok       = (ACI_DFU_STATE_ACTIVATE == aci_dfu_state(&dfu)) && (0 == memcmp(image, flash, sizeof(image)));
+  image_us = peer.image_end_us - peer.image_start_us;
+  emu_failed = emu_failed || !ok;
+  printf("%4u %4u %7.1f %8.1f %7lu %5u %5u %5u %5u %4u %s\n", prn, interval, write_us / 1000.0,
+         image_us / 1000.0, ok ? (unsigned long)((uint64_t)EMU_IMAGE_SIZE * 1000000ULL / image_us) : 0UL,
+         stats.notifications, stats.held_room, stats.held_credit, stats.pages, stats.overruns, ok ? "ok" : "FAILED");
+}
+
+int main(void)
+{
+  static const uint16_t prns[]   = { 1, 4, 8, 12 };
+  static const uint32_t writes[] = { 700, 4500 };
+  nrf8001_model_config_t model;
+  uint32_t               i;
+  uint8_t                j;
+  uint8_t                k;
+
+  for (i = 0; i < sizeof(image); i++)
+  {
+    image[i] = (uint8_t)(i * 7 + (i >> 8));
+  }
+
+  nrf8001_model_config_default(&model);
+  model.setup_done = true;
+  model.reset_pin  = 4;
+
+  printf("%u byte image, %u byte pages, %.2f ms connection interval, %u packets per event\n",
+         EMU_IMAGE_SIZE, ACI_DFU_PAGE_SIZE, model.conn_interval * 1.25, model.packets_per_event);
+  printf("   N intv write ms image ms     B/s  prns  room  cred pages ovr\n");
+  for (k = 0; k < sizeof(writes) / sizeof(writes[0]); k++)
+  {
+    for (j = 0; j < sizeof(prns) / sizeof(prns[0]); j++)
+    {
+      // Notifying every N packets, as a receiver that answers each window
+      emu_run(&model, prns[j], (uint8_t)prns[j], writes[k]);
+      if (prns[j] > 1)
+      {
+        emu_run(&model, prns[j], 0, writes[k]);
+      }
+    }
+  }
+  return emu_failed ? 1 : 0;
+}
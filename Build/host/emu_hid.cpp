@@ -0,0 +1,642 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+/** @file
+ * @brief Typing text with aci_hid_report against the nRF8001 model
+ *
+ * A typist types a text at a key every so many milliseconds, in bursts of keys with a pause
+ * between them, or pastes it at once, on the HID
+ * report pipe of ble_HID_keyboard_template. The keys come from an interrupt, as the Timer1 one of
+ * the template, while the loop runs. The loop of earlier releases keeps the key in a flag, as
+ * timer1_f, and sends its press and release back to back once both credits are there, a key typed
+ * while the flag is set is lost. With aci_hid_report the keys are queued and go out as the
+ * credits come back.
+ *
+ * With the 2 credits of the nRF8001 a key, press and release, takes a connection interval either
+ * way. Typed faster than that the queue keeps the keys that the flag loses, until it is full.
+ * A burst that fits in the queue gets through whole, the pause lets the queue empty.
+ *
+ * The peer types a key on each report that presses one, the text it gets is compared with the
+ * one typed. The latency is from the key typed to its press at the peer.
+ *
+ * A text of mixed case and punctuation is then pasted as aci_hid_report_key() presses and
+ * releases, a key per report, and with aci_hid_text, which presses up to ACI_HID_TEXT_KEYS keys
+ * in a report and only puts a release when a key repeats and at the end. The peer types the keys
+ * of each report that the report before did not press, in order, with the shift of the report.
+ *
+ * A mouse then moves at a steady speed, its sensor read every millisecond, with a click now and
+ * then, on the same pipe. The loop of the HID template sends each reading in a report when there
+ * is a credit and loses it otherwise; aci_hid_motion sums the readings into one report per
+ * connection event. The peer adds up the motion and counts the clicks. With aci_hid_motion the
+ * latency is the age of the oldest reading in a report, the loop of the template has none as
+ * it loses the readings instead.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "arduino_mock.h"
+#include "SPI.h"
+#include "hal_platform.h"
+#include "lib_aci.h"
+#include "aci_hid_report.h"
+#include "nrf8001_model.h"
+#include "../../libraries/BLE/examples/ble_HID_keyboard_template/services.h"
+
+#define EMU_LOOP_US      20          // Time taken by one pass of loop() outside the library
+#define EMU_TIMEOUT_US   60000000UL  // A run that takes longer stops there
+#define EMU_TEXT_SIZE    300
+#define EMU_REPORT_LEN   8
+#define EMU_PAUSE_US     100000UL    // Between the bursts
+#define EMU_MOUSE_LEN    3           // Buttons, X, Y
+#define EMU_MOUSE_TICKS  2000        // Sensor readings, one per millisecond
+#define EMU_MOUSE_DX     3
+#define EMU_MOUSE_DY     -2
+#define EMU_MOUSE_CLICK  97          // Readings between the clicks, a press then a release
+#define EMU_PASTE_SIZE   288
+
+static services_pipe_type_mapping_t services_pipe_type_mapping[NUMBER_OF_PIPES] = SERVICES_PIPE_TYPE_MAPPING_CONTENT;
+static const hal_aci_data_t setup_msgs[NB_SETUP_MESSAGES] PROGMEM = SETUP_MESSAGES_CONTENT;
+
+static aci_state_t            aci_state;
+static hal_aci_evt_t          aci_data;
+static aci_hid_report_queue_t hid_report_queue;
+static aci_hid_motion_t       hid_motion;
+static aci_hid_text_t         hid_text;
+static bool                   emu_failed;  // A run printed FAILED, main() returns 1
+
+static const aci_hid_report_params_t hid_report_params =
+{
+  PIPE_HID_SERVICE_HID_REPORT_TX, EMU_REPORT_LEN, 0
+};
+
+static uint8_t emu_mouse_encode(const aci_hid_motion_report_t *p_motion, uint8_t *p_report)
+{
+  p_report[0] = p_motion->buttons;
+  p_report[1] = (uint8_t)p_motion->x;
+  p_report[2] = (uint8_t)p_motion->y;
+  return EMU_MOUSE_LEN;
+}
+
+static const aci_hid_motion_params_t hid_motion_params =
+{
+  PIPE_HID_SERVICE_HID_REPORT_TX, false, 127, 127, emu_mouse_encode
+};
+
+typedef enum
+{
+  EMU_LOOP_LEGACY,               // The key in a flag, press and release sent with 2 credits
+  EMU_LOOP_QUEUE,
+  EMU_LOOP_MOUSE_LEGACY,         // A report per reading when there is a credit
+  EMU_LOOP_MOUSE_MOTION,
+  EMU_LOOP_TEXT_KEYS,            // The text pasted with aci_hid_report_key()
+  EMU_LOOP_TEXT                  // The text pasted with aci_hid_text
+} emu_loop_t;
+
+static const char text_line[] = "the quick brown fox jumps over the lazy dog 0123456789\n";
+
+static const char paste_line[] = "The quick brown fox jumps over the lazy dog. Hello, World! (1+1=2)\n";
+
+static char     paste[EMU_PASTE_SIZE + 1];
+static uint8_t  text[EMU_TEXT_SIZE];       // Keycodes
+static uint32_t typed_us[EMU_TEXT_SIZE];
+
+/* The typist */
+static struct
+{
+  uint32_t key_us;               // Time between keys, 0 to paste
+  uint8_t  burst;                // Keys before a pause, 0 for no pause
+  uint32_t next_us;
+  uint32_t typed;
+  uint32_t refused;              // Found the flag set or the queue full, lost
+} typist;
+
+/* The peer */
+static struct
+{
+  uint8_t  received[EMU_TEXT_SIZE];
+  uint32_t count;
+  uint32_t latency_max_us;
+  uint64_t latency_sum_us;
+} peer;
+
+/* The peer of the mouse */
+static struct
+{
+  int32_t  x;
+  int32_t  y;
+  uint32_t clicks;
+  uint8_t  buttons;
+  uint32_t reports;
+  uint32_t latency_max_us;
+} mouse_peer;
+
+static uint32_t mouse_start_us;      // Time of the first reading
+
+/* The peer of the pasted text */
+static struct
+{
+  bool     active;
+  char     received[EMU_PASTE_SIZE];
+  uint32_t count;
+  uint32_t reports;
+  uint8_t  keys[6];              // Pressed by the report before
+} text_peer;
+
+/* Keys that found room, in the order typed */
+static uint16_t accepted[EMU_TEXT_SIZE];
+static uint32_t accepted_count;
+
+/* The loop of earlier releases */
+static struct
+{
+  volatile uint8_t flag;         // timer1_f
+  uint8_t          keycode;
+} legacy;
+
+static uint8_t emu_keycode(char c)
+{
+  if ((c >= 'a') && (c <= 'z'))
+  {
+    return 0x04 + (c - 'a');
+  }
+  if ((c >= '1') && (c <= '9'))
+  {
+    return 0x1E + (c - '1');
+  }
+  if ('0' == c)
+  {
+    return 0x27;
+  }
+  return (' ' == c) ? 0x2C : 0x28;
+}
+
+/*
+  The keys of the report that the one before did not press are typed, in order.
+*/
+static void emu_text_peer_read(const uint8_t *p_data)
+{
+  uint8_t modifier;
+  uint8_t keycode;
+  uint8_t i;
+  int     c;
+
+  text_peer.reports++;
+  for (i = 0; i < 6; i++)
+  {
+    if ((0 == p_data[2 + i]) || (NULL != memchr(&text_peer.keys[0], p_data[2 + i], sizeof(text_peer.keys))))
+    {
+      continue;
+    }
+    for (c = 0; c < 128; c++)
+    {
+      if (aci_hid_key_from_ascii((char)c, &modifier, &keycode) && (keycode == p_data[2 + i]) &&
+          (modifier == (p_data[0] & ACI_HID_MODIFIER_LEFT_SHIFT)))
+      {
+        break;
+      }
+    }
+    if (text_peer.count < EMU_PASTE_SIZE)
+    {
+      text_peer.received[text_peer.count] = (char)c;
+    }
+    text_peer.count++;
+  }
+  memcpy(&text_peer.keys[0], &p_data[2], sizeof(text_peer.keys));
+}
+
+/*
+  A report with a key pressed is the next key that found room.
+*/
+static void emu_peer_read(uint8_t pipe, const uint8_t *p_data, uint8_t length)
+{
+  uint32_t latency_us;
+
+  if (text_peer.active && (PIPE_HID_SERVICE_HID_REPORT_TX == pipe) && (EMU_REPORT_LEN == length))
+  {
+    emu_text_peer_read(p_data);
+    return;
+  }
+
+  if ((PIPE_HID_SERVICE_HID_REPORT_TX == pipe) && (EMU_MOUSE_LEN == length))
+  {
+    // The oldest reading in the report is the one after those already added up
+    latency_us = mock_time_now_us() - (mouse_start_us + (uint32_t)(mouse_peer.x / EMU_MOUSE_DX) * 1000);
+    if ((0 != (int8_t)p_data[1]) && (latency_us > mouse_peer.latency_max_us))
+    {
+      mouse_peer.latency_max_us = latency_us;
+    }
+    if ((0 != p_data[0]) && (0 == mouse_peer.buttons))
+    {
+      mouse_peer.clicks++;
+    }
+    mouse_peer.buttons = p_data[0];
+    mouse_peer.x      += (int8_t)p_data[1];
+    mouse_peer.y      += (int8_t)p_data[2];
+    mouse_peer.reports++;
+    return;
+  }
+
+  if ((PIPE_HID_SERVICE_HID_REPORT_TX != pipe) || (EMU_REPORT_LEN != length) ||
+      (0 == p_data[2]) || (peer.count >= accepted_count))
+  {
+    return;
+  }
+
+  latency_us = mock_time_now_us() - typed_us[accepted[peer.count]];
+  if (latency_us > peer.latency_max_us)
+  {
+    peer.latency_max_us = latency_us;
+  }
+  peer.latency_sum_us += latency_us;
+  peer.received[peer.count++] = p_data[2];
+}
+
+static void emu_aci_loop(emu_loop_t loop)
+{
+  aci_evt_t *aci_evt;
+
+  if (lib_aci_event_get(&aci_state, &aci_data))
+  {
+    aci_evt = &aci_data.evt;
+    if ((EMU_LOOP_QUEUE == loop) || (EMU_LOOP_TEXT_KEYS == loop) || (EMU_LOOP_TEXT == loop))
+    {
+      aci_hid_report_event(&hid_report_queue, &aci_state, aci_evt);
+    }
+    if (EMU_LOOP_TEXT == loop)
+    {
+      aci_hid_text_event(&hid_text, aci_evt);
+    }
+    else if (EMU_LOOP_MOUSE_MOTION == loop)
+    {
+      aci_hid_motion_event(&hid_motion, &aci_state, aci_evt);
+    }
+
+    if ((ACI_EVT_DEVICE_STARTED == aci_evt->evt_opcode) &&
+        (ACI_DEVICE_STANDBY == aci_evt->params.device_started.device_mode))
+    {
+      aci_state.data_credit_total = aci_evt->params.device_started.credit_available;
+      lib_aci_connect(180, 0x0050);
+    }
+  }
+}
+
+static bool emu_connected(void)
+{
+  return nrf8001_model_is_connected() &&
+         lib_aci_is_pipe_available(&aci_state, PIPE_HID_SERVICE_HID_REPORT_TX);
+}
+
+/*
+  The interrupt of the typist, a key every key_us. Pasting puts the keys as long as there is room.
+*/
+static void emu_typist(emu_loop_t loop)
+{
+  while ((typist.typed < EMU_TEXT_SIZE) && ((int32_t)(mock_time_now_us() - typist.next_us) >= 0))
+  {
+    bool room;
+
+    if (0 == typist.key_us)
+    {
+      room = (EMU_LOOP_LEGACY == loop) ? (0 == legacy.flag) : (aci_hid_report_room(&hid_report_queue) >= 2);
+      if (!room)
+      {
+        break;
+      }
+    }
+
+    typed_us[typist.typed] = mock_time_now_us();
+    if (EMU_LOOP_LEGACY == loop)
+    {
+      room = (0 == legacy.flag);
+      if (room)
+      {
+        legacy.keycode = text[typist.typed];
+        legacy.flag    = 1;
+      }
+    }
+    else
+    {
+      room = aci_hid_report_key(&hid_report_queue, 0x00, text[typist.typed]);
+    }
+
+    if (room)
+    {
+      accepted[accepted_count++] = (uint16_t)typist.typed;
+    }
+    else
+    {
+      typist.refused++;
+    }
+    typist.typed++;
+    typist.next_us += typist.key_us;
+    if ((0 != typist.burst) && (0 == (typist.typed % typist.burst)))
+    {
+      typist.next_us += EMU_PAUSE_US;
+    }
+  }
+}
+
+static void emu_loop_legacy(void)
+{
+  uint8_t report[EMU_REPORT_LEN];
+
+  if (lib_aci_is_pipe_available(&aci_state, PIPE_HID_SERVICE_HID_REPORT_TX)
+      && (aci_state.data_credit_available == 2)
+      && (1 == legacy.flag))
+  {
+    memset(report, 0, sizeof(report));
+    report[2] = legacy.keycode;
+    lib_aci_send_data(PIPE_HID_SERVICE_HID_REPORT_TX, &report[0], EMU_REPORT_LEN);
+    report[2] = 0x00;
+    lib_aci_send_data(PIPE_HID_SERVICE_HID_REPORT_TX, &report[0], EMU_REPORT_LEN);
+    legacy.flag = 0;
+  }
+}
+
+static void emu_start(const nrf8001_model_config_t *p_model)
+{
+  mock_reset();
+  nrf8001_model_init(p_model);
+  nrf8001_model_peer_read_set(emu_peer_read);
+
+  nrf8001_model_aci_state_fill(&aci_state, p_model, &services_pipe_type_mapping[0], NUMBER_OF_PIPES,
+                               setup_msgs, NB_SETUP_MESSAGES);
+
+  memset(&typist, 0, sizeof(typist));
+  memset(&peer, 0, sizeof(peer));
+  memset(&legacy, 0, sizeof(legacy));
+  memset(&mouse_peer, 0, sizeof(mouse_peer));
+  memset(&text_peer, 0, sizeof(text_peer));
+  accepted_count = 0;
+  aci_hid_report_init(&hid_report_queue, &hid_report_params);
+  aci_hid_motion_init(&hid_motion, &hid_motion_params);
+  aci_hid_text_init(&hid_text, &hid_report_queue);
+
+  lib_aci_init(&aci_state, false);
+  while (!emu_connected() && (mock_time_now_us() < EMU_TIMEOUT_US))
+  {
+    nrf8001_model_run();
+    emu_aci_loop(EMU_LOOP_LEGACY);
+    mock_time_advance_us(EMU_LOOP_US);
+  }
+}
+
+/*
+  Types the text at a key every key_ms, 0 to paste it, burst keys at a time, with the given loop.
+*/
+static void emu_run(const nrf8001_model_config_t *p_model, emu_loop_t loop, uint32_t key_ms, uint8_t burst)
+{
+  nrf8001_model_stats_t model_stats;
+  uint32_t              start_us;
+  uint32_t              end_us;
+  uint32_t              i;
+  bool                  ok;
+
+  emu_start(p_model);
+  typist.key_us  = key_ms * 1000;
+  typist.burst   = burst;
+  typist.next_us = mock_time_now_us();
+  start_us       = typist.next_us;
+
+  while (((typist.typed < EMU_TEXT_SIZE) || (peer.count < accepted_count)) &&
+         ((mock_time_now_us() - start_us) < EMU_TIMEOUT_US))
+  {
+    nrf8001_model_run();
+    emu_typist(loop);
+    emu_aci_loop(loop);
+    if (EMU_LOOP_LEGACY == loop)
+    {
+      emu_loop_legacy();
+    }
+    else
+    {
+      aci_hid_report_poll(&hid_report_queue, &aci_state);
+    }
+    mock_time_advance_us(EMU_LOOP_US);
+  }
+  end_us = mock_time_now_us();
+
+  // What got through must be the keys that found room, in order
+  ok = (peer.count == accepted_count);
+  for (i = 0; ok && (i < peer.count); i++)
+  {
+    ok = (peer.received[i] == text[accepted[i]]);
+  }
+
+  nrf8001_model_stats_get(&model_stats);
+  emu_failed = emu_failed || !ok;
+  printf("  %-6s %5lu %5u %8.1f %7.1f %5lu %6lu %7.1f %7.1f %s\n",
+         (EMU_LOOP_LEGACY == loop) ? "legacy" : "queue",
+         (unsigned long)key_ms, burst, (end_us - start_us) / 1000.0,
+         peer.count * 1000000.0 / (end_us - start_us),
+         (unsigned long)(EMU_TEXT_SIZE - peer.count), (unsigned long)model_stats.credit_errors,
+         (0 != peer.count) ? (double)peer.latency_sum_us / peer.count / 1000.0 : 0.0,
+         peer.latency_max_us / 1000.0, ok ? "ok" : "FAILED");
+}
+
+/*
+  Moves the mouse for EMU_MOUSE_TICKS readings with the given loop, and then until all is sent.
+*/
+static void emu_run_mouse(const nrf8001_model_config_t *p_model, emu_loop_t loop)
+{
+  aci_hid_motion_stats_t stats;
+  uint32_t               ticks = 0;
+  uint32_t               clicks = 0;
+  uint32_t               next_us;
+  uint32_t               end_us;
+  uint8_t                buttons = 0;
+  char                   latency[16];
+  bool                   ok;
+
+  emu_start(p_model);
+  mouse_start_us = mock_time_now_us();
+  next_us        = mouse_start_us;
+
+  while ((mock_time_now_us() - mouse_start_us) < EMU_TIMEOUT_US)
+  {
+    nrf8001_model_run();
+    emu_aci_loop(loop);
+
+    if ((ticks < EMU_MOUSE_TICKS) && ((int32_t)(mock_time_now_us() - next_us) >= 0))
+    {
+      // A press on one reading, the release on the next
+      if (0 == (ticks % EMU_MOUSE_CLICK))
+      {
+        buttons = 0x01;
+        clicks++;
+      }
+      else
+      {
+        buttons = 0x00;
+      }
+
+      if (EMU_LOOP_MOUSE_LEGACY == loop)
+      {
+        uint8_t report[EMU_MOUSE_LEN] = { buttons, (uint8_t)EMU_MOUSE_DX, (uint8_t)EMU_MOUSE_DY };
+
+        if (lib_aci_is_pipe_available(&aci_state, PIPE_HID_SERVICE_HID_REPORT_TX)
+            && (aci_state.data_credit_available > 0))
+        {
+          lib_aci_send_data(PIPE_HID_SERVICE_HID_REPORT_TX, &report[0], EMU_MOUSE_LEN);
+        }
+      }
+      else
+      {
+        aci_hid_motion_move(&hid_motion, EMU_MOUSE_DX, EMU_MOUSE_DY, 0);
+        aci_hid_motion_buttons(&hid_motion, buttons);
+      }
+      ticks++;
+      next_us += 1000;
+    }
+    else if ((EMU_MOUSE_TICKS == ticks) && ((int32_t)(mock_time_now_us() - next_us) >= 100000))
+    {
+      break;
+    }
+
+    if (EMU_LOOP_MOUSE_MOTION == loop)
+    {
+      aci_hid_motion_poll(&hid_motion, &aci_state);
+    }
+    mock_time_advance_us(EMU_LOOP_US);
+  }
+  end_us = mock_time_now_us();
+
+  aci_hid_motion_stats_get(&hid_motion, &stats);
+  ok = (EMU_LOOP_MOUSE_LEGACY == loop) ||
+       ((mouse_peer.x == (int32_t)EMU_MOUSE_TICKS * EMU_MOUSE_DX) &&
+        (mouse_peer.y == (int32_t)EMU_MOUSE_TICKS * EMU_MOUSE_DY) && (mouse_peer.clicks == clicks));
+  if (EMU_LOOP_MOUSE_LEGACY == loop)
+  {
+    snprintf(latency, sizeof(latency), "-");
+  }
+  else
+  {
+    snprintf(latency, sizeof(latency), "%.1f", mouse_peer.latency_max_us / 1000.0);
+  }
+  emu_failed = emu_failed || !ok;
+  printf("  %-6s %7ld %7ld %6lu %6lu %7lu %8.1f %7s %s\n",
+         (EMU_LOOP_MOUSE_LEGACY == loop) ? "legacy" : "motion",
+         (long)mouse_peer.x, (long)mouse_peer.y, (unsigned long)mouse_peer.clicks,
+         (unsigned long)clicks, (unsigned long)mouse_peer.reports, (end_us - mouse_start_us) / 1000.0,
+         latency, ok ? "ok" : "FAILED");
+}
+
+/*
+  Pastes the text with the given loop, until the peer has it all and the keys are released.
+*/
+static void emu_run_text(const nrf8001_model_config_t *p_model, emu_loop_t loop)
+{
+  aci_hid_text_stats_t stats;
+  uint32_t             pasted = 0;
+  uint32_t             start_us;
+  uint32_t             end_us;
+  uint8_t              modifier;
+  uint8_t              keycode;
+  bool                 ok;
+
+  emu_start(p_model);
+  text_peer.active = true;
+  start_us         = mock_time_now_us();
+  if (EMU_LOOP_TEXT == loop)
+  {
+    aci_hid_text_type(&hid_text, &paste[0]);
+  }
+
+  while (((text_peer.count < EMU_PASTE_SIZE) || (ACI_HID_REPORT_QUEUE_SIZE != aci_hid_report_room(&hid_report_queue)) ||
+          aci_hid_text_busy(&hid_text)) &&
+         ((mock_time_now_us() - start_us) < EMU_TIMEOUT_US))
+  {
+    nrf8001_model_run();
+    emu_aci_loop(loop);
+    if (EMU_LOOP_TEXT == loop)
+    {
+      aci_hid_text_poll(&hid_text);
+    }
+    else
+    {
+      while ((pasted < EMU_PASTE_SIZE) && (aci_hid_report_room(&hid_report_queue) >= 2))
+      {
+        aci_hid_key_from_ascii(paste[pasted++], &modifier, &keycode);
+        aci_hid_report_key(&hid_report_queue, modifier, keycode);
+      }
+    }
+    aci_hid_report_poll(&hid_report_queue, &aci_state);
+    mock_time_advance_us(EMU_LOOP_US);
+  }
+  end_us = mock_time_now_us();
+
+  aci_hid_text_stats_get(&hid_text, &stats);
+  ok = (EMU_PASTE_SIZE == text_peer.count) && (0 == memcmp(&text_peer.received[0], &paste[0], EMU_PASTE_SIZE)) &&
+       !aci_hid_text_busy(&hid_text);
+  emu_failed = emu_failed || !ok;
+  printf("  %-6s %8.1f %7.1f %7lu %8u %s\n",
+         (EMU_LOOP_TEXT == loop) ? "text" : "keys", (end_us - start_us) / 1000.0,
+         text_peer.count * 1000000.0 / (end_us - start_us), (unsigned long)text_peer.reports,
+         (EMU_LOOP_TEXT == loop) ? stats.releases : (unsigned int)text_peer.count,
+         ok ? "ok" : "FAILED");
+}
+
+int main(void)
+{
+  static const struct
+  {
+    uint32_t key_ms;
+    uint8_t  burst;
+  } typing[] = { { 100, 0 }, { 10, 0 }, { 5, 0 }, { 2, 8 }, { 2, 16 }, { 0, 0 } };
+  nrf8001_model_config_t model;
+  uint32_t               i;
+  uint8_t                j;
+
+  for (i = 0; i < EMU_TEXT_SIZE; i++)
+  {
+    text[i] = emu_keycode(text_line[i % (sizeof(text_line) - 1)]);
+  }
+  for (i = 0; i < EMU_PASTE_SIZE; i++)
+  {
+    paste[i] = paste_line[i % (sizeof(paste_line) - 1)];
+  }
+
+  nrf8001_model_config_default(&model);
+  model.setup_done = true;
+  model.reset_pin  = 4;
+
+  printf("%u keys, %.2f ms connection interval, %u packets per event, %u credits, %u reports queued\n",
+         EMU_TEXT_SIZE, model.conn_interval * 1.25, model.packets_per_event, model.credits,
+         ACI_HID_REPORT_QUEUE_SIZE);
+  printf("         key ms burst       ms  keys/s  lost crderr  lat ms  max ms\n");
+  for (j = 0; j < sizeof(typing) / sizeof(typing[0]); j++)
+  {
+    emu_run(&model, EMU_LOOP_LEGACY, typing[j].key_ms, typing[j].burst);
+    emu_run(&model, EMU_LOOP_QUEUE, typing[j].key_ms, typing[j].burst);
+  }
+
+  printf("%u mouse readings of %d, %d every ms\n", EMU_MOUSE_TICKS, EMU_MOUSE_DX, EMU_MOUSE_DY);
+  printf("               x       y clicks     of reports       ms  max ms\n");
+  emu_run_mouse(&model, EMU_LOOP_MOUSE_LEGACY);
+  emu_run_mouse(&model, EMU_LOOP_MOUSE_MOTION);
+
+  printf("%u characters pasted, up to %u keys per report\n", EMU_PASTE_SIZE, ACI_HID_TEXT_KEYS);
+  printf("               ms chars/s reports releases\n");
+  emu_run_text(&model, EMU_LOOP_TEXT_KEYS);
+  emu_run_text(&model, EMU_LOOP_TEXT);
+  return emu_failed ? 1 : 0;
+}
@@ -0,0 +1,275 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/** @file
+ * @brief Setup, connect and reconnect times, RAM and stack of the BLE library against the nRF8001 model
+ *
+ * Uploads the setup of ble_HID_template_HID_HRM, the largest of the examples, with aci_setup_poll()
+ * from the loop, connects, streams heart rate measurements on pipe 2 for as long as there are
+ * credits, then the peer drops the link and the sketch advertises again until the pipe is back open.
+ * Prints one figure per line, read by Build/PerfSuite.py against Build/host/perf_limits.txt.
+ *
+ * The stack figure is the host stack the runs took below main(), measured by painting: it follows
+ * the stack the library takes on the AVR, not its size there. The RAM figure is lib_aci_ram_get().
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "arduino_mock.h"
+#include "SPI.h"
+#include "hal_platform.h"
+#include "lib_aci.h"
+#include "aci_setup.h"
+#include "nrf8001_model.h"
+#include "../../libraries/BLE/examples/ble_HID_template_HID_HRM/services.h"
+
+#define EMU_LOOP_US     20          // Time taken by one pass of loop() outside the library
+#define EMU_TIMEOUT_US  2000000UL   // A step that takes longer fails
+#define EMU_STREAM_US   2000000UL   // Streaming time once the pipe is open
+#define EMU_PIPE        PIPE_HEART_RATE_HEART_RATE_MEASUREMENT_TX
+#define EMU_STACK_AREA  65536       // Bytes of stack painted under main()
+#define EMU_STACK_PAINT 0xC5
+
+static services_pipe_type_mapping_t services_pipe_type_mapping[NUMBER_OF_PIPES] = SERVICES_PIPE_TYPE_MAPPING_CONTENT;
+static const hal_aci_data_t setup_msgs[NB_SETUP_MESSAGES] PROGMEM = SETUP_MESSAGES_CONTENT;
+
+static aci_state_t    aci_state;
+static hal_aci_evt_t  aci_data;
+
+typedef struct
+{
+  bool     setup_required;
+  uint8_t  setup_result;
+  bool     pipe_open;
+  uint32_t init_us;
+  uint32_t standby_us;            // DeviceStarted in Standby, the setup is done
+  uint32_t open_us;               // Last time the pipe opened
+  uint32_t connect_us;            // Standby to the pipe open
+  uint32_t reconnect_us;          // The peer dropping the link to the pipe open again
+  uint32_t disconnects;
+  uint32_t sent;
+  uint32_t bytes;                 // Bytes the peer took while streaming
+  bool     failed;
+} emu_perf_t;
+
+static emu_perf_t perf;
+
+static uintptr_t emu_stack_low;   // Lowest address painted
+
+static uint8_t measurement[PIPE_HEART_RATE_HEART_RATE_MEASUREMENT_TX_MAX_SIZE] = { 0x00, 72 };
+
+/*
+  Paints EMU_STACK_AREA bytes of stack under the caller, which then takes the same stack again
+  for the runs.
+*/
+static __attribute__((noinline)) void emu_stack_paint(void)
+{
+  volatile uint8_t area[EMU_STACK_AREA];
+  uint32_t         i;
+
+  for (i = 0; i < EMU_STACK_AREA; i++)
+  {
+    area[i] = EMU_STACK_PAINT;
+  }
+  emu_stack_low = (uintptr_t)&area[0];
+}
+
+/*
+  Bytes of the painted area written since, counted from its low end up to the first one written.
+*/
+static __attribute__((noinline)) uint32_t emu_stack_used(void)
+{
+  const volatile uint8_t *p_area = (const volatile uint8_t *)emu_stack_low;
+  uint32_t                i      = 0;
+
+  while ((i < EMU_STACK_AREA) && (EMU_STACK_PAINT == p_area[i]))
+  {
+    i++;
+  }
+  return EMU_STACK_AREA - i;
+}
+
+/*
+  The event handling of the examples, cut down to what the runs need.
+*/
+static void emu_aci_loop(void)
+{
+  aci_evt_t *aci_evt;
+
+  if (perf.setup_required)
+  {
+    perf.setup_result   = aci_setup_poll(&aci_state);
+    perf.setup_required = (SETUP_IN_PROGRESS == perf.setup_result);
+    perf.failed         = perf.failed || ((SETUP_IN_PROGRESS != perf.setup_result) && (SETUP_SUCCESS != perf.setup_result));
+    return;
+  }
+
+  if (!lib_aci_event_get(&aci_state, &aci_data))
+  {
+    return;
+  }
+  aci_evt = &aci_data.evt;
+
+  switch (aci_evt->evt_opcode)
+  {
+    case ACI_EVT_DEVICE_STARTED:
+      aci_state.data_credit_total = aci_evt->params.device_started.credit_available;
+      if (ACI_DEVICE_SETUP == aci_evt->params.device_started.device_mode)
+      {
+        perf.setup_required = true;
+      }
+      else if (ACI_DEVICE_STANDBY == aci_evt->params.device_started.device_mode)
+      {
+        perf.standby_us = mock_time_now_us();
+        lib_aci_connect(180, 0x0050);
+      }
+      break;
+
+    case ACI_EVT_PIPE_STATUS:
+      if (!perf.pipe_open && lib_aci_is_pipe_available(&aci_state, EMU_PIPE))
+      {
+        perf.pipe_open = true;
+        perf.open_us   = mock_time_now_us();
+      }
+      break;
+
+    case ACI_EVT_DISCONNECTED:
+      perf.pipe_open = false;
+      perf.disconnects++;
+      lib_aci_connect(180, 0x0050);
+      break;
+
+    default:
+      break;
+  }
+}
+
+/*
+  Runs the loop until the pipe is open, or EMU_TIMEOUT_US.
+*/
+static bool emu_wait_open(void)
+{
+  const uint32_t start_us = mock_time_now_us();
+
+  while (!perf.pipe_open && ((mock_time_now_us() - start_us) < EMU_TIMEOUT_US))
+  {
+    nrf8001_model_run();
+    emu_aci_loop();
+    mock_time_advance_us(EMU_LOOP_US);
+  }
+  return perf.pipe_open;
+}
+
+/*
+  Sends a measurement whenever there is a credit, as the heart rate template would with no pacing.
+*/
+static void emu_stream(void)
+{
+  nrf8001_model_stats_t model_stats;
+  const uint32_t        start_us = mock_time_now_us();
+  uint32_t              bytes_start;
+
+  nrf8001_model_stats_get(&model_stats);
+  bytes_start = model_stats.bytes_sent;
+  while (perf.pipe_open && ((mock_time_now_us() - start_us) < EMU_STREAM_US))
+  {
+    nrf8001_model_run();
+    emu_aci_loop();
+    if (perf.pipe_open && (aci_state.data_credit_available > 0))
+    {
+      measurement[1] = (uint8_t)(60 + (perf.sent % 40));
+      if (lib_aci_send_data(EMU_PIPE, measurement, sizeof(measurement)))
+      {
+        perf.sent++;
+      }
+    }
+    mock_time_advance_us(EMU_LOOP_US);
+  }
+  nrf8001_model_stats_get(&model_stats);
+  perf.bytes = model_stats.bytes_sent - bytes_start;
+}
+
+/*
+  Powers on with the nRF8001 in Setup, the whole run the stack is measured over.
+  The peer drops the link once the stream is done.
+*/
+static __attribute__((noinline)) void emu_run(const nrf8001_model_config_t *p_model)
+{
+  uint32_t disconnect_us;
+
+  mock_reset();
+  nrf8001_model_init(p_model);
+  memset(&perf, 0, sizeof(perf));
+  nrf8001_model_aci_state_fill(&aci_state, p_model, &services_pipe_type_mapping[0], NUMBER_OF_PIPES,
+                               setup_msgs, NB_SETUP_MESSAGES);
+
+  perf.init_us = mock_time_now_us();
+  lib_aci_init(&aci_state, false);
+  if (!emu_wait_open())
+  {
+    perf.failed = true;
+    return;
+  }
+  perf.connect_us = perf.open_us - perf.standby_us;
+  emu_stream();
+
+  nrf8001_model_peer_disconnect();
+  disconnect_us  = mock_time_now_us();
+  perf.pipe_open = false;  // Until the Disconnected event and the PipeStatus after the reconnect
+  if (!emu_wait_open() || (1 != perf.disconnects))
+  {
+    perf.failed = true;
+    return;
+  }
+  perf.reconnect_us = perf.open_us - disconnect_us;
+}
+
+int main(void)
+{
+  nrf8001_model_config_t model;
+  lib_aci_ram_t          ram;
+  uint32_t               stack;
+
+  nrf8001_model_config_default(&model);
+  model.reset_pin = 4;
+
+  emu_stack_paint();
+  emu_run(&model);
+  stack = emu_stack_used();
+  lib_aci_ram_get(&aci_state, &ram);
+
+  printf("%-12s %10s %-6s %s\n", "figure", "value", "unit", "workload");
+  printf("%-12s %10.1f %-6s %u setup messages of ble_HID_template_HID_HRM\n", "setup",
+         (double)(perf.standby_us - perf.init_us) / 1000.0, "ms", NB_SETUP_MESSAGES);
+  printf("%-12s %10.1f %-6s Standby to pipe %u open, %.0f ms of advertising\n", "connect",
+         (double)perf.connect_us / 1000.0, "ms",
+         EMU_PIPE, model.connect_delay_us / 1000.0);
+  printf("%-12s %10lu %-6s %u byte measurements, %.2f ms interval, %u packets per event\n", "stream",
+         (unsigned long)((uint64_t)perf.bytes * 1000000ULL / EMU_STREAM_US), "B/s",
+         (unsigned)sizeof(measurement), model.conn_interval * 1.25, model.packets_per_event);
+  printf("%-12s %10.1f %-6s peer drops the link to pipe %u open again\n", "reconnect",
+         (double)perf.reconnect_us / 1000.0, "ms", EMU_PIPE);
+  printf("%-12s %10u %-6s lib_aci_ram_get(), %u pipes\n", "ram", ram.total, "bytes", NUMBER_OF_PIPES);
+  printf("%-12s %10lu %-6s host stack taken by the runs\n", "stack", (unsigned long)stack, "bytes");
+  printf("%s\n", perf.failed ? "FAILED" : "ok");
+  return perf.failed ? 1 : 0;
+}
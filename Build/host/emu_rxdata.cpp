@@ -0,0 +1,336 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+/** @file
+ * @brief Slow reader of the data received, with and without ACI_RX_DATA_QUEUE_BYTES, against the nRF8001 model
+ *
+ * The peer writes bursts of numbered packets on the DFU packet pipe of
+ * ble_proximity_with_dfu_template. The sketch reads the events with lib_aci_event_get() and takes
+ * EMU_READ_US to handle each data event, as a DFU that writes the flash, while it asks for the
+ * temperature every EMU_TEMP_US and measures the round trip to its command response. In the event
+ * queue the response waits behind the data received before it, with a data event queue it does not.
+ *
+ * The peer then writes while the sketch is busy and drops the link before the data are read. The
+ * data must still come, in order and ahead of the ACI_EVT_DISCONNECTED. With a data event queue
+ * they are read once more with lib_aci_data_peek_ptr(), lib_aci_data_is_stale() must flag them.
+ *
+ * The Makefile builds it twice, emu_rxdata with the library options of DEFINES and emu_rxdata_q
+ * with ACI_RX_DATA_QUEUE_BYTES added.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "arduino_mock.h"
+#include "SPI.h"
+#include "hal_platform.h"
+#include "lib_aci.h"
+#include "nrf8001_model.h"
+#include "../../libraries/BLE/examples/ble_proximity_with_dfu_template/services.h"
+
+#define EMU_LOOP_US       20          // Time taken by one pass of loop() outside the library
+#define EMU_TIMEOUT_US    10000000UL  // Connecting that takes longer stops there
+#define EMU_LOAD_US       2000000UL   // Time the peer writes
+#define EMU_BURST_US      100000UL    // Between the bursts of the peer
+#define EMU_BURST         4           // Packets in a burst
+#define EMU_READ_US       20000UL     // Time the sketch takes to handle a data event
+#define EMU_TEMP_US       30000UL     // Between the temperature requests
+#define EMU_DROP_BUSY_US  100000UL    // The sketch is busy from the write of the peer
+#define EMU_DROP_US       50000UL     // The peer drops the link after its write
+#define EMU_DROP_WRITES   2
+#define EMU_PIPE          PIPE_NORDIC_DEVICE_FIRMWARE_UPDATE_SERVICE_DFU_PACKET_RX
+
+/* The transfers stall when the data event queue cannot take one more full event */
+#define EMU_QUEUE_TAKES(packets)  (ACI_RX_DATA_QUEUE_BYTES >= (((packets) + 1) * ACI_QUEUE_ENTRY_MAX))
+
+static services_pipe_type_mapping_t services_pipe_type_mapping[NUMBER_OF_PIPES] = SERVICES_PIPE_TYPE_MAPPING_CONTENT;
+static const hal_aci_data_t setup_msgs[NB_SETUP_MESSAGES] PROGMEM = SETUP_MESSAGES_CONTENT;
+
+static aci_state_t   aci_state;
+static hal_aci_evt_t aci_data;
+
+/* The sketch */
+static struct
+{
+  bool     peek;                 // Reads the data with lib_aci_data_peek_ptr()
+  uint32_t busy_until_us;
+  bool     in_order;
+  uint8_t  next;                 // Number of the next packet
+  uint16_t reads;                // Data events read
+  uint16_t reads_before_drop;    // Data events read ahead of the ACI_EVT_DISCONNECTED
+  uint16_t stale;                // Flagged by lib_aci_data_is_stale()
+  bool     disconnected;
+  bool     temp_pending;
+  uint32_t temp_sent_us;
+  uint32_t temp_next_us;
+  uint16_t temps;                // Round trips
+  uint32_t temp_total_us;
+  uint32_t temp_max_us;
+} sketch;
+
+/* The peer */
+static struct
+{
+  uint8_t  next;                 // Number of the next packet written
+  uint16_t writes;
+} peer;
+
+static void emu_data_read(const aci_evt_t *aci_evt)
+{
+  if ((EMU_PIPE != aci_evt->params.data_received.rx_data.pipe_number) ||
+      (sketch.next != aci_evt->params.data_received.rx_data.aci_data[0]))
+  {
+    sketch.in_order = false;
+  }
+  sketch.next++;
+  sketch.reads++;
+  if (!sketch.disconnected)
+  {
+    sketch.reads_before_drop++;
+  }
+  sketch.busy_until_us = mock_time_now_us() + EMU_READ_US;
+}
+
+static void emu_aci_loop(void)
+{
+  aci_evt_t *aci_evt;
+  uint32_t   round_trip_us;
+
+  if ((int32_t)(mock_time_now_us() - sketch.busy_until_us) < 0)
+  {
+    return;
+  }
+#if ACI_RX_DATA_QUEUE_BYTES
+  if (sketch.peek && (NULL != lib_aci_data_peek_ptr()))
+  {
+    if (lib_aci_data_is_stale())
+    {
+      sketch.stale++;
+    }
+    emu_data_read(&lib_aci_data_peek_ptr()->evt);
+    lib_aci_data_release(&aci_state);
+    return;
+  }
+#endif
+  if (!lib_aci_event_get(&aci_state, &aci_data))
+  {
+    return;
+  }
+  aci_evt = &aci_data.evt;
+  switch (aci_evt->evt_opcode)
+  {
+    case ACI_EVT_DEVICE_STARTED:
+      if (ACI_DEVICE_STANDBY == aci_evt->params.device_started.device_mode)
+      {
+        aci_state.data_credit_total = aci_evt->params.device_started.credit_available;
+        lib_aci_connect(180, 0x0050);
+      }
+      break;
+
+    case ACI_EVT_DISCONNECTED:
+      sketch.disconnected = true;
+      break;
+
+    case ACI_EVT_CMD_RSP:
+      if (sketch.temp_pending && (ACI_CMD_GET_TEMPERATURE == aci_evt->params.cmd_rsp.cmd_opcode))
+      {
+        round_trip_us        = mock_time_now_us() - sketch.temp_sent_us;
+        sketch.temp_pending  = false;
+        sketch.temps++;
+        sketch.temp_total_us += round_trip_us;
+        if (round_trip_us > sketch.temp_max_us)
+        {
+          sketch.temp_max_us = round_trip_us;
+        }
+      }
+      break;
+
+    case ACI_EVT_DATA_RECEIVED:
+      emu_data_read(aci_evt);
+      break;
+
+    default:
+      break;
+  }
+}
+
+static void emu_peer_write(void)
+{
+  uint8_t data[ACI_PIPE_RX_DATA_MAX_LEN];
+
+  memset(&data[0], peer.next, sizeof(data));
+  if (nrf8001_model_peer_write(EMU_PIPE, &data[0], sizeof(data)))
+  {
+    peer.next++;
+    peer.writes++;
+  }
+}
+
+static void emu_temperature(void)
+{
+  if (!sketch.temp_pending && ((int32_t)(mock_time_now_us() - sketch.busy_until_us) >= 0) &&
+      ((int32_t)(mock_time_now_us() - sketch.temp_next_us) >= 0) && lib_aci_get_temperature())
+  {
+    sketch.temp_pending  = true;
+    sketch.temp_sent_us  = mock_time_now_us();
+    sketch.temp_next_us += EMU_TEMP_US;
+  }
+}
+
+static void emu_step(void)
+{
+  nrf8001_model_run();
+  emu_aci_loop();
+  mock_time_advance_us(EMU_LOOP_US);
+}
+
+static void emu_connect(const nrf8001_model_config_t *p_model)
+{
+  uint32_t start_us;
+
+  mock_reset();
+  nrf8001_model_init(p_model);
+  nrf8001_model_aci_state_fill(&aci_state, p_model, &services_pipe_type_mapping[0], NUMBER_OF_PIPES,
+                               setup_msgs, NB_SETUP_MESSAGES);
+  memset(&sketch, 0, sizeof(sketch));
+  memset(&peer, 0, sizeof(peer));
+  sketch.in_order = true;
+
+  lib_aci_init(&aci_state, false);
+  start_us = mock_time_now_us();
+  while (!(nrf8001_model_is_connected() && lib_aci_is_pipe_available(&aci_state, EMU_PIPE)) &&
+         ((mock_time_now_us() - start_us) < EMU_TIMEOUT_US))
+  {
+    emu_step();
+  }
+}
+
+/* The peer writes in bursts while the sketch asks for the temperature */
+static bool emu_load(const nrf8001_model_config_t *p_model)
+{
+  uint32_t start_us;
+  uint32_t burst_us;
+  uint8_t  i;
+  bool     ok;
+
+  emu_connect(p_model);
+  start_us            = mock_time_now_us();
+  burst_us            = start_us;
+  sketch.temp_next_us = start_us;
+  while ((mock_time_now_us() - start_us) < (EMU_LOAD_US + EMU_BURST_US))
+  {
+    if (((mock_time_now_us() - start_us) < EMU_LOAD_US) && ((int32_t)(mock_time_now_us() - burst_us) >= 0))
+    {
+      for (i = 0; i < EMU_BURST; i++)
+      {
+        emu_peer_write();
+      }
+      burst_us += EMU_BURST_US;
+    }
+    emu_temperature();
+    emu_step();
+  }
+
+  /*
+    Every packet is read in order. With a data event queue that takes a burst the command response
+    waits at most for the data event the sketch is handling.
+  */
+  ok = sketch.in_order && (sketch.reads == peer.writes) && (0 != sketch.temps);
+#if EMU_QUEUE_TAKES(EMU_BURST - 1)
+  ok = ok && (sketch.temp_max_us <= (EMU_READ_US + 1000));
+#endif
+  printf("  %-6s %7u %6u %6s %6u %7.2f %7.2f %s\n",
+         "load", peer.writes, sketch.reads, "-", sketch.temps,
+         (0 != sketch.temps) ? sketch.temp_total_us / 1000.0 / sketch.temps : 0.0,
+         sketch.temp_max_us / 1000.0, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+/* The peer writes while the sketch is busy and drops the link before they are read */
+static bool emu_drop(const nrf8001_model_config_t *p_model, const char *name, bool peek)
+{
+  uint32_t start_us;
+  bool     dropped = false;
+  uint8_t  i;
+  bool     ok;
+
+  emu_connect(p_model);
+  sketch.peek          = peek;
+  start_us             = mock_time_now_us();
+  sketch.busy_until_us = start_us + EMU_DROP_BUSY_US;
+  for (i = 0; i < EMU_DROP_WRITES; i++)
+  {
+    emu_peer_write();
+  }
+  while (!(sketch.disconnected && (sketch.reads == peer.writes)) && ((mock_time_now_us() - start_us) < EMU_TIMEOUT_US))
+  {
+    if (!dropped && ((mock_time_now_us() - start_us) >= EMU_DROP_US))
+    {
+      nrf8001_model_peer_disconnect();
+      dropped = true;
+    }
+    emu_step();
+  }
+
+  /*
+    The data written are read in order, ahead of the ACI_EVT_DISCONNECTED from
+    lib_aci_event_get(), and flagged when read ahead of it with lib_aci_data_peek_ptr().
+  */
+  ok = sketch.in_order && (EMU_DROP_WRITES == peer.writes) && (sketch.reads == peer.writes) && sketch.disconnected;
+  if (peek)
+  {
+    ok = ok && (sketch.stale == peer.writes);
+  }
+  else
+  {
+    ok = ok && (sketch.reads_before_drop == peer.writes);
+  }
+  printf("  %-6s %7u %6u %6u %6s %7s %7s %s\n",
+         name, peer.writes, sketch.reads, sketch.stale, "-", "-", "-", ok ? "ok" : "FAILED");
+  return ok;
+}
+
+int main(void)
+{
+  nrf8001_model_config_t model;
+  bool                   ok;
+
+  nrf8001_model_config_default(&model);
+  model.setup_done             = true;
+  model.reset_pin              = 4;
+  model.interface_is_interrupt = true;
+
+#if ACI_RX_DATA_QUEUE_BYTES
+  printf("Data event queue of %u bytes", ACI_RX_DATA_QUEUE_BYTES);
+#else
+  printf("No data event queue");
+#endif
+  printf(", event queue of %u bytes, %u packets every %lu ms read in %lu ms, temperature every %lu ms\n",
+         ACI_RX_QUEUE_BYTES, EMU_BURST, EMU_BURST_US / 1000, EMU_READ_US / 1000, EMU_TEMP_US / 1000);
+  printf("  run    written   read  stale  temps  avg ms  max ms\n");
+  ok = emu_load(&model);
+  ok = emu_drop(&model, "drop", false) && ok;
+#if EMU_QUEUE_TAKES(EMU_DROP_WRITES)
+  ok = emu_drop(&model, "peek", true) && ok;
+#endif
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,468 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+/** @file
+ * @brief Sharing the data credits between services with aci_scheduler against the nRF8001 model
+ *
+ * Three services of ble_HID_template_HID_HRM send on one link: keys typed on the HID report pipe,
+ * a press and a release report each, a bulk stream of measurements on the heart rate pipe, and
+ * the battery level now and then. The bulk stream either always has data, or comes in bursts.
+ *
+ * The loop of the templates calls lib_aci_send_data() for each service in turn when there is a
+ * credit, the bulk stream first as the heart rate of ble_heart_rate_template_with_battery_service.
+ * It takes every credit that comes back and the key reports wait until it has nothing left to
+ * send. With aci_scheduler each service is a flow with a weight and a deadline, and the credits
+ * are shared between the flows that have values waiting.
+ *
+ * The peer checks that the keys come in the order typed and measures the latency from a key typed
+ * to its press at the peer, and from a battery level put to its arrival.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "arduino_mock.h"
+#include "SPI.h"
+#include "hal_platform.h"
+#include "lib_aci.h"
+#include "aci_scheduler.h"
+#include "nrf8001_model.h"
+#include "../../libraries/BLE/examples/ble_HID_template_HID_HRM/services.h"
+
+#define EMU_LOOP_US       20          // Time taken by one pass of loop() outside the library
+#define EMU_TIMEOUT_US    60000000UL  // A run that takes longer stops there
+#define EMU_KEYS          100
+#define EMU_KEY_US        50000UL     // Between the keys
+#define EMU_REPORT_LEN    8
+#define EMU_BULK_LEN      8
+#define EMU_BURST         40          // Bulk values in a burst
+#define EMU_BURST_US      500000UL    // Between the bursts
+#define EMU_BATTERY_US    200000UL    // Between the battery levels
+#define EMU_LEGACY_QUEUE  16          // Key reports the loop of the templates keeps
+
+#define EMU_KEY_PIPE      PIPE_HID_SERVICE_HID_REPORT1_TX
+#define EMU_BULK_PIPE     PIPE_HEART_RATE_HEART_RATE_MEASUREMENT_TX
+#define EMU_BATTERY_PIPE  PIPE_BATTERY_BATTERY_LEVEL_TX
+
+static services_pipe_type_mapping_t services_pipe_type_mapping[NUMBER_OF_PIPES] = SERVICES_PIPE_TYPE_MAPPING_CONTENT;
+static const hal_aci_data_t setup_msgs[NB_SETUP_MESSAGES] PROGMEM = SETUP_MESSAGES_CONTENT;
+
+static aci_state_t     aci_state;
+static hal_aci_evt_t   aci_data;
+static aci_scheduler_t scheduler;
+static bool            emu_failed;  // A run printed FAILED, main() returns 1
+
+typedef struct
+{
+  const char *name;
+  bool        legacy;            // The loop of the templates, the weights are not used
+  uint8_t     key_weight;
+  uint16_t    key_deadline_ms;
+  uint8_t     bulk_weight;
+  uint8_t     battery_weight;
+} emu_config_t;
+
+static uint8_t key_flow;
+static uint8_t bulk_flow;
+static uint8_t battery_flow;
+
+/* The services */
+static struct
+{
+  bool     stream;               // The bulk stream always has data, else it comes in bursts
+  uint32_t bulk_backlog;         // Bulk values not yet put or sent
+  uint32_t next_burst_us;
+  uint32_t keys_typed;
+  uint32_t keys_refused;
+  uint32_t next_key_us;
+  uint32_t key_us[EMU_KEYS];
+  uint32_t accepted[EMU_KEYS];   // Keys that found room, in the order typed
+  uint32_t accepted_count;
+  uint8_t  battery_level;
+  uint32_t next_battery_us;
+  uint32_t battery_put_us;
+  uint32_t battery_puts;
+} app;
+
+/* Key reports waiting in the loop of the templates */
+static struct
+{
+  uint8_t  reports[EMU_LEGACY_QUEUE];   // The keycode, 0 for a release
+  uint8_t  head;
+  uint8_t  tail;
+  bool     battery_pending;
+} legacy;
+
+/* The peer */
+static struct
+{
+  uint32_t keys;
+  bool     in_order;
+  uint32_t key_latency_max_us;
+  uint64_t key_latency_sum_us;
+  uint32_t bulk;
+  uint32_t battery;
+  uint32_t battery_latency_max_us;
+} peer;
+
+static uint8_t emu_keycode(uint32_t key)
+{
+  return (uint8_t)(0x04 + (key % 26));
+}
+
+static void emu_peer_read(uint8_t pipe, const uint8_t *p_data, uint8_t length)
+{
+  uint32_t latency_us;
+  uint32_t key;
+
+  if ((EMU_KEY_PIPE == pipe) && (EMU_REPORT_LEN == length) && (0 != p_data[2]))
+  {
+    if (peer.keys >= app.accepted_count)
+    {
+      peer.in_order = false;
+      return;
+    }
+    key = app.accepted[peer.keys];
+    if (p_data[2] != emu_keycode(key))
+    {
+      peer.in_order = false;
+    }
+    latency_us = mock_time_now_us() - app.key_us[key];
+    if (latency_us > peer.key_latency_max_us)
+    {
+      peer.key_latency_max_us = latency_us;
+    }
+    peer.key_latency_sum_us += latency_us;
+    peer.keys++;
+  }
+  else if (EMU_BULK_PIPE == pipe)
+  {
+    peer.bulk++;
+  }
+  else if (EMU_BATTERY_PIPE == pipe)
+  {
+    // The level sent is the latest one put, its latency counts from that put
+    latency_us = mock_time_now_us() - app.battery_put_us;
+    if (latency_us > peer.battery_latency_max_us)
+    {
+      peer.battery_latency_max_us = latency_us;
+    }
+    peer.battery++;
+  }
+}
+
+static void emu_aci_loop(const emu_config_t *p_config)
+{
+  aci_evt_t *aci_evt;
+
+  if (lib_aci_event_get(&aci_state, &aci_data))
+  {
+    aci_evt = &aci_data.evt;
+    if (!p_config->legacy)
+    {
+      aci_scheduler_event(&scheduler, &aci_state, aci_evt);
+    }
+
+    if ((ACI_EVT_DEVICE_STARTED == aci_evt->evt_opcode) &&
+        (ACI_DEVICE_STANDBY == aci_evt->params.device_started.device_mode))
+    {
+      aci_state.data_credit_total = aci_evt->params.device_started.credit_available;
+      lib_aci_connect(180, 0x0050);
+    }
+  }
+}
+
+static bool emu_connected(void)
+{
+  return nrf8001_model_is_connected() &&
+         lib_aci_is_pipe_available(&aci_state, EMU_KEY_PIPE) &&
+         lib_aci_is_pipe_available(&aci_state, EMU_BULK_PIPE) &&
+         lib_aci_is_pipe_available(&aci_state, EMU_BATTERY_PIPE);
+}
+
+/* Puts a key report, the press or the release */
+static bool emu_key_put(const emu_config_t *p_config, uint8_t keycode)
+{
+  uint8_t report[EMU_REPORT_LEN];
+
+  if (p_config->legacy)
+  {
+    if (EMU_LEGACY_QUEUE == (uint8_t)(legacy.head - legacy.tail))
+    {
+      return false;
+    }
+    legacy.reports[legacy.head++ % EMU_LEGACY_QUEUE] = keycode;
+    return true;
+  }
+  memset(report, 0, sizeof(report));
+  report[2] = keycode;
+  return aci_scheduler_put(&scheduler, key_flow, &report[0], EMU_REPORT_LEN);
+}
+
+static uint8_t emu_key_room(const emu_config_t *p_config)
+{
+  if (p_config->legacy)
+  {
+    return EMU_LEGACY_QUEUE - (uint8_t)(legacy.head - legacy.tail);
+  }
+  return ACI_SCHEDULER_FLOW_DEPTH - aci_scheduler_pending(&scheduler, key_flow);
+}
+
+/*
+  The services put their values: a key every EMU_KEY_US, the bulk values while there is room
+  and the battery level every EMU_BATTERY_US.
+*/
+static void emu_services(const emu_config_t *p_config)
+{
+  const uint32_t now_us = mock_time_now_us();
+  uint8_t        value[EMU_BULK_LEN];
+
+  if ((app.keys_typed < EMU_KEYS) && ((int32_t)(now_us - app.next_key_us) >= 0))
+  {
+    app.key_us[app.keys_typed] = now_us;
+    if (emu_key_room(p_config) >= 2)
+    {
+      emu_key_put(p_config, emu_keycode(app.keys_typed));
+      emu_key_put(p_config, 0x00);
+      app.accepted[app.accepted_count++] = app.keys_typed;
+    }
+    else
+    {
+      app.keys_refused++;
+    }
+    app.keys_typed++;
+    app.next_key_us += EMU_KEY_US;
+  }
+
+  if (!app.stream && ((int32_t)(now_us - app.next_burst_us) >= 0))
+  {
+    app.bulk_backlog  += EMU_BURST;
+    app.next_burst_us += EMU_BURST_US;
+  }
+  if (!p_config->legacy)
+  {
+    memset(value, 0x5A, sizeof(value));
+    while ((app.stream || (0 != app.bulk_backlog)) &&
+           (aci_scheduler_pending(&scheduler, bulk_flow) < ACI_SCHEDULER_FLOW_DEPTH))
+    {
+      aci_scheduler_put(&scheduler, bulk_flow, &value[0], EMU_BULK_LEN);
+      if (!app.stream)
+      {
+        app.bulk_backlog--;
+      }
+    }
+  }
+
+  if ((int32_t)(now_us - app.next_battery_us) >= 0)
+  {
+    app.battery_level  = (uint8_t)(100 - (app.battery_puts % 100));
+    app.battery_put_us = now_us;
+    app.battery_puts++;
+    app.next_battery_us += EMU_BATTERY_US;
+    if (p_config->legacy)
+    {
+      legacy.battery_pending = true;
+    }
+    else
+    {
+      aci_scheduler_put(&scheduler, battery_flow, &app.battery_level, 1);
+    }
+  }
+}
+
+/*
+  The loop of the templates: each service sends when there is a credit, the bulk stream first.
+*/
+static void emu_loop_legacy(void)
+{
+  uint8_t value[EMU_BULK_LEN];
+  uint8_t report[EMU_REPORT_LEN];
+
+  memset(value, 0x5A, sizeof(value));
+  while ((app.stream || (0 != app.bulk_backlog)) && (aci_state.data_credit_available > 0))
+  {
+    if (!lib_aci_send_data(EMU_BULK_PIPE, &value[0], EMU_BULK_LEN))
+    {
+      break;
+    }
+    if (!app.stream)
+    {
+      app.bulk_backlog--;
+    }
+  }
+
+  if ((legacy.head != legacy.tail) && (aci_state.data_credit_available > 0))
+  {
+    memset(report, 0, sizeof(report));
+    report[2] = legacy.reports[legacy.tail % EMU_LEGACY_QUEUE];
+    if (lib_aci_send_data(EMU_KEY_PIPE, &report[0], EMU_REPORT_LEN))
+    {
+      legacy.tail++;
+    }
+  }
+
+  if (legacy.battery_pending && (aci_state.data_credit_available > 0))
+  {
+    if (lib_aci_send_data(EMU_BATTERY_PIPE, &app.battery_level, 1))
+    {
+      legacy.battery_pending = false;
+    }
+  }
+}
+
+static void emu_start(const nrf8001_model_config_t *p_model, const emu_config_t *p_config)
+{
+  static aci_scheduler_flow_params_t key_params;
+  static aci_scheduler_flow_params_t bulk_params;
+  static aci_scheduler_flow_params_t battery_params;
+
+  mock_reset();
+  nrf8001_model_init(p_model);
+  nrf8001_model_peer_read_set(emu_peer_read);
+
+  nrf8001_model_aci_state_fill(&aci_state, p_model, &services_pipe_type_mapping[0], NUMBER_OF_PIPES,
+                               setup_msgs, NB_SETUP_MESSAGES);
+
+  memset(&legacy, 0, sizeof(legacy));
+  memset(&peer, 0, sizeof(peer));
+  peer.in_order = true;
+
+  key_params.pipe            = EMU_KEY_PIPE;
+  key_params.weight          = p_config->key_weight;
+  key_params.deadline_ms     = p_config->key_deadline_ms;
+  key_params.replace         = false;
+  bulk_params.pipe           = EMU_BULK_PIPE;
+  bulk_params.weight         = p_config->bulk_weight;
+  bulk_params.deadline_ms    = 0;
+  bulk_params.replace        = false;
+  battery_params.pipe        = EMU_BATTERY_PIPE;
+  battery_params.weight      = p_config->battery_weight;
+  battery_params.deadline_ms = 0;
+  battery_params.replace     = true;   // Only the latest level counts
+  aci_scheduler_init(&scheduler);
+  if (!p_config->legacy)
+  {
+    key_flow     = aci_scheduler_flow_add(&scheduler, &key_params);
+    bulk_flow    = aci_scheduler_flow_add(&scheduler, &bulk_params);
+    battery_flow = aci_scheduler_flow_add(&scheduler, &battery_params);
+  }
+
+  lib_aci_init(&aci_state, false);
+  while (!emu_connected() && (mock_time_now_us() < EMU_TIMEOUT_US))
+  {
+    nrf8001_model_run();
+    emu_aci_loop(p_config);
+    mock_time_advance_us(EMU_LOOP_US);
+  }
+}
+
+/*
+  Types EMU_KEYS keys with the bulk stream and the battery level sent alongside, until the keys
+  typed are at the peer.
+*/
+static void emu_run(const nrf8001_model_config_t *p_model, const emu_config_t *p_config, bool stream)
+{
+  nrf8001_model_stats_t model_stats;
+  char                  latency[24];
+  uint32_t              start_us;
+  uint32_t              end_us;
+  uint32_t              typed_us;
+  bool                  ok;
+
+  emu_start(p_model, p_config);
+  memset(&app, 0, sizeof(app));
+  app.stream          = stream;
+  start_us            = mock_time_now_us();
+  app.next_key_us     = start_us;
+  app.next_burst_us   = start_us;
+  app.next_battery_us = start_us;
+  typed_us            = start_us + EMU_KEYS * EMU_KEY_US;
+
+  // A key that has not arrived a second after the last one typed is not coming
+  while (((mock_time_now_us() - start_us) < (EMU_KEYS * EMU_KEY_US)) ||
+         ((peer.keys < app.accepted_count) && ((mock_time_now_us() - typed_us) < 1000000UL)))
+  {
+    nrf8001_model_run();
+    emu_services(p_config);
+    emu_aci_loop(p_config);
+    if (p_config->legacy)
+    {
+      emu_loop_legacy();
+    }
+    else
+    {
+      aci_scheduler_poll(&scheduler, &aci_state);
+    }
+    mock_time_advance_us(EMU_LOOP_US);
+  }
+  end_us = mock_time_now_us();
+
+  ok = peer.in_order && (peer.keys == app.accepted_count);
+  if (0 != peer.keys)
+  {
+    snprintf(latency, sizeof(latency), "%6.1f %6.1f", (double)peer.key_latency_sum_us / peer.keys / 1000.0,
+             peer.key_latency_max_us / 1000.0);
+  }
+  else
+  {
+    snprintf(latency, sizeof(latency), "%6s %6s", "-", "-");
+  }
+
+  // The loop of the templates is the baseline, its keys starve behind the bulk stream
+  emu_failed = emu_failed || (!ok && !p_config->legacy);
+  nrf8001_model_stats_get(&model_stats);
+  printf("  %-9s %-6s %4lu %4lu %s %8.1f %4lu %7.1f %6lu %s\n",
+         p_config->name, stream ? "stream" : "burst",
+         (unsigned long)peer.keys, (unsigned long)app.keys_refused, latency,
+         peer.bulk * 1000000.0 / (end_us - start_us), (unsigned long)peer.battery,
+         peer.battery_latency_max_us / 1000.0, (unsigned long)model_stats.credit_errors,
+         ok ? "ok" : "FAILED");
+}
+
+int main(void)
+{
+  static const emu_config_t configs[] =
+  {
+    { "legacy",   true,  0,  0, 0, 0 },
+    { "1/1/1",    false, 1,  0, 1, 1 },
+    { "1/8/1",    false, 1,  0, 8, 1 },
+    { "1/8/1 dl", false, 1, 20, 8, 1 },
+    { "4/1/1",    false, 4,  0, 1, 1 },
+  };
+  nrf8001_model_config_t model;
+  uint8_t                i;
+
+  nrf8001_model_config_default(&model);
+  model.setup_done = true;
+  model.reset_pin  = 4;
+
+  printf("%u keys every %lu ms, bulk of %u byte values, battery every %lu ms, %.2f ms connection interval, %u credits\n",
+         EMU_KEYS, EMU_KEY_US / 1000, EMU_BULK_LEN, EMU_BATTERY_US / 1000, model.conn_interval * 1.25,
+         model.credits);
+  printf("weights key/bulk/battery, dl: key deadline of 20 ms\n");
+  printf("  flows     bulk   keys lost lat ms max ms   bulk/s batt batt ms crderr\n");
+  for (i = 0; i < sizeof(configs) / sizeof(configs[0]); i++)
+  {
+    emu_run(&model, &configs[i], true);
+    emu_run(&model, &configs[i], false);
+  }
+  return emu_failed ? 1 : 0;
+}
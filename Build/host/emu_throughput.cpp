@@ -0,0 +1,502 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/** @file
+ * @brief Throughput and latency of the BLE library against the nRF8001 model
+ *
+ * Runs the loop of the ble_bandwidth_test example (20 byte packets on the UART TX pipe for as
+ * long as there are credits) and an echo loop as in ble_uart_project_template, on the virtual
+ * clock, for a set of connection intervals, packets per connection event and transports.
+ * The setup is the one of ble_bandwidth_test.
+ */
+
+#include <stdio.h>
+#include "arduino_mock.h"
+#include "SPI.h"
+#include "hal_platform.h"
+#include "lib_aci.h"
+#include "aci_setup.h"
+#include "nrf8001_model.h"
+#include "../../libraries/BLE/examples/ble_bandwidth_test/services.h"
+#if ACI_SETUP_COMPRESSED
+// Made by the Makefile with Build/CompressSetup.py
+#include "services_compressed.h"
+#endif
+
+#define EMU_RUN_US          5000000UL   // Simulated time of a run once the pipe is open
+#define EMU_LOOP_US         20          // Time taken by one pass of loop() outside the library
+#define EMU_ECHO_PERIOD_US  50000UL     // The peer writes this often in the echo run
+#define EMU_ACTIVE_PIN      5           // ACTIVE of the model with HAL_ACI_TL_ACTIVE
+#define EMU_QUIET_WORK_US   1000        // Work run in the quiet windows with HAL_ACI_TL_ACTIVE
+#define EMU_BUSY_EVERY      10          // SendData failed as Busy in the run of LIB_ACI_RETRANSMIT_SLOTS
+
+static services_pipe_type_mapping_t services_pipe_type_mapping[NUMBER_OF_PIPES] = SERVICES_PIPE_TYPE_MAPPING_CONTENT;
+static const hal_aci_data_t setup_msgs[NB_SETUP_MESSAGES] PROGMEM = SETUP_MESSAGES_CONTENT;
+#if ACI_SETUP_COMPRESSED
+static const uint8_t setup_msgs_compressed[SETUP_MESSAGES_COMPRESSED_SIZE] PROGMEM = SETUP_MESSAGES_COMPRESSED_CONTENT;
+#endif
+
+static aci_state_t    aci_state;
+static hal_aci_evt_t  aci_data;
+static bool           emu_failed;  // A run did not connect or sent without a credit, main() returns 1
+
+typedef struct
+{
+  bool     tx_on;
+  uint32_t init_us;
+  uint32_t bytes_start;           // Bytes the model had sent when the pipe opened
+  uint32_t tx_start_us;
+  uint32_t sent;
+  uint32_t refused;
+  uint32_t pipe_errors;
+  uint32_t loops;
+  uint32_t queue_full_loops;
+  uint32_t echo_written_us;
+  uint32_t echoes;
+  uint32_t rx_latency_sum_us;
+  uint32_t rx_latency_max_us;
+  bool     setup_required;
+  uint8_t  setup_result;
+#if HAL_ACI_TL_ACTIVE
+  uint32_t quiet_loops;           // Loops that found a quiet window of EMU_QUIET_WORK_US
+  uint32_t quiet_until_us;        // End of the work started in the last quiet window
+  uint32_t quiet_overlaps;        // Quiet windows that had ACTIVE go high before their end
+#endif
+} emu_run_t;
+
+static emu_run_t run;
+
+static uint8_t data_input[20] = { 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A,
+                                  0x6B, 0x6C, 0x6D, 0x6E, 0x6F, 0x70, 0x71, 0x72, 0x00, 0x00 };
+
+/*
+  power_on starts the nRF8001 model too, otherwise only the MCU restarts and the model keeps
+  its state, as after a watchdog reset.
+*/
+static void emu_init(const nrf8001_model_config_t *p_model, bool power_on)
+{
+  if (power_on)
+  {
+    mock_reset();
+    nrf8001_model_init(p_model);
+  }
+
+  memset(&run, 0, sizeof(run));
+  nrf8001_model_aci_state_fill(&aci_state, p_model, &services_pipe_type_mapping[0], NUMBER_OF_PIPES,
+                               setup_msgs, NB_SETUP_MESSAGES);
+#if ACI_SETUP_COMPRESSED
+  aci_state.aci_setup_info.setup_msgs_compressed = setup_msgs_compressed;
+#endif
+
+#if ACI_SETUP_PATCHES
+  {
+    /* Patches in the first and the second to last message, the model checks the CRC */
+    static const uint8_t serial[] = { 0x12, 0x34, 0x56, 0x78 };
+
+    aci_setup_patch_clear(&aci_state);
+    aci_setup_patch(&aci_state, 1, 8, serial, sizeof(serial));
+    aci_setup_patch(&aci_state, 1, 10, serial, 1);
+    aci_setup_patch(&aci_state, NB_SETUP_MESSAGES - 2, 4, serial, sizeof(serial));
+  }
+#endif
+#if ACI_SETUP_RETAIN
+  if (power_on)
+  {
+    /* The retained RAM holds no record after a power on */
+    aci_setup_retain_clear(&aci_state);
+  }
+#endif
+  run.init_us = mock_time_now_us();
+  lib_aci_init(&aci_state, false);
+}
+
+/*
+  The event handling of the examples, cut down to what the runs need.
+*/
+static void emu_aci_loop(void)
+{
+  aci_evt_t *aci_evt;
+
+  /* The setup runs a step per pass of the loop, the events are its own until it is done */
+  if (run.setup_required)
+  {
+    run.setup_result = aci_setup_poll(&aci_state);
+    run.setup_required = (SETUP_IN_PROGRESS == run.setup_result);
+    return;
+  }
+
+  if (!lib_aci_event_get(&aci_state, &aci_data))
+  {
+    return;
+  }
+  aci_evt = &aci_data.evt;
+
+  switch (aci_evt->evt_opcode)
+  {
+    case ACI_EVT_DEVICE_STARTED:
+      aci_state.data_credit_total = aci_evt->params.device_started.credit_available;
+      if (ACI_DEVICE_SETUP == aci_evt->params.device_started.device_mode)
+      {
+        run.setup_required = true;
+      }
+      else if (ACI_DEVICE_STANDBY == aci_evt->params.device_started.device_mode)
+      {
+        lib_aci_connect(180, 0x0050);
+      }
+      break;
+
+    case ACI_EVT_PIPE_STATUS:
+      if (!run.tx_on && lib_aci_is_pipe_available(&aci_state, PIPE_UART_OVER_BTLE_UART_TX_TX))
+      {
+        nrf8001_model_stats_t model_stats;
+
+        nrf8001_model_stats_get(&model_stats);
+        run.tx_on       = true;
+        run.tx_start_us = mock_time_now_us();
+        run.bytes_start = model_stats.bytes_sent;
+      }
+      break;
+
+    case ACI_EVT_DATA_RECEIVED:
+      {
+        const uint32_t latency = mock_time_now_us() - run.echo_written_us;
+
+        run.echoes++;
+        run.rx_latency_sum_us += latency;
+        if (latency > run.rx_latency_max_us)
+        {
+          run.rx_latency_max_us = latency;
+        }
+        if (aci_state.data_credit_available > 0)
+        {
+          lib_aci_send_data(PIPE_UART_OVER_BTLE_UART_TX_TX, aci_evt->params.data_received.rx_data.aci_data,
+                            aci_evt->len - 2);
+        }
+      }
+      break;
+
+    case ACI_EVT_PIPE_ERROR:
+      run.pipe_errors++;
+      break;
+
+    case ACI_EVT_DISCONNECTED:
+      run.tx_on = false;
+      lib_aci_connect(180, 0x0050);
+      break;
+
+    default:
+      break;
+  }
+}
+
+/*
+  Runs the loop until EMU_RUN_US after the TX pipe has opened.
+  bandwidth sends as in ble_bandwidth_test, otherwise the peer writes and the sketch echoes.
+*/
+static void emu_loop(bool bandwidth)
+{
+  const uint32_t give_up_us = 2000000UL;
+
+  while (!run.tx_on || ((mock_time_now_us() - run.tx_start_us) < EMU_RUN_US))
+  {
+    if (!run.tx_on && ((mock_time_now_us() - run.init_us) > give_up_us))
+    {
+      break;
+    }
+
+    nrf8001_model_run();
+    emu_aci_loop();
+
+    if (run.tx_on && bandwidth && (aci_state.data_credit_available > 0))
+    {
+      data_input[18] = (uint8_t)(run.sent >> 8);
+      data_input[19] = (uint8_t)(run.sent);
+      if (lib_aci_send_data(PIPE_UART_OVER_BTLE_UART_TX_TX, data_input, sizeof(data_input)))
+      {
+        run.sent++;
+      }
+      else
+      {
+        run.refused++;
+      }
+    }
+    if (run.tx_on && !bandwidth && ((mock_time_now_us() - run.echo_written_us) >= EMU_ECHO_PERIOD_US))
+    {
+      run.echo_written_us = mock_time_now_us();
+      nrf8001_model_peer_write(PIPE_UART_OVER_BTLE_UART_RX_RX, data_input, sizeof(data_input));
+    }
+
+#if HAL_ACI_TL_ACTIVE
+    /* The work is not run, the window is only checked against the ACTIVE of the model */
+    if (run.tx_on && ((int32_t)(mock_time_now_us() - run.quiet_until_us) >= 0) &&
+        hal_aci_tl_quiet_window(EMU_QUIET_WORK_US))
+    {
+      run.quiet_loops++;
+      run.quiet_until_us = mock_time_now_us() + EMU_QUIET_WORK_US;
+    }
+    else if (((int32_t)(mock_time_now_us() - run.quiet_until_us) < 0) && (HIGH == mock_pin_get(EMU_ACTIVE_PIN)))
+    {
+      run.quiet_overlaps++;
+      run.quiet_until_us = mock_time_now_us();
+    }
+#endif
+
+    run.loops++;
+    if (lib_aci_command_queue_full())
+    {
+      run.queue_full_loops++;
+    }
+    mock_time_advance_us(EMU_LOOP_US);
+  }
+}
+
+#if LIB_ACI_LINK_HISTORY
+static void emu_report_link(void)
+{
+  lib_aci_link_record_t link;
+
+  if (0 == lib_aci_link_history_get(&aci_state, &link, 1))
+  {
+    return;
+  }
+  printf("  link: interval %u (%u..%u), latency %u, timeout %u, %u timing changes, %u pipe errors,"
+         " starved %lu ms (%u times, max %u ms), %s %lu ms\n",
+         link.interval, link.interval_min, link.interval_max, link.slave_latency,
+         link.supervision_timeout, link.timing_changes, link.pipe_errors, (unsigned long)link.starved_ms,
+         link.starved_count, link.starved_max_ms, (0 == link.duration_ms) ? "connected" : "lasted",
+         (unsigned long)((0 == link.duration_ms) ? millis() - link.connected_ms : link.duration_ms));
+}
+#endif
+
+#if LIB_ACI_CREDIT_FORECAST
+static void emu_report_forecast(void)
+{
+  lib_aci_throughput_t throughput;
+
+  lib_aci_throughput_get(&aci_state, &throughput);
+  printf("  forecast: %lu B/s, %u packets/s, %u.%02u credits per event (%s), %lu ms for all credits\n",
+         (unsigned long)throughput.bytes_per_s, throughput.packets_per_s, throughput.credits_per_event / 16,
+         (throughput.credits_per_event % 16) * 100 / 16, throughput.measured ? "measured" : "estimated",
+         (unsigned long)lib_aci_credit_wait_ms(&aci_state, aci_state.data_credit_total));
+}
+#endif
+
+#if LIB_ACI_RETRANSMIT_SLOTS
+static uint8_t  emu_peer_got[65536 / 8];  // Packet numbers the peer has, one bit each
+static uint16_t emu_peer_next;            // Packet number the peer expects next
+static uint32_t emu_peer_late;            // Packets that came after one sent later
+
+static void emu_peer_read(uint8_t pipe, const uint8_t *p_data, uint8_t length)
+{
+  uint16_t number;
+
+  if ((PIPE_UART_OVER_BTLE_UART_TX_TX != pipe) || (sizeof(data_input) != length))
+  {
+    return;
+  }
+  number = (uint16_t)((p_data[18] << 8) | p_data[19]);
+  if ((int16_t)(number - emu_peer_next) < 0)
+  {
+    emu_peer_late++;
+  }
+  else
+  {
+    emu_peer_next = (uint16_t)(number + 1);
+  }
+  emu_peer_got[number / 8] |= (uint8_t)(1 << (number % 8));
+}
+
+/* Packets numbered below the newest one of the peer that it never got, the last ones may be in flight */
+static uint32_t emu_peer_lost(void)
+{
+  uint32_t lost = 0;
+  uint32_t i;
+
+  for (i = 0; i < emu_peer_next; i++)
+  {
+    if (0 == (emu_peer_got[i / 8] & (1 << (i % 8))))
+    {
+      lost++;
+    }
+  }
+  return lost;
+}
+
+static void emu_report_retransmit(void)
+{
+  lib_aci_retransmit_stats_t stats;
+  nrf8001_model_stats_t      model_stats;
+
+  lib_aci_retransmit_stats_get(&aci_state, &stats);
+  nrf8001_model_stats_get(&model_stats);
+  printf("  retransmit: %lu busy errors, %u sent again, %u recovered, %u dropped, %u refused,"
+         " the peer got %lu late and lost %lu\n",
+         (unsigned long)model_stats.busy_errors, stats.retries, stats.recovered, stats.dropped,
+         stats.refused, (unsigned long)emu_peer_late, (unsigned long)emu_peer_lost());
+}
+#endif
+
+#if LIB_ACI_STARTUP_PROFILE
+static void emu_report_profile(void)
+{
+  lib_aci_startup_profile_t profile;
+
+  lib_aci_startup_profile_get(&aci_state, &profile);
+  printf("  startup us: reset %lu, board init %lu, started %lu, setup %lu..%lu (%u msgs, %u..%u us),"
+         " standby %lu, advertising %lu\n",
+         (unsigned long)profile.reset_us, (unsigned long)profile.board_init_us,
+         (unsigned long)profile.device_started_us, (unsigned long)profile.setup_start_us,
+         (unsigned long)profile.setup_complete_us, profile.setup_msgs, profile.setup_msg_min_us,
+         profile.setup_msg_max_us, (unsigned long)profile.standby_us, (unsigned long)profile.advertising_us);
+}
+#endif
+
+#if HAL_ACI_TL_ACTIVE
+static void emu_report_active(void)
+{
+  nrf8001_model_stats_t model_stats;
+  hal_aci_tl_active_t   active;
+
+  nrf8001_model_stats_get(&model_stats);
+  hal_aci_tl_active_get(&active);
+  printf("  active: %lu events, last %u us, max %u us, period %lu us, duty %u permille,"
+         " %lu us of %lu us in the model; %lu quiet windows, %lu overlapped ACTIVE\n",
+         (unsigned long)active.events, active.last_active_us, active.max_active_us,
+         (unsigned long)active.period_us, active.duty_permille, (unsigned long)active.active_us,
+         (unsigned long)model_stats.active_us, (unsigned long)run.quiet_loops,
+         (unsigned long)run.quiet_overlaps);
+}
+#endif
+
+static void emu_report(const char *p_name, const nrf8001_model_config_t *p_model, bool interrupt)
+{
+  nrf8001_model_stats_t model_stats;
+  hal_aci_tl_stats_t    tl_stats;
+  const uint32_t        run_us = mock_time_now_us() - run.tx_start_us;
+
+  nrf8001_model_stats_get(&model_stats);
+  hal_aci_tl_stats_get(&tl_stats);
+
+  emu_failed = emu_failed || !run.tx_on || (0 != model_stats.credit_errors);
+  if (!run.tx_on)
+  {
+    printf("%-9s %6.2f %3u %-9s no connection, setup result %u\n", p_name, p_model->conn_interval * 1.25,
+           p_model->packets_per_event, interrupt ? "interrupt" : "polling", run.setup_result);
+    return;
+  }
+
+  printf("%-9s %6.2f %3u %-9s %6.1f %8lu %8.2f %7.2f %4u %4u %3u %5.1f %7lu %6lu %6lu %6u\n",
+         p_name, p_model->conn_interval * 1.25, p_model->packets_per_event,
+         interrupt ? "interrupt" : "polling",
+         (double)(run.tx_start_us - run.init_us) / 1000.0,
+         (unsigned long)((uint64_t)(model_stats.bytes_sent - run.bytes_start) * 1000000ULL / run_us),
+         run.echoes ? (double)run.rx_latency_sum_us / run.echoes / 1000.0 : 0.0,
+         (double)run.rx_latency_max_us / 1000.0,
+         tl_stats.tx_q_high_water, tl_stats.rx_q_high_water, model_stats.event_q_high_water,
+         100.0 * run.queue_full_loops / run.loops,
+         (unsigned long)tl_stats.spi_transfers, (unsigned long)run.refused,
+         (unsigned long)(model_stats.credit_errors + run.pipe_errors), tl_stats.rx_credit_coalesced);
+}
+
+int main(void)
+{
+  static const uint16_t intervals[]  = { 6, 12, 24, 80 };
+  static const uint8_t  per_event[]  = { 1, 4, 6 };
+  nrf8001_model_config_t model;
+  uint8_t i;
+  uint8_t j;
+  uint8_t mode;
+
+  printf("%-9s %6s %3s %-9s %6s %8s %8s %7s %4s %4s %3s %5s %7s %6s %6s %6s\n",
+         "run", "cx ms", "pkt", "transport", "up ms", "B/s", "rx ms", "rx max", "txhw", "rxhw", "evq",
+         "full%", "spi", "refusd", "errors", "crdmrg");
+
+  for (mode = 0; mode < 2; mode++)
+  {
+    for (i = 0; i < sizeof(intervals) / sizeof(intervals[0]); i++)
+    {
+      for (j = 0; j < sizeof(per_event); j++)
+      {
+        nrf8001_model_config_default(&model);
+        model.reset_pin              = 4;
+        model.interface_is_interrupt = (1 == mode);
+        model.conn_interval          = intervals[i];
+        model.packets_per_event      = per_event[j];
+#if HAL_ACI_TL_ACTIVE
+        model.active_pin             = EMU_ACTIVE_PIN;
+#endif
+
+        emu_init(&model, true);
+        emu_loop(true);
+        emu_report("bandwidth", &model, model.interface_is_interrupt);
+#if HAL_ACI_TL_ACTIVE
+        emu_report_active();
+#endif
+#if LIB_ACI_LINK_HISTORY
+        emu_report_link();
+#endif
+#if LIB_ACI_CREDIT_FORECAST
+        emu_report_forecast();
+#endif
+      }
+    }
+
+    nrf8001_model_config_default(&model);
+    model.reset_pin              = 4;
+    model.interface_is_interrupt = (1 == mode);
+#if HAL_ACI_TL_ACTIVE
+    model.active_pin             = EMU_ACTIVE_PIN;
+#endif
+    emu_init(&model, true);
+    emu_loop(false);
+    emu_report("echo", &model, model.interface_is_interrupt);
+#if HAL_ACI_TL_ACTIVE
+    emu_report_active();
+#endif
+#if LIB_ACI_STARTUP_PROFILE
+    emu_report_profile();
+#endif
+
+    /* The MCU restarts in the middle of the link, the nRF8001 does not */
+    emu_init(&model, false);
+    emu_loop(true);
+    emu_report("restart", &model, model.interface_is_interrupt);
+#if LIB_ACI_STARTUP_PROFILE
+    emu_report_profile();
+#endif
+
+#if LIB_ACI_RETRANSMIT_SLOTS
+    /* The nRF8001 fails a SendData now and then, the pool sends it again */
+    model.busy_every = EMU_BUSY_EVERY;
+    emu_init(&model, true);
+    nrf8001_model_peer_read_set(emu_peer_read);
+    memset(emu_peer_got, 0, sizeof(emu_peer_got));
+    emu_peer_next = 0;
+    emu_peer_late = 0;
+    emu_loop(true);
+    emu_report("busy", &model, model.interface_is_interrupt);
+    emu_report_retransmit();
+    model.busy_every = 0;
+#endif
+  }
+  return emu_failed ? 1 : 0;
+}
@@ -0,0 +1,344 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+ 
+/** @file
+ * @brief Tuning of the connection parameters with aci_tuner against the nRF8001 model
+ *
+ * ble_bandwidth_test sends on the UART TX pipe in two backlogs, with idle time after each. The
+ * peer starts at a 100 ms connection interval and takes the longest interval of a ChangeTiming.
+ * The commands the model receives are logged: aci_tuner must ask for the burst interval once the
+ * credits run out, for the idle interval and then the application latency idle_after_ms after the
+ * backlog, and take the latency off again before the next burst interval. Two requests are never
+ * closer than hold_ms, the second backlog starts before that and its request has to wait.
+ *
+ * The run without the tuner keeps the 100 ms interval, for the throughput of the first backlog
+ * and the connection events of the last idle time.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "arduino_mock.h"
+#include "SPI.h"
+#include "hal_platform.h"
+#include "lib_aci.h"
+#include "aci_tuner.h"
+#include "nrf8001_model.h"
+#include "../../libraries/BLE/examples/ble_bandwidth_test/services.h"
+
+#define EMU_LOOP_US        20          // Time taken by one pass of loop() outside the library
+#define EMU_TIMEOUT_US     10000000UL  // Connecting that takes longer stops there
+#define EMU_PEER_INTERVAL  80          // Connection interval at connect, 100 ms
+#define EMU_PACKET_LEN     20
+#define EMU_PIPE           PIPE_UART_OVER_BTLE_UART_TX_TX
+#define EMU_REQUESTS_MAX   16
+
+// Times from the pipe open
+#define EMU_BACKLOG1_END_MS   1500
+#define EMU_BACKLOG2_MS       2200     // Inside the hold_ms of the idle request
+#define EMU_BACKLOG2_END_MS   4000
+#define EMU_IDLE_MS           5000     // Connection events counted from there to the end
+#define EMU_END_MS            7000
+
+static services_pipe_type_mapping_t services_pipe_type_mapping[NUMBER_OF_PIPES] = SERVICES_PIPE_TYPE_MAPPING_CONTENT;
+static const hal_aci_data_t setup_msgs[NB_SETUP_MESSAGES] PROGMEM = SETUP_MESSAGES_CONTENT;
+
+static const aci_tuner_params_t tuner_params =
+{
+  6,     // burst_min_interval, 7.5 ms
+  12,    // burst_max_interval, 15 ms
+  400,   // idle_min_interval, 500 ms
+  800,   // idle_max_interval, 1 s
+  4,     // idle_slave_latency
+  10,    // idle_app_latency
+  600,   // timeout, 6 s
+  500,   // idle_after_ms
+  1000   // hold_ms
+};
+
+static aci_state_t   aci_state;
+static hal_aci_evt_t aci_data;
+static aci_tuner_t   tuner;
+
+/* A ChangeTiming or SetAppLatency received by the model */
+typedef struct
+{
+  uint32_t time_ms;              // From the pipe open
+  uint8_t  opcode;
+  uint16_t interval;             // Longest interval of a ChangeTiming
+  uint16_t latency;              // Application latency of a SetAppLatency
+  uint8_t  mode;                 // aci_app_latency_mode_t of a SetAppLatency
+} emu_request_t;
+
+static struct
+{
+  bool          use_tuner;
+  uint32_t      open_us;         // Pipe open, 0 before
+  emu_request_t requests[EMU_REQUESTS_MAX];
+  uint8_t       request_count;
+  uint32_t      backlog1_bytes;  // At the peer by the end of the first backlog
+  uint32_t      idle_conn_events;
+} run;
+
+static uint32_t peer_bytes;
+
+static uint32_t emu_time_ms(void)
+{
+  return (mock_time_now_us() - run.open_us) / 1000;
+}
+
+static void emu_peer_read(uint8_t pipe, const uint8_t *p_data, uint8_t length)
+{
+  (void)pipe;
+  (void)p_data;
+  peer_bytes += length;
+}
+
+static void emu_command_read(uint8_t opcode, const uint8_t *p_params, uint8_t length)
+{
+  emu_request_t *p_request;
+
+  if (((ACI_CMD_CHANGE_TIMING != opcode) || (8 != length)) &&
+      ((ACI_CMD_SET_APP_LATENCY != opcode) || (3 != length)))
+  {
+    return;
+  }
+  if (EMU_REQUESTS_MAX == run.request_count)
+  {
+    return;
+  }
+  p_request = &run.requests[run.request_count++];
+  memset(p_request, 0, sizeof(*p_request));
+  p_request->time_ms = emu_time_ms();
+  p_request->opcode  = opcode;
+  if (ACI_CMD_CHANGE_TIMING == opcode)
+  {
+    p_request->interval = (uint16_t)(p_params[2] | (p_params[3] << 8));
+  }
+  else
+  {
+    p_request->mode    = p_params[0];
+    p_request->latency = (uint16_t)(p_params[1] | (p_params[2] << 8));
+  }
+}
+
+static void emu_aci_loop(void)
+{
+  aci_evt_t *aci_evt;
+
+  if (lib_aci_event_get(&aci_state, &aci_data))
+  {
+    aci_evt = &aci_data.evt;
+    if (run.use_tuner)
+    {
+      aci_tuner_event(&tuner, &aci_state, aci_evt);
+    }
+
+    if ((ACI_EVT_DEVICE_STARTED == aci_evt->evt_opcode) &&
+        (ACI_DEVICE_STANDBY == aci_evt->params.device_started.device_mode))
+    {
+      aci_state.data_credit_total = aci_evt->params.device_started.credit_available;
+      lib_aci_connect(180, 0x0050);
+    }
+  }
+  if (run.use_tuner)
+  {
+    aci_tuner_poll(&tuner, &aci_state);
+  }
+}
+
+static bool emu_in_backlog(void)
+{
+  const uint32_t time_ms = emu_time_ms();
+
+  return (time_ms < EMU_BACKLOG1_END_MS) || ((time_ms >= EMU_BACKLOG2_MS) && (time_ms < EMU_BACKLOG2_END_MS));
+}
+
+/* The backlog takes every credit */
+static void emu_send(void)
+{
+  uint8_t data[EMU_PACKET_LEN];
+
+  memset(data, 0x5A, sizeof(data));
+  while (emu_in_backlog() && (aci_state.data_credit_available > 0))
+  {
+    if (!lib_aci_send_data(EMU_PIPE, &data[0], EMU_PACKET_LEN))
+    {
+      break;
+    }
+  }
+}
+
+static void emu_run(const nrf8001_model_config_t *p_model, bool use_tuner)
+{
+  nrf8001_model_stats_t model_stats;
+  uint32_t              idle_conn_events = 0;
+  bool                  backlog1_done    = false;
+  bool                  idle_started     = false;
+
+  mock_reset();
+  nrf8001_model_init(p_model);
+  nrf8001_model_peer_read_set(emu_peer_read);
+  nrf8001_model_command_read_set(emu_command_read);
+  nrf8001_model_aci_state_fill(&aci_state, p_model, &services_pipe_type_mapping[0], NUMBER_OF_PIPES,
+                               setup_msgs, NB_SETUP_MESSAGES);
+  memset(&run, 0, sizeof(run));
+  run.use_tuner = use_tuner;
+  peer_bytes    = 0;
+  aci_tuner_init(&tuner, &tuner_params);
+
+  lib_aci_init(&aci_state, false);
+  while (!(nrf8001_model_is_connected() && lib_aci_is_pipe_available(&aci_state, EMU_PIPE)) &&
+         (mock_time_now_us() < EMU_TIMEOUT_US))
+  {
+    nrf8001_model_run();
+    emu_aci_loop();
+    mock_time_advance_us(EMU_LOOP_US);
+  }
+  run.open_us = mock_time_now_us();
+
+  while (emu_time_ms() < EMU_END_MS)
+  {
+    nrf8001_model_run();
+    emu_aci_loop();
+    emu_send();
+    if (!backlog1_done && (emu_time_ms() >= EMU_BACKLOG1_END_MS))
+    {
+      backlog1_done      = true;
+      run.backlog1_bytes = peer_bytes;
+    }
+    if (!idle_started && (emu_time_ms() >= EMU_IDLE_MS))
+    {
+      idle_started = true;
+      nrf8001_model_stats_get(&model_stats);
+      idle_conn_events = model_stats.conn_events;
+    }
+    mock_time_advance_us(EMU_LOOP_US);
+  }
+  nrf8001_model_stats_get(&model_stats);
+  run.idle_conn_events = model_stats.conn_events - idle_conn_events;
+}
+
+static void emu_request_print(const emu_request_t *p_request)
+{
+  if (ACI_CMD_CHANGE_TIMING == p_request->opcode)
+  {
+    printf("  %6lu ChangeTiming    interval up to %u\n", (unsigned long)p_request->time_ms, p_request->interval);
+  }
+  else
+  {
+    printf("  %6lu SetAppLatency   %s %u\n", (unsigned long)p_request->time_ms,
+           (ACI_APP_LATENCY_ENABLE == p_request->mode) ? "enable" : "disable", p_request->latency);
+  }
+}
+
+static bool emu_is_timing(const emu_request_t *p_request, uint16_t interval)
+{
+  return (ACI_CMD_CHANGE_TIMING == p_request->opcode) && (interval == p_request->interval);
+}
+
+static bool emu_is_latency(const emu_request_t *p_request, uint8_t mode)
+{
+  return (ACI_CMD_SET_APP_LATENCY == p_request->opcode) && (mode == p_request->mode);
+}
+
+/*
+  The requests expected: burst, idle with the latency on, the latency off with the burst, idle
+  with the latency on. Each after the backlog change it follows and hold_ms after the one before.
+  With ACI_TX_CTRL_QUEUE_BYTES the ChangeTimingRequest of the burst goes out ahead of the
+  SetAppLatency queued before it in the same poll.
+*/
+static bool emu_check(void)
+{
+  emu_request_t        p[7];
+  const uint16_t       burst = tuner_params.burst_max_interval;
+  const uint16_t       idle  = tuner_params.idle_max_interval;
+  const uint32_t       hold  = tuner_params.hold_ms;
+  const uint32_t       after = tuner_params.idle_after_ms;
+
+  if (7 != run.request_count)
+  {
+    return false;
+  }
+  memcpy(&p[0], &run.requests[0], sizeof(p));
+#if ACI_TX_CTRL_QUEUE_BYTES
+  if (emu_is_timing(&p[3], burst) && (p[3].time_ms == p[4].time_ms))
+  {
+    emu_request_t swap = p[3];
+    p[3] = p[4];
+    p[4] = swap;
+  }
+#endif
+  if (!emu_is_timing(&p[0], burst) || !emu_is_timing(&p[1], idle) || !emu_is_latency(&p[2], ACI_APP_LATENCY_ENABLE) ||
+      !emu_is_latency(&p[3], ACI_APP_LATENCY_DISABLE) || !emu_is_timing(&p[4], burst) ||
+      !emu_is_timing(&p[5], idle) || !emu_is_latency(&p[6], ACI_APP_LATENCY_ENABLE))
+  {
+    return false;
+  }
+  if ((tuner_params.idle_app_latency != p[2].latency) || (tuner_params.idle_app_latency != p[6].latency))
+  {
+    return false;
+  }
+  // A latency change goes with the ChangeTiming of the same poll
+  if ((p[2].time_ms != p[1].time_ms) || (p[3].time_ms != p[4].time_ms) || (p[6].time_ms != p[5].time_ms))
+  {
+    return false;
+  }
+  return (p[0].time_ms < EMU_BACKLOG1_END_MS) &&
+         (p[1].time_ms >= EMU_BACKLOG1_END_MS + after) && (p[1].time_ms >= p[0].time_ms + hold) &&
+         (p[4].time_ms >= p[1].time_ms + hold) && (p[4].time_ms < EMU_BACKLOG2_END_MS) &&
+         (p[5].time_ms >= EMU_BACKLOG2_END_MS + after) && (p[5].time_ms >= p[4].time_ms + hold);
+}
+
+int main(void)
+{
+  nrf8001_model_config_t model;
+  uint8_t                i;
+  bool                   ok;
+
+  nrf8001_model_config_default(&model);
+  model.setup_done    = true;
+  model.reset_pin     = 4;
+  model.conn_interval = EMU_PEER_INTERVAL;
+
+  printf("%u byte packets, backlogs at 0-%u and %u-%u ms, burst interval %u-%u, idle %u-%u, idle after %u ms, hold %u ms\n",
+         EMU_PACKET_LEN, EMU_BACKLOG1_END_MS, EMU_BACKLOG2_MS, EMU_BACKLOG2_END_MS,
+         tuner_params.burst_min_interval, tuner_params.burst_max_interval,
+         tuner_params.idle_min_interval, tuner_params.idle_max_interval,
+         tuner_params.idle_after_ms, tuner_params.hold_ms);
+
+  emu_run(&model, true);
+  printf("requests of aci_tuner, ms from the pipe open\n");
+  for (i = 0; i < run.request_count; i++)
+  {
+    emu_request_print(&run.requests[i]);
+  }
+  ok = emu_check();
+  printf("  run    backlog B/s idle events/s requests\n");
+  printf("  tuner  %11.0f %13.1f %8u %s\n", run.backlog1_bytes * 1000.0 / EMU_BACKLOG1_END_MS,
+         run.idle_conn_events * 1000.0 / (EMU_END_MS - EMU_IDLE_MS), run.request_count, ok ? "ok" : "FAILED");
+
+  emu_run(&model, false);
+  printf("  fixed  %11.0f %13.1f %8u\n", run.backlog1_bytes * 1000.0 / EMU_BACKLOG1_END_MS,
+         run.idle_conn_events * 1000.0 / (EMU_END_MS - EMU_IDLE_MS), run.request_count);
+  return ok ? 0 : 1;
+}
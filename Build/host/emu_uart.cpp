@@ -0,0 +1,414 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+ * @brief Serial to BLE bridging of aci_uart_bridge against the nRF8001 model
+ *
+ * A serial source sends a byte stream at a baud rate into a 64 byte receive buffer, as the
+ * HardwareSerial one, bytes that find it full are lost. The loop of ble_uart_project_template
+ * carries it to the peer: the one of earlier releases, which takes up to 20 bytes and sends them
+ * once, and the one with aci_uart_bridge, with and without an RTS pin that holds the source.
+ * What the peer gets is compared with what the receive buffer took.
+ *
+ * The other way the peer writes 20 byte packets on UART RX as fast as the link takes them, with
+ * one packet or a connection event of packets in flight, and the serial port writes them
+ * out at the baud rate. The bridge tells the peer to stop on the control point when its ring
+ * fills, the peer stops until told to go on.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "arduino_mock.h"
+#include "SPI.h"
+#include "hal_platform.h"
+#include "lib_aci.h"
+#include "aci_uart_bridge.h"
+#include "nrf8001_model.h"
+#include "../../libraries/BLE/examples/ble_uart_project_template/services.h"
+
+#define EMU_LOOP_US      20          // Time taken by one pass of loop() outside the library
+#define EMU_TIMEOUT_US   30000000UL  // A run that takes longer stops there
+#define EMU_STREAM_SIZE  8192
+#define EMU_SERIAL_BUF   64          // Receive buffer of HardwareSerial
+#define EMU_RTS_PIN      7
+
+static services_pipe_type_mapping_t services_pipe_type_mapping[NUMBER_OF_PIPES] = SERVICES_PIPE_TYPE_MAPPING_CONTENT;
+static const hal_aci_data_t setup_msgs[NB_SETUP_MESSAGES] PROGMEM = SETUP_MESSAGES_CONTENT;
+
+static aci_state_t       aci_state;
+static hal_aci_evt_t     aci_data;
+static aci_uart_bridge_t bridge;
+static bool              emu_failed;  // A run printed FAILED, main() returns 1
+
+static const aci_uart_bridge_params_t bridge_params[2] =
+{
+  {
+    PIPE_UART_OVER_BTLE_UART_TX_TX,
+    PIPE_UART_OVER_BTLE_UART_RX_RX,
+    PIPE_UART_OVER_BTLE_UART_CONTROL_POINT_TX,
+    PIPE_UART_OVER_BTLE_UART_CONTROL_POINT_RX,
+    10,
+    UNUSED
+  },
+  {
+    PIPE_UART_OVER_BTLE_UART_TX_TX,
+    PIPE_UART_OVER_BTLE_UART_RX_RX,
+    PIPE_UART_OVER_BTLE_UART_CONTROL_POINT_TX,
+    PIPE_UART_OVER_BTLE_UART_CONTROL_POINT_RX,
+    10,
+    EMU_RTS_PIN
+  }
+};
+
+typedef enum
+{
+  EMU_LOOP_LEGACY,               // 20 bytes at most, sent once, lost without a credit
+  EMU_LOOP_BRIDGE,
+  EMU_LOOP_BRIDGE_RTS
+} emu_loop_t;
+
+static uint8_t  stream[EMU_STREAM_SIZE];
+static uint8_t  accepted[EMU_STREAM_SIZE]; // What the receive buffer took
+static uint8_t  received[EMU_STREAM_SIZE];
+
+/* The serial port */
+static struct
+{
+  uint32_t byte_us;              // Time of one byte at the baud rate
+  uint32_t next_us;
+  uint32_t in;                   // Bytes of the stream that came in
+  uint32_t accepted;             // Bytes the receive buffer took
+  uint32_t overruns;             // Lost with the receive buffer full
+  bool     rts;                  // The source holds while the RTS pin is HIGH
+  uint8_t  buffer[EMU_SERIAL_BUF];
+  uint8_t  count;
+} serial;
+
+/* The peer */
+static struct
+{
+  uint32_t received;             // Bytes got on UART TX
+  uint32_t sent;                 // Bytes written on UART RX
+  bool     stopped;              // TRANSMIT_STOP came on the control point
+} peer;
+
+/* The loop of earlier releases */
+static struct
+{
+  uint8_t  buffer[ACI_PIPE_TX_DATA_MAX_LEN];
+  uint8_t  length;
+  uint32_t dropped;
+  uint32_t packets;
+} legacy;
+
+static void emu_peer_read(uint8_t pipe, const uint8_t *p_data, uint8_t length)
+{
+  if (PIPE_UART_OVER_BTLE_UART_TX_TX == pipe)
+  {
+    if ((peer.received + length) <= EMU_STREAM_SIZE)
+    {
+      memcpy(&received[peer.received], p_data, length);
+    }
+    peer.received += length;
+  }
+  else if ((PIPE_UART_OVER_BTLE_UART_CONTROL_POINT_TX == pipe) && (0 != length))
+  {
+    peer.stopped = (ACI_UART_BRIDGE_OP_TRANSMIT_STOP == p_data[0]);
+  }
+}
+
+static void emu_aci_loop(void)
+{
+  aci_evt_t *aci_evt;
+
+  if (lib_aci_event_get(&aci_state, &aci_data))
+  {
+    aci_evt = &aci_data.evt;
+    aci_uart_bridge_event(&bridge, &aci_state, aci_evt);
+
+    if ((ACI_EVT_DEVICE_STARTED == aci_evt->evt_opcode) &&
+        (ACI_DEVICE_STANDBY == aci_evt->params.device_started.device_mode))
+    {
+      aci_state.data_credit_total = aci_evt->params.device_started.credit_available;
+      lib_aci_connect(180, 0x0050);
+    }
+  }
+}
+
+static bool emu_connected(void)
+{
+  return nrf8001_model_is_connected() &&
+         lib_aci_is_pipe_available(&aci_state, PIPE_UART_OVER_BTLE_UART_TX_TX);
+}
+
+/*
+  Bytes coming in on the serial port, the first one once connected.
+*/
+static void emu_serial_rx(void)
+{
+  while ((serial.in < EMU_STREAM_SIZE) && ((int32_t)(mock_time_now_us() - serial.next_us) >= 0))
+  {
+    if (serial.rts && (HIGH == mock_pin_get(EMU_RTS_PIN)))
+    {
+      serial.next_us = mock_time_now_us() + serial.byte_us;
+      break;
+    }
+    if (serial.count < EMU_SERIAL_BUF)
+    {
+      serial.buffer[serial.count++] = stream[serial.in];
+      accepted[serial.accepted++] = stream[serial.in];
+    }
+    else
+    {
+      serial.overruns++;
+    }
+    serial.in++;
+    serial.next_us += serial.byte_us;
+  }
+}
+
+static uint8_t emu_serial_read(void)
+{
+  const uint8_t data = serial.buffer[0];
+
+  serial.count--;
+  memmove(&serial.buffer[0], &serial.buffer[1], serial.count);
+  return data;
+}
+
+static void emu_loop_legacy(void)
+{
+  // serialEvent(), the 21st byte ends the string and is lost
+  while (0 != serial.count)
+  {
+    if (ACI_PIPE_TX_DATA_MAX_LEN == legacy.length)
+    {
+      emu_serial_read();
+      legacy.dropped++;
+      break;
+    }
+    legacy.buffer[legacy.length++] = emu_serial_read();
+  }
+
+  // loop()
+  if (0 != legacy.length)
+  {
+    if (lib_aci_send_data(PIPE_UART_OVER_BTLE_UART_TX_TX, legacy.buffer, legacy.length))
+    {
+      legacy.packets++;
+    }
+    else
+    {
+      legacy.dropped += legacy.length;
+    }
+    legacy.length = 0;
+  }
+}
+
+static void emu_loop_bridge(void)
+{
+  while ((0 != aci_uart_bridge_room(&bridge)) && (0 != serial.count))
+  {
+    aci_uart_bridge_put(&bridge, emu_serial_read());
+  }
+  aci_uart_bridge_poll(&bridge, &aci_state);
+}
+
+static void emu_start(const nrf8001_model_config_t *p_model, const aci_uart_bridge_params_t *p_params)
+{
+  mock_reset();
+  nrf8001_model_init(p_model);
+  nrf8001_model_peer_read_set(emu_peer_read);
+
+  nrf8001_model_aci_state_fill(&aci_state, p_model, &services_pipe_type_mapping[0], NUMBER_OF_PIPES,
+                               setup_msgs, NB_SETUP_MESSAGES);
+
+  memset(&serial, 0, sizeof(serial));
+  memset(&peer, 0, sizeof(peer));
+  memset(&legacy, 0, sizeof(legacy));
+  memset(received, 0, sizeof(received));
+  aci_uart_bridge_init(&bridge, p_params);
+
+  lib_aci_init(&aci_state, false);
+  while (!emu_connected() && (mock_time_now_us() < EMU_TIMEOUT_US))
+  {
+    nrf8001_model_run();
+    emu_aci_loop();
+    mock_time_advance_us(EMU_LOOP_US);
+  }
+}
+
+/*
+  Carries the serial stream at baud to the peer with the given loop.
+*/
+static void emu_run_to_peer(const nrf8001_model_config_t *p_model, emu_loop_t loop, uint32_t baud)
+{
+  aci_uart_bridge_stats_t stats;
+  nrf8001_model_stats_t   model_stats;
+  uint32_t                start_us;
+  uint32_t                end_us;
+  uint32_t                lost;
+  uint32_t                packets;
+  bool                    ok;
+
+  emu_start(p_model, &bridge_params[(EMU_LOOP_BRIDGE_RTS == loop) ? 1 : 0]);
+  serial.rts     = (EMU_LOOP_BRIDGE_RTS == loop);
+  serial.byte_us = 10000000UL / baud;
+  serial.next_us = mock_time_now_us();
+  start_us       = serial.next_us;
+
+  while ((mock_time_now_us() - start_us) < EMU_TIMEOUT_US)
+  {
+    nrf8001_model_run();
+    emu_aci_loop();
+    emu_serial_rx();
+    if (EMU_LOOP_LEGACY == loop)
+    {
+      emu_loop_legacy();
+    }
+    else
+    {
+      emu_loop_bridge();
+    }
+    mock_time_advance_us(EMU_LOOP_US);
+
+    nrf8001_model_stats_get(&model_stats);
+    if ((EMU_STREAM_SIZE == serial.in) && (0 == serial.count) &&
+        (model_stats.bytes_sent >= (serial.accepted - legacy.dropped)))
+    {
+      break;
+    }
+  }
+  end_us = mock_time_now_us();
+
+  aci_uart_bridge_stats_get(&bridge, &stats);
+  packets = (EMU_LOOP_LEGACY == loop) ? legacy.packets : stats.packets_sent;
+  lost    = EMU_STREAM_SIZE - peer.received;
+  ok      = (EMU_LOOP_LEGACY == loop) ||
+            ((peer.received == serial.accepted) && (0 == memcmp(accepted, received, serial.accepted)));
+  emu_failed = emu_failed || !ok;
+  printf("  to peer %-6s %6lu %8.1f %7lu %6lu %6lu %5lu %5.1f %s\n",
+         (EMU_LOOP_LEGACY == loop) ? "legacy" : ((EMU_LOOP_BRIDGE == loop) ? "bridge" : "rts"),
+         (unsigned long)baud, (end_us - start_us) / 1000.0,
+         (unsigned long)((uint64_t)peer.received * 1000000ULL / (end_us - start_us)),
+         (unsigned long)lost, (unsigned long)serial.overruns, (unsigned long)packets,
+         (0 != packets) ? (double)peer.received / packets : 0.0, ok ? "ok" : "FAILED");
+}
+
+/*
+  Carries what the peer writes to the serial port at baud, the peer having up to in_flight
+  packets on the way.
+*/
+static void emu_run_to_serial(const nrf8001_model_config_t *p_model, uint32_t baud, uint8_t in_flight)
+{
+  aci_uart_bridge_stats_t stats;
+  uint32_t                next_us;
+  uint32_t                byte_us = 10000000UL / baud;
+  uint32_t                start_us;
+  uint32_t                end_us;
+  uint32_t                out = 0;
+  int                     data;
+  bool                    ok = true;
+
+  emu_start(p_model, &bridge_params[0]);
+  start_us = mock_time_now_us();
+  next_us  = start_us;
+
+  // Until all is written out, or lost
+  aci_uart_bridge_stats_get(&bridge, &stats);
+  while (((out + stats.bytes_dropped) < EMU_STREAM_SIZE) && ((mock_time_now_us() - start_us) < EMU_TIMEOUT_US))
+  {
+    while (!peer.stopped && (peer.sent < EMU_STREAM_SIZE) &&
+           ((peer.sent - stats.bytes_received - stats.bytes_dropped) <
+            ((uint32_t)in_flight * ACI_PIPE_TX_DATA_MAX_LEN)))
+    {
+      const uint32_t left   = EMU_STREAM_SIZE - peer.sent;
+      const uint8_t  length = (left < ACI_PIPE_TX_DATA_MAX_LEN) ? (uint8_t)left : ACI_PIPE_TX_DATA_MAX_LEN;
+
+      if (!nrf8001_model_peer_write(PIPE_UART_OVER_BTLE_UART_RX_RX, &stream[peer.sent], length))
+      {
+        break;
+      }
+      peer.sent += length;
+    }
+
+    nrf8001_model_run();
+    emu_aci_loop();
+    // Serial.write() of the bytes from the peer, the port takes a byte every byte_us
+    if ((int32_t)(mock_time_now_us() - next_us) >= 0)
+    {
+      data = aci_uart_bridge_get(&bridge);
+      if (data >= 0)
+      {
+        ok = ok && ((0 != stats.bytes_dropped) || (stream[out] == (uint8_t)data));
+        out++;
+        next_us = mock_time_now_us() + byte_us;
+      }
+    }
+    aci_uart_bridge_poll(&bridge, &aci_state);
+    mock_time_advance_us(EMU_LOOP_US);
+    aci_uart_bridge_stats_get(&bridge, &stats);
+  }
+  end_us = mock_time_now_us();
+
+  // With bytes dropped only the first ones can be compared
+  ok = (0 != stats.bytes_dropped) || (ok && (EMU_STREAM_SIZE == out));
+  emu_failed = emu_failed || !ok;
+  printf("  to serial %u   %6lu %8.1f %7lu %6u %6u %s\n", in_flight, (unsigned long)baud,
+         (end_us - start_us) / 1000.0, (unsigned long)((uint64_t)out * 1000000ULL / (end_us - start_us)),
+         stats.bytes_dropped, stats.stops_sent, !ok ? "FAILED" : ((0 != stats.bytes_dropped) ? "lossy" : "ok"));
+}
+
+int main(void)
+{
+  static const uint32_t bauds[] = { 9600, 38400, 115200 };
+  nrf8001_model_config_t model;
+  uint32_t               i;
+  uint8_t                j;
+
+  for (i = 0; i < sizeof(stream); i++)
+  {
+    stream[i] = (uint8_t)(i * 13 + (i >> 8));
+  }
+
+  nrf8001_model_config_default(&model);
+  model.setup_done = true;
+  model.reset_pin  = 4;
+
+  printf("%u byte stream, %.2f ms connection interval, %u packets per event, %u credits\n",
+         EMU_STREAM_SIZE, model.conn_interval * 1.25, model.packets_per_event, model.credits);
+  printf("                   baud       ms     B/s   lost  ovrun  pkts B/pkt\n");
+  for (j = 0; j < sizeof(bauds) / sizeof(bauds[0]); j++)
+  {
+    emu_run_to_peer(&model, EMU_LOOP_LEGACY, bauds[j]);
+    emu_run_to_peer(&model, EMU_LOOP_BRIDGE, bauds[j]);
+    emu_run_to_peer(&model, EMU_LOOP_BRIDGE_RTS, bauds[j]);
+  }
+  printf("        in flight  baud       ms     B/s   lost  stops\n");
+  for (j = 0; j < sizeof(bauds) / sizeof(bauds[0]); j++)
+  {
+    emu_run_to_serial(&model, bauds[j], 1);
+    emu_run_to_serial(&model, bauds[j], model.packets_per_event);
+  }
+  return emu_failed ? 1 : 0;
+}
@@ -0,0 +1,881 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/** @file
+ * @brief Behavioural model of the nRF8001 for the host build of the BLE library
+ */
+
+#include <string.h>
+#include "arduino_mock.h"
+#include "hal_platform.h"
+#include "aci.h"
+#include "aci_cmds.h"
+#include "aci_evts.h"
+#include "hal_aci_tl.h"
+#include "SPI.h"
+#include "nrf8001_model.h"
+
+#define MODEL_EVENT_Q_SIZE   16
+#define MODEL_FRAME_MAX      (HAL_ACI_MAX_LENGTH + 2)
+#define MODEL_PEER_Q_SIZE    8
+#define MODEL_AIR_MAX        (ACI_PIPE_TX_DATA_MAX_LEN + 2)
+
+// Bytes of dynamic data per ReadDynamicData response
+#define MODEL_DYNAMIC_CHUNK     26
+
+// Setup message written to the CRC target, the last one of the setup
+#define MODEL_SETUP_TARGET_CRC  0xF0
+
+typedef enum
+{
+  MODEL_SETUP,
+  MODEL_STANDBY,
+  MODEL_ADVERTISING,
+  MODEL_CONNECTED,
+  MODEL_SLEEP,
+  MODEL_TEST
+} model_state_t;
+
+typedef struct
+{
+  nrf8001_model_config_t config;
+  nrf8001_model_stats_t  stats;
+  model_state_t          state;
+  model_state_t          test_from;      // SETUP or STANDBY, taken back when Test mode is left
+
+  uint8_t  event_q[MODEL_EVENT_Q_SIZE][MODEL_FRAME_MAX];  // [len][opcode][params]
+  uint8_t  event_head;
+  uint8_t  event_count;
+
+  uint8_t  tx_frame[MODEL_FRAME_MAX];    // [debug][len][opcode][params] clocked out
+  uint8_t  rx_frame[MODEL_FRAME_MAX];    // [len][opcode][params] clocked in
+  uint8_t  frame_index;
+  bool     frame_has_event;
+  bool     reqn_low;
+  bool     rdyn_delayed;                 // RDYN stays high for one more read after REQN low
+  bool     reset_low;
+
+  uint8_t  credits;                      // Credits the MCU holds
+  uint8_t  air_packets;                  // Packets waiting for a connection event
+  uint8_t  air_answers;                  // Ack, Nack and RequestData waiting for a connection event
+  uint8_t  air_frames[MODEL_EVENT_Q_SIZE][MODEL_AIR_MAX]; // [length][pipe][data]
+  uint16_t conn_interval;
+  uint32_t connect_at_us;
+  uint32_t advertising_end_us;           // When the advertising times out, with no_peer
+  uint32_t sleep_at_us;
+  uint32_t next_conn_event_us;
+  bool     timing_pending;
+  bool     active_high;
+  uint32_t active_low_at_us;             // When ACTIVE goes low again
+  uint8_t  peer_q[MODEL_PEER_Q_SIZE][MODEL_FRAME_MAX]; // DataReceived events for the next connection events
+  uint8_t  peer_head;
+  uint8_t  peer_count;
+  nrf8001_model_peer_read_t peer_read;
+  nrf8001_model_command_read_t command_read;
+  uint16_t setup_crc;                    // CRC of the setup messages so far
+  uint8_t  dynamic[NRF8001_MODEL_DYNAMIC_MAX];
+  uint8_t  dynamic_in[NRF8001_MODEL_DYNAMIC_MAX]; // Written with WriteDynamicData, taken once complete
+  uint16_t dynamic_offset;               // Read or written so far
+  uint8_t  dynamic_seq;                  // Sequence number of the last message, 0 for none
+  uint8_t  dynamic_opcode;               // Command of the transfer under way
+  uint16_t busy_count;                   // SendData taken since the last busy_every error
+} model_t;
+
+static model_t model;
+
+static bool model_event_put(const uint8_t *p_event)
+{
+  uint8_t *p_slot;
+
+  if (MODEL_EVENT_Q_SIZE == model.event_count)
+  {
+    return false;
+  }
+  p_slot = model.event_q[(model.event_head + model.event_count) % MODEL_EVENT_Q_SIZE];
+  memcpy(p_slot, p_event, p_event[0] + 1);
+  model.event_count++;
+  if (model.event_count > model.stats.event_q_high_water)
+  {
+    model.stats.event_q_high_water = model.event_count;
+  }
+  return true;
+}
+
+/*
+  CRC-16-CCITT of the setup, as checked by the nRF8001
+*/
+static uint16_t model_crc(uint16_t crc, const uint8_t *p_data, uint8_t length)
+{
+  uint8_t i;
+
+  for (i = 0; i < length; i++)
+  {
+    crc  = (uint8_t)(crc >> 8) | (crc << 8);
+    crc ^= p_data[i];
+    crc ^= (uint8_t)(crc & 0xff) >> 4;
+    crc ^= (crc << 8) << 4;
+    crc ^= ((crc & 0xff) << 4) << 1;
+  }
+  return crc;
+}
+
+static void model_cmd_rsp(uint8_t cmd_opcode, uint8_t status)
+{
+  const uint8_t event[] = { 3, ACI_EVT_CMD_RSP, cmd_opcode, status };
+
+  model_event_put(event);
+}
+
+static void model_device_started(void)
+{
+  const uint8_t mode    = (MODEL_TEST  == model.state) ? ACI_DEVICE_TEST :
+                          (MODEL_SETUP == model.state) ? ACI_DEVICE_SETUP : ACI_DEVICE_STANDBY;
+  const uint8_t credits = (MODEL_TEST  == model.state) ? 0 : model.config.credits;
+  const uint8_t event[] = { 4, ACI_EVT_DEVICE_STARTED, mode, 0, credits };
+
+  model.credits = credits;
+  model_event_put(event);
+}
+
+static void model_timing(void)
+{
+  const uint8_t event[] = { 7, ACI_EVT_TIMING,
+                            (uint8_t)model.conn_interval, (uint8_t)(model.conn_interval >> 8),
+                            0, 0, 0x58, 0x02 };
+
+  model_event_put(event);
+}
+
+static void model_connected(void)
+{
+  uint8_t event[18] = { 15, ACI_EVT_CONNECTED, ACI_BD_ADDR_TYPE_PUBLIC,
+                        0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+                        (uint8_t)model.conn_interval, (uint8_t)(model.conn_interval >> 8),
+                        0, 0, 0x58, 0x02, 0 };
+  uint8_t pipe_status[2 + 2 * NRF8001_MODEL_PIPES_BYTES] = { 1 + 2 * NRF8001_MODEL_PIPES_BYTES, ACI_EVT_PIPE_STATUS };
+
+  model_event_put(event);
+  memcpy(&pipe_status[2], model.config.pipes_open, NRF8001_MODEL_PIPES_BYTES);
+  model_event_put(pipe_status);
+
+  model.state              = MODEL_CONNECTED;
+  model.credits            = model.config.credits;
+  model.air_packets        = 0;
+  model.air_answers        = 0;
+  model.next_conn_event_us = mock_time_now_us() + (uint32_t)model.conn_interval * 1250;
+}
+
+static void model_disconnected(uint8_t btle_status)
+{
+  const uint8_t event[] = { 3, ACI_EVT_DISCONNECTED, ACI_STATUS_EXTENDED, btle_status };
+
+  model_event_put(event);
+  model.state       = MODEL_STANDBY;
+  model.air_packets = 0;
+  model.air_answers = 0;
+}
+
+static void model_advertising_timeout(void)
+{
+  const uint8_t event[] = { 3, ACI_EVT_DISCONNECTED, ACI_STATUS_ERROR_ADVT_TIMEOUT, 0 };
+
+  model_event_put(event);
+  model.state = MODEL_STANDBY;
+}
+
+static void model_pipe_error(uint8_t pipe, uint8_t error_code)
+{
+  const uint8_t event[] = { 3, ACI_EVT_PIPE_ERROR, pipe, error_code };
+
+  model_event_put(event);
+}
+
+static void model_send_data(void)
+{
+  const uint8_t pipe = model.rx_frame[2];
+
+  if (MODEL_CONNECTED != model.state)
+  {
+    model_pipe_error(pipe, ACI_STATUS_ERROR_PIPE_STATE_INVALID);
+    return;
+  }
+  if (0 == model.credits)
+  {
+    model.stats.credit_errors++;
+    model_pipe_error(pipe, ACI_STATUS_ERROR_CREDIT_NOT_AVAILABLE);
+    return;
+  }
+  if ((0 != model.config.busy_every) && (++model.busy_count >= model.config.busy_every))
+  {
+    // The packet is not taken and the credit stays, as any pipe error
+    model.busy_count = 0;
+    model.stats.busy_errors++;
+    model_pipe_error(pipe, ACI_STATUS_ERROR_BUSY);
+    return;
+  }
+  model.credits--;
+  model.air_frames[model.air_packets][0] = model.rx_frame[0] - 2;
+  memcpy(&model.air_frames[model.air_packets][1], &model.rx_frame[2], model.rx_frame[0] - 1);
+  model.air_packets++;
+}
+
+/*
+  SendDataAck, SendDataNack and RequestData take a credit as SendData, it comes back with the
+  packets of the next connection event.
+*/
+static void model_send_answer(void)
+{
+  const uint8_t pipe = model.rx_frame[2];
+
+  if (MODEL_CONNECTED != model.state)
+  {
+    model_pipe_error(pipe, ACI_STATUS_ERROR_PIPE_STATE_INVALID);
+    return;
+  }
+  if (0 == model.credits)
+  {
+    model.stats.credit_errors++;
+    model_pipe_error(pipe, ACI_STATUS_ERROR_CREDIT_NOT_AVAILABLE);
+    return;
+  }
+  model.credits--;
+  model.air_answers++;
+}
+
+/*
+  A ReadDynamicData or WriteDynamicData transfer starts again with any other command.
+*/
+static void model_dynamic_read(void)
+{
+  uint8_t  event[MODEL_FRAME_MAX] = { 0, ACI_EVT_CMD_RSP, ACI_CMD_READ_DYNAMIC_DATA };
+  uint16_t length = model.config.dynamic_length - model.dynamic_offset;
+
+  if (MODEL_STANDBY != model.state)
+  {
+    model_cmd_rsp(ACI_CMD_READ_DYNAMIC_DATA, ACI_STATUS_ERROR_DEVICE_STATE_INVALID);
+    return;
+  }
+  if (length > MODEL_DYNAMIC_CHUNK)
+  {
+    length = MODEL_DYNAMIC_CHUNK;
+  }
+  model.dynamic_seq++;
+  event[0] = (uint8_t)(4 + length);
+  event[3] = ((model.dynamic_offset + length) < model.config.dynamic_length) ?
+             ACI_STATUS_TRANSACTION_CONTINUE : ACI_STATUS_TRANSACTION_COMPLETE;
+  event[4] = model.dynamic_seq;
+  memcpy(&event[5], &model.dynamic[model.dynamic_offset], length);
+  model.dynamic_offset += length;
+  model_event_put(event);
+  model.stats.dynamic_reads++;
+  if (ACI_STATUS_TRANSACTION_COMPLETE == event[3])
+  {
+    model.dynamic_offset = 0;
+    model.dynamic_seq    = 0;
+  }
+}
+
+static void model_dynamic_write(void)
+{
+  const uint8_t length = model.rx_frame[0] - 2;
+
+  if ((MODEL_STANDBY != model.state) && (MODEL_SETUP != model.state))
+  {
+    model_cmd_rsp(ACI_CMD_WRITE_DYNAMIC_DATA, ACI_STATUS_ERROR_DEVICE_STATE_INVALID);
+    return;
+  }
+  if ((model.rx_frame[0] < 2) || (model.rx_frame[2] != (uint8_t)(model.dynamic_seq + 1)) ||
+      ((model.dynamic_offset + length) > model.config.dynamic_length))
+  {
+    model.dynamic_offset = 0;
+    model.dynamic_seq    = 0;
+    model_cmd_rsp(ACI_CMD_WRITE_DYNAMIC_DATA, ACI_STATUS_ERROR_INVALID_SEQ_NO);
+    return;
+  }
+  model.dynamic_seq = model.rx_frame[2];
+  memcpy(&model.dynamic_in[model.dynamic_offset], &model.rx_frame[3], length);
+  model.dynamic_offset += length;
+  model.stats.dynamic_writes++;
+  if (model.dynamic_offset < model.config.dynamic_length)
+  {
+    model_cmd_rsp(ACI_CMD_WRITE_DYNAMIC_DATA, ACI_STATUS_TRANSACTION_CONTINUE);
+    return;
+  }
+  memcpy(model.dynamic, model.dynamic_in, model.config.dynamic_length);
+  model.dynamic_offset = 0;
+  model.dynamic_seq    = 0;
+  model_cmd_rsp(ACI_CMD_WRITE_DYNAMIC_DATA, ACI_STATUS_TRANSACTION_COMPLETE);
+}
+
+/*
+  Answers the command clocked in during the last transfer.
+*/
+static void model_command(void)
+{
+  const uint8_t opcode = model.rx_frame[1];
+
+  model.stats.commands++;
+  if (NULL != model.command_read)
+  {
+    model.command_read(opcode, &model.rx_frame[2], model.rx_frame[0] - 1);
+  }
+  if (opcode != model.dynamic_opcode)
+  {
+    model.dynamic_opcode = opcode;
+    model.dynamic_offset = 0;
+    model.dynamic_seq    = 0;
+  }
+
+  if ((MODEL_SLEEP == model.state) && (ACI_CMD_WAKEUP != opcode))
+  {
+    model.stats.sleep_commands++;
+    model_cmd_rsp(opcode, ACI_STATUS_ERROR_DEVICE_STATE_INVALID);
+    return;
+  }
+
+  switch (opcode)
+  {
+    case ACI_CMD_READ_DYNAMIC_DATA:
+      model_dynamic_read();
+      break;
+
+    case ACI_CMD_WRITE_DYNAMIC_DATA:
+      model_dynamic_write();
+      break;
+
+    case ACI_CMD_SETUP:
+      if (MODEL_SETUP != model.state)
+      {
+        model_cmd_rsp(opcode, ACI_STATUS_ERROR_DEVICE_STATE_INVALID);
+        break;
+      }
+      if (MODEL_SETUP_TARGET_CRC != model.rx_frame[2])
+      {
+        model.setup_crc = model_crc(model.setup_crc, model.rx_frame, model.rx_frame[0] + 1);
+        model_cmd_rsp(opcode, ACI_STATUS_TRANSACTION_CONTINUE);
+        break;
+      }
+      // The last message ends with the CRC of all the setup, most significant byte first
+      model.setup_crc = model_crc(model.setup_crc, model.rx_frame, model.rx_frame[0] - 1);
+      if (model.setup_crc != (uint16_t)((model.rx_frame[model.rx_frame[0] - 1] << 8) | model.rx_frame[model.rx_frame[0]]))
+      {
+        model.setup_crc = 0xFFFF;
+        model_cmd_rsp(opcode, ACI_STATUS_ERROR_CRC_MISMATCH);
+        break;
+      }
+      model_cmd_rsp(opcode, ACI_STATUS_TRANSACTION_COMPLETE);
+      model.state = MODEL_STANDBY;
+      model_device_started();
+      break;
+
+    case ACI_CMD_TEST:
+      // Entering or leaving Test mode restarts the nRF8001, there is no command response
+      if (ACI_TEST_MODE_EXIT == model.rx_frame[2])
+      {
+        if (MODEL_TEST != model.state)
+        {
+          model_cmd_rsp(opcode, ACI_STATUS_ERROR_DEVICE_STATE_INVALID);
+          break;
+        }
+        model.state = model.test_from;
+      }
+      else
+      {
+        if ((MODEL_SETUP != model.state) && (MODEL_STANDBY != model.state))
+        {
+          model_cmd_rsp(opcode, ACI_STATUS_ERROR_DEVICE_STATE_INVALID);
+          break;
+        }
+        model.test_from = model.state;
+        model.state     = MODEL_TEST;
+      }
+      model_device_started();
+      break;
+
+    case ACI_CMD_ECHO:
+      model.rx_frame[1] = ACI_EVT_ECHO;
+      model_event_put(model.rx_frame);
+      break;
+
+    case ACI_CMD_CONNECT:
+    case ACI_CMD_BOND:
+      if (MODEL_STANDBY != model.state)
+      {
+        model_cmd_rsp(opcode, ACI_STATUS_ERROR_DEVICE_STATE_INVALID);
+        break;
+      }
+      model_cmd_rsp(opcode, ACI_STATUS_SUCCESS);
+      model.state              = MODEL_ADVERTISING;
+      model.connect_at_us      = mock_time_now_us() + model.config.connect_delay_us;
+      model.advertising_end_us = mock_time_now_us() +
+                                 (uint32_t)(model.rx_frame[2] | (model.rx_frame[3] << 8)) * 1000000UL;
+      break;
+
+    case ACI_CMD_CONNECT_DIRECT:
+      if (MODEL_STANDBY != model.state)
+      {
+        model_cmd_rsp(opcode, ACI_STATUS_ERROR_DEVICE_STATE_INVALID);
+        break;
+      }
+      if (!model.config.bonded)
+      {
+        model_cmd_rsp(opcode, ACI_STATUS_ERROR_BOND_REQUIRED);
+        break;
+      }
+      // Directed advertising lasts 1.28 s
+      model_cmd_rsp(opcode, ACI_STATUS_SUCCESS);
+      model.state              = MODEL_ADVERTISING;
+      model.connect_at_us      = mock_time_now_us() + model.config.direct_delay_us;
+      model.advertising_end_us = mock_time_now_us() + 1280000UL;
+      break;
+
+    case ACI_CMD_SLEEP:
+      // No command response when the Sleep is taken
+      if (MODEL_STANDBY != model.state)
+      {
+        model_cmd_rsp(opcode, ACI_STATUS_ERROR_DEVICE_STATE_INVALID);
+        break;
+      }
+      model.state       = MODEL_SLEEP;
+      model.sleep_at_us = mock_time_now_us();
+      model.stats.sleeps++;
+      break;
+
+    case ACI_CMD_WAKEUP:
+      if (MODEL_SLEEP != model.state)
+      {
+        model_cmd_rsp(opcode, ACI_STATUS_ERROR_DEVICE_STATE_INVALID);
+        break;
+      }
+      model.stats.sleep_us += mock_time_now_us() - model.sleep_at_us;
+      model.state = MODEL_STANDBY;
+      model_device_started();
+      break;
+
+    case ACI_CMD_DISCONNECT:
+      // Also stops the advertising
+      if ((MODEL_CONNECTED != model.state) && (MODEL_ADVERTISING != model.state))
+      {
+        model_cmd_rsp(opcode, ACI_STATUS_ERROR_DEVICE_STATE_INVALID);
+        break;
+      }
+      model_cmd_rsp(opcode, ACI_STATUS_SUCCESS);
+      model_disconnected(0x16);  // Connection terminated by the local host
+      break;
+
+    case ACI_CMD_CHANGE_TIMING:
+      if (MODEL_CONNECTED != model.state)
+      {
+        model_cmd_rsp(opcode, ACI_STATUS_ERROR_DEVICE_STATE_INVALID);
+        break;
+      }
+      model_cmd_rsp(opcode, ACI_STATUS_SUCCESS);
+      // The peer takes the maximum of the interval asked for, or the GAP PPCP one it already has
+      if (9 == model.rx_frame[0])
+      {
+        model.conn_interval = (uint16_t)(model.rx_frame[4] | (model.rx_frame[5] << 8));
+      }
+      model.timing_pending = true;
+      break;
+
+    case ACI_CMD_RADIO_RESET:
+      if (MODEL_SETUP == model.state)
+      {
+        model_cmd_rsp(opcode, ACI_STATUS_ERROR_DEVICE_STATE_INVALID);
+        break;
+      }
+      // The link is dropped without a Disconnected event, the setup is kept
+      model.state          = MODEL_STANDBY;
+      model.air_packets    = 0;
+      model.air_answers    = 0;
+      model.timing_pending = false;
+      model.peer_count     = 0;
+      model.event_count    = 0;
+      model_cmd_rsp(opcode, ACI_STATUS_SUCCESS);
+      break;
+
+    case ACI_CMD_SEND_DATA:
+      model_send_data();
+      break;
+
+    case ACI_CMD_SEND_DATA_ACK:
+    case ACI_CMD_SEND_DATA_NACK:
+    case ACI_CMD_REQUEST_DATA:
+      // No command response
+      model_send_answer();
+      break;
+
+    default:
+      model_cmd_rsp(opcode, ACI_STATUS_SUCCESS);
+      break;
+  }
+}
+
+static void model_rdyn_update(void)
+{
+  const bool low = ((model.reqn_low && !model.rdyn_delayed) || (0 != model.event_count)) && !model.reset_low;
+
+  mock_pin_set(model.config.rdyn_pin, low ? LOW : HIGH);
+}
+
+static void model_reset(void)
+{
+  model.state          = model.config.setup_done ? MODEL_STANDBY : MODEL_SETUP;
+  model.event_head     = 0;
+  model.event_count    = 0;
+  model.air_packets    = 0;
+  model.air_answers    = 0;
+  model.peer_count     = 0;
+  model.frame_index    = 0;
+  model.timing_pending = false;
+  model.conn_interval  = model.config.conn_interval;
+  model.setup_crc      = 0xFFFF;
+  model_device_started();
+}
+
+/*
+  REQN low starts a transfer, REQN high ends it. RESET low holds the model in reset.
+*/
+static void model_pin_hook(uint8_t pin, uint8_t level)
+{
+  if (pin == model.config.reset_pin)
+  {
+    if ((LOW == level) && !model.reset_low)
+    {
+      model.reset_low = true;
+    }
+    else if ((HIGH == level) && model.reset_low)
+    {
+      model.reset_low = false;
+      model_reset();
+    }
+  }
+  else if (pin == model.config.reqn_pin)
+  {
+    if (LOW == level)
+    {
+      // The nRF8001 takes a moment to answer REQN, the MCU sees RDYN high at least once
+      // RDYN read in the main context does that, an interrupt goes off with no read
+      model.rdyn_delayed    = !model.reqn_low && (HIGH == mock_pin_get(model.config.rdyn_pin)) &&
+                              (!model.config.interface_is_interrupt || !mock_interrupts_are_enabled());
+      model.reqn_low        = true;
+      model.frame_index     = 0;
+      model.frame_has_event = (0 != model.event_count);
+      memset(model.tx_frame, 0, sizeof(model.tx_frame));
+      memset(model.rx_frame, 0, sizeof(model.rx_frame));
+      if (model.frame_has_event)
+      {
+        const uint8_t *p_event = model.event_q[model.event_head];
+        memcpy(&model.tx_frame[1], p_event, p_event[0] + 1);
+      }
+    }
+    else if (model.reqn_low)
+    {
+      model.reqn_low = false;
+      // A transfer clocks at least the length of the command and the length of the event
+      if (model.frame_index >= 2)
+      {
+        model.stats.transfers++;
+        if (model.frame_has_event)
+        {
+          model.event_head = (model.event_head + 1) % MODEL_EVENT_Q_SIZE;
+          model.event_count--;
+          model.stats.events++;
+        }
+        if (0 != model.rx_frame[0])
+        {
+          model_command();
+        }
+      }
+      model.frame_index = 0;
+    }
+  }
+  model_rdyn_update();
+}
+
+static void model_pin_read_hook(uint8_t pin)
+{
+  if ((pin == model.config.rdyn_pin) && model.rdyn_delayed)
+  {
+    model.rdyn_delayed = false;
+    model_rdyn_update();
+  }
+}
+
+static uint8_t model_spi_hook(uint8_t mosi)
+{
+  uint8_t miso = 0;
+
+  if (model.frame_index < MODEL_FRAME_MAX)
+  {
+    model.rx_frame[model.frame_index] = mosi;
+    miso = model.tx_frame[model.frame_index];
+  }
+  model.frame_index++;
+  return miso;
+}
+
+/*
+  ACTIVE goes high at the start of a connection event, for longer with more packets.
+*/
+static void model_active_pulse(uint32_t start_us, uint8_t packets)
+{
+  const uint32_t length_us = model.config.active_event_us + (uint32_t)packets * model.config.active_packet_us;
+
+  if (UNUSED == model.config.active_pin)
+  {
+    return;
+  }
+  model.active_high      = true;
+  model.active_low_at_us = start_us + length_us;
+  model.stats.active_us += length_us;
+  mock_pin_set(model.config.active_pin, HIGH);
+}
+
+static void model_active_update(void)
+{
+  if (model.active_high && ((int32_t)(mock_time_now_us() - model.active_low_at_us) >= 0))
+  {
+    model.active_high = false;
+    mock_pin_set(model.config.active_pin, LOW);
+  }
+}
+
+/*
+  Runs the connection events that are due: the peer takes up to packets_per_event packets,
+  their credits and those of the answers are given back in one DataCredit event.
+*/
+static void model_conn_events(void)
+{
+  const uint32_t now = mock_time_now_us();
+
+  while ((MODEL_CONNECTED == model.state) && ((int32_t)(now - model.next_conn_event_us) >= 0))
+  {
+    uint8_t sent = (model.air_packets < model.config.packets_per_event) ? model.air_packets : model.config.packets_per_event;
+    uint8_t i;
+
+    model.stats.conn_events++;
+    model_active_pulse(model.next_conn_event_us, sent);
+    for (i = 0; i < sent; i++)
+    {
+      model.stats.bytes_sent += model.air_frames[i][0];
+      if (NULL != model.peer_read)
+      {
+        model.peer_read(model.air_frames[i][1], &model.air_frames[i][2], model.air_frames[i][0]);
+      }
+    }
+    // The packets left move up
+    memmove(model.air_frames, &model.air_frames[sent], sizeof(model.air_frames) - sent * MODEL_AIR_MAX);
+    model.air_packets       -= sent;
+    model.stats.packets_sent += sent;
+
+    if (0 != (sent + model.air_answers))
+    {
+      const uint8_t event[] = { 2, ACI_EVT_DATA_CREDIT, (uint8_t)(sent + model.air_answers) };
+
+      if (model_event_put(event))
+      {
+        model.credits    += event[2];
+        model.air_answers = 0;
+      }
+    }
+    if (model.timing_pending)
+    {
+      model.timing_pending = false;
+      model_timing();
+    }
+    for (i = 0; (i < model.config.packets_per_event) && (0 != model.peer_count); i++)
+    {
+      if (!model_event_put(model.peer_q[model.peer_head]))
+      {
+        break;
+      }
+      model.peer_head = (model.peer_head + 1) % MODEL_PEER_Q_SIZE;
+      model.peer_count--;
+    }
+    model.next_conn_event_us += (uint32_t)model.conn_interval * 1250;
+  }
+}
+
+void nrf8001_model_config_default(nrf8001_model_config_t *p_config)
+{
+  memset(p_config, 0, sizeof(*p_config));
+  p_config->reqn_pin               = 9;
+  p_config->rdyn_pin               = 8;
+  p_config->reset_pin              = UNUSED;
+  p_config->interface_is_interrupt = false;
+  p_config->interrupt_number       = 1;
+  p_config->setup_done             = false;
+  p_config->credits                = 2;
+  p_config->conn_interval          = 6;
+  p_config->packets_per_event      = 4;
+  p_config->connect_delay_us       = 100000;
+  memset(p_config->pipes_open, 0xFF, sizeof(p_config->pipes_open));
+  p_config->pipes_open[0]         &= 0xFE;  // Pipe 0 does not exist
+  p_config->dynamic_length         = 205;   // As ble_proximity_with_dfu_template
+  p_config->active_pin             = UNUSED;
+  p_config->active_event_us        = 250;
+  p_config->active_packet_us       = 400;
+  p_config->no_peer                = false;
+  p_config->bonded                 = false;
+  p_config->direct_delay_us        = 10000;
+  p_config->busy_every             = 0;
+}
+
+void nrf8001_model_init(const nrf8001_model_config_t *p_config)
+{
+  uint16_t i;
+
+  memset(&model, 0, sizeof(model));
+  model.config = *p_config;
+
+  if (model.config.dynamic_length > NRF8001_MODEL_DYNAMIC_MAX)
+  {
+    model.config.dynamic_length = NRF8001_MODEL_DYNAMIC_MAX;
+  }
+  for (i = 0; i < model.config.dynamic_length; i++)
+  {
+    model.dynamic[i] = (uint8_t)(i * 31 + 7);
+  }
+
+  mock_pin_hook_set(model_pin_hook);
+  mock_pin_read_hook_set(model_pin_read_hook);
+  mock_spi_hook_set(model_spi_hook);
+
+  if (model.config.interface_is_interrupt)
+  {
+    mock_interrupt_pin_set(model.config.interrupt_number, model.config.rdyn_pin);
+  }
+
+  if (UNUSED != model.config.active_pin)
+  {
+    mock_pin_set(model.config.active_pin, LOW);
+  }
+
+  // Power on
+  model_reset();
+  model_rdyn_update();
+}
+
+void nrf8001_model_run(void)
+{
+  if ((MODEL_ADVERTISING == model.state) && model.config.no_peer &&
+      ((int32_t)(mock_time_now_us() - model.advertising_end_us) >= 0))
+  {
+    model_advertising_timeout();
+  }
+  else if ((MODEL_ADVERTISING == model.state) && !model.config.no_peer &&
+           ((int32_t)(mock_time_now_us() - model.connect_at_us) >= 0))
+  {
+    model_connected();
+  }
+  model_active_update();
+  model_conn_events();
+  // The mock runs the RDYN interrupt handler when RDYN goes low
+  model_rdyn_update();
+}
+
+bool nrf8001_model_peer_write(uint8_t pipe, const uint8_t *p_data, uint8_t length)
+{
+  uint8_t *p_frame;
+
+  if ((MODEL_CONNECTED != model.state) || (MODEL_PEER_Q_SIZE == model.peer_count) || (length > ACI_PIPE_RX_DATA_MAX_LEN))
+  {
+    return false;
+  }
+  p_frame    = model.peer_q[(model.peer_head + model.peer_count) % MODEL_PEER_Q_SIZE];
+  p_frame[0] = 2 + length;
+  p_frame[1] = ACI_EVT_DATA_RECEIVED;
+  p_frame[2] = pipe;
+  memcpy(&p_frame[3], p_data, length);
+  model.peer_count++;
+  return true;
+}
+
+void nrf8001_model_peer_disconnect(void)
+{
+  if (MODEL_CONNECTED != model.state)
+  {
+    return;
+  }
+  model.peer_count     = 0;
+  model.timing_pending = false;
+  model_disconnected(0x13);  // Remote user terminated the connection
+}
+
+void nrf8001_model_peer_read_set(nrf8001_model_peer_read_t peer_read)
+{
+  model.peer_read = peer_read;
+}
+
+void nrf8001_model_command_read_set(nrf8001_model_command_read_t command_read)
+{
+  model.command_read = command_read;
+}
+
+bool nrf8001_model_is_connected(void)
+{
+  return (MODEL_CONNECTED == model.state);
+}
+
+void nrf8001_model_dynamic_set(uint16_t index, uint8_t value)
+{
+  if (index < model.config.dynamic_length)
+  {
+    model.dynamic[index] = value;
+  }
+}
+
+const uint8_t *nrf8001_model_dynamic_get(uint16_t *p_length)
+{
+  *p_length = model.config.dynamic_length;
+  return model.dynamic;
+}
+
+void nrf8001_model_aci_state_fill(aci_state_t *p_aci_state, const nrf8001_model_config_t *p_config,
+                                  services_pipe_type_mapping_t *p_pipe_types, uint8_t pipes,
+                                  const hal_aci_data_t *p_setup_msgs, uint8_t setup_msgs)
+{
+  memset(p_aci_state, 0, sizeof(*p_aci_state));
+  p_aci_state->aci_setup_info.services_pipe_type_mapping = p_pipe_types;
+  p_aci_state->aci_setup_info.number_of_pipes            = pipes;
+  p_aci_state->aci_setup_info.setup_msgs                 = (hal_aci_data_t *)p_setup_msgs;
+  p_aci_state->aci_setup_info.num_setup_msgs             = setup_msgs;
+
+  p_aci_state->aci_pins.board_name             = BOARD_DEFAULT;
+  p_aci_state->aci_pins.reqn_pin               = p_config->reqn_pin;
+  p_aci_state->aci_pins.rdyn_pin               = p_config->rdyn_pin;
+  p_aci_state->aci_pins.mosi_pin               = MOSI;
+  p_aci_state->aci_pins.miso_pin               = MISO;
+  p_aci_state->aci_pins.sck_pin                = SCK;
+  p_aci_state->aci_pins.spi_clock_divider      = SPI_CLOCK_DIV8;
+  p_aci_state->aci_pins.reset_pin              = p_config->reset_pin;
+  p_aci_state->aci_pins.active_pin             = p_config->active_pin;
+  p_aci_state->aci_pins.optional_chip_sel_pin  = UNUSED;
+  p_aci_state->aci_pins.interface_is_interrupt = p_config->interface_is_interrupt;
+  p_aci_state->aci_pins.interrupt_number       = p_config->interrupt_number;
+}
+
+void nrf8001_model_stats_get(nrf8001_model_stats_t *p_stats)
+{
+  *p_stats = model.stats;
+}
@@ -0,0 +1,143 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/** @file
+ * @brief Behavioural model of the nRF8001 for the host build of the BLE library
+ *
+ * The model sits behind the mock SPI and the REQN, RDYN, RESET and ACTIVE pins of arduino_mock.h and
+ * speaks the ACI of aci_cmds.h and aci_evts.h: the setup transaction, connecting, the data
+ * credits, the connection events and the DataCredit events that return the credits.
+ * It runs on the virtual clock of the mock, so a run is fast and the same every time.
+ *
+ * It is not a radio: the peer takes packets_per_event packets at every connection event,
+ * nothing is lost, and the commands that are not modelled get a successful command response.
+ * The dynamic data is read out with ReadDynamicData in messages of 26 bytes and written back with
+ * WriteDynamicData. It is the same after each power on, until changed with nrf8001_model_dynamic_set().
+ */
+
+#ifndef NRF8001_MODEL_H__
+#define NRF8001_MODEL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lib_aci.h"
+
+#define NRF8001_MODEL_PIPES_BYTES  8
+#define NRF8001_MODEL_DYNAMIC_MAX  400
+
+typedef struct
+{
+  uint8_t  reqn_pin;
+  uint8_t  rdyn_pin;
+  uint8_t  reset_pin;                   // UNUSED when the sketch does not reset the nRF8001
+  bool     interface_is_interrupt;      // The RDYN interrupt is raised by nrf8001_model_run()
+  uint8_t  interrupt_number;
+
+  bool     setup_done;                  // Starts in Standby, as with the setup in OTP
+  uint8_t  credits;                     // Data credits given in the DeviceStarted event
+  uint16_t conn_interval;               // Connection interval given by the peer, 1.25 ms units
+  uint8_t  packets_per_event;           // Packets the peer takes at every connection event
+  uint32_t connect_delay_us;            // Advertising time before the peer connects
+  uint8_t  pipes_open[NRF8001_MODEL_PIPES_BYTES]; // Pipes reported open once connected
+  uint16_t dynamic_length;              // Bytes of dynamic data (bond information) held
+  uint8_t  active_pin;                  // ACTIVE, UNUSED when the sketch does not read it
+  uint16_t active_event_us;             // ACTIVE high time of a connection event without packets
+  uint16_t active_packet_us;            // and for each packet the peer takes
+  bool     no_peer;                     // No peer connects, the advertising times out
+  bool     bonded;                      // ConnectDirect is taken, else answered Bond Required
+  uint32_t direct_delay_us;             // Directed advertising time before the peer connects
+  uint16_t busy_every;                  // Every Nth SendData fails with a Busy pipe error, 0 for none
+} nrf8001_model_config_t;
+
+typedef struct
+{
+  uint32_t commands;                    // Commands received
+  uint32_t transfers;                   // SPI transfers, REQN low to REQN high
+  uint32_t events;                      // Events clocked out
+  uint32_t conn_events;                 // Connection events run
+  uint32_t packets_sent;                // Data packets sent to the peer
+  uint32_t bytes_sent;                  // Payload bytes sent to the peer
+  uint32_t credit_errors;               // SendData without a credit
+  uint8_t  event_q_high_water;          // Most events waiting for the MCU
+  uint32_t dynamic_reads;               // ReadDynamicData commands answered
+  uint32_t dynamic_writes;              // WriteDynamicData commands taken
+  uint32_t active_us;                   // ACTIVE high time
+  uint32_t sleeps;                      // Sleep commands taken
+  uint32_t sleep_us;                    // Time spent in Sleep
+  uint32_t sleep_commands;              // Commands other than Wakeup received in Sleep
+  uint32_t busy_errors;                 // SendData failed by busy_every
+} nrf8001_model_stats_t;
+
+/** @brief Fills the configuration with the model defaults: the pins of the examples, polling,
+ *  2 credits, 7.5 ms connection interval, 4 packets per connection event. */
+void nrf8001_model_config_default(nrf8001_model_config_t *p_config);
+
+/** @brief Powers the model on, takes over the SPI and pin hooks of the mock.
+ *  The DeviceStarted event is sent right away, and again after each pin reset. */
+void nrf8001_model_init(const nrf8001_model_config_t *p_config);
+
+/** @brief Runs the model up to the virtual time of the mock. Call it from the loop of the sketch. */
+void nrf8001_model_run(void);
+
+/** @brief Sends data from the peer on a pipe, as a DataReceived event at the next connection event
+ *  with room. Up to packets_per_event packets go at each connection event.
+ *  @return True if the packet was taken, false when not connected or 8 packets are already waiting. */
+bool nrf8001_model_peer_write(uint8_t pipe, const uint8_t *p_data, uint8_t length);
+
+/** @brief Called for each packet the peer takes at a connection event, with the data of its SendData */
+typedef void (*nrf8001_model_peer_read_t)(uint8_t pipe, const uint8_t *p_data, uint8_t length);
+
+/** @brief Sets the function called with the packets the peer takes, NULL for none.
+ *  It is kept until the next nrf8001_model_init(). */
+void nrf8001_model_peer_read_set(nrf8001_model_peer_read_t peer_read);
+
+/** @brief Called for each command the model receives, with the parameters after the opcode */
+typedef void (*nrf8001_model_command_read_t)(uint8_t opcode, const uint8_t *p_params, uint8_t length);
+
+/** @brief Sets the function called with the commands received, NULL for none.
+ *  It is called before the command is answered, and kept until the next nrf8001_model_init(). */
+void nrf8001_model_command_read_set(nrf8001_model_command_read_t command_read);
+
+/** @brief The peer drops the link, the Disconnected event gives the remote user terminated reason.
+ *  The packets the peer had not sent yet are lost. Does nothing when not connected. */
+void nrf8001_model_peer_disconnect(void);
+
+/** @brief True while a peer is connected */
+bool nrf8001_model_is_connected(void);
+
+/** @brief Changes a byte of the dynamic data, as a new bond or a change of a CCCD would */
+void nrf8001_model_dynamic_set(uint16_t index, uint8_t value);
+
+/** @brief Dynamic data held, after the WriteDynamicData commands that completed */
+const uint8_t *nrf8001_model_dynamic_get(uint16_t *p_length);
+
+/** @brief Fills the aci_state of a run against the model: the setup of the services and the pins of the
+ *  configuration, on the mock SPI at SPI_CLOCK_DIV8. The rest of aci_state is cleared.
+ *  p_pipe_types and p_setup_msgs can be NULL with 0 pipes and 0 messages, when the setup is not sent. */
+void nrf8001_model_aci_state_fill(aci_state_t *p_aci_state, const nrf8001_model_config_t *p_config,
+                                  services_pipe_type_mapping_t *p_pipe_types, uint8_t pipes,
+                                  const hal_aci_data_t *p_setup_msgs, uint8_t setup_msgs);
+
+/** @brief Statistics since nrf8001_model_init() */
+void nrf8001_model_stats_get(nrf8001_model_stats_t *p_stats);
+
+#endif /* NRF8001_MODEL_H__ */
@@ -0,0 +1,445 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+/** @file
+ * @brief Replay of a captured ACI trace through the BLE library, for offline analysis
+ *
+ * Reads a capture of HAL_ACI_TL_TRACE (the record format of Build/DecodeAciTrace.py) and feeds
+ * its events, in order and on the virtual clock of the capture, to lib_aci_event_get() so that
+ * lib_aci keeps the credits and the pipe states as on the board. The commands of the capture are
+ * not sent again, they are only accounted: the data commands take a credit, the other ones wait
+ * for their response. Prints a timeline with, for every record, the gap since the event before,
+ * the commands waiting for a response, the credits available, the open pipes and the command to
+ * response latency, and a summary of the latencies per command.
+ *
+ * The events are recorded when the sketch takes them, the commands when they are queued, so the
+ * gaps are the ones seen by the sketch and the latencies include the time in the queues.
+ *
+ * The replay fails, and returns 1, when the capture is truncated, when an event could not be
+ * given to the library or when a data command went without a credit.
+ *
+ * Usage: replay_aci [-s] <capture file>   -s prints the summary only
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "arduino_mock.h"
+#include "SPI.h"
+#include "hal_platform.h"
+#include "lib_aci.h"
+#include "nrf8001_model.h"
+
+#define REPLAY_HEADER_LENGTH  6           // [type][micros() 4 bytes][length]
+#define REPLAY_PENDING_MAX    16          // Commands waiting for a response
+#define REPLAY_TIMEOUT_US     2000000UL   // Time given to lib_aci_init()
+#define REPLAY_LOOP_US        20
+
+static aci_state_t    aci_state;
+static hal_aci_evt_t  aci_data;
+
+typedef struct
+{
+  uint8_t  opcode;
+  uint32_t time_us;
+} replay_pending_t;
+
+typedef struct
+{
+  uint32_t count;
+  uint32_t total_us;
+  uint32_t max_us;
+} replay_latency_t;
+
+static replay_pending_t pending[REPLAY_PENDING_MAX];
+static uint8_t          pending_count;
+static replay_latency_t latency[256];
+
+static struct
+{
+  uint32_t commands;
+  uint32_t events;
+  uint32_t logs;
+  uint32_t data_commands;
+  uint32_t credit_underruns;      // Data commands sent with no credit left
+  uint32_t unmatched;             // Responses to no pending command
+  uint32_t dropped;               // Events the event queue did not take
+  bool     truncated;             // The capture ends in a record
+  uint32_t gap_max_us;
+  uint32_t gap_total_us;
+  uint8_t  pending_max;
+  uint8_t  credits_min;
+} replay;
+
+static const char *replay_cmd_name(uint8_t opcode)
+{
+  static const char *names[] = {
+    "Unknown", "Test", "Echo", "DtmCommand", "Sleep", "Wakeup", "Setup", "ReadDynamicData",
+    "WriteDynamicData", "GetDeviceVersion", "GetDeviceAddress", "GetBatteryLevel",
+    "GetTemperature", "SetLocalData", "RadioReset", "Connect", "Bond", "Disconnect",
+    "SetTxPower", "ChangeTiming", "OpenRemotePipe", "SendData", "SendDataAck", "RequestData",
+    "SendDataNack", "SetApplLatency", "SetKey", "OpenAdvPipe", "Broadcast",
+    "BondSecurityRequest", "ConnectDirect", "CloseRemotePipe",
+  };
+
+  return (opcode < sizeof(names) / sizeof(names[0])) ? names[opcode] : names[0];
+}
+
+static const char *replay_evt_name(uint8_t opcode)
+{
+  static const char *names[] = {
+    "Unknown", "DeviceStarted", "Echo", "HardwareError", "CommandResponse", "Connected",
+    "Disconnected", "BondStatus", "PipeStatus", "Timing", "DataCredit", "DataAck",
+    "DataReceived", "PipeError", "DisplayPasskey", "KeyRequest",
+  };
+  uint8_t index = (uint8_t)(opcode - 0x80);
+
+  return (index < sizeof(names) / sizeof(names[0])) ? names[index] : names[0];
+}
+
+static bool replay_is_data_cmd(uint8_t opcode)
+{
+  return (ACI_CMD_SEND_DATA == opcode) || (ACI_CMD_REQUEST_DATA == opcode) ||
+         (ACI_CMD_SEND_DATA_ACK == opcode) || (ACI_CMD_SEND_DATA_NACK == opcode);
+}
+
+/* Brings the library up against the nRF8001 model, the model is left idle afterwards */
+static bool replay_init(void)
+{
+  nrf8001_model_config_t model;
+  uint32_t               start_us;
+
+  nrf8001_model_config_default(&model);
+  model.setup_done = true;
+  model.reset_pin  = 4;
+
+  mock_reset();
+  nrf8001_model_init(&model);
+
+  nrf8001_model_aci_state_fill(&aci_state, &model, NULL, 0, NULL, 0);
+
+  lib_aci_init(&aci_state, false);
+
+  start_us = mock_time_now_us();
+  while ((mock_time_now_us() - start_us) < REPLAY_TIMEOUT_US)
+  {
+    nrf8001_model_run();
+    if (lib_aci_event_get(&aci_state, &aci_data) &&
+        (ACI_EVT_DEVICE_STARTED == aci_data.evt.evt_opcode))
+    {
+      return true;
+    }
+    mock_time_advance_us(REPLAY_LOOP_US);
+  }
+  return false;
+}
+
+static uint8_t replay_pipes_open(void)
+{
+  uint8_t count = 0;
+  uint8_t i;
+
+  for (i = 0; i < PIPES_ARRAY_SIZE; i++)
+  {
+    uint8_t bits = aci_state.pipes_open_bitmap[i];
+
+    for (; 0 != bits; bits &= (uint8_t)(bits - 1))
+    {
+      count++;
+    }
+  }
+  return count;
+}
+
+static void replay_command(uint32_t time_us, uint8_t opcode)
+{
+  replay.commands++;
+  if (replay_is_data_cmd(opcode))
+  {
+    replay.data_commands++;
+    if (0 == aci_state.data_credit_available)
+    {
+      replay.credit_underruns++;
+    }
+    else
+    {
+      /* Taken by lib_aci_send_data() and the others on the board */
+      aci_state.data_credit_available--;
+    }
+    return;
+  }
+  if ((ACI_CMD_SLEEP == opcode) || (ACI_CMD_WAKEUP == opcode))
+  {
+    /* No response, Wakeup is answered by a DeviceStarted event */
+    return;
+  }
+  if (REPLAY_PENDING_MAX == pending_count)
+  {
+    memmove(&pending[0], &pending[1], (REPLAY_PENDING_MAX - 1) * sizeof(pending[0]));
+    pending_count--;
+  }
+  pending[pending_count].opcode  = opcode;
+  pending[pending_count].time_us = time_us;
+  pending_count++;
+  if (pending_count > replay.pending_max)
+  {
+    replay.pending_max = pending_count;
+  }
+}
+
+/* Returns the latency of the oldest command waiting for this response, or -1 */
+static int32_t replay_response(uint32_t time_us, uint8_t opcode)
+{
+  uint32_t elapsed_us;
+  uint8_t  i;
+
+  for (i = 0; i < pending_count; i++)
+  {
+    if (pending[i].opcode == opcode)
+    {
+      break;
+    }
+  }
+  if (i == pending_count)
+  {
+    replay.unmatched++;
+    return -1;
+  }
+
+  elapsed_us = time_us - pending[i].time_us;
+  memmove(&pending[i], &pending[i + 1], (pending_count - i - 1) * sizeof(pending[0]));
+  pending_count--;
+
+  latency[opcode].count++;
+  latency[opcode].total_us += elapsed_us;
+  if (elapsed_us > latency[opcode].max_us)
+  {
+    latency[opcode].max_us = elapsed_us;
+  }
+  return (int32_t)elapsed_us;
+}
+
+static void replay_event(const uint8_t *p_payload, uint8_t length)
+{
+  hal_aci_data_t evt;
+
+  memset(&evt, 0, sizeof(evt));
+  evt.buffer[0] = length;
+  memcpy(&evt.buffer[1], p_payload, length);
+  if (!hal_aci_tl_event_inject(&evt))
+  {
+    replay.dropped++;
+    return;
+  }
+  while (lib_aci_event_get(&aci_state, &aci_data))
+  {
+  }
+}
+
+static void replay_run(const uint8_t *p_data, uint32_t size, bool timeline)
+{
+  uint32_t offset = 0;
+  uint32_t first_us = 0;
+  uint32_t clock_us = mock_time_now_us();
+  uint32_t last_evt_us = 0;
+  bool     started = false;
+  bool     evt_seen = false;
+
+  if (timeline)
+  {
+    printf("%11s %9s %s %-18s %4s %4s %5s %9s\n",
+           "us", "gap us", "t", "name", "pend", "crd", "pipes", "lat us");
+  }
+
+  while ((offset + REPLAY_HEADER_LENGTH) <= size)
+  {
+    const uint8_t  type = p_data[offset];
+    uint32_t       time_us;
+    uint8_t        length;
+    const uint8_t *p_payload;
+    int32_t        lat_us = -1;
+    uint32_t       gap_us = 0;
+    const char    *p_name;
+
+    if (('C' != type) && ('E' != type) && ('L' != type))
+    {
+      /* Not at a record boundary, resynchronise on the next type byte */
+      offset++;
+      continue;
+    }
+    time_us = (uint32_t)p_data[offset + 1] | ((uint32_t)p_data[offset + 2] << 8) |
+              ((uint32_t)p_data[offset + 3] << 16) | ((uint32_t)p_data[offset + 4] << 24);
+    length    = p_data[offset + 5];
+    p_payload = &p_data[offset + REPLAY_HEADER_LENGTH];
+    if (((offset + REPLAY_HEADER_LENGTH + length) > size) || (length > HAL_ACI_MAX_LENGTH))
+    {
+      printf("Truncated record at offset %lu\n", (unsigned long)offset);
+      replay.truncated = true;
+      break;
+    }
+    offset += REPLAY_HEADER_LENGTH + length;
+
+    if ('L' == type)
+    {
+      replay.logs++;
+      continue;
+    }
+    if (0 == length)
+    {
+      continue;
+    }
+
+    /* The library sees the time of the capture, e.g. for the command timeouts */
+    if (!started)
+    {
+      first_us = time_us;
+      started  = true;
+    }
+    if ((time_us - first_us) > (mock_time_now_us() - clock_us))
+    {
+      mock_time_advance_us((time_us - first_us) - (mock_time_now_us() - clock_us));
+    }
+
+    if ('C' == type)
+    {
+      replay_command(time_us, p_payload[0]);
+      p_name = replay_cmd_name(p_payload[0]);
+    }
+    else
+    {
+      replay.events++;
+      if (evt_seen)
+      {
+        gap_us = time_us - last_evt_us;
+        replay.gap_total_us += gap_us;
+        if (gap_us > replay.gap_max_us)
+        {
+          replay.gap_max_us = gap_us;
+        }
+      }
+      evt_seen    = true;
+      last_evt_us = time_us;
+
+      if ((ACI_EVT_CMD_RSP == p_payload[0]) && (length >= 2))
+      {
+        lat_us = replay_response(time_us, p_payload[1]);
+      }
+      else if (ACI_EVT_ECHO == p_payload[0])
+      {
+        lat_us = replay_response(time_us, ACI_CMD_ECHO);
+      }
+      replay_event(p_payload, length);
+      p_name = replay_evt_name(p_payload[0]);
+    }
+    if (aci_state.data_credit_available < replay.credits_min)
+    {
+      replay.credits_min = aci_state.data_credit_available;
+    }
+
+    if (timeline)
+    {
+      printf("%11lu %9lu %c %-18s %4u %4u %5u ", (unsigned long)(time_us - first_us),
+             (unsigned long)gap_us, type, p_name, pending_count,
+             aci_state.data_credit_available, replay_pipes_open());
+      if (lat_us < 0)
+      {
+        printf("%9s\n", "-");
+      }
+      else
+      {
+        printf("%9ld\n", (long)lat_us);
+      }
+    }
+  }
+}
+
+static void replay_summary(void)
+{
+  uint16_t opcode;
+
+  printf("\n%lu commands (%lu data, %lu without a credit), %lu events (%lu not taken), %lu log records\n",
+         (unsigned long)replay.commands, (unsigned long)replay.data_commands,
+         (unsigned long)replay.credit_underruns, (unsigned long)replay.events,
+         (unsigned long)replay.dropped, (unsigned long)replay.logs);
+  printf("event gap avg %lu us max %lu us, most commands waiting %u, fewest credits %u, "
+         "%lu responses unmatched, %u commands never answered\n",
+         (unsigned long)((replay.events > 1) ? (replay.gap_total_us / (replay.events - 1)) : 0),
+         (unsigned long)replay.gap_max_us, replay.pending_max, replay.credits_min,
+         (unsigned long)replay.unmatched, pending_count);
+
+  printf("\n%-20s %6s %9s %9s\n", "command", "count", "avg us", "max us");
+  for (opcode = 0; opcode < 256; opcode++)
+  {
+    if (0 != latency[opcode].count)
+    {
+      printf("%-20s %6lu %9lu %9lu\n", replay_cmd_name((uint8_t)opcode),
+             (unsigned long)latency[opcode].count,
+             (unsigned long)(latency[opcode].total_us / latency[opcode].count),
+             (unsigned long)latency[opcode].max_us);
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  static uint8_t data[1024UL * 1024UL];
+  const char    *p_path;
+  bool           timeline = true;
+  FILE          *p_file;
+  size_t         size;
+
+  if ((3 == argc) && (0 == strcmp(argv[1], "-s")))
+  {
+    timeline = false;
+    p_path   = argv[2];
+  }
+  else if (2 == argc)
+  {
+    p_path = argv[1];
+  }
+  else
+  {
+    printf("Usage: replay_aci [-s] <capture file>\n");
+    return 1;
+  }
+
+  p_file = fopen(p_path, "rb");
+  if (NULL == p_file)
+  {
+    printf("Cannot open %s\n", p_path);
+    return 1;
+  }
+  size = fread(data, 1, sizeof(data), p_file);
+  fclose(p_file);
+
+  if (!replay_init())
+  {
+    printf("lib_aci_init() did not complete\n");
+    return 1;
+  }
+  memset(&replay, 0, sizeof(replay));
+  replay.credits_min = 0xFF;
+
+  replay_run(data, (uint32_t)size, timeline);
+  replay_summary();
+  return (replay.truncated || (0 != replay.dropped) || (0 != replay.credit_underruns)) ? 1 : 0;
+}
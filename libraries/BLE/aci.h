@@ -51,6 +51,8 @@
 #ifndef ACI_H__
 #define ACI_H__
 
+#include <stddef.h>
+
 /**
  * Define an _aci_packed_ macro we can use in structure and enumerated type
  * declarations so that the types are sized consistently across different
@@ -87,6 +89,13 @@
  */
 #define ACI_ASSERT_SIZE(x,y) typedef char x ## _assert_size_t[-1+10*(sizeof(x) == (y))]
 
+/**
+ * @def ACI_ASSERT_OFFSET
+ * @brief Compile time assert that field f of structure x is at offset y.
+ * Same as ACI_ASSERT_SIZE, used to pin the overlay views to the protocol offsets.
+ */
+#define ACI_ASSERT_OFFSET(x,f,y) typedef char x ## _ ## f ## _assert_offset_t[-1+10*(offsetof(x, f) == (y))]
+
 /**
  * @def ACI_VERSION
  * @brief Current ACI protocol version. 0 means a device that is not yet released.
@@ -0,0 +1,113 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+ 
+
+/** @file
+@brief Implementation of the sample aggregator
+*/
+
+#include <lib_aci.h>
+#include "aci_aggregator.h"
+
+bool aci_aggregator_init(aci_aggregator_t *p_agg, uint8_t pipe, uint8_t sample_size, bool timestamped, uint16_t deadline_ms)
+{
+  const uint8_t record_size = sample_size + (timestamped ? ACI_AGGREGATOR_TIMESTAMP_LEN : 0);
+
+  if ((0 == sample_size) || (record_size > ACI_PIPE_TX_DATA_MAX_LEN))
+  {
+    return false;
+  }
+
+  p_agg->pipe        = pipe;
+  p_agg->record_size = record_size;
+  p_agg->timestamped = timestamped;
+  p_agg->deadline_ms = deadline_ms;
+  p_agg->length      = 0;
+  p_agg->first_ms    = 0;
+  return true;
+}
+
+bool aci_aggregator_flush(aci_aggregator_t *p_agg, aci_state_t *aci_stat)
+{
+  if (0 == p_agg->length)
+  {
+    return true;
+  }
+
+  lib_aci_select(aci_stat);
+  if (!lib_aci_is_pipe_available(aci_stat, p_agg->pipe) ||
+      !lib_aci_send_data(p_agg->pipe, &p_agg->buffer[0], p_agg->length))
+  {
+    return false;
+  }
+
+  p_agg->length = 0;
+  return true;
+}
+
+bool aci_aggregator_add(aci_aggregator_t *p_agg, aci_state_t *aci_stat, const uint8_t *p_sample)
+{
+  const unsigned long now_ms = millis();
+  uint8_t *p_record;
+
+  // No room left from a packet that could not be sent yet
+  if (((p_agg->length + p_agg->record_size) > ACI_PIPE_TX_DATA_MAX_LEN) &&
+      !aci_aggregator_flush(p_agg, aci_stat))
+  {
+    return false;
+  }
+
+  if (0 == p_agg->length)
+  {
+    p_agg->first_ms = now_ms;
+  }
+
+  p_record = &p_agg->buffer[p_agg->length];
+  if (p_agg->timestamped)
+  {
+    p_record[0] = (uint8_t)(now_ms & 0xFF);
+    p_record[1] = (uint8_t)((now_ms >> 8) & 0xFF);
+    p_record += ACI_AGGREGATOR_TIMESTAMP_LEN;
+  }
+  memcpy(p_record, p_sample, p_agg->record_size - (p_agg->timestamped ? ACI_AGGREGATOR_TIMESTAMP_LEN : 0));
+  p_agg->length += p_agg->record_size;
+
+  // Send as soon as the next record would not fit, a failure is retried by the next call
+  if ((p_agg->length + p_agg->record_size) > ACI_PIPE_TX_DATA_MAX_LEN)
+  {
+    aci_aggregator_flush(p_agg, aci_stat);
+  }
+  return true;
+}
+
+void aci_aggregator_poll(aci_aggregator_t *p_agg, aci_state_t *aci_stat)
+{
+  if ((0 != p_agg->length) && (0 != p_agg->deadline_ms) &&
+      ((millis() - p_agg->first_ms) >= p_agg->deadline_ms))
+  {
+    aci_aggregator_flush(p_agg, aci_stat);
+  }
+}
+
+void aci_aggregator_clear(aci_aggregator_t *p_agg)
+{
+  p_agg->length = 0;
+}
@@ -0,0 +1,91 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+ 
+
+/** @file
+ * @brief Packs several fixed size samples into each SendData.
+ */
+
+/** @defgroup aci_aggregator aci_aggregator
+@{
+@ingroup lib
+
+@brief Buffers the samples of a pipe and sends them together with lib_aci_send_data().
+@details One packet of up to ACI_PIPE_TX_DATA_MAX_LEN bytes holds as many records as fit.
+A record is the sample, preceded by the low 16 bits of millis() (LSB first) when the
+aggregator is timestamped. The packet is sent when no other record fits, or when its oldest
+record is deadline_ms old; call aci_aggregator_poll() from the loop for the deadline.
+*/
+
+#ifndef ACI_AGGREGATOR_H__
+#define ACI_AGGREGATOR_H__
+
+#include <lib_aci.h>
+
+/** Bytes of the timestamp before each sample of a timestamped aggregator */
+#define ACI_AGGREGATOR_TIMESTAMP_LEN  2
+
+typedef struct
+{
+  uint8_t       pipe;
+  uint8_t       record_size;                        /**< Sample size plus timestamp */
+  bool          timestamped;
+  uint16_t      deadline_ms;                        /**< Longest time a record waits, 0 to only send full packets */
+  uint8_t       length;                             /**< Bytes in buffer */
+  unsigned long first_ms;                           /**< Time the oldest record was added */
+  uint8_t       buffer[ACI_PIPE_TX_DATA_MAX_LEN];
+} aci_aggregator_t;
+
+/** @brief Initializes an aggregator for a pipe.
+ *  @param p_agg state of the aggregator.
+ *  @param pipe pipe the packets are sent on, see lib_aci_send_data().
+ *  @param sample_size bytes in one sample.
+ *  @param timestamped true to store the time with each sample.
+ *  @param deadline_ms longest time a sample waits to be sent, 0 to only send full packets.
+ *  @return False if a sample does not fit in a packet.
+ */
+bool aci_aggregator_init(aci_aggregator_t *p_agg, uint8_t pipe, uint8_t sample_size, bool timestamped, uint16_t deadline_ms);
+
+/** @brief Adds a sample, sends the packet when it is full.
+ *  @details When the packet cannot be sent, e.g. for lack of data credit, the sample is kept
+ *  as long as there is room for it and the packet is sent by a later call.
+ *  @param p_agg state of the aggregator.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param p_sample sample_size bytes.
+ *  @return False if the sample was dropped, the packet being full and not sent.
+ */
+bool aci_aggregator_add(aci_aggregator_t *p_agg, aci_state_t *aci_stat, const uint8_t *p_sample);
+
+/** @brief Sends the records buffered, if any.
+ *  @return False if there are records and they could not be sent.
+ */
+bool aci_aggregator_flush(aci_aggregator_t *p_agg, aci_state_t *aci_stat);
+
+/** @brief Sends the records buffered when the oldest has waited deadline_ms, call it from the loop.
+ */
+void aci_aggregator_poll(aci_aggregator_t *p_agg, aci_state_t *aci_stat);
+
+/** @brief Drops the records buffered, e.g. on disconnect.
+ */
+void aci_aggregator_clear(aci_aggregator_t *p_agg);
+
+#endif // ACI_AGGREGATOR_H__
+/** @} */
@@ -0,0 +1,709 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+@brief Implementation of the bond store in the EEPROM
+*/
+
+#include <lib_aci.h>
+#include "aci_bond_store.h"
+#include "aci_crc.h"
+
+#if (ACI_BOND_STORE_SLOTS < 2)
+#error "ACI_BOND_STORE_SLOTS must be at least 2"
+#endif
+
+#if (ACI_BOND_STORE_BONDS < 1) || (ACI_BOND_STORE_BONDS > 8)
+#error "ACI_BOND_STORE_BONDS must be 1 to 8"
+#endif
+
+//Board dependent defines
+#if defined(__AVR__)
+  #include <avr/eeprom.h>
+  #define aci_bond_store_nv_read(address)         eeprom_read_byte((const uint8_t *)(uintptr_t)(address))
+  #define aci_bond_store_nv_write(address, value) eeprom_write_byte((uint8_t *)(uintptr_t)(address), (value))
+  //The write of a byte runs in the background, the next access waits for it
+  #define aci_bond_store_nv_ready()               eeprom_is_ready()
+#else
+  #define aci_bond_store_nv_ready()               (true)
+#endif
+
+#define ACI_BOND_STORE_NO_SLOT  0xFF
+
+/* Offsets in the header of a slot */
+#define ACI_BOND_STORE_SEQ      0
+#define ACI_BOND_STORE_COUNT    1
+#define ACI_BOND_STORE_PEER     2
+#define ACI_BOND_STORE_LENGTH   3
+#define ACI_BOND_STORE_CRC      5
+
+/* Current record of a bond, the index kept in RAM */
+typedef struct
+{
+  uint8_t  slot;            /* ACI_BOND_STORE_NO_SLOT when the bond is not stored */
+  uint8_t  seq;
+  uint8_t  msg_count;
+  uint8_t  peer;            /* Hash of the peer address */
+  uint16_t length;
+} aci_bond_store_record_t;
+
+typedef struct
+{
+  aci_bond_store_record_t record[ACI_BOND_STORE_BONDS];
+  uint8_t  bond;            /* Bond selected */
+  uint8_t  bonds;           /* Bitmap of the bonds stored */
+
+  /* Record being saved */
+  uint8_t  save_slot;
+  uint8_t  save_msg_count;
+  uint8_t  save_peer;
+  uint16_t save_length;
+  uint16_t save_crc;
+  bool     save_diverged;   /* The data is not the same as the current record, it is being written */
+  bool     save_failed;
+
+#if ACI_BOND_STORE_STAGING
+  /* Record written by aci_bond_store_commit_poll(), from the staging buffer */
+  bool     commit_pending;
+  uint8_t  commit_bond;
+  uint8_t  commit_slot;
+  uint16_t commit_pos;      /* Next byte to write, the data and then the header */
+  uint16_t commit_length;
+  uint8_t  commit_msg_count;
+  uint8_t  commit_header[ACI_BOND_STORE_HEADER_SIZE];
+  uint8_t  staging[ACI_BOND_STORE_DATA_MAX];
+#endif
+
+  /* Restore run by aci_bond_store_restore_poll() */
+  bool          restore_running;
+  uint16_t      restore_cursor;       /* Next command of the record to put in the command queue */
+  unsigned long restore_progress_ms;  /* millis() of the start or of the last response */
+
+  uint16_t write_count;
+} aci_bond_store_t;
+
+static aci_bond_store_t aci_bond_store;
+
+#define aci_bond_store_current() (&aci_bond_store.record[aci_bond_store.bond])
+
+static uint16_t aci_bond_store_bond_address(uint8_t bond, uint8_t slot, uint16_t offset)
+{
+  return (uint16_t)(ACI_BOND_STORE_START + ((uint16_t)bond * ACI_BOND_STORE_BOND_SIZE) +
+                    ((uint16_t)slot * ACI_BOND_STORE_SLOT_SIZE) + offset);
+}
+
+/* Address in the selected bond */
+static uint16_t aci_bond_store_address(uint8_t slot, uint16_t offset)
+{
+  return aci_bond_store_bond_address(aci_bond_store.bond, slot, offset);
+}
+
+/*
+  Writes the byte only when the EEPROM holds something else, an EEPROM write takes about 3.3 ms.
+*/
+static void aci_bond_store_update(uint16_t address, uint8_t value)
+{
+  if (aci_bond_store_nv_read(address) != value)
+  {
+    aci_bond_store_nv_write(address, value);
+    aci_bond_store.write_count++;
+  }
+}
+
+static uint16_t aci_bond_store_header_crc(uint16_t crc, uint8_t seq, uint8_t msg_count, uint8_t peer,
+                                          uint16_t length)
+{
+  crc = aci_crc16_ccitt_update(crc, seq);
+  crc = aci_crc16_ccitt_update(crc, msg_count);
+  crc = aci_crc16_ccitt_update(crc, peer);
+  crc = aci_crc16_ccitt_update(crc, (uint8_t)length);
+  return aci_crc16_ccitt_update(crc, (uint8_t)(length >> 8));
+}
+
+/*
+  Header of the record being saved, crc is the CRC of its data.
+*/
+static void aci_bond_store_header_make(uint8_t *p_header, uint8_t seq, uint16_t crc)
+{
+  crc = aci_bond_store_header_crc(crc, seq, aci_bond_store.save_msg_count, aci_bond_store.save_peer,
+                                  aci_bond_store.save_length);
+  p_header[ACI_BOND_STORE_SEQ]        = seq;
+  p_header[ACI_BOND_STORE_COUNT]      = aci_bond_store.save_msg_count;
+  p_header[ACI_BOND_STORE_PEER]       = aci_bond_store.save_peer;
+  p_header[ACI_BOND_STORE_LENGTH]     = (uint8_t)aci_bond_store.save_length;
+  p_header[ACI_BOND_STORE_LENGTH + 1] = (uint8_t)(aci_bond_store.save_length >> 8);
+  p_header[ACI_BOND_STORE_CRC]        = (uint8_t)crc;
+  p_header[ACI_BOND_STORE_CRC + 1]    = (uint8_t)(crc >> 8);
+}
+
+/*
+  One byte hash of a peer address, folded from its CRC.
+*/
+static uint8_t aci_bond_store_peer_hash(const uint8_t *p_peer_address)
+{
+  const uint16_t crc = aci_crc16_ccitt(ACI_CRC16_CCITT_INIT, p_peer_address, BTLE_DEVICE_ADDRESS_SIZE);
+
+  return (uint8_t)(crc ^ (crc >> 8));
+}
+
+/*
+  True if the slot of the selected bond holds a whole record, its header is then in p_record.
+*/
+static bool aci_bond_store_slot_check(uint8_t slot, aci_bond_store_record_t *p_record)
+{
+  const uint16_t header = aci_bond_store_address(slot, 0);
+  uint16_t       crc    = ACI_CRC16_CCITT_INIT;
+  uint16_t       stored;
+  uint16_t       i;
+
+  p_record->slot      = slot;
+  p_record->seq       = aci_bond_store_nv_read(header + ACI_BOND_STORE_SEQ);
+  p_record->msg_count = aci_bond_store_nv_read(header + ACI_BOND_STORE_COUNT);
+  p_record->peer      = aci_bond_store_nv_read(header + ACI_BOND_STORE_PEER);
+  p_record->length    = aci_bond_store_nv_read(header + ACI_BOND_STORE_LENGTH) |
+                        ((uint16_t)aci_bond_store_nv_read(header + ACI_BOND_STORE_LENGTH + 1) << 8);
+  stored              = aci_bond_store_nv_read(header + ACI_BOND_STORE_CRC) |
+                        ((uint16_t)aci_bond_store_nv_read(header + ACI_BOND_STORE_CRC + 1) << 8);
+
+  if ((0 == p_record->msg_count) || (p_record->length > ACI_BOND_STORE_DATA_MAX))
+  {
+    return false;
+  }
+  for (i = 0; i < p_record->length; i++)
+  {
+    crc = aci_crc16_ccitt_update(crc, aci_bond_store_nv_read(header + ACI_BOND_STORE_HEADER_SIZE + i));
+  }
+  return (stored == aci_bond_store_header_crc(crc, p_record->seq, p_record->msg_count, p_record->peer,
+                                              p_record->length));
+}
+
+static void aci_bond_store_record_clear(aci_bond_store_record_t *p_record)
+{
+  p_record->slot      = ACI_BOND_STORE_NO_SLOT;
+  p_record->msg_count = 0;
+  p_record->peer      = 0;
+  p_record->length    = 0;
+}
+
+void aci_bond_store_init(void)
+{
+  aci_bond_store_record_t  candidate;
+  aci_bond_store_record_t *p_record;
+  uint8_t                  bond;
+  uint8_t                  slot;
+
+  aci_bond_store.bonds           = 0;
+  aci_bond_store.restore_running = false;
+#if ACI_BOND_STORE_STAGING
+  aci_bond_store.commit_pending  = false;
+#endif
+  aci_bond_store.write_count     = 0;
+
+  for (bond = 0; bond < ACI_BOND_STORE_BONDS; bond++)
+  {
+    aci_bond_store.bond = bond;
+    p_record            = aci_bond_store_current();
+    aci_bond_store_record_clear(p_record);
+
+    for (slot = 0; slot < ACI_BOND_STORE_SLOTS; slot++)
+    {
+      if (!aci_bond_store_slot_check(slot, &candidate))
+      {
+        continue;
+      }
+      /* The newest record wins, the sequence wraps around */
+      if ((ACI_BOND_STORE_NO_SLOT == p_record->slot) || ((int8_t)(candidate.seq - p_record->seq) > 0))
+      {
+        *p_record = candidate;
+      }
+    }
+    if (ACI_BOND_STORE_NO_SLOT != p_record->slot)
+    {
+      aci_bond_store.bonds |= (uint8_t)(1 << bond);
+    }
+  }
+  aci_bond_store.bond = 0;
+}
+
+void aci_bond_store_select(uint8_t bond)
+{
+  if ((bond < ACI_BOND_STORE_BONDS) && !aci_bond_store.restore_running)
+  {
+    aci_bond_store.bond = bond;
+  }
+}
+
+uint8_t aci_bond_store_bonds(void)
+{
+  return aci_bond_store.bonds;
+}
+
+uint8_t aci_bond_store_find(const uint8_t *p_peer_address)
+{
+  const uint8_t peer = aci_bond_store_peer_hash(p_peer_address);
+  uint8_t       bond;
+
+  for (bond = 0; bond < ACI_BOND_STORE_BONDS; bond++)
+  {
+    if ((aci_bond_store.bonds & (1 << bond)) && (peer == aci_bond_store.record[bond].peer))
+    {
+      return bond;
+    }
+  }
+  return ACI_BOND_STORE_NO_BOND;
+}
+
+uint8_t aci_bond_store_free(void)
+{
+  uint8_t bond;
+
+  for (bond = 0; bond < ACI_BOND_STORE_BONDS; bond++)
+  {
+    if (0 == (aci_bond_store.bonds & (1 << bond)))
+    {
+      return bond;
+    }
+  }
+  return ACI_BOND_STORE_NO_BOND;
+}
+
+uint8_t aci_bond_store_msg_count(void)
+{
+  return aci_bond_store_current()->msg_count;
+}
+
+/*
+  Reads the command of the current record at cursor into p_buffer.
+  Returns the bytes it takes in the record, 0 at the end of the record.
+*/
+static uint8_t aci_bond_store_msg_get(uint16_t cursor, uint8_t *p_buffer)
+{
+  const aci_bond_store_record_t *p_record = aci_bond_store_current();
+  uint16_t                       address;
+  uint8_t                        length;
+  uint8_t                        i;
+
+  if ((ACI_BOND_STORE_NO_SLOT == p_record->slot) || (cursor >= p_record->length))
+  {
+    return 0;
+  }
+
+  address = aci_bond_store_address(p_record->slot, ACI_BOND_STORE_HEADER_SIZE + cursor);
+  length  = aci_bond_store_nv_read(address);
+  if ((length > HAL_ACI_MAX_LENGTH) || ((cursor + length + 1) > p_record->length))
+  {
+    return 0;
+  }
+  for (i = 0; i <= length; i++)
+  {
+    p_buffer[i] = aci_bond_store_nv_read(address + i);
+  }
+  return length + 1;
+}
+
+bool aci_bond_store_msg_read(uint16_t *p_cursor, hal_aci_data_t *p_msg)
+{
+  const uint8_t size = aci_bond_store_msg_get(*p_cursor, &p_msg->buffer[0]);
+
+  if (0 == size)
+  {
+    return false;
+  }
+  p_msg->status_byte = 0;
+  *p_cursor += size;
+  return true;
+}
+
+/*
+  Puts the commands of the record that are left straight into command queue slots, read from the
+  EEPROM there, until the queue is full.
+*/
+static void aci_bond_store_restore_fill(void)
+{
+  hal_aci_data_t *p_slot;
+  uint8_t         size;
+
+  while (aci_bond_store.restore_cursor < aci_bond_store_current()->length)
+  {
+    p_slot = hal_aci_tl_send_reserve(ACI_CMD_WRITE_DYNAMIC_DATA);
+    if (NULL == p_slot)
+    {
+      //ACI Command Queue is full
+      return;
+    }
+    size = aci_bond_store_msg_get(aci_bond_store.restore_cursor, &p_slot->buffer[0]);
+    if ((0 == size) || !hal_aci_tl_send_commit())
+    {
+      return;
+    }
+    aci_bond_store.restore_cursor += size;
+  }
+}
+
+uint8_t aci_bond_store_restore_poll(aci_state_t *aci_stat)
+{
+  const hal_aci_evt_t *aci_data;
+  aci_status_code_t    cmd_status;
+
+  lib_aci_select(aci_stat);
+
+  if (!aci_bond_store.restore_running)
+  {
+    if (0 == aci_bond_store_current()->msg_count)
+    {
+      return ACI_BOND_STORE_RESTORE_NO_BOND;
+    }
+    if (!lib_aci_command_queue_empty())
+    {
+      return ACI_BOND_STORE_RESTORE_FAIL_COMMAND_QUEUE_NOT_EMPTY;
+    }
+    if (NULL != lib_aci_event_peek_ptr())
+    {
+      return ACI_BOND_STORE_RESTORE_FAIL_EVENT_QUEUE_NOT_EMPTY;
+    }
+    aci_bond_store.restore_cursor      = 0;
+    aci_bond_store.restore_progress_ms = millis();
+    aci_bond_store.restore_running     = true;
+  }
+
+  /* Keep the ACI command queue filled with as many Write Dynamic Data commands as it will hold */
+  aci_bond_store_restore_fill();
+
+  aci_data = lib_aci_event_peek_ptr();
+  if (NULL == aci_data)
+  {
+    /* The timeout restarts each time the device responds */
+    if ((millis() - aci_bond_store.restore_progress_ms) > ACI_BOND_STORE_RESTORE_TIMEOUT_MS)
+    {
+      aci_bond_store.restore_running = false;
+      return ACI_BOND_STORE_RESTORE_FAIL_TIMEOUT;
+    }
+    return ACI_BOND_STORE_RESTORE_IN_PROGRESS;
+  }
+
+  if ((ACI_EVT_CMD_RSP != aci_data->evt.evt_opcode) ||
+      (ACI_CMD_WRITE_DYNAMIC_DATA != aci_data->evt.params.cmd_rsp.cmd_opcode))
+  {
+    //The event is left for the application
+    aci_bond_store.restore_running = false;
+    return ACI_BOND_STORE_RESTORE_FAIL_NOT_COMMAND_RESPONSE;
+  }
+
+  cmd_status = (aci_status_code_t)aci_data->evt.params.cmd_rsp.cmd_status;
+  lib_aci_event_release(aci_stat);
+  aci_bond_store.restore_progress_ms = millis();
+
+  if (ACI_STATUS_TRANSACTION_COMPLETE == cmd_status)
+  {
+    aci_bond_store.restore_running = false;
+    return ACI_BOND_STORE_RESTORE_SUCCESS;
+  }
+  if (ACI_STATUS_TRANSACTION_CONTINUE != cmd_status)
+  {
+    //The nRF8001 drops the transfer, the commands still queued get an error response as well
+    aci_bond_store.restore_running = false;
+    return ACI_BOND_STORE_RESTORE_FAIL_STATUS;
+  }
+
+  aci_bond_store_restore_fill();
+  return ACI_BOND_STORE_RESTORE_IN_PROGRESS;
+}
+
+uint8_t aci_bond_store_restore(aci_state_t *aci_stat)
+{
+  uint8_t result;
+
+  /* aci_bond_store_restore() always starts a new restore */
+  aci_bond_store.restore_running = false;
+
+  do
+  {
+    result = aci_bond_store_restore_poll(aci_stat);
+  } while (ACI_BOND_STORE_RESTORE_IN_PROGRESS == result);
+
+  return result;
+}
+
+void aci_bond_store_save_start(void)
+{
+  const aci_bond_store_record_t *p_record = aci_bond_store_current();
+
+#if ACI_BOND_STORE_STAGING
+  if (aci_bond_store.commit_pending)
+  {
+    if (aci_bond_store.commit_bond == aci_bond_store.bond)
+    {
+      /* The new record replaces it. The slot it was written to has no valid header yet. */
+      aci_bond_store.commit_pending = false;
+    }
+    else
+    {
+      /* The staging buffer is needed for the new record */
+      aci_bond_store_commit();
+    }
+  }
+#endif
+
+  aci_bond_store.save_slot      = (ACI_BOND_STORE_NO_SLOT == p_record->slot) ? 0 :
+                                  (uint8_t)((p_record->slot + 1) % ACI_BOND_STORE_SLOTS);
+  aci_bond_store.save_msg_count = 0;
+  aci_bond_store.save_peer      = p_record->peer;
+  aci_bond_store.save_length    = 0;
+  aci_bond_store.save_crc       = ACI_CRC16_CCITT_INIT;
+  aci_bond_store.save_diverged  = (ACI_BOND_STORE_NO_SLOT == p_record->slot);
+  aci_bond_store.save_failed    = false;
+}
+
+void aci_bond_store_save_peer(const uint8_t *p_peer_address)
+{
+  aci_bond_store.save_peer = aci_bond_store_peer_hash(p_peer_address);
+}
+
+/*
+  Copies the start of the current record that the new one has in common with it, when the new
+  one turns out to be different. The staging buffer holds it already.
+*/
+static void aci_bond_store_save_diverge(void)
+{
+#if !ACI_BOND_STORE_STAGING
+  const uint8_t slot = aci_bond_store_current()->slot;
+  uint16_t      i;
+#endif
+
+  aci_bond_store.save_diverged = true;
+#if !ACI_BOND_STORE_STAGING
+  for (i = 0; i < aci_bond_store.save_length; i++)
+  {
+    aci_bond_store_update(aci_bond_store_address(aci_bond_store.save_slot, ACI_BOND_STORE_HEADER_SIZE + i),
+                          aci_bond_store_nv_read(aci_bond_store_address(slot, ACI_BOND_STORE_HEADER_SIZE + i)));
+  }
+#endif
+}
+
+static void aci_bond_store_save_byte(uint8_t value)
+{
+  const aci_bond_store_record_t *p_record = aci_bond_store_current();
+
+  if (aci_bond_store.save_length >= ACI_BOND_STORE_DATA_MAX)
+  {
+    aci_bond_store.save_failed = true;
+    return;
+  }
+
+  if (!aci_bond_store.save_diverged)
+  {
+    if ((aci_bond_store.save_length >= p_record->length) ||
+        (value != aci_bond_store_nv_read(aci_bond_store_address(p_record->slot,
+                                                               ACI_BOND_STORE_HEADER_SIZE + aci_bond_store.save_length))))
+    {
+      aci_bond_store_save_diverge();
+    }
+  }
+#if ACI_BOND_STORE_STAGING
+  aci_bond_store.staging[aci_bond_store.save_length] = value;
+#else
+  if (aci_bond_store.save_diverged)
+  {
+    aci_bond_store_update(aci_bond_store_address(aci_bond_store.save_slot,
+                                                 ACI_BOND_STORE_HEADER_SIZE + aci_bond_store.save_length), value);
+  }
+#endif
+  aci_bond_store.save_crc = aci_crc16_ccitt_update(aci_bond_store.save_crc, value);
+  aci_bond_store.save_length++;
+}
+
+bool aci_bond_store_save_msg(const aci_evt_t *p_evt)
+{
+  /* [cmd opcode][status][sequence number][data] follow the event opcode */
+  const uint8_t length = p_evt->len - 3;
+  uint8_t       i;
+
+  if ((ACI_EVT_CMD_RSP != p_evt->evt_opcode) || (p_evt->len < 4))
+  {
+    aci_bond_store.save_failed = true;
+    return false;
+  }
+
+  aci_bond_store_save_byte(length + 1);
+  aci_bond_store_save_byte(ACI_CMD_WRITE_DYNAMIC_DATA);
+  for (i = 0; i < length; i++)
+  {
+    aci_bond_store_save_byte(p_evt->params.cmd_rsp.params.padding[i]);
+  }
+  aci_bond_store.save_msg_count++;
+  return !aci_bond_store.save_failed;
+}
+
+bool aci_bond_store_save_end(void)
+{
+  aci_bond_store_record_t *p_record = aci_bond_store_current();
+#if !ACI_BOND_STORE_STAGING
+  uint8_t                  header[ACI_BOND_STORE_HEADER_SIZE];
+  uint8_t                  i;
+#endif
+
+  if (aci_bond_store.save_failed || (0 == aci_bond_store.save_msg_count))
+  {
+    return false;
+  }
+  if (!aci_bond_store.save_diverged)
+  {
+    if ((aci_bond_store.save_length == p_record->length) &&
+        (aci_bond_store.save_msg_count == p_record->msg_count) &&
+        (aci_bond_store.save_peer == p_record->peer))
+    {
+      /* Same bond, nothing to write */
+      return true;
+    }
+    /* The new record is the start of the current one or has another peer */
+    aci_bond_store_save_diverge();
+  }
+
+#if ACI_BOND_STORE_STAGING
+  /* The data and then the header are written by aci_bond_store_commit_poll() */
+  aci_bond_store_header_make(aci_bond_store.commit_header, p_record->seq + 1, aci_bond_store.save_crc);
+  aci_bond_store.commit_bond      = aci_bond_store.bond;
+  aci_bond_store.commit_slot      = aci_bond_store.save_slot;
+  aci_bond_store.commit_pos       = 0;
+  aci_bond_store.commit_length    = aci_bond_store.save_length;
+  aci_bond_store.commit_msg_count = aci_bond_store.save_msg_count;
+  aci_bond_store.commit_pending   = true;
+#else
+  /* The header goes last, the record is only valid once it is written */
+  aci_bond_store_header_make(header, p_record->seq + 1, aci_bond_store.save_crc);
+  for (i = 0; i < ACI_BOND_STORE_HEADER_SIZE; i++)
+  {
+    aci_bond_store_update(aci_bond_store_address(aci_bond_store.save_slot, i), header[i]);
+  }
+
+  p_record->slot       = aci_bond_store.save_slot;
+  p_record->seq        = header[ACI_BOND_STORE_SEQ];
+  p_record->msg_count  = aci_bond_store.save_msg_count;
+  p_record->peer       = aci_bond_store.save_peer;
+  p_record->length     = aci_bond_store.save_length;
+  aci_bond_store.bonds |= (uint8_t)(1 << aci_bond_store.bond);
+#endif
+  return true;
+}
+
+bool aci_bond_store_commit_poll(void)
+{
+#if ACI_BOND_STORE_STAGING
+  const uint16_t           end = aci_bond_store.commit_length + ACI_BOND_STORE_HEADER_SIZE;
+  aci_bond_store_record_t *p_record;
+  uint16_t                 address;
+  uint8_t                  value;
+
+  if (!aci_bond_store.commit_pending)
+  {
+    return false;
+  }
+
+  /* Bytes that hold the right value already are skipped, one byte is written per call */
+  while (aci_bond_store.commit_pos < end)
+  {
+    if (!aci_bond_store_nv_ready())
+    {
+      return true;
+    }
+    if (aci_bond_store.commit_pos < aci_bond_store.commit_length)
+    {
+      address = aci_bond_store_bond_address(aci_bond_store.commit_bond, aci_bond_store.commit_slot,
+                                            ACI_BOND_STORE_HEADER_SIZE + aci_bond_store.commit_pos);
+      value   = aci_bond_store.staging[aci_bond_store.commit_pos];
+    }
+    else
+    {
+      address = aci_bond_store_bond_address(aci_bond_store.commit_bond, aci_bond_store.commit_slot,
+                                            aci_bond_store.commit_pos - aci_bond_store.commit_length);
+      value   = aci_bond_store.commit_header[aci_bond_store.commit_pos - aci_bond_store.commit_length];
+    }
+    aci_bond_store.commit_pos++;
+    if (aci_bond_store_nv_read(address) != value)
+    {
+      aci_bond_store_nv_write(address, value);
+      aci_bond_store.write_count++;
+      return true;
+    }
+  }
+
+  p_record             = &aci_bond_store.record[aci_bond_store.commit_bond];
+  p_record->slot       = aci_bond_store.commit_slot;
+  p_record->seq        = aci_bond_store.commit_header[ACI_BOND_STORE_SEQ];
+  p_record->msg_count  = aci_bond_store.commit_msg_count;
+  p_record->peer       = aci_bond_store.commit_header[ACI_BOND_STORE_PEER];
+  p_record->length     = aci_bond_store.commit_length;
+  aci_bond_store.bonds |= (uint8_t)(1 << aci_bond_store.commit_bond);
+  aci_bond_store.commit_pending = false;
+#endif
+  return false;
+}
+
+void aci_bond_store_commit(void)
+{
+  while (aci_bond_store_commit_poll())
+  {
+  }
+}
+
+void aci_bond_store_delete(void)
+{
+  aci_bond_store_record_t candidate;
+  uint8_t                 slot;
+
+#if ACI_BOND_STORE_STAGING
+  if (aci_bond_store.commit_pending && (aci_bond_store.commit_bond == aci_bond_store.bond))
+  {
+    aci_bond_store.commit_pending = false;
+  }
+#endif
+
+  for (slot = 0; slot < ACI_BOND_STORE_SLOTS; slot++)
+  {
+    if (aci_bond_store_slot_check(slot, &candidate))
+    {
+      /* A message count of 0 is never valid, one byte written per record */
+      aci_bond_store_update(aci_bond_store_address(slot, ACI_BOND_STORE_COUNT), 0);
+    }
+  }
+  aci_bond_store_record_clear(aci_bond_store_current());
+  aci_bond_store.bonds &= (uint8_t)~(1 << aci_bond_store.bond);
+}
+
+void aci_bond_store_clear(void)
+{
+  const uint8_t selected = aci_bond_store.bond;
+  uint8_t       bond;
+
+  for (bond = 0; bond < ACI_BOND_STORE_BONDS; bond++)
+  {
+    aci_bond_store.bond = bond;
+    aci_bond_store_delete();
+  }
+  aci_bond_store.bond = selected;
+}
+
+uint16_t aci_bond_store_write_count(void)
+{
+  return aci_bond_store.write_count;
+}
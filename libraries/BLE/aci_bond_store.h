@@ -0,0 +1,249 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+ * @brief Bond information of the nRF8001 kept in the EEPROM of the MCU.
+ */
+
+/** @defgroup aci_bond_store aci_bond_store
+@{
+@ingroup lib
+
+@brief Stores the dynamic data read with lib_aci_read_dynamic_data() so the bond can be given back
+to the nRF8001 with lib_aci_write_dynamic_data() after a power loss.
+@details The area of the EEPROM holds ACI_BOND_STORE_BONDS bonds, one per peer. The area of a bond is
+split in ACI_BOND_STORE_SLOTS slots and each new record of the bond goes to the slot after the one of
+its current record, which spreads the wear over the slots. A record is
+[sequence][message count][peer hash][length, 2 bytes][CRC, 2 bytes] followed by the Write Dynamic
+Data commands as they are sent: [length][ACI_CMD_WRITE_DYNAMIC_DATA][sequence number][data]. The CRC
+covers the commands and then the first five bytes, it is only right once the whole record is
+written, so a record cut by a reset is ignored and the one before it is used.
+
+aci_bond_store_init() reads the headers once and keeps an index in RAM: a bitmap of the bonds stored
+and the slot and peer hash of each. aci_bond_store_find() gives the bond of a peer address from the
+index and aci_bond_store_select() goes straight to its record, the EEPROM is not scanned again.
+
+aci_bond_store_restore_poll() gives the record back to the nRF8001 the way aci_setup_poll() sends
+the setup: the command queue is kept filled with the Write Dynamic Data commands read ahead from the
+EEPROM, so each next command goes to the nRF8001 in the transfer that clocks out the response of the
+one before, instead of waiting for the response to be handled.
+
+While the dynamic data read back is the same as the current record nothing is written. EEPROM bytes
+are only written when they differ from what the slot holds already, so storing the bond on every
+disconnect costs no EEPROM writes when the bond has not changed.
+
+With ACI_BOND_STORE_STAGING the record is kept in a RAM buffer as it is read out of the nRF8001,
+which then goes at the speed of the ACI, and aci_bond_store_save_end() returns without writing the
+EEPROM. aci_bond_store_commit_poll(), called from the loop, writes one byte each time the EEPROM is
+ready and the header last. Until then the record before it is the current one, and is the one kept
+if the power is lost.
+
+On AVR the EEPROM is used through avr/eeprom.h. On other MCUs the application provides
+aci_bond_store_nv_read() and aci_bond_store_nv_write(), e.g. on top of an EEPROM emulation in flash.
+*/
+
+#ifndef ACI_BOND_STORE_H__
+#define ACI_BOND_STORE_H__
+
+#include <lib_aci.h>
+
+/************************************************************************/
+/* EEPROM area of the bond store                                         */
+/* Address of the first byte and size in bytes of all the bonds. The     */
+/* size of the dynamic data is in ublue_setup.gen.out.txt, a slot needs  */
+/* it plus 3 bytes per message (about 27 bytes of data each) plus 7.     */
+/************************************************************************/
+#ifndef ACI_BOND_STORE_START
+#define ACI_BOND_STORE_START 0
+#endif
+
+#ifndef ACI_BOND_STORE_SIZE
+#define ACI_BOND_STORE_SIZE 1024
+#endif
+
+/************************************************************************/
+/* Number of bonds, i.e. peers, that can be stored, at most 8            */
+/* Each bond has ACI_BOND_STORE_SIZE / ACI_BOND_STORE_BONDS bytes.       */
+/************************************************************************/
+#ifndef ACI_BOND_STORE_BONDS
+#define ACI_BOND_STORE_BONDS 2
+#endif
+
+/************************************************************************/
+/* Number of slots the records of a bond rotate through                  */
+/* At least 2 so the last record is kept while the next one is written.  */
+/************************************************************************/
+#ifndef ACI_BOND_STORE_SLOTS
+#define ACI_BOND_STORE_SLOTS 2
+#endif
+
+#define ACI_BOND_STORE_HEADER_SIZE  7
+#define ACI_BOND_STORE_BOND_SIZE    (ACI_BOND_STORE_SIZE / ACI_BOND_STORE_BONDS)
+#define ACI_BOND_STORE_SLOT_SIZE    (ACI_BOND_STORE_BOND_SIZE / ACI_BOND_STORE_SLOTS)
+#define ACI_BOND_STORE_DATA_MAX     (ACI_BOND_STORE_SLOT_SIZE - ACI_BOND_STORE_HEADER_SIZE)
+
+/************************************************************************/
+/* Staged save                                                           */
+/* 1 : The record is kept in a RAM buffer of ACI_BOND_STORE_DATA_MAX     */
+/*     bytes and written to the EEPROM by aci_bond_store_commit_poll(),  */
+/*     the application can advertise again right after the save.        */
+/* 0 : The EEPROM is written while the dynamic data is read out.         */
+/************************************************************************/
+#ifndef ACI_BOND_STORE_STAGING
+#define ACI_BOND_STORE_STAGING 0
+#endif
+
+/************************************************************************/
+/* Restore timeout                                                       */
+/* The restore fails with ACI_BOND_STORE_RESTORE_FAIL_TIMEOUT when the   */
+/* nRF8001 has not answered a Write Dynamic Data for this many ms.      */
+/************************************************************************/
+#ifndef ACI_BOND_STORE_RESTORE_TIMEOUT_MS
+#define ACI_BOND_STORE_RESTORE_TIMEOUT_MS 1000
+#endif
+
+#define ACI_BOND_STORE_RESTORE_SUCCESS                      0
+#define ACI_BOND_STORE_RESTORE_NO_BOND                      1
+#define ACI_BOND_STORE_RESTORE_FAIL_COMMAND_QUEUE_NOT_EMPTY 2
+#define ACI_BOND_STORE_RESTORE_FAIL_EVENT_QUEUE_NOT_EMPTY   3
+#define ACI_BOND_STORE_RESTORE_FAIL_TIMEOUT                 4
+#define ACI_BOND_STORE_RESTORE_FAIL_NOT_COMMAND_RESPONSE    5
+#define ACI_BOND_STORE_RESTORE_FAIL_STATUS                  6
+#define ACI_BOND_STORE_RESTORE_IN_PROGRESS                  7
+
+/** Returned by aci_bond_store_find() and aci_bond_store_free() when there is no such bond */
+#define ACI_BOND_STORE_NO_BOND      0xFF
+
+#if !defined(__AVR__)
+/** @brief Reads a byte of the non-volatile memory, provided by the application */
+uint8_t aci_bond_store_nv_read(uint16_t address);
+
+/** @brief Writes a byte of the non-volatile memory, provided by the application */
+void aci_bond_store_nv_write(uint16_t address, uint8_t value);
+#endif
+
+/** @brief Finds the current record of each bond.
+ *  @details Reads the headers and checks the CRC of each slot. Call once before the other functions.
+ *  Bond 0 is selected.
+ */
+void aci_bond_store_init(void);
+
+/** @brief Selects the bond the other functions work on.
+ *  @param bond 0 to ACI_BOND_STORE_BONDS - 1.
+ */
+void aci_bond_store_select(uint8_t bond);
+
+/** @brief Bonds stored.
+ *  @return Bit n is set when bond n holds a record.
+ */
+uint8_t aci_bond_store_bonds(void);
+
+/** @brief Finds the bond of a peer.
+ *  @details Compares the hash of the address with the index in RAM, the EEPROM is not read. Two
+ *  addresses can have the same hash, the nRF8001 rejects the bond of the wrong peer when it connects.
+ *  @param p_peer_address BTLE_DEVICE_ADDRESS_SIZE bytes, e.g. dev_addr of ACI_EVT_CONNECTED.
+ *  @return The bond or ACI_BOND_STORE_NO_BOND.
+ */
+uint8_t aci_bond_store_find(const uint8_t *p_peer_address);
+
+/** @brief First bond that holds no record.
+ *  @return The bond or ACI_BOND_STORE_NO_BOND when all the bonds are stored.
+ */
+uint8_t aci_bond_store_free(void);
+
+/** @brief Number of Write Dynamic Data commands in the current record of the selected bond.
+ *  @return 0 when the bond is not stored.
+ */
+uint8_t aci_bond_store_msg_count(void);
+
+/** @brief Reads the next Write Dynamic Data command of the current record of the selected bond.
+ *  @param p_cursor set to 0 for the first command, moved on to the next one.
+ *  @param p_msg the command is read into p_msg->buffer, ready for hal_aci_tl_send().
+ *  @return False when all the commands have been read.
+ */
+bool aci_bond_store_msg_read(uint16_t *p_cursor, hal_aci_data_t *p_msg);
+
+/** @brief Gives the selected bond back to the nRF8001 without blocking
+ *  @details
+ *  The first call starts the restore, the command and event queues must be empty. Each call then
+ *  puts as many Write Dynamic Data commands of the record in the command queue as it will hold
+ *  and handles the response of the nRF8001 if there is one. Call it from the loop, in place of
+ *  lib_aci_event_get(), for as long as it returns ACI_BOND_STORE_RESTORE_IN_PROGRESS: the
+ *  Command Response events of the restore are taken by it. Any other result ends the restore.
+ *  @return ACI_BOND_STORE_RESTORE_IN_PROGRESS, ACI_BOND_STORE_RESTORE_SUCCESS or the reason the
+ *  restore failed.
+ */
+uint8_t aci_bond_store_restore_poll(aci_state_t *aci_stat);
+
+/** @brief Gives the selected bond back to the nRF8001
+ *  @details Same as aci_bond_store_restore_poll() but blocks until the restore is done.
+ *  @return ACI_BOND_STORE_RESTORE_SUCCESS or the reason the restore failed.
+ */
+uint8_t aci_bond_store_restore(aci_state_t *aci_stat);
+
+/** @brief Starts a new record of the selected bond.
+ *  @details Give each command response of the Read Dynamic Data to aci_bond_store_save_msg(),
+ *  then call aci_bond_store_save_end().
+ */
+void aci_bond_store_save_start(void);
+
+/** @brief Sets the peer of the record being saved.
+ *  @details Without it the record keeps the peer of the current record of the bond.
+ *  @param p_peer_address BTLE_DEVICE_ADDRESS_SIZE bytes.
+ */
+void aci_bond_store_save_peer(const uint8_t *p_peer_address);
+
+/** @brief Adds the dynamic data of a command response event of lib_aci_read_dynamic_data().
+ *  @param p_evt ACI_EVT_CMD_RSP of ACI_CMD_READ_DYNAMIC_DATA.
+ *  @return False if the record does not fit in a slot.
+ */
+bool aci_bond_store_save_msg(const aci_evt_t *p_evt);
+
+/** @brief Commits the record.
+ *  @details Nothing is written when the record is the same as the current one. With
+ *  ACI_BOND_STORE_STAGING the record is written by aci_bond_store_commit_poll().
+ *  @return True if the record is the current one now, or will be once committed.
+ */
+bool aci_bond_store_save_end(void);
+
+/** @brief Writes the next EEPROM byte of the record that aci_bond_store_save_end() left to commit.
+ *  @details Returns at once when the EEPROM is still busy with the byte before. Call it from the
+ *  loop. A new save of the same bond replaces the record, a save of another bond commits it first.
+ *  @return True while the record is not committed, false without ACI_BOND_STORE_STAGING.
+ */
+bool aci_bond_store_commit_poll(void);
+
+/** @brief Commits the record left by aci_bond_store_save_end(), e.g. before going to sleep. */
+void aci_bond_store_commit(void);
+
+/** @brief Deletes the selected bond, its records are made invalid. */
+void aci_bond_store_delete(void);
+
+/** @brief Deletes all the bonds. */
+void aci_bond_store_clear(void);
+
+/** @brief Number of EEPROM bytes written since aci_bond_store_init(). */
+uint16_t aci_bond_store_write_count(void);
+
+#endif // ACI_BOND_STORE_H__
+/** @} */
@@ -0,0 +1,244 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+/** @file
+@brief Implementation of the broadcast payload rotation
+*/
+
+#include <lib_aci.h>
+#include "aci_broadcast.h"
+#include "ble_assert.h"
+
+/* Needs the Broadcast and OpenAdvPipe commands */
+#if ACI_FEATURE_BROADCAST
+
+#define FAR_BEHIND_CYCLES 4
+
+static uint8_t group_size(const aci_broadcast_params_t *p_params)
+{
+  if ((0 == p_params->pipes_per_cycle) || (p_params->pipes_per_cycle > p_params->payloads))
+  {
+    return p_params->payloads;
+  }
+  return p_params->pipes_per_cycle;
+}
+
+static unsigned long period_ms(const aci_broadcast_params_t *p_params)
+{
+  const uint16_t events = (0 == p_params->events_per_cycle) ? 1 : p_params->events_per_cycle;
+
+  /* 0.625 ms units, the nRF8001 adds up to 10 ms of random delay to every event */
+  return ((unsigned long)p_params->adv_interval * events * 5) / 8;
+}
+
+/*
+  Sends the SetLocalData of the changed payloads of the next group, then opens the pipes of the
+  group. A payload that did not fit in the command queue stays changed, the cycle is sent again
+  from there at the next poll and what went out already is not sent twice.
+*/
+static bool cycle_send(aci_broadcast_t *p_broadcast, aci_state_t *aci_stat)
+{
+  const aci_broadcast_params_t *p_params = p_broadcast->p_params;
+  const uint8_t size = group_size(p_params);
+  uint8_t pipes[PIPES_ARRAY_SIZE];
+  uint8_t i;
+
+  if (0 == p_params->payloads)
+  {
+    return true;
+  }
+
+  for (i = 0; i < PIPES_ARRAY_SIZE; i++)
+  {
+    pipes[i] = 0;
+  }
+
+  for (i = 0; i < size; i++)
+  {
+    const uint8_t payload = (uint8_t)((p_broadcast->next + i) % p_params->payloads);
+    const uint8_t pipe = p_params->p_pipes[payload];
+    const uint8_t bit = (uint8_t)(1 << payload);
+
+    if (p_broadcast->changed & bit)
+    {
+      if (!lib_aci_set_local_data(aci_stat, pipe, &p_broadcast->data[payload][0], p_broadcast->length[payload]))
+      {
+        return false;
+      }
+      p_broadcast->changed &= (uint8_t)~bit;
+      p_broadcast->stats.set_local_data++;
+    }
+    pipes[pipe / 8] |= (uint8_t)(1 << (pipe % 8));
+  }
+
+  /* With a single group the pipes stay opened, only their data changes */
+  if (!p_broadcast->opened)
+  {
+    if (!lib_aci_open_adv_pipes(pipes))
+    {
+      return false;
+    }
+    p_broadcast->opened = (size == p_params->payloads);
+  }
+
+  p_broadcast->next = (uint8_t)((p_broadcast->next + size) % p_params->payloads);
+  p_broadcast->stats.cycles++;
+  return true;
+}
+
+void aci_broadcast_init(aci_broadcast_t *p_broadcast, const aci_broadcast_params_t *p_params)
+{
+  uint8_t i;
+
+  ble_assert(p_params->payloads <= ACI_BROADCAST_PAYLOADS);
+
+  p_broadcast->p_params     = p_params;
+  p_broadcast->broadcasting = false;
+  p_broadcast->restart_due  = false;
+  p_broadcast->opened       = false;
+  p_broadcast->late         = false;
+  p_broadcast->next         = 0;
+  p_broadcast->changed      = 0;
+  p_broadcast->cycle_ms     = 0;
+
+  p_broadcast->stats.cycles         = 0;
+  p_broadcast->stats.set_local_data = 0;
+  p_broadcast->stats.cycles_late    = 0;
+  p_broadcast->stats.restarts       = 0;
+
+  for (i = 0; i < ACI_BROADCAST_PAYLOADS; i++)
+  {
+    p_broadcast->length[i] = 0;
+  }
+}
+
+bool aci_broadcast_set(aci_broadcast_t *p_broadcast, uint8_t payload, const uint8_t *p_data, uint8_t length)
+{
+  uint8_t i;
+
+  if ((payload >= p_broadcast->p_params->payloads) || (length > ACI_BROADCAST_DATA_MAX))
+  {
+    return false;
+  }
+
+  for (i = 0; i < length; i++)
+  {
+    p_broadcast->data[payload][i] = p_data[i];
+  }
+  p_broadcast->length[payload] = length;
+  p_broadcast->changed |= (uint8_t)(1 << payload);
+  return true;
+}
+
+bool aci_broadcast_start(aci_broadcast_t *p_broadcast, aci_state_t *aci_stat)
+{
+  const aci_broadcast_params_t *p_params = p_broadcast->p_params;
+
+  p_broadcast->opened = false;
+  if (!cycle_send(p_broadcast, aci_stat))
+  {
+    return false;
+  }
+  if (!lib_aci_broadcast(p_params->timeout, p_params->adv_interval))
+  {
+    return false;
+  }
+
+  p_broadcast->broadcasting = true;
+  p_broadcast->restart_due  = false;
+  p_broadcast->late         = false;
+  p_broadcast->cycle_ms     = millis();
+  return true;
+}
+
+void aci_broadcast_event(aci_broadcast_t *p_broadcast, aci_state_t *aci_stat, const aci_evt_t *p_evt)
+{
+  (void)aci_stat;
+
+  switch (p_evt->evt_opcode)
+  {
+    case ACI_EVT_DEVICE_STARTED:
+      p_broadcast->broadcasting = false;
+      p_broadcast->restart_due  = false;
+      break;
+
+    case ACI_EVT_DISCONNECTED:
+      if (p_broadcast->broadcasting &&
+          (ACI_STATUS_ERROR_ADVT_TIMEOUT == p_evt->params.disconnected.aci_status))
+      {
+        p_broadcast->broadcasting = false;
+        p_broadcast->restart_due  = p_broadcast->p_params->restart;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+void aci_broadcast_poll(aci_broadcast_t *p_broadcast, aci_state_t *aci_stat)
+{
+  const unsigned long period = period_ms(p_broadcast->p_params);
+  const unsigned long now = millis();
+
+  if (p_broadcast->restart_due)
+  {
+    if (aci_broadcast_start(p_broadcast, aci_stat))
+    {
+      p_broadcast->stats.restarts++;
+    }
+    return;
+  }
+
+  if (!p_broadcast->broadcasting || ((now - p_broadcast->cycle_ms) < period))
+  {
+    return;
+  }
+
+  if (!cycle_send(p_broadcast, aci_stat))
+  {
+    if (!p_broadcast->late)
+    {
+      p_broadcast->late = true;
+      p_broadcast->stats.cycles_late++;
+    }
+    return;
+  }
+  p_broadcast->late = false;
+
+  /* Keep the cadence, unless the loop was away for several cycles */
+  if ((now - p_broadcast->cycle_ms) >= (period * FAR_BEHIND_CYCLES))
+  {
+    p_broadcast->cycle_ms = now;
+  }
+  else
+  {
+    p_broadcast->cycle_ms += period;
+  }
+}
+
+void aci_broadcast_stats_get(const aci_broadcast_t *p_broadcast, aci_broadcast_stats_t *p_stats)
+{
+  *p_stats = p_broadcast->stats;
+}
+
+#endif // ACI_FEATURE_BROADCAST
@@ -0,0 +1,141 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+ * @brief Rotates the payloads of the broadcast pipes while broadcasting.
+ */
+
+/** @defgroup aci_broadcast aci_broadcast
+@{
+@ingroup lib
+
+@brief Broadcasts several payloads in turn, e.g. sensor values and IDs, each on its own broadcast
+pipe, as set up in nRFgo Studio.
+@details The payloads are given with aci_broadcast_set() whenever they change, they are only
+kept in RAM then. Every events_per_cycle advertising events the next pipes_per_cycle of them are
+put in the advertising packets: the SetLocalData commands of those that changed since they were
+last sent and one OpenAdvPipes command for the pipes go out together, so the nRF8001 is woken up
+once per cycle and each payload is as fresh as the last aci_broadcast_set() before its turn.
+When pipes_per_cycle is the number of payloads nothing rotates, the changed ones are sent together
+once per cycle.
+
+The cycle is timed with millis() from the advertising interval, the nRF8001 does not tell the
+advertising events. Broadcasting is started again when its timeout ends it, with restart set.
+
+Call aci_broadcast_event() with every ACI event and aci_broadcast_poll() from the loop.
+*/
+
+#ifndef ACI_BROADCAST_H__
+#define ACI_BROADCAST_H__
+
+#include <lib_aci.h>
+
+/************************************************************************/
+/* Payloads rotated, one broadcast pipe each                             */
+/* 1 to 8.                                                               */
+/************************************************************************/
+#ifndef ACI_BROADCAST_PAYLOADS
+#define ACI_BROADCAST_PAYLOADS 4
+#endif
+
+/************************************************************************/
+/* Bytes of the longest payload                                          */
+/* 1 to ACI_PIPE_TX_DATA_MAX_LEN, the advertising packet is 31 bytes.    */
+/************************************************************************/
+#ifndef ACI_BROADCAST_DATA_MAX
+#define ACI_BROADCAST_DATA_MAX 8
+#endif
+
+#if (ACI_BROADCAST_PAYLOADS < 1) || (ACI_BROADCAST_PAYLOADS > 8)
+#error "ACI_BROADCAST_PAYLOADS must be 1 to 8"
+#endif
+#if (ACI_BROADCAST_DATA_MAX < 1) || (ACI_BROADCAST_DATA_MAX > ACI_PIPE_TX_DATA_MAX_LEN)
+#error "ACI_BROADCAST_DATA_MAX must be 1 to ACI_PIPE_TX_DATA_MAX_LEN"
+#endif
+
+typedef struct
+{
+  const uint8_t *p_pipes;          /**< The broadcast pipe of each payload */
+  uint8_t        payloads;         /**< Payloads in p_pipes, 0 to ACI_BROADCAST_PAYLOADS */
+  uint8_t        pipes_per_cycle;  /**< Payloads advertised together, 1 to payloads */
+  uint16_t       adv_interval;     /**< Advertising interval, in multiple of 0.625&nbsp;ms, 160 to 16384 */
+  uint16_t       events_per_cycle; /**< Advertising events before the next payloads are put in */
+  uint16_t       timeout;          /**< Of lib_aci_broadcast(), in seconds, 0 for no timeout */
+  bool           restart;          /**< Broadcast again once the timeout has ended it */
+} aci_broadcast_params_t;
+
+typedef struct
+{
+  uint16_t cycles;                 /**< Cycles started, the first one included */
+  uint16_t set_local_data;         /**< SetLocalData commands sent */
+  uint16_t cycles_late;            /**< Cycles that waited for room in the command queue */
+  uint16_t restarts;               /**< Broadcasts started again after their timeout */
+} aci_broadcast_stats_t;
+
+/** State of the broadcast, one per nRF8001 */
+typedef struct
+{
+  const aci_broadcast_params_t *p_params;
+  bool                   broadcasting;
+  bool                   restart_due;         /**< The timeout has ended the broadcast */
+  bool                   opened;              /**< The pipes of the one group are opened */
+  bool                   late;                /**< The cycle is waiting for the command queue */
+  uint8_t                next;                /**< First payload of the next cycle */
+  uint8_t                changed;             /**< A bit per payload, set since its SetLocalData */
+  unsigned long          cycle_ms;            /**< Start of the cycle */
+  aci_broadcast_stats_t  stats;
+  uint8_t                length[ACI_BROADCAST_PAYLOADS];
+  uint8_t                data[ACI_BROADCAST_PAYLOADS][ACI_BROADCAST_DATA_MAX];
+} aci_broadcast_t;
+
+/** @brief Initializes the broadcast, the payloads are empty.
+ *  @param p_broadcast state of the broadcast.
+ *  @param p_params pipes and timing, must stay valid while the broadcast is used.
+ */
+void aci_broadcast_init(aci_broadcast_t *p_broadcast, const aci_broadcast_params_t *p_params);
+
+/** @brief Sets a payload, it is sent when its pipe is next put in the advertising packets.
+ *  @param payload index of the pipe in p_pipes.
+ *  @return False if payload or length is out of range.
+ */
+bool aci_broadcast_set(aci_broadcast_t *p_broadcast, uint8_t payload, const uint8_t *p_data, uint8_t length);
+
+/** @brief Puts in the first payloads and starts broadcasting, in Standby.
+ *  @return False if the commands did not fit in the command queue, call it again then.
+ */
+bool aci_broadcast_start(aci_broadcast_t *p_broadcast, aci_state_t *aci_stat);
+
+/** @brief Gives an ACI event to the broadcast, call it for every event taken from lib_aci_event_get().
+ */
+void aci_broadcast_event(aci_broadcast_t *p_broadcast, aci_state_t *aci_stat, const aci_evt_t *p_evt);
+
+/** @brief Starts the cycles when due, call it from the loop.
+ */
+void aci_broadcast_poll(aci_broadcast_t *p_broadcast, aci_state_t *aci_stat);
+
+/** @brief Gets the counters since aci_broadcast_init().
+ */
+void aci_broadcast_stats_get(const aci_broadcast_t *p_broadcast, aci_broadcast_stats_t *p_stats);
+
+#endif // ACI_BROADCAST_H__
+/** @} */
@@ -0,0 +1,104 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/** @file
+@brief Prebuilt commands with the parameters checked by the compiler, for the sketches written in C++
+@details The functions build the same ::hal_aci_data_t as the LIB_ACI_CMD_* initializers of
+lib_aci.h, the parameters are template parameters and a value out of the range of the nRF8001
+stops the build:
+@code
+static const hal_aci_data_t timing_cmd PROGMEM = aci_cmd_change_timing<11, 18, 0, 600>();
+
+lib_aci_send_cmd_P(&timing_cmd);
+@endcode
+The library is compiled as the C of its examples and takes the initializers; this header is
+included by the sketch only, as aci_device.h, and needs C++11.
+*/
+
+#ifndef ACI_CMD_BUILDER_H__
+#define ACI_CMD_BUILDER_H__
+
+#include <lib_aci.h>
+
+/** @brief LIB_ACI_CMD_CONNECT(), run_timeout 0 to 16383 s, adv_interval 32 to 16384 */
+template <uint16_t RUN_TIMEOUT, uint16_t ADV_INTERVAL>
+constexpr hal_aci_data_t aci_cmd_connect(void)
+{
+  static_assert(RUN_TIMEOUT <= 16383, "RUN_TIMEOUT must be 0 to 16383 seconds");
+  static_assert((ADV_INTERVAL >= 32) && (ADV_INTERVAL <= 16384), "ADV_INTERVAL must be 32 to 16384 (20 ms to 10.24 s)");
+  return LIB_ACI_CMD_CONNECT(RUN_TIMEOUT, ADV_INTERVAL);
+}
+
+/** @brief LIB_ACI_CMD_BOND(), run_timeout 1 to 180 s, adv_interval 32 to 16384 */
+template <uint16_t RUN_TIMEOUT, uint16_t ADV_INTERVAL>
+constexpr hal_aci_data_t aci_cmd_bond(void)
+{
+  static_assert((RUN_TIMEOUT >= 1) && (RUN_TIMEOUT <= 180), "RUN_TIMEOUT must be 1 to 180 seconds");
+  static_assert((ADV_INTERVAL >= 32) && (ADV_INTERVAL <= 16384), "ADV_INTERVAL must be 32 to 16384 (20 ms to 10.24 s)");
+  return LIB_ACI_CMD_BOND(RUN_TIMEOUT, ADV_INTERVAL);
+}
+
+/** @brief LIB_ACI_CMD_BROADCAST(), timeout 0 to 16383 s, adv_interval 160 to 16384 */
+template <uint16_t TIMEOUT, uint16_t ADV_INTERVAL>
+constexpr hal_aci_data_t aci_cmd_broadcast(void)
+{
+  static_assert(TIMEOUT <= 16383, "TIMEOUT must be 0 to 16383 seconds");
+  static_assert((ADV_INTERVAL >= 160) && (ADV_INTERVAL <= 16384), "ADV_INTERVAL must be 160 to 16384 (100 ms to 10.24 s)");
+  return LIB_ACI_CMD_BROADCAST(TIMEOUT, ADV_INTERVAL);
+}
+
+/** @brief LIB_ACI_CMD_CHANGE_TIMING(), intervals 6 to 3200, slave latency 0 to 1000, timeout 10 to 3200 */
+template <uint16_t MIN_CX_INTERVAL, uint16_t MAX_CX_INTERVAL, uint16_t SLAVE_LATENCY, uint16_t TIMEOUT>
+constexpr hal_aci_data_t aci_cmd_change_timing(void)
+{
+  static_assert((MIN_CX_INTERVAL >= 6) && (MAX_CX_INTERVAL <= 3200), "The intervals must be 6 to 3200 (7.5 ms to 4 s)");
+  static_assert(MIN_CX_INTERVAL <= MAX_CX_INTERVAL, "MIN_CX_INTERVAL must not exceed MAX_CX_INTERVAL");
+  static_assert(SLAVE_LATENCY <= 1000, "SLAVE_LATENCY must be 0 to 1000");
+  static_assert((TIMEOUT >= 10) && (TIMEOUT <= 3200), "TIMEOUT must be 10 to 3200 (100 ms to 32 s)");
+  return LIB_ACI_CMD_CHANGE_TIMING(MIN_CX_INTERVAL, MAX_CX_INTERVAL, SLAVE_LATENCY, TIMEOUT);
+}
+
+/** @brief LIB_ACI_CMD_SET_APP_LATENCY() */
+template <uint16_t LATENCY, aci_app_latency_mode_t LATENCY_MODE>
+constexpr hal_aci_data_t aci_cmd_set_app_latency(void)
+{
+  static_assert((ACI_APP_LATENCY_DISABLE == LATENCY_MODE) || (ACI_APP_LATENCY_ENABLE == LATENCY_MODE),
+                "LATENCY_MODE must be ACI_APP_LATENCY_DISABLE or ACI_APP_LATENCY_ENABLE");
+  return LIB_ACI_CMD_SET_APP_LATENCY(LATENCY, LATENCY_MODE);
+}
+
+/** @brief LIB_ACI_CMD_SET_TX_POWER() */
+template <aci_device_output_power_t TX_POWER>
+constexpr hal_aci_data_t aci_cmd_set_tx_power(void)
+{
+  static_assert(TX_POWER <= ACI_DEVICE_OUTPUT_POWER_0DBM, "TX_POWER must be an aci_device_output_power_t");
+  return LIB_ACI_CMD_SET_TX_POWER(TX_POWER);
+}
+
+/** @brief LIB_ACI_CMD_OPEN_ADV_PIPE(), pipe 1 to ACI_DEVICE_MAX_PIPES */
+template <uint8_t PIPE>
+constexpr hal_aci_data_t aci_cmd_open_adv_pipe(void)
+{
+  static_assert((PIPE >= 1) && (PIPE <= ACI_DEVICE_MAX_PIPES), "PIPE must be 1 to ACI_DEVICE_MAX_PIPES");
+  return LIB_ACI_CMD_OPEN_ADV_PIPE(PIPE);
+}
+
+#endif // ACI_CMD_BUILDER_H__
@@ -0,0 +1,82 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+ * @brief CRC-16-CCITT over RAM and program memory.
+ */
+
+/** @defgroup aci_crc aci_crc
+@{
+@ingroup lib
+
+@brief CRC-16-CCITT (polynomial 0x1021, MSB first, no final XOR) as used by the nRF8001 for the
+setup and by the examples for the bootloader data kept in EEPROM.
+@details The CRC is streamed: start with ACI_CRC16_CCITT_INIT and give the result of each call as the
+crc of the next one, so data spread over several buffers or read a byte at a time gets one CRC.
+ACI_CRC_TABLE picks the size of the lookup table held in program memory.
+*/
+
+#ifndef ACI_CRC_H__
+#define ACI_CRC_H__
+
+#include <hal_platform.h>
+
+/************************************************************************/
+/* Lookup table of the CRC, in program memory                           */
+/* 0   : No table, a few shifts and XORs per byte.                      */
+/* 16  : One entry per nibble, 32 bytes of flash, two lookups per byte. */
+/* 256 : One entry per byte, 512 bytes of flash, fastest.               */
+/************************************************************************/
+#ifndef ACI_CRC_TABLE
+#define ACI_CRC_TABLE 0
+#endif
+
+/** Value to start a CRC with */
+#define ACI_CRC16_CCITT_INIT 0xFFFF
+
+/** @brief Adds one byte to a CRC.
+ *  @param crc CRC so far.
+ *  @param data_in next byte.
+ *  @return CRC including data_in.
+ */
+uint16_t aci_crc16_ccitt_update(uint16_t crc, uint8_t data_in);
+
+/** @brief Adds a buffer in RAM to a CRC.
+ *  @param crc CRC so far.
+ *  @param p_data bytes to add.
+ *  @param length number of bytes.
+ *  @return CRC including the buffer.
+ */
+uint16_t aci_crc16_ccitt(uint16_t crc, const uint8_t *p_data, uint16_t length);
+
+/** @brief Adds a buffer in program memory (PROGMEM) to a CRC.
+ *  @details On the PIC32 the setup and other constant data are in RAM and this is the same as aci_crc16_ccitt().
+ *  @param crc CRC so far.
+ *  @param p_data bytes to add, in program memory.
+ *  @param length number of bytes.
+ *  @return CRC including the buffer.
+ */
+uint16_t aci_crc16_ccitt_P(uint16_t crc, const uint8_t *p_data, uint16_t length);
+
+#endif // ACI_CRC_H__
+/** @} */
@@ -0,0 +1,66 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+@brief Implementation of the CPU cycle counter of the micro-benchmarks
+*/
+
+#include "aci_cycles.h"
+
+static uint16_t aci_cycles_empty;
+
+uint16_t aci_cycles_overhead(void)
+{
+  return aci_cycles_empty;
+}
+
+void aci_cycles_start(void)
+{
+  uint32_t start;
+  uint32_t cycles;
+  uint8_t  i;
+
+#if defined(__AVR__)
+  TCCR1B = 0;
+  TCCR1A = 0;
+  TIMSK1 = 0;
+  TCNT1  = 0;
+  TCCR1B = _BV(CS10);
+#elif (!defined(ARDUINO_ARCH_SAMD) && (defined(__SAM3X8E__) || defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)))
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL  |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
+  /* The least of a few empty measures, the first one may take a cache miss or an interrupt */
+  aci_cycles_empty = 0xFFFF;
+  for (i = 0; i < 8; i++)
+  {
+    start  = aci_cycles_now();
+    cycles = aci_cycles_since(start);
+    if (cycles < aci_cycles_empty)
+    {
+      aci_cycles_empty = (uint16_t)cycles;
+    }
+  }
+}
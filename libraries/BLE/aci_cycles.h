@@ -0,0 +1,112 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/** @file
+ * @brief CPU cycle counter for the on-target micro-benchmarks of the BLE library.
+ */
+
+/** @defgroup aci_cycles aci_cycles
+@{
+@ingroup lib
+
+@brief Counts the CPU cycles of a piece of code, on the board it runs on.
+@details aci_cycles_start() sets the counter of the part up, aci_cycles_now() reads it and
+aci_cycles_since() gives the cycles since such a reading, the counter width and wrap taken care
+of. aci_cycles_overhead() is what an empty measure costs, for the caller to subtract.
+
+ - AVR: Timer1 without prescaler, taken over from the sketch. 16 bits, a measure must be shorter
+   than 65536 cycles (4 ms at 16 MHz).
+ - SAM3X and the other Cortex-M3/M4: the DWT cycle counter, 32 bits.
+ - SAMD (Cortex-M0+, no DWT counter): SysTick, which counts down over the 1 ms tick of millis().
+   A measure must be shorter than 1 ms.
+ - PIC32: the core timer, one count every 2 cycles, so the cycles are even.
+ - Anything else: micros() times the cycles per microsecond of F_CPU.
+
+See examples/ble_cycle_benchmark for the table of acilib, aci_queue, hal_aci_tl_send() and
+lib_aci_event_get().
+*/
+
+#ifndef ACI_CYCLES_H__
+#define ACI_CYCLES_H__
+
+#include "hal_platform.h"
+
+#if defined(F_CPU)
+#define ACI_CYCLES_PER_US  ((uint32_t)(F_CPU / 1000000UL))
+#else
+#define ACI_CYCLES_PER_US  1UL
+#endif
+
+/** @brief Reads the cycle counter
+ *  @return A reading for aci_cycles_since(), in the units of the counter.
+ */
+static inline uint32_t aci_cycles_now(void)
+{
+#if defined(__AVR__)
+  return TCNT1;
+#elif defined(__PIC32MX__)
+  return _CP0_GET_COUNT();
+#elif defined(ARDUINO_ARCH_SAMD)
+  return SysTick->VAL;
+#elif (defined(__SAM3X8E__) || defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__))
+  return DWT->CYCCNT;
+#else
+  return micros();
+#endif
+}
+
+/** @brief Cycles since a reading of aci_cycles_now()
+ *  @param start the reading.
+ *  @return The cycles elapsed, aci_cycles_overhead() included.
+ */
+static inline uint32_t aci_cycles_since(uint32_t start)
+{
+#if defined(__AVR__)
+  return (uint16_t)(TCNT1 - (uint16_t)start);
+#elif defined(__PIC32MX__)
+  return 2UL * (_CP0_GET_COUNT() - start);
+#elif defined(ARDUINO_ARCH_SAMD)
+  /* SysTick counts down and reloads at the millis() tick */
+  const uint32_t now = SysTick->VAL;
+
+  return (start >= now) ? (start - now) : (start + SysTick->LOAD + 1 - now);
+#elif (defined(__SAM3X8E__) || defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__))
+  return DWT->CYCCNT - start;
+#else
+  return (micros() - start) * ACI_CYCLES_PER_US;
+#endif
+}
+
+/** @brief Cycles of an empty measure, aci_cycles_now() then aci_cycles_since()
+ *  @details Measured by aci_cycles_start().
+ */
+uint16_t aci_cycles_overhead(void);
+
+/** @brief Sets the cycle counter up, to be called before the first measure.
+ *  @details On AVR Timer1 is stopped, reset to normal mode without prescaler and its interrupts are
+ *  disabled. On the Cortex-M3/M4 the trace unit and the DWT cycle counter are enabled.
+ */
+void aci_cycles_start(void);
+
+/** @} */
+
+#endif // ACI_CYCLES_H__
@@ -0,0 +1,239 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+@brief Implementation of the delta encoding of samples
+*/
+
+#include <lib_aci.h>
+#include "aci_delta.h"
+
+/* Longest varint of a 32 bit value */
+#define VARINT_MAX_LEN  5
+
+static uint8_t varint_put(uint8_t *p_out, int32_t value)
+{
+  // Zig-zag, the small negative values get small codes too
+  uint32_t code   = ((uint32_t)value << 1) ^ (0 - ((uint32_t)value >> 31));
+  uint8_t  length = 0;
+
+  while (code >= 0x80)
+  {
+    p_out[length++] = (uint8_t)(code | 0x80);
+    code >>= 7;
+  }
+  p_out[length++] = (uint8_t)code;
+  return length;
+}
+
+/*
+  Reads a varint at *p_pos, false when it runs past the end of the packet.
+*/
+static bool varint_get(const uint8_t *p_packet, uint8_t length, uint8_t *p_pos, int32_t *p_value)
+{
+  uint32_t code  = 0;
+  uint8_t  shift = 0;
+  uint8_t  byte;
+
+  do
+  {
+    if ((*p_pos >= length) || (shift >= (7 * VARINT_MAX_LEN)))
+    {
+      return false;
+    }
+    byte   = p_packet[(*p_pos)++];
+    code  |= (uint32_t)(byte & 0x7F) << shift;
+    shift += 7;
+  } while (0 != (byte & 0x80));
+
+  *p_value = (int32_t)((code >> 1) ^ (0 - (code & 1)));
+  return true;
+}
+
+static uint8_t sample_encode(const aci_delta_t *p_delta, const int32_t *p_values, bool keyframe, uint8_t *p_out)
+{
+  uint8_t length = 0;
+  uint8_t i;
+
+  for (i = 0; i < p_delta->channels; i++)
+  {
+    length += varint_put(&p_out[length],
+                         keyframe ? p_values[i] : (int32_t)((uint32_t)p_values[i] - (uint32_t)p_delta->last[i]));
+  }
+  return length;
+}
+
+bool aci_delta_init(aci_delta_t *p_delta, uint8_t pipe, uint8_t channels, uint8_t keyframe_interval, uint16_t deadline_ms)
+{
+  if ((0 == channels) || (channels > ACI_DELTA_MAX_CHANNELS))
+  {
+    return false;
+  }
+
+  memset(p_delta, 0, sizeof(*p_delta));
+  p_delta->pipe              = pipe;
+  p_delta->channels          = channels;
+  p_delta->keyframe_interval = keyframe_interval;
+  p_delta->deadline_ms       = deadline_ms;
+  p_delta->keyframe_due      = true;
+  return true;
+}
+
+bool aci_delta_flush(aci_delta_t *p_delta, aci_state_t *aci_stat)
+{
+  if (0 == p_delta->length)
+  {
+    return true;
+  }
+
+  lib_aci_select(aci_stat);
+  if (!lib_aci_is_pipe_available(aci_stat, p_delta->pipe) ||
+      !lib_aci_send_data(p_delta->pipe, &p_delta->buffer[0], p_delta->length))
+  {
+    return false;
+  }
+
+  p_delta->length = 0;
+  p_delta->seq    = (p_delta->seq + 1) & ACI_DELTA_SEQ_MASK;
+  p_delta->since_keyframe++;
+  if ((0 != p_delta->keyframe_interval) && (p_delta->since_keyframe >= p_delta->keyframe_interval))
+  {
+    p_delta->keyframe_due = true;
+  }
+  return true;
+}
+
+bool aci_delta_add(aci_delta_t *p_delta, aci_state_t *aci_stat, const int32_t *p_values)
+{
+  uint8_t record[ACI_DELTA_MAX_CHANNELS * VARINT_MAX_LEN];
+  uint8_t length = 0;
+  bool    keyframe;
+
+  if (0 != p_delta->length)
+  {
+    length = sample_encode(p_delta, p_values, false, &record[0]);
+
+    // No room left from a packet that could not be sent yet
+    if (((p_delta->length + length) > ACI_PIPE_TX_DATA_MAX_LEN) &&
+        !aci_delta_flush(p_delta, aci_stat))
+    {
+      return false;
+    }
+  }
+
+  if (0 == p_delta->length)
+  {
+    keyframe = p_delta->keyframe_due;
+    if (keyframe)
+    {
+      p_delta->keyframe_due   = false;
+      p_delta->since_keyframe = 0;
+    }
+    p_delta->buffer[0] = (keyframe ? ACI_DELTA_KEYFRAME : 0) | p_delta->seq;
+    p_delta->length    = 1;
+    p_delta->first_ms  = millis();
+    length = sample_encode(p_delta, p_values, keyframe, &record[0]);
+  }
+
+  memcpy(&p_delta->buffer[p_delta->length], &record[0], length);
+  p_delta->length += length;
+  memcpy(&p_delta->last[0], p_values, p_delta->channels * sizeof(p_values[0]));
+
+  // Every value takes a byte at least, send once no other sample fits, a failure is retried by the next call
+  if ((p_delta->length + p_delta->channels) > ACI_PIPE_TX_DATA_MAX_LEN)
+  {
+    aci_delta_flush(p_delta, aci_stat);
+  }
+  return true;
+}
+
+void aci_delta_poll(aci_delta_t *p_delta, aci_state_t *aci_stat)
+{
+  if ((0 != p_delta->length) && (0 != p_delta->deadline_ms) &&
+      ((millis() - p_delta->first_ms) >= p_delta->deadline_ms))
+  {
+    aci_delta_flush(p_delta, aci_stat);
+  }
+}
+
+void aci_delta_clear(aci_delta_t *p_delta)
+{
+  p_delta->length       = 0;
+  p_delta->keyframe_due = true;
+}
+
+void aci_delta_decoder_init(aci_delta_decoder_t *p_decoder, uint8_t channels)
+{
+  memset(p_decoder, 0, sizeof(*p_decoder));
+  p_decoder->channels = channels;
+}
+
+uint8_t aci_delta_decode(aci_delta_decoder_t *p_decoder, const uint8_t *p_packet, uint8_t length,
+                         int32_t *p_values, uint8_t max_samples)
+{
+  bool     keyframe;
+  uint8_t  pos     = 1;
+  uint8_t  samples = 0;
+  uint8_t  i;
+  int32_t  value;
+  int32_t *p_sample;
+
+  if (0 == length)
+  {
+    return 0;
+  }
+
+  keyframe = (0 != (p_packet[0] & ACI_DELTA_KEYFRAME));
+  if (!keyframe && (!p_decoder->in_step || ((p_packet[0] & ACI_DELTA_SEQ_MASK) != p_decoder->seq)))
+  {
+    // Missed a packet, wait for the next keyframe
+    p_decoder->in_step = false;
+    return 0;
+  }
+  p_decoder->in_step = true;
+  p_decoder->seq     = (p_packet[0] + 1) & ACI_DELTA_SEQ_MASK;
+
+  while ((pos < length) && (samples < max_samples))
+  {
+    p_sample = &p_values[samples * p_decoder->channels];
+    for (i = 0; i < p_decoder->channels; i++)
+    {
+      if (!varint_get(p_packet, length, &pos, &value))
+      {
+        p_decoder->in_step = false;
+        return samples;
+      }
+      p_sample[i] = keyframe ? value : (int32_t)((uint32_t)p_decoder->last[i] + (uint32_t)value);
+      p_decoder->last[i] = p_sample[i];
+    }
+    keyframe = false;
+    samples++;
+  }
+
+  if (pos < length)
+  {
+    // The rest of the samples did not fit in p_values
+    p_decoder->in_step = false;
+  }
+  return samples;
+}
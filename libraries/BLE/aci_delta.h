@@ -0,0 +1,136 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/** @file
+ * @brief Packs slowly changing samples as varint deltas into each SendData.
+ */
+
+/** @defgroup aci_delta aci_delta
+@{
+@ingroup lib
+
+@brief Buffers the samples of a pipe as the change from the sample before and sends them together
+with lib_aci_send_data(), for the telemetry that aci_aggregator would send at full size.
+@details A sample is 1 to ACI_DELTA_MAX_CHANNELS signed values. Each value is stored as its
+difference to the same value of the sample before, zig-zag encoded (0, -1, 1, -2, ... as 0, 1, 2,
+3, ...) and packed as a varint: 7 bits per byte, LSB first, the top bit set on every byte but the
+last. A difference of -64 to 63 takes one byte, -8192 to 8191 two.
+
+Every packet starts with a header byte, ACI_DELTA_KEYFRAME when the first sample of the packet is
+stored as the values themselves (zig-zag varints too) and a sequence number in the low 7 bits, one
+more for every packet sent. The first packet after aci_delta_init() or aci_delta_clear() is a
+keyframe, then every keyframe_interval packets, so a peer that missed a packet (sequence number
+out of order) or joined late is back in step by the next keyframe. aci_delta_decode() reads the
+packets back, as the peer would.
+
+As with aci_aggregator, the packet is sent when the next sample does not fit, or when its oldest
+sample is deadline_ms old; call aci_delta_poll() from the loop for the deadline. A heart rate or
+temperature that moves by a few units per sample fits 19 samples in a packet, where aci_aggregator
+fits 10 of 16 bits.
+*/
+
+#ifndef ACI_DELTA_H__
+#define ACI_DELTA_H__
+
+#include <lib_aci.h>
+
+/** Values in a sample, a keyframe of 32 bit values must fit in a packet */
+#define ACI_DELTA_MAX_CHANNELS  3
+
+/** The first sample of the packet is stored whole, in the header byte */
+#define ACI_DELTA_KEYFRAME      0x80
+/** Sequence number of a packet, in the header byte */
+#define ACI_DELTA_SEQ_MASK      0x7F
+
+typedef struct
+{
+  uint8_t       pipe;
+  uint8_t       channels;                           /**< Values in a sample */
+  uint8_t       keyframe_interval;                  /**< Packets from one keyframe to the next, 0 for the first packet only */
+  uint16_t      deadline_ms;                        /**< Longest time a sample waits, 0 to only send full packets */
+  uint8_t       seq;                                /**< Sequence number of the packet in buffer */
+  uint8_t       since_keyframe;                     /**< Packets sent since the last keyframe */
+  bool          keyframe_due;                       /**< The next packet starts with a keyframe */
+  uint8_t       length;                             /**< Bytes in buffer, 0 when no sample is buffered */
+  unsigned long first_ms;                           /**< Time the oldest sample was added */
+  int32_t       last[ACI_DELTA_MAX_CHANNELS];       /**< Sample the next one is encoded against */
+  uint8_t       buffer[ACI_PIPE_TX_DATA_MAX_LEN];
+} aci_delta_t;
+
+/** State of the reading of the packets, aci_delta_decode() */
+typedef struct
+{
+  uint8_t channels;
+  uint8_t seq;                                      /**< Sequence number of the next packet */
+  bool    in_step;                                  /**< A keyframe was read and no packet missed since */
+  int32_t last[ACI_DELTA_MAX_CHANNELS];
+} aci_delta_decoder_t;
+
+/** @brief Initializes the delta encoding for a pipe.
+ *  @param p_delta state of the encoding.
+ *  @param pipe pipe the packets are sent on, see lib_aci_send_data().
+ *  @param channels values in a sample, 1 to ACI_DELTA_MAX_CHANNELS.
+ *  @param keyframe_interval packets from one keyframe to the next, 0 for the first packet only.
+ *  @param deadline_ms longest time a sample waits to be sent, 0 to only send full packets.
+ *  @return False if channels is out of range.
+ */
+bool aci_delta_init(aci_delta_t *p_delta, uint8_t pipe, uint8_t channels, uint8_t keyframe_interval, uint16_t deadline_ms);
+
+/** @brief Adds a sample, sends the packet when the sample does not fit or no other one will.
+ *  @details When the packet cannot be sent, e.g. for lack of data credit, the sample is kept
+ *  as long as there is room for it and the packet is sent by a later call.
+ *  @param p_delta state of the encoding.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param p_values channels values.
+ *  @return False if the sample was dropped, the packet being full and not sent.
+ */
+bool aci_delta_add(aci_delta_t *p_delta, aci_state_t *aci_stat, const int32_t *p_values);
+
+/** @brief Sends the samples buffered, if any.
+ *  @return False if there are samples and they could not be sent.
+ */
+bool aci_delta_flush(aci_delta_t *p_delta, aci_state_t *aci_stat);
+
+/** @brief Sends the samples buffered when the oldest has waited deadline_ms, call it from the loop.
+ */
+void aci_delta_poll(aci_delta_t *p_delta, aci_state_t *aci_stat);
+
+/** @brief Drops the samples buffered, the next packet is a keyframe. Call it on disconnect.
+ */
+void aci_delta_clear(aci_delta_t *p_delta);
+
+/** @brief Initializes the reading of the packets of an aci_delta_t with channels values.
+ */
+void aci_delta_decoder_init(aci_delta_decoder_t *p_decoder, uint8_t channels);
+
+/** @brief Reads the samples of a packet.
+ *  @param p_decoder state of the reading.
+ *  @param p_packet packet as sent by aci_delta_flush().
+ *  @param length bytes in the packet.
+ *  @param p_values room for max_samples samples of channels values.
+ *  @param max_samples samples that fit in p_values.
+ *  @return Samples read, 0 while out of step until the next keyframe.
+ */
+uint8_t aci_delta_decode(aci_delta_decoder_t *p_decoder, const uint8_t *p_packet, uint8_t length,
+                         int32_t *p_values, uint8_t max_samples);
+
+#endif // ACI_DELTA_H__
+/** @} */
@@ -0,0 +1,151 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/** @file
+@brief nRF8001 wired to pins known at compile time, for the sketches written in C++
+@details aci_device holds the aci_state_t of one nRF8001 and fills its aci_pins_t from the
+template parameters, in place of the aci_state.aci_pins assignments in setup() of the examples:
+@code
+aci_device<9, 8, 4, false, SPI_CLOCK_DIV8> nrf8001;  // REQN, RDYN, RESET, interrupt, SPI clock
+
+void setup(void)
+{
+  nrf8001.setup_set(setup_msgs, NB_SETUP_MESSAGES, services_pipe_type_mapping, NUMBER_OF_PIPES);
+  nrf8001.begin();
+}
+@endcode
+The members are inline and forward to lib_aci, state() gives the aci_state_t to the rest of the
+library (aci_run(), aci_setup, ...). The pins can still be changed in state() before begin(), e.g.
+optional_chip_sel_pin for the Arduino Due.
+
+The transport is compiled once for every sketch, so the template resolves what it can in the
+sketch and leaves the rest to the transport options:
+ - HAL_ACI_INTERFACE set to HAL_ACI_INTERFACE_INTERRUPT or HAL_ACI_INTERFACE_POLL leaves the
+   unused RDYN interface out of the transport. It must match the INTERRUPT parameter.
+ - On AVR, HAL_ACI_REQN_PORT, HAL_ACI_REQN_BIT, HAL_ACI_RDYN_PIN_REG and HAL_ACI_RDYN_BIT for the
+   REQN_PIN and RDYN_PIN of the template compile REQN and RDYN to single sbi/cbi/sbis instructions.
+INTERRUPT_NUMBER is digitalPinToInterrupt(RDYN_PIN), cores without digitalPinToInterrupt take the
+pin number as the Arduino Due does, give it explicitly for the older AVR cores.
+*/
+
+#ifndef ACI_DEVICE_H__
+#define ACI_DEVICE_H__
+
+#include <lib_aci.h>
+
+#ifdef digitalPinToInterrupt
+#define ACI_DEVICE_RDYN_INTERRUPT(pin)  ((uint8_t)digitalPinToInterrupt(pin))
+#else
+#define ACI_DEVICE_RDYN_INTERRUPT(pin)  ((uint8_t)(pin))
+#endif
+
+template <uint8_t REQN_PIN, uint8_t RDYN_PIN, uint8_t RESET_PIN = UNUSED, bool INTERRUPT = false,
+          uint8_t SPI_CLOCK_DIVIDER = SPI_CLOCK_DIV8, uint8_t INSTANCE = 0,
+          uint8_t INTERRUPT_NUMBER = ACI_DEVICE_RDYN_INTERRUPT(RDYN_PIN)>
+class aci_device
+{
+  static_assert((REQN_PIN != UNUSED) && (RDYN_PIN != UNUSED) && (REQN_PIN != RDYN_PIN),
+                "REQN_PIN and RDYN_PIN are required and must differ");
+  static_assert((RESET_PIN != REQN_PIN) && (RESET_PIN != RDYN_PIN),
+                "RESET_PIN must differ from REQN_PIN and RDYN_PIN");
+  static_assert(INSTANCE < HAL_ACI_INSTANCES, "INSTANCE must be below HAL_ACI_INSTANCES");
+  static_assert(!INTERRUPT || (INTERRUPT_NUMBER != 0xFF), "RDYN_PIN has no external interrupt");
+  static_assert((HAL_ACI_INTERFACE == HAL_ACI_INTERFACE_RUNTIME) ||
+                (INTERRUPT == (HAL_ACI_INTERFACE == HAL_ACI_INTERFACE_INTERRUPT)),
+                "INTERRUPT does not match HAL_ACI_INTERFACE");
+
+public:
+  static const uint8_t reqn_pin               = REQN_PIN;
+  static const uint8_t rdyn_pin               = RDYN_PIN;
+  static const uint8_t reset_pin              = RESET_PIN;
+  static const bool    interface_is_interrupt = INTERRUPT;
+
+  aci_device(uint8_t board_name = BOARD_DEFAULT) : m_state()
+  {
+    m_state.aci_pins.board_name             = board_name;
+    m_state.aci_pins.reqn_pin               = REQN_PIN;
+    m_state.aci_pins.rdyn_pin               = RDYN_PIN;
+    m_state.aci_pins.mosi_pin               = MOSI;
+    m_state.aci_pins.miso_pin               = MISO;
+    m_state.aci_pins.sck_pin                = SCK;
+    m_state.aci_pins.spi_clock_divider      = SPI_CLOCK_DIVIDER;
+    m_state.aci_pins.reset_pin              = RESET_PIN;
+    m_state.aci_pins.active_pin             = UNUSED;
+    m_state.aci_pins.optional_chip_sel_pin  = UNUSED;
+    m_state.aci_pins.interface_is_interrupt = INTERRUPT;
+    m_state.aci_pins.interrupt_number       = INTERRUPT ? INTERRUPT_NUMBER : 0;
+    m_state.aci_pins.instance               = INSTANCE;
+  }
+
+  /** @brief Setup messages and pipe map made by nRFgo Studio, see aci_setup_info_t */
+  void setup_set(hal_aci_data_t *setup_msgs, uint8_t num_setup_msgs,
+                 services_pipe_type_mapping_t *pipe_map, uint8_t number_of_pipes)
+  {
+    m_state.aci_setup_info.setup_msgs                 = setup_msgs;
+    m_state.aci_setup_info.num_setup_msgs             = num_setup_msgs;
+    m_state.aci_setup_info.services_pipe_type_mapping = pipe_map;
+    m_state.aci_setup_info.number_of_pipes            = number_of_pipes;
+  }
+
+  /** @brief lib_aci_init() */
+  void begin(bool debug = false)
+  {
+    lib_aci_init(&m_state, debug);
+  }
+
+  /** @brief lib_aci_init_start(), finish with begin_poll() */
+  void begin_start(bool debug = false)
+  {
+    lib_aci_init_start(&m_state, debug);
+  }
+
+  /** @brief lib_aci_init_poll() */
+  bool begin_poll(void)
+  {
+    return lib_aci_init_poll(&m_state);
+  }
+
+  /** @brief lib_aci_event_get() */
+  bool event_get(hal_aci_evt_t *p_aci_evt)
+  {
+    return lib_aci_event_get(&m_state, p_aci_evt);
+  }
+
+  /** @brief Makes this nRF8001 the one the functions without an aci_state_t go to, lib_aci_select() */
+  void select(void)
+  {
+    if (HAL_ACI_INSTANCES > 1)
+    {
+      lib_aci_select(&m_state);
+    }
+  }
+
+  /** @brief The aci_state_t for the functions of the library that take one */
+  aci_state_t *state(void)
+  {
+    return &m_state;
+  }
+
+private:
+  aci_state_t m_state;
+};
+
+#endif // ACI_DEVICE_H__
@@ -0,0 +1,465 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+@brief Implementation of the DFU receive pipeline
+*/
+
+#include <lib_aci.h>
+#include "aci_dfu.h"
+#include "aci_crc.h"
+
+#define ACI_DFU_PRN_LEN  5
+#define ACI_DFU_RSP_LEN  3
+
+static uint32_t aci_dfu_uint32_decode(const uint8_t *p_data)
+{
+  return (uint32_t)p_data[0] | ((uint32_t)p_data[1] << 8) | ((uint32_t)p_data[2] << 16) | ((uint32_t)p_data[3] << 24);
+}
+
+static void aci_dfu_pages_clear(aci_dfu_t *p_dfu)
+{
+  p_dfu->write_page   = 0;
+  p_dfu->full_pages   = 0;
+  p_dfu->fill_length  = 0;
+  p_dfu->write_offset = 0;
+}
+
+static void aci_dfu_respond(aci_dfu_t *p_dfu, uint8_t op, uint8_t result)
+{
+  p_dfu->rsp[0]      = ACI_DFU_OP_RESPONSE;
+  p_dfu->rsp[1]      = op;
+  p_dfu->rsp[2]      = result;
+  p_dfu->rsp_pending = true;
+}
+
+static void aci_dfu_fail(aci_dfu_t *p_dfu, uint8_t op, uint8_t result)
+{
+  p_dfu->state = ACI_DFU_STATE_FAILED;
+  aci_dfu_pages_clear(p_dfu);
+  aci_dfu_respond(p_dfu, op, result);
+}
+
+/* Bytes free in the pages */
+static uint16_t aci_dfu_room(const aci_dfu_t *p_dfu)
+{
+  return (uint16_t)((ACI_DFU_PAGES - p_dfu->full_pages) * ACI_DFU_PAGE_SIZE) - p_dfu->fill_length;
+}
+
+static void aci_dfu_page_full(aci_dfu_t *p_dfu)
+{
+  const uint8_t page = (p_dfu->write_page + p_dfu->full_pages) % ACI_DFU_PAGES;
+
+  p_dfu->write_length[page] = p_dfu->fill_length;
+  p_dfu->full_pages++;
+  p_dfu->fill_length = 0;
+}
+
+static void aci_dfu_image_put(aci_dfu_t *p_dfu, const uint8_t *p_data, uint8_t length)
+{
+  if ((p_dfu->received + length) > p_dfu->image_size)
+  {
+    aci_dfu_fail(p_dfu, ACI_DFU_OP_RECEIVE_FIRMWARE_IMAGE, ACI_DFU_RESULT_DATA_SIZE_EXCEEDS_LIMIT);
+    return;
+  }
+  if (length > aci_dfu_room(p_dfu))
+  {
+    p_dfu->stats.overruns++;
+    aci_dfu_fail(p_dfu, ACI_DFU_OP_RECEIVE_FIRMWARE_IMAGE, ACI_DFU_RESULT_OPERATION_FAILED);
+    return;
+  }
+
+  if (0 == p_dfu->received)
+  {
+    p_dfu->stats.start_ms = millis();
+  }
+  p_dfu->stats.packets++;
+  p_dfu->rx_packets++;
+  p_dfu->crc       = aci_crc16_ccitt(p_dfu->crc, p_data, length);
+  p_dfu->received += length;
+
+  while (0 != length)
+  {
+    const uint8_t page  = (p_dfu->write_page + p_dfu->full_pages) % ACI_DFU_PAGES;
+    uint16_t      chunk = ACI_DFU_PAGE_SIZE - p_dfu->fill_length;
+
+    if (chunk > length)
+    {
+      chunk = length;
+    }
+    memcpy(&p_dfu->pages[page][p_dfu->fill_length], p_data, chunk);
+    p_dfu->fill_length += chunk;
+    p_data             += chunk;
+    length             -= (uint8_t)chunk;
+
+    if (ACI_DFU_PAGE_SIZE == p_dfu->fill_length)
+    {
+      aci_dfu_page_full(p_dfu);
+    }
+  }
+
+  if (p_dfu->received == p_dfu->image_size)
+  {
+    if (0 != p_dfu->fill_length)
+    {
+      aci_dfu_page_full(p_dfu);
+    }
+    p_dfu->state = ACI_DFU_STATE_WRITE;
+  }
+}
+
+static void aci_dfu_packet(aci_dfu_t *p_dfu, const uint8_t *p_data, uint8_t length)
+{
+  uint8_t i;
+
+  switch (p_dfu->state)
+  {
+    case ACI_DFU_STATE_START:
+      // The size of the application alone, or of the SoftDevice, the bootloader and the application
+      if (4 == length)
+      {
+        p_dfu->image_size = aci_dfu_uint32_decode(p_data);
+      }
+      else if ((12 == length) && (0 == aci_dfu_uint32_decode(p_data)) && (0 == aci_dfu_uint32_decode(&p_data[4])))
+      {
+        p_dfu->image_size = aci_dfu_uint32_decode(&p_data[8]);
+      }
+      else
+      {
+        p_dfu->state = ACI_DFU_STATE_IDLE;
+        aci_dfu_respond(p_dfu, ACI_DFU_OP_START_DFU, ACI_DFU_RESULT_NOT_SUPPORTED);
+        break;
+      }
+
+      if ((0 == p_dfu->image_size) || (p_dfu->image_size > p_dfu->p_params->image_size_max))
+      {
+        p_dfu->state = ACI_DFU_STATE_IDLE;
+        aci_dfu_respond(p_dfu, ACI_DFU_OP_START_DFU, ACI_DFU_RESULT_DATA_SIZE_EXCEEDS_LIMIT);
+        break;
+      }
+      p_dfu->state = ACI_DFU_STATE_INIT;
+      aci_dfu_respond(p_dfu, ACI_DFU_OP_START_DFU, ACI_DFU_RESULT_SUCCESS);
+      break;
+
+    case ACI_DFU_STATE_INIT:
+      // Only the CRC at the end of the init packet is used
+      for (i = 0; i < length; i++)
+      {
+        p_dfu->crc_expected = (p_dfu->crc_expected >> 8) | ((uint16_t)p_data[i] << 8);
+      }
+      p_dfu->init_length = ((p_dfu->init_length + length) > 2) ? 2 : (p_dfu->init_length + length);
+      break;
+
+    case ACI_DFU_STATE_RECEIVE:
+      aci_dfu_image_put(p_dfu, p_data, length);
+      break;
+
+    default:
+      break;
+  }
+}
+
+static void aci_dfu_control_point(aci_dfu_t *p_dfu, const uint8_t *p_data, uint8_t length)
+{
+  const uint8_t op = p_data[0];
+
+  switch (op)
+  {
+    case ACI_DFU_OP_START_DFU:
+      p_dfu->state        = ACI_DFU_STATE_START;
+      p_dfu->image_size   = 0;
+      p_dfu->received     = 0;
+      p_dfu->crc          = ACI_CRC16_CCITT_INIT;
+      p_dfu->crc_expected = 0;
+      p_dfu->init_length  = 0;
+      p_dfu->prn_peer     = 0;
+      p_dfu->rsp_pending  = false;
+      aci_dfu_pages_clear(p_dfu);
+      memset(&p_dfu->stats, 0, sizeof(p_dfu->stats));
+      break;
+
+    case ACI_DFU_OP_INITIALIZE_DFU:
+      // [op][0] starts the init packet, [op][1] ends it
+      if ((length < 2) || (0 == p_data[1]))
+      {
+        break;
+      }
+      if ((ACI_DFU_STATE_INIT == p_dfu->state) && (2 == p_dfu->init_length))
+      {
+        p_dfu->state = ACI_DFU_STATE_READY;
+        aci_dfu_respond(p_dfu, op, ACI_DFU_RESULT_SUCCESS);
+      }
+      else
+      {
+        aci_dfu_respond(p_dfu, op, ACI_DFU_RESULT_INVALID_STATE);
+      }
+      break;
+
+    case ACI_DFU_OP_PKT_RCPT_NOTIF_REQ:
+      p_dfu->prn_peer = (length < 3) ? 0 : (p_data[1] | ((uint16_t)p_data[2] << 8));
+      break;
+
+    case ACI_DFU_OP_RECEIVE_FIRMWARE_IMAGE:
+      // Without an init packet the image is not checked by VALIDATE
+      if ((ACI_DFU_STATE_INIT != p_dfu->state) && (ACI_DFU_STATE_READY != p_dfu->state))
+      {
+        aci_dfu_respond(p_dfu, op, ACI_DFU_RESULT_INVALID_STATE);
+        break;
+      }
+      p_dfu->state           = ACI_DFU_STATE_RECEIVE;
+      p_dfu->rx_packets      = 0;
+      p_dfu->rx_packets_prn  = 0;
+      p_dfu->allowed_packets = p_dfu->prn_peer;
+      break;
+
+    case ACI_DFU_OP_VALIDATE:
+      if (ACI_DFU_STATE_RECEIVED != p_dfu->state)
+      {
+        aci_dfu_respond(p_dfu, op, ACI_DFU_RESULT_INVALID_STATE);
+      }
+      else if ((2 == p_dfu->init_length) && (p_dfu->crc != p_dfu->crc_expected))
+      {
+        p_dfu->state = ACI_DFU_STATE_FAILED;
+        aci_dfu_respond(p_dfu, op, ACI_DFU_RESULT_CRC_ERROR);
+      }
+      else
+      {
+        p_dfu->state = ACI_DFU_STATE_VALIDATED;
+        aci_dfu_respond(p_dfu, op, ACI_DFU_RESULT_SUCCESS);
+      }
+      break;
+
+    case ACI_DFU_OP_ACTIVATE_N_RESET:
+      if (ACI_DFU_STATE_VALIDATED == p_dfu->state)
+      {
+        p_dfu->state = ACI_DFU_STATE_ACTIVATE;
+      }
+      else
+      {
+        aci_dfu_respond(p_dfu, op, ACI_DFU_RESULT_INVALID_STATE);
+      }
+      break;
+
+    case ACI_DFU_OP_SYSTEM_RESET:
+      p_dfu->state = ACI_DFU_STATE_IDLE;
+      aci_dfu_pages_clear(p_dfu);
+      break;
+
+    default:
+      aci_dfu_respond(p_dfu, op, ACI_DFU_RESULT_NOT_SUPPORTED);
+      break;
+  }
+}
+
+void aci_dfu_init(aci_dfu_t *p_dfu, const aci_dfu_params_t *p_params)
+{
+  memset(p_dfu, 0, sizeof(*p_dfu));
+  p_dfu->p_params     = p_params;
+  p_dfu->state        = ACI_DFU_STATE_IDLE;
+  p_dfu->prn_interval = ACI_DFU_PRN_INTERVAL;
+}
+
+void aci_dfu_event(aci_dfu_t *p_dfu, aci_state_t *aci_stat, const aci_evt_t *p_evt)
+{
+  (void)aci_stat;
+
+  switch (p_evt->evt_opcode)
+  {
+    case ACI_EVT_CONNECTED:
+    case ACI_EVT_DISCONNECTED:
+      // The image started is not resumed over a new connection
+      if (ACI_DFU_STATE_ACTIVATE != p_dfu->state)
+      {
+        p_dfu->state = ACI_DFU_STATE_IDLE;
+      }
+      p_dfu->rsp_pending = false;
+      aci_dfu_pages_clear(p_dfu);
+      break;
+
+    case ACI_EVT_DATA_RECEIVED:
+    {
+      const uint8_t  pipe   = p_evt->params.data_received.rx_data.pipe_number;
+      const uint8_t *p_data = &p_evt->params.data_received.rx_data.aci_data[0];
+      const uint8_t  length = p_evt->len - 2;
+
+      if (0 == length)
+      {
+        break;
+      }
+      if (pipe == p_dfu->p_params->packet_rx_pipe)
+      {
+        aci_dfu_packet(p_dfu, p_data, length);
+      }
+      else if (pipe == p_dfu->p_params->control_point_rx_pipe)
+      {
+        aci_dfu_control_point(p_dfu, p_data, length);
+      }
+      break;
+    }
+
+    default:
+      break;
+  }
+}
+
+static bool aci_dfu_send(aci_dfu_t *p_dfu, aci_state_t *aci_stat, uint8_t *p_data, uint8_t length)
+{
+  return (0 != lib_aci_get_nb_available_credits(aci_stat)) &&
+         lib_aci_is_pipe_available(aci_stat, p_dfu->p_params->control_point_tx_pipe) &&
+         lib_aci_send_data(p_dfu->p_params->control_point_tx_pipe, p_data, length);
+}
+
+/*
+  The notification lets the peer send up to prn_peer packets more than it may have sent so far,
+  allowed_packets. It is sent early only when all of them fit in one page less than the pages
+  hold. A peer that was let send more than it did then still fits once its N packets are in and
+  the full pages written, so the notification it waits for can always go.
+  A window larger than that gets no early notifications, the notification goes once the peer
+  has sent its N packets and the pages are written.
+*/
+static void aci_dfu_prn_poll(aci_dfu_t *p_dfu, aci_state_t *aci_stat)
+{
+  const uint16_t guaranteed = ((ACI_DFU_PAGES - 1) * ACI_DFU_PAGE_SIZE) / ACI_DFU_PACKET_LEN;
+  const uint16_t since      = p_dfu->rx_packets - p_dfu->rx_packets_prn;
+  uint16_t       interval   = p_dfu->prn_interval;
+  uint16_t       outstanding;
+  uint16_t       room;
+  uint8_t        prn[ACI_DFU_PRN_LEN];
+
+  if ((ACI_DFU_STATE_RECEIVE != p_dfu->state) || (0 == p_dfu->prn_peer) || (0 == since))
+  {
+    return;
+  }
+
+  // Past N the peer waits for the notification
+  if ((p_dfu->prn_peer > guaranteed) || (interval > p_dfu->prn_peer))
+  {
+    interval = p_dfu->prn_peer;
+  }
+  if (since < interval)
+  {
+    return;
+  }
+
+  if (p_dfu->prn_peer > guaranteed)
+  {
+    if (0 != p_dfu->full_pages)
+    {
+      p_dfu->stats.held_room++;
+      return;
+    }
+  }
+  else
+  {
+    outstanding = (uint16_t)(p_dfu->allowed_packets - p_dfu->rx_packets) + p_dfu->prn_peer;
+    room        = aci_dfu_room(p_dfu) / ACI_DFU_PACKET_LEN;
+    if ((outstanding > room) || (outstanding > guaranteed))
+    {
+      p_dfu->stats.held_room++;
+      return;
+    }
+  }
+
+  prn[0] = ACI_DFU_OP_PKT_RCPT_NOTIF;
+  prn[1] = (uint8_t)p_dfu->received;
+  prn[2] = (uint8_t)(p_dfu->received >> 8);
+  prn[3] = (uint8_t)(p_dfu->received >> 16);
+  prn[4] = (uint8_t)(p_dfu->received >> 24);
+  if (!aci_dfu_send(p_dfu, aci_stat, &prn[0], ACI_DFU_PRN_LEN))
+  {
+    p_dfu->stats.held_credit++;
+    return;
+  }
+
+  p_dfu->allowed_packets += p_dfu->prn_peer;
+  p_dfu->rx_packets_prn   = p_dfu->rx_packets;
+  p_dfu->stats.notifications++;
+}
+
+void aci_dfu_poll(aci_dfu_t *p_dfu, aci_state_t *aci_stat)
+{
+  lib_aci_select(aci_stat);
+
+  if (0 != p_dfu->full_pages)
+  {
+    const uint8_t       page   = p_dfu->write_page;
+    const uint16_t      length = p_dfu->write_length[page];
+    const unsigned long start  = micros();
+    unsigned long       write_us;
+    bool                written;
+
+    written  = p_dfu->p_params->page_write(p_dfu->write_offset, &p_dfu->pages[page][0], length);
+    write_us = micros() - start;
+
+    p_dfu->stats.pages++;
+    p_dfu->stats.write_us += write_us;
+    if (write_us > p_dfu->stats.write_us_max)
+    {
+      p_dfu->stats.write_us_max = write_us;
+    }
+
+    if (!written)
+    {
+      aci_dfu_fail(p_dfu, ACI_DFU_OP_RECEIVE_FIRMWARE_IMAGE, ACI_DFU_RESULT_OPERATION_FAILED);
+    }
+    else
+    {
+      p_dfu->write_offset += length;
+      p_dfu->write_page    = (page + 1) % ACI_DFU_PAGES;
+      p_dfu->full_pages--;
+
+      if ((ACI_DFU_STATE_WRITE == p_dfu->state) && (0 == p_dfu->full_pages))
+      {
+        p_dfu->state        = ACI_DFU_STATE_RECEIVED;
+        p_dfu->stats.end_ms = millis();
+        aci_dfu_respond(p_dfu, ACI_DFU_OP_RECEIVE_FIRMWARE_IMAGE, ACI_DFU_RESULT_SUCCESS);
+      }
+    }
+  }
+
+  if (p_dfu->rsp_pending)
+  {
+    if (aci_dfu_send(p_dfu, aci_stat, &p_dfu->rsp[0], ACI_DFU_RSP_LEN))
+    {
+      p_dfu->rsp_pending = false;
+    }
+    return;
+  }
+
+  aci_dfu_prn_poll(p_dfu, aci_stat);
+}
+
+void aci_dfu_prn_interval_set(aci_dfu_t *p_dfu, uint8_t interval)
+{
+  p_dfu->prn_interval = interval;
+}
+
+uint8_t aci_dfu_state(const aci_dfu_t *p_dfu)
+{
+  return p_dfu->state;
+}
+
+void aci_dfu_stats_get(const aci_dfu_t *p_dfu, aci_dfu_stats_t *p_stats)
+{
+  *p_stats = p_dfu->stats;
+}
@@ -0,0 +1,213 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+ * @brief Receives an application image over the DFU packet pipe and writes it page by page.
+ */
+
+/** @defgroup aci_dfu aci_dfu
+@{
+@ingroup lib
+
+@brief Runs the receiving end of the Nordic DFU service (the pipes of the *_with_dfu_template
+examples) inside the application, for an image written to external flash or another MCU.
+@details The peer writes the opcodes on the control point and the image on the packet pipe:
+START_DFU and the image size, INITIALIZE_DFU and the init packet (its last two bytes are the
+CRC-16-CCITT of the image), PACKET_RECEIPT_NOTIFICATION_REQUEST with its interval N, RECEIVE_FIRMWARE_IMAGE
+and the image, VALIDATE and ACTIVATE_N_RESET. Responses and receipt notifications go out on the
+control point notification pipe.
+
+The image goes into two RAM pages of ACI_DFU_PAGE_SIZE bytes. When one is full it is handed to the
+page_write function by aci_dfu_poll() while the next fills from the events, and the CRC is updated
+as the packets come in, so VALIDATE does not read the image back.
+
+A peer sends at most N packets after the last receipt notification it got. Each notification sent
+therefore lets in up to N more packets, and aci_dfu_poll() sends the next one as soon as all the
+packets it lets in fit in the free room, and in one page less than the two, and there is a data
+credit. The peer gets it before it has sent its N packets and does not stop, the pages being
+written then hold the notifications back and with them the peer. A window N larger than a page
+gets a notification once its N packets are in and the full pages written. With ACI_DFU_PRN_INTERVAL, or aci_dfu_prn_interval_set(), a notification is
+sent at most every that many packets, to spend fewer credits on them.
+
+A peer that asks for no notifications (N = 0) is not held back, a packet that finds no room
+fails the transfer.
+
+Call aci_dfu_event() with every ACI event and aci_dfu_poll() from the loop.
+*/
+
+#ifndef ACI_DFU_H__
+#define ACI_DFU_H__
+
+#include <lib_aci.h>
+
+/************************************************************************/
+/* Bytes handed to page_write at a time                                  */
+/* Two pages are kept in RAM. The flash page size of the target, e.g.    */
+/* 128 on the ATmega32u4, or a multiple of it. Early receipt           */
+/* notifications need room for the window N of the peer in one page.    */
+/************************************************************************/
+#ifndef ACI_DFU_PAGE_SIZE
+#define ACI_DFU_PAGE_SIZE 256
+#endif
+
+/************************************************************************/
+/* Shortest number of packets between two receipt notifications          */
+/* 0 : A notification is sent as soon as it fits in the pages, at most   */
+/*     one per packet.                                                   */
+/************************************************************************/
+#ifndef ACI_DFU_PRN_INTERVAL
+#define ACI_DFU_PRN_INTERVAL 0
+#endif
+
+#define ACI_DFU_PAGES 2
+
+/** Image bytes in a packet of the packet pipe, the size of the DFU packet characteristic */
+#define ACI_DFU_PACKET_LEN 20
+
+/** Opcodes written on the control point */
+typedef enum
+{
+  ACI_DFU_OP_START_DFU                   = 0x01,
+  ACI_DFU_OP_INITIALIZE_DFU              = 0x02,
+  ACI_DFU_OP_RECEIVE_FIRMWARE_IMAGE      = 0x03,
+  ACI_DFU_OP_VALIDATE                    = 0x04,
+  ACI_DFU_OP_ACTIVATE_N_RESET            = 0x05,
+  ACI_DFU_OP_SYSTEM_RESET                = 0x06,
+  ACI_DFU_OP_PKT_RCPT_NOTIF_REQ          = 0x08,
+  ACI_DFU_OP_RESPONSE                    = 0x10,
+  ACI_DFU_OP_PKT_RCPT_NOTIF              = 0x11
+} aci_dfu_op_t;
+
+/** Results in the responses */
+typedef enum
+{
+  ACI_DFU_RESULT_SUCCESS                 = 0x01,
+  ACI_DFU_RESULT_INVALID_STATE           = 0x02,
+  ACI_DFU_RESULT_NOT_SUPPORTED           = 0x03,
+  ACI_DFU_RESULT_DATA_SIZE_EXCEEDS_LIMIT = 0x04,
+  ACI_DFU_RESULT_CRC_ERROR               = 0x05,
+  ACI_DFU_RESULT_OPERATION_FAILED        = 0x06
+} aci_dfu_result_t;
+
+typedef enum
+{
+  ACI_DFU_STATE_IDLE,
+  ACI_DFU_STATE_START,       /**< Waiting for the image size */
+  ACI_DFU_STATE_INIT,        /**< Receiving the init packet */
+  ACI_DFU_STATE_READY,       /**< Waiting for RECEIVE_FIRMWARE_IMAGE */
+  ACI_DFU_STATE_RECEIVE,     /**< Receiving the image */
+  ACI_DFU_STATE_WRITE,       /**< Whole image received, pages left to write */
+  ACI_DFU_STATE_RECEIVED,    /**< Whole image written, waiting for VALIDATE */
+  ACI_DFU_STATE_VALIDATED,
+  ACI_DFU_STATE_ACTIVATE,    /**< ACTIVATE_N_RESET received, the application starts the image */
+  ACI_DFU_STATE_FAILED
+} aci_dfu_state_t;
+
+/** @brief Writes a page of the image.
+ *  @param offset offset of the page in the image, a multiple of ACI_DFU_PAGE_SIZE.
+ *  @param p_page the page.
+ *  @param length ACI_DFU_PAGE_SIZE, less for the last page.
+ *  @return False if the page could not be written, the transfer fails.
+ */
+typedef bool (*aci_dfu_page_write_t)(uint32_t offset, const uint8_t *p_page, uint16_t length);
+
+typedef struct
+{
+  uint8_t              packet_rx_pipe;
+  uint8_t              control_point_tx_pipe;
+  uint8_t              control_point_rx_pipe;
+  uint32_t             image_size_max;       /**< Larger images are refused at START_DFU */
+  aci_dfu_page_write_t page_write;
+} aci_dfu_params_t;
+
+/** Timing of the last transfer, times from millis() and micros() */
+typedef struct
+{
+  unsigned long start_ms;                    /**< First byte of the image received */
+  unsigned long end_ms;                      /**< Last page written */
+  uint16_t      packets;                     /**< Image packets received */
+  uint16_t      notifications;               /**< Receipt notifications sent */
+  uint16_t      held_room;                   /**< Polls a due notification waited for room in the pages */
+  uint16_t      held_credit;                 /**< Polls a due notification waited for a data credit */
+  uint16_t      pages;                       /**< Pages written */
+  unsigned long write_us;                    /**< Time spent in page_write */
+  unsigned long write_us_max;                /**< Longest page_write */
+  uint16_t      overruns;                    /**< Packets that found no room */
+} aci_dfu_stats_t;
+
+/** State of the transfer, one per nRF8001 */
+typedef struct
+{
+  const aci_dfu_params_t *p_params;
+  uint8_t                 state;              /**< aci_dfu_state_t */
+  uint32_t                image_size;
+  uint32_t                received;           /**< Bytes of the image received */
+  uint16_t                crc;                /**< Of the bytes received */
+  uint16_t                crc_expected;       /**< Last two bytes of the init packet */
+  uint8_t                 init_length;        /**< Bytes of the init packet received, up to 2 */
+  uint16_t                prn_peer;           /**< N asked for by the peer, 0 for none */
+  uint8_t                 prn_interval;
+  uint16_t                rx_packets;         /**< Image packets received */
+  uint16_t                rx_packets_prn;     /**< rx_packets when the last notification was sent */
+  uint16_t                allowed_packets;    /**< rx_packets the peer may have sent, at most */
+  uint8_t                 rsp[3];
+  bool                    rsp_pending;
+  uint8_t                 write_page;         /**< Oldest full page */
+  uint8_t                 full_pages;
+  uint16_t                fill_length;        /**< Bytes in the page after the full ones */
+  uint16_t                write_length[ACI_DFU_PAGES];
+  uint32_t                write_offset;       /**< Image offset of write_page */
+  uint8_t                 pages[ACI_DFU_PAGES][ACI_DFU_PAGE_SIZE];
+  aci_dfu_stats_t         stats;
+} aci_dfu_t;
+
+/** @brief Initializes the transfer state.
+ *  @param p_dfu state of the transfer.
+ *  @param p_params pipes and page writer, must stay valid while the transfer state is used.
+ */
+void aci_dfu_init(aci_dfu_t *p_dfu, const aci_dfu_params_t *p_params);
+
+/** @brief Gives an ACI event to the transfer, call it for every event taken from lib_aci_event_get().
+ *  @details Image packets are copied into the pages, nothing is sent from here.
+ */
+void aci_dfu_event(aci_dfu_t *p_dfu, aci_state_t *aci_stat, const aci_evt_t *p_evt);
+
+/** @brief Writes a full page, sends the response and receipt notification due, call it from the loop.
+ *  @details At most one page is written per call.
+ */
+void aci_dfu_poll(aci_dfu_t *p_dfu, aci_state_t *aci_stat);
+
+/** @brief Sets the shortest number of packets between two receipt notifications, 0 for as soon as they fit.
+ */
+void aci_dfu_prn_interval_set(aci_dfu_t *p_dfu, uint8_t interval);
+
+/** @brief Gets the state of the transfer, aci_dfu_state_t.
+ */
+uint8_t aci_dfu_state(const aci_dfu_t *p_dfu);
+
+/** @brief Gets the timing of the last transfer.
+ */
+void aci_dfu_stats_get(const aci_dfu_t *p_dfu, aci_dfu_stats_t *p_stats);
+
+#endif // ACI_DFU_H__
+/** @} */
@@ -0,0 +1,148 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+@brief Implementation of the hand-off to the BLE bootloader
+*/
+
+#include <lib_aci.h>
+#include "aci_dfu_handoff.h"
+#include "aci_crc.h"
+
+#if defined(__AVR__)
+#include <stddef.h>
+#include <avr/eeprom.h>
+#include <avr/wdt.h>
+
+/* The bootloader knows aci_pins_t up to interrupt_number */
+#define ACI_DFU_HANDOFF_PINS_SIZE    offsetof(aci_pins_t, instance)
+
+/* Length of the record before its CRC */
+#define ACI_DFU_HANDOFF_LENGTH       (2 + ACI_DFU_HANDOFF_PINS_SIZE + 1 + 3 + 4)
+
+#define ACI_DFU_HANDOFF_EEPROM_BASE  (E2END - ACI_DFU_HANDOFF_EEPROM_SIZE)
+
+#define aci_dfu_handoff_eeprom_read(address)         eeprom_read_byte((const uint8_t *)(uintptr_t)(address))
+#define aci_dfu_handoff_eeprom_update(address, value) eeprom_update_byte((uint8_t *)(uintptr_t)(address), (value))
+
+/* Put in .noinit, it is not cleared by the startup code after the watchdog reset */
+static uint16_t aci_dfu_handoff_key __attribute__ ((section (".noinit")));
+
+/*
+  Runs before the C startup code. Jumps to the bootloader when the reset was made by
+  aci_dfu_handoff_jump(). This way of jumping to the bootloader is inspired by the bootloaders
+  of Dean Camera.
+*/
+void aci_dfu_handoff_jump_check(void) __attribute__ ((used, naked, section (".init3")));
+
+void aci_dfu_handoff_jump_check(void)
+{
+  uint8_t wdt_flag = MCUSR & (1 << WDRF);
+
+  MCUSR &= ~(1 << WDRF);
+  wdt_disable();
+
+  if (wdt_flag && (aci_dfu_handoff_key == ACI_DFU_HANDOFF_BOOTLOADER_KEY))
+  {
+    aci_dfu_handoff_key = 0;
+
+    ((void (*)(void)) ACI_DFU_HANDOFF_BOOTLOADER_START_ADDR) ();
+  }
+}
+
+bool aci_dfu_handoff_store(aci_state_t *aci_stat, const aci_dfu_handoff_t *p_handoff)
+{
+  uint8_t  record[ACI_DFU_HANDOFF_LENGTH + 2];
+  uint8_t *p_record = &record[0];
+  uint16_t crc;
+  uint16_t crc_eeprom;
+  uint8_t  i;
+
+  *p_record++ = 1; /* Valid application */
+  *p_record++ = 1; /* Valid BLE data */
+  memcpy(p_record, &aci_stat->aci_pins, ACI_DFU_HANDOFF_PINS_SIZE);
+  p_record   += ACI_DFU_HANDOFF_PINS_SIZE;
+  *p_record++ = aci_stat->data_credit_total;
+  *p_record++ = p_handoff->packet_rx_pipe;
+  *p_record++ = p_handoff->control_point_tx_pipe;
+  *p_record++ = p_handoff->control_point_rx_pipe;
+  *p_record++ = (uint8_t)p_handoff->conn_timeout;
+  *p_record++ = (uint8_t)(p_handoff->conn_timeout >> 8);
+  *p_record++ = (uint8_t)p_handoff->adv_interval;
+  *p_record++ = (uint8_t)(p_handoff->adv_interval >> 8);
+
+  crc         = aci_crc16_ccitt(ACI_CRC16_CCITT_INIT, record, ACI_DFU_HANDOFF_LENGTH);
+  *p_record++ = (uint8_t)crc;
+  *p_record   = (uint8_t)(crc >> 8);
+
+  /* Nothing changed since the last boot: the two CRC bytes are all that is read */
+  crc_eeprom = aci_dfu_handoff_eeprom_read(ACI_DFU_HANDOFF_EEPROM_BASE + ACI_DFU_HANDOFF_LENGTH) |
+               ((uint16_t)aci_dfu_handoff_eeprom_read(ACI_DFU_HANDOFF_EEPROM_BASE + ACI_DFU_HANDOFF_LENGTH + 1) << 8);
+  if (crc == crc_eeprom)
+  {
+    return true;
+  }
+
+  /* Only the bytes that changed are written, the CRC last */
+  for (i = 0; i < sizeof(record); i++)
+  {
+    aci_dfu_handoff_eeprom_update(ACI_DFU_HANDOFF_EEPROM_BASE + i, record[i]);
+  }
+
+  /* Read the record back, EEPROM cells wear out */
+  crc = ACI_CRC16_CCITT_INIT;
+  for (i = 0; i < ACI_DFU_HANDOFF_LENGTH; i++)
+  {
+    crc = aci_crc16_ccitt_update(crc, aci_dfu_handoff_eeprom_read(ACI_DFU_HANDOFF_EEPROM_BASE + i));
+  }
+  crc_eeprom = aci_dfu_handoff_eeprom_read(ACI_DFU_HANDOFF_EEPROM_BASE + ACI_DFU_HANDOFF_LENGTH) |
+               ((uint16_t)aci_dfu_handoff_eeprom_read(ACI_DFU_HANDOFF_EEPROM_BASE + ACI_DFU_HANDOFF_LENGTH + 1) << 8);
+  return (crc == crc_eeprom);
+}
+
+bool aci_dfu_handoff_is_ready(aci_state_t *aci_stat, const aci_dfu_handoff_t *p_handoff)
+{
+  /* The bootloader starts with all the credits */
+  return (aci_stat->data_credit_available == aci_stat->data_credit_total) &&
+         lib_aci_is_pipe_available(aci_stat, p_handoff->packet_rx_pipe) &&
+         lib_aci_is_pipe_available(aci_stat, p_handoff->control_point_tx_pipe) &&
+         lib_aci_is_pipe_available(aci_stat, p_handoff->control_point_rx_pipe);
+}
+
+void aci_dfu_handoff_jump(aci_state_t *aci_stat, const aci_dfu_handoff_t *p_handoff)
+{
+  if (!aci_dfu_handoff_is_ready(aci_stat, p_handoff))
+  {
+    return;
+  }
+
+  /* Wait until ready line goes low before jump */
+  while (digitalRead(aci_stat->aci_pins.rdyn_pin));
+
+  /* Set the special bootloader key value */
+  aci_dfu_handoff_key = ACI_DFU_HANDOFF_BOOTLOADER_KEY;
+
+  wdt_enable(WDTO_15MS);
+  while(1);
+}
+#endif
@@ -0,0 +1,101 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+ * @brief Hand-off record and jump to the bootloader that updates the application over BLE.
+ */
+
+/** @defgroup aci_dfu_handoff aci_dfu_handoff
+@{
+@ingroup lib
+
+@brief Lets the application hand the link with the nRF8001 over to the BLE bootloader of the
+*_with_dfu_template examples (ATmega328 only).
+@details The bootloader reads what it needs to use the nRF8001 from a record at the end of the
+EEPROM: [valid app][valid BLE][aci_pins_t][total credits][3 DFU pipes][connection timeout, 2 bytes]
+[advertising interval, 2 bytes][CRC, 2 bytes], multi-byte fields little endian. The CRC is the
+aci_crc CRC-16-CCITT of the bytes before it.
+
+aci_dfu_handoff_store() builds the record in RAM and compares its CRC with the two CRC bytes in the
+EEPROM, so a boot where nothing has changed reads two EEPROM bytes. When they differ only the bytes
+that changed are written, the CRC last, and the record is read back to check it.
+
+aci_dfu_handoff_jump() sets a key in RAM that is not cleared by a reset and resets the MCU with the
+watchdog. aci_dfu_handoff_jump_check(), in the .init3 section, runs before the C startup code and
+jumps to the bootloader when it finds the key after a watchdog reset.
+*/
+
+#ifndef ACI_DFU_HANDOFF_H__
+#define ACI_DFU_HANDOFF_H__
+
+#include <lib_aci.h>
+
+/************************************************************************/
+/* Start address of the bootloader in flash                              */
+/* 0x7000 on the ATmega328(p) of the Arduino UNO.                        */
+/************************************************************************/
+#ifndef ACI_DFU_HANDOFF_BOOTLOADER_START_ADDR
+#define ACI_DFU_HANDOFF_BOOTLOADER_START_ADDR 0x7000
+#endif
+
+/************************************************************************/
+/* Key left in RAM across the watchdog reset to ask for the bootloader   */
+/************************************************************************/
+#ifndef ACI_DFU_HANDOFF_BOOTLOADER_KEY
+#define ACI_DFU_HANDOFF_BOOTLOADER_KEY 0xDC42
+#endif
+
+/************************************************************************/
+/* Size of the block reserved for the record at the end of the EEPROM    */
+/************************************************************************/
+#ifndef ACI_DFU_HANDOFF_EEPROM_SIZE
+#define ACI_DFU_HANDOFF_EEPROM_SIZE 32
+#endif
+
+/** What the bootloader needs besides the pins and credits of the ACI state */
+typedef struct
+{
+  uint8_t  packet_rx_pipe;            /**< PIPE_NORDIC_DEVICE_FIRMWARE_UPDATE_SERVICE_DFU_PACKET_RX */
+  uint8_t  control_point_tx_pipe;     /**< PIPE_NORDIC_DEVICE_FIRMWARE_UPDATE_SERVICE_DFU_CONTROL_POINT_TX */
+  uint8_t  control_point_rx_pipe;     /**< PIPE_NORDIC_DEVICE_FIRMWARE_UPDATE_SERVICE_DFU_CONTROL_POINT_RX_ACK_AUTO */
+  uint16_t conn_timeout;              /**< Advertising timeout of the bootloader, in seconds */
+  uint16_t adv_interval;              /**< Advertising interval of the bootloader, in 0.625 ms units */
+} aci_dfu_handoff_t;
+
+/** @brief Stores the record the bootloader reads, when it is not in the EEPROM already.
+ *  @details Call it once the nRF8001 has started, the total credits are known then.
+ *  @return True if the EEPROM holds the record.
+ */
+bool aci_dfu_handoff_store(aci_state_t *aci_stat, const aci_dfu_handoff_t *p_handoff);
+
+/** @brief True when the bootloader can take over: no data packet in flight and the DFU pipes open. */
+bool aci_dfu_handoff_is_ready(aci_state_t *aci_stat, const aci_dfu_handoff_t *p_handoff);
+
+/** @brief Jumps to the bootloader through a watchdog reset.
+ *  @details Returns only if aci_dfu_handoff_is_ready() is false. Waits for RDYN low, with an event
+ *  of the nRF8001 pending for the bootloader, before the reset.
+ */
+void aci_dfu_handoff_jump(aci_state_t *aci_stat, const aci_dfu_handoff_t *p_handoff);
+
+#endif // ACI_DFU_HANDOFF_H__
+/** @} */
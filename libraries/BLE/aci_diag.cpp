@@ -0,0 +1,410 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+@brief Implementation of the diagnostics report
+*/
+
+#include <lib_aci.h>
+#include "aci_diag.h"
+#include "ble_assert.h"
+
+/* Bytes of a record after a notification header */
+#define PACKET_DATA_MAX  (ACI_PIPE_TX_DATA_MAX_LEN - 1)
+
+static uint8_t *put_leb128(uint8_t *p_out, uint32_t value)
+{
+  while (value >= 0x80)
+  {
+    *p_out++ = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  *p_out++ = (uint8_t)value;
+  return p_out;
+}
+
+#if HAL_ACI_TL_LATENCY
+/*
+  The next event opcode measured from *p_index, 0 for ACI_EVT_DEVICE_STARTED.
+*/
+static uint8_t *record_latency(uint8_t *p_out, uint8_t *p_index)
+{
+  hal_aci_tl_latency_t latency;
+  uint8_t              opcode;
+  uint8_t              i;
+
+  while (*p_index <= (ACI_EVT_KEY_REQUEST - ACI_EVT_DEVICE_STARTED))
+  {
+    opcode = (uint8_t)(ACI_EVT_DEVICE_STARTED + (*p_index)++);
+    if (!hal_aci_tl_latency_get(opcode, &latency) || (0 == latency.count))
+    {
+      continue;
+    }
+
+    *p_out++ = opcode;
+    p_out = put_leb128(p_out, latency.count);
+    p_out = put_leb128(p_out, latency.min_us);
+    p_out = put_leb128(p_out, latency.max_us);
+    p_out = put_leb128(p_out, latency.total_us / latency.count);
+    for (i = 0; i < HAL_ACI_TL_LATENCY_BUCKETS; i++)
+    {
+      p_out = put_leb128(p_out, latency.histogram[i]);
+    }
+    return p_out;
+  }
+  return NULL;
+}
+#endif
+
+#if LIB_ACI_LINK_HISTORY
+static uint8_t *record_link(uint8_t *p_out, aci_state_t *aci_stat, uint8_t *p_index)
+{
+  lib_aci_link_record_t link;
+
+  if (!lib_aci_link_history_read(aci_stat, *p_index, &link))
+  {
+    return NULL;
+  }
+  (*p_index)++;
+
+  p_out = put_leb128(p_out, link.connected_ms);
+  p_out = put_leb128(p_out, link.duration_ms);
+  p_out = put_leb128(p_out, link.starved_ms);
+  p_out = put_leb128(p_out, link.starved_max_ms);
+  p_out = put_leb128(p_out, link.starved_count);
+  p_out = put_leb128(p_out, link.interval);
+  p_out = put_leb128(p_out, link.interval_min);
+  p_out = put_leb128(p_out, link.interval_max);
+  p_out = put_leb128(p_out, link.slave_latency);
+  p_out = put_leb128(p_out, link.slave_latency_max);
+  p_out = put_leb128(p_out, link.supervision_timeout);
+  p_out = put_leb128(p_out, link.timing_changes);
+  p_out = put_leb128(p_out, link.pipe_errors);
+  p_out = put_leb128(p_out, link.aci_status);
+  p_out = put_leb128(p_out, link.btle_status);
+  return p_out;
+}
+#endif
+
+static uint8_t *record_energy(uint8_t *p_out, aci_energy_t *p_energy)
+{
+  aci_energy_report_t energy;
+
+  aci_energy_get(p_energy, &energy);
+  p_out = put_leb128(p_out, energy.elapsed_ms);
+  p_out = put_leb128(p_out, energy.awake_ms);
+  p_out = put_leb128(p_out, energy.sleep_ms);
+  p_out = put_leb128(p_out, energy.radio_active_ms);
+  p_out = put_leb128(p_out, energy.sleeps);
+  p_out = put_leb128(p_out, energy.events);
+  p_out = put_leb128(p_out, energy.bytes);
+  p_out = put_leb128(p_out, energy.packets);
+  p_out = put_leb128(p_out, energy.mcu_uc);
+  p_out = put_leb128(p_out, energy.radio_uc);
+  p_out = put_leb128(p_out, energy.average_ua);
+  p_out = put_leb128(p_out, energy.nc_per_byte);
+  p_out = put_leb128(p_out, energy.nc_per_packet);
+  p_out = put_leb128(p_out, energy.nc_per_event);
+  return p_out;
+}
+
+/*
+  The payload of the record tag, NULL when there is no more of it. The records of a tag that
+  repeats are numbered by *p_index.
+*/
+static uint8_t *record_payload(const aci_diag_params_t *p_params, uint8_t tag, uint8_t *p_out,
+                               aci_state_t *aci_stat, uint8_t *p_index)
+{
+#if HAL_ACI_TL_STATS
+  hal_aci_tl_stats_t stats;
+#endif
+
+  (void)aci_stat;
+
+  switch (tag)
+  {
+    case ACI_DIAG_RECORD_HEADER:
+      if (0 != (*p_index)++)
+      {
+        return NULL;
+      }
+      p_out = put_leb128(p_out, ACI_DIAG_FORMAT);
+      return put_leb128(p_out, millis());
+
+#if HAL_ACI_TL_STATS
+    case ACI_DIAG_RECORD_TRANSPORT:
+      if (0 != (*p_index)++)
+      {
+        return NULL;
+      }
+      hal_aci_tl_stats_get(&stats);
+      p_out = put_leb128(p_out, stats.spi_transfers);
+      p_out = put_leb128(p_out, stats.bytes_out);
+      p_out = put_leb128(p_out, stats.bytes_in);
+      p_out = put_leb128(p_out, stats.empty_transfers);
+      p_out = put_leb128(p_out, stats.isr_transfers);
+      p_out = put_leb128(p_out, stats.poll_transfers);
+      p_out = put_leb128(p_out, stats.rx_full_stalls);
+      p_out = put_leb128(p_out, stats.tx_enqueue_failures);
+      p_out = put_leb128(p_out, stats.tx_coalesced);
+      p_out = put_leb128(p_out, stats.rx_credit_coalesced);
+      p_out = put_leb128(p_out, stats.tx_q_high_water);
+      p_out = put_leb128(p_out, stats.rx_q_high_water);
+#if HAL_ACI_TL_HYBRID
+      p_out = put_leb128(p_out, stats.hybrid_switches);
+#endif
+      return p_out;
+#endif
+
+#if HAL_ACI_TL_LATENCY
+    case ACI_DIAG_RECORD_LATENCY:
+      return record_latency(p_out, p_index);
+#endif
+
+#if LIB_ACI_LINK_HISTORY
+    case ACI_DIAG_RECORD_LINK:
+      return record_link(p_out, aci_stat, p_index);
+#endif
+
+    case ACI_DIAG_RECORD_ENERGY:
+      if ((NULL == p_params->p_energy) || (0 != (*p_index)++))
+      {
+        return NULL;
+      }
+      return record_energy(p_out, p_params->p_energy);
+
+    default:
+      return NULL;
+  }
+}
+
+/*
+  Encodes the next record of the report in the record buffer, false at the end of the report.
+*/
+static bool record_next(aci_diag_t *p_diag, aci_state_t *aci_stat)
+{
+  uint8_t *p_end;
+
+  while (p_diag->tag <= ACI_DIAG_RECORD_LAST)
+  {
+    if (0 != (p_diag->mask & ACI_DIAG_MASK(p_diag->tag)))
+    {
+      p_end = record_payload(p_diag->p_params, p_diag->tag, &p_diag->record[2], aci_stat, &p_diag->index);
+      if (NULL != p_end)
+      {
+        p_diag->record[0]  = p_diag->tag;
+        p_diag->record[1]  = (uint8_t)(p_end - &p_diag->record[2]);
+        p_diag->record_len = (uint8_t)(p_end - &p_diag->record[0]);
+        p_diag->record_pos = 0;
+        ble_assert(p_diag->record_len <= ACI_DIAG_RECORD_MAX);
+        return true;
+      }
+    }
+    p_diag->tag++;
+    p_diag->index = 0;
+  }
+  return false;
+}
+
+/*
+  Fills the next notification from the records, the last one of the report is marked.
+*/
+static void packet_build(aci_diag_t *p_diag, aci_state_t *aci_stat)
+{
+  bool    last = false;
+  uint8_t count;
+
+  p_diag->packet_len = 1;
+  while (p_diag->packet_len <= PACKET_DATA_MAX)
+  {
+    if ((p_diag->record_pos == p_diag->record_len) && !record_next(p_diag, aci_stat))
+    {
+      last = true;
+      break;
+    }
+    count = p_diag->record_len - p_diag->record_pos;
+    if (count > (ACI_PIPE_TX_DATA_MAX_LEN - p_diag->packet_len))
+    {
+      count = ACI_PIPE_TX_DATA_MAX_LEN - p_diag->packet_len;
+    }
+    memcpy(&p_diag->packet[p_diag->packet_len], &p_diag->record[p_diag->record_pos], count);
+    p_diag->packet_len += count;
+    p_diag->record_pos += count;
+  }
+
+  if (!last && (p_diag->record_pos == p_diag->record_len) && !record_next(p_diag, aci_stat))
+  {
+    last = true;
+  }
+  p_diag->packet[0] = (uint8_t)((p_diag->seq & ~ACI_DIAG_PACKET_LAST) | (last ? ACI_DIAG_PACKET_LAST : 0));
+}
+
+static void report_abort(aci_diag_t *p_diag)
+{
+  if (p_diag->active)
+  {
+    p_diag->stats.reports_aborted++;
+  }
+  p_diag->active     = false;
+  p_diag->packet_len = 0;
+}
+
+static void report_send(aci_diag_t *p_diag, aci_state_t *aci_stat)
+{
+  const aci_diag_params_t *p_params = p_diag->p_params;
+
+  lib_aci_select(aci_stat);
+  if (!p_diag->active || !lib_aci_is_pipe_available(aci_stat, p_params->report_pipe))
+  {
+    return;
+  }
+
+  while (aci_stat->data_credit_available > p_params->credits_kept)
+  {
+    if (0 == p_diag->packet_len)
+    {
+      packet_build(p_diag, aci_stat);
+    }
+    if (!lib_aci_send_data(p_params->report_pipe, &p_diag->packet[0], p_diag->packet_len))
+    {
+      return;
+    }
+    p_diag->stats.packets++;
+    p_diag->seq++;
+
+    if (0 != (p_diag->packet[0] & ACI_DIAG_PACKET_LAST))
+    {
+      p_diag->stats.reports++;
+      p_diag->active     = false;
+      p_diag->packet_len = 0;
+      return;
+    }
+    p_diag->packet_len = 0;
+  }
+}
+
+void aci_diag_init(aci_diag_t *p_diag, const aci_diag_params_t *p_params)
+{
+  ble_assert(0 != p_params->credits_kept);
+
+  memset(p_diag, 0, sizeof(*p_diag));
+  p_diag->p_params = p_params;
+}
+
+bool aci_diag_request(aci_diag_t *p_diag, uint8_t mask)
+{
+  p_diag->stats.requests++;
+  if (p_diag->active)
+  {
+    p_diag->stats.requests_busy++;
+    return false;
+  }
+
+  p_diag->active     = true;
+  p_diag->mask       = (uint8_t)(mask | ACI_DIAG_MASK(ACI_DIAG_RECORD_HEADER));
+  p_diag->tag        = ACI_DIAG_RECORD_HEADER;
+  p_diag->index      = 0;
+  p_diag->seq        = 0;
+  p_diag->record_len = 0;
+  p_diag->record_pos = 0;
+  p_diag->packet_len = 0;
+  return true;
+}
+
+void aci_diag_clear(aci_diag_t *p_diag, aci_state_t *aci_stat)
+{
+  (void)aci_stat;
+
+  if (NULL != p_diag->p_params->p_energy)
+  {
+    aci_energy_reset(p_diag->p_params->p_energy);
+  }
+
+#if HAL_ACI_TL_STATS
+  hal_aci_tl_stats_reset();
+#endif
+#if HAL_ACI_TL_LATENCY
+  hal_aci_tl_latency_reset();
+#endif
+#if LIB_ACI_LINK_HISTORY
+  lib_aci_link_history_clear(aci_stat);
+#endif
+}
+
+void aci_diag_event(aci_diag_t *p_diag, aci_state_t *aci_stat, const aci_evt_t *p_evt)
+{
+  const aci_diag_params_t *p_params = p_diag->p_params;
+  const uint8_t           *p_data;
+  uint8_t                  length;
+
+  switch (p_evt->evt_opcode)
+  {
+    case ACI_EVT_DATA_RECEIVED:
+      if (p_evt->params.data_received.rx_data.pipe_number != p_params->request_pipe)
+      {
+        break;
+      }
+      p_data = &p_evt->params.data_received.rx_data.aci_data[0];
+      length = p_evt->len - 2;
+      if ((length >= 1) && (ACI_DIAG_OP_REPORT == p_data[0]))
+      {
+        aci_diag_request(p_diag, (length >= 2) ? p_data[1] : ACI_DIAG_MASK_ALL);
+        report_send(p_diag, aci_stat);
+      }
+      else if ((length >= 1) && (ACI_DIAG_OP_CLEAR == p_data[0]))
+      {
+        aci_diag_clear(p_diag, aci_stat);
+      }
+      break;
+
+    case ACI_EVT_PIPE_STATUS:
+      lib_aci_select(aci_stat);
+      if (!lib_aci_is_pipe_available(aci_stat, p_params->report_pipe))
+      {
+        report_abort(p_diag);
+      }
+      report_send(p_diag, aci_stat);
+      break;
+
+    case ACI_EVT_DATA_CREDIT:
+      report_send(p_diag, aci_stat);
+      break;
+
+    case ACI_EVT_DISCONNECTED:
+      report_abort(p_diag);
+      break;
+
+    default:
+      break;
+  }
+}
+
+void aci_diag_poll(aci_diag_t *p_diag, aci_state_t *aci_stat)
+{
+  report_send(p_diag, aci_stat);
+}
+
+void aci_diag_stats_get(const aci_diag_t *p_diag, aci_diag_stats_t *p_stats)
+{
+  *p_stats = p_diag->stats;
+}
@@ -0,0 +1,156 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/** @file
+ * @brief Diagnostics of the transport and the link, reported over a GATT service.
+ */
+
+/** @defgroup aci_diag aci_diag
+@{
+@ingroup lib
+
+@brief Sends the counters of the library to a phone or a collector on request, over the
+Diagnostics service of ble_diagnostics_template, with the data credits the application leaves.
+@details The service has a Request characteristic, written without response (an RX pipe), and a
+Report characteristic that notifies (a TX pipe). Copy the service of Diagnostics.xml into the
+nRFgo Studio project of the application and give the two pipes to aci_diag_params_t.
+
+A request is a byte, ACI_DIAG_OP_REPORT followed by a mask of the records wanted, all of them when
+it is left out, or ACI_DIAG_OP_CLEAR. A report is a stream of records, each the tag, the length
+of the payload and the payload, where the counters are LEB128: 7 bits per byte, the low ones
+first, bit 7 set when more follow. Small counters take a byte.
+@code
+  ACI_DIAG_RECORD_HEADER     format ACI_DIAG_FORMAT, millis()
+  ACI_DIAG_RECORD_TRANSPORT  the fields of hal_aci_tl_stats_t in order, HAL_ACI_TL_STATS
+  ACI_DIAG_RECORD_LATENCY    per event opcode measured: the opcode byte, count, min_us, max_us,
+                             the average and the histogram, HAL_ACI_TL_LATENCY
+  ACI_DIAG_RECORD_LINK       per connection, newest first: the fields of lib_aci_link_record_t in
+                             order, LIB_ACI_LINK_HISTORY
+  ACI_DIAG_RECORD_ENERGY     the fields of aci_energy_report_t in order, when
+                             aci_diag_params_t::p_energy is set
+@endcode
+The records of the options not built are left out. The stream is cut into notifications, each
+starting with a byte of the packet number in the report, and ACI_DIAG_PACKET_LAST in the last one.
+A reader skips the records it does not know, and the fields past the ones it knows in a record.
+
+The report only takes the credits above aci_diag_params_t::credits_kept, one packet at a time, so
+the application that sends first in the loop keeps its rate. With aci_scheduler, call
+aci_diag_poll() only while the flows have nothing pending.
+
+Call aci_diag_event() with every ACI event and aci_diag_poll() from the loop.
+*/
+
+#ifndef ACI_DIAG_H__
+#define ACI_DIAG_H__
+
+#include <lib_aci.h>
+#include "aci_energy.h"
+
+/** Version of the records, in ACI_DIAG_RECORD_HEADER */
+#define ACI_DIAG_FORMAT           1
+
+/** Opcodes of the Request characteristic */
+#define ACI_DIAG_OP_REPORT        0x01
+#define ACI_DIAG_OP_CLEAR         0x02
+
+/** Tags of the records, the mask of a request has bit (tag - 1) for each */
+#define ACI_DIAG_RECORD_HEADER    0x01
+#define ACI_DIAG_RECORD_TRANSPORT 0x02
+#define ACI_DIAG_RECORD_LATENCY   0x03
+#define ACI_DIAG_RECORD_LINK      0x04
+#define ACI_DIAG_RECORD_ENERGY    0x05
+#define ACI_DIAG_RECORD_LAST      ACI_DIAG_RECORD_ENERGY
+#define ACI_DIAG_MASK(tag)        (1u << ((tag) - 1))
+#define ACI_DIAG_MASK_ALL         0xFF
+
+/** In the first byte of the last notification of a report */
+#define ACI_DIAG_PACKET_LAST      0x80
+
+/** Longest record, tag and length included */
+#define ACI_DIAG_RECORD_MAX       72
+
+typedef struct
+{
+  uint8_t request_pipe;            /**< RX pipe of the Request characteristic */
+  uint8_t report_pipe;             /**< TX pipe of the Report characteristic */
+  uint8_t credits_kept;            /**< Data credits left for the application, 1 or more */
+  aci_energy_t *p_energy;          /**< Meter of ACI_DIAG_RECORD_ENERGY, NULL for none */
+} aci_diag_params_t;
+
+typedef struct
+{
+  uint16_t requests;
+  uint16_t reports;                /**< Sent whole */
+  uint16_t reports_aborted;        /**< Cut by a disconnect or the Report pipe closing */
+  uint16_t requests_busy;          /**< Ignored, a report was being sent */
+  uint32_t packets;
+} aci_diag_stats_t;
+
+/** State of the diagnostics */
+typedef struct
+{
+  const aci_diag_params_t *p_params;
+  bool                     active;              /**< A report is being sent */
+  uint8_t                  mask;
+  uint8_t                  tag;                 /**< Next record */
+  uint8_t                  index;               /**< Opcode or connection within the record tag */
+  uint8_t                  seq;
+  uint8_t                  record_len;
+  uint8_t                  record_pos;
+  uint8_t                  packet_len;          /**< 0 when the next packet is not built */
+  aci_diag_stats_t         stats;
+  uint8_t                  record[ACI_DIAG_RECORD_MAX];
+  uint8_t                  packet[ACI_PIPE_TX_DATA_MAX_LEN];
+} aci_diag_t;
+
+/** @brief Initializes the diagnostics, no report is being sent.
+ *  @param p_diag state of the diagnostics.
+ *  @param p_params pipes and credits, must stay valid while the diagnostics are used.
+ */
+void aci_diag_init(aci_diag_t *p_diag, const aci_diag_params_t *p_params);
+
+/** @brief Gives an ACI event to the diagnostics, call it for every event taken from lib_aci_event_get().
+ *  @details The requests come with the DataReceived events of the Request pipe, the report is sent on
+ *  the DataCredit and PipeStatus events and is cut by the Disconnected event.
+ */
+void aci_diag_event(aci_diag_t *p_diag, aci_state_t *aci_stat, const aci_evt_t *p_evt);
+
+/** @brief Sends the report with the credits left, call it from the loop after the application.
+ */
+void aci_diag_poll(aci_diag_t *p_diag, aci_state_t *aci_stat);
+
+/** @brief Starts a report from the sketch, as a request written by the peer.
+ *  @param mask records wanted, ACI_DIAG_MASK() of their tags or ACI_DIAG_MASK_ALL.
+ *  @return False if a report is being sent.
+ */
+bool aci_diag_request(aci_diag_t *p_diag, uint8_t mask);
+
+/** @brief Clears the counters reported, as ACI_DIAG_OP_CLEAR.
+ *  @details The energy meter is started again with aci_energy_reset().
+ */
+void aci_diag_clear(aci_diag_t *p_diag, aci_state_t *aci_stat);
+
+/** @brief Gets the counters since aci_diag_init().
+ */
+void aci_diag_stats_get(const aci_diag_t *p_diag, aci_diag_stats_t *p_stats);
+
+#endif // ACI_DIAG_H__
+/** @} */
@@ -0,0 +1,358 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+/** @file
+@brief Implementation of the Direct Test Mode sweep
+*/
+
+#include <lib_aci.h>
+#include "aci_dtm.h"
+#include "ble_assert.h"
+
+/* Needs the DtmCommand commands */
+#if ACI_FEATURE_DTM
+
+#define DTM_CHANNEL_MASK     0x3F
+#define DTM_LENGTH_MASK      0x3F
+#define DTM_PKT_MASK         0x03
+#define DTM_PKT_TYPES        4
+#define DTM_PACKET_MSB_MASK  0x7F
+
+typedef enum
+{
+  DTM_STATE_IDLE,
+  DTM_STATE_RESET,         /**< LE_RESET to send or answered */
+  DTM_STATE_TEST_START,    /**< The receiver or transmitter test to send or answered */
+  DTM_STATE_TEST_RUNNING,  /**< Waiting for duration_ms */
+  DTM_STATE_TEST_END,      /**< LE_TEST_END to send or answered */
+  DTM_STATE_STOPPING       /**< The test to end, without result */
+} dtm_state_t;
+
+static void report_init(aci_dtm_report_t *p_report)
+{
+  p_report->tests          = 0;
+  p_report->failures       = 0;
+  p_report->rx_packets     = 0;
+  p_report->rx_packets_min = 0xFFFF;
+  p_report->rx_channel_min = 0;
+  p_report->duration_ms    = 0;
+}
+
+/* First packet type from packet_type in the packet_types of the sweep, DTM_PKT_TYPES if none */
+static uint8_t packet_type_next(const aci_dtm_params_t *p_params, uint8_t packet_type)
+{
+  while ((packet_type < DTM_PKT_TYPES) && !(p_params->packet_types & (1 << packet_type)))
+  {
+    packet_type++;
+  }
+  return packet_type;
+}
+
+/*
+  Moves to the first test of a channel: the receiver test, then the transmitter test of each
+  packet type. Returns false when the sweep is over.
+*/
+static bool channel_first_test(aci_dtm_t *p_dtm)
+{
+  const aci_dtm_params_t *p_params = p_dtm->p_params;
+
+  if (p_dtm->channel > p_params->last_channel)
+  {
+    return false;
+  }
+
+  p_dtm->packet_type = packet_type_next(p_params, 0);
+  if (p_params->modes & ACI_DTM_MODE_RX)
+  {
+    p_dtm->mode = ACI_DTM_MODE_RX;
+    return true;
+  }
+  if ((p_params->modes & ACI_DTM_MODE_TX) && (p_dtm->packet_type < DTM_PKT_TYPES))
+  {
+    p_dtm->mode = ACI_DTM_MODE_TX;
+    return true;
+  }
+  return false;
+}
+
+static bool test_next(aci_dtm_t *p_dtm)
+{
+  const aci_dtm_params_t *p_params = p_dtm->p_params;
+
+  if (ACI_DTM_MODE_RX == p_dtm->mode)
+  {
+    if ((p_params->modes & ACI_DTM_MODE_TX) && (p_dtm->packet_type < DTM_PKT_TYPES))
+    {
+      p_dtm->mode = ACI_DTM_MODE_TX;
+      return true;
+    }
+  }
+  else
+  {
+    p_dtm->packet_type = packet_type_next(p_params, p_dtm->packet_type + 1);
+    if (p_dtm->packet_type < DTM_PKT_TYPES)
+    {
+      return true;
+    }
+  }
+
+  p_dtm->channel += (0 == p_params->channel_step) ? 1 : p_params->channel_step;
+  return channel_first_test(p_dtm);
+}
+
+static void test_result(aci_dtm_t *p_dtm, uint16_t packets)
+{
+  const aci_dtm_params_t *p_params = p_dtm->p_params;
+  aci_dtm_result_t result;
+
+  result.mode        = p_dtm->mode;
+  result.channel     = p_dtm->channel;
+  result.packet_type = p_dtm->packet_type;
+  result.success     = p_dtm->test_started;
+  result.packets     = packets;
+
+  p_dtm->report.tests++;
+  if (!result.success)
+  {
+    p_dtm->report.failures++;
+  }
+  else if (ACI_DTM_MODE_RX == result.mode)
+  {
+    p_dtm->report.rx_packets += packets;
+    if (packets < p_dtm->report.rx_packets_min)
+    {
+      p_dtm->report.rx_packets_min = packets;
+      p_dtm->report.rx_channel_min = result.channel;
+    }
+  }
+
+  if (NULL != p_params->result_handler)
+  {
+    p_params->result_handler(&result);
+  }
+}
+
+static void sweep_done(aci_dtm_t *p_dtm)
+{
+  p_dtm->state              = DTM_STATE_IDLE;
+  p_dtm->report.duration_ms = millis() - p_dtm->start_ms;
+  if (0xFFFF == p_dtm->report.rx_packets_min)
+  {
+    p_dtm->report.rx_packets_min = 0;
+  }
+
+  if (NULL != p_dtm->p_params->done_handler)
+  {
+    p_dtm->p_params->done_handler(&p_dtm->report);
+  }
+}
+
+static bool command_send(aci_dtm_t *p_dtm, uint8_t msb, uint8_t lsb)
+{
+  if (!lib_aci_dtm_command(msb, lsb))
+  {
+    return false;
+  }
+  p_dtm->cmd_in_flight = true;
+  return true;
+}
+
+void aci_dtm_init(aci_dtm_t *p_dtm, const aci_dtm_params_t *p_params)
+{
+  ble_assert(p_params->first_channel <= p_params->last_channel);
+  ble_assert(p_params->last_channel < ACI_DTM_CHANNELS);
+
+  p_dtm->p_params      = p_params;
+  p_dtm->state         = DTM_STATE_IDLE;
+  p_dtm->test_mode     = false;
+  p_dtm->cmd_in_flight = false;
+  p_dtm->test_started  = false;
+  report_init(&p_dtm->report);
+}
+
+bool aci_dtm_start(aci_dtm_t *p_dtm)
+{
+  if (!p_dtm->test_mode || (DTM_STATE_IDLE != p_dtm->state))
+  {
+    return false;
+  }
+
+  p_dtm->channel = p_dtm->p_params->first_channel;
+  if (!channel_first_test(p_dtm))
+  {
+    return false;
+  }
+
+  report_init(&p_dtm->report);
+  p_dtm->start_ms = millis();
+  p_dtm->state    = DTM_STATE_RESET;
+  return true;
+}
+
+void aci_dtm_stop(aci_dtm_t *p_dtm)
+{
+  /* Nothing started yet */
+  if ((DTM_STATE_RESET == p_dtm->state) ||
+      ((DTM_STATE_TEST_START == p_dtm->state) && !p_dtm->cmd_in_flight))
+  {
+    p_dtm->state = DTM_STATE_IDLE;
+  }
+  else if (DTM_STATE_IDLE != p_dtm->state)
+  {
+    p_dtm->state = DTM_STATE_STOPPING;
+  }
+}
+
+bool aci_dtm_running(const aci_dtm_t *p_dtm)
+{
+  return (DTM_STATE_IDLE != p_dtm->state);
+}
+
+void aci_dtm_event(aci_dtm_t *p_dtm, aci_state_t *aci_stat, const aci_evt_t *p_evt)
+{
+  const aci_evt_params_cmd_rsp_t *p_rsp = &p_evt->params.cmd_rsp;
+  bool success;
+  uint16_t packets;
+
+  (void)aci_stat;
+
+  if (ACI_EVT_DEVICE_STARTED == p_evt->evt_opcode)
+  {
+    /* A reset ends the sweep, the done handler is not called */
+    p_dtm->test_mode     = (ACI_DEVICE_TEST == p_evt->params.device_started.device_mode);
+    p_dtm->state         = DTM_STATE_IDLE;
+    p_dtm->cmd_in_flight = false;
+    return;
+  }
+
+  if ((ACI_EVT_CMD_RSP != p_evt->evt_opcode) || (ACI_CMD_DTM_CMD != p_rsp->cmd_opcode) ||
+      !p_dtm->cmd_in_flight)
+  {
+    return;
+  }
+  p_dtm->cmd_in_flight = false;
+
+  /* LE_TEST_END is answered with a packet report, the other commands with a status */
+  if (p_rsp->params.dtm_cmd.evt_msb & LE_PACKET_REPORTING_EVENT_MSB_BIT)
+  {
+    success = true;
+    packets = (uint16_t)(((p_rsp->params.dtm_cmd.evt_msb & DTM_PACKET_MSB_MASK) << 8) |
+                         p_rsp->params.dtm_cmd.evt_lsb);
+  }
+  else
+  {
+    success = (LE_TEST_STATUS_SUCCESS == (p_rsp->params.dtm_cmd.evt_lsb & LE_TEST_STATUS_EVENT_LSB_BIT));
+    packets = 0;
+  }
+  success = success && (ACI_STATUS_SUCCESS == p_rsp->cmd_status);
+
+  switch (p_dtm->state)
+  {
+    case DTM_STATE_RESET:
+      p_dtm->state = DTM_STATE_TEST_START;
+      break;
+
+    case DTM_STATE_TEST_START:
+      p_dtm->test_started = success;
+      p_dtm->test_ms      = millis();
+      if (success)
+      {
+        p_dtm->state = DTM_STATE_TEST_RUNNING;
+      }
+      else
+      {
+        test_result(p_dtm, 0);
+        if (!test_next(p_dtm))
+        {
+          sweep_done(p_dtm);
+        }
+      }
+      break;
+
+    case DTM_STATE_TEST_END:
+      test_result(p_dtm, packets);
+      if (test_next(p_dtm))
+      {
+        p_dtm->state = DTM_STATE_TEST_START;
+      }
+      else
+      {
+        sweep_done(p_dtm);
+      }
+      break;
+
+    case DTM_STATE_STOPPING:
+      /* The status of a test started, end it. Or the packet report of LE_TEST_END */
+      if (!success || (p_rsp->params.dtm_cmd.evt_msb & LE_PACKET_REPORTING_EVENT_MSB_BIT))
+      {
+        p_dtm->state = DTM_STATE_IDLE;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+void aci_dtm_poll(aci_dtm_t *p_dtm)
+{
+  const aci_dtm_params_t *p_params = p_dtm->p_params;
+  uint8_t msb;
+  uint8_t lsb;
+
+  if (p_dtm->cmd_in_flight)
+  {
+    return;
+  }
+
+  switch (p_dtm->state)
+  {
+    case DTM_STATE_RESET:
+      command_send(p_dtm, DTM_LE_CMD_RESET, 0x00);
+      break;
+
+    case DTM_STATE_TEST_START:
+      /* The packet type of a receiver test is not used */
+      msb = (uint8_t)(((ACI_DTM_MODE_RX == p_dtm->mode) ? DTM_LE_CMD_RECEIVER_TEST : DTM_LE_CMD_TRANSMITTER_TEST) |
+                      (p_dtm->channel & DTM_CHANNEL_MASK));
+      lsb = (uint8_t)(((p_params->length & DTM_LENGTH_MASK) << 2) | (p_dtm->packet_type & DTM_PKT_MASK));
+      command_send(p_dtm, msb, lsb);
+      break;
+
+    case DTM_STATE_TEST_RUNNING:
+      if ((millis() - p_dtm->test_ms) >= p_params->duration_ms)
+      {
+        p_dtm->state = DTM_STATE_TEST_END;
+      }
+      break;
+
+    case DTM_STATE_TEST_END:
+    case DTM_STATE_STOPPING:
+      command_send(p_dtm, DTM_LE_CMD_TEST_END, 0x00);
+      break;
+
+    default:
+      break;
+  }
+}
+
+#endif // ACI_FEATURE_DTM
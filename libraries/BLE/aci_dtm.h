@@ -0,0 +1,142 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+/** @file
+ * @brief Runs a sweep of Direct Test Mode tests over the ACI.
+ */
+
+/** @defgroup aci_dtm aci_dtm
+@{
+@ingroup lib
+
+@brief Sweeps the receiver and transmitter tests of the Direct Test Mode over the RF channels.
+@details For each channel from first_channel to last_channel, every channel_step, the runner
+does a receiver test, then a transmitter test for each of the packet types, each for
+duration_ms. A DTM tester on the other side sends the packets counted by the receiver tests and
+counts the packets of the transmitter tests. Each test is ended with LE_TEST_END and its packet
+count is given to the result handler, so a sweep of the 40 channels takes a few seconds.
+
+The nRF8001 must be in Test mode with DTM over ACI, see lib_aci_test(ACI_TEST_MODE_DTM_ACI).
+Call aci_dtm_event() with every ACI event and aci_dtm_poll() from the loop. The commands are
+sent one at a time, each after the command response of the previous one.
+*/
+
+#ifndef ACI_DTM_H__
+#define ACI_DTM_H__
+
+#include <lib_aci.h>
+#include "dtm.h"
+
+/** Modes of aci_dtm_params_t modes */
+#define ACI_DTM_MODE_RX  0x01
+#define ACI_DTM_MODE_TX  0x02
+
+/** RF channels of the Direct Test Mode, N = (F - 2402) / 2 */
+#define ACI_DTM_CHANNELS 40
+
+/** The result of a test */
+typedef struct
+{
+  uint8_t  mode;                   /**< ACI_DTM_MODE_RX or ACI_DTM_MODE_TX */
+  uint8_t  channel;                /**< 0 to 39 */
+  uint8_t  packet_type;            /**< DTM_LE_PKT_*, of the transmitter test */
+  bool     success;                /**< The nRF8001 started the test */
+  uint16_t packets;                /**< Packets received, 0 for a transmitter test */
+} aci_dtm_result_t;
+
+/** Summary of the sweep */
+typedef struct
+{
+  uint16_t tests;                  /**< Tests done */
+  uint16_t failures;               /**< Tests the nRF8001 refused */
+  uint32_t rx_packets;             /**< Packets received over all the receiver tests */
+  uint16_t rx_packets_min;         /**< Packets of the worst receiver test */
+  uint8_t  rx_channel_min;         /**< Channel of the worst receiver test */
+  unsigned long duration_ms;       /**< From aci_dtm_start() to the end of the sweep */
+} aci_dtm_report_t;
+
+/** Called with the result of each test, from aci_dtm_event() */
+typedef void (*aci_dtm_result_handler_t)(const aci_dtm_result_t *p_result);
+
+/** Called with the summary when the sweep is done, from aci_dtm_event() */
+typedef void (*aci_dtm_done_handler_t)(const aci_dtm_report_t *p_report);
+
+typedef struct
+{
+  uint8_t  first_channel;          /**< 0 to 39 */
+  uint8_t  last_channel;           /**< first_channel to 39 */
+  uint8_t  channel_step;           /**< 1 for every channel */
+  uint8_t  modes;                  /**< ACI_DTM_MODE_RX, ACI_DTM_MODE_TX or both */
+  uint8_t  packet_types;           /**< A bit per DTM_LE_PKT_* of the transmitter tests */
+  uint8_t  length;                 /**< Payload of the transmitted packets, 0 to 37 */
+  uint16_t duration_ms;            /**< Of each test */
+  aci_dtm_result_handler_t result_handler; /**< NULL for the summary only */
+  aci_dtm_done_handler_t   done_handler;
+} aci_dtm_params_t;
+
+/** State of the runner, one per nRF8001 */
+typedef struct
+{
+  const aci_dtm_params_t *p_params;
+  uint8_t          state;
+  bool             test_mode;      /**< The nRF8001 started in Test mode */
+  bool             cmd_in_flight;  /**< The command response is waited for */
+  uint8_t          channel;
+  uint8_t          mode;
+  uint8_t          packet_type;
+  bool             test_started;   /**< The status event of the current test was a success */
+  unsigned long    test_ms;        /**< Start of the current test */
+  unsigned long    start_ms;
+  aci_dtm_report_t report;
+} aci_dtm_t;
+
+/** @brief Initializes the runner.
+ *  @param p_dtm state of the runner.
+ *  @param p_params sweep, must stay valid while the runner is used.
+ */
+void aci_dtm_init(aci_dtm_t *p_dtm, const aci_dtm_params_t *p_params);
+
+/** @brief Starts the sweep, with an LE_RESET.
+ *  @return False if the nRF8001 is not in Test mode or a sweep is running.
+ */
+bool aci_dtm_start(aci_dtm_t *p_dtm);
+
+/** @brief Stops the sweep after the current test, the done handler is not called.
+ */
+void aci_dtm_stop(aci_dtm_t *p_dtm);
+
+/** @brief Tells if a sweep is running.
+ */
+bool aci_dtm_running(const aci_dtm_t *p_dtm);
+
+/** @brief Gives an ACI event to the runner, call it for every event taken from lib_aci_event_get().
+ *  @details The command responses to the DTM commands of a sweep are still given to the
+ *  application.
+ */
+void aci_dtm_event(aci_dtm_t *p_dtm, aci_state_t *aci_stat, const aci_evt_t *p_evt);
+
+/** @brief Sends the next DTM command when due, call it from the loop.
+ */
+void aci_dtm_poll(aci_dtm_t *p_dtm);
+
+#endif // ACI_DTM_H__
+/** @} */
@@ -0,0 +1,223 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+@brief Implementation of the energy meter
+*/
+
+#include <lib_aci.h>
+#include "aci_energy.h"
+#if defined(__AVR__)
+#include <avr/sleep.h>
+#endif
+
+static void time_add(aci_energy_time_t *p_time, uint32_t us)
+{
+  us += p_time->us;
+  p_time->ms += us / 1000;
+  p_time->us  = (uint16_t)(us % 1000);
+}
+
+/*
+  ua x ms / 1000 in uC, without the product overflowing.
+*/
+static uint32_t charge_uc(uint16_t ua, uint32_t ms)
+{
+  return ((uint32_t)ua * (ms / 1000)) + (((uint32_t)ua * (ms % 1000)) / 1000);
+}
+
+/*
+  num x 1000 / den, without the product overflowing. den is not 0.
+*/
+static uint32_t per_thousand(uint32_t num, uint32_t den)
+{
+  uint32_t rest = num % den;
+
+  if (rest < (0xFFFFFFFFUL / 1000))
+  {
+    return ((num / den) * 1000) + ((rest * 1000) / den);
+  }
+  return ((num / den) * 1000) + (rest / (den / 1000));
+}
+
+/*
+  Counts the time since the last count as awake.
+*/
+static void awake_count(aci_energy_t *p_energy)
+{
+  uint32_t now_us = micros();
+
+  time_add(&p_energy->awake, now_us - p_energy->last_us);
+  p_energy->last_us = now_us;
+}
+
+void aci_energy_init(aci_energy_t *p_energy, const aci_energy_params_t *p_params)
+{
+  p_energy->p_params = p_params;
+  aci_energy_reset(p_energy);
+}
+
+void aci_energy_reset(aci_energy_t *p_energy)
+{
+#if HAL_ACI_TL_ACTIVE
+  hal_aci_tl_active_t active;
+#endif
+#if HAL_ACI_TL_STATS
+  hal_aci_tl_stats_t  stats;
+#endif
+
+  p_energy->last_us  = micros();
+  p_energy->awake.ms = 0;
+  p_energy->awake.us = 0;
+  p_energy->sleep.ms = 0;
+  p_energy->sleep.us = 0;
+  p_energy->sleeps   = 0;
+  p_energy->packets  = 0;
+#if HAL_ACI_TL_ACTIVE
+  hal_aci_tl_active_get(&active);
+  p_energy->events_base    = active.events;
+  p_energy->active_us_base = active.active_us;
+#endif
+#if HAL_ACI_TL_STATS
+  hal_aci_tl_stats_get(&stats);
+  p_energy->bytes_base = stats.bytes_out + stats.bytes_in;
+#endif
+}
+
+void aci_energy_event(aci_energy_t *p_energy, const aci_evt_t *p_evt)
+{
+  switch (p_evt->evt_opcode)
+  {
+    case ACI_EVT_DATA_CREDIT:
+      p_energy->packets += p_evt->params.data_credit.credit;
+      break;
+
+    case ACI_EVT_DATA_RECEIVED:
+      p_energy->packets++;
+      break;
+
+    default:
+      break;
+  }
+}
+
+bool aci_energy_idle(aci_energy_t *p_energy, uint8_t sleep_mode)
+{
+  uint32_t start_us;
+  uint32_t slept_us;
+#if (defined(__AVR__) && HAL_ACI_TL_ACTIVE)
+  hal_aci_tl_active_t active;
+  uint32_t            quiet_us;
+  uint32_t            events;
+#endif
+
+  awake_count(p_energy);
+#if (defined(__AVR__) && HAL_ACI_TL_ACTIVE)
+  quiet_us = hal_aci_tl_quiet_us();
+  hal_aci_tl_active_get(&active);
+  events = active.events;
+#endif
+
+  start_us = p_energy->last_us;
+  if (!lib_aci_idle(sleep_mode))
+  {
+    return false;
+  }
+  p_energy->last_us = micros();
+  slept_us = p_energy->last_us - start_us;
+
+#if defined(__AVR__)
+  if (SLEEP_MODE_IDLE != sleep_mode)
+  {
+    /* micros() has stopped, the sleep is estimated from the radio events */
+#if HAL_ACI_TL_ACTIVE
+    if (HAL_ACI_TL_QUIET_UNKNOWN != quiet_us)
+    {
+      slept_us += quiet_us + HAL_ACI_TL_ACTIVE_GUARD_US;
+      hal_aci_tl_active_get(&active);
+      if ((active.events - events) > 1)
+      {
+        slept_us += (active.events - events - 1) * active.period_us;
+      }
+    }
+    else
+#endif
+    {
+      slept_us += p_energy->p_params->stopped_sleep_us;
+    }
+  }
+#endif
+
+  time_add(&p_energy->sleep, slept_us);
+  p_energy->sleeps++;
+  return true;
+}
+
+void aci_energy_get(aci_energy_t *p_energy, aci_energy_report_t *p_report)
+{
+  const aci_energy_params_t *p_params = p_energy->p_params;
+  uint32_t                   charge_total_uc;
+  uint32_t                   radio_idle_ms;
+#if HAL_ACI_TL_ACTIVE
+  hal_aci_tl_active_t        active;
+#endif
+#if HAL_ACI_TL_STATS
+  hal_aci_tl_stats_t         stats;
+#endif
+
+  awake_count(p_energy);
+
+  p_report->awake_ms        = p_energy->awake.ms;
+  p_report->sleep_ms        = p_energy->sleep.ms;
+  p_report->elapsed_ms      = p_energy->awake.ms + p_energy->sleep.ms;
+  p_report->sleeps          = p_energy->sleeps;
+  p_report->packets         = p_energy->packets;
+  p_report->radio_active_ms = 0;
+  p_report->events          = 0;
+  p_report->bytes           = 0;
+#if HAL_ACI_TL_ACTIVE
+  hal_aci_tl_active_get(&active);
+  p_report->radio_active_ms = (active.active_us - p_energy->active_us_base) / 1000;
+  p_report->events          = active.events - p_energy->events_base;
+  if (p_report->radio_active_ms > p_report->elapsed_ms)
+  {
+    p_report->radio_active_ms = p_report->elapsed_ms;
+  }
+#endif
+#if HAL_ACI_TL_STATS
+  hal_aci_tl_stats_get(&stats);
+  p_report->bytes = (stats.bytes_out + stats.bytes_in) - p_energy->bytes_base;
+#endif
+
+  radio_idle_ms      = p_report->elapsed_ms - p_report->radio_active_ms;
+  p_report->mcu_uc   = charge_uc(p_params->mcu_active_ua, p_report->awake_ms) +
+                       charge_uc(p_params->mcu_sleep_ua, p_report->sleep_ms);
+  p_report->radio_uc = charge_uc(p_params->radio_active_ua, p_report->radio_active_ms) +
+                       charge_uc(p_params->radio_idle_ua, radio_idle_ms);
+
+  charge_total_uc         = p_report->mcu_uc + p_report->radio_uc;
+  p_report->average_ua    = (0 == p_report->elapsed_ms) ? 0 : per_thousand(charge_total_uc, p_report->elapsed_ms);
+  p_report->nc_per_byte   = (0 == p_report->bytes)      ? 0 : per_thousand(charge_total_uc, p_report->bytes);
+  p_report->nc_per_packet = (0 == p_report->packets)    ? 0 : per_thousand(charge_total_uc, p_report->packets);
+  p_report->nc_per_event  = (0 == p_report->events)     ? 0 : per_thousand(charge_total_uc, p_report->events);
+}
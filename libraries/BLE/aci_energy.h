@@ -0,0 +1,155 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/** @file
+ * @brief Estimated charge of the MCU and the nRF8001, per byte and per connection event.
+ */
+
+/** @defgroup aci_energy aci_energy
+@{
+@ingroup lib
+
+@brief Meters the time the MCU is awake and asleep and the time the radio of the nRF8001 is
+active, and turns them into the charge drawn, with a current per state given in
+aci_energy_params_t. The charge is then divided by the bytes of the transport and by the
+connection events.
+@details The sources of the meter:
+ - MCU awake and asleep: the sleeps of aci_energy_idle(), which calls lib_aci_idle().
+ - Radio active and connection events: the ACTIVE pulses of hal_aci_tl_active_get(),
+   HAL_ACI_TL_ACTIVE. Without it the radio is counted idle and there are no events.
+ - Bytes: bytes_out and bytes_in of hal_aci_tl_stats_get(), HAL_ACI_TL_STATS, the ACI bytes
+   over the SPI. Without it there are no bytes.
+ - Packets: the data packets sent, from the credits given back, and received, from the events
+   given to aci_energy_event().
+The meter takes the counters of the transport as they are at aci_energy_reset() as its start, it
+does not clear them.
+
+micros() stops in the sleep modes of the AVR that stop the I/O clock, all but SLEEP_MODE_IDLE.
+Such a sleep is estimated from the ACTIVE pulses, to the next radio event and a period for each
+radio event seen during the sleep, or is counted as aci_energy_params_t::stopped_sleep_us when the
+period is not known. The currents are those of the datasheets, measure the board to get figures
+closer than some ten percent.
+
+Call aci_energy_event() with every ACI event and aci_energy_idle() in place of lib_aci_idle(),
+read the figures with aci_energy_get().
+*/
+
+#ifndef ACI_ENERGY_H__
+#define ACI_ENERGY_H__
+
+#include <lib_aci.h>
+
+/** Currents of an ATmega328 at 16 MHz and 5 V and of the nRF8001, in uA */
+#define ACI_ENERGY_MCU_ACTIVE_UA    9000
+#define ACI_ENERGY_MCU_SLEEP_UA     5
+#define ACI_ENERGY_RADIO_ACTIVE_UA  11000
+#define ACI_ENERGY_RADIO_IDLE_UA    2
+
+/** Initializer of aci_energy_params_t with the currents above */
+#define ACI_ENERGY_PARAMS_DEFAULT  \
+{                                  \
+  ACI_ENERGY_MCU_ACTIVE_UA,        \
+  ACI_ENERGY_MCU_SLEEP_UA,         \
+  ACI_ENERGY_RADIO_ACTIVE_UA,      \
+  ACI_ENERGY_RADIO_IDLE_UA,        \
+  0,                               \
+}
+
+typedef struct
+{
+  uint16_t mcu_active_ua;          /**< MCU awake */
+  uint16_t mcu_sleep_ua;           /**< MCU in the sleep mode given to aci_energy_idle() */
+  uint16_t radio_active_ua;        /**< ACTIVE high, average of the radio event */
+  uint16_t radio_idle_ua;          /**< ACTIVE low */
+  uint32_t stopped_sleep_us;       /**< A sleep with micros() stopped and no ACTIVE period, 0 leaves it out */
+} aci_energy_params_t;
+
+/** Figures since aci_energy_reset(), from aci_energy_get() */
+typedef struct
+{
+  uint32_t elapsed_ms;             /**< Awake and asleep */
+  uint32_t awake_ms;
+  uint32_t sleep_ms;
+  uint32_t radio_active_ms;
+  uint32_t sleeps;                 /**< Calls of aci_energy_idle() that slept */
+  uint32_t events;                 /**< Radio events, connection or advertising events */
+  uint32_t bytes;                  /**< ACI bytes out and in */
+  uint32_t packets;                /**< Data packets sent and received */
+  uint32_t mcu_uc;                 /**< Charge drawn by the MCU, uC */
+  uint32_t radio_uc;               /**< Charge drawn by the nRF8001, uC */
+  uint32_t average_ua;             /**< (mcu_uc + radio_uc) / elapsed_ms */
+  uint32_t nc_per_byte;            /**< (mcu_uc + radio_uc) / bytes, in nC, 0 without bytes */
+  uint32_t nc_per_packet;          /**< (mcu_uc + radio_uc) / packets, in nC, 0 without packets */
+  uint32_t nc_per_event;           /**< (mcu_uc + radio_uc) / events, in nC, 0 without events */
+} aci_energy_report_t;
+
+/** A time kept in ms and the us below a ms */
+typedef struct
+{
+  uint32_t ms;
+  uint16_t us;
+} aci_energy_time_t;
+
+/** State of the meter */
+typedef struct
+{
+  const aci_energy_params_t *p_params;
+  uint32_t                   last_us;        /**< micros() when the awake time was last counted */
+  aci_energy_time_t          awake;
+  aci_energy_time_t          sleep;
+  uint32_t                   sleeps;
+  uint32_t                   packets;
+#if HAL_ACI_TL_ACTIVE
+  uint32_t                   events_base;    /**< hal_aci_tl_active_t at aci_energy_reset() */
+  uint32_t                   active_us_base;
+#endif
+#if HAL_ACI_TL_STATS
+  uint32_t                   bytes_base;     /**< bytes_out + bytes_in at aci_energy_reset() */
+#endif
+} aci_energy_t;
+
+/** @brief Initializes the meter and starts it.
+ *  @param p_energy state of the meter.
+ *  @param p_params currents, must stay valid while the meter is used.
+ */
+void aci_energy_init(aci_energy_t *p_energy, const aci_energy_params_t *p_params);
+
+/** @brief Starts the meter again from now.
+ */
+void aci_energy_reset(aci_energy_t *p_energy);
+
+/** @brief Gives an ACI event to the meter, call it for every event taken from lib_aci_event_get().
+ *  @details The packets are counted from the DataCredit and DataReceived events.
+ */
+void aci_energy_event(aci_energy_t *p_energy, const aci_evt_t *p_evt);
+
+/** @brief Sleeps with lib_aci_idle() and counts the sleep.
+ *  @return True if the MCU has been sleeping, false if there was work pending.
+ */
+bool aci_energy_idle(aci_energy_t *p_energy, uint8_t sleep_mode);
+
+/** @brief Counts the time awake up to now and gets the figures since aci_energy_reset().
+ */
+void aci_energy_get(aci_energy_t *p_energy, aci_energy_report_t *p_report);
+
+#endif // ACI_ENERGY_H__
+/** @} */
@@ -31,6 +31,7 @@
 #define ACI_EVTS_H__
 
 #include "aci.h"
+#include "aci_protocol_defines.h"
 
 /**
  * @enum aci_evt_opcode_t
@@ -394,4 +395,78 @@ typedef struct
 
 ACI_ASSERT_SIZE(aci_evt_t, 33);
 
+/**
+ * @def ACI_EVT_VIEW
+ * @brief Reads an event in place, e.g. in the slot returned by lib_aci_event_peek_ptr(),
+ * through one of the overlay views below. Check evt_opcode before picking the view.
+ */
+#define ACI_EVT_VIEW(view_type, p_aci_evt) ((const view_type *)(const void *)(p_aci_evt))
+
+/**
+ * @struct aci_evt_data_received_view_t
+ * @brief  Overlay of a whole ACI_EVT_DATA_RECEIVED message
+ */
+typedef struct
+{
+  uint8_t len;
+  aci_evt_opcode_t evt_opcode;
+  uint8_t pipe_number;
+  uint8_t data[ACI_PIPE_RX_DATA_MAX_LEN];
+} _aci_packed_ aci_evt_data_received_view_t;
+
+ACI_ASSERT_OFFSET(aci_evt_data_received_view_t, pipe_number, OFFSET_ACI_EVT_T_DATA_RECEIVED + OFFSET_ACI_EVT_PARAMS_DATA_RECEIVED_T_RX_DATA);
+ACI_ASSERT_OFFSET(aci_evt_data_received_view_t, data, OFFSET_ACI_EVT_T_DATA_RECEIVED + OFFSET_ACI_EVT_PARAMS_DATA_RECEIVED_T_RX_DATA + 1);
+ACI_ASSERT_SIZE(aci_evt_data_received_view_t, 3 + ACI_PIPE_RX_DATA_MAX_LEN);
+
+/**
+ * @struct aci_evt_data_credit_view_t
+ * @brief  Overlay of a whole ACI_EVT_DATA_CREDIT message
+ */
+typedef struct
+{
+  uint8_t len;
+  aci_evt_opcode_t evt_opcode;
+  uint8_t credit;
+} _aci_packed_ aci_evt_data_credit_view_t;
+
+ACI_ASSERT_OFFSET(aci_evt_data_credit_view_t, credit, OFFSET_ACI_EVT_T_DATA_CREDIT + OFFSET_ACI_EVT_PARAMS_DATA_CREDIT_T_CREDIT);
+ACI_ASSERT_SIZE(aci_evt_data_credit_view_t, 3);
+
+/**
+ * @struct aci_evt_cmd_rsp_view_t
+ * @brief  Overlay of a whole ACI_EVT_CMD_RSP message, data holds the command specific parameters
+ */
+typedef struct
+{
+  uint8_t len;
+  aci_evt_opcode_t evt_opcode;
+  aci_cmd_opcode_t cmd_opcode;
+  aci_status_code_t cmd_status;
+  uint8_t data[ACI_PACKET_MAX_LEN - 4];
+} _aci_packed_ aci_evt_cmd_rsp_view_t;
+
+ACI_ASSERT_OFFSET(aci_evt_cmd_rsp_view_t, cmd_opcode, OFFSET_ACI_EVT_T_CMD_RSP + OFFSET_ACI_EVT_PARAMS_CMD_RSP_T_CMD_OPCODE);
+ACI_ASSERT_OFFSET(aci_evt_cmd_rsp_view_t, cmd_status, OFFSET_ACI_EVT_T_CMD_RSP + OFFSET_ACI_EVT_PARAMS_CMD_RSP_T_CMD_STATUS);
+ACI_ASSERT_OFFSET(aci_evt_cmd_rsp_view_t, data, OFFSET_ACI_EVT_T_CMD_RSP + OFFSET_ACI_EVT_PARAMS_CMD_RSP_T_CMD_STATUS + 1);
+ACI_ASSERT_SIZE(aci_evt_cmd_rsp_view_t, ACI_PACKET_MAX_LEN);
+
+/**
+ * @struct aci_evt_pipe_status_view_t
+ * @brief  Overlay of a whole ACI_EVT_PIPE_STATUS message
+ */
+typedef struct
+{
+  uint8_t len;
+  aci_evt_opcode_t evt_opcode;
+  uint8_t pipes_open_bitmap[8];
+  uint8_t pipes_closed_bitmap[8];
+} _aci_packed_ aci_evt_pipe_status_view_t;
+
+ACI_ASSERT_OFFSET(aci_evt_pipe_status_view_t, pipes_open_bitmap, OFFSET_ACI_EVT_T_PIPE_STATUS + OFFSET_ACI_EVT_PARAMS_PIPE_STATUS_T_PIPES_OPEN_BITMAP);
+ACI_ASSERT_OFFSET(aci_evt_pipe_status_view_t, pipes_closed_bitmap, OFFSET_ACI_EVT_T_PIPE_STATUS + OFFSET_ACI_EVT_PARAMS_PIPE_STATUS_T_PIPES_CLOSED_BITMAP);
+ACI_ASSERT_SIZE(aci_evt_pipe_status_view_t, 18);
+
+/* The overlays of aci_evt_t itself are at the same offsets */
+ACI_ASSERT_OFFSET(aci_evt_t, params, OFFSET_ACI_EVT_T_CMD_RSP);
+
 #endif // ACI_EVTS_H__
@@ -0,0 +1,279 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+@brief Implementation of the framing of long messages over the UART over BLE pipes
+*/
+
+#include <lib_aci.h>
+#include "aci_crc.h"
+#include "aci_frame.h"
+
+/* Header byte, then the length in the first packet */
+#define FIRST_HEADER_LENGTH  3
+#define NEXT_HEADER_LENGTH   1
+
+static uint16_t tx_total(const aci_frame_t *p_frame)
+{
+  return p_frame->tx_length + (p_frame->p_params->crc ? 2 : 0);
+}
+
+static uint16_t rx_total(const aci_frame_t *p_frame)
+{
+  return p_frame->rx_length + (p_frame->rx_has_crc ? 2 : 0);
+}
+
+/*
+  Starts a message from its first packet, the rest of a message still being received is lost.
+  Returns the offset of the message bytes in the packet, 0 when the message is dropped.
+*/
+static uint8_t rx_start(aci_frame_t *p_frame, const uint8_t *p_packet, uint8_t length)
+{
+  uint16_t raw_length;
+
+  if (p_frame->rx_active)
+  {
+    p_frame->stats.sequence_errors++;
+    p_frame->rx_active = false;
+  }
+
+  if (p_frame->rx_complete)
+  {
+    p_frame->stats.overruns++;
+    return 0;
+  }
+
+  if (length < FIRST_HEADER_LENGTH)
+  {
+    p_frame->stats.sequence_errors++;
+    return 0;
+  }
+
+  raw_length            = (uint16_t)p_packet[1] | ((uint16_t)p_packet[2] << 8);
+  p_frame->rx_has_crc   = (0 != (raw_length & ACI_FRAME_LENGTH_CRC));
+  p_frame->rx_length    = raw_length & ACI_FRAME_MAX_LENGTH;
+  if (p_frame->rx_length > p_frame->rx_size)
+  {
+    p_frame->stats.too_long++;
+    return 0;
+  }
+  if (0 == p_frame->rx_length)
+  {
+    return 0;
+  }
+
+  p_frame->rx_pos    = 0;
+  p_frame->rx_crc    = ACI_CRC16_CCITT_INIT;
+  p_frame->rx_seq    = (uint8_t)(p_packet[0] + 1) & ACI_FRAME_SEQ_MASK;
+  p_frame->rx_active = true;
+  return FIRST_HEADER_LENGTH;
+}
+
+static void rx_packet(aci_frame_t *p_frame, const uint8_t *p_packet, uint8_t length)
+{
+  uint16_t total;
+  uint8_t  i;
+
+  p_frame->stats.packets_received++;
+
+  if (0 != (p_packet[0] & ACI_FRAME_START))
+  {
+    i = rx_start(p_frame, p_packet, length);
+    if (0 == i)
+    {
+      return;
+    }
+  }
+  else
+  {
+    if (!p_frame->rx_active)
+    {
+      // The rest of a message that was dropped
+      return;
+    }
+    if ((p_packet[0] & ACI_FRAME_SEQ_MASK) != p_frame->rx_seq)
+    {
+      p_frame->stats.sequence_errors++;
+      p_frame->rx_active = false;
+      return;
+    }
+    p_frame->rx_seq = (p_frame->rx_seq + 1) & ACI_FRAME_SEQ_MASK;
+    i = NEXT_HEADER_LENGTH;
+  }
+
+  total = rx_total(p_frame);
+  for (; (i < length) && (p_frame->rx_pos < total); i++, p_frame->rx_pos++)
+  {
+    if (p_frame->rx_pos < p_frame->rx_length)
+    {
+      p_frame->p_rx[p_frame->rx_pos] = p_packet[i];
+      p_frame->rx_crc = aci_crc16_ccitt_update(p_frame->rx_crc, p_packet[i]);
+    }
+    else
+    {
+      p_frame->rx_crc_received[p_frame->rx_pos - p_frame->rx_length] = p_packet[i];
+    }
+  }
+
+  if (p_frame->rx_pos < total)
+  {
+    return;
+  }
+
+  p_frame->rx_active = false;
+  if (p_frame->rx_has_crc &&
+      (p_frame->rx_crc != (((uint16_t)p_frame->rx_crc_received[0] << 8) | p_frame->rx_crc_received[1])))
+  {
+    p_frame->stats.crc_errors++;
+    return;
+  }
+  p_frame->rx_complete = true;
+  p_frame->stats.messages_received++;
+}
+
+void aci_frame_init(aci_frame_t *p_frame, const aci_frame_params_t *p_params, uint8_t *p_rx, uint16_t rx_size)
+{
+  memset(p_frame, 0, sizeof(*p_frame));
+  p_frame->p_params = p_params;
+  p_frame->p_rx     = p_rx;
+  p_frame->rx_size  = rx_size;
+}
+
+void aci_frame_event(aci_frame_t *p_frame, aci_state_t *aci_stat, const aci_evt_t *p_evt)
+{
+  uint8_t length;
+
+  (void)aci_stat;
+
+  switch (p_evt->evt_opcode)
+  {
+    case ACI_EVT_DATA_RECEIVED:
+      length = p_evt->len - 2;
+      if ((p_evt->params.data_received.rx_data.pipe_number == p_frame->p_params->rx_pipe) &&
+          (0 != length))
+      {
+        rx_packet(p_frame, &p_evt->params.data_received.rx_data.aci_data[0], length);
+      }
+      break;
+
+    case ACI_EVT_DISCONNECTED:
+      // A message cut short is not finished with the next peer, one received complete is kept
+      p_frame->p_tx      = NULL;
+      p_frame->rx_active = false;
+      break;
+
+    default:
+      break;
+  }
+}
+
+void aci_frame_poll(aci_frame_t *p_frame, aci_state_t *aci_stat)
+{
+  uint8_t  packet[ACI_PIPE_TX_DATA_MAX_LEN];
+  uint16_t total;
+  uint16_t pos;
+  uint8_t  length;
+
+  lib_aci_select(aci_stat);
+
+  while ((NULL != p_frame->p_tx) &&
+         (0 != aci_stat->data_credit_available) &&
+         lib_aci_is_pipe_available(aci_stat, p_frame->p_params->tx_pipe))
+  {
+    pos    = p_frame->tx_pos;
+    total  = tx_total(p_frame);
+    packet[0] = p_frame->tx_seq & ACI_FRAME_SEQ_MASK;
+    length = NEXT_HEADER_LENGTH;
+    if (0 == pos)
+    {
+      packet[0] |= ACI_FRAME_START;
+      packet[1]  = (uint8_t)p_frame->tx_length;
+      packet[2]  = (uint8_t)((p_frame->tx_length | (p_frame->p_params->crc ? ACI_FRAME_LENGTH_CRC : 0)) >> 8);
+      length     = FIRST_HEADER_LENGTH;
+    }
+
+    for (; (length < ACI_PIPE_TX_DATA_MAX_LEN) && (pos < total); length++, pos++)
+    {
+      if (pos < p_frame->tx_length)
+      {
+        packet[length] = p_frame->p_tx[pos];
+      }
+      else if (pos == p_frame->tx_length)
+      {
+        packet[length] = (uint8_t)(p_frame->tx_crc >> 8);
+      }
+      else
+      {
+        packet[length] = (uint8_t)p_frame->tx_crc;
+      }
+    }
+
+    if (!lib_aci_send_data(p_frame->p_params->tx_pipe, &packet[0], length))
+    {
+      break;
+    }
+
+    p_frame->tx_pos = pos;
+    p_frame->tx_seq++;
+    p_frame->stats.packets_sent++;
+    if (pos == total)
+    {
+      p_frame->p_tx = NULL;
+      p_frame->stats.messages_sent++;
+    }
+  }
+}
+
+bool aci_frame_send(aci_frame_t *p_frame, const uint8_t *p_msg, uint16_t length)
+{
+  if ((NULL != p_frame->p_tx) || (0 == length) || (length > ACI_FRAME_MAX_LENGTH))
+  {
+    return false;
+  }
+
+  p_frame->tx_length = length;
+  p_frame->tx_pos    = 0;
+  p_frame->tx_crc    = p_frame->p_params->crc ? aci_crc16_ccitt(ACI_CRC16_CCITT_INIT, p_msg, length) : 0;
+  p_frame->p_tx      = p_msg;
+  return true;
+}
+
+bool aci_frame_tx_busy(const aci_frame_t *p_frame)
+{
+  return (NULL != p_frame->p_tx);
+}
+
+uint16_t aci_frame_received(const aci_frame_t *p_frame)
+{
+  return p_frame->rx_complete ? p_frame->rx_length : 0;
+}
+
+void aci_frame_release(aci_frame_t *p_frame)
+{
+  p_frame->rx_complete = false;
+}
+
+void aci_frame_stats_get(const aci_frame_t *p_frame, aci_frame_stats_t *p_stats)
+{
+  *p_stats = p_frame->stats;
+}
@@ -0,0 +1,152 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/** @file
+ * @brief Messages longer than a packet over the pipes of the UART over BLE service.
+ */
+
+/** @defgroup aci_frame aci_frame
+@{
+@ingroup lib
+
+@brief Cuts messages of up to ACI_FRAME_MAX_LENGTH bytes into the 20 byte packets of the UART TX pipe,
+and puts the packets of the UART RX pipe back together into a buffer of the sketch.
+@details Every packet starts with a header byte, ACI_FRAME_START for the first packet of a message
+and a sequence number in the low 7 bits, one more for every packet sent. The first packet then holds
+the length of the message, LSB first, ACI_FRAME_LENGTH_CRC set when the message is followed by its
+CRC-16-CCITT (aci_crc.h), MSB first. The rest of the packets are filled up with the message and the
+CRC, only the last one is shorter:
+@code
+  first : [ACI_FRAME_START | seq] [length LSB] [length MSB | crc flag] [17 bytes of the message]
+  next  : [seq + 1]               [19 bytes of the message ... CRC MSB, CRC LSB]
+@endcode
+A 200 byte message takes 11 packets, 12 with the CRC.
+
+aci_frame_send() takes the message without a copy, it must stay as it is until aci_frame_tx_busy()
+is false. aci_frame_poll() sends as many packets as there are data credits for, so the packets of a
+message fill the connection events the same way the packets of a stream do.
+
+The packets received go straight into the rx buffer given to aci_frame_init(). Once a message is
+complete, aci_frame_received() returns its length until aci_frame_release(), the packets of a new
+message are dropped meanwhile. A packet out of sequence, a message longer than the buffer or a CRC
+that does not match drops the message, the next first packet starts over.
+
+Call aci_frame_event() with every ACI event and aci_frame_poll() from the loop.
+*/
+
+#ifndef ACI_FRAME_H__
+#define ACI_FRAME_H__
+
+#include <lib_aci.h>
+
+/** First packet of a message, in the header byte */
+#define ACI_FRAME_START       0x80
+/** Sequence number of a packet, in the header byte */
+#define ACI_FRAME_SEQ_MASK    0x7F
+/** The message is followed by its CRC, in the length */
+#define ACI_FRAME_LENGTH_CRC  0x8000
+
+/** Longest message, the length has 15 bits */
+#define ACI_FRAME_MAX_LENGTH  0x7FFF
+
+typedef struct
+{
+  uint8_t tx_pipe;                 /**< UART TX, to the peer */
+  uint8_t rx_pipe;                 /**< UART RX, from the peer */
+  bool    crc;                     /**< The messages sent are followed by their CRC */
+} aci_frame_params_t;
+
+typedef struct
+{
+  uint16_t messages_sent;
+  uint16_t packets_sent;
+  uint16_t messages_received;
+  uint16_t packets_received;
+  uint16_t sequence_errors;        /**< Messages dropped for a missing packet */
+  uint16_t too_long;               /**< Messages dropped for not fitting in the rx buffer */
+  uint16_t crc_errors;             /**< Messages dropped for a CRC that does not match */
+  uint16_t overruns;               /**< Messages dropped while one was not released */
+} aci_frame_stats_t;
+
+/** State of the framing, one per nRF8001 */
+typedef struct
+{
+  const aci_frame_params_t *p_params;
+  const uint8_t    *p_tx;          /**< Message being sent, NULL when none */
+  uint16_t          tx_length;
+  uint16_t          tx_pos;        /**< Bytes of the message and the CRC sent */
+  uint16_t          tx_crc;
+  uint8_t           tx_seq;
+  uint8_t          *p_rx;
+  uint16_t          rx_size;
+  uint16_t          rx_length;     /**< Length of the message being received, CRC excluded */
+  uint16_t          rx_pos;        /**< Bytes of the message and the CRC received */
+  uint16_t          rx_crc;
+  uint8_t           rx_crc_received[2];
+  uint8_t           rx_seq;        /**< Sequence number of the next packet */
+  bool              rx_active;     /**< A message is being received */
+  bool              rx_has_crc;
+  bool              rx_complete;   /**< A message waits for aci_frame_release() */
+  aci_frame_stats_t stats;
+} aci_frame_t;
+
+/** @brief Initializes the framing.
+ *  @param p_frame state of the framing.
+ *  @param p_params pipes and CRC, must stay valid while the framing is used.
+ *  @param p_rx buffer the messages received are put together in.
+ *  @param rx_size size of p_rx, the longest message that can be received.
+ */
+void aci_frame_init(aci_frame_t *p_frame, const aci_frame_params_t *p_params, uint8_t *p_rx, uint16_t rx_size);
+
+/** @brief Gives an ACI event to the framing, call it for every event taken from lib_aci_event_get().
+ */
+void aci_frame_event(aci_frame_t *p_frame, aci_state_t *aci_stat, const aci_evt_t *p_evt);
+
+/** @brief Sends the packets there are data credits for, call it from the loop.
+ */
+void aci_frame_poll(aci_frame_t *p_frame, aci_state_t *aci_stat);
+
+/** @brief Starts sending a message.
+ *  @param p_msg message, kept by the framing until aci_frame_tx_busy() is false.
+ *  @param length 1 to ACI_FRAME_MAX_LENGTH bytes.
+ *  @return False if a message is still being sent or the length is out of range.
+ */
+bool aci_frame_send(aci_frame_t *p_frame, const uint8_t *p_msg, uint16_t length);
+
+/** @brief True while the packets of a message are still to be sent.
+ */
+bool aci_frame_tx_busy(const aci_frame_t *p_frame);
+
+/** @brief Length of the complete message in the rx buffer.
+ *  @return 0 if there is none.
+ */
+uint16_t aci_frame_received(const aci_frame_t *p_frame);
+
+/** @brief Gives the rx buffer back for the next message.
+ */
+void aci_frame_release(aci_frame_t *p_frame);
+
+/** @brief Gets the counters since aci_frame_init().
+ */
+void aci_frame_stats_get(const aci_frame_t *p_frame, aci_frame_stats_t *p_stats);
+
+#endif // ACI_FRAME_H__
+/** @} */
@@ -0,0 +1,303 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+@brief Implementation of the raw ACI gateway over a serial port
+*/
+
+#include <lib_aci.h>
+#include "aci_gateway.h"
+#include "aci_crc.h"
+
+#define CMD_MASK  (ACI_GATEWAY_CMD_SLOTS - 1)
+
+/* The frames to the PC are shorter than a COBS block, see frame_write() */
+#if (ACI_GATEWAY_FRAME_MAX > 254)
+#error "ACI_GATEWAY_FRAME_MAX must fit in a COBS block"
+#endif
+
+static uint8_t cmd_count(const aci_gateway_t *p_gw)
+{
+  return (uint8_t)(p_gw->head - p_gw->tail);
+}
+
+static void rx_frame_start(aci_gateway_t *p_gw)
+{
+  p_gw->cobs_code     = 0;
+  p_gw->cobs_left     = 0;
+  p_gw->held_count    = 0;
+  p_gw->crc           = ACI_CRC16_CCITT_INIT;
+  p_gw->packet_pos    = 0;
+  p_gw->frame_packets = 0;
+  p_gw->frame_bad     = false;
+}
+
+/*
+  A byte of the frame from the PC that is not the CRC: adds it to the CRC and to the command
+  being received, in the slot after the commands of the frame so far.
+*/
+static void rx_frame_byte(aci_gateway_t *p_gw, uint8_t byte)
+{
+  hal_aci_data_t *p_cmd = &p_gw->cmds[(uint8_t)(p_gw->head + p_gw->frame_packets) & CMD_MASK];
+
+  p_gw->crc = aci_crc16_ccitt_update(p_gw->crc, byte);
+  if (p_gw->frame_bad)
+  {
+    return;
+  }
+
+  if (0 == p_gw->packet_pos)
+  {
+    if ((0 == byte) || (byte > HAL_ACI_MAX_LENGTH))
+    {
+      p_gw->stats.framing_errors++;
+      p_gw->frame_bad = true;
+      return;
+    }
+    if ((cmd_count(p_gw) + p_gw->frame_packets) >= ACI_GATEWAY_CMD_SLOTS)
+    {
+      p_gw->stats.overruns++;
+      p_gw->frame_bad = true;
+      return;
+    }
+  }
+
+  p_cmd->buffer[p_gw->packet_pos++] = byte;
+  if (p_gw->packet_pos > p_cmd->buffer[0])
+  {
+    p_gw->packet_pos = 0;
+    p_gw->frame_packets++;
+  }
+}
+
+/*
+  A decoded byte, held back until two more come as the last two bytes are the CRC.
+*/
+static void rx_decoded(aci_gateway_t *p_gw, uint8_t byte)
+{
+  if (p_gw->held_count < 2)
+  {
+    p_gw->held[p_gw->held_count++] = byte;
+    return;
+  }
+  rx_frame_byte(p_gw, p_gw->held[0]);
+  p_gw->held[0] = p_gw->held[1];
+  p_gw->held[1] = byte;
+}
+
+/*
+  The 0x00 at the end of a frame: the commands are queued when the frame is whole and its CRC
+  matches. Several 0x00 in a row are not frames.
+*/
+static void rx_frame_end(aci_gateway_t *p_gw)
+{
+  const uint16_t crc = (uint16_t)(((uint16_t)p_gw->held[0] << 8) | p_gw->held[1]);
+
+  if (p_gw->frame_bad || ((0 == p_gw->cobs_code) && (0 == p_gw->held_count)))
+  {
+    /* Already counted, or no frame */
+  }
+  else if ((0 != p_gw->cobs_left) || (p_gw->held_count < 2) || (0 != p_gw->packet_pos))
+  {
+    p_gw->stats.framing_errors++;
+  }
+  else if (crc != p_gw->crc)
+  {
+    p_gw->stats.crc_errors++;
+  }
+  else
+  {
+    p_gw->stats.frames_received++;
+    if (0 == p_gw->frame_packets)
+    {
+      p_gw->grant_reset = true;
+    }
+    p_gw->head = (uint8_t)(p_gw->head + p_gw->frame_packets);
+  }
+
+  rx_frame_start(p_gw);
+}
+
+/*
+  COBS encodes the frame to the serial port. The frame is shorter than 254 bytes, so a code byte
+  is the distance to the next zero, or to the end of the frame, plus one.
+*/
+static void frame_write(aci_gateway_t *p_gw, uint8_t length)
+{
+  const aci_gateway_params_t *p_params = p_gw->p_params;
+  uint8_t start = 0;
+  uint8_t code;
+  uint8_t i;
+
+  for (i = 0; i <= length; i++)
+  {
+    if ((i == length) || (0 == p_gw->frame[i]))
+    {
+      code = (uint8_t)(i - start + 1);
+      p_params->p_write(&code, 1);
+      if (i != start)
+      {
+        p_params->p_write(&p_gw->frame[start], (uint8_t)(i - start));
+      }
+      start = (uint8_t)(i + 1);
+    }
+  }
+
+  code = 0;
+  p_params->p_write(&code, 1);
+}
+
+/*
+  The oldest event to send, from the data event queue once the other events are sent.
+*/
+static const hal_aci_data_t *event_peek(bool *p_is_data)
+{
+  const hal_aci_data_t *p_evt = hal_aci_tl_event_peek_ptr();
+
+  *p_is_data = false;
+#if ACI_RX_DATA_QUEUE_BYTES
+  if (NULL == p_evt)
+  {
+    p_evt      = hal_aci_tl_data_peek_ptr();
+    *p_is_data = true;
+  }
+#endif
+  return p_evt;
+}
+
+static void event_release(bool is_data)
+{
+#if ACI_RX_DATA_QUEUE_BYTES
+  if (is_data)
+  {
+    hal_aci_tl_data_release();
+    return;
+  }
+#else
+  (void)is_data;
+#endif
+  hal_aci_tl_event_release();
+}
+
+void aci_gateway_init(aci_gateway_t *p_gw, const aci_gateway_params_t *p_params)
+{
+  memset(p_gw, 0, sizeof(*p_gw));
+  p_gw->p_params    = p_params;
+  p_gw->grant_reset = true;
+  rx_frame_start(p_gw);
+}
+
+void aci_gateway_put(aci_gateway_t *p_gw, uint8_t byte)
+{
+  if (0 == byte)
+  {
+    rx_frame_end(p_gw);
+    return;
+  }
+
+  if (0 != p_gw->cobs_left)
+  {
+    rx_decoded(p_gw, byte);
+    p_gw->cobs_left--;
+    return;
+  }
+
+  /* A code byte, the block before it ended with a zero unless it was a full block */
+  if ((0 != p_gw->cobs_code) && (0xFF != p_gw->cobs_code))
+  {
+    rx_decoded(p_gw, 0);
+  }
+  p_gw->cobs_code = byte;
+  p_gw->cobs_left = (uint8_t)(byte - 1);
+}
+
+void aci_gateway_poll(aci_gateway_t *p_gw)
+{
+  const aci_gateway_params_t *p_params = p_gw->p_params;
+  const hal_aci_data_t *p_evt;
+  uint8_t  length = 1;
+  uint8_t  count = 0;
+  uint16_t crc;
+  bool     is_data;
+  int      room;
+
+  while (0 != cmd_count(p_gw))
+  {
+    if (!hal_aci_tl_send(&p_gw->cmds[p_gw->tail & CMD_MASK]))
+    {
+      break;
+    }
+    p_gw->tail++;
+    p_gw->grant++;
+    p_gw->stats.commands++;
+  }
+
+  /* The frame goes out with its CRC, its first COBS code byte and the 0x00 */
+  room = (NULL == p_params->p_write_room) ? ACI_GATEWAY_WIRE_MAX : p_params->p_write_room();
+  if (room < (1 + 4))
+  {
+    return;
+  }
+
+  while (count < ACI_GATEWAY_EVTS_PER_FRAME)
+  {
+    p_evt = event_peek(&is_data);
+    if ((NULL == p_evt) || ((length + p_evt->buffer[0] + 1 + 4) > room))
+    {
+      break;
+    }
+    memcpy(&p_gw->frame[length], &p_evt->buffer[0], p_evt->buffer[0] + 1);
+    length = (uint8_t)(length + p_evt->buffer[0] + 1);
+    event_release(is_data);
+    count++;
+  }
+
+  if ((0 == count) && (0 == p_gw->grant) && !p_gw->grant_reset)
+  {
+    return;
+  }
+
+  if (p_gw->grant_reset)
+  {
+    p_gw->frame[0] = (uint8_t)(ACI_GATEWAY_GRANT_RESET | (ACI_GATEWAY_CMD_SLOTS - cmd_count(p_gw)));
+  }
+  else
+  {
+    p_gw->frame[0] = p_gw->grant;
+  }
+  p_gw->grant       = 0;
+  p_gw->grant_reset = false;
+
+  crc = aci_crc16_ccitt(ACI_CRC16_CCITT_INIT, &p_gw->frame[0], length);
+  p_gw->frame[length++] = (uint8_t)(crc >> 8);
+  p_gw->frame[length++] = (uint8_t)crc;
+  frame_write(p_gw, length);
+
+  p_gw->stats.frames_sent++;
+  p_gw->stats.events += count;
+}
+
+void aci_gateway_stats_get(const aci_gateway_t *p_gw, aci_gateway_stats_t *p_stats)
+{
+  *p_stats = p_gw->stats;
+}
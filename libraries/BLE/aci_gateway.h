@@ -0,0 +1,161 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/** @file
+ * @brief Raw ACI commands and events over a serial port, for a PC that drives the nRF8001.
+ */
+
+/** @defgroup aci_gateway aci_gateway
+@{
+@ingroup lib
+
+@brief Carries the ACI packets of the nRF8001 to and from a PC over the serial port, in COBS
+framed batches, so a test rig or a PC gateway drives the radio at the rate of the link.
+@details A packet is the buffer of a ::hal_aci_data_t, its length then the opcode and parameters
+as on the SPI. A frame is a batch of packets followed by their CRC-16-CCITT (aci_crc.h), MSB first,
+COBS encoded and ended by a 0x00 byte:
+@code
+  PC to gateway : [packet] [packet] ... [CRC MSB] [CRC LSB]                 commands
+  gateway to PC : [grant]  [packet] [packet] ... [CRC MSB] [CRC LSB]        events
+@endcode
+COBS replaces the zero bytes of the frame so that 0x00 only ends a frame: a receiver that starts
+in the middle of a frame, or loses a byte, is in step again at the next 0x00. A frame sent to the
+PC holds up to ACI_GATEWAY_EVTS_PER_FRAME events.
+
+The commands are flow controlled by credits: the PC may have ACI_GATEWAY_CMD_SLOTS commands in
+the gateway, and the grant byte of each frame gives back the number of commands that have been
+moved to the command queue of the transport since the frame before. With
+ACI_GATEWAY_GRANT_RESET set the grant is the number of commands the PC may send from now on,
+the first frame after aci_gateway_init() is one. An empty frame from the PC, the CRC alone, asks
+for such a frame, e.g. when the PC program starts. A frame with more commands than the PC had
+credits for is dropped.
+
+The events are taken from the event queue of the transport only when the serial port has room for
+them in the frame, see aci_gateway_params_t::p_write_room. With the 64 bytes of the serial
+buffer of an AVR a frame holds one or two events. While the PC does not keep up the event queue
+fills and the transport stops reading the nRF8001, which holds the events back in turn.
+
+The gateway takes the transport for itself, do not call lib_aci_event_get() alongside. Put the
+bytes of the serial port with aci_gateway_put() and call aci_gateway_poll() from the loop.
+*/
+
+#ifndef ACI_GATEWAY_H__
+#define ACI_GATEWAY_H__
+
+#include <lib_aci.h>
+
+/************************************************************************/
+/* Commands from the PC waiting for room in the command queue            */
+/* A power of two, 1 to 8, each takes a hal_aci_data_t of RAM.           */
+/************************************************************************/
+#ifndef ACI_GATEWAY_CMD_SLOTS
+#define ACI_GATEWAY_CMD_SLOTS 4
+#endif
+
+/************************************************************************/
+/* Events batched in one frame to the PC                                 */
+/* 1 to 7.                                                               */
+/************************************************************************/
+#ifndef ACI_GATEWAY_EVTS_PER_FRAME
+#define ACI_GATEWAY_EVTS_PER_FRAME 4
+#endif
+
+#if (ACI_GATEWAY_CMD_SLOTS < 1) || (ACI_GATEWAY_CMD_SLOTS > 8) || \
+    (0 != (ACI_GATEWAY_CMD_SLOTS & (ACI_GATEWAY_CMD_SLOTS - 1)))
+#error "ACI_GATEWAY_CMD_SLOTS must be a power of two from 1 to 8"
+#endif
+#if (ACI_GATEWAY_EVTS_PER_FRAME < 1) || (ACI_GATEWAY_EVTS_PER_FRAME > 7)
+#error "ACI_GATEWAY_EVTS_PER_FRAME must be 1 to 7"
+#endif
+
+/** The grant is the number of commands the PC may send, not the number given back */
+#define ACI_GATEWAY_GRANT_RESET  0x80
+
+/** Longest frame to the PC before COBS: the grant, the events and the CRC */
+#define ACI_GATEWAY_FRAME_MAX    (1 + (ACI_GATEWAY_EVTS_PER_FRAME * (HAL_ACI_MAX_LENGTH + 1)) + 2)
+
+/** Longest frame to the PC on the serial port, the first COBS code byte and the 0x00 added */
+#define ACI_GATEWAY_WIRE_MAX     (ACI_GATEWAY_FRAME_MAX + 2)
+
+typedef struct
+{
+  void (*p_write)(const uint8_t *p_data, uint8_t length);   /**< Writes to the serial port, e.g. with Serial.write() */
+  int  (*p_write_room)(void);                               /**< Bytes the serial port takes without waiting, e.g.
+                                                                 Serial.availableForWrite(). NULL when p_write may wait */
+} aci_gateway_params_t;
+
+typedef struct
+{
+  uint32_t commands;               /**< Moved to the command queue */
+  uint32_t events;                 /**< Sent to the PC */
+  uint16_t frames_received;
+  uint16_t frames_sent;
+  uint16_t crc_errors;             /**< Frames from the PC dropped for their CRC */
+  uint16_t framing_errors;         /**< Frames from the PC dropped for their COBS or a packet length */
+  uint16_t overruns;               /**< Frames from the PC dropped for more commands than credits */
+} aci_gateway_stats_t;
+
+/** State of the gateway */
+typedef struct
+{
+  const aci_gateway_params_t *p_params;
+  /* From the PC */
+  uint8_t             cobs_code;           /**< Code byte of the COBS block being decoded */
+  uint8_t             cobs_left;           /**< Bytes of the block still to come */
+  uint8_t             held[2];             /**< The last two bytes decoded, the CRC at the end of the frame */
+  uint8_t             held_count;
+  uint16_t            crc;
+  uint8_t             packet_pos;          /**< Bytes of the packet being received, 0 for its length next */
+  uint8_t             frame_packets;       /**< Commands of the frame being received, after the head */
+  bool                frame_bad;
+  uint8_t             head;                /**< Free running, the index is masked */
+  uint8_t             tail;
+  hal_aci_data_t      cmds[ACI_GATEWAY_CMD_SLOTS];
+  /* To the PC */
+  uint8_t             grant;
+  bool                grant_reset;
+  aci_gateway_stats_t stats;
+  uint8_t             frame[ACI_GATEWAY_FRAME_MAX];
+} aci_gateway_t;
+
+/** @brief Initializes the gateway, the first frame to the PC resets its credits.
+ *  @param p_gw state of the gateway.
+ *  @param p_params the serial port, must stay valid while the gateway is used.
+ */
+void aci_gateway_init(aci_gateway_t *p_gw, const aci_gateway_params_t *p_params);
+
+/** @brief Puts a byte from the PC, e.g. from Serial.read().
+ *  @details The commands of a frame are queued when its 0x00 comes and its CRC matches.
+ */
+void aci_gateway_put(aci_gateway_t *p_gw, uint8_t byte);
+
+/** @brief Moves the commands to the command queue, and sends the events and the grant to the PC.
+ *  @details Call it from the loop, the events are framed as they come, up to
+ *  ACI_GATEWAY_EVTS_PER_FRAME at a time.
+ */
+void aci_gateway_poll(aci_gateway_t *p_gw);
+
+/** @brief Gets the counters since aci_gateway_init().
+ */
+void aci_gateway_stats_get(const aci_gateway_t *p_gw, aci_gateway_stats_t *p_stats);
+
+#endif // ACI_GATEWAY_H__
+/** @} */
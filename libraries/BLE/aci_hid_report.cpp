@@ -0,0 +1,588 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+/** @file
+@brief Implementation of the HID input report queue and motion
+*/
+
+#include <lib_aci.h>
+#include "aci_hid_report.h"
+#include "ble_assert.h"
+
+#define QUEUE_MASK  (ACI_HID_REPORT_QUEUE_SIZE - 1)
+
+/* Keeps the compiler from moving the report copy across the head update that publishes it */
+#define ACI_HID_REPORT_BARRIER()  __asm__ __volatile__ ("" ::: "memory")
+
+//Board dependent defines
+#if defined(__PIC32MX__)
+  //In ChipKit the constants are in RAM
+  #define aci_hid_byte_P(p)   (*(const uint8_t *)(p))
+#else
+  #define aci_hid_byte_P(p)   pgm_read_byte_near(p)
+#endif
+
+/* Bit 7 of an entry of the ASCII table, the key is typed with the left shift */
+#define ASCII_SHIFT   0x80
+
+/* Boot keyboard report: modifier byte, reserved byte and the keys */
+#define TEXT_REPORT_LEN   8
+#define TEXT_REPORT_KEY0  2
+
+/* Usage of the keyboard page for each ASCII character, US layout, 0 for none */
+static const uint8_t aci_hid_ascii_usage[128] PROGMEM =
+{
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  /* 0x00 to 0x07 */
+  0x2A, 0x2B, 0x28, 0x00, 0x00, 0x00, 0x00, 0x00,  /* \b to 0x0F */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  /* 0x10 to 0x17 */
+  0x00, 0x00, 0x00, 0x29, 0x00, 0x00, 0x00, 0x00,  /* 0x18 to 0x1F */
+  0x2C, 0x9E, 0xB4, 0xA0, 0xA1, 0xA2, 0xA4, 0x34,  /* space to ' */
+  0xA6, 0xA7, 0xA5, 0xAE, 0x36, 0x2D, 0x37, 0x38,  /* ( to / */
+  0x27, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24,  /* 0 to 7 */
+  0x25, 0x26, 0xB3, 0x33, 0xB6, 0x2E, 0xB7, 0xB8,  /* 8 to ? */
+  0x9F, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8A,  /* @ to G */
+  0x8B, 0x8C, 0x8D, 0x8E, 0x8F, 0x90, 0x91, 0x92,  /* H to O */
+  0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A,  /* P to W */
+  0x9B, 0x9C, 0x9D, 0x2F, 0x31, 0x30, 0xA3, 0xAD,  /* X to _ */
+  0x35, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A,  /* ` to g */
+  0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x11, 0x12,  /* h to o */
+  0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A,  /* p to w */
+  0x1B, 0x1C, 0x1D, 0xAF, 0xB1, 0xB0, 0xB5, 0x4C,  /* x to del */
+};
+
+static uint8_t queue_count(const aci_hid_report_queue_t *p_queue)
+{
+  return (uint8_t)(p_queue->head - p_queue->tail);
+}
+
+/*
+  Sends from the tail while there are credits, the reports_per_interval of the params count
+  from the first report sent in a connection interval.
+*/
+static void queue_send(aci_hid_report_queue_t *p_queue, aci_state_t *aci_stat)
+{
+  const aci_hid_report_params_t *p_params = p_queue->p_params;
+  const unsigned long now_ms = millis();
+  uint16_t latency_ms;
+  uint8_t  slot;
+
+  lib_aci_select(aci_stat);
+  if (!lib_aci_is_pipe_available(aci_stat, p_params->pipe))
+  {
+    return;
+  }
+
+  while ((0 != queue_count(p_queue)) && (0 != aci_stat->data_credit_available))
+  {
+    if (0 != p_params->reports_per_interval)
+    {
+      if ((now_ms - p_queue->interval_start_ms) >= lib_aci_get_cx_interval_ms(aci_stat))
+      {
+        p_queue->interval_start_ms = now_ms;
+        p_queue->interval_sent     = 0;
+      }
+      if (p_queue->interval_sent >= p_params->reports_per_interval)
+      {
+        break;
+      }
+    }
+
+    slot = p_queue->tail & QUEUE_MASK;
+    if (!lib_aci_send_data(p_params->pipe, &p_queue->reports[slot][0], p_params->length))
+    {
+      break;
+    }
+
+    latency_ms = (uint16_t)now_ms - p_queue->put_ms[slot];
+    if (latency_ms > p_queue->stats.latency_max_ms)
+    {
+      p_queue->stats.latency_max_ms = latency_ms;
+    }
+    p_queue->stats.reports_sent++;
+    p_queue->interval_sent++;
+    // The report stays in the ring, the next put compares with it
+    p_queue->tail++;
+  }
+}
+
+void aci_hid_report_init(aci_hid_report_queue_t *p_queue, const aci_hid_report_params_t *p_params)
+{
+  ble_assert(p_params->length <= ACI_HID_REPORT_LEN_MAX);
+
+  memset(p_queue, 0, sizeof(*p_queue));
+  p_queue->p_params = p_params;
+}
+
+void aci_hid_report_event(aci_hid_report_queue_t *p_queue, aci_state_t *aci_stat, const aci_evt_t *p_evt)
+{
+  switch (p_evt->evt_opcode)
+  {
+    // The DataCredit event ends a connection event, the credits are back
+    case ACI_EVT_DATA_CREDIT:
+    case ACI_EVT_PIPE_STATUS:
+      queue_send(p_queue, aci_stat);
+      break;
+
+    case ACI_EVT_DISCONNECTED:
+      // The keys put are not sent to the next connection, which starts with none pressed
+      noInterrupts();
+      p_queue->stats.reports_flushed += queue_count(p_queue);
+      p_queue->tail = p_queue->head;
+      memset(&p_queue->reports[(uint8_t)(p_queue->head - 1) & QUEUE_MASK][0], 0, ACI_HID_REPORT_LEN_MAX);
+      interrupts();
+      p_queue->interval_sent = 0;
+      break;
+
+    default:
+      break;
+  }
+}
+
+void aci_hid_report_poll(aci_hid_report_queue_t *p_queue, aci_state_t *aci_stat)
+{
+  if (0 != queue_count(p_queue))
+  {
+    queue_send(p_queue, aci_stat);
+  }
+}
+
+bool aci_hid_report_put(aci_hid_report_queue_t *p_queue, const uint8_t *p_report)
+{
+  const uint8_t length = p_queue->p_params->length;
+  const uint8_t head   = p_queue->head;
+
+  // The report before is still in the ring, sent or not
+  if (0 == memcmp(&p_queue->reports[(uint8_t)(head - 1) & QUEUE_MASK][0], p_report, length))
+  {
+    p_queue->stats.reports_coalesced++;
+    return true;
+  }
+
+  if (ACI_HID_REPORT_QUEUE_SIZE == queue_count(p_queue))
+  {
+    p_queue->stats.reports_refused++;
+    return false;
+  }
+
+  memcpy(&p_queue->reports[head & QUEUE_MASK][0], p_report, length);
+  p_queue->put_ms[head & QUEUE_MASK] = (uint16_t)millis();
+  ACI_HID_REPORT_BARRIER();
+  p_queue->head = head + 1;
+  return true;
+}
+
+bool aci_hid_report_key(aci_hid_report_queue_t *p_queue, uint8_t modifier, uint8_t keycode)
+{
+  uint8_t report[ACI_HID_REPORT_LEN_MAX];
+
+  if (aci_hid_report_room(p_queue) < 2)
+  {
+    return false;
+  }
+
+  memset(&report[0], 0, sizeof(report));
+  report[0] = modifier;
+  report[2] = keycode;
+  aci_hid_report_put(p_queue, &report[0]);
+
+  report[0] = 0;
+  report[2] = 0;
+  return aci_hid_report_put(p_queue, &report[0]);
+}
+
+uint8_t aci_hid_report_room(const aci_hid_report_queue_t *p_queue)
+{
+  return ACI_HID_REPORT_QUEUE_SIZE - queue_count(p_queue);
+}
+
+void aci_hid_report_stats_get(const aci_hid_report_queue_t *p_queue, aci_hid_report_stats_t *p_stats)
+{
+  *p_stats = p_queue->stats;
+}
+
+bool aci_hid_key_from_ascii(char c, uint8_t *p_modifier, uint8_t *p_keycode)
+{
+  uint8_t usage;
+
+  if ((uint8_t)c >= sizeof(aci_hid_ascii_usage))
+  {
+    return false;
+  }
+  usage = aci_hid_byte_P(&aci_hid_ascii_usage[(uint8_t)c]);
+  if (0 == usage)
+  {
+    return false;
+  }
+  *p_modifier = (0 != (usage & ASCII_SHIFT)) ? ACI_HID_MODIFIER_LEFT_SHIFT : 0x00;
+  *p_keycode  = usage & ~ASCII_SHIFT;
+  return true;
+}
+
+static bool text_key_in(const uint8_t *p_keys, uint8_t count, uint8_t keycode)
+{
+  while (0 != count--)
+  {
+    if (p_keys[count] == keycode)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+  Puts the report being built, its keys are then the ones pressed.
+*/
+static void text_report_put(aci_hid_text_t *p_text)
+{
+  uint8_t report[TEXT_REPORT_LEN];
+
+  memset(&report[0], 0, sizeof(report));
+  report[0] = p_text->modifier;
+  memcpy(&report[TEXT_REPORT_KEY0], &p_text->report_keys[0], p_text->keys);
+  aci_hid_report_put(p_text->p_queue, &report[0]);
+
+  memcpy(&p_text->pressed_keys[0], &p_text->report_keys[0], p_text->keys);
+  p_text->pressed = p_text->keys;
+  p_text->keys    = 0;
+  p_text->stats.reports++;
+}
+
+static void text_release_put(aci_hid_text_t *p_text)
+{
+  uint8_t report[TEXT_REPORT_LEN];
+
+  memset(&report[0], 0, sizeof(report));
+  aci_hid_report_put(p_text->p_queue, &report[0]);
+  p_text->pressed = 0;
+  p_text->stats.releases++;
+}
+
+void aci_hid_text_init(aci_hid_text_t *p_text, aci_hid_report_queue_t *p_queue)
+{
+  ble_assert(TEXT_REPORT_LEN == p_queue->p_params->length);
+
+  memset(p_text, 0, sizeof(*p_text));
+  p_text->p_queue = p_queue;
+}
+
+bool aci_hid_text_type(aci_hid_text_t *p_text, const char *p_chars)
+{
+  if (NULL != p_text->p_chars)
+  {
+    return false;
+  }
+  p_text->chars_progmem = false;
+  p_text->p_chars       = p_chars;
+  return true;
+}
+
+bool aci_hid_text_type_P(aci_hid_text_t *p_text, const char *p_chars)
+{
+  if (NULL != p_text->p_chars)
+  {
+    return false;
+  }
+  p_text->chars_progmem = true;
+  p_text->p_chars       = p_chars;
+  return true;
+}
+
+bool aci_hid_text_putc(aci_hid_text_t *p_text, char c)
+{
+  uint8_t modifier;
+  uint8_t keycode;
+
+  if (!aci_hid_key_from_ascii(c, &modifier, &keycode))
+  {
+    p_text->stats.chars_skipped++;
+    return true;
+  }
+
+  // The report being built is full, or the key would not be seen as pressed in it: held from the
+  // report before, in it already or with a shift of its own. The next report releases the keys
+  // held that it does not press.
+  if ((0 != p_text->keys) &&
+      ((ACI_HID_TEXT_KEYS == p_text->keys) || (modifier != p_text->modifier) ||
+       text_key_in(&p_text->report_keys[0], p_text->keys, keycode) ||
+       text_key_in(&p_text->pressed_keys[0], p_text->pressed, keycode)))
+  {
+    // The report, and the release the next one may need
+    if (aci_hid_report_room(p_text->p_queue) < 2)
+    {
+      return false;
+    }
+    text_report_put(p_text);
+  }
+
+  // A key held since the report before has to be released to be typed again
+  if ((0 == p_text->keys) && text_key_in(&p_text->pressed_keys[0], p_text->pressed, keycode))
+  {
+    if (0 == aci_hid_report_room(p_text->p_queue))
+    {
+      return false;
+    }
+    text_release_put(p_text);
+  }
+
+  p_text->modifier                    = modifier;
+  p_text->report_keys[p_text->keys++] = (uint8_t)keycode;
+  p_text->stats.chars_typed++;
+  return true;
+}
+
+bool aci_hid_text_busy(const aci_hid_text_t *p_text)
+{
+  return (NULL != p_text->p_chars) || (0 != p_text->keys) || (0 != p_text->pressed);
+}
+
+void aci_hid_text_event(aci_hid_text_t *p_text, const aci_evt_t *p_evt)
+{
+  if (ACI_EVT_DISCONNECTED == p_evt->evt_opcode)
+  {
+    p_text->p_chars = NULL;
+    p_text->keys    = 0;
+    p_text->pressed = 0;
+  }
+}
+
+void aci_hid_text_poll(aci_hid_text_t *p_text)
+{
+  char c;
+
+  while (NULL != p_text->p_chars)
+  {
+    c = p_text->chars_progmem ? (char)aci_hid_byte_P(p_text->p_chars) : *p_text->p_chars;
+    if ('\0' == c)
+    {
+      p_text->p_chars = NULL;
+      break;
+    }
+    if (!aci_hid_text_putc(p_text, c))
+    {
+      break;
+    }
+    p_text->p_chars++;
+  }
+
+  // Once the reports before it are with the nRF8001, or the typing has stopped
+  if (ACI_HID_REPORT_QUEUE_SIZE == aci_hid_report_room(p_text->p_queue))
+  {
+    if (0 != p_text->keys)
+    {
+      text_report_put(p_text);
+    }
+    else if (0 != p_text->pressed)
+    {
+      text_release_put(p_text);
+    }
+  }
+}
+
+void aci_hid_text_stats_get(const aci_hid_text_t *p_text, aci_hid_text_stats_t *p_stats)
+{
+  *p_stats = p_text->stats;
+}
+
+/* Adds to an axis, saturated, the motion of a long stall must not wrap */
+static int16_t motion_add(int16_t value, int16_t delta)
+{
+  const int32_t sum = (int32_t)value + delta;
+
+  if (sum > INT16_MAX)
+  {
+    return INT16_MAX;
+  }
+  if (sum < -INT16_MAX)
+  {
+    return -INT16_MAX;
+  }
+  return (int16_t)sum;
+}
+
+/* The motion of an axis that goes in a report, the rest waits for the next one */
+static int16_t motion_clamp(int16_t value, int16_t limit)
+{
+  if (value > limit)
+  {
+    return limit;
+  }
+  if (value < -limit)
+  {
+    return -limit;
+  }
+  return value;
+}
+
+static void motion_pending_update(aci_hid_motion_t *p_motion)
+{
+  const aci_hid_motion_report_t *p_now = &p_motion->motion;
+  const aci_hid_motion_report_t *p_sent = &p_motion->sent;
+  bool pending;
+
+  if (p_motion->p_params->absolute)
+  {
+    pending = (p_now->x != p_sent->x) || (p_now->y != p_sent->y) || (p_now->wheel != p_sent->wheel);
+  }
+  else
+  {
+    pending = (0 != p_now->x) || (0 != p_now->y) || (0 != p_now->wheel);
+  }
+  pending = pending || ((p_now->buttons | p_motion->buttons_pressed) != p_sent->buttons);
+
+  if (pending && !p_motion->pending)
+  {
+    p_motion->pending_ms = millis();
+  }
+  p_motion->pending = pending;
+}
+
+static void motion_send(aci_hid_motion_t *p_motion, aci_state_t *aci_stat)
+{
+  const aci_hid_motion_params_t *p_params = p_motion->p_params;
+  aci_hid_motion_report_t report;
+  uint8_t  data[ACI_PIPE_TX_DATA_MAX_LEN];
+  uint8_t  length;
+  uint16_t latency_ms;
+
+  lib_aci_select(aci_stat);
+  if (!p_motion->pending || p_motion->in_flight ||
+      (0 == aci_stat->data_credit_available) ||
+      !lib_aci_is_pipe_available(aci_stat, p_params->pipe))
+  {
+    return;
+  }
+
+  // Built from a copy, the motion is only taken once the report is queued
+  report = p_motion->motion;
+  if (!p_params->absolute)
+  {
+    report.x     = motion_clamp(report.x, p_params->xy_limit);
+    report.y     = motion_clamp(report.y, p_params->xy_limit);
+    report.wheel = motion_clamp(report.wheel, p_params->wheel_limit);
+  }
+  report.buttons |= p_motion->buttons_pressed;
+
+  length = p_params->encode(&report, &data[0]);
+  if (!lib_aci_send_data(p_params->pipe, &data[0], length))
+  {
+    return;
+  }
+
+  if (!p_params->absolute)
+  {
+    p_motion->motion.x     -= report.x;
+    p_motion->motion.y     -= report.y;
+    p_motion->motion.wheel -= report.wheel;
+  }
+  p_motion->buttons_pressed = 0;
+  p_motion->sent            = report;
+  p_motion->in_flight       = true;
+
+  latency_ms = (uint16_t)(millis() - p_motion->pending_ms);
+  if (latency_ms > p_motion->stats.latency_max_ms)
+  {
+    p_motion->stats.latency_max_ms = latency_ms;
+  }
+  p_motion->stats.reports_sent++;
+
+  // What is left, a move over the limits or the release of a click, is pending from now
+  p_motion->pending = false;
+  motion_pending_update(p_motion);
+}
+
+void aci_hid_motion_init(aci_hid_motion_t *p_motion, const aci_hid_motion_params_t *p_params)
+{
+  memset(p_motion, 0, sizeof(*p_motion));
+  p_motion->p_params = p_params;
+}
+
+void aci_hid_motion_move(aci_hid_motion_t *p_motion, int16_t dx, int16_t dy, int16_t wheel)
+{
+  p_motion->motion.x     = motion_add(p_motion->motion.x, dx);
+  p_motion->motion.y     = motion_add(p_motion->motion.y, dy);
+  p_motion->motion.wheel = motion_add(p_motion->motion.wheel, wheel);
+  motion_pending_update(p_motion);
+  p_motion->stats.updates++;
+}
+
+void aci_hid_motion_position(aci_hid_motion_t *p_motion, int16_t x, int16_t y, int16_t wheel)
+{
+  p_motion->motion.x     = x;
+  p_motion->motion.y     = y;
+  p_motion->motion.wheel = wheel;
+  motion_pending_update(p_motion);
+  p_motion->stats.updates++;
+}
+
+void aci_hid_motion_buttons(aci_hid_motion_t *p_motion, uint8_t buttons)
+{
+  p_motion->buttons_pressed |= buttons;
+  p_motion->motion.buttons   = buttons;
+  motion_pending_update(p_motion);
+  p_motion->stats.updates++;
+}
+
+void aci_hid_motion_event(aci_hid_motion_t *p_motion, aci_state_t *aci_stat, const aci_evt_t *p_evt)
+{
+  switch (p_evt->evt_opcode)
+  {
+    case ACI_EVT_DATA_CREDIT:
+      // The connection event took the report, the next one carries the motion since
+      p_motion->in_flight = false;
+      motion_send(p_motion, aci_stat);
+      break;
+
+    case ACI_EVT_PIPE_ERROR:
+      if (p_motion->p_params->pipe == p_evt->params.pipe_error.pipe_number)
+      {
+        p_motion->in_flight = false;
+      }
+      break;
+
+    case ACI_EVT_PIPE_STATUS:
+      motion_send(p_motion, aci_stat);
+      break;
+
+    case ACI_EVT_DISCONNECTED:
+      // The next connection starts still, with no button pressed
+      memset(&p_motion->motion, 0, sizeof(p_motion->motion));
+      memset(&p_motion->sent, 0, sizeof(p_motion->sent));
+      p_motion->buttons_pressed = 0;
+      p_motion->pending         = false;
+      p_motion->in_flight       = false;
+      break;
+
+    default:
+      break;
+  }
+}
+
+void aci_hid_motion_poll(aci_hid_motion_t *p_motion, aci_state_t *aci_stat)
+{
+  motion_send(p_motion, aci_stat);
+}
+
+void aci_hid_motion_stats_get(const aci_hid_motion_t *p_motion, aci_hid_motion_stats_t *p_stats)
+{
+  *p_stats = p_motion->stats;
+}
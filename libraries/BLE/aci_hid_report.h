@@ -0,0 +1,324 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+ * @brief Queue of the input reports of a HID over GATT service.
+ */
+
+/** @defgroup aci_hid_report aci_hid_report
+@{
+@ingroup lib
+
+@brief Queues the input reports of a HID report pipe, as PIPE_HID_SERVICE_HID_REPORT_TX of
+ble_HID_keyboard_template, and sends them as the data credits come back.
+@details A report is put with aci_hid_report_put(), from the loop or from an interrupt, and waits
+in a ring of ACI_HID_REPORT_QUEUE_SIZE reports. A report that is the same as the one put before it
+is not queued: a HID input report is a state, the host does not see it again. The state after a
+disconnect is all zeros, no key pressed, as the host assumes at a new connection.
+
+The reports are sent in the order they were put, as many as there are data credits for, when
+aci_hid_report_event() gets the DataCredit event that ends a connection event and from
+aci_hid_report_poll(). With reports_per_interval set no more than that many are sent in a
+connection interval, for hosts that lose a key press and its release in the same connection event.
+
+A key typed with aci_hid_report_key() is its press and its release, so text streams at two reports
+per key up to the link rate and a key waits at most the queue ahead of it.
+
+A text typed with aci_hid_text goes faster: the characters are looked up in a table in flash of
+the US layout, and up to ACI_HID_TEXT_KEYS of them are pressed in one boot keyboard report, in
+the order typed. The host takes the keys of a report that were not pressed in the report before
+as typed, in the order of the report. A character goes in the next report instead when its shift
+is not the one of the report, when its key is in the report already, or when the report is full.
+An all zero release report is only put when a key must be pressed again, as the l of "hello",
+and when the typing stops, so that the host does not repeat the keys held. The reports go
+through the queue as above; the report being built waits until the queue has handed all the
+reports before it to the nRF8001, the characters typed in the meantime join it.
+
+Only one context may put reports, the loop or one interrupt.
+Call aci_hid_report_event() with every ACI event and aci_hid_report_poll() from the loop.
+
+The motion of a mouse or a joystick is not queued, two equal moves are not the same state, but
+summed by aci_hid_motion. The relative X, Y
+and wheel moves given to aci_hid_motion_move() are added up, and the button presses are kept, until
+the report can be sent. Only one report of it is in flight at a time: the next one is built when
+the DataCredit event has given the credit back, it carries all the motion since, so each connection
+event takes one complete report and the motion is never older than about a connection interval.
+The report is encoded by a function of the sketch, for its report descriptor.
+*/
+
+#ifndef ACI_HID_REPORT_H__
+#define ACI_HID_REPORT_H__
+
+#include <lib_aci.h>
+
+/************************************************************************/
+/* Reports waiting to be sent                                            */
+/* A power of two, 4 to 32.                                              */
+/************************************************************************/
+#ifndef ACI_HID_REPORT_QUEUE_SIZE
+#define ACI_HID_REPORT_QUEUE_SIZE 16
+#endif
+
+/************************************************************************/
+/* Bytes of the longest report                                           */
+/* 8 for the boot keyboard report, ACI_PIPE_TX_DATA_MAX_LEN at most.     */
+/************************************************************************/
+#ifndef ACI_HID_REPORT_LEN_MAX
+#define ACI_HID_REPORT_LEN_MAX 8
+#endif
+
+/************************************************************************/
+/* Keys pressed in one report by aci_hid_text                            */
+/* 1 to 6. 6 is the most of the boot keyboard report. 1 types a key per  */
+/* report, for the hosts that do not keep the order of the keys in a     */
+/* report.                                                               */
+/************************************************************************/
+#ifndef ACI_HID_TEXT_KEYS
+#define ACI_HID_TEXT_KEYS 6
+#endif
+
+#if (ACI_HID_REPORT_QUEUE_SIZE < 4) || (ACI_HID_REPORT_QUEUE_SIZE > 32) || \
+    (0 != (ACI_HID_REPORT_QUEUE_SIZE & (ACI_HID_REPORT_QUEUE_SIZE - 1)))
+#error "ACI_HID_REPORT_QUEUE_SIZE must be a power of two from 4 to 32"
+#endif
+#if (ACI_HID_REPORT_LEN_MAX < 1) || (ACI_HID_REPORT_LEN_MAX > ACI_PIPE_TX_DATA_MAX_LEN)
+#error "ACI_HID_REPORT_LEN_MAX must be 1 to ACI_PIPE_TX_DATA_MAX_LEN"
+#endif
+#if (ACI_HID_TEXT_KEYS < 1) || (ACI_HID_TEXT_KEYS > 6)
+#error "ACI_HID_TEXT_KEYS must be 1 to 6"
+#endif
+
+typedef struct
+{
+  uint8_t pipe;                    /**< The input report pipe */
+  uint8_t length;                  /**< Bytes of a report, up to ACI_HID_REPORT_LEN_MAX */
+  uint8_t reports_per_interval;    /**< Most reports in a connection interval, 0 for as many as the credits */
+} aci_hid_report_params_t;
+
+typedef struct
+{
+  uint32_t reports_sent;
+  uint16_t reports_coalesced;      /**< Not queued, the same as the report before */
+  uint16_t reports_refused;        /**< Not queued, the queue was full */
+  uint16_t reports_flushed;        /**< Dropped by a disconnect */
+  uint16_t latency_max_ms;         /**< Longest time from put to sent */
+} aci_hid_report_stats_t;
+
+/** State of the queue, one per report pipe */
+typedef struct
+{
+  const aci_hid_report_params_t *p_params;
+  volatile uint8_t        head;               /**< Free running, the index is masked. Written by the put */
+  volatile uint8_t        tail;               /**< Written by the sending */
+  uint8_t                 interval_sent;      /**< Reports sent in the connection interval */
+  unsigned long           interval_start_ms;
+  aci_hid_report_stats_t  stats;
+  uint16_t                put_ms[ACI_HID_REPORT_QUEUE_SIZE];
+  uint8_t                 reports[ACI_HID_REPORT_QUEUE_SIZE][ACI_HID_REPORT_LEN_MAX];
+} aci_hid_report_queue_t;
+
+/** @brief Initializes the queue, empty and with an all zero report as the last one.
+ *  @param p_queue state of the queue.
+ *  @param p_params pipe and pacing, must stay valid while the queue is used.
+ */
+void aci_hid_report_init(aci_hid_report_queue_t *p_queue, const aci_hid_report_params_t *p_params);
+
+/** @brief Gives an ACI event to the queue, call it for every event taken from lib_aci_event_get().
+ *  @details Reports are sent on the DataCredit and PipeStatus events, the queue is emptied on the
+ *  Disconnected event.
+ */
+void aci_hid_report_event(aci_hid_report_queue_t *p_queue, aci_state_t *aci_stat, const aci_evt_t *p_evt);
+
+/** @brief Sends the reports that have credits, call it from the loop.
+ */
+void aci_hid_report_poll(aci_hid_report_queue_t *p_queue, aci_state_t *aci_stat);
+
+/** @brief Puts a report, of the length in the params.
+ *  @return True if it was queued or is the same as the last one, false if the queue is full.
+ */
+bool aci_hid_report_put(aci_hid_report_queue_t *p_queue, const uint8_t *p_report);
+
+/** @brief Puts the press and the release of a key of the boot keyboard report.
+ *  @param modifier the modifier keys byte, e.g. 0x02 for the left shift.
+ *  @param keycode the usage of the key in the keyboard page, e.g. 0x04 for 'a'.
+ *  @return False if there is not room for both, nothing is put then.
+ */
+bool aci_hid_report_key(aci_hid_report_queue_t *p_queue, uint8_t modifier, uint8_t keycode);
+
+/** @brief Reports that can be put.
+ */
+uint8_t aci_hid_report_room(const aci_hid_report_queue_t *p_queue);
+
+/** @brief Gets the counters since aci_hid_report_init().
+ */
+void aci_hid_report_stats_get(const aci_hid_report_queue_t *p_queue, aci_hid_report_stats_t *p_stats);
+
+/** Left shift in the modifier byte of the boot keyboard report */
+#define ACI_HID_MODIFIER_LEFT_SHIFT 0x02
+
+typedef struct
+{
+  uint32_t chars_typed;            /**< Put in a report */
+  uint32_t reports;                /**< Reports put with keys pressed */
+  uint16_t releases;               /**< Release reports put */
+  uint16_t chars_skipped;          /**< Not in the table, not typed */
+} aci_hid_text_stats_t;
+
+/** State of the typing of a text, on a queue of boot keyboard reports */
+typedef struct
+{
+  aci_hid_report_queue_t *p_queue;
+  const char             *p_chars;            /**< Left to type, NULL when there is none */
+  bool                    chars_progmem;
+  uint8_t                 keys;               /**< In the report being built */
+  uint8_t                 modifier;           /**< Of the report being built */
+  uint8_t                 report_keys[ACI_HID_TEXT_KEYS];
+  uint8_t                 pressed;            /**< Keys in the report put last */
+  uint8_t                 pressed_keys[ACI_HID_TEXT_KEYS];
+  aci_hid_text_stats_t    stats;
+} aci_hid_text_t;
+
+/** @brief Keycode and modifier of the boot keyboard report for an ASCII character, US layout.
+ *  @details The printable characters, '\n' as Enter, '\t', '\b' as Backspace, Escape and Delete.
+ *  @return False for the characters that are not typed.
+ */
+bool aci_hid_key_from_ascii(char c, uint8_t *p_modifier, uint8_t *p_keycode);
+
+/** @brief Initializes the typing, nothing to type and no key pressed.
+ *  @param p_text state of the typing.
+ *  @param p_queue queue of the boot keyboard reports, of a length of 8. Put no other reports on it
+ *  while a text is typed.
+ */
+void aci_hid_text_init(aci_hid_text_t *p_text, aci_hid_report_queue_t *p_queue);
+
+/** @brief Starts typing a string in RAM, it must stay valid until aci_hid_text_busy() is false.
+ *  @return False if a string is being typed.
+ */
+bool aci_hid_text_type(aci_hid_text_t *p_text, const char *p_chars);
+
+/** @brief Starts typing a string in flash, e.g. from PSTR().
+ *  @return False if a string is being typed.
+ */
+bool aci_hid_text_type_P(aci_hid_text_t *p_text, const char *p_chars);
+
+/** @brief Types a character, e.g. from the Serial.
+ *  @return False if the queue has no room for it, it must be given again.
+ */
+bool aci_hid_text_putc(aci_hid_text_t *p_text, char c);
+
+/** @brief True while there is a string to type or a key is not released.
+ */
+bool aci_hid_text_busy(const aci_hid_text_t *p_text);
+
+/** @brief Gives an ACI event to the typing, call it for every event taken from lib_aci_event_get().
+ *  @details The text and the report being built are dropped on the Disconnected event, as the
+ *  queue drops its reports.
+ */
+void aci_hid_text_event(aci_hid_text_t *p_text, const aci_evt_t *p_evt);
+
+/** @brief Puts the reports of the string, the report being built and the releases, call it from
+ *  the loop before aci_hid_report_poll().
+ */
+void aci_hid_text_poll(aci_hid_text_t *p_text);
+
+/** @brief Gets the counters since aci_hid_text_init().
+ */
+void aci_hid_text_stats_get(const aci_hid_text_t *p_text, aci_hid_text_stats_t *p_stats);
+
+/** Motion and buttons for one report, given to the encode function of aci_hid_motion */
+typedef struct
+{
+  int16_t x;                       /**< Relative, or the position with absolute */
+  int16_t y;
+  int16_t wheel;
+  uint8_t buttons;                 /**< A bit per button, 1 for pressed */
+} aci_hid_motion_report_t;
+
+/** @brief Encodes the motion as the input report of the report descriptor.
+ *  @return Bytes of the report, up to ACI_PIPE_TX_DATA_MAX_LEN.
+ */
+typedef uint8_t (*aci_hid_motion_encode_t)(const aci_hid_motion_report_t *p_motion, uint8_t *p_report);
+
+typedef struct
+{
+  uint8_t                 pipe;          /**< The input report pipe */
+  bool                    absolute;      /**< Positions, the last one given is sent, as the X and Y of a joystick */
+  int16_t                 xy_limit;      /**< Most relative X or Y in a report, the rest goes in the next, e.g. 127 */
+  int16_t                 wheel_limit;   /**< The same for the wheel */
+  aci_hid_motion_encode_t encode;
+} aci_hid_motion_params_t;
+
+typedef struct
+{
+  uint32_t reports_sent;
+  uint32_t updates;                /**< Calls of aci_hid_motion_move(), _position() and _buttons() */
+  uint16_t latency_max_ms;         /**< Longest time from the first update in a report to it being sent */
+} aci_hid_motion_stats_t;
+
+/** State of the motion of one report pipe */
+typedef struct
+{
+  const aci_hid_motion_params_t *p_params;
+  aci_hid_motion_report_t motion;             /**< Not sent yet, the positions with absolute */
+  aci_hid_motion_report_t sent;               /**< The last report sent */
+  uint8_t                 buttons_pressed;    /**< Pressed since the last report, a click between two reports is kept */
+  bool                    pending;
+  bool                    in_flight;          /**< Sent and its credit not back yet */
+  unsigned long           pending_ms;
+  aci_hid_motion_stats_t  stats;
+} aci_hid_motion_t;
+
+/** @brief Initializes the motion, nothing moved and no button pressed.
+ *  @param p_motion state of the motion.
+ *  @param p_params pipe, limits and encoding, must stay valid while the motion is used.
+ */
+void aci_hid_motion_init(aci_hid_motion_t *p_motion, const aci_hid_motion_params_t *p_params);
+
+/** @brief Adds a relative move, e.g. from the sensor of a mouse.
+ */
+void aci_hid_motion_move(aci_hid_motion_t *p_motion, int16_t dx, int16_t dy, int16_t wheel);
+
+/** @brief Sets the position, with absolute in the params, e.g. from the analog inputs of a joystick.
+ */
+void aci_hid_motion_position(aci_hid_motion_t *p_motion, int16_t x, int16_t y, int16_t wheel);
+
+/** @brief Sets the state of the buttons, a bit per button.
+ */
+void aci_hid_motion_buttons(aci_hid_motion_t *p_motion, uint8_t buttons);
+
+/** @brief Gives an ACI event to the motion, call it for every event taken from lib_aci_event_get().
+ *  @details The next report is sent on the DataCredit event, the motion is dropped on the
+ *  Disconnected event.
+ */
+void aci_hid_motion_event(aci_hid_motion_t *p_motion, aci_state_t *aci_stat, const aci_evt_t *p_evt);
+
+/** @brief Sends the report when there is motion and no report in flight, call it from the loop.
+ */
+void aci_hid_motion_poll(aci_hid_motion_t *p_motion, aci_state_t *aci_stat);
+
+/** @brief Gets the counters since aci_hid_motion_init().
+ */
+void aci_hid_motion_stats_get(const aci_hid_motion_t *p_motion, aci_hid_motion_stats_t *p_stats);
+
+#endif // ACI_HID_REPORT_H__
+/** @} */
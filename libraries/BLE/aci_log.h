@@ -0,0 +1,118 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+/** @file
+ * @brief Compile-time levels of the library diagnostics
+ */
+
+/** @defgroup aci_log aci_log
+@{
+@ingroup lib
+
+@brief Levelled log calls of the BLE library that compile to nothing below ACI_LOG_LEVEL.
+@details Each log call has an ID of aci_log_id_t, a text and a 16 bit value. At the error and
+information levels the text and the value are printed on the Serial, the text stays in flash
+with F(). At the trace level the text is left out and aci_log_write() writes the ID and the
+value as a binary record, into the HAL_ACI_TL_TRACE ring when it is built in or on the Serial
+otherwise. ACI_LOG_TRACE() calls log at the trace level only, they have no text.
+
+Keep the IDs stable, Build/DecodeAciTrace.py names the records from the same list.
+*/
+
+#ifndef ACI_LOG_H__
+#define ACI_LOG_H__
+
+#include "hal_aci_tl.h"
+
+#define ACI_LOG_LEVEL_NONE   0
+#define ACI_LOG_LEVEL_ERROR  1
+#define ACI_LOG_LEVEL_INFO   2
+#define ACI_LOG_LEVEL_TRACE  3
+
+/************************************************************************/
+/* Log level of the library diagnostics, log calls below the level       */
+/* compile to nothing.                                                   */
+/* 0 : None. ble_assert() passes no file name to __ble_assert().         */
+/* 1 : Errors, printed as text on the Serial.                            */
+/* 2 : Errors, information and the debug printing of the commands and    */
+/*     events (hal_aci_tl_debug_print()), as text on the Serial.         */
+/* 3 : Everything, as compact binary records without the text: the log   */
+/*     calls write [type 'L'][micros() 4 bytes][length 3][ID][value 2    */
+/*     bytes] and the debug printing writes the 'C' and 'E' records of   */
+/*     HAL_ACI_TL_TRACE. Decode them with Build/DecodeAciTrace.py.       */
+/* With HAL_ACI_TL_TRACE the records go to the trace ring at any level.  */
+/************************************************************************/
+#ifndef ACI_LOG_LEVEL
+#define ACI_LOG_LEVEL ACI_LOG_LEVEL_INFO
+#endif
+
+#if (ACI_LOG_LEVEL > ACI_LOG_LEVEL_TRACE)
+#error "ACI_LOG_LEVEL must be 0 to 3"
+#endif
+
+/**
+ * @enum aci_log_id_t
+ * @brief IDs of the log records
+ */
+typedef enum
+{
+  ACI_LOG_ID_ASSERT             = 0x01, /**< ble_assert() failed, value: line */
+  ACI_LOG_ID_CMD_TOO_LONG       = 0x02, /**< Command longer than HAL_ACI_MAX_LENGTH, value: length */
+  ACI_LOG_ID_CMD_QUEUE_FULL     = 0x03, /**< Command queue full, value: opcode */
+  ACI_LOG_ID_BOARD_INIT         = 0x04, /**< lib_aci_board_init(), value: board name */
+  ACI_LOG_ID_BOARD_INIT_DISCARD = 0x05, /**< Event discarded by the board init, value: opcode */
+} aci_log_id_t;
+
+/** @brief Write a log record with id and value
+ *  @details
+ *  Used by the log calls at the trace level. Call it from the main context, the trace ring is
+ *  not protected from interrupts.
+ */
+void aci_log_write(uint8_t id, uint16_t value);
+
+#if (ACI_LOG_LEVEL >= ACI_LOG_LEVEL_TRACE)
+#define ACI_LOG_PRINT(id, text, value)  aci_log_write((id), (uint16_t)(value))
+#define ACI_LOG_TRACE(id, value)        aci_log_write((id), (uint16_t)(value))
+#else
+#define ACI_LOG_PRINT(id, text, value)  \
+  do                                    \
+  {                                     \
+    Serial.print(F(text));              \
+    Serial.println((value), HEX);       \
+  } while (0)
+#define ACI_LOG_TRACE(id, value)        do { } while (0)
+#endif
+
+#if (ACI_LOG_LEVEL >= ACI_LOG_LEVEL_ERROR)
+#define ACI_LOG_ERROR(id, text, value)  ACI_LOG_PRINT(id, text, value)
+#else
+#define ACI_LOG_ERROR(id, text, value)  do { } while (0)
+#endif
+
+#if (ACI_LOG_LEVEL >= ACI_LOG_LEVEL_INFO)
+#define ACI_LOG_INFO(id, text, value)   ACI_LOG_PRINT(id, text, value)
+#else
+#define ACI_LOG_INFO(id, text, value)   do { } while (0)
+#endif
+
+#endif // ACI_LOG_H__
+/** @} */
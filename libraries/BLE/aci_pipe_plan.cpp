@@ -0,0 +1,252 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+@brief Implementation of the remote pipe plan
+*/
+
+#include <lib_aci.h>
+#include "aci_pipe_plan.h"
+
+#if ACI_FEATURE_REMOTE_PIPES
+
+static uint16_t plan_mask(const aci_pipe_plan_t *p_plan)
+{
+  return (ACI_PIPE_PLAN_MAX_STEPS == p_plan->count) ? 0xFFFF : (uint16_t)((1u << p_plan->count) - 1);
+}
+
+static void step_finish(aci_pipe_plan_t *p_plan, uint8_t step, bool success)
+{
+  const uint16_t bit = (uint16_t)(1u << step);
+
+  if (success)
+  {
+    p_plan->done |= bit;
+  }
+  else
+  {
+    p_plan->failed |= bit;
+    p_plan->stats.failed++;
+  }
+  if (step == p_plan->in_flight)
+  {
+    p_plan->in_flight = ACI_PIPE_PLAN_NONE;
+  }
+  if ((p_plan->done | p_plan->failed) == plan_mask(p_plan))
+  {
+    p_plan->stats.last_ready_ms = millis() - p_plan->connected_ms;
+  }
+}
+
+static bool step_ready(const aci_pipe_plan_t *p_plan, aci_state_t *aci_stat, uint8_t step)
+{
+  const aci_pipe_plan_step_t *p_step = &p_plan->p_steps[step];
+
+  if (0 != ((p_plan->done | p_plan->failed) & (1u << step)))
+  {
+    return false;
+  }
+  if ((ACI_PIPE_PLAN_NONE != p_step->after) && (0 == (p_plan->done & (1u << p_step->after))))
+  {
+    return false;
+  }
+  if (ACI_PIPE_PLAN_OPEN == p_step->action)
+  {
+    return lib_aci_is_pipe_closed(aci_stat, p_step->pipe);
+  }
+  return lib_aci_is_pipe_available(aci_stat, p_step->pipe);
+}
+
+/*
+  Sends the first ready step, when the link is up and no step is in flight.
+*/
+static void plan_next(aci_pipe_plan_t *p_plan, aci_state_t *aci_stat)
+{
+  const aci_pipe_plan_step_t *p_step;
+  uint8_t step;
+  bool    sent;
+
+  if (!p_plan->connected || p_plan->wait_event || (ACI_PIPE_PLAN_NONE != p_plan->in_flight) ||
+      !lib_aci_is_discovery_finished(aci_stat))
+  {
+    return;
+  }
+
+  // Pipes open already need no opening, in order so the steps after them are ready below
+  for (step = 0; step < p_plan->count; step++)
+  {
+    p_step = &p_plan->p_steps[step];
+    if ((ACI_PIPE_PLAN_OPEN == p_step->action) &&
+        (0 == ((p_plan->done | p_plan->failed) & (1u << step))) &&
+        lib_aci_is_pipe_available(aci_stat, p_step->pipe))
+    {
+      step_finish(p_plan, step, true);
+    }
+  }
+
+  for (step = 0; step < p_plan->count; step++)
+  {
+    if (!step_ready(p_plan, aci_stat, step))
+    {
+      continue;
+    }
+
+    p_step = &p_plan->p_steps[step];
+    if (ACI_PIPE_PLAN_OPEN == p_step->action)
+    {
+      sent = lib_aci_open_remote_pipe(aci_stat, p_step->pipe);
+    }
+    else
+    {
+      sent = lib_aci_request_data(aci_stat, p_step->pipe);
+    }
+
+    // Not queued, sent again by the next poll
+    if (sent)
+    {
+      p_plan->in_flight = step;
+      p_plan->stats.commands++;
+    }
+    return;
+  }
+}
+
+bool aci_pipe_plan_init(aci_pipe_plan_t *p_plan, const aci_pipe_plan_step_t *p_steps, uint8_t count)
+{
+  uint8_t step;
+
+  if ((0 == count) || (count > ACI_PIPE_PLAN_MAX_STEPS))
+  {
+    return false;
+  }
+  for (step = 0; step < count; step++)
+  {
+    if ((ACI_PIPE_PLAN_NONE != p_steps[step].after) && (p_steps[step].after >= step))
+    {
+      return false;
+    }
+  }
+
+  memset(p_plan, 0, sizeof(*p_plan));
+  p_plan->p_steps   = p_steps;
+  p_plan->count     = count;
+  p_plan->in_flight = ACI_PIPE_PLAN_NONE;
+  return true;
+}
+
+void aci_pipe_plan_event(aci_pipe_plan_t *p_plan, aci_state_t *aci_stat, const aci_evt_t *p_evt)
+{
+  const aci_pipe_plan_step_t *p_step = NULL;
+  uint8_t expected_opcode = 0;
+
+  if (ACI_PIPE_PLAN_NONE != p_plan->in_flight)
+  {
+    p_step          = &p_plan->p_steps[p_plan->in_flight];
+    expected_opcode = (ACI_PIPE_PLAN_OPEN == p_step->action) ? ACI_CMD_OPEN_REMOTE_PIPE : ACI_CMD_REQUEST_DATA;
+  }
+  p_plan->wait_event = false;
+
+  switch (p_evt->evt_opcode)
+  {
+    case ACI_EVT_CONNECTED:
+      p_plan->done         = 0;
+      p_plan->failed       = 0;
+      p_plan->in_flight    = ACI_PIPE_PLAN_NONE;
+      p_plan->connected    = true;
+      p_plan->connected_ms = millis();
+      break;
+
+    case ACI_EVT_DISCONNECTED:
+      p_plan->connected = false;
+      p_plan->in_flight = ACI_PIPE_PLAN_NONE;
+      break;
+
+    case ACI_EVT_PIPE_STATUS:
+      if ((NULL != p_step) && (ACI_PIPE_PLAN_OPEN == p_step->action) &&
+          lib_aci_is_pipe_available(aci_stat, p_step->pipe))
+      {
+        step_finish(p_plan, p_plan->in_flight, true);
+      }
+      break;
+
+    case ACI_EVT_DATA_RECEIVED:
+      if ((NULL != p_step) && (ACI_PIPE_PLAN_REQUEST == p_step->action) &&
+          (p_evt->params.data_received.rx_data.pipe_number == p_step->pipe))
+      {
+        step_finish(p_plan, p_plan->in_flight, true);
+      }
+      break;
+
+    case ACI_EVT_PIPE_ERROR:
+      if ((NULL != p_step) && (p_evt->params.pipe_error.pipe_number == p_step->pipe))
+      {
+        step_finish(p_plan, p_plan->in_flight, false);
+      }
+      break;
+
+    case ACI_EVT_CMD_RSP:
+      if ((NULL == p_step) || (p_evt->params.cmd_rsp.cmd_opcode != expected_opcode) ||
+          (ACI_STATUS_SUCCESS == p_evt->params.cmd_rsp.cmd_status))
+      {
+        break;
+      }
+      if (ACI_STATUS_ERROR_BUSY == p_evt->params.cmd_rsp.cmd_status)
+      {
+        // Another GATT client procedure runs, try again once it has moved on
+        p_plan->in_flight  = ACI_PIPE_PLAN_NONE;
+        p_plan->wait_event = true;
+        p_plan->stats.busy++;
+        return;
+      }
+      step_finish(p_plan, p_plan->in_flight, false);
+      break;
+
+    default:
+      break;
+  }
+
+  plan_next(p_plan, aci_stat);
+}
+
+void aci_pipe_plan_poll(aci_pipe_plan_t *p_plan, aci_state_t *aci_stat)
+{
+  lib_aci_select(aci_stat);
+  plan_next(p_plan, aci_stat);
+}
+
+bool aci_pipe_plan_is_done(const aci_pipe_plan_t *p_plan)
+{
+  return p_plan->connected && ((p_plan->done | p_plan->failed) == plan_mask(p_plan));
+}
+
+bool aci_pipe_plan_step_done(const aci_pipe_plan_t *p_plan, uint8_t step)
+{
+  return (step < p_plan->count) && (0 != (p_plan->done & (1u << step)));
+}
+
+void aci_pipe_plan_stats_get(const aci_pipe_plan_t *p_plan, aci_pipe_plan_stats_t *p_stats)
+{
+  *p_stats = p_plan->stats;
+}
+
+#endif // ACI_FEATURE_REMOTE_PIPES
@@ -0,0 +1,124 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/** @file
+ * @brief Opens the remote pipes and reads the ACI_RX_REQ pipes of a sketch once connected.
+ */
+
+/** @defgroup aci_pipe_plan aci_pipe_plan
+@{
+@ingroup lib
+
+@brief Runs a list of remote pipe openings and data requests on every connection, in place of the
+lib_aci_open_remote_pipe() and lib_aci_request_data() calls of the ANCS and proximity templates.
+@details Each step opens a remote pipe (ACI_PIPE_PLAN_OPEN, lib_aci_open_remote_pipe()) or reads an
+ACI_RX_REQ pipe (ACI_PIPE_PLAN_REQUEST, lib_aci_request_data()), optionally after another step of
+the list. A step is ready once the service discovery is finished, the step it comes after is done,
+and its pipe can be used: closed for an opening, available for a request. A pipe found open
+already, e.g. with a bond, needs no opening.
+
+The nRF8001 runs one GATT client procedure at a time and answers ACI_STATUS_ERROR_BUSY to the
+next one, so the plan keeps one step in flight. The next ready step is sent by
+aci_pipe_plan_event() as soon as the one in flight is done, in the same pass of the loop: the
+PipeStatus of an opening, the DataReceived of a request. A busy step is sent again after the next
+event, a step that fails otherwise is not tried again on this connection.
+
+Call aci_pipe_plan_event() with every ACI event and aci_pipe_plan_poll() from the loop.
+*/
+
+#ifndef ACI_PIPE_PLAN_H__
+#define ACI_PIPE_PLAN_H__
+
+#include <lib_aci.h>
+
+#if ACI_FEATURE_REMOTE_PIPES
+
+/** Steps in a plan */
+#define ACI_PIPE_PLAN_MAX_STEPS  16
+
+/** Actions of a step */
+#define ACI_PIPE_PLAN_OPEN       0  /**< lib_aci_open_remote_pipe() */
+#define ACI_PIPE_PLAN_REQUEST    1  /**< lib_aci_request_data() */
+
+/** after of a step that waits for no other, and in_flight with no step in flight */
+#define ACI_PIPE_PLAN_NONE       0xFF
+
+typedef struct
+{
+  uint8_t action;                  /**< ACI_PIPE_PLAN_OPEN or ACI_PIPE_PLAN_REQUEST */
+  uint8_t pipe;
+  uint8_t after;                   /**< Index of an earlier step to wait for, ACI_PIPE_PLAN_NONE */
+} aci_pipe_plan_step_t;
+
+typedef struct
+{
+  uint16_t commands;               /**< Openings and requests sent */
+  uint16_t busy;                   /**< Sent again after ACI_STATUS_ERROR_BUSY */
+  uint16_t failed;                 /**< Steps given up on */
+  uint32_t last_ready_ms;          /**< Connected to the last step done, on the last connection */
+} aci_pipe_plan_stats_t;
+
+/** State of the plan, one per nRF8001 */
+typedef struct
+{
+  const aci_pipe_plan_step_t *p_steps;
+  uint8_t               count;
+  uint16_t              done;          /**< Bit n: step n done */
+  uint16_t              failed;        /**< Bit n: step n given up on */
+  uint8_t               in_flight;     /**< Step sent and not done, ACI_PIPE_PLAN_NONE */
+  bool                  connected;
+  bool                  wait_event;    /**< A step was busy, wait for the next event */
+  unsigned long         connected_ms;
+  aci_pipe_plan_stats_t stats;
+} aci_pipe_plan_t;
+
+/** @brief Initializes the plan.
+ *  @param p_plan state of the plan.
+ *  @param p_steps steps, must stay valid while the plan is used.
+ *  @param count 1 to ACI_PIPE_PLAN_MAX_STEPS steps.
+ *  @return False if count is out of range, or a step comes after itself or a later step.
+ */
+bool aci_pipe_plan_init(aci_pipe_plan_t *p_plan, const aci_pipe_plan_step_t *p_steps, uint8_t count);
+
+/** @brief Gives an ACI event to the plan, call it for every event taken from lib_aci_event_get().
+ *  @details Sends the next ready step when the one in flight is done.
+ */
+void aci_pipe_plan_event(aci_pipe_plan_t *p_plan, aci_state_t *aci_stat, const aci_evt_t *p_evt);
+
+/** @brief Sends the next ready step when none is in flight, call it from the loop.
+ */
+void aci_pipe_plan_poll(aci_pipe_plan_t *p_plan, aci_state_t *aci_stat);
+
+/** @brief True once every step of this connection is done or given up on.
+ */
+bool aci_pipe_plan_is_done(const aci_pipe_plan_t *p_plan);
+
+/** @brief True if the step is done on this connection.
+ */
+bool aci_pipe_plan_step_done(const aci_pipe_plan_t *p_plan, uint8_t step);
+
+/** @brief Gets the counters since aci_pipe_plan_init().
+ */
+void aci_pipe_plan_stats_get(const aci_pipe_plan_t *p_plan, aci_pipe_plan_stats_t *p_stats);
+
+#endif // ACI_FEATURE_REMOTE_PIPES
+#endif // ACI_PIPE_PLAN_H__
+/** @} */
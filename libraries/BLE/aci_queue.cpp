@@ -27,165 +27,255 @@
 #include "aci_queue.h"
 #include "ble_assert.h"
 
-void aci_queue_init(aci_queue_t *aci_q)
+/* Keeps the compiler from moving the entry copy across the head/tail update that publishes it */
+#define ACI_QUEUE_BARRIER()  __asm__ __volatile__ ("" ::: "memory")
+
+/* Offset following an entry of length bytes at offset, wrapped so that a full size entry always fits */
+static inline uint8_t aci_queue_next(const aci_queue_t *aci_q, uint8_t offset, uint8_t length)
+{
+  offset += length;
+  if (offset > (aci_q->size - ACI_QUEUE_ENTRY_MAX))
+  {
+    offset = 0;
+  }
+  return offset;
+}
+
+/* Check if an entry of length bytes fits at the tail. Only the producer calls this. */
+static bool aci_queue_has_room(const aci_queue_t *aci_q, uint8_t length)
+{
+  const uint8_t head = aci_q->head;
+  const uint8_t tail = aci_q->tail;
+
+  if (tail < head)
+  {
+    /* The tail must not catch up with the head, the queue would look empty */
+    return ((uint8_t)(tail + length) < head);
+  }
+
+  /* The entry fits before the end by construction, but it must not wrap the tail onto the head */
+  return !((0 == head) && (0 == aci_queue_next(aci_q, tail, length)));
+}
+
+static inline uint8_t aci_queue_entry_length(const aci_queue_t *aci_q, uint8_t offset)
 {
-  uint8_t loop;
+  return aci_q->data[offset + 1] + 2;
+}
 
+void aci_queue_init(aci_queue_t *aci_q, uint8_t *p_storage, uint8_t size)
+{
   ble_assert(NULL != aci_q);
+  ble_assert(NULL != p_storage);
+  ble_assert(size >= (2 * ACI_QUEUE_ENTRY_MAX));
 
+  aci_q->data = p_storage;
+  aci_q->size = size;
   aci_q->head = 0;
   aci_q->tail = 0;
-  for(loop=0; loop<ACI_QUEUE_SIZE; loop++)
+}
+
+static bool aci_queue_copy_head(aci_queue_t *aci_q, hal_aci_data_t *p_data)
+{
+  if (aci_q->head == aci_q->tail)
   {
-    aci_q->aci_data[loop].buffer[0] = 0x00;
-    aci_q->aci_data[loop].buffer[1] = 0x00;
+    return false;
   }
+
+  memcpy((uint8_t *)p_data, &aci_q->data[aci_q->head], aci_queue_entry_length(aci_q, aci_q->head));
+  return true;
 }
 
-bool aci_queue_dequeue(aci_queue_t *aci_q, hal_aci_data_t *p_data)
+static bool aci_queue_add(aci_queue_t *aci_q, hal_aci_data_t *p_data)
 {
-  ble_assert(NULL != aci_q);
-  ble_assert(NULL != p_data);
+  const uint8_t length = p_data->buffer[0];
 
-  if (aci_queue_is_empty(aci_q))
+  if ((length > HAL_ACI_MAX_LENGTH) || !aci_queue_has_room(aci_q, length + 2))
   {
     return false;
   }
 
-  memcpy((uint8_t *)p_data, (uint8_t *)&(aci_q->aci_data[aci_q->head % ACI_QUEUE_SIZE]), sizeof(hal_aci_data_t));
-  ++aci_q->head;
+  aci_q->data[aci_q->tail] = 0;
+  memcpy(&aci_q->data[aci_q->tail + 1], (uint8_t *)&p_data->buffer[0], length + 1);
+  ACI_QUEUE_BARRIER();
+  aci_q->tail = aci_queue_next(aci_q, aci_q->tail, length + 2);
 
   return true;
 }
 
-bool aci_queue_dequeue_from_isr(aci_queue_t *aci_q, hal_aci_data_t *p_data)
+bool aci_queue_dequeue(aci_queue_t *aci_q, hal_aci_data_t *p_data)
 {
   ble_assert(NULL != aci_q);
   ble_assert(NULL != p_data);
 
-  if (aci_queue_is_empty_from_isr(aci_q))
+  if (!aci_queue_copy_head(aci_q, p_data))
   {
     return false;
   }
 
-  memcpy((uint8_t *)p_data, (uint8_t *)&(aci_q->aci_data[aci_q->head % ACI_QUEUE_SIZE]), sizeof(hal_aci_data_t));
-  ++aci_q->head;
+  ACI_QUEUE_BARRIER();
+  aci_q->head = aci_queue_next(aci_q, aci_q->head, p_data->buffer[0] + 2);
 
   return true;
 }
 
-bool aci_queue_enqueue(aci_queue_t *aci_q, hal_aci_data_t *p_data)
+bool aci_queue_dequeue_from_isr(aci_queue_t *aci_q, hal_aci_data_t *p_data)
 {
-  const uint8_t length = p_data->buffer[0];
+  return aci_queue_dequeue(aci_q, p_data);
+}
 
+bool aci_queue_enqueue(aci_queue_t *aci_q, hal_aci_data_t *p_data)
+{
   ble_assert(NULL != aci_q);
   ble_assert(NULL != p_data);
 
-  if (aci_queue_is_full(aci_q))
-  {
-    return false;
-  }
+  return aci_queue_add(aci_q, p_data);
+}
 
-  aci_q->aci_data[aci_q->tail % ACI_QUEUE_SIZE].status_byte = 0;
-  memcpy((uint8_t *)&(aci_q->aci_data[aci_q->tail % ACI_QUEUE_SIZE].buffer[0]), (uint8_t *)&p_data->buffer[0], length + 1);
-  ++aci_q->tail;
+bool aci_queue_enqueue_from_isr(aci_queue_t *aci_q, hal_aci_data_t *p_data)
+{
+  return aci_queue_enqueue(aci_q, p_data);
+}
 
-  return true;
+bool aci_queue_is_empty(aci_queue_t *aci_q)
+{
+  ble_assert(NULL != aci_q);
+
+  return aci_q->head == aci_q->tail;
 }
 
-bool aci_queue_enqueue_from_isr(aci_queue_t *aci_q, hal_aci_data_t *p_data)
+bool aci_queue_is_empty_from_isr(aci_queue_t *aci_q)
 {
-  const uint8_t length = p_data->buffer[0];
+  return aci_queue_is_empty(aci_q);
+}
+
+bool aci_queue_is_full(aci_queue_t *aci_q)
+{
+  ble_assert(NULL != aci_q);
+
+  return !aci_queue_has_room(aci_q, ACI_QUEUE_ENTRY_MAX);
+}
+
+bool aci_queue_is_full_from_isr(aci_queue_t *aci_q)
+{
+  return aci_queue_is_full(aci_q);
+}
+
+uint8_t aci_queue_bytes_used(aci_queue_t *aci_q)
+{
+  const uint8_t head = aci_q->head;
+  const uint8_t tail = aci_q->tail;
 
+  ble_assert(NULL != aci_q);
+
+  return (tail >= head) ? (tail - head) : (aci_q->size - head + tail);
+}
+
+bool aci_queue_peek(aci_queue_t *aci_q, hal_aci_data_t *p_data)
+{
   ble_assert(NULL != aci_q);
   ble_assert(NULL != p_data);
 
-  if (aci_queue_is_full_from_isr(aci_q))
-  {
-    return false;
-  }
+  return aci_queue_copy_head(aci_q, p_data);
+}
 
-  aci_q->aci_data[aci_q->tail % ACI_QUEUE_SIZE].status_byte = 0;
-  memcpy((uint8_t *)&(aci_q->aci_data[aci_q->tail % ACI_QUEUE_SIZE].buffer[0]), (uint8_t *)&p_data->buffer[0], length + 1);
-  ++aci_q->tail;
+bool aci_queue_peek_from_isr(aci_queue_t *aci_q, hal_aci_data_t *p_data)
+{
+  return aci_queue_peek(aci_q, p_data);
+}
 
-  return true;
+const hal_aci_data_t *aci_queue_peek_ptr(aci_queue_t *aci_q)
+{
+  return aci_queue_peek_slot_from_isr(aci_q);
 }
 
-bool aci_queue_is_empty(aci_queue_t *aci_q)
+void aci_queue_consume(aci_queue_t *aci_q)
+{
+  aci_queue_consume_from_isr(aci_q);
+}
+
+hal_aci_data_t *aci_queue_reserve(aci_queue_t *aci_q)
 {
-  bool state = false;
+  return aci_queue_reserve_from_isr(aci_q);
+}
 
+void aci_queue_commit(aci_queue_t *aci_q)
+{
+  aci_queue_commit_from_isr(aci_q);
+}
+
+hal_aci_data_t *aci_queue_peek_slot_from_isr(aci_queue_t *aci_q)
+{
   ble_assert(NULL != aci_q);
 
-  //Critical section
-  noInterrupts();
   if (aci_q->head == aci_q->tail)
   {
-    state = true;
+    return NULL;
   }
-  interrupts();
 
-  return state;
+  return (hal_aci_data_t *)&aci_q->data[aci_q->head];
 }
 
-bool aci_queue_is_empty_from_isr(aci_queue_t *aci_q)
+void aci_queue_consume_from_isr(aci_queue_t *aci_q)
 {
   ble_assert(NULL != aci_q);
+  ble_assert(aci_q->head != aci_q->tail);
 
-  return aci_q->head == aci_q->tail;
+  ACI_QUEUE_BARRIER();
+  aci_q->head = aci_queue_next(aci_q, aci_q->head, aci_queue_entry_length(aci_q, aci_q->head));
 }
 
-bool aci_queue_is_full(aci_queue_t *aci_q)
+hal_aci_data_t *aci_queue_reserve_from_isr(aci_queue_t *aci_q)
 {
-  bool state;
-
   ble_assert(NULL != aci_q);
 
-  //This should be done in a critical section
-  noInterrupts();
-  
-  state = (aci_q->tail == aci_q->head + ACI_QUEUE_SIZE);
-
-  interrupts();
-  //end
+  if (!aci_queue_has_room(aci_q, ACI_QUEUE_ENTRY_MAX))
+  {
+    return NULL;
+  }
 
-  return state;
+  return (hal_aci_data_t *)&aci_q->data[aci_q->tail];
 }
 
-bool aci_queue_is_full_from_isr(aci_queue_t *aci_q)
+void aci_queue_commit_from_isr(aci_queue_t *aci_q)
 {
   ble_assert(NULL != aci_q);
 
-  return (aci_q->tail == aci_q->head + ACI_QUEUE_SIZE);
+  ACI_QUEUE_BARRIER();
+  aci_q->tail = aci_queue_next(aci_q, aci_q->tail, aci_queue_entry_length(aci_q, aci_q->tail));
 }
 
-bool aci_queue_peek(aci_queue_t *aci_q, hal_aci_data_t *p_data)
+hal_aci_data_t *aci_queue_find_from_isr(aci_queue_t *aci_q, const uint8_t *p_match, uint8_t match_length)
 {
+  hal_aci_data_t *p_found = NULL;
+  uint8_t offset;
+
   ble_assert(NULL != aci_q);
-  ble_assert(NULL != p_data);
+  ble_assert(NULL != p_match);
 
-  if (aci_queue_is_empty(aci_q))
+  for (offset = aci_q->head; offset != aci_q->tail;
+       offset = aci_queue_next(aci_q, offset, aci_queue_entry_length(aci_q, offset)))
   {
-    return false;
+    if (0 == memcmp(&aci_q->data[offset + 1], p_match, match_length))
+    {
+      p_found = (hal_aci_data_t *)&aci_q->data[offset];
+    }
   }
 
-  memcpy((uint8_t *)p_data, (uint8_t *)&(aci_q->aci_data[aci_q->head % ACI_QUEUE_SIZE]), sizeof(hal_aci_data_t));
-
-  return true;
+  return p_found;
 }
 
-bool aci_queue_peek_from_isr(aci_queue_t *aci_q, hal_aci_data_t *p_data)
+hal_aci_data_t *aci_queue_newest_from_isr(aci_queue_t *aci_q)
 {
+  hal_aci_data_t *p_newest = NULL;
+  uint8_t offset;
+
   ble_assert(NULL != aci_q);
-  ble_assert(NULL != p_data);
 
-  if (aci_queue_is_empty_from_isr(aci_q))
+  for (offset = aci_q->head; offset != aci_q->tail;
+       offset = aci_queue_next(aci_q, offset, aci_queue_entry_length(aci_q, offset)))
   {
-    return false;
+    p_newest = (hal_aci_data_t *)&aci_q->data[offset];
   }
 
-  memcpy((uint8_t *)p_data, (uint8_t *)&(aci_q->aci_data[aci_q->head % ACI_QUEUE_SIZE]), sizeof(hal_aci_data_t));
-
-  return true;
-}
\ No newline at end of file
+  return p_newest;
+}
@@ -36,26 +36,111 @@
 #include "hal_aci_tl.h"
 
 /***********************************************************************    */
-/* The ACI_QUEUE_SIZE determines the memory usage of the system.            */
-/* Successfully tested to a ACI_QUEUE_SIZE of 4 (interrupt) and 4 (polling) */
+/* The queue byte budgets determine the memory usage of the system.         */
+/* Entries are stored with their length, so small events (credits, command  */
+/* responses) only take the bytes they need.                                */
+/* ACI_QUEUE_SIZE is the number of full size packets each queue holds by    */
+/* default, 2 with ACI_LOW_MEMORY. ACI_TX_QUEUE_BYTES and                   */
+/* ACI_RX_QUEUE_BYTES override it per queue.                                */
+/* Each budget must hold at least two full size packets, 255 bytes at most. */
 /***********************************************************************    */
+#ifndef ACI_QUEUE_SIZE
+#if ACI_LOW_MEMORY
+#define ACI_QUEUE_SIZE  2
+#else
 #define ACI_QUEUE_SIZE  4
+#endif
+#endif
+
+/* Largest entry: status byte, length byte and payload */
+#define ACI_QUEUE_ENTRY_MAX  (HAL_ACI_MAX_LENGTH + 2)
+
+#ifndef ACI_TX_QUEUE_BYTES
+#define ACI_TX_QUEUE_BYTES  (ACI_QUEUE_SIZE * ACI_QUEUE_ENTRY_MAX)
+#endif
+
+#ifndef ACI_RX_QUEUE_BYTES
+#define ACI_RX_QUEUE_BYTES  (ACI_QUEUE_SIZE * ACI_QUEUE_ENTRY_MAX)
+#endif
+
+/* Control command queue, sent ahead of the commands in ACI_TX_QUEUE_BYTES.      */
+/* SendDataAck, SendDataNack, ChangeTimingRequest, SetKey and Disconnect go      */
+/* there. The other commands stay in the main queue in order, so that e.g. a     */
+/* Connect is sent after the SetLocalData queued before it.                      */
+/* 0 : no control queue, all the commands are sent in the order they are queued. */
+#ifndef ACI_TX_CTRL_QUEUE_BYTES
+#define ACI_TX_CTRL_QUEUE_BYTES  0
+#endif
+
+/* Commands queued from interrupts by the *_from_isr() sends. The interrupt is    */
+/* the only producer of this queue, the transport sends it after the control      */
+/* queue and before ACI_TX_QUEUE_BYTES.                                           */
+/* 0 : no such queue, commands can only be queued from the loop.                  */
+#ifndef ACI_TX_ISR_QUEUE_BYTES
+#define ACI_TX_ISR_QUEUE_BYTES  0
+#endif
+
+/* Data event queue: the ACI_EVT_DATA_RECEIVED go there and the other events stay */
+/* in ACI_RX_QUEUE_BYTES, so a slow reader of the data does not hold them up. The */
+/* transfers stall only when one of the two is full. lib_aci_event_get() returns  */
+/* the data after the other events, but ahead of an ACI_EVT_DISCONNECTED received */
+/* after them. lib_aci_data_is_stale() flags those, the automatic acknowledgement */
+/* skips them. lib_aci_data_peek_ptr() reads the data ahead of the other events.  */
+/* 0 : no such queue, all the events are in the event queue in order.             */
+#ifndef ACI_RX_DATA_QUEUE_BYTES
+#define ACI_RX_DATA_QUEUE_BYTES  0
+#endif
+
+#if (ACI_TX_CTRL_QUEUE_BYTES != 0) && ((ACI_TX_CTRL_QUEUE_BYTES < (2 * ACI_QUEUE_ENTRY_MAX)) || (ACI_TX_CTRL_QUEUE_BYTES > 255))
+#error "ACI_TX_CTRL_QUEUE_BYTES must be 0, or hold two full size packets and not exceed 255"
+#endif
+
+#if (ACI_TX_ISR_QUEUE_BYTES != 0) && ((ACI_TX_ISR_QUEUE_BYTES < (2 * ACI_QUEUE_ENTRY_MAX)) || (ACI_TX_ISR_QUEUE_BYTES > 255))
+#error "ACI_TX_ISR_QUEUE_BYTES must be 0, or hold two full size packets and not exceed 255"
+#endif
+
+#if (ACI_RX_DATA_QUEUE_BYTES != 0) && ((ACI_RX_DATA_QUEUE_BYTES < (2 * ACI_QUEUE_ENTRY_MAX)) || (ACI_RX_DATA_QUEUE_BYTES > 255))
+#error "ACI_RX_DATA_QUEUE_BYTES must be 0, or hold two full size packets and not exceed 255"
+#endif
+
+#if (ACI_TX_QUEUE_BYTES < (2 * ACI_QUEUE_ENTRY_MAX)) || (ACI_TX_QUEUE_BYTES > 255)
+#error "ACI_TX_QUEUE_BYTES must hold two full size packets and not exceed 255"
+#endif
+
+#if (ACI_RX_QUEUE_BYTES < (2 * ACI_QUEUE_ENTRY_MAX)) || (ACI_RX_QUEUE_BYTES > 255)
+#error "ACI_RX_QUEUE_BYTES must hold two full size packets and not exceed 255"
+#endif
 
 /** Data type for queue of data packets to send/receive from radio.
  *
  *  A FIFO queue is maintained for packets. New packets are added (enqueued)
  *  at the tail and taken (dequeued) from the head. The head variable is the
- *  index of the next packet to dequeue while the tail variable is the index of
- *  where the next packet should be queued.
+ *  byte offset of the next packet to dequeue while the tail variable is the
+ *  byte offset of where the next packet should be queued.
+ *
+ *  Packets are stored back to back as [status byte][length][payload], laid out
+ *  like the start of a hal_aci_data_t. A packet never starts less than
+ *  ACI_QUEUE_ENTRY_MAX bytes before the end of the storage: when the next offset
+ *  would, both the producer and the consumer continue at offset 0. So every
+ *  packet is contiguous and can be used in place.
+ *
+ *  Each queue has a single producer and a single consumer (one of them the ISR
+ *  in interrupt mode). head is only written by the consumer and tail only by the
+ *  producer. Both are 8-bit, so they are read and written atomically and no
+ *  critical section is needed to test for empty or full.
  */
 
 typedef struct {
-	hal_aci_data_t           aci_data[ACI_QUEUE_SIZE];
-	uint8_t                  head;
-	uint8_t                  tail;
+	uint8_t                 *data;
+	uint8_t                  size;
+	volatile uint8_t         head;
+	volatile uint8_t         tail;
 } aci_queue_t;
 
-void aci_queue_init(aci_queue_t *aci_q);
+/** @brief Initialise the queue on the storage given, size bytes long.
+ *  @details size must be at least 2 * ACI_QUEUE_ENTRY_MAX and not more than 255.
+ */
+void aci_queue_init(aci_queue_t *aci_q, uint8_t *p_storage, uint8_t size);
 
 bool aci_queue_dequeue(aci_queue_t *aci_q, hal_aci_data_t *p_data);
 bool aci_queue_dequeue_from_isr(aci_queue_t *aci_q, hal_aci_data_t *p_data);
@@ -66,11 +151,70 @@ bool aci_queue_enqueue_from_isr(aci_queue_t *aci_q, hal_aci_data_t *p_data);
 bool aci_queue_is_empty(aci_queue_t *aci_q);
 bool aci_queue_is_empty_from_isr(aci_queue_t *aci_q);
 
+/** @brief Check if a full size packet can no longer be added.
+ *  @details A shorter packet may still fit, aci_queue_enqueue() checks for its actual length.
+ */
 bool aci_queue_is_full(aci_queue_t *aci_q);
 bool aci_queue_is_full_from_isr(aci_queue_t *aci_q);
 
+/** @brief Number of storage bytes in use, including the unused end of the storage when the queue has wrapped. */
+uint8_t aci_queue_bytes_used(aci_queue_t *aci_q);
+
+/** @brief Copy the head packet without removing it.
+ *  @details Only the status byte, the length and the payload are copied into p_data.
+ */
 bool aci_queue_peek(aci_queue_t *aci_q, hal_aci_data_t *p_data);
 bool aci_queue_peek_from_isr(aci_queue_t *aci_q, hal_aci_data_t *p_data);
 
+/** @brief Get the head packet in place without removing it, NULL if the queue is empty.
+ *  @details Call from the consumer side. The packet stays valid until aci_queue_consume() is called.
+ *  Only the status byte, buffer[0] and buffer[1..buffer[0]] belong to the packet.
+ */
+const hal_aci_data_t *aci_queue_peek_ptr(aci_queue_t *aci_q);
+
+/** @brief Remove the head packet returned by aci_queue_peek_ptr(). */
+void aci_queue_consume(aci_queue_t *aci_q);
+
+/** @brief Get room for a full size packet at the tail without adding it, NULL if the queue is full.
+ *  @details Call from the producer side, the packet is encoded in place and only added by
+ *  aci_queue_commit(). Not committing discards it.
+ */
+hal_aci_data_t *aci_queue_reserve(aci_queue_t *aci_q);
+
+/** @brief Add the packet returned by aci_queue_reserve() to the queue. */
+void aci_queue_commit(aci_queue_t *aci_q);
+
+/* In-place access used by the transport layer to clock SPI data straight into and out of the queue.
+   These are not protected against interrupts, call them from the ISR or with the ISR not attached. */
+
+/** @brief Get the head entry without removing it, NULL if the queue is empty.
+ *  @details The entry stays valid until aci_queue_consume_from_isr() is called.
+ *  Only the status byte, buffer[0] and buffer[1..buffer[0]] belong to the entry.
+ */
+hal_aci_data_t *aci_queue_peek_slot_from_isr(aci_queue_t *aci_q);
+
+/** @brief Remove the head entry returned by aci_queue_peek_slot_from_isr(). */
+void aci_queue_consume_from_isr(aci_queue_t *aci_q);
+
+/** @brief Get room for a full size entry without adding it, NULL if the queue is full.
+ *  @details The entry is only added by aci_queue_commit_from_isr(), using the length then
+ *  in buffer[0]. Not committing discards it.
+ */
+hal_aci_data_t *aci_queue_reserve_from_isr(aci_queue_t *aci_q);
+
+/** @brief Add the entry returned by aci_queue_reserve_from_isr() to the queue. */
+void aci_queue_commit_from_isr(aci_queue_t *aci_q);
+
+/** @brief Find the newest entry that starts with the given bytes, NULL if there is none.
+ *  @details p_match is compared with buffer[0..match_length-1], the length byte included, so
+ *  the entry found has the same length. The consumer must not run while the entry is used.
+ */
+hal_aci_data_t *aci_queue_find_from_isr(aci_queue_t *aci_q, const uint8_t *p_match, uint8_t match_length);
+
+/** @brief Get the newest entry, NULL if the queue is empty.
+ *  @details Call from the producer side. The consumer may be using the entry when it is also the head one.
+ */
+hal_aci_data_t *aci_queue_newest_from_isr(aci_queue_t *aci_q);
+
 #endif /* ACI_QUEUE_H__ */
 /** @} */
\ No newline at end of file
@@ -0,0 +1,260 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+/** @file
+@brief Implementation of the recovery snapshot
+*/
+
+#include <stddef.h>
+#include <lib_aci.h>
+#include "aci_recovery.h"
+#include "aci_crc.h"
+
+#define ACI_RECOVERY_MARKER  0x7EC0
+
+#define ACI_RECOVERY_LINK    0x01   // The link was up
+#define ACI_RECOVERY_TIMING  0x02   // The timing is the one of the last link
+
+/* Kept through resets of the MCU, checked with the marker and the CRC */
+typedef struct
+{
+  uint16_t marker;
+  uint16_t setup_crc;
+  uint8_t  flags;
+  uint8_t  bond;
+  uint16_t conn_interval;
+  uint16_t slave_latency;
+  uint16_t supervision_timeout;
+  uint8_t  pipes_open[PIPES_ARRAY_SIZE];
+  uint16_t crc;                           // Of the bytes before it
+} aci_recovery_snapshot_t;
+
+typedef struct
+{
+  bool                 resume_pending;   // The link was lost, waits for the next Connected
+  bool                 pipes_pending;    // Resumed, waits for the Pipe Status
+  aci_recovery_stats_t stats;
+} aci_recovery_ctx_t;
+
+static aci_recovery_snapshot_t aci_recovery_snapshot[HAL_ACI_INSTANCES] ACI_RECOVERY_SECTION;
+static aci_recovery_ctx_t      aci_recovery_ctx[HAL_ACI_INSTANCES];
+
+#define aci_recovery_snap_cur  (&aci_recovery_snapshot[hal_aci_tl_selected()])
+#define aci_recovery_cur       (&aci_recovery_ctx[hal_aci_tl_selected()])
+
+static uint16_t aci_recovery_crc(const aci_recovery_snapshot_t *p_snap)
+{
+  return aci_crc16_ccitt(ACI_CRC16_CCITT_INIT, (const uint8_t *)p_snap, offsetof(aci_recovery_snapshot_t, crc));
+}
+
+static void aci_recovery_store(aci_recovery_snapshot_t *p_snap)
+{
+  p_snap->marker = ACI_RECOVERY_MARKER;
+  p_snap->crc    = aci_recovery_crc(p_snap);
+}
+
+static bool aci_recovery_snap_valid(const aci_recovery_snapshot_t *p_snap)
+{
+  return (ACI_RECOVERY_MARKER == p_snap->marker) && (aci_recovery_crc(p_snap) == p_snap->crc);
+}
+
+bool aci_recovery_is_valid(aci_state_t *aci_stat)
+{
+  lib_aci_select(aci_stat);
+
+  return aci_recovery_snap_valid(aci_recovery_snap_cur) &&
+         (aci_setup_crc(aci_stat) == aci_recovery_snap_cur->setup_crc);
+}
+
+bool aci_recovery_had_link(aci_state_t *aci_stat)
+{
+  return aci_recovery_is_valid(aci_stat) && (0 != (aci_recovery_snap_cur->flags & ACI_RECOVERY_LINK));
+}
+
+void aci_recovery_bond_set(aci_state_t *aci_stat, uint8_t bond)
+{
+  lib_aci_select(aci_stat);
+
+  if (aci_recovery_snap_valid(aci_recovery_snap_cur) && (bond != aci_recovery_snap_cur->bond))
+  {
+    aci_recovery_snap_cur->bond = bond;
+    aci_recovery_store(aci_recovery_snap_cur);
+  }
+}
+
+uint8_t aci_recovery_bond(aci_state_t *aci_stat)
+{
+  return aci_recovery_is_valid(aci_stat) ? aci_recovery_snap_cur->bond : ACI_RECOVERY_NO_BOND;
+}
+
+void aci_recovery_clear(aci_state_t *aci_stat)
+{
+  lib_aci_select(aci_stat);
+
+  aci_recovery_snap_cur->marker    = 0;
+  aci_recovery_cur->resume_pending = false;
+  aci_recovery_cur->pipes_pending  = false;
+}
+
+void aci_recovery_stats_get(aci_state_t *aci_stat, aci_recovery_stats_t *p_stats)
+{
+  lib_aci_select(aci_stat);
+
+  *p_stats = aci_recovery_cur->stats;
+}
+
+/*
+  Starts the snapshot again for a setup that is not the one it was taken with.
+*/
+static void aci_recovery_start(aci_state_t *aci_stat, aci_recovery_snapshot_t *p_snap)
+{
+  memset(p_snap, 0, sizeof(*p_snap));
+  p_snap->setup_crc = aci_setup_crc(aci_stat);
+  p_snap->bond      = ACI_RECOVERY_NO_BOND;
+  aci_recovery_store(p_snap);
+}
+
+static void aci_recovery_timing_set(aci_recovery_snapshot_t *p_snap, uint16_t interval, uint16_t latency, uint16_t timeout)
+{
+  p_snap->conn_interval       = interval;
+  p_snap->slave_latency       = latency;
+  p_snap->supervision_timeout = timeout;
+  p_snap->flags              |= ACI_RECOVERY_TIMING;
+}
+
+/*
+  Opens the remote pipes that were open on the lost link and are closed on this one.
+*/
+static void aci_recovery_pipes_open(aci_state_t *aci_stat, const aci_recovery_snapshot_t *p_snap)
+{
+  uint8_t pipe;
+
+  for (pipe = 1; pipe < ACI_DEVICE_MAX_PIPES; pipe++)
+  {
+    if ((0 != (p_snap->pipes_open[pipe / 8] & (1 << (pipe % 8)))) &&
+        lib_aci_is_pipe_closed(aci_stat, pipe) && lib_aci_open_remote_pipe(aci_stat, pipe))
+    {
+      aci_recovery_cur->stats.pipes_reopened++;
+    }
+  }
+}
+
+void aci_recovery_event(aci_state_t *aci_stat, const aci_evt_t *p_evt)
+{
+  aci_recovery_snapshot_t *p_snap;
+  aci_recovery_ctx_t      *p_ctx;
+
+  lib_aci_select(aci_stat);
+  p_snap = aci_recovery_snap_cur;
+  p_ctx  = aci_recovery_cur;
+
+  switch (p_evt->evt_opcode)
+  {
+    case ACI_EVT_DEVICE_STARTED:
+      if (ACI_DEVICE_STANDBY != p_evt->params.device_started.device_mode)
+      {
+        break;
+      }
+      if (!aci_recovery_is_valid(aci_stat))
+      {
+        aci_recovery_start(aci_stat, p_snap);
+      }
+      else if (0 != (p_snap->flags & ACI_RECOVERY_LINK))
+      {
+        // The link was not ended by a Disconnected
+        p_ctx->resume_pending = true;
+      }
+      break;
+
+    case ACI_EVT_CONNECTED:
+      if (!aci_recovery_snap_valid(p_snap))
+      {
+        break;
+      }
+      p_ctx->pipes_pending = p_ctx->resume_pending;
+      if (p_ctx->resume_pending)
+      {
+        p_ctx->resume_pending = false;
+        p_ctx->stats.resumes++;
+        if ((0 != (p_snap->flags & ACI_RECOVERY_TIMING)) &&
+            ((p_snap->conn_interval       != p_evt->params.connected.conn_rf_interval) ||
+             (p_snap->slave_latency       != p_evt->params.connected.conn_slave_rf_latency) ||
+             (p_snap->supervision_timeout != p_evt->params.connected.conn_rf_timeout)) &&
+            lib_aci_change_timing(p_snap->conn_interval, p_snap->conn_interval,
+                                  p_snap->slave_latency, p_snap->supervision_timeout))
+        {
+          p_ctx->stats.timing_restores++;
+        }
+      }
+      else
+      {
+        aci_recovery_timing_set(p_snap, p_evt->params.connected.conn_rf_interval,
+                                p_evt->params.connected.conn_slave_rf_latency,
+                                p_evt->params.connected.conn_rf_timeout);
+      }
+      p_snap->flags |= ACI_RECOVERY_LINK;
+      aci_recovery_store(p_snap);
+      break;
+
+    case ACI_EVT_TIMING:
+      if (!aci_recovery_snap_valid(p_snap))
+      {
+        break;
+      }
+      aci_recovery_timing_set(p_snap, p_evt->params.timing.conn_rf_interval,
+                              p_evt->params.timing.conn_slave_rf_latency,
+                              p_evt->params.timing.conn_rf_timeout);
+      aci_recovery_store(p_snap);
+      break;
+
+    case ACI_EVT_PIPE_STATUS:
+      if (!aci_recovery_snap_valid(p_snap))
+      {
+        break;
+      }
+      if (p_ctx->pipes_pending)
+      {
+        // The pipes of the lost link are kept until they are open again
+        p_ctx->pipes_pending = false;
+        aci_recovery_pipes_open(aci_stat, p_snap);
+      }
+      else if (0 != memcmp(p_snap->pipes_open, aci_stat->pipes_open_bitmap, PIPES_ARRAY_SIZE))
+      {
+        memcpy(p_snap->pipes_open, aci_stat->pipes_open_bitmap, PIPES_ARRAY_SIZE);
+        aci_recovery_store(p_snap);
+      }
+      break;
+
+    case ACI_EVT_DISCONNECTED:
+      p_ctx->resume_pending = false;
+      p_ctx->pipes_pending  = false;
+      if (aci_recovery_snap_valid(p_snap) && (0 != (p_snap->flags & ACI_RECOVERY_LINK)))
+      {
+        p_snap->flags &= ~ACI_RECOVERY_LINK;
+        aci_recovery_store(p_snap);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
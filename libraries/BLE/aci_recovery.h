@@ -0,0 +1,101 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+/** @file
+ * @brief Snapshot of the link kept through resets, to resume it with few ACI commands.
+ */
+
+/** @defgroup aci_recovery aci_recovery
+@{
+@ingroup lib
+
+@brief Takes the link back to where it was after an ACI_EVT_HW_ERROR of the nRF8001 or a reset of
+the MCU, in place of the usual start of the templates.
+@details aci_recovery_event(), called with every ACI event, keeps a snapshot of the link in RAM that
+the C startup code does not clear (ACI_RECOVERY_SECTION): the CRC of the setup, the bond slot of
+aci_recovery_bond_set(), the pipes open and the last timing of the link. It is checked with a
+marker and the aci_crc CRC-16-CCITT of its bytes, and thrown away when the setup has changed.
+
+A Device Started in Standby while the snapshot still holds a link, i.e. the link was lost to a
+hardware error or to a reset and not to a disconnect, arms the resume. When the peer connects again
+the last timing is asked for with one Change Timing, instead of the GAP PPCP negotiation, and the
+Pipe Status that follows opens the remote pipes that were open and are closed again. The advertising
+itself stays with the sketch or aci_run(): after an ACI_EVT_HW_ERROR it is started right away, there
+is no need for the delay(20) of the templates.
+
+With ACI_SETUP_RETAIN, lib_aci_init() after a reset of the MCU does not pin reset the nRF8001 and
+has no setup to send, and aci_recovery_bond() gives the bond to use without a search of the bond
+store. A Disconnected, the advertising timeout included, ends the window in which a link is resumed.
+*/
+
+#ifndef ACI_RECOVERY_H__
+#define ACI_RECOVERY_H__
+
+#include <lib_aci.h>
+#include "aci_setup.h"
+
+/************************************************************************/
+/* Section of the recovery snapshot                                      */
+/* Must be RAM that the C startup code does not clear, as the retained   */
+/* setup. Without one only the hardware errors of the nRF8001 are        */
+/* recovered, a reset of the MCU starts from scratch.                    */
+/************************************************************************/
+#ifndef ACI_RECOVERY_SECTION
+#define ACI_RECOVERY_SECTION ACI_SETUP_RETAIN_SECTION
+#endif
+
+/** Returned by aci_recovery_bond() when the snapshot holds no bond */
+#define ACI_RECOVERY_NO_BOND  0xFF
+
+typedef struct
+{
+  uint16_t resumes;                      /**< Links lost to a hardware error or a reset, resumed */
+  uint16_t timing_restores;              /**< Change Timing sent with the last timing */
+  uint16_t pipes_reopened;               /**< Open Remote Pipe sent for the pipes that were open */
+} aci_recovery_stats_t;
+
+/** @brief Keeps the snapshot and resumes the link.
+ *  @details Call with every event, after lib_aci_event_get() has updated the ACI state. Sends a
+ *  Change Timing on the Connected and Open Remote Pipe on the Pipe Status of a resumed link.
+ */
+void aci_recovery_event(aci_state_t *aci_stat, const aci_evt_t *p_evt);
+
+/** @brief Whether the snapshot survived the last reset and is for the setup in aci_setup_info */
+bool aci_recovery_is_valid(aci_state_t *aci_stat);
+
+/** @brief Whether the link was up when the snapshot was last updated, e.g. to advertise faster */
+bool aci_recovery_had_link(aci_state_t *aci_stat);
+
+/** @brief Puts the bond slot of the link in the snapshot, ACI_RECOVERY_NO_BOND for none */
+void aci_recovery_bond_set(aci_state_t *aci_stat, uint8_t bond);
+
+/** @brief Bond slot of the snapshot, ACI_RECOVERY_NO_BOND if none or the snapshot is not valid */
+uint8_t aci_recovery_bond(aci_state_t *aci_stat);
+
+/** @brief Throws the snapshot away, the next start is a cold one */
+void aci_recovery_clear(aci_state_t *aci_stat);
+
+/** @brief Gets the counters since the MCU started */
+void aci_recovery_stats_get(aci_state_t *aci_stat, aci_recovery_stats_t *p_stats);
+
+#endif // ACI_RECOVERY_H__
+/** @} */
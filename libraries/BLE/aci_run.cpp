@@ -0,0 +1,442 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+/** @file
+@brief Implementation of the ACI run loop
+*/
+
+#include <lib_aci.h>
+#include "aci_run.h"
+#if ACI_RUN_RECOVERY
+#include "aci_recovery.h"
+#endif
+#include "aci_setup.h"
+#include "ble_assert.h"
+
+void aci_run_init(aci_run_t *p_run, const aci_run_params_t *p_params)
+{
+  ble_assert(NULL != p_params);
+
+  memset(p_run, 0, sizeof(*p_run));
+  p_run->p_params = p_params;
+}
+
+#if ACI_RUN_TASKS
+bool aci_run_task_add(aci_run_t *p_run, aci_run_task_t task)
+{
+  if ((NULL == task) || (p_run->task_count >= ACI_RUN_TASKS))
+  {
+    return false;
+  }
+  p_run->tasks[p_run->task_count++] = task;
+  return true;
+}
+#endif
+
+#if ACI_RUN_TIMERS
+bool aci_run_timer_add(aci_run_t *p_run, aci_run_task_t task, uint16_t period_ms)
+{
+  aci_run_timer_t *p_timer;
+
+  if ((NULL == task) || (0 == period_ms) || (p_run->timer_count >= ACI_RUN_TIMERS))
+  {
+    return false;
+  }
+  p_timer = &p_run->timers[p_run->timer_count++];
+  p_timer->task      = task;
+  p_timer->period_ms = period_ms;
+  p_timer->due_ms    = millis() + period_ms;
+  return true;
+}
+#endif
+
+/*
+  Starts the advertising again, from the directed advertising with ACI_RUN_RECONNECT.
+*/
+static void aci_run_advertise_restart(aci_run_t *p_run)
+{
+  p_run->advertise_pending = true;
+#if ACI_RUN_RECONNECT
+  p_run->advertise_phase   = ACI_RUN_ADVERTISE_DIRECT;
+#endif
+}
+
+void aci_run_advertise(aci_run_t *p_run)
+{
+  aci_run_advertise_restart(p_run);
+}
+
+#if ACI_RUN_RECONNECT
+/*
+  Goes on to the phase after the one that has timed out or was refused, the slow advertising is the
+  last one.
+*/
+static void aci_run_advertise_next(aci_run_t *p_run)
+{
+  if ((ACI_RUN_ADVERTISE_DIRECT == p_run->advertise_phase) && (0 != p_run->p_params->fast_timeout_s))
+  {
+    p_run->advertise_phase = ACI_RUN_ADVERTISE_FAST;
+  }
+  else
+  {
+    p_run->advertise_phase = ACI_RUN_ADVERTISE_SLOW;
+  }
+}
+#endif
+
+/*
+  Sends the Connect, or the ConnectDirect, once there is room for it in the command queue.
+*/
+static void aci_run_advertise_send(aci_run_t *p_run, aci_state_t *aci_stat)
+{
+  bool sent;
+
+#if ACI_RUN_RECONNECT
+  if ((ACI_RUN_ADVERTISE_DIRECT == p_run->advertise_phase) &&
+      (ACI_BOND_STATUS_SUCCESS != aci_stat->bonded))
+  {
+    aci_run_advertise_next(p_run);
+  }
+  if (ACI_RUN_ADVERTISE_DIRECT == p_run->advertise_phase)
+  {
+    sent = lib_aci_direct_connect();
+    if (sent)
+    {
+      p_run->stats.direct_starts++;
+    }
+  }
+  else if (ACI_RUN_ADVERTISE_FAST == p_run->advertise_phase)
+  {
+    sent = lib_aci_connect(p_run->p_params->fast_timeout_s, p_run->p_params->fast_interval);
+  }
+  else
+#else
+  (void)aci_stat;
+#endif
+  {
+    sent = lib_aci_connect(p_run->p_params->advertising_timeout_s, p_run->p_params->advertising_interval);
+  }
+  if (sent)
+  {
+    p_run->advertise_pending = false;
+    p_run->stats.advertising_starts++;
+#if LIB_ACI_AUTO_WAKEUP
+    p_run->radio_busy = true;
+#endif
+  }
+}
+
+#if LIB_ACI_AUTO_WAKEUP
+bool aci_run_wakeup(aci_run_t *p_run, aci_state_t *aci_stat)
+{
+  if ((ACI_DEVICE_SLEEP != aci_stat->device_state) || p_run->radio_waking)
+  {
+    return false;
+  }
+  p_run->radio_waking = lib_aci_wakeup();
+  return p_run->radio_waking;
+}
+
+/*
+  Puts the nRF8001 to sleep once it has idled in Standby for radio_sleep_after_ms.
+*/
+static void aci_run_radio_idle(aci_run_t *p_run, aci_state_t *aci_stat)
+{
+  if ((0 == p_run->p_params->radio_sleep_after_ms) ||
+      (ACI_DEVICE_STANDBY != aci_stat->device_state) || p_run->radio_busy ||
+      p_run->advertise_pending || p_run->setup_required || !lib_aci_command_queue_empty() ||
+      ((millis() - p_run->radio_idle_ms) < p_run->p_params->radio_sleep_after_ms))
+  {
+    return;
+  }
+  if (lib_aci_sleep())
+  {
+    aci_stat->device_state = ACI_DEVICE_SLEEP;
+    p_run->stats.radio_sleeps++;
+  }
+}
+#endif
+
+/*
+  The life cycle of the nRF8001, as in the aci_loop() of the examples.
+*/
+static void aci_run_event(aci_run_t *p_run, aci_state_t *aci_stat, const aci_evt_t *p_evt)
+{
+  switch (p_evt->evt_opcode)
+  {
+    case ACI_EVT_DEVICE_STARTED:
+#if LIB_ACI_AUTO_WAKEUP
+      if (ACI_DEVICE_SLEEP == aci_stat->device_state)
+      {
+        p_run->stats.radio_wakeups++;
+      }
+      p_run->radio_busy   = false;
+      p_run->radio_waking = false;
+#endif
+      aci_stat->device_state = (aci_device_operation_mode_t)p_evt->params.device_started.device_mode;
+#if !LIB_ACI_CREDIT_TRACKING
+      aci_stat->data_credit_total     = p_evt->params.device_started.credit_available;
+      aci_stat->data_credit_available = p_evt->params.device_started.credit_available;
+#endif
+      if (ACI_DEVICE_SETUP == p_evt->params.device_started.device_mode)
+      {
+        p_run->setup_required = true;
+      }
+      else if ((ACI_DEVICE_STANDBY == p_evt->params.device_started.device_mode) &&
+               !p_evt->params.device_started.hw_error && p_run->p_params->advertise)
+      {
+        // After a hardware error the advertising is started by the ACI_EVT_HW_ERROR that follows
+        aci_run_advertise_restart(p_run);
+      }
+      break;
+
+    case ACI_EVT_CMD_RSP:
+      // The setup answers with ACI_STATUS_TRANSACTION_CONTINUE and ACI_STATUS_TRANSACTION_COMPLETE
+      if ((ACI_STATUS_SUCCESS              != p_evt->params.cmd_rsp.cmd_status) &&
+          (ACI_STATUS_TRANSACTION_CONTINUE != p_evt->params.cmd_rsp.cmd_status) &&
+          (ACI_STATUS_TRANSACTION_COMPLETE != p_evt->params.cmd_rsp.cmd_status))
+      {
+        p_run->stats.cmd_errors++;
+#if ACI_RUN_RECONNECT
+        // Without a bond in the nRF8001 the ConnectDirect is refused, the fast advertising is next
+        if (ACI_CMD_CONNECT_DIRECT == p_evt->params.cmd_rsp.cmd_opcode)
+        {
+#if LIB_ACI_AUTO_WAKEUP
+          p_run->radio_busy        = false;
+#endif
+          aci_run_advertise_next(p_run);
+          p_run->advertise_pending = true;
+        }
+#endif
+      }
+      break;
+
+#if (LIB_ACI_AUTO_WAKEUP || ACI_RUN_RECONNECT)
+    case ACI_EVT_CONNECTED:
+#if LIB_ACI_AUTO_WAKEUP
+      p_run->radio_busy = true;
+#endif
+#if ACI_RUN_RECONNECT
+      if (ACI_RUN_ADVERTISE_DIRECT == p_run->advertise_phase)
+      {
+        p_run->stats.direct_connects++;
+      }
+      else if (ACI_RUN_ADVERTISE_FAST == p_run->advertise_phase)
+      {
+        p_run->stats.fast_connects++;
+      }
+#endif
+      break;
+#endif
+
+#if ACI_RUN_RECONNECT
+    case ACI_EVT_BOND_STATUS:
+      if (ACI_BOND_STATUS_SUCCESS == p_evt->params.bond_status.status_code)
+      {
+        aci_stat->bonded = ACI_BOND_STATUS_SUCCESS;
+      }
+      break;
+#endif
+
+    case ACI_EVT_DISCONNECTED:
+#if ACI_RUN_RECONNECT
+      if (ACI_STATUS_ERROR_ADVT_TIMEOUT != p_evt->params.disconnected.aci_status)
+      {
+        // The link is lost, the bonded peer is likely to be back soon
+        p_run->advertise_phase = ACI_RUN_ADVERTISE_DIRECT;
+      }
+      else if (ACI_RUN_ADVERTISE_SLOW != p_run->advertise_phase)
+      {
+#if LIB_ACI_AUTO_WAKEUP
+        p_run->radio_busy = false;
+#endif
+        aci_run_advertise_next(p_run);
+        p_run->advertise_pending = true;
+        break;
+      }
+#endif
+#if LIB_ACI_AUTO_WAKEUP
+      p_run->radio_busy = false;
+      // With the radio sleep the nRF8001 idles once the advertising has timed out
+      if ((0 != p_run->p_params->radio_sleep_after_ms) &&
+          (ACI_STATUS_ERROR_ADVT_TIMEOUT == p_evt->params.disconnected.aci_status))
+      {
+        break;
+      }
+#endif
+      if (p_run->p_params->advertise)
+      {
+        p_run->advertise_pending = true;
+      }
+      break;
+
+    case ACI_EVT_HW_ERROR:
+      p_run->stats.hw_errors++;
+      if (p_run->p_params->advertise)
+      {
+        aci_run_advertise_restart(p_run);
+      }
+      break;
+
+#if !LIB_ACI_CREDIT_TRACKING
+    case ACI_EVT_DATA_CREDIT:
+      aci_stat->data_credit_available += p_evt->params.data_credit.credit;
+      break;
+
+    case ACI_EVT_PIPE_ERROR:
+      // The Attribute protocol Error Response of the peer does not take a credit
+      if (ACI_STATUS_ERROR_PEER_ATT_ERROR != p_evt->params.pipe_error.error_code)
+      {
+        aci_stat->data_credit_available++;
+      }
+      break;
+#endif
+
+    default:
+      break;
+  }
+}
+
+/*
+  Calls the timers whose period is over, the next period starts from now when one is late.
+*/
+#if ACI_RUN_TIMERS
+static void aci_run_timers(aci_run_t *p_run, aci_state_t *aci_stat)
+{
+  uint8_t i;
+
+  for (i = 0; i < p_run->timer_count; i++)
+  {
+    aci_run_timer_t *p_timer = &p_run->timers[i];
+    unsigned long    now_ms  = millis();
+
+    if ((long)(now_ms - p_timer->due_ms) < 0)
+    {
+      continue;
+    }
+    p_timer->due_ms += p_timer->period_ms;
+    if ((long)(now_ms - p_timer->due_ms) >= 0)
+    {
+      p_timer->due_ms = now_ms + p_timer->period_ms;
+    }
+    p_timer->task(aci_stat);
+  }
+}
+#endif
+
+bool aci_run(aci_run_t *p_run, aci_state_t *aci_stat)
+{
+#if ACI_LOW_MEMORY
+  hal_aci_evt_t *p_aci_data = lib_aci_event_buffer();
+#else
+  hal_aci_evt_t *p_aci_data = &p_run->aci_data;
+#endif
+  bool    busy         = false;
+  bool    setup_events = false;
+  uint8_t i;
+
+  p_run->stats.passes++;
+
+  if (p_run->setup_required)
+  {
+    uint8_t result = aci_setup_poll(aci_stat);
+
+    busy         = true;
+    setup_events = (SETUP_IN_PROGRESS == result);
+    if (SETUP_SUCCESS == result)
+    {
+      p_run->setup_required = false;
+      p_run->stats.setups++;
+    }
+    else if (SETUP_IN_PROGRESS != result)
+    {
+      // The event that ended the setup is handled below, the next pass starts the setup again
+      p_run->stats.setup_failures++;
+    }
+  }
+
+  // The setup takes the events while it runs, a Device Started in Setup ends the pass
+  for (i = 0; (i < ACI_RUN_EVENTS_PER_PASS) && !setup_events; i++)
+  {
+    if (!lib_aci_event_get(aci_stat, p_aci_data))
+    {
+      break;
+    }
+    busy = true;
+    p_run->stats.events++;
+#if LIB_ACI_AUTO_WAKEUP
+    p_run->radio_idle_ms = millis();
+#endif
+    aci_run_event(p_run, aci_stat, &p_aci_data->evt);
+#if ACI_RUN_RECOVERY
+    aci_recovery_event(aci_stat, &p_aci_data->evt);
+#endif
+    if (NULL != p_run->p_params->event_handler)
+    {
+      p_run->p_params->event_handler(aci_stat, &p_aci_data->evt);
+    }
+    if (p_run->setup_required)
+    {
+      break;
+    }
+  }
+
+#if LIB_ACI_AUTO_WAKEUP
+  // The Connect is sent once the nRF8001 is back in Standby
+  if (p_run->advertise_pending && (ACI_DEVICE_SLEEP == aci_stat->device_state))
+  {
+    aci_run_wakeup(p_run, aci_stat);
+  }
+  else
+#endif
+  if (p_run->advertise_pending && !p_run->setup_required)
+  {
+    aci_run_advertise_send(p_run, aci_stat);
+  }
+
+#if ACI_RUN_TASKS
+  for (i = 0; i < p_run->task_count; i++)
+  {
+    p_run->tasks[i](aci_stat);
+  }
+#endif
+#if ACI_RUN_TIMERS
+  aci_run_timers(p_run, aci_stat);
+#endif
+#if LIB_ACI_AUTO_WAKEUP
+  aci_run_radio_idle(p_run, aci_stat);
+#endif
+
+  if (!busy && !p_run->advertise_pending && (ACI_RUN_NO_SLEEP != p_run->p_params->sleep_mode))
+  {
+    if (lib_aci_idle(p_run->p_params->sleep_mode))
+    {
+      p_run->stats.sleeps++;
+    }
+  }
+  return busy;
+}
+
+void aci_run_stats_get(const aci_run_t *p_run, aci_run_stats_t *p_stats)
+{
+  *p_stats = p_run->stats;
+}
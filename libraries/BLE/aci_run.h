@@ -0,0 +1,265 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+/** @file
+ * @brief Runs the ACI event loop of a sketch, its tasks and its timers.
+ */
+
+/** @defgroup aci_run aci_run
+@{
+@ingroup lib
+
+@brief Handles the life cycle of the nRF8001 that every sketch carries in its aci_loop(), and runs
+the tasks and timers of the application in between the ACI events.
+@details Each aci_run() takes up to ACI_RUN_EVENTS_PER_PASS events from lib_aci_event_get() and
+handles the life cycle events before giving every event to the event handler of the sketch:
+ - ACI_EVT_DEVICE_STARTED sets device_state and the data credits. In Setup the setup is run with
+   aci_setup_poll(), a setup that fails is started again. In Standby the advertising is started.
+ - ACI_EVT_DISCONNECTED and ACI_EVT_HW_ERROR start the advertising again.
+ - An ACI_EVT_CMD_RSP with an error is counted and given to the event handler, the loop goes on.
+ - Without LIB_ACI_CREDIT_TRACKING, ACI_EVT_DATA_CREDIT and ACI_EVT_PIPE_ERROR give the credits back.
+A Connect that does not fit in the command queue is sent again by the next pass.
+With ACI_RUN_RECOVERY the events also go to aci_recovery_event(), before the event handler.
+
+The tasks are then called on every pass and the timers once their period is over. When the pass had
+nothing to do, lib_aci_idle() puts the MCU in sleep_mode until the next interrupt. With timers use
+SLEEP_MODE_IDLE, millis() stops in the deeper sleep modes.
+
+With LIB_ACI_AUTO_WAKEUP and a radio_sleep_after_ms, the nRF8001 is put to sleep once it has been
+in Standby, neither advertising nor connected, with no event and no command queued, for
+radio_sleep_after_ms. The advertising is then not started again when it times out. lib_aci wakes
+the nRF8001 up for any command sent while it sleeps, aci_run_advertise() and aci_run_wakeup() wake
+it up too, and its Device Started in Standby starts the advertising as usual.
+
+With ACI_RUN_RECONNECT a peer that was bonded gets the link back within a few connection events.
+The advertising goes through these phases, each one started when the one before times out:
+ - ACI_RUN_ADVERTISE_DIRECT, when aci_stat->bonded is ACI_BOND_STATUS_SUCCESS: lib_aci_direct_connect(),
+   the directed advertising of the nRF8001 to its bonded peer for 1.28 s.
+ - ACI_RUN_ADVERTISE_FAST, for fast_timeout_s when it is not 0: lib_aci_connect() at fast_interval.
+ - ACI_RUN_ADVERTISE_SLOW: lib_aci_connect() with advertising_timeout_s and advertising_interval,
+   started again as before when it times out.
+A Device Started in Standby, a link lost and a hardware error start over from the directed
+advertising, a ConnectDirect refused by the nRF8001 goes on to the next phase. aci_stat->bonded is
+set by a Bond Status with ACI_BOND_STATUS_SUCCESS, or by the sketch once it has restored the bond.
+
+Call aci_run() from loop() in place of the aci_loop() of the examples.
+*/
+
+#ifndef ACI_RUN_H__
+#define ACI_RUN_H__
+
+#include <lib_aci.h>
+
+/************************************************************************/
+/* Tasks called on every pass of aci_run()                               */
+/* 0 to 8.                                                               */
+/************************************************************************/
+#ifndef ACI_RUN_TASKS
+#define ACI_RUN_TASKS 4
+#endif
+
+/************************************************************************/
+/* Timers of aci_run()                                                   */
+/* 0 to 8.                                                               */
+/************************************************************************/
+#ifndef ACI_RUN_TIMERS
+#define ACI_RUN_TIMERS 4
+#endif
+
+/************************************************************************/
+/* Events taken by one pass of aci_run()                                 */
+/* 1 to 16. More keeps up with bursts of received data, fewer runs the   */
+/* tasks more often.                                                     */
+/************************************************************************/
+#ifndef ACI_RUN_EVENTS_PER_PASS
+#define ACI_RUN_EVENTS_PER_PASS 4
+#endif
+
+/************************************************************************/
+/* Recovery of the link                                                  */
+/* 1 : aci_run() gives every event to aci_recovery_event(), a link lost  */
+/*     to a hardware error or a reset of the MCU is resumed with its     */
+/*     timing and its remote pipes. See aci_recovery.h.                  */
+/* 0 : Not used.                                                         */
+/************************************************************************/
+#ifndef ACI_RUN_RECOVERY
+#define ACI_RUN_RECOVERY 0
+#endif
+
+/************************************************************************/
+/* Reconnect to the bonded peer                                          */
+/* 1 : The advertising starts with a directed advertising to the bonded  */
+/*     peer, then a fast undirected advertising and then the undirected  */
+/*     advertising of the parameters. See aci_run_params_t.              */
+/* 0 : Only the undirected advertising of the parameters.                */
+/************************************************************************/
+#ifndef ACI_RUN_RECONNECT
+#define ACI_RUN_RECONNECT 0
+#endif
+
+#if (ACI_RUN_TASKS > 8)
+#error "ACI_RUN_TASKS must be 0 to 8"
+#endif
+#if (ACI_RUN_TIMERS > 8)
+#error "ACI_RUN_TIMERS must be 0 to 8"
+#endif
+#if (ACI_RUN_EVENTS_PER_PASS < 1) || (ACI_RUN_EVENTS_PER_PASS > 16)
+#error "ACI_RUN_EVENTS_PER_PASS must be 1 to 16"
+#endif
+
+#if ACI_RUN_RECONNECT
+/** Phase of the advertising with ACI_RUN_RECONNECT */
+typedef enum
+{
+  ACI_RUN_ADVERTISE_DIRECT,              /**< Directed advertising to the bonded peer */
+  ACI_RUN_ADVERTISE_FAST,                /**< Undirected, at fast_interval for fast_timeout_s */
+  ACI_RUN_ADVERTISE_SLOW                 /**< Undirected, at advertising_interval */
+} aci_run_advertise_phase_t;
+#endif
+
+/** sleep_mode of aci_run_params_t for a loop that never sleeps */
+#define ACI_RUN_NO_SLEEP  0xFF
+
+/** Called with every ACI event, after aci_run() has handled it */
+typedef void (*aci_run_event_handler_t)(aci_state_t *aci_stat, const aci_evt_t *p_evt);
+
+/** A task or a timer of the application */
+typedef void (*aci_run_task_t)(aci_state_t *aci_stat);
+
+typedef struct
+{
+  bool     advertise;                    /**< Advertise in Standby and after a disconnect */
+  uint16_t advertising_timeout_s;        /**< Of lib_aci_connect(), 0 to advertise until connected */
+  uint16_t advertising_interval;         /**< 0.625 ms units, 0x0020 to 0x4000 */
+  uint8_t  sleep_mode;                   /**< Of lib_aci_idle(), ACI_RUN_NO_SLEEP not to sleep */
+  aci_run_event_handler_t event_handler; /**< NULL for none */
+#if LIB_ACI_AUTO_WAKEUP
+  uint32_t radio_sleep_after_ms;         /**< Idle Standby time before the nRF8001 sleeps, 0 never */
+#endif
+#if ACI_RUN_RECONNECT
+  uint16_t fast_timeout_s;               /**< Fast advertising after the directed one, 0 for none */
+  uint16_t fast_interval;                /**< 0.625 ms units, 0x0020 to 0x4000 */
+#endif
+} aci_run_params_t;
+
+typedef struct
+{
+  uint32_t passes;
+  uint32_t events;
+  uint32_t sleeps;                       /**< Passes that ended in lib_aci_idle() sleeping */
+  uint16_t setups;                       /**< Setups done */
+  uint16_t setup_failures;
+  uint16_t advertising_starts;
+  uint16_t cmd_errors;                   /**< ACI_EVT_CMD_RSP with an error status */
+  uint16_t hw_errors;
+#if LIB_ACI_AUTO_WAKEUP
+  uint16_t radio_sleeps;                 /**< Sleep commands sent after radio_sleep_after_ms */
+  uint16_t radio_wakeups;                /**< Device Started events ending a sleep */
+#endif
+#if ACI_RUN_RECONNECT
+  uint16_t direct_starts;                /**< Directed advertising started */
+  uint16_t direct_connects;              /**< Connections made by the directed advertising */
+  uint16_t fast_connects;                /**< Connections made by the fast advertising */
+#endif
+} aci_run_stats_t;
+
+typedef struct
+{
+  aci_run_task_t task;
+  uint16_t       period_ms;
+  unsigned long  due_ms;
+} aci_run_timer_t;
+
+/** State of the run loop, one per nRF8001 */
+typedef struct
+{
+  const aci_run_params_t *p_params;
+  bool                    setup_required;
+  bool                    advertise_pending;    /**< The Connect is still to be sent */
+#if LIB_ACI_AUTO_WAKEUP
+  bool                    radio_busy;           /**< Advertising or connected */
+  bool                    radio_waking;         /**< The Wakeup is sent, the Device Started is awaited */
+  unsigned long           radio_idle_ms;        /**< millis() of the last event */
+#endif
+#if ACI_RUN_RECONNECT
+  uint8_t                 advertise_phase;      /**< aci_run_advertise_phase_t of the next advertising */
+#endif
+#if !ACI_LOW_MEMORY
+  hal_aci_evt_t           aci_data;             /**< lib_aci_event_buffer() with ACI_LOW_MEMORY */
+#endif
+#if ACI_RUN_TASKS
+  uint8_t                 task_count;
+  aci_run_task_t          tasks[ACI_RUN_TASKS];
+#endif
+#if ACI_RUN_TIMERS
+  uint8_t                 timer_count;
+  aci_run_timer_t         timers[ACI_RUN_TIMERS];
+#endif
+  aci_run_stats_t         stats;
+} aci_run_t;
+
+/** @brief Initializes the run loop, with no task and no timer.
+ *  @param p_run state of the run loop.
+ *  @param p_params advertising, sleep and event handler, must stay valid while the run loop is used.
+ */
+void aci_run_init(aci_run_t *p_run, const aci_run_params_t *p_params);
+
+#if ACI_RUN_TASKS
+/** @brief Adds a task called on every pass, in the order they are added.
+ *  @return False if there are ACI_RUN_TASKS tasks already.
+ */
+bool aci_run_task_add(aci_run_t *p_run, aci_run_task_t task);
+#endif
+
+#if ACI_RUN_TIMERS
+/** @brief Adds a timer, first called period_ms from now.
+ *  @details A timer late by more than its period is not called again to catch up.
+ *  @return False if there are ACI_RUN_TIMERS timers already or period_ms is 0.
+ */
+bool aci_run_timer_add(aci_run_t *p_run, aci_run_task_t task, uint16_t period_ms);
+#endif
+
+/** @brief Runs one pass of the loop, call it from loop().
+ *  @return True when the pass handled an event or ran the setup.
+ */
+bool aci_run(aci_run_t *p_run, aci_state_t *aci_stat);
+
+/** @brief Starts the advertising, as done in Standby and after a disconnect.
+ *  @details With advertise false in the parameters, the sketch starts it when it wants to. With
+ *  ACI_RUN_RECONNECT it starts from the directed advertising.
+ */
+void aci_run_advertise(aci_run_t *p_run);
+
+#if LIB_ACI_AUTO_WAKEUP
+/** @brief Wakes the nRF8001 up if aci_run() has put it to sleep.
+ *  @return False if the nRF8001 is not sleeping, is already waking up or the Wakeup does not fit
+ *          in the command queue.
+ */
+bool aci_run_wakeup(aci_run_t *p_run, aci_state_t *aci_stat);
+#endif
+
+/** @brief Gets the counters since aci_run_init().
+ */
+void aci_run_stats_get(const aci_run_t *p_run, aci_run_stats_t *p_stats);
+
+#endif // ACI_RUN_H__
+/** @} */
@@ -0,0 +1,219 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+/** @file
+@brief Implementation of the temperature and battery level sampler
+*/
+
+#include <lib_aci.h>
+#include "aci_sampler.h"
+#include "ble_assert.h"
+
+/* Needs the GetTemperature and GetBatteryLevel commands */
+#if ACI_FEATURE_DEVICE_INFO
+
+#define AVERAGE_SHIFT_MAX  8
+
+static void quantity_init(aci_sampler_quantity_t *p_quantity)
+{
+  p_quantity->value.last     = 0;
+  p_quantity->value.average  = 0;
+  p_quantity->value.min      = 0;
+  p_quantity->value.max      = 0;
+  p_quantity->value.samples  = 0;
+  p_quantity->average_acc    = 0;
+  p_quantity->next_ms        = 0;
+  p_quantity->averaging      = false;
+  p_quantity->in_flight      = false;
+}
+
+static void quantity_sample(aci_sampler_quantity_t *p_quantity, uint8_t shift, int16_t sample)
+{
+  aci_sampler_value_t *p_value = &p_quantity->value;
+
+  if (0 == p_value->samples)
+  {
+    p_value->min = sample;
+    p_value->max = sample;
+  }
+  else
+  {
+    if (sample < p_value->min)
+    {
+      p_value->min = sample;
+    }
+    if (sample > p_value->max)
+    {
+      p_value->max = sample;
+    }
+  }
+
+  /* The first sample starts the average, aci_sampler_reset() keeps it going */
+  if (!p_quantity->averaging)
+  {
+    p_quantity->average_acc = (int32_t)sample << shift;
+    p_quantity->averaging   = true;
+  }
+  else
+  {
+    p_quantity->average_acc += (int32_t)sample - (p_quantity->average_acc >> shift);
+  }
+
+  p_value->last    = sample;
+  p_value->average = (int16_t)(p_quantity->average_acc >> shift);
+  if (p_value->samples < 0xFFFF)
+  {
+    p_value->samples++;
+  }
+}
+
+/* Returns true when the command has to be sent now */
+static bool quantity_due(aci_sampler_quantity_t *p_quantity, uint16_t period_ms, unsigned long now)
+{
+  if ((0 == period_ms) || p_quantity->in_flight)
+  {
+    return false;
+  }
+  return ((long)(now - p_quantity->next_ms) >= 0);
+}
+
+static void quantity_sent(aci_sampler_quantity_t *p_quantity, uint16_t period_ms, unsigned long now)
+{
+  p_quantity->in_flight = true;
+
+  /* Keep the period, unless the loop was away for more than one */
+  p_quantity->next_ms += period_ms;
+  if ((long)(now - p_quantity->next_ms) >= 0)
+  {
+    p_quantity->next_ms = now + period_ms;
+  }
+}
+
+void aci_sampler_init(aci_sampler_t *p_sampler, const aci_sampler_params_t *p_params)
+{
+  ble_assert(p_params->average_shift <= AVERAGE_SHIFT_MAX);
+
+  p_sampler->p_params = p_params;
+  p_sampler->standby  = false;
+  p_sampler->failures = 0;
+  quantity_init(&p_sampler->temperature);
+  quantity_init(&p_sampler->battery);
+}
+
+void aci_sampler_event(aci_sampler_t *p_sampler, aci_state_t *aci_stat, const aci_evt_t *p_evt)
+{
+  const aci_sampler_params_t *p_params = p_sampler->p_params;
+  aci_sampler_quantity_t *p_quantity;
+  int32_t sample;
+
+  (void)aci_stat;
+
+  switch (p_evt->evt_opcode)
+  {
+    case ACI_EVT_DEVICE_STARTED:
+      /* The commands in flight are lost with a reset or a wakeup */
+      p_sampler->standby = (ACI_DEVICE_STANDBY == p_evt->params.device_started.device_mode);
+      p_sampler->temperature.in_flight = false;
+      p_sampler->battery.in_flight     = false;
+      p_sampler->temperature.next_ms   = millis();
+      p_sampler->battery.next_ms       = millis();
+      break;
+
+    case ACI_EVT_CMD_RSP:
+      if (ACI_CMD_GET_TEMPERATURE == p_evt->params.cmd_rsp.cmd_opcode)
+      {
+        p_quantity = &p_sampler->temperature;
+        /* 0.25 C steps */
+        sample = (int32_t)p_evt->params.cmd_rsp.params.get_temperature.temperature_value * 25;
+      }
+      else if (ACI_CMD_GET_BATTERY_LEVEL == p_evt->params.cmd_rsp.cmd_opcode)
+      {
+        p_quantity = &p_sampler->battery;
+        /* 3.52 mV steps */
+        sample = ((int32_t)p_evt->params.cmd_rsp.params.get_battery_level.battery_level * 352) / 100;
+      }
+      else
+      {
+        break;
+      }
+
+      if (!p_quantity->in_flight)
+      {
+        break;
+      }
+      p_quantity->in_flight = false;
+
+      if (ACI_STATUS_SUCCESS != p_evt->params.cmd_rsp.cmd_status)
+      {
+        p_sampler->failures++;
+        break;
+      }
+      quantity_sample(p_quantity, p_params->average_shift, (int16_t)sample);
+      break;
+
+    default:
+      break;
+  }
+}
+
+void aci_sampler_poll(aci_sampler_t *p_sampler, aci_state_t *aci_stat)
+{
+  const aci_sampler_params_t *p_params = p_sampler->p_params;
+  const unsigned long now = millis();
+
+  if (!p_sampler->standby || (ACI_DEVICE_SLEEP == aci_stat->device_state))
+  {
+    return;
+  }
+
+  if (quantity_due(&p_sampler->temperature, p_params->temperature_period_ms, now) &&
+      lib_aci_get_temperature())
+  {
+    quantity_sent(&p_sampler->temperature, p_params->temperature_period_ms, now);
+  }
+
+  if (quantity_due(&p_sampler->battery, p_params->battery_period_ms, now) &&
+      lib_aci_get_battery_level())
+  {
+    quantity_sent(&p_sampler->battery, p_params->battery_period_ms, now);
+  }
+}
+
+bool aci_sampler_temperature_get(const aci_sampler_t *p_sampler, aci_sampler_value_t *p_value)
+{
+  *p_value = p_sampler->temperature.value;
+  return (0 != p_value->samples);
+}
+
+bool aci_sampler_battery_get(const aci_sampler_t *p_sampler, aci_sampler_value_t *p_value)
+{
+  *p_value = p_sampler->battery.value;
+  return (0 != p_value->samples);
+}
+
+void aci_sampler_reset(aci_sampler_t *p_sampler)
+{
+  p_sampler->temperature.value.samples = 0;
+  p_sampler->battery.value.samples     = 0;
+}
+
+#endif // ACI_FEATURE_DEVICE_INFO
@@ -0,0 +1,120 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+/** @file
+ * @brief Samples the temperature and the battery level of the nRF8001 periodically.
+ */
+
+/** @defgroup aci_sampler aci_sampler
+@{
+@ingroup lib
+
+@brief Keeps the latest, average, minimum and maximum temperature and battery level in fixed point.
+@details The GetTemperature and GetBatteryLevel commands are sent from aci_sampler_poll() at
+their own period, one of each in flight at a time, and their command responses are taken from
+aci_sampler_event(). The application reads the cached values with aci_sampler_temperature_get()
+and aci_sampler_battery_get() and never waits for a command response.
+
+The temperature is in 0.01&nbsp;C, the nRF8001 measures it in 0.25&nbsp;C steps. The battery
+level is in mV, the nRF8001 measures it in 3.52&nbsp;mV steps. The average is an exponential
+moving average over about 2^average_shift samples.
+
+Sampling runs while the nRF8001 is in Standby or connected, from ACI_EVT_DEVICE_STARTED in
+Standby until the next ACI_EVT_DEVICE_STARTED in another mode, and stops while
+aci_state_t device_state is ACI_DEVICE_SLEEP.
+*/
+
+#ifndef ACI_SAMPLER_H__
+#define ACI_SAMPLER_H__
+
+#include <lib_aci.h>
+
+typedef struct
+{
+  uint16_t temperature_period_ms;  /**< Between two GetTemperature, 0 to not sample the temperature */
+  uint16_t battery_period_ms;      /**< Between two GetBatteryLevel, 0 to not sample the battery level */
+  uint8_t  average_shift;          /**< The average follows about 2^average_shift samples, 0 to 8 */
+} aci_sampler_params_t;
+
+/** A sampled quantity, in 0.01&nbsp;C or in mV */
+typedef struct
+{
+  int16_t  last;
+  int16_t  average;
+  int16_t  min;
+  int16_t  max;
+  uint16_t samples;                /**< Samples since aci_sampler_init() or aci_sampler_reset() */
+} aci_sampler_value_t;
+
+/** State of a quantity, part of aci_sampler_t */
+typedef struct
+{
+  aci_sampler_value_t value;
+  int32_t             average_acc; /**< The average shifted up by average_shift */
+  unsigned long       next_ms;     /**< When the next command is due */
+  bool                averaging;   /**< average_acc holds the average */
+  bool                in_flight;   /**< The command response is waited for */
+} aci_sampler_quantity_t;
+
+/** State of the sampler, one per nRF8001 */
+typedef struct
+{
+  const aci_sampler_params_t *p_params;
+  bool                        standby;     /**< Commands can be sent */
+  uint16_t                    failures;    /**< Commands refused by the nRF8001 */
+  aci_sampler_quantity_t      temperature;
+  aci_sampler_quantity_t      battery;
+} aci_sampler_t;
+
+/** @brief Initializes the sampler, there are no samples yet.
+ *  @param p_sampler state of the sampler.
+ *  @param p_params periods, must stay valid while the sampler is used.
+ */
+void aci_sampler_init(aci_sampler_t *p_sampler, const aci_sampler_params_t *p_params);
+
+/** @brief Gives an ACI event to the sampler, call it for every event taken from lib_aci_event_get().
+ *  @details The command responses to GetTemperature and GetBatteryLevel are taken as samples while
+ *  the sampler waits for one, they are still handled by the application too.
+ */
+void aci_sampler_event(aci_sampler_t *p_sampler, aci_state_t *aci_stat, const aci_evt_t *p_evt);
+
+/** @brief Sends the commands when due, call it from the loop.
+ */
+void aci_sampler_poll(aci_sampler_t *p_sampler, aci_state_t *aci_stat);
+
+/** @brief Gets the temperature, in 0.01&nbsp;C.
+ *  @return False if there is no sample yet.
+ */
+bool aci_sampler_temperature_get(const aci_sampler_t *p_sampler, aci_sampler_value_t *p_value);
+
+/** @brief Gets the battery level, in mV.
+ *  @return False if there is no sample yet.
+ */
+bool aci_sampler_battery_get(const aci_sampler_t *p_sampler, aci_sampler_value_t *p_value);
+
+/** @brief Starts the minimum, maximum and sample count again from the next samples.
+ *  @details The average goes on.
+ */
+void aci_sampler_reset(aci_sampler_t *p_sampler);
+
+#endif // ACI_SAMPLER_H__
+/** @} */
@@ -0,0 +1,254 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+@brief Implementation of the data credit scheduler
+*/
+
+#include <lib_aci.h>
+#include "aci_scheduler.h"
+#include "ble_assert.h"
+
+#define FLOW_MASK  (ACI_SCHEDULER_FLOW_DEPTH - 1)
+
+/* Pass added for a credit at weight 1, a flow of weight w adds SCHED_STRIDE / w */
+#define SCHED_STRIDE  0x1000u
+
+static uint8_t flow_count(const aci_scheduler_flow_t *p_flow)
+{
+  return (uint8_t)(p_flow->head - p_flow->tail);
+}
+
+static uint16_t flow_stride(const aci_scheduler_flow_t *p_flow)
+{
+  return (uint16_t)(SCHED_STRIDE / p_flow->p_params->weight);
+}
+
+/*
+  The flow for the next credit. A value goes first when it would miss its deadline by waiting
+  for the next credit, a connection interval, and the connection event that carries it, another
+  one. The closest to its deadline goes first, otherwise the flow with the lowest pass.
+*/
+static uint8_t sched_pick(aci_scheduler_t *p_sched, aci_state_t *aci_stat, uint16_t now_ms, bool *p_deadline)
+{
+  const int32_t urgent_ms = 2 * (int32_t)lib_aci_get_cx_interval_ms(aci_stat);
+  int32_t       slack_ms;
+  int32_t       urgent_slack_ms = 0;
+  uint8_t       urgent = ACI_SCHEDULER_FLOW_INVALID;
+  uint8_t       fair = ACI_SCHEDULER_FLOW_INVALID;
+  uint8_t       i;
+
+  for (i = 0; i < p_sched->count; i++)
+  {
+    const aci_scheduler_flow_t *p_flow = &p_sched->flows[i];
+
+    if ((0 == flow_count(p_flow)) || !lib_aci_is_pipe_available(aci_stat, p_flow->p_params->pipe))
+    {
+      continue;
+    }
+
+    if (0 != p_flow->p_params->deadline_ms)
+    {
+      slack_ms = (int32_t)p_flow->p_params->deadline_ms -
+                 (uint16_t)(now_ms - p_flow->put_ms[p_flow->tail & FLOW_MASK]);
+      if ((slack_ms < urgent_ms) &&
+          ((ACI_SCHEDULER_FLOW_INVALID == urgent) || (slack_ms < urgent_slack_ms)))
+      {
+        urgent          = i;
+        urgent_slack_ms = slack_ms;
+      }
+    }
+
+    if ((ACI_SCHEDULER_FLOW_INVALID == fair) ||
+        ((int16_t)(p_flow->pass - p_sched->flows[fair].pass) < 0))
+    {
+      fair = i;
+    }
+  }
+
+  *p_deadline = (ACI_SCHEDULER_FLOW_INVALID != urgent);
+  return *p_deadline ? urgent : fair;
+}
+
+/*
+  Sends while there are credits, one value per credit from the flow sched_pick() gives.
+*/
+static void sched_send(aci_scheduler_t *p_sched, aci_state_t *aci_stat)
+{
+  const uint16_t        now_ms = (uint16_t)millis();
+  aci_scheduler_flow_t *p_flow;
+  uint16_t              latency_ms;
+  uint8_t               slot;
+  uint8_t               flow;
+  bool                  deadline;
+
+  lib_aci_select(aci_stat);
+  while (0 != aci_stat->data_credit_available)
+  {
+    flow = sched_pick(p_sched, aci_stat, now_ms, &deadline);
+    if (ACI_SCHEDULER_FLOW_INVALID == flow)
+    {
+      break;
+    }
+
+    p_flow = &p_sched->flows[flow];
+    slot   = p_flow->tail & FLOW_MASK;
+    if (!lib_aci_send_data(p_flow->p_params->pipe, &p_flow->values[slot][0], p_flow->length[slot]))
+    {
+      break;
+    }
+
+    latency_ms = now_ms - p_flow->put_ms[slot];
+    if (latency_ms > p_flow->stats.latency_max_ms)
+    {
+      p_flow->stats.latency_max_ms = latency_ms;
+    }
+    // It reaches the peer at the next connection event
+    if ((0 != p_flow->p_params->deadline_ms) &&
+        ((latency_ms + lib_aci_get_cx_interval_ms(aci_stat)) > p_flow->p_params->deadline_ms))
+    {
+      p_flow->stats.deadline_missed++;
+    }
+    if (deadline)
+    {
+      p_flow->stats.values_deadline++;
+    }
+    p_flow->stats.values_sent++;
+
+    // A credit taken at the deadline is counted in the share of the flow as well
+    p_sched->pass  = p_flow->pass;
+    p_flow->pass  += flow_stride(p_flow);
+    p_flow->tail++;
+  }
+}
+
+void aci_scheduler_init(aci_scheduler_t *p_sched)
+{
+  memset(p_sched, 0, sizeof(*p_sched));
+}
+
+uint8_t aci_scheduler_flow_add(aci_scheduler_t *p_sched, const aci_scheduler_flow_params_t *p_params)
+{
+  aci_scheduler_flow_t *p_flow;
+
+  ble_assert(0 != p_params->weight);
+
+  if (ACI_SCHEDULER_FLOWS == p_sched->count)
+  {
+    return ACI_SCHEDULER_FLOW_INVALID;
+  }
+  p_flow = &p_sched->flows[p_sched->count];
+  memset(p_flow, 0, sizeof(*p_flow));
+  p_flow->p_params = p_params;
+  p_flow->pass     = p_sched->pass;
+  return p_sched->count++;
+}
+
+void aci_scheduler_event(aci_scheduler_t *p_sched, aci_state_t *aci_stat, const aci_evt_t *p_evt)
+{
+  uint8_t i;
+
+  switch (p_evt->evt_opcode)
+  {
+    // The DataCredit event ends a connection event, the credits are back
+    case ACI_EVT_DATA_CREDIT:
+    case ACI_EVT_PIPE_STATUS:
+      sched_send(p_sched, aci_stat);
+      break;
+
+    case ACI_EVT_DISCONNECTED:
+      for (i = 0; i < p_sched->count; i++)
+      {
+        p_sched->flows[i].stats.values_flushed += flow_count(&p_sched->flows[i]);
+        p_sched->flows[i].tail = p_sched->flows[i].head;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+void aci_scheduler_poll(aci_scheduler_t *p_sched, aci_state_t *aci_stat)
+{
+  uint8_t i;
+
+  for (i = 0; i < p_sched->count; i++)
+  {
+    if (0 != flow_count(&p_sched->flows[i]))
+    {
+      sched_send(p_sched, aci_stat);
+      return;
+    }
+  }
+}
+
+bool aci_scheduler_put(aci_scheduler_t *p_sched, uint8_t flow, const uint8_t *p_value, uint8_t length)
+{
+  aci_scheduler_flow_t *p_flow;
+  uint8_t               slot;
+
+  ble_assert((flow < p_sched->count) && (length <= ACI_SCHEDULER_LEN_MAX));
+
+  p_flow = &p_sched->flows[flow];
+  if (ACI_SCHEDULER_FLOW_DEPTH == flow_count(p_flow))
+  {
+    if (!p_flow->p_params->replace)
+    {
+      p_flow->stats.values_refused++;
+      return false;
+    }
+    // The newest value keeps its place and the time it was put
+    slot = (uint8_t)(p_flow->head - 1) & FLOW_MASK;
+    p_flow->stats.values_replaced++;
+  }
+  else
+  {
+    if (0 == flow_count(p_flow))
+    {
+      // A flow that waited for nothing has not saved credits: it starts at the pass of the others,
+      // or stays a stride ahead of it when it had just been served
+      if ((uint16_t)(p_flow->pass - p_sched->pass) > flow_stride(p_flow))
+      {
+        p_flow->pass = p_sched->pass;
+      }
+    }
+    slot = p_flow->head & FLOW_MASK;
+    p_flow->put_ms[slot] = (uint16_t)millis();
+    p_flow->head++;
+  }
+
+  memcpy(&p_flow->values[slot][0], p_value, length);
+  p_flow->length[slot] = length;
+  return true;
+}
+
+uint8_t aci_scheduler_pending(const aci_scheduler_t *p_sched, uint8_t flow)
+{
+  return flow_count(&p_sched->flows[flow]);
+}
+
+void aci_scheduler_stats_get(const aci_scheduler_t *p_sched, uint8_t flow, aci_scheduler_stats_t *p_stats)
+{
+  *p_stats = p_sched->flows[flow].stats;
+}
@@ -0,0 +1,178 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/** @file
+ * @brief Shares the data credits between the pipes of several services.
+ */
+
+/** @defgroup aci_scheduler aci_scheduler
+@{
+@ingroup lib
+
+@brief Queues the values of several transmit pipes, as the HID reports, the heart rate
+measurements and the battery level of ble_HID_template_HID_HRM, and hands the data credits out
+between them.
+@details Each pipe is a flow, added with aci_scheduler_flow_add(), with a weight and a deadline.
+A value is put with aci_scheduler_put() and waits in the ring of its flow, of
+ACI_SCHEDULER_FLOW_DEPTH values. When the ring is full the value put replaces the newest one if
+the flow replaces, as for a measurement where only the latest counts, and is refused otherwise.
+
+Each data credit goes to one flow, in two steps:
+ - A value that would reach the peer after its deadline if it waited for the next credit goes
+   first, the closest to its deadline first. The credits come back at the end of a connection
+   event and the value goes out in the next one, so a value goes first when it has less than two
+   connection intervals left. A HID report with a deadline keeps a bounded latency while a bulk
+   flow fills the link.
+ - Otherwise the credits are shared by weight between the flows with values waiting: a flow of
+   weight 3 gets three credits for each one of a flow of weight 1. A flow with nothing waiting
+   does not save credits for later, the others use its share.
+A credit taken at the deadline is counted against the share of the flow, so a flow with a
+deadline does not get more than its weight when the link is full, unless its deadlines demand it.
+
+The values are sent when aci_scheduler_event() gets the DataCredit event that ends a connection
+event, and from aci_scheduler_poll(). A flow whose pipe is not available keeps its values until
+the peer opens it; the Disconnected event empties the rings.
+
+Only the loop may put values. Call aci_scheduler_event() with every ACI event and
+aci_scheduler_poll() from the loop.
+*/
+
+#ifndef ACI_SCHEDULER_H__
+#define ACI_SCHEDULER_H__
+
+#include <lib_aci.h>
+
+/************************************************************************/
+/* Flows a scheduler shares the data credits between                     */
+/* 1 to 8.                                                               */
+/************************************************************************/
+#ifndef ACI_SCHEDULER_FLOWS
+#define ACI_SCHEDULER_FLOWS 4
+#endif
+
+/************************************************************************/
+/* Values waiting per flow                                               */
+/* A power of two, 1 to 16.                                              */
+/************************************************************************/
+#ifndef ACI_SCHEDULER_FLOW_DEPTH
+#define ACI_SCHEDULER_FLOW_DEPTH 4
+#endif
+
+/************************************************************************/
+/* Bytes of the longest value of a flow                                  */
+/* ACI_PIPE_TX_DATA_MAX_LEN at most.                                     */
+/************************************************************************/
+#ifndef ACI_SCHEDULER_LEN_MAX
+#define ACI_SCHEDULER_LEN_MAX 8
+#endif
+
+#if (ACI_SCHEDULER_FLOWS < 1) || (ACI_SCHEDULER_FLOWS > 8)
+#error "ACI_SCHEDULER_FLOWS must be 1 to 8"
+#endif
+#if (ACI_SCHEDULER_FLOW_DEPTH < 1) || (ACI_SCHEDULER_FLOW_DEPTH > 16) || \
+    (0 != (ACI_SCHEDULER_FLOW_DEPTH & (ACI_SCHEDULER_FLOW_DEPTH - 1)))
+#error "ACI_SCHEDULER_FLOW_DEPTH must be a power of two from 1 to 16"
+#endif
+#if (ACI_SCHEDULER_LEN_MAX < 1) || (ACI_SCHEDULER_LEN_MAX > ACI_PIPE_TX_DATA_MAX_LEN)
+#error "ACI_SCHEDULER_LEN_MAX must be 1 to ACI_PIPE_TX_DATA_MAX_LEN"
+#endif
+
+/** Returned by aci_scheduler_flow_add() when no flow is left */
+#define ACI_SCHEDULER_FLOW_INVALID  0xFF
+
+typedef struct
+{
+  uint8_t  pipe;                   /**< A transmit pipe, see lib_aci_send_data() */
+  uint8_t  weight;                 /**< Share of the credits, 1 to 255 */
+  uint16_t deadline_ms;            /**< Longest time from put to the peer, 0 for none */
+  bool     replace;                /**< A value put in a full ring replaces the newest one */
+} aci_scheduler_flow_params_t;
+
+typedef struct
+{
+  uint32_t values_sent;
+  uint16_t values_deadline;        /**< Sent ahead of the weights, for the deadline */
+  uint16_t values_replaced;        /**< Replaced in a full ring, not sent */
+  uint16_t values_refused;         /**< Not queued, the ring was full */
+  uint16_t values_flushed;         /**< Dropped by a disconnect */
+  uint16_t deadline_missed;        /**< Sent later than a connection interval before the deadline */
+  uint16_t latency_max_ms;         /**< Longest time from put to sent */
+} aci_scheduler_stats_t;
+
+/** State of one flow */
+typedef struct
+{
+  const aci_scheduler_flow_params_t *p_params;
+  uint8_t                head;                /**< Free running, the index is masked */
+  uint8_t                tail;
+  uint16_t               pass;                /**< The flow with the lowest pass gets the next credit */
+  aci_scheduler_stats_t  stats;
+  uint16_t               put_ms[ACI_SCHEDULER_FLOW_DEPTH];
+  uint8_t                length[ACI_SCHEDULER_FLOW_DEPTH];
+  uint8_t                values[ACI_SCHEDULER_FLOW_DEPTH][ACI_SCHEDULER_LEN_MAX];
+} aci_scheduler_flow_t;
+
+typedef struct
+{
+  uint8_t               count;               /**< Flows added */
+  uint16_t              pass;                /**< Pass of the last credit, a flow that starts to wait starts there */
+  aci_scheduler_flow_t  flows[ACI_SCHEDULER_FLOWS];
+} aci_scheduler_t;
+
+/** @brief Initializes the scheduler, without flows.
+ */
+void aci_scheduler_init(aci_scheduler_t *p_sched);
+
+/** @brief Adds a flow.
+ *  @param p_params pipe, weight and deadline, must stay valid while the scheduler is used.
+ *  @return The flow to give to aci_scheduler_put(), ACI_SCHEDULER_FLOW_INVALID when
+ *  ACI_SCHEDULER_FLOWS are already added.
+ */
+uint8_t aci_scheduler_flow_add(aci_scheduler_t *p_sched, const aci_scheduler_flow_params_t *p_params);
+
+/** @brief Gives an ACI event to the scheduler, call it for every event taken from lib_aci_event_get().
+ *  @details Values are sent on the DataCredit and PipeStatus events, the rings are emptied on the
+ *  Disconnected event.
+ */
+void aci_scheduler_event(aci_scheduler_t *p_sched, aci_state_t *aci_stat, const aci_evt_t *p_evt);
+
+/** @brief Sends the values that have credits, call it from the loop.
+ */
+void aci_scheduler_poll(aci_scheduler_t *p_sched, aci_state_t *aci_stat);
+
+/** @brief Puts a value of a flow.
+ *  @param flow as returned by aci_scheduler_flow_add().
+ *  @param p_value length bytes.
+ *  @param length up to ACI_SCHEDULER_LEN_MAX.
+ *  @return True if it was queued or replaced the newest value, false if the ring is full.
+ */
+bool aci_scheduler_put(aci_scheduler_t *p_sched, uint8_t flow, const uint8_t *p_value, uint8_t length);
+
+/** @brief Values of a flow waiting to be sent.
+ */
+uint8_t aci_scheduler_pending(const aci_scheduler_t *p_sched, uint8_t flow);
+
+/** @brief Copies the counters of a flow.
+ */
+void aci_scheduler_stats_get(const aci_scheduler_t *p_sched, uint8_t flow, aci_scheduler_stats_t *p_stats);
+
+#endif // ACI_SCHEDULER_H__
+/** @} */
@@ -21,6 +21,7 @@
 
 #include <lib_aci.h>
 #include "aci_setup.h"
+#include "aci_crc.h"
 
 
 // aci_struct that will contain 
@@ -35,9 +36,479 @@
 // Current State of the the GATT client (Service Discovery status)
 
 
-extern hal_aci_data_t msg_to_send;
+/* State of a setup run by aci_setup_poll(), per nRF8001 */
+typedef struct
+{
+  uint8_t       offset;       // Next setup message to put in the command queue
+  bool          running;
+  bool          crc_valid;
+  uint16_t      crc;          // aci_setup_crc(), once computed
+  unsigned long progress_ms;  // millis() of the start or of the last response
+#if ACI_SETUP_COMPRESSED
+  uint16_t      compressed_pos;     // Next record in setup_msgs_compressed
+  uint8_t       compressed_target;  // Target and offset of the next message, when not in its record
+  uint8_t       compressed_offset;
+#endif
+#if ACI_SETUP_PATCHES
+  aci_setup_patch_t patches[ACI_SETUP_PATCHES];
+  uint8_t           patch_count;
+  uint16_t          patch_crc_delta;  // XOR of the stored setup CRC and the CRC with the patches
+#endif
+#if ACI_SETUP_PROFILES
+  const aci_setup_profile_t *p_profile;                       // Selected, NULL for aci_setup_info as given
+  const aci_setup_profile_t *profile_ids[ACI_SETUP_PROFILES]; // CRCs of the profiles selected, newest first
+  uint16_t                   profile_crcs[ACI_SETUP_PROFILES];
+#endif
+} aci_setup_ctx_t;
+
+static aci_setup_ctx_t aci_setup_ctx[HAL_ACI_INSTANCES];
+
+#define aci_setup_cur  (&aci_setup_ctx[hal_aci_tl_selected()])
+
+#if ACI_SETUP_RETAIN
+#define ACI_SETUP_RETAIN_MARKER  0x5E7A
+
+/* Kept through resets of the MCU, checked with the marker and the inverted CRC */
+typedef struct
+{
+  uint16_t marker;
+  uint16_t crc;
+  uint16_t crc_inverted;
+} aci_setup_retain_t;
+
+static aci_setup_retain_t aci_setup_retained[HAL_ACI_INSTANCES] ACI_SETUP_RETAIN_SECTION;
+
+#define aci_setup_retained_cur  (&aci_setup_retained[hal_aci_tl_selected()])
+#endif
+
+//Board dependent defines
+#if defined(__PIC32MX__)
+  //In ChipKit we store the setup messages in RAM
+  #define aci_setup_msg_byte(p)  (*(const uint8_t *)(p))
+#else
+  #define aci_setup_msg_byte(p)  pgm_read_byte_near(p)
+#endif
+
+#if ACI_SETUP_PROFILES
+#if defined(__AVR__)
+  #define aci_setup_msg_table_read(p)  ((const hal_aci_data_t *)(uintptr_t)pgm_read_word_near(p))
+#else
+  #define aci_setup_msg_table_read(p)  (*(p))
+#endif
+
+/* Setup message msg_index, from the table of a setup profile or from setup_msgs */
+static const hal_aci_data_t *aci_setup_msg_ptr(aci_state_t *aci_stat, uint8_t msg_index)
+{
+  if (NULL != aci_stat->aci_setup_info.setup_msg_table)
+  {
+    return aci_setup_msg_table_read(&aci_stat->aci_setup_info.setup_msg_table[msg_index]);
+  }
+  return &aci_stat->aci_setup_info.setup_msgs[msg_index];
+}
+#else
+#define aci_setup_msg_ptr(aci_stat, msg_index)  (&(aci_stat)->aci_setup_info.setup_msgs[msg_index])
+#endif
+
+#if ACI_SETUP_COMPRESSED
+#define ACI_SETUP_COMPRESSED_NEW_TARGET   0x20
+#define ACI_SETUP_COMPRESSED_LENGTH_MASK  0x1F
+
+/* Where the next record of setup_msgs_compressed is, and the target and offset it follows on from */
+typedef struct
+{
+  uint16_t pos;
+  uint8_t  target;
+  uint8_t  offset;
+} aci_setup_decoder_t;
+
+/*
+  Decodes the record at p_dec->pos into p_msg as a Setup command [length][0x06][target][offset][data].
+  Records are [header][target][offset, only with the new target bit] then, per 8 data bytes,
+  a mask of the non zero bytes followed by them. See Build/CompressSetup.py.
+*/
+static void aci_setup_decode(aci_setup_decoder_t *p_dec, const uint8_t *p_stream, uint8_t *p_msg)
+{
+  uint8_t header = aci_setup_msg_byte(&p_stream[p_dec->pos++]);
+  uint8_t length = header & ACI_SETUP_COMPRESSED_LENGTH_MASK;
+  uint8_t mask   = 0;
+  uint8_t i;
+
+  if (header & ACI_SETUP_COMPRESSED_NEW_TARGET)
+  {
+    p_dec->target = aci_setup_msg_byte(&p_stream[p_dec->pos++]);
+    p_dec->offset = aci_setup_msg_byte(&p_stream[p_dec->pos++]);
+  }
+
+  p_msg[0] = length + 3;
+  p_msg[1] = ACI_CMD_SETUP;
+  p_msg[2] = p_dec->target;
+  p_msg[3] = p_dec->offset;
+  for (i = 0; i < length; i++)
+  {
+    if (0 == (i & 0x07))
+    {
+      mask = aci_setup_msg_byte(&p_stream[p_dec->pos++]);
+    }
+    p_msg[4 + i] = (mask & 0x01) ? aci_setup_msg_byte(&p_stream[p_dec->pos++]) : 0;
+    mask >>= 1;
+  }
+  p_dec->offset += length;
+}
+#endif
+
+#if ACI_SETUP_PROFILES
+/*
+  Keeps the CRC of a profile, the entries of the profiles selected longest ago give way.
+*/
+static void aci_setup_profile_crc_store(const aci_setup_profile_t *p_profile, uint16_t crc)
+{
+  aci_setup_ctx_t *p_ctx = aci_setup_cur;
+  uint8_t          i;
+
+  if (NULL == p_profile)
+  {
+    return;
+  }
+  for (i = 0; i < (ACI_SETUP_PROFILES - 1); i++)
+  {
+    if (p_profile == p_ctx->profile_ids[i])
+    {
+      break;
+    }
+  }
+  for (; i > 0; i--)
+  {
+    p_ctx->profile_ids[i]  = p_ctx->profile_ids[i - 1];
+    p_ctx->profile_crcs[i] = p_ctx->profile_crcs[i - 1];
+  }
+  p_ctx->profile_ids[0]  = p_profile;
+  p_ctx->profile_crcs[0] = crc;
+}
+#endif
+
+#if ACI_SETUP_PATCHES
+#define ACI_SETUP_PATCH_CRC_DELTA  (aci_setup_cur->patch_crc_delta)
+#else
+#define ACI_SETUP_PATCH_CRC_DELTA  0
+#endif
+
+uint16_t aci_setup_crc(aci_state_t *aci_stat)
+{
+  uint16_t crc = ACI_CRC16_CCITT_INIT;
+  uint8_t  msg_len;
+  uint8_t  i;
+#if ACI_SETUP_COMPRESSED
+  aci_setup_decoder_t decoder = { 0, 0, 0 };
+  uint8_t             msg[HAL_ACI_MAX_LENGTH + 1];
+#endif
+
+  lib_aci_select(aci_stat);
+
+  if (aci_setup_cur->crc_valid)
+  {
+    return aci_setup_cur->crc ^ ACI_SETUP_PATCH_CRC_DELTA;
+  }
+
+  for (i = 0; i < aci_stat->aci_setup_info.num_setup_msgs; i++)
+  {
+    const uint8_t *p_msg;
+    bool           in_ram;
+
+#if ACI_SETUP_COMPRESSED
+    if (NULL != aci_stat->aci_setup_info.setup_msgs_compressed)
+    {
+      aci_setup_decode(&decoder, aci_stat->aci_setup_info.setup_msgs_compressed, msg);
+      p_msg  = msg;
+      in_ram = true;
+    }
+    else
+#endif
+    {
+      p_msg  = &aci_setup_msg_ptr(aci_stat, i)->buffer[0];
+      in_ram = false;
+    }
+    msg_len = in_ram ? p_msg[0] : aci_setup_msg_byte(&p_msg[0]);
+    if ((aci_stat->aci_setup_info.num_setup_msgs - 1) == i)
+    {
+      //The 2 bytes of the CRC itself are not part of the CRC
+      msg_len -= 1;
+    }
+    else
+    {
+      msg_len += 1;
+    }
+    crc = in_ram ? aci_crc16_ccitt(crc, p_msg, msg_len) : aci_crc16_ccitt_P(crc, p_msg, msg_len);
+  }
+
+  aci_setup_cur->crc       = crc;
+  aci_setup_cur->crc_valid = true;
+#if ACI_SETUP_PROFILES
+  aci_setup_profile_crc_store(aci_setup_cur->p_profile, crc);
+#endif
+  return crc ^ ACI_SETUP_PATCH_CRC_DELTA;
+}
+
+#if ACI_SETUP_RETAIN
+bool aci_setup_is_retained(aci_state_t *aci_stat)
+{
+  uint16_t crc = aci_setup_crc(aci_stat);
+
+  return ((ACI_SETUP_RETAIN_MARKER == aci_setup_retained_cur->marker) &&
+          (crc == aci_setup_retained_cur->crc) &&
+          ((uint16_t)~crc == aci_setup_retained_cur->crc_inverted));
+}
+
+void aci_setup_retain_clear(aci_state_t *aci_stat)
+{
+  lib_aci_select(aci_stat);
+
+  aci_setup_retained_cur->marker = 0;
+}
+
+static void aci_setup_retain_set(aci_state_t *aci_stat)
+{
+  uint16_t crc = aci_setup_crc(aci_stat);
+
+  aci_setup_retained_cur->crc          = crc;
+  aci_setup_retained_cur->crc_inverted = ~crc;
+  aci_setup_retained_cur->marker       = ACI_SETUP_RETAIN_MARKER;
+}
+#endif
+
+
+#if ACI_SETUP_PATCHES
+/*
+  Product of two polynomials modulo the CCITT polynomial x^16 + x^12 + x^5 + 1.
+*/
+static uint16_t aci_setup_crc_mul(uint16_t a, uint16_t b)
+{
+  uint16_t r = 0;
+  uint8_t  i;
+
+  for (i = 0; i < 16; i++)
+  {
+    r = (r & 0x8000) ? ((r << 1) ^ 0x1021) : (r << 1);
+    if (b & 0x8000)
+    {
+      r ^= a;
+    }
+    b <<= 1;
+  }
+  return r;
+}
+
+/*
+  CRC after zero_bytes more zero bytes, when it started from 0: the CRC times x^(8 * zero_bytes).
+  Square and multiply, at most 16 steps whatever the size of the setup.
+*/
+static uint16_t aci_setup_crc_shift(uint16_t crc, uint16_t zero_bytes)
+{
+  uint16_t power = 0x0100; // x^8
+
+  while (0 != zero_bytes)
+  {
+    if (zero_bytes & 0x01)
+    {
+      crc = aci_setup_crc_mul(crc, power);
+    }
+    power = aci_setup_crc_mul(power, power);
+    zero_bytes >>= 1;
+  }
+  return crc;
+}
+
+/*
+  Copies setup message msg_index, as stored, into p_msg.
+  Returns the number of bytes under the setup CRC that follow it.
+*/
+static uint16_t aci_setup_msg_get(aci_state_t *aci_stat, uint8_t msg_index, uint8_t *p_msg)
+{
+  const uint8_t last  = aci_stat->aci_setup_info.num_setup_msgs - 1;
+  uint16_t      after = 0;
+  uint8_t       length;
+  uint8_t       i;
+
+#if ACI_SETUP_COMPRESSED
+  if (NULL != aci_stat->aci_setup_info.setup_msgs_compressed)
+  {
+    /* The records are walked up to the message, without the CRC */
+    aci_setup_decoder_t decoder = { 0, 0, 0 };
+    uint8_t             msg[HAL_ACI_MAX_LENGTH + 1];
+
+    for (i = 0; i <= last; i++)
+    {
+      aci_setup_decode(&decoder, aci_stat->aci_setup_info.setup_msgs_compressed,
+                       (i == msg_index) ? p_msg : msg);
+      if (i > msg_index)
+      {
+        after += (last == i) ? (msg[0] - 1) : (msg[0] + 1);
+      }
+    }
+    return after;
+  }
+#endif
+
+  length = aci_setup_msg_byte(&aci_setup_msg_ptr(aci_stat, msg_index)->buffer[0]);
+  for (i = 0; i <= length; i++)
+  {
+    p_msg[i] = aci_setup_msg_byte(&aci_setup_msg_ptr(aci_stat, msg_index)->buffer[i]);
+  }
+  for (i = msg_index + 1; i <= last; i++)
+  {
+    length = aci_setup_msg_byte(&aci_setup_msg_ptr(aci_stat, i)->buffer[0]);
+    after += (last == i) ? (length - 1) : (length + 1);
+  }
+  return after;
+}
+
+/*
+  Puts the patches of setup message msg_index over it, and the patched CRC in the last message.
+*/
+static void aci_setup_patch_apply(aci_state_t *aci_stat, uint8_t msg_index, uint8_t *p_msg)
+{
+  const aci_setup_patch_t *p_patch = &aci_setup_cur->patches[0];
+  uint8_t                  i;
+
+  for (i = 0; i < aci_setup_cur->patch_count; i++, p_patch++)
+  {
+    if (msg_index == p_patch->msg_index)
+    {
+      memcpy(&p_msg[p_patch->offset], p_patch->data, p_patch->length);
+    }
+  }
+
+  if ((aci_stat->aci_setup_info.num_setup_msgs - 1) == msg_index)
+  {
+    //The CRC is in the last 2 bytes, most significant byte first
+    const uint16_t crc = ((p_msg[p_msg[0] - 1] << 8) | p_msg[p_msg[0]]) ^ aci_setup_cur->patch_crc_delta;
 
+    p_msg[p_msg[0] - 1] = (uint8_t)(crc >> 8);
+    p_msg[p_msg[0]]     = (uint8_t)crc;
+  }
+}
+
+bool aci_setup_patch(aci_state_t *aci_stat, uint8_t msg_index, uint8_t offset, const uint8_t *p_data, uint8_t length)
+{
+  aci_setup_patch_t *p_patch;
+  uint8_t            msg[HAL_ACI_MAX_LENGTH + 1];
+  uint16_t           after;
+  uint16_t           crc = 0;
+  uint8_t            covered;
+  uint8_t            i;
+
+  lib_aci_select(aci_stat);
+
+  if (aci_setup_cur->running || (aci_setup_cur->patch_count >= ACI_SETUP_PATCHES) ||
+      (msg_index >= aci_stat->aci_setup_info.num_setup_msgs) || (0 == length) || (offset < 4))
+  {
+    return false;
+  }
+
+  after   = aci_setup_msg_get(aci_stat, msg_index, msg);
+  covered = ((aci_stat->aci_setup_info.num_setup_msgs - 1) == msg_index) ? (msg[0] - 1) : (msg[0] + 1);
+  if (((uint16_t)offset + length) > covered)
+  {
+    //Only the data of the message, and never the CRC itself
+    return false;
+  }
+
+  /* The change is against the bytes as the earlier patches left them */
+  p_patch = &aci_setup_cur->patches[0];
+  for (i = 0; i < aci_setup_cur->patch_count; i++, p_patch++)
+  {
+    if (msg_index == p_patch->msg_index)
+    {
+      memcpy(&msg[p_patch->offset], p_patch->data, p_patch->length);
+    }
+  }
+
+  /* The CRC is linear: the new CRC is the old one XOR the CRC, from 0, of the changed bits
+   * followed by the zero bytes up to the end of the setup. */
+  for (i = 0; i < length; i++)
+  {
+    crc = aci_crc16_ccitt_update(crc, msg[offset + i] ^ p_data[i]);
+  }
+  crc = aci_setup_crc_shift(crc, after + (covered - offset - length));
+
+  p_patch            = &aci_setup_cur->patches[aci_setup_cur->patch_count];
+  p_patch->msg_index = msg_index;
+  p_patch->offset    = offset;
+  p_patch->length    = length;
+  memcpy(p_patch->data, p_data, length);
+  aci_setup_cur->patch_count++;
+  aci_setup_cur->patch_crc_delta ^= crc;
+
+  return true;
+}
+
+void aci_setup_patch_clear(aci_state_t *aci_stat)
+{
+  lib_aci_select(aci_stat);
+
+  aci_setup_cur->patch_count     = 0;
+  aci_setup_cur->patch_crc_delta = 0;
+}
+#endif
+
+/*
+  Puts setup message msg_index straight into a command queue slot, decoded and patched there.
+  Returns false with nothing consumed when the queue is full.
+*/
+static bool aci_setup_send(aci_state_t *aci_stat, uint8_t msg_index)
+{
+  hal_aci_data_t *p_slot;
+#if ACI_SETUP_COMPRESSED
+  aci_setup_decoder_t decoder;
+#endif
+
+  p_slot = hal_aci_tl_send_reserve(ACI_CMD_SETUP);
+  if (NULL == p_slot)
+  {
+    return false;
+  }
 
+#if ACI_SETUP_COMPRESSED
+  if (NULL != aci_stat->aci_setup_info.setup_msgs_compressed)
+  {
+    decoder.pos    = aci_setup_cur->compressed_pos;
+    decoder.target = aci_setup_cur->compressed_target;
+    decoder.offset = aci_setup_cur->compressed_offset;
+    aci_setup_decode(&decoder, aci_stat->aci_setup_info.setup_msgs_compressed, &p_slot->buffer[0]);
+  }
+  else
+#endif
+  {
+    const hal_aci_data_t *p_setup_msg = aci_setup_msg_ptr(aci_stat, msg_index);
+
+	//Board dependent defines
+	#if defined(__PIC32MX__)
+		//In ChipKit we store the setup messages in RAM
+		memcpy(&p_slot->buffer[0], &p_setup_msg->buffer[0], p_setup_msg->buffer[0] + 1);
+	#else
+		//For the other cores the setup ACI message is read from Flash into the slot
+		memcpy_P(&p_slot->buffer[0], &p_setup_msg->buffer[0], pgm_read_byte_near(&p_setup_msg->buffer[0]) + 1);
+	#endif
+  }
+
+#if ACI_SETUP_PATCHES
+  aci_setup_patch_apply(aci_stat, msg_index, &p_slot->buffer[0]);
+#endif
+
+  if (!hal_aci_tl_send_commit())
+  {
+    return false;
+  }
+
+#if ACI_SETUP_COMPRESSED
+  if (NULL != aci_stat->aci_setup_info.setup_msgs_compressed)
+  {
+    aci_setup_cur->compressed_pos    = decoder.pos;
+    aci_setup_cur->compressed_target = decoder.target;
+    aci_setup_cur->compressed_offset = decoder.offset;
+  }
+#endif
+  return true;
+}
 
 /**************************************************************************                */
 /* Utility function to fill the the ACI command queue                                      */
@@ -53,20 +524,8 @@ static bool aci_setup_fill(aci_state_t *aci_stat, uint8_t *num_cmd_offset)
   
   while (*num_cmd_offset < aci_stat->aci_setup_info.num_setup_msgs)
   {
-	//Board dependent defines
-	#if defined (__AVR__)
-		//For Arduino copy the setup ACI message from Flash to RAM.
-		memcpy_P(&msg_to_send, &(aci_stat->aci_setup_info.setup_msgs[*num_cmd_offset]), 
-				  pgm_read_byte_near(&(aci_stat->aci_setup_info.setup_msgs[*num_cmd_offset].buffer[0]))+2); 
-	#elif defined(__PIC32MX__)
-		//In ChipKit we store the setup messages in RAM
-		//Add 2 bytes to the length byte for status byte, length for the total number of bytes
-		memcpy(&msg_to_send, &(aci_stat->aci_setup_info.setup_msgs[*num_cmd_offset]), 
-				  (aci_stat->aci_setup_info.setup_msgs[*num_cmd_offset].buffer[0]+2)); 
-	#endif
-
     //Put the Setup ACI message in the command queue
-    if (!hal_aci_tl_send(&msg_to_send))
+    if (!aci_setup_send(aci_stat, *num_cmd_offset))
     {
       //ACI Command Queue is full
       // *num_cmd_offset is now pointing to the index of the Setup command that did not get sent
@@ -81,91 +540,178 @@ static bool aci_setup_fill(aci_state_t *aci_stat, uint8_t *num_cmd_offset)
   return ret_val;
 }
 
-uint8_t do_aci_setup(aci_state_t *aci_stat)
+/*
+  Messages in the outgoing queue must be handled before the Setup routine can run.
+  If there are events pending from the device that are not relevant to setup, we fail
+  so that the user can handle them. At this point we don't care what the event is,
+  as any event is an error.
+*/
+static uint8_t aci_setup_start(aci_state_t *aci_stat)
 {
-  uint8_t setup_offset         = 0;
-  uint32_t i                   = 0x0000;
-  aci_evt_t * aci_evt          = NULL;
-  aci_status_code_t cmd_status = ACI_STATUS_ERROR_CRC_MISMATCH;
-  
-  /*
-  We are using the same buffer since we are copying the contents of the buffer 
-  when queuing and immediately processing the buffer when receiving
-  */
-  hal_aci_evt_t  *aci_data = (hal_aci_evt_t *)&msg_to_send;
-  
-  /* Messages in the outgoing queue must be handled before the Setup routine can run.
-   * If it is non-empty we return. The user should then process the messages before calling
-   * do_aci_setup() again.
-   */
   if (!lib_aci_command_queue_empty())
   {
     return SETUP_FAIL_COMMAND_QUEUE_NOT_EMPTY;
   }
-  
-  /* If there are events pending from the device that are not relevant to setup, we return false
-   * so that the user can handle them. At this point we don't care what the event is,
-   * as any event is an error.
-   */
-  if (lib_aci_event_peek(aci_data))
+
+  if (NULL != lib_aci_event_peek_ptr())
   {
     return SETUP_FAIL_EVENT_QUEUE_NOT_EMPTY;
   }
-  
-  /* Fill the ACI command queue with as many Setup messages as it will hold. */
-  aci_setup_fill(aci_stat, &setup_offset);
-  
-  while (cmd_status != ACI_STATUS_TRANSACTION_COMPLETE)
+
+#if LIB_ACI_STARTUP_PROFILE
+  lib_aci_startup_profile_setup_start(aci_stat);
+#endif
+  aci_setup_cur->offset      = 0;
+  aci_setup_cur->progress_ms = millis();
+#if ACI_SETUP_COMPRESSED
+  aci_setup_cur->compressed_pos    = 0;
+  aci_setup_cur->compressed_target = 0;
+  aci_setup_cur->compressed_offset = 0;
+#endif
+  aci_setup_cur->running     = true;
+#if ACI_SETUP_RETAIN
+  /* Until the setup completes the nRF8001 holds no known setup */
+  aci_setup_retained_cur->marker = 0;
+#endif
+
+  return SETUP_IN_PROGRESS;
+}
+
+uint8_t aci_setup_poll(aci_state_t *aci_stat)
+{
+  const aci_evt_t      *aci_evt;
+  /* Events are inspected in place in the event queue */
+  const hal_aci_evt_t  *aci_data;
+  aci_status_code_t     cmd_status;
+
+  lib_aci_select(aci_stat);
+
+  if (!aci_setup_cur->running)
   {
-    /* This counter is used to ensure that this function does not loop forever. When the device
-     * returns a valid response, we reset the counter.
-     */
-    if (i++ > 0xFFFFE)
+    uint8_t result = aci_setup_start(aci_stat);
+
+    if (SETUP_IN_PROGRESS != result)
     {
-      return SETUP_FAIL_TIMEOUT;	
+      return result;
     }
-    
-    if (lib_aci_event_peek(aci_data))
+  }
+
+  /* Keep the ACI command queue filled with as many Setup messages as it will hold. */
+  aci_setup_fill(aci_stat, &aci_setup_cur->offset);
+
+  aci_data = lib_aci_event_peek_ptr();
+  if (NULL == aci_data)
+  {
+    /* The timeout restarts each time the device responds */
+    if ((millis() - aci_setup_cur->progress_ms) > ACI_SETUP_TIMEOUT_MS)
     {
-      aci_evt = &(aci_data->evt);
-      
-      if (ACI_EVT_CMD_RSP != aci_evt->evt_opcode)
-      {
-        //Receiving something other than a Command Response Event is an error.
-        return SETUP_FAIL_NOT_COMMAND_RESPONSE;
-      }
-      
-      cmd_status = (aci_status_code_t) aci_evt->params.cmd_rsp.cmd_status;
-      switch (cmd_status)
-      {
-        case ACI_STATUS_TRANSACTION_CONTINUE:
-          //As the device is responding, reset guard counter
-          i = 0;
-          
-          /* As the device has processed the Setup messages we put in the command queue earlier,
-           * we can proceed to fill the queue with new messages
-           */
-          aci_setup_fill(aci_stat, &setup_offset);
-          break;
-        
-        case ACI_STATUS_TRANSACTION_COMPLETE:
-          //Break out of the while loop when this status code appears
-          break;
-        
-        default:
-          //An event with any other status code should be handled by the application
-          return SETUP_FAIL_NOT_SETUP_EVENT;
-      }
-      
-      /* If we haven't returned at this point, the event was either ACI_STATUS_TRANSACTION_CONTINUE
-       * or ACI_STATUS_TRANSACTION_COMPLETE. We don't need the event itself, so we simply
-       * remove it from the queue.
-       */
-       lib_aci_event_get (aci_stat, aci_data);
+      aci_setup_cur->running = false;
+      return SETUP_FAIL_TIMEOUT;
     }
+    return SETUP_IN_PROGRESS;
   }
-  
-  return SETUP_SUCCESS;
+
+  aci_evt = &(aci_data->evt);
+  if (ACI_EVT_CMD_RSP != aci_evt->evt_opcode)
+  {
+    //Receiving something other than a Command Response Event is an error.
+    aci_setup_cur->running = false;
+    return SETUP_FAIL_NOT_COMMAND_RESPONSE;
+  }
+
+  cmd_status = (aci_status_code_t) aci_evt->params.cmd_rsp.cmd_status;
+  if ((ACI_STATUS_TRANSACTION_CONTINUE != cmd_status) && (ACI_STATUS_TRANSACTION_COMPLETE != cmd_status))
+  {
+    //An event with any other status code should be handled by the application
+    aci_setup_cur->running = false;
+    return SETUP_FAIL_NOT_SETUP_EVENT;
+  }
+
+  /* The event was either ACI_STATUS_TRANSACTION_CONTINUE or ACI_STATUS_TRANSACTION_COMPLETE.
+   * We don't need the event itself, so we simply remove it from the queue.
+   */
+  lib_aci_event_release(aci_stat);
+  aci_setup_cur->progress_ms = millis();
+
+  if (ACI_STATUS_TRANSACTION_COMPLETE == cmd_status)
+  {
+    aci_setup_cur->running = false;
+#if ACI_SETUP_RETAIN
+    aci_setup_retain_set(aci_stat);
+#endif
+    return SETUP_SUCCESS;
+  }
+
+  /* As the device has processed the Setup messages we put in the command queue earlier,
+   * we can proceed to fill the queue with new messages
+   */
+  aci_setup_fill(aci_stat, &aci_setup_cur->offset);
+
+  return SETUP_IN_PROGRESS;
 }
-  
 
+#if ACI_SETUP_PROFILES
+bool aci_setup_profile_select(aci_state_t *aci_stat, const aci_setup_profile_t *p_profile, bool debug)
+{
+  aci_setup_ctx_t *p_ctx;
+  uint8_t          i;
+
+  lib_aci_select(aci_stat);
+  p_ctx = aci_setup_cur;
+  if (p_ctx->running)
+  {
+    return false;
+  }
+
+  aci_stat->aci_setup_info.setup_msg_table            = p_profile->p_msg_table;
+  aci_stat->aci_setup_info.num_setup_msgs             = p_profile->num_setup_msgs;
+  aci_stat->aci_setup_info.services_pipe_type_mapping = p_profile->p_pipe_map;
+  aci_stat->aci_setup_info.number_of_pipes            = p_profile->number_of_pipes;
+  aci_stat->aci_setup_info.setup_msgs                 = NULL;
+  aci_stat->aci_setup_info.setup_msgs_compressed      = NULL;
+#if ACI_SETUP_PATCHES
+  aci_setup_patch_clear(aci_stat);
+#endif
+
+  /* A profile selected before needs no pass over its messages for the CRC */
+  p_ctx->p_profile = p_profile;
+  p_ctx->crc_valid = false;
+  for (i = 0; i < ACI_SETUP_PROFILES; i++)
+  {
+    if (p_profile == p_ctx->profile_ids[i])
+    {
+      p_ctx->crc       = p_ctx->profile_crcs[i];
+      p_ctx->crc_valid = true;
+      break;
+    }
+  }
+
+  lib_aci_init_start(aci_stat, debug);
+  return true;
+}
+#endif
+
+uint16_t aci_setup_ram_bytes(void)
+{
+#if ACI_SETUP_RETAIN
+  return sizeof(aci_setup_ctx) + sizeof(aci_setup_retained);
+#else
+  return sizeof(aci_setup_ctx);
+#endif
+}
+
+uint8_t do_aci_setup(aci_state_t *aci_stat)
+{
+  uint8_t result;
+
+  /* do_aci_setup() always starts a new setup */
+  lib_aci_select(aci_stat);
+  aci_setup_cur->running = false;
+
+  do
+  {
+    result = aci_setup_poll(aci_stat);
+  } while (SETUP_IN_PROGRESS == result);
+
+  return result;
+}
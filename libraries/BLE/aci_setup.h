@@ -29,6 +29,111 @@
 #define SETUP_FAIL_TIMEOUT                   3
 #define SETUP_FAIL_NOT_SETUP_EVENT           4
 #define SETUP_FAIL_NOT_COMMAND_RESPONSE      5
+#define SETUP_IN_PROGRESS                    6
+
+/************************************************************************/
+/* Setup timeout                                                         */
+/* The setup fails with SETUP_FAIL_TIMEOUT when the nRF8001 has not      */
+/* answered a setup message for this many milliseconds.                  */
+/************************************************************************/
+#ifndef ACI_SETUP_TIMEOUT_MS
+#define ACI_SETUP_TIMEOUT_MS 1000
+#endif
+
+/************************************************************************/
+/* Retained setup                                                        */
+/* 1 : The CRC of the last setup that completed is kept in RAM that is   */
+/*     not cleared by a reset of the MCU (.noinit on AVR). After a       */
+/*     watchdog or brownout reset lib_aci_init() then does not pin reset */
+/*     the nRF8001 when the setup is the same: it sends a radio reset,   */
+/*     and an nRF8001 that still holds the setup starts in STANDBY with  */
+/*     no setup to upload. Otherwise it is pin reset as usual.           */
+/* 0 : The nRF8001 is pin reset and set up at each start.                */
+/************************************************************************/
+#ifndef ACI_SETUP_RETAIN
+#define ACI_SETUP_RETAIN 0
+#endif
+
+/************************************************************************/
+/* Section of the retained setup record                                  */
+/* Must be RAM that the C startup code does not clear. Without one the   */
+/* record is cleared at each start and the nRF8001 is always set up.     */
+/************************************************************************/
+#ifndef ACI_SETUP_RETAIN_SECTION
+#if defined(__AVR__)
+#define ACI_SETUP_RETAIN_SECTION __attribute__((section(".noinit")))
+#else
+#define ACI_SETUP_RETAIN_SECTION
+#endif
+#endif
+
+/************************************************************************/
+/* Compressed setup messages                                             */
+/* 1 : When aci_setup_info.setup_msgs_compressed is set, the setup       */
+/*     messages are decoded from it into the command queue. It is made   */
+/*     from services.h by Build/CompressSetup.py                         */
+/*     (SETUP_MESSAGES_COMPRESSED_CONTENT) and is about half the size of */
+/*     SETUP_MESSAGES_CONTENT. num_setup_msgs is still NB_SETUP_MESSAGES.*/
+/* 0 : Only setup_msgs is used.                                          */
+/************************************************************************/
+#ifndef ACI_SETUP_COMPRESSED
+#define ACI_SETUP_COMPRESSED 0
+#endif
+
+/************************************************************************/
+/* Setup patches of aci_setup_patch()                                    */
+/* Number of patches that can be put over the setup messages, per        */
+/* nRF8001. Each takes 31 bytes of RAM. 0 compiles it out.               */
+/************************************************************************/
+#ifndef ACI_SETUP_PATCHES
+#define ACI_SETUP_PATCHES 0
+#endif
+
+#if (ACI_SETUP_PATCHES > 255)
+#error "ACI_SETUP_PATCHES must be at most 255"
+#endif
+
+/************************************************************************/
+/* Setup profiles of aci_setup_profile_select()                          */
+/* N : The nRF8001 can be switched between setup profiles at run time,   */
+/*     the CRCs of the last N profiles selected are kept so switching    */
+/*     back does not read the messages again. A profile is a table of    */
+/*     pointers to its setup messages, the messages that profiles have   */
+/*     the same are stored once. Made by Build/SetupProfiles.py.         */
+/* 0 : Compiled out, aci_setup_info.setup_msg_table is not used.         */
+/************************************************************************/
+#ifndef ACI_SETUP_PROFILES
+#define ACI_SETUP_PROFILES 0
+#endif
+
+#if ((ACI_SETUP_PROFILES < 0) || (ACI_SETUP_PROFILES > 8))
+#error "ACI_SETUP_PROFILES must be 0 to 8"
+#endif
+
+/* Most bytes a setup message holds after its length, opcode, target and offset */
+#define ACI_SETUP_PATCH_MAX_LEN  (HAL_ACI_MAX_LENGTH - 3)
+
+#if ACI_SETUP_PATCHES
+/* Bytes put over a setup message when it is sent */
+typedef struct
+{
+  uint8_t msg_index;
+  uint8_t offset;                         // In hal_aci_data_t.buffer, 4 is the first data byte
+  uint8_t length;
+  uint8_t data[ACI_SETUP_PATCH_MAX_LEN];
+} aci_setup_patch_t;
+#endif
+
+#if ACI_SETUP_PROFILES
+/* A setup of aci_setup_profile_select(), from SETUP_PROFILE_<n>_... of Build/SetupProfiles.py */
+typedef struct
+{
+  const hal_aci_data_t * const *p_msg_table;     // SETUP_PROFILE_<n>_TABLE, in PROGMEM but on ChipKit
+  uint8_t                       num_setup_msgs;  // SETUP_PROFILE_<n>_MSG_COUNT
+  services_pipe_type_mapping_t *p_pipe_map;      // SETUP_PROFILE_<n>_PIPE_MAP_CONTENT
+  uint8_t                       number_of_pipes; // SETUP_PROFILE_<n>_NUMBER_OF_PIPES
+} aci_setup_profile_t;
+#endif
 
 /** @brief Setup the nRF8001 device
  *  @details
@@ -37,8 +142,84 @@
  *  Once all messages are sent, the nRF8001 will send a Device Started Event.
  *  The function requires that the Command queue is empty when it is invoked, and will fail
  *  otherwise.
+ *  The function blocks until the setup is done, see aci_setup_poll() for the non-blocking setup.
  *  @returns An integer indicating the reason the function terminated
  */
 uint8_t do_aci_setup(aci_state_t *aci_stat);
 
+/** @brief Setup the nRF8001 device without blocking
+ *  @details
+ *  Performs the same setup as do_aci_setup(), a step at a time. The first call starts the
+ *  setup, with the same conditions on the queues as do_aci_setup(). Each call then puts as
+ *  many setup messages in the command queue as it will hold and handles the response of the
+ *  nRF8001 if there is one. Call it from the loop, in place of lib_aci_event_get(), for as long
+ *  as it returns SETUP_IN_PROGRESS: the Command Response events of the setup are taken by it.
+ *  Any other result ends the setup, a failed setup is started again by the next call.
+ *  @returns SETUP_IN_PROGRESS, SETUP_SUCCESS or the reason the setup failed
+ */
+uint8_t aci_setup_poll(aci_state_t *aci_stat);
+
+#if ACI_SETUP_PATCHES
+/** @brief Changes bytes of a setup message, e.g. the device name or a characteristic default
+ *  @details
+ *  The bytes are put over setup message msg_index each time it is sent, and the CRC at the end
+ *  of the setup is updated to match. The CRC is not recomputed over the setup: the change is
+ *  worked out from the old and new bytes alone, so a patch takes the same time for any size of
+ *  GATT table. Patches are kept until aci_setup_patch_clear(), a later patch of the same bytes
+ *  wins. Must not be called while a setup is running.
+ *  @param msg_index setup message, as in SETUP_MESSAGES_CONTENT.
+ *  @param offset of the first byte in hal_aci_data_t.buffer, at least 4 (after the length,
+ *         opcode, target and offset of the message).
+ *  @param p_data new bytes, copied.
+ *  @param length number of bytes, within the data of the message and not over the CRC.
+ *  @return False when there is no patch left or the bytes are not in the message data.
+ */
+bool aci_setup_patch(aci_state_t *aci_stat, uint8_t msg_index, uint8_t offset, const uint8_t *p_data, uint8_t length);
+
+/** @brief Removes all the patches, the next setup sends the setup messages as stored
+ */
+void aci_setup_patch_clear(aci_state_t *aci_stat);
+#endif
+
+/** @brief CRC of the setup messages
+ *  @details
+ *  The CRC-16-CCITT of the setup messages in aci_setup_info, the same the nRF8001 checks at the
+ *  end of the setup, with the patches of aci_setup_patch(). It is computed over the messages on
+ *  the first call and kept.
+ */
+uint16_t aci_setup_crc(aci_state_t *aci_stat);
+
+/** @brief RAM taken by the setup state of all the instances, the retained record included
+ */
+uint16_t aci_setup_ram_bytes(void);
+
+#if ACI_SETUP_RETAIN
+/** @brief Whether the nRF8001 was last set up with the setup messages in aci_setup_info
+ *  @details
+ *  True when the retained record says the last setup that completed had the same CRC. The
+ *  nRF8001 itself may have been reset since, lib_aci_init() checks with a radio reset.
+ */
+bool aci_setup_is_retained(aci_state_t *aci_stat);
+
+/** @brief Clears the retained record, the next start sets the nRF8001 up again
+ */
+void aci_setup_retain_clear(aci_state_t *aci_stat);
+#endif
+
+#if ACI_SETUP_PROFILES
+/** @brief Resets the nRF8001 to set it up with another setup profile
+ *  @details
+ *  Puts the profile in aci_setup_info, clears the patches of aci_setup_patch() as they were for
+ *  the messages of the previous profile, and starts the initialization with lib_aci_init_start()
+ *  to be advanced with lib_aci_init_poll(). The Device Started that follows is handled as at the
+ *  start: aci_setup_poll() or do_aci_setup() uploads the profile in SETUP mode. With
+ *  ACI_SETUP_RETAIN an nRF8001 that already holds the profile is not reset and starts in STANDBY.
+ *  The link and the pipes of the previous profile are lost.
+ *  @param p_profile the profile, kept by the application for as long as it is in use.
+ *  @param debug as for lib_aci_init().
+ *  @return False while a setup is running, nothing is changed.
+ */
+bool aci_setup_profile_select(aci_state_t *aci_stat, const aci_setup_profile_t *p_profile, bool debug);
+#endif
+
 #endif
@@ -0,0 +1,127 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+@brief Implementation of the free stack and static RAM measures
+*/
+
+#include <lib_aci.h>
+#include "aci_stack.h"
+
+#if defined(__AVR__)
+/* Symbols of the AVR linker script and of avr-libc malloc() */
+extern "C"
+{
+  extern uint8_t  __data_start;
+  extern uint8_t  __bss_end;
+  extern uint8_t  __heap_start;
+  extern uint8_t *__brkval;
+}
+
+#if ACI_STACK_CHECK
+volatile uint16_t aci_stack_isr_sp_min  = 0xFFFF;
+volatile uint16_t aci_stack_loop_sp_min = 0xFFFF;
+#endif
+
+/* First byte above the heap, where the stack must not come down to */
+static uint8_t *aci_stack_heap_end(void)
+{
+  return (NULL != __brkval) ? __brkval : &__heap_start;
+}
+
+static uint16_t aci_stack_free_at(uint16_t sp)
+{
+  const uint16_t heap_end = (uint16_t)(uintptr_t)aci_stack_heap_end();
+
+  return (sp > heap_end) ? (uint16_t)(sp - heap_end) : 0;
+}
+
+void aci_stack_paint(void)
+{
+  const uint8_t  sreg = SREG;
+  uint8_t       *p_byte;
+  uint8_t       *p_end;
+
+  noInterrupts();
+  p_byte = aci_stack_heap_end();
+  p_end  = (uint8_t *)(uintptr_t)(SP - ACI_STACK_PAINT_MARGIN);
+  while (p_byte < p_end)
+  {
+    *p_byte++ = ACI_STACK_PAINT;
+  }
+#if ACI_STACK_CHECK
+  aci_stack_isr_sp_min  = 0xFFFF;
+  aci_stack_loop_sp_min = 0xFFFF;
+#endif
+  SREG = sreg;
+}
+
+void aci_stack_sample(void)
+{
+  ACI_STACK_SAMPLE(aci_stack_loop_sp_min);
+}
+
+void aci_stack_report_get(aci_state_t *aci_stat, aci_stack_report_t *p_report)
+{
+  const uint8_t *p_byte = aci_stack_heap_end();
+  const uint8_t *p_sp   = (const uint8_t *)(uintptr_t)SP;
+  lib_aci_ram_t  ram;
+
+  lib_aci_ram_get(aci_stat, &ram);
+  memset(p_report, 0, sizeof(*p_report));
+  p_report->static_ram = (uint16_t)(&__bss_end - &__data_start);
+  p_report->ble_ram    = ram.total;
+  p_report->free_now   = aci_stack_free_at(SP);
+
+  while ((p_byte < p_sp) && (ACI_STACK_PAINT == *p_byte))
+  {
+    p_byte++;
+  }
+  p_report->free_min = (uint16_t)(p_byte - aci_stack_heap_end());
+
+#if ACI_STACK_CHECK
+  ACI_STACK_SAMPLE(aci_stack_loop_sp_min);
+  noInterrupts();
+  p_report->isr_free_min  = (0xFFFF == aci_stack_isr_sp_min) ? 0 : aci_stack_free_at(aci_stack_isr_sp_min);
+  interrupts();
+  p_report->loop_free_min = aci_stack_free_at(aci_stack_loop_sp_min);
+#endif
+}
+#else
+void aci_stack_paint(void)
+{
+}
+
+void aci_stack_sample(void)
+{
+}
+
+void aci_stack_report_get(aci_state_t *aci_stat, aci_stack_report_t *p_report)
+{
+  lib_aci_ram_t ram;
+
+  lib_aci_ram_get(aci_stat, &ram);
+  memset(p_report, 0, sizeof(*p_report));
+  p_report->ble_ram = ram.total;
+}
+#endif
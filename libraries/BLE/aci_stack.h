@@ -0,0 +1,112 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/** @file
+ * @brief Free stack and static RAM of the sketch and of the BLE library.
+ */
+
+/** @defgroup aci_stack aci_stack
+@{
+@ingroup lib
+
+@brief Measures how close the stack came to the heap, in the loop and in the ACI interrupt.
+@details aci_stack_paint(), called first thing in setup(), fills the RAM between the heap and the
+stack with ACI_STACK_PAINT. aci_stack_report_get() then counts the bytes the stack never reached
+since, whichever context used them, and gives the static RAM of the sketch and of the BLE library
+(lib_aci_ram_get()).
+
+With ACI_STACK_CHECK the stack pointer is also sampled by the ACI interrupt before its SPI transfer
+and by the polling transport before its own, and by aci_stack_sample() wherever the sketch calls it.
+The least free stack of the interrupt is what is left once it is nested on the deepest loop() it
+interrupted, the margin to tune the queue sizes against on a 2 KB part.
+
+Only the AVR has a layout of the heap and stack to measure, elsewhere the stack figures are 0.
+*/
+
+#ifndef ACI_STACK_H__
+#define ACI_STACK_H__
+
+#include <lib_aci.h>
+
+/************************************************************************/
+/* Stack pointer samples                                                 */
+/* 1 : The ACI interrupt, the polling transport and aci_stack_sample()   */
+/*     keep the lowest stack pointer they have seen (AVR).               */
+/* 0 : Only the painted stack is measured.                               */
+/************************************************************************/
+#ifndef ACI_STACK_CHECK
+#define ACI_STACK_CHECK 0
+#endif
+
+/* Byte the free RAM is painted with */
+#define ACI_STACK_PAINT  0xC5
+
+/* Bytes under the stack pointer left alone by aci_stack_paint(), for its own frame */
+#define ACI_STACK_PAINT_MARGIN  16
+
+#if (ACI_STACK_CHECK && defined(__AVR__))
+extern volatile uint16_t aci_stack_isr_sp_min;
+extern volatile uint16_t aci_stack_loop_sp_min;
+
+/* Keeps the lowest stack pointer seen in a context */
+#define ACI_STACK_SAMPLE(sp_min)                 \
+  do {                                           \
+    const uint16_t sp_now = SP;                  \
+    if (sp_now < (sp_min)) { (sp_min) = sp_now; } \
+  } while (0)
+#else
+#define ACI_STACK_SAMPLE(sp_min)
+#endif
+
+/* From aci_stack_report_get(), in bytes */
+typedef struct
+{
+  uint16_t static_ram;     // .data and .bss of the sketch, all of it
+  uint16_t ble_ram;        // Static RAM of the BLE library, lib_aci_ram_get() total
+  uint16_t free_now;       // Between the heap and the stack pointer of the caller
+  uint16_t free_min;       // Painted bytes the stack never reached, any context
+  uint16_t loop_free_min;  // Least free stack sampled in the loop, 0 without ACI_STACK_CHECK
+  uint16_t isr_free_min;   // Least free stack sampled by the ACI interrupt, 0 without ACI_STACK_CHECK
+} aci_stack_report_t;
+
+/** @brief Paints the free RAM, to be called first thing in setup().
+ *  @details With the interrupts disabled, from the end of the heap to ACI_STACK_PAINT_MARGIN bytes
+ *  under the stack pointer. Clears the stack pointer samples. May be called again to start over.
+ */
+void aci_stack_paint(void);
+
+/** @brief Samples the stack pointer of the loop, from a deep point of the sketch.
+ *  @details Only with ACI_STACK_CHECK, does nothing otherwise.
+ */
+void aci_stack_sample(void);
+
+/** @brief Gets the free stack and static RAM figures.
+ *  @details Counts the painted bytes left from the end of the heap up, so it takes longer the more
+ *  RAM is free: about 1 ms per KB on a 16 MHz AVR.
+ *  @param aci_stat pointer to the state of the ACI, for lib_aci_ram_get().
+ *  @param p_report filled with the figures.
+ */
+void aci_stack_report_get(aci_state_t *aci_stat, aci_stack_report_t *p_report);
+
+/** @} */
+
+#endif // ACI_STACK_H__
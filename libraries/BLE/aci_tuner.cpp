@@ -0,0 +1,176 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+ 
+
+/** @file
+@brief Implementation of the connection parameter tuner
+*/
+
+#include <lib_aci.h>
+#include "aci_tuner.h"
+
+void aci_tuner_init(aci_tuner_t *p_tuner, const aci_tuner_params_t *p_params)
+{
+  p_tuner->p_params        = p_params;
+  p_tuner->connected       = false;
+  p_tuner->mode            = ACI_TUNER_MODE_NONE;
+  p_tuner->app_latency_on  = false;
+  p_tuner->last_busy_ms    = 0;
+  p_tuner->last_request_ms = 0;
+}
+
+void aci_tuner_event(aci_tuner_t *p_tuner, aci_state_t *aci_stat, const aci_evt_t *p_evt)
+{
+  (void)aci_stat;
+
+  switch (p_evt->evt_opcode)
+  {
+    case ACI_EVT_CONNECTED:
+      p_tuner->connected      = true;
+      p_tuner->mode           = ACI_TUNER_MODE_NONE;
+      p_tuner->app_latency_on = false;
+      p_tuner->last_busy_ms   = millis();
+      break;
+
+    case ACI_EVT_DISCONNECTED:
+      p_tuner->connected = false;
+      break;
+
+    default:
+      break;
+  }
+}
+
+/*
+  True when there is data waiting for the link. A queue that is only not empty is not enough,
+  the commands of the tuner itself would look like a backlog.
+*/
+static bool aci_tuner_is_busy(aci_state_t *aci_stat)
+{
+  if (lib_aci_command_queue_full() || (0 == aci_stat->data_credit_available))
+  {
+    return true;
+  }
+#if LIB_ACI_STREAM_BYTES
+  if (0 != lib_aci_stream_pending(aci_stat))
+  {
+    return true;
+  }
+#endif
+  return false;
+}
+
+/*
+  True when the interval given by the last ACI_EVT_TIMING is in the range asked for the mode.
+*/
+static bool aci_tuner_is_granted(const aci_tuner_t *p_tuner, aci_state_t *aci_stat)
+{
+  const aci_tuner_params_t *p_params = p_tuner->p_params;
+
+  if (ACI_TUNER_MODE_BURST == p_tuner->mode)
+  {
+    return (aci_stat->connection_interval <= p_params->burst_max_interval);
+  }
+  return (aci_stat->connection_interval >= p_params->idle_min_interval);
+}
+
+static bool aci_tuner_request(aci_tuner_t *p_tuner, uint8_t mode)
+{
+  const aci_tuner_params_t *p_params = p_tuner->p_params;
+
+  if (ACI_TUNER_MODE_BURST == mode)
+  {
+    // Take every connection event again before asking for the short interval, with
+    // ACI_TX_CTRL_QUEUE_BYTES the ChangeTimingRequest goes out just ahead of it
+    if (p_tuner->app_latency_on)
+    {
+      if (!lib_aci_set_app_latency(0, ACI_APP_LATENCY_DISABLE))
+      {
+        return false;
+      }
+      p_tuner->app_latency_on = false;
+    }
+    return lib_aci_change_timing(p_params->burst_min_interval, p_params->burst_max_interval, 0, p_params->timeout);
+  }
+
+  if (!lib_aci_change_timing(p_params->idle_min_interval, p_params->idle_max_interval,
+                             p_params->idle_slave_latency, p_params->timeout))
+  {
+    return false;
+  }
+  if ((0 != p_params->idle_app_latency) && !p_tuner->app_latency_on)
+  {
+    p_tuner->app_latency_on = lib_aci_set_app_latency(p_params->idle_app_latency, ACI_APP_LATENCY_ENABLE);
+  }
+  return true;
+}
+
+void aci_tuner_poll(aci_tuner_t *p_tuner, aci_state_t *aci_stat)
+{
+  unsigned long now_ms;
+  uint8_t mode;
+
+  if (!p_tuner->connected)
+  {
+    return;
+  }
+
+  lib_aci_select(aci_stat);
+  now_ms = millis();
+
+  if (aci_tuner_is_busy(aci_stat))
+  {
+    p_tuner->last_busy_ms = now_ms;
+    mode = ACI_TUNER_MODE_BURST;
+  }
+  else if ((now_ms - p_tuner->last_busy_ms) >= p_tuner->p_params->idle_after_ms)
+  {
+    mode = ACI_TUNER_MODE_IDLE;
+  }
+  else
+  {
+    // Short pause in the data, keep the current parameters
+    return;
+  }
+
+  if ((mode == p_tuner->mode) && aci_tuner_is_granted(p_tuner, aci_stat))
+  {
+    return;
+  }
+
+  // The first request of a connection is made at once, the peer has time to answer the others
+  if ((ACI_TUNER_MODE_NONE != p_tuner->mode) &&
+      ((now_ms - p_tuner->last_request_ms) < p_tuner->p_params->hold_ms))
+  {
+    return;
+  }
+
+  if (aci_tuner_request(p_tuner, mode))
+  {
+    p_tuner->mode            = mode;
+    p_tuner->last_request_ms = now_ms;
+  }
+}
+
+uint8_t aci_tuner_mode(const aci_tuner_t *p_tuner)
+{
+  return p_tuner->mode;
+}
@@ -0,0 +1,96 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+ 
+
+/** @file
+ * @brief Connection parameter tuner driven by the command backlog.
+ */
+
+/** @defgroup aci_tuner aci_tuner
+@{
+@ingroup lib
+
+@brief Asks for a short connection interval while data is waiting to be sent and for a long
+interval with slave latency when the link has been idle for a while.
+@details The link is busy when the ACI command queue is full, no data credit is left or
+the lib_aci_send_stream() buffer holds data. Call aci_tuner_event() with every ACI event and
+aci_tuner_poll() from the loop. A new request is only made once hold_ms after the previous one,
+and again when the ACI_EVT_TIMING from the peer did not give an interval in the requested range.
+*/
+
+#ifndef ACI_TUNER_H__
+#define ACI_TUNER_H__
+
+#include <lib_aci.h>
+
+/** Connection parameters of the two modes, intervals in multiples of 1.25&nbsp;ms */
+typedef struct
+{
+  uint16_t burst_min_interval;   /**< e.g. 11 */
+  uint16_t burst_max_interval;   /**< e.g. 18 */
+  uint16_t idle_min_interval;    /**< e.g. 400 */
+  uint16_t idle_max_interval;    /**< e.g. 800 */
+  uint16_t idle_slave_latency;   /**< Slave latency asked for in the idle mode */
+  uint16_t idle_app_latency;     /**< Application latency of the idle mode (lib_aci_set_app_latency()), 0 for none */
+  uint16_t timeout;              /**< Supervision timeout in multiples of 10&nbsp;ms, e.g. 600 */
+  uint16_t idle_after_ms;        /**< Time without backlog before the idle mode is asked for */
+  uint16_t hold_ms;              /**< Shortest time between two requests */
+} aci_tuner_params_t;
+
+typedef enum
+{
+  ACI_TUNER_MODE_NONE,     /**< Nothing asked for in this connection yet */
+  ACI_TUNER_MODE_BURST,
+  ACI_TUNER_MODE_IDLE
+} aci_tuner_mode_t;
+
+/** State of the tuner, one per nRF8001 */
+typedef struct
+{
+  const aci_tuner_params_t *p_params;
+  bool                      connected;
+  uint8_t                   mode;              /**< aci_tuner_mode_t last asked for */
+  bool                      app_latency_on;
+  unsigned long             last_busy_ms;
+  unsigned long             last_request_ms;
+} aci_tuner_t;
+
+/** @brief Initializes the tuner.
+ *  @param p_tuner state of the tuner.
+ *  @param p_params connection parameters, must stay valid while the tuner is used.
+ */
+void aci_tuner_init(aci_tuner_t *p_tuner, const aci_tuner_params_t *p_params);
+
+/** @brief Gives an ACI event to the tuner, call it for every event taken from lib_aci_event_get().
+ */
+void aci_tuner_event(aci_tuner_t *p_tuner, aci_state_t *aci_stat, const aci_evt_t *p_evt);
+
+/** @brief Asks for the connection parameters of the current load, call it from the loop.
+ *  @details At most one request is made per call, nothing is sent when the mode is unchanged.
+ */
+void aci_tuner_poll(aci_tuner_t *p_tuner, aci_state_t *aci_stat);
+
+/** @brief Gets the mode asked for last, aci_tuner_mode_t.
+ */
+uint8_t aci_tuner_mode(const aci_tuner_t *p_tuner);
+
+#endif // ACI_TUNER_H__
+/** @} */
@@ -0,0 +1,263 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+@brief Implementation of the UART over BLE bridge
+*/
+
+#include <lib_aci.h>
+#include "aci_uart_bridge.h"
+
+#define TO_BLE_MASK     (ACI_UART_BRIDGE_TO_BLE_SIZE - 1)
+#define TO_SERIAL_MASK  (ACI_UART_BRIDGE_TO_SERIAL_SIZE - 1)
+
+static uint8_t to_ble_count(const aci_uart_bridge_t *p_bridge)
+{
+  return (uint8_t)(p_bridge->to_ble_head - p_bridge->to_ble_tail);
+}
+
+static uint8_t to_serial_count(const aci_uart_bridge_t *p_bridge)
+{
+  return (uint8_t)(p_bridge->to_serial_head - p_bridge->to_serial_tail);
+}
+
+static void rts_update(aci_uart_bridge_t *p_bridge)
+{
+  const uint8_t room = aci_uart_bridge_room(p_bridge);
+
+  if (UNUSED == p_bridge->p_params->rts_pin)
+  {
+    return;
+  }
+
+  if (!p_bridge->rts_high && (room < (ACI_UART_BRIDGE_TO_BLE_SIZE / 4)))
+  {
+    p_bridge->rts_high = true;
+    digitalWrite(p_bridge->p_params->rts_pin, HIGH);
+  }
+  else if (p_bridge->rts_high && (room >= (ACI_UART_BRIDGE_TO_BLE_SIZE / 2)))
+  {
+    p_bridge->rts_high = false;
+    digitalWrite(p_bridge->p_params->rts_pin, LOW);
+  }
+}
+
+/*
+  Tells the peer to stop at a quarter of the ring and to go on at an eighth, the control point
+  notification takes a data credit like the data.
+*/
+static void flow_control_send(aci_uart_bridge_t *p_bridge, aci_state_t *aci_stat)
+{
+  const aci_uart_bridge_params_t *p_params = p_bridge->p_params;
+  const uint8_t count = to_serial_count(p_bridge);
+  uint8_t opcode;
+
+  if (!p_bridge->peer_told_stop && (count >= (ACI_UART_BRIDGE_TO_SERIAL_SIZE / 4)))
+  {
+    opcode = ACI_UART_BRIDGE_OP_TRANSMIT_STOP;
+  }
+  else if (p_bridge->peer_told_stop && (count <= (ACI_UART_BRIDGE_TO_SERIAL_SIZE / 8)))
+  {
+    opcode = ACI_UART_BRIDGE_OP_TRANSMIT_OK;
+  }
+  else
+  {
+    return;
+  }
+
+  if ((0 == p_params->control_point_tx_pipe) ||
+      !lib_aci_is_pipe_available(aci_stat, p_params->control_point_tx_pipe) ||
+      !lib_aci_send_data(p_params->control_point_tx_pipe, &opcode, 1))
+  {
+    return;
+  }
+
+  p_bridge->peer_told_stop = (ACI_UART_BRIDGE_OP_TRANSMIT_STOP == opcode);
+  if (p_bridge->peer_told_stop)
+  {
+    p_bridge->stats.stops_sent++;
+  }
+}
+
+void aci_uart_bridge_init(aci_uart_bridge_t *p_bridge, const aci_uart_bridge_params_t *p_params)
+{
+  memset(p_bridge, 0, sizeof(*p_bridge));
+  p_bridge->p_params = p_params;
+
+  if (UNUSED != p_params->rts_pin)
+  {
+    pinMode(p_params->rts_pin, OUTPUT);
+    digitalWrite(p_params->rts_pin, LOW);
+  }
+}
+
+void aci_uart_bridge_event(aci_uart_bridge_t *p_bridge, aci_state_t *aci_stat, const aci_evt_t *p_evt)
+{
+  const aci_uart_bridge_params_t *p_params = p_bridge->p_params;
+  uint8_t pipe;
+  uint8_t length;
+  uint8_t i;
+
+  (void)aci_stat;
+
+  switch (p_evt->evt_opcode)
+  {
+    case ACI_EVT_DATA_RECEIVED:
+      pipe   = p_evt->params.data_received.rx_data.pipe_number;
+      length = p_evt->len - 2;
+
+      if (pipe == p_params->rx_pipe)
+      {
+        for (i = 0; i < length; i++)
+        {
+          if (to_serial_count(p_bridge) == ACI_UART_BRIDGE_TO_SERIAL_SIZE)
+          {
+            p_bridge->stats.bytes_dropped += (length - i);
+            break;
+          }
+          p_bridge->to_serial[p_bridge->to_serial_head & TO_SERIAL_MASK] =
+            p_evt->params.data_received.rx_data.aci_data[i];
+          p_bridge->to_serial_head++;
+          p_bridge->stats.bytes_received++;
+        }
+      }
+      else if ((0 != p_params->control_point_rx_pipe) &&
+               (pipe == p_params->control_point_rx_pipe) && (0 != length))
+      {
+        if (ACI_UART_BRIDGE_OP_TRANSMIT_STOP == p_evt->params.data_received.rx_data.aci_data[0])
+        {
+          p_bridge->peer_stopped = true;
+        }
+        else if (ACI_UART_BRIDGE_OP_TRANSMIT_OK == p_evt->params.data_received.rx_data.aci_data[0])
+        {
+          p_bridge->peer_stopped = false;
+        }
+      }
+      break;
+
+    case ACI_EVT_DISCONNECTED:
+      // Nothing is kept for the next peer
+      p_bridge->to_ble_tail    = p_bridge->to_ble_head;
+      p_bridge->to_serial_tail = p_bridge->to_serial_head;
+      p_bridge->peer_stopped   = false;
+      p_bridge->peer_told_stop = false;
+      rts_update(p_bridge);
+      break;
+
+    default:
+      break;
+  }
+}
+
+void aci_uart_bridge_poll(aci_uart_bridge_t *p_bridge, aci_state_t *aci_stat)
+{
+  const aci_uart_bridge_params_t *p_params = p_bridge->p_params;
+  uint8_t packet[ACI_PIPE_TX_DATA_MAX_LEN];
+  uint8_t count;
+  uint8_t length;
+  uint8_t i;
+
+  lib_aci_select(aci_stat);
+  flow_control_send(p_bridge, aci_stat);
+
+  while (!p_bridge->peer_stopped &&
+         (0 != aci_stat->data_credit_available) &&
+         lib_aci_is_pipe_available(aci_stat, p_params->tx_pipe))
+  {
+    count = to_ble_count(p_bridge);
+    if (0 == count)
+    {
+      break;
+    }
+
+    // A short packet only once the serial side has gone quiet
+    if ((count < ACI_PIPE_TX_DATA_MAX_LEN) &&
+        ((millis() - p_bridge->last_put_ms) < p_params->idle_ms))
+    {
+      break;
+    }
+
+    length = (count > ACI_PIPE_TX_DATA_MAX_LEN) ? ACI_PIPE_TX_DATA_MAX_LEN : count;
+    for (i = 0; i < length; i++)
+    {
+      packet[i] = p_bridge->to_ble[(uint8_t)(p_bridge->to_ble_tail + i) & TO_BLE_MASK];
+    }
+    if (!lib_aci_send_data(p_params->tx_pipe, &packet[0], length))
+    {
+      break;
+    }
+
+    p_bridge->to_ble_tail += length;
+    p_bridge->stats.bytes_sent += length;
+    p_bridge->stats.packets_sent++;
+    if (length < ACI_PIPE_TX_DATA_MAX_LEN)
+    {
+      p_bridge->stats.short_packets++;
+    }
+  }
+
+  rts_update(p_bridge);
+}
+
+bool aci_uart_bridge_put(aci_uart_bridge_t *p_bridge, uint8_t byte)
+{
+  if (to_ble_count(p_bridge) == ACI_UART_BRIDGE_TO_BLE_SIZE)
+  {
+    return false;
+  }
+
+  p_bridge->to_ble[p_bridge->to_ble_head & TO_BLE_MASK] = byte;
+  p_bridge->to_ble_head++;
+  p_bridge->last_put_ms = millis();
+  rts_update(p_bridge);
+  return true;
+}
+
+uint8_t aci_uart_bridge_room(const aci_uart_bridge_t *p_bridge)
+{
+  return ACI_UART_BRIDGE_TO_BLE_SIZE - to_ble_count(p_bridge);
+}
+
+int aci_uart_bridge_get(aci_uart_bridge_t *p_bridge)
+{
+  uint8_t byte;
+
+  if (0 == to_serial_count(p_bridge))
+  {
+    return -1;
+  }
+
+  byte = p_bridge->to_serial[p_bridge->to_serial_tail & TO_SERIAL_MASK];
+  p_bridge->to_serial_tail++;
+  return byte;
+}
+
+uint8_t aci_uart_bridge_available(const aci_uart_bridge_t *p_bridge)
+{
+  return to_serial_count(p_bridge);
+}
+
+void aci_uart_bridge_stats_get(const aci_uart_bridge_t *p_bridge, aci_uart_bridge_stats_t *p_stats)
+{
+  *p_stats = p_bridge->stats;
+}
@@ -0,0 +1,160 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+ 
+
+/** @file
+ * @brief Bridges a serial port and the pipes of the UART over BLE service.
+ */
+
+/** @defgroup aci_uart_bridge aci_uart_bridge
+@{
+@ingroup lib
+
+@brief Carries a byte stream both ways between the MCU serial port and the UART TX and UART RX pipes,
+as in ble_uart_project_template.
+@details Bytes for the peer are put in a ring of ACI_UART_BRIDGE_TO_BLE_SIZE bytes and
+aci_uart_bridge_poll() sends them in packets of ACI_PIPE_TX_DATA_MAX_LEN bytes, as many as there are
+data credits for. A shorter packet is only sent once no byte has been put for idle_ms, so a steady
+stream goes out in full packets. While the peer has written UART_OVER_BLE_TRANSMIT_STOP on the
+control point nothing is sent, UART_OVER_BLE_TRANSMIT_OK starts it again.
+
+Bytes from the peer go to a ring of ACI_UART_BRIDGE_TO_SERIAL_SIZE bytes, read with
+aci_uart_bridge_get(). Once a quarter of it is used UART_OVER_BLE_TRANSMIT_STOP is notified on the
+control point, and UART_OVER_BLE_TRANSMIT_OK once it is down to an eighth. What the peer still sends
+before it sees the stop, a connection event of packets or so, has to fit in the rest.
+
+On the serial side rts_pin, when used, is driven HIGH while less than a quarter of the ring to the
+peer is free and LOW again at half, for a serial source with hardware flow control.
+
+Call aci_uart_bridge_event() with every ACI event and aci_uart_bridge_poll() from the loop.
+*/
+
+#ifndef ACI_UART_BRIDGE_H__
+#define ACI_UART_BRIDGE_H__
+
+#include <lib_aci.h>
+
+/************************************************************************/
+/* Bytes buffered for the peer                                           */
+/* A power of two, 32 to 128.                                            */
+/************************************************************************/
+#ifndef ACI_UART_BRIDGE_TO_BLE_SIZE
+#define ACI_UART_BRIDGE_TO_BLE_SIZE 64
+#endif
+
+/************************************************************************/
+/* Bytes buffered from the peer for the serial port                      */
+/* A power of two, 64 to 128. The peer may send 4 packets or more in a   */
+/* connection event, and more after the stop is notified.                */
+/************************************************************************/
+#ifndef ACI_UART_BRIDGE_TO_SERIAL_SIZE
+#define ACI_UART_BRIDGE_TO_SERIAL_SIZE 128
+#endif
+
+#if (ACI_UART_BRIDGE_TO_BLE_SIZE < 32) || (ACI_UART_BRIDGE_TO_BLE_SIZE > 128) || \
+    (0 != (ACI_UART_BRIDGE_TO_BLE_SIZE & (ACI_UART_BRIDGE_TO_BLE_SIZE - 1)))
+#error "ACI_UART_BRIDGE_TO_BLE_SIZE must be a power of two from 32 to 128"
+#endif
+#if (ACI_UART_BRIDGE_TO_SERIAL_SIZE < 64) || (ACI_UART_BRIDGE_TO_SERIAL_SIZE > 128) || \
+    (0 != (ACI_UART_BRIDGE_TO_SERIAL_SIZE & (ACI_UART_BRIDGE_TO_SERIAL_SIZE - 1)))
+#error "ACI_UART_BRIDGE_TO_SERIAL_SIZE must be a power of two from 64 to 128"
+#endif
+
+/** Control point opcodes of the UART over BLE service, as in uart_over_ble.h of the examples */
+#define ACI_UART_BRIDGE_OP_TRANSMIT_STOP  0x03
+#define ACI_UART_BRIDGE_OP_TRANSMIT_OK    0x04
+
+typedef struct
+{
+  uint8_t  tx_pipe;                /**< UART TX, to the peer */
+  uint8_t  rx_pipe;                /**< UART RX, from the peer */
+  uint8_t  control_point_tx_pipe;  /**< 0 when the peer is not told to stop */
+  uint8_t  control_point_rx_pipe;  /**< 0 when the peer does not tell to stop */
+  uint16_t idle_ms;                /**< Time without a new byte before a short packet is sent */
+  uint8_t  rts_pin;                /**< UNUSED for no serial flow control */
+} aci_uart_bridge_params_t;
+
+typedef struct
+{
+  uint32_t bytes_sent;
+  uint16_t packets_sent;
+  uint16_t short_packets;          /**< Packets of less than ACI_PIPE_TX_DATA_MAX_LEN bytes */
+  uint32_t bytes_received;
+  uint16_t bytes_dropped;          /**< From the peer, with no room left */
+  uint16_t stops_sent;
+} aci_uart_bridge_stats_t;
+
+/** State of the bridge, one per nRF8001 */
+typedef struct
+{
+  const aci_uart_bridge_params_t *p_params;
+  uint8_t                 to_ble_head;        /**< Free running, the index is masked */
+  uint8_t                 to_ble_tail;
+  uint8_t                 to_serial_head;
+  uint8_t                 to_serial_tail;
+  bool                    peer_stopped;       /**< The peer wrote UART_OVER_BLE_TRANSMIT_STOP */
+  bool                    peer_told_stop;     /**< UART_OVER_BLE_TRANSMIT_STOP was notified */
+  bool                    rts_high;
+  unsigned long           last_put_ms;
+  aci_uart_bridge_stats_t stats;
+  uint8_t                 to_ble[ACI_UART_BRIDGE_TO_BLE_SIZE];
+  uint8_t                 to_serial[ACI_UART_BRIDGE_TO_SERIAL_SIZE];
+} aci_uart_bridge_t;
+
+/** @brief Initializes the bridge, the rts_pin is made an output and driven LOW.
+ *  @param p_bridge state of the bridge.
+ *  @param p_params pipes and timing, must stay valid while the bridge is used.
+ */
+void aci_uart_bridge_init(aci_uart_bridge_t *p_bridge, const aci_uart_bridge_params_t *p_params);
+
+/** @brief Gives an ACI event to the bridge, call it for every event taken from lib_aci_event_get().
+ */
+void aci_uart_bridge_event(aci_uart_bridge_t *p_bridge, aci_state_t *aci_stat, const aci_evt_t *p_evt);
+
+/** @brief Sends the packets and the flow control due, call it from the loop.
+ */
+void aci_uart_bridge_poll(aci_uart_bridge_t *p_bridge, aci_state_t *aci_stat);
+
+/** @brief Puts a byte for the peer, e.g. from Serial.read().
+ *  @return False if the ring is full, see aci_uart_bridge_room().
+ */
+bool aci_uart_bridge_put(aci_uart_bridge_t *p_bridge, uint8_t byte);
+
+/** @brief Bytes that can be put.
+ */
+uint8_t aci_uart_bridge_room(const aci_uart_bridge_t *p_bridge);
+
+/** @brief Gets a byte from the peer, e.g. for Serial.write().
+ *  @return The byte, -1 if there is none.
+ */
+int aci_uart_bridge_get(aci_uart_bridge_t *p_bridge);
+
+/** @brief Bytes from the peer that can be got.
+ */
+uint8_t aci_uart_bridge_available(const aci_uart_bridge_t *p_bridge);
+
+/** @brief Gets the counters since aci_uart_bridge_init().
+ */
+void aci_uart_bridge_stats_get(const aci_uart_bridge_t *p_bridge, aci_uart_bridge_stats_t *p_stats);
+
+#endif // ACI_UART_BRIDGE_H__
+/** @} */
@@ -52,11 +52,13 @@ void acil_encode_cmd_sleep(uint8_t *buffer)
   *(buffer + OFFSET_ACI_CMD_T_CMD_OPCODE) = ACI_CMD_SLEEP;
 }
 
+#if ACI_FEATURE_DEVICE_INFO
 void acil_encode_cmd_get_device_version(uint8_t *buffer)
 {
   *(buffer + OFFSET_ACI_CMD_T_LEN) = 1;
   *(buffer + OFFSET_ACI_CMD_T_CMD_OPCODE) = ACI_CMD_GET_DEVICE_VERSION;
 }
+#endif
 
 void acil_encode_cmd_set_local_data(uint8_t *buffer, aci_cmd_params_set_local_data_t *p_aci_cmd_params_set_local_data, uint8_t data_size)
 {
@@ -76,6 +78,7 @@ void acil_encode_cmd_connect(uint8_t *buffer, aci_cmd_params_connect_t *p_aci_cm
   *(buffer + OFFSET_ACI_CMD_T_CONNECT + OFFSET_ACI_CMD_PARAMS_CONNECT_T_ADV_INTERVAL_LSB) = (uint8_t)(p_aci_cmd_params_connect->adv_interval);
 }
 
+#if ACI_FEATURE_SECURITY
 void acil_encode_cmd_bond(uint8_t *buffer, aci_cmd_params_bond_t *p_aci_cmd_params_bond)
 {
   *(buffer + OFFSET_ACI_CMD_T_LEN) = MSG_BOND_LEN;
@@ -85,6 +88,7 @@ void acil_encode_cmd_bond(uint8_t *buffer, aci_cmd_params_bond_t *p_aci_cmd_para
   *(buffer + OFFSET_ACI_CMD_T_BOND + OFFSET_ACI_CMD_PARAMS_BOND_T_ADV_INTERVAL_MSB) = (uint8_t)(p_aci_cmd_params_bond->adv_interval >> 8);
   *(buffer + OFFSET_ACI_CMD_T_BOND + OFFSET_ACI_CMD_PARAMS_BOND_T_ADV_INTERVAL_LSB) = (uint8_t)(p_aci_cmd_params_bond->adv_interval);
 }
+#endif
 
 void acil_encode_cmd_disconnect(uint8_t *buffer, aci_cmd_params_disconnect_t *p_aci_cmd_params_disconnect)
 {
@@ -118,20 +122,36 @@ void acil_encode_cmd_set_radio_tx_power(uint8_t *buffer, aci_cmd_params_set_tx_p
   *(buffer + OFFSET_ACI_CMD_T_SET_TX_POWER + OFFSET_ACI_CMD_PARAMS_SET_TX_POWER_T_DEVICE_POWER) = (uint8_t)p_aci_cmd_params_set_tx_power->device_power;
 }
 
+#if ACI_FEATURE_DEVICE_INFO
 void acil_encode_cmd_get_address(uint8_t *buffer)
 {
   *(buffer + OFFSET_ACI_CMD_T_LEN) = MSG_GET_DEVICE_ADDR_LEN;
   *(buffer + OFFSET_ACI_CMD_T_CMD_OPCODE) = ACI_CMD_GET_DEVICE_ADDRESS;
 }
+#endif
 
 void acil_encode_cmd_send_data(uint8_t *buffer, aci_cmd_params_send_data_t *p_aci_cmd_params_send_data_t, uint8_t data_size)
+{
+  acil_encode_cmd_send_data_raw(buffer, p_aci_cmd_params_send_data_t->tx_data.pipe_number, &(p_aci_cmd_params_send_data_t->tx_data.aci_data[0]), data_size);
+}
+
+void acil_encode_cmd_send_data_raw(uint8_t *buffer, const uint8_t pipe_number, const uint8_t *p_data, uint8_t data_size)
 {
   *(buffer + OFFSET_ACI_CMD_T_LEN) = MSG_SEND_DATA_BASE_LEN + data_size;
   *(buffer + OFFSET_ACI_CMD_T_CMD_OPCODE) = ACI_CMD_SEND_DATA;
-  *(buffer + OFFSET_ACI_CMD_T_SEND_DATA + OFFSET_ACI_CMD_PARAMS_SEND_DATA_T_TX_DATA + OFFSET_ACI_TX_DATA_T_PIPE_NUMBER) = p_aci_cmd_params_send_data_t->tx_data.pipe_number;
-  memcpy((buffer + OFFSET_ACI_CMD_T_SEND_DATA + OFFSET_ACI_CMD_PARAMS_SEND_DATA_T_TX_DATA + OFFSET_ACI_TX_DATA_T_ACI_DATA), &(p_aci_cmd_params_send_data_t->tx_data.aci_data[0]), data_size);
+  *(buffer + OFFSET_ACI_CMD_T_SEND_DATA + OFFSET_ACI_CMD_PARAMS_SEND_DATA_T_TX_DATA + OFFSET_ACI_TX_DATA_T_PIPE_NUMBER) = pipe_number;
+  memcpy((buffer + OFFSET_ACI_CMD_T_SEND_DATA + OFFSET_ACI_CMD_PARAMS_SEND_DATA_T_TX_DATA + OFFSET_ACI_TX_DATA_T_ACI_DATA), p_data, data_size);
 }
 
+void acil_encode_cmd_send_data_raw_P(uint8_t *buffer, const uint8_t pipe_number, const uint8_t *p_data_P, uint8_t data_size)
+{
+  *(buffer + OFFSET_ACI_CMD_T_LEN) = MSG_SEND_DATA_BASE_LEN + data_size;
+  *(buffer + OFFSET_ACI_CMD_T_CMD_OPCODE) = ACI_CMD_SEND_DATA;
+  *(buffer + OFFSET_ACI_CMD_T_SEND_DATA + OFFSET_ACI_CMD_PARAMS_SEND_DATA_T_TX_DATA + OFFSET_ACI_TX_DATA_T_PIPE_NUMBER) = pipe_number;
+  memcpy_P((buffer + OFFSET_ACI_CMD_T_SEND_DATA + OFFSET_ACI_CMD_PARAMS_SEND_DATA_T_TX_DATA + OFFSET_ACI_TX_DATA_T_ACI_DATA), p_data_P, data_size);
+}
+
+#if ACI_FEATURE_REMOTE_PIPES
 void acil_encode_cmd_request_data(uint8_t *buffer, aci_cmd_params_request_data_t *p_aci_cmd_params_request_data)
 {
   *(buffer + OFFSET_ACI_CMD_T_LEN) = MSG_DATA_REQUEST_LEN;
@@ -152,6 +172,7 @@ void acil_encode_cmd_close_remote_pipe(uint8_t *buffer, aci_cmd_params_close_rem
   *(buffer + OFFSET_ACI_CMD_T_CMD_OPCODE) = ACI_CMD_CLOSE_REMOTE_PIPE;
   *(buffer + OFFSET_ACI_CMD_T_CLOSE_REMOTE_PIPE + OFFSET_ACI_CMD_PARAMS_CLOSE_REMOTE_PIPE_T_PIPE_NUMBER) = p_aci_cmd_params_close_remote_pipe->pipe_number;
 }
+#endif
 
 void acil_encode_cmd_echo_msg(uint8_t *buffer, aci_cmd_params_echo_t *p_cmd_params_echo, uint8_t msg_size)
 {
@@ -160,6 +181,7 @@ void acil_encode_cmd_echo_msg(uint8_t *buffer, aci_cmd_params_echo_t *p_cmd_para
   memcpy((buffer + OFFSET_ACI_CMD_T_ECHO + OFFSET_ACI_CMD_PARAMS_ECHO_T_ECHO_DATA), &(p_cmd_params_echo->echo_data[0]), msg_size);
 }
 
+#if ACI_FEATURE_DEVICE_INFO
 void acil_encode_cmd_battery_level(uint8_t *buffer)
 {
   *(buffer + OFFSET_ACI_CMD_T_LEN) = 1;
@@ -171,7 +193,9 @@ void acil_encode_cmd_temparature(uint8_t *buffer)
   *(buffer + OFFSET_ACI_CMD_T_LEN) = 1;
   *(buffer + OFFSET_ACI_CMD_T_CMD_OPCODE) = ACI_CMD_GET_TEMPERATURE;
 }
+#endif
 
+#if ACI_FEATURE_DYNAMIC_DATA
 void acil_encode_cmd_read_dynamic_data(uint8_t *buffer)
 {
   *(buffer + OFFSET_ACI_CMD_T_LEN) = 1;
@@ -185,6 +209,7 @@ void acil_encode_cmd_write_dynamic_data(uint8_t *buffer, uint8_t seq_no, uint8_t
   *(buffer + OFFSET_ACI_CMD_T_WRITE_DYNAMIC_DATA + OFFSET_ACI_CMD_PARAMS_WRITE_DYNAMIC_DATA_T_SEQ_NO) = seq_no;
   memcpy((buffer + OFFSET_ACI_CMD_T_WRITE_DYNAMIC_DATA + OFFSET_ACI_CMD_PARAMS_WRITE_DYNAMIC_DATA_T_DYNAMIC_DATA), dynamic_data, dynamic_data_size);
 }
+#endif
 
 void acil_encode_cmd_change_timing_req(uint8_t *buffer, aci_cmd_params_change_timing_t *p_aci_cmd_params_change_timing)
 {
@@ -223,6 +248,7 @@ void acil_encode_cmd_setup(uint8_t *buffer, aci_cmd_params_setup_t *p_aci_cmd_pa
   memcpy((buffer + OFFSET_ACI_CMD_T_SETUP), &(p_aci_cmd_params_setup->setup_data[0]), setup_data_size);
 }
 
+#if ACI_FEATURE_DTM
 void acil_encode_cmd_dtm_cmd(uint8_t *buffer, aci_cmd_params_dtm_cmd_t *p_aci_cmd_params_dtm_cmd)
 {
   *(buffer + OFFSET_ACI_CMD_T_LEN) = MSG_DTM_CMD;
@@ -230,6 +256,7 @@ void acil_encode_cmd_dtm_cmd(uint8_t *buffer, aci_cmd_params_dtm_cmd_t *p_aci_cm
   *(buffer + OFFSET_ACI_CMD_T_DTM_CMD) = p_aci_cmd_params_dtm_cmd->cmd_msb;
   *(buffer + OFFSET_ACI_CMD_T_DTM_CMD + 1) = p_aci_cmd_params_dtm_cmd->cmd_lsb;
 }
+#endif
 
 void acil_encode_cmd_send_data_ack(uint8_t *buffer, const uint8_t pipe_number )
 {
@@ -246,12 +273,15 @@ void acil_encode_cmd_send_data_nack(uint8_t *buffer, const uint8_t pipe_number,
   *(buffer + OFFSET_ACI_CMD_T_SEND_DATA_NACK + OFFSET_ACI_CMD_PARAMS_SEND_DATA_NACK_T_ERROR_CODE) = err_code;
 }
 
+#if ACI_FEATURE_SECURITY
 void acil_encode_cmd_bond_security_request(uint8_t *buffer)
 {
   *(buffer + OFFSET_ACI_CMD_T_LEN) = 1;
   *(buffer + OFFSET_ACI_CMD_T_CMD_OPCODE) = ACI_CMD_BOND_SECURITY_REQUEST;
 }
+#endif
 
+#if ACI_FEATURE_BROADCAST
 void acil_encode_cmd_broadcast(uint8_t *buffer, aci_cmd_params_broadcast_t * p_aci_cmd_params_broadcast)
 {
   *(buffer + OFFSET_ACI_CMD_T_LEN) = MSG_BROADCAST_LEN;
@@ -268,8 +298,10 @@ void acil_encode_cmd_open_adv_pipes(uint8_t *buffer, aci_cmd_params_open_adv_pip
   *(buffer + OFFSET_ACI_CMD_T_CMD_OPCODE) = ACI_CMD_OPEN_ADV_PIPE;
   memcpy(buffer + OFFSET_ACI_CMD_T_OPEN_ADV_PIPE + OFFSET_ACI_CMD_PARAMS_OPEN_ADV_PIPE_T_PIPES, p_aci_cmd_params_open_adv_pipe->pipes, 8);
 }
+#endif
 
 
+#if ACI_FEATURE_SECURITY
 void acil_encode_cmd_set_key(uint8_t *buffer, aci_cmd_params_set_key_t *p_aci_cmd_params_set_key)
 {
   /*
@@ -296,6 +328,7 @@ void acil_encode_cmd_set_key(uint8_t *buffer, aci_cmd_params_set_key_t *p_aci_cm
   *(buffer + OFFSET_ACI_CMD_T_SET_KEY + OFFSET_ACI_CMD_PARAMS_SET_KEY_T_KEY_TYPE) = p_aci_cmd_params_set_key->key_type;
   memcpy((buffer + OFFSET_ACI_CMD_T_SET_KEY + OFFSET_ACI_CMD_PARAMS_SET_KEY_T_PASSKEY), (uint8_t * )&(p_aci_cmd_params_set_key->key), len-2);//Reducing 2 for the opcode byte and type
 }
+#endif
 
 bool acil_encode_cmd(uint8_t *buffer, aci_cmd_t *p_aci_cmd)
 {
@@ -309,15 +342,18 @@ bool acil_encode_cmd(uint8_t *buffer, aci_cmd_t *p_aci_cmd)
     case ACI_CMD_SLEEP:
       acil_encode_cmd_sleep(buffer);
       break;
+#if ACI_FEATURE_DEVICE_INFO
     case ACI_CMD_GET_DEVICE_VERSION:
       acil_encode_cmd_get_device_version(buffer);
       break;
+#endif
     case ACI_CMD_WAKEUP:
       acil_encode_cmd_wakeup(buffer);
       break;
     case ACI_CMD_ECHO:
       acil_encode_cmd_echo_msg(buffer, &(p_aci_cmd->params.echo), (p_aci_cmd->len - MSG_ECHO_MSG_CMD_BASE_LEN));
       break;
+#if ACI_FEATURE_DEVICE_INFO
     case ACI_CMD_GET_BATTERY_LEVEL:
       acil_encode_cmd_battery_level(buffer);
       break;
@@ -327,15 +363,18 @@ bool acil_encode_cmd(uint8_t *buffer, aci_cmd_t *p_aci_cmd)
     case ACI_CMD_GET_DEVICE_ADDRESS:
       acil_encode_cmd_get_address(buffer);
       break;
+#endif
     case ACI_CMD_SET_TX_POWER:
       acil_encode_cmd_set_radio_tx_power(buffer, &(p_aci_cmd->params.set_tx_power));
       break;
     case ACI_CMD_CONNECT:
       acil_encode_cmd_connect(buffer, &(p_aci_cmd->params.connect));
       break;
+#if ACI_FEATURE_SECURITY
     case ACI_CMD_BOND:
       acil_encode_cmd_bond(buffer, &(p_aci_cmd->params.bond));
       break;
+#endif
     case ACI_CMD_DISCONNECT:
       acil_encode_cmd_disconnect(buffer, &(p_aci_cmd->params.disconnect));
       break;
@@ -348,33 +387,43 @@ bool acil_encode_cmd(uint8_t *buffer, aci_cmd_t *p_aci_cmd)
     case ACI_CMD_SETUP:
       acil_encode_cmd_setup(buffer, &(p_aci_cmd->params.setup), (p_aci_cmd->len - MSG_SETUP_CMD_BASE_LEN));
       break;
+#if ACI_FEATURE_DTM
     case ACI_CMD_DTM_CMD:
       acil_encode_cmd_dtm_cmd(buffer, &(p_aci_cmd->params.dtm_cmd));
       break;
+#endif
+#if ACI_FEATURE_DYNAMIC_DATA
     case ACI_CMD_READ_DYNAMIC_DATA:
       acil_encode_cmd_read_dynamic_data(buffer);
       break;
     case ACI_CMD_WRITE_DYNAMIC_DATA:
       acil_encode_cmd_write_dynamic_data(buffer, p_aci_cmd->params.write_dynamic_data.seq_no, &(p_aci_cmd->params.write_dynamic_data.dynamic_data[0]), (p_aci_cmd->len - MSG_WRITE_DYNAMIC_DATA_BASE_LEN));
       break;
+#endif
+#if ACI_FEATURE_REMOTE_PIPES
     case ACI_CMD_OPEN_REMOTE_PIPE:
       acil_encode_cmd_open_remote_pipe(buffer, &(p_aci_cmd->params.open_remote_pipe));
       break;
+#endif
     case ACI_CMD_SEND_DATA:
       acil_encode_cmd_send_data(buffer, &(p_aci_cmd->params.send_data), (p_aci_cmd->len - MSG_SEND_DATA_BASE_LEN));
       break;
     case ACI_CMD_SEND_DATA_ACK:
       acil_encode_cmd_send_data_ack(buffer, p_aci_cmd->params.send_data_ack.pipe_number );
       break;
+#if ACI_FEATURE_REMOTE_PIPES
     case ACI_CMD_REQUEST_DATA:
       acil_encode_cmd_request_data(buffer, &(p_aci_cmd->params.request_data));
       break;
+#endif
     case ACI_CMD_SET_LOCAL_DATA:
       acil_encode_cmd_set_local_data(buffer, (aci_cmd_params_set_local_data_t *)(&(p_aci_cmd->params.send_data)), (p_aci_cmd->len - MSG_SET_LOCAL_DATA_BASE_LEN));
       break;
+#if ACI_FEATURE_SECURITY
     case ACI_CMD_BOND_SECURITY_REQUEST:
       acil_encode_cmd_bond_security_request(buffer);
       break;
+#endif
     default:
       break;
   }
@@ -383,18 +432,25 @@ bool acil_encode_cmd(uint8_t *buffer, aci_cmd_t *p_aci_cmd)
 
 void acil_decode_evt_command_response(uint8_t *buffer_in, aci_evt_params_cmd_rsp_t *p_evt_params_cmd_rsp)
 {
+#if ACI_FEATURE_DEVICE_INFO
   aci_evt_cmd_rsp_params_get_device_version_t *p_device_version;
   aci_evt_cmd_rsp_params_get_device_address_t *p_device_address;
   aci_evt_cmd_rsp_params_get_temperature_t    *p_temperature;
   aci_evt_cmd_rsp_params_get_battery_level_t  *p_batt_lvl;
+#endif
+#if ACI_FEATURE_DYNAMIC_DATA
   aci_evt_cmd_rsp_read_dynamic_data_t         *p_read_dyn_data;
+#endif
+#if ACI_FEATURE_DTM
   aci_evt_cmd_rsp_params_dtm_cmd_t            *p_dtm_evt;
+#endif
 
   p_evt_params_cmd_rsp->cmd_opcode = (aci_cmd_opcode_t)*(buffer_in + OFFSET_ACI_EVT_T_CMD_RSP + OFFSET_ACI_EVT_PARAMS_CMD_RSP_T_CMD_OPCODE);
   p_evt_params_cmd_rsp->cmd_status = (aci_status_code_t)*(buffer_in + OFFSET_ACI_EVT_T_CMD_RSP + OFFSET_ACI_EVT_PARAMS_CMD_RSP_T_CMD_STATUS);
 
   switch (p_evt_params_cmd_rsp->cmd_opcode)
   {
+#if ACI_FEATURE_DEVICE_INFO
     case ACI_CMD_GET_DEVICE_VERSION:
       p_device_version = &(p_evt_params_cmd_rsp->params.get_device_version);
       p_device_version->configuration_id  = (uint16_t)*(buffer_in + OFFSET_ACI_EVT_T_CMD_RSP + OFFSET_ACI_EVT_PARAMS_CMD_RSP_T_GET_DEVICE_VERSION + OFFSET_ACI_EVT_CMD_RSP_PARAMS_GET_DEVICE_VERSION_T_CONFIGURATION_ID_LSB);
@@ -425,19 +481,27 @@ void acil_decode_evt_command_response(uint8_t *buffer_in, aci_evt_params_cmd_rsp
       p_batt_lvl->battery_level =  (int16_t)*(buffer_in + OFFSET_ACI_EVT_T_CMD_RSP + OFFSET_ACI_EVT_PARAMS_CMD_RSP_T_GET_BATTERY_LEVEL + OFFSET_ACI_EVT_CMD_RSP_PARAMS_GET_BATTERY_LEVEL_T_BATTERY_LEVEL_LSB);
       p_batt_lvl->battery_level |= (int16_t)*(buffer_in + OFFSET_ACI_EVT_T_CMD_RSP + OFFSET_ACI_EVT_PARAMS_CMD_RSP_T_GET_BATTERY_LEVEL + OFFSET_ACI_EVT_CMD_RSP_PARAMS_GET_BATTERY_LEVEL_T_BATTERY_LEVEL_MSB) << 8;
       break;
+#endif
     
+#if ACI_FEATURE_DYNAMIC_DATA
     case ACI_CMD_READ_DYNAMIC_DATA:
       p_read_dyn_data = &(p_evt_params_cmd_rsp->params.read_dynamic_data);
       p_read_dyn_data->seq_no =  (uint8_t)*(buffer_in + OFFSET_ACI_EVT_T_CMD_RSP + OFFSET_ACI_EVT_PARAMS_CMD_RSP_T_READ_DYNAMIC_DATA + OFFSET_ACI_EVT_CMD_RSP_READ_DYNAMIC_DATA_T_SEQ_NO);
       memcpy((uint8_t *)(p_read_dyn_data->dynamic_data), (buffer_in + OFFSET_ACI_EVT_T_CMD_RSP + OFFSET_ACI_EVT_PARAMS_CMD_RSP_T_READ_DYNAMIC_DATA + OFFSET_ACI_CMD_PARAMS_WRITE_DYNAMIC_DATA_T_DYNAMIC_DATA), ACIL_DECODE_EVT_GET_LENGTH(buffer_in) - 3); // 3 bytes subtracted account for EventCode, CommandOpCode and Status bytes.
       // Now that the p_read_dyn_data->dynamic_data will be pointing to memory location with enough space to accommodate upto 27 bytes of dynamic data received. This is because of the padding element in aci_evt_params_cmd_rsp_t
       break;
+#endif
     
+#if ACI_FEATURE_DTM
     case ACI_CMD_DTM_CMD:
       p_dtm_evt = &(p_evt_params_cmd_rsp->params.dtm_cmd);
       p_dtm_evt->evt_msb = (uint8_t)*(buffer_in + OFFSET_ACI_EVT_T_CMD_RSP + OFFSET_ACI_EVT_PARAMS_CMD_RSP_T_DTM_CMD + OFFSET_ACI_EVT_CMD_RSP_PARAMS_DTM_CMD_T_EVT_MSB);
       p_dtm_evt->evt_lsb = (uint8_t)*(buffer_in + OFFSET_ACI_EVT_T_CMD_RSP + OFFSET_ACI_EVT_PARAMS_CMD_RSP_T_DTM_CMD + OFFSET_ACI_EVT_CMD_RSP_PARAMS_DTM_CMD_T_EVT_LSB);
       break;
+#endif
+
+    default:
+      break;
   }
 }
 
@@ -551,60 +615,56 @@ void acil_decode_evt_display_passkey(uint8_t *buffer_in, aci_evt_params_display_
   p_aci_evt_params_display_passkey->passkey[5] = *(buffer_in + OFFSET_ACI_EVT_T_DISPLAY_PASSKEY +  OFFSET_ACI_EVT_PARAMS_DISPLAY_PASSKEY_T_PASSKEY + 5);
 }
 
-bool acil_decode_evt(uint8_t *buffer_in, aci_evt_t *p_aci_evt)
+/* Shortest length byte of each event, opcode and fixed parameters, from ACI_EVT_DEVICE_STARTED on */
+static const uint8_t acil_evt_min_lengths[ACI_EVT_KEY_REQUEST - ACI_EVT_DEVICE_STARTED + 1] PROGMEM =
+{
+  1 + 3,                                                    // ACI_EVT_DEVICE_STARTED
+  1,                                                        // ACI_EVT_ECHO
+  1 + OFFSET_ACI_EVT_PARAMS_HW_ERROR_T_FILE_NAME,           // ACI_EVT_HW_ERROR
+  1 + OFFSET_ACI_EVT_PARAMS_CMD_RSP_T_GET_TEMPERATURE,      // ACI_EVT_CMD_RSP
+  1 + OFFSET_ACI_EVT_PARAMS_CONNECTED_T_MASTER_CLOCK_ACCURACY + 1, // ACI_EVT_CONNECTED
+  1 + 2,                                                    // ACI_EVT_DISCONNECTED
+  1 + OFFSET_ACI_EVT_PARAMS_BOND_STATUS_T_KEYS_EXCHANGED_MASTER + 1, // ACI_EVT_BOND_STATUS
+  1 + OFFSET_ACI_EVT_PARAMS_PIPE_STATUS_T_PIPES_CLOSED_BITMAP + 8,   // ACI_EVT_PIPE_STATUS
+  1 + OFFSET_ACI_EVT_PARAMS_TIMING_T_CONN_RF_TIMEOUT_MSB + 1,        // ACI_EVT_TIMING
+  1 + 1,                                                    // ACI_EVT_DATA_CREDIT
+  1 + 1,                                                    // ACI_EVT_DATA_ACK
+  1 + 1,                                                    // ACI_EVT_DATA_RECEIVED
+  1 + OFFSET_ACI_EVT_PARAMS_PIPE_ERROR_T_ERROR_DATA,        // ACI_EVT_PIPE_ERROR
+  1 + 6,                                                    // ACI_EVT_DISPLAY_PASSKEY
+  1 + 1                                                     // ACI_EVT_KEY_REQUEST
+};
+
+uint8_t acil_evt_min_length(uint8_t evt_opcode)
+{
+  const uint8_t index = (uint8_t)(evt_opcode - ACI_EVT_DEVICE_STARTED);
+
+  if (index >= sizeof(acil_evt_min_lengths))
+  {
+    return 0;
+  }
+  return pgm_read_byte(&acil_evt_min_lengths[index]);
+}
+
+bool acil_evt_is_valid(const uint8_t *buffer_in)
 {
-  bool ret_val = true;
+  const uint8_t length     = ACIL_DECODE_EVT_GET_LENGTH(buffer_in);
+  const uint8_t min_length = acil_evt_min_length(ACIL_DECODE_EVT_GET_OPCODE(buffer_in));
+
+  return ((0 != min_length) && (length >= min_length) && (length < ACI_PACKET_MAX_LEN));
+}
 
+bool acil_decode_evt(uint8_t *buffer_in, aci_evt_t *p_aci_evt)
+{
   p_aci_evt->len = ACIL_DECODE_EVT_GET_LENGTH(buffer_in);
   p_aci_evt->evt_opcode = (aci_evt_opcode_t)ACIL_DECODE_EVT_GET_OPCODE(buffer_in);
 
-  switch(p_aci_evt->evt_opcode)
+  if (!acil_evt_is_valid(buffer_in))
   {
-    case ACI_EVT_DEVICE_STARTED:
-      acil_decode_evt_device_started(buffer_in, &(p_aci_evt->params.device_started));
-      break;
-    case ACI_EVT_HW_ERROR:
-      acil_decode_evt_hw_error(buffer_in, &(p_aci_evt->params.hw_error));
-      break;
-    case ACI_EVT_CMD_RSP:
-      acil_decode_evt_command_response(buffer_in, &(p_aci_evt->params.cmd_rsp));
-      break;
-    case ACI_EVT_DATA_CREDIT:
-      acil_decode_evt_credit(buffer_in, &(p_aci_evt->params.data_credit));
-      break;
-    case ACI_EVT_CONNECTED:
-      acil_decode_evt_connected(buffer_in, &(p_aci_evt->params.connected));
-      break;
-    case ACI_EVT_PIPE_STATUS:
-      acil_decode_evt_pipe_status(buffer_in, &(p_aci_evt->params.pipe_status));
-      break;
-    case ACI_EVT_DISCONNECTED:
-      acil_decode_evt_disconnected(buffer_in, &(p_aci_evt->params.disconnected));
-      break;
-    case ACI_EVT_BOND_STATUS:
-      acil_decode_evt_bond_status(buffer_in, &(p_aci_evt->params.bond_status));
-      break;
-    case ACI_EVT_TIMING:
-      acil_decode_evt_timing(buffer_in, &(p_aci_evt->params.timing));
-      break;
-    case ACI_EVT_DATA_ACK:
-      acil_decode_evt_data_ack(buffer_in, &(p_aci_evt->params.data_ack));
-      break;
-    case ACI_EVT_DATA_RECEIVED:
-      acil_decode_evt_data_received(buffer_in, &(p_aci_evt->params.data_received));
-      break;
-    case ACI_EVT_PIPE_ERROR:
-      acil_decode_evt_pipe_error(buffer_in, &(p_aci_evt->params.pipe_error));
-      break;
-    case ACI_EVT_KEY_REQUEST:
-      acil_decode_evt_key_request(buffer_in, &(p_aci_evt->params.key_request));
-      break;
-    case ACI_EVT_DISPLAY_PASSKEY:
-      acil_decode_evt_display_passkey(buffer_in, &(p_aci_evt->params.display_passkey));     
-      break;
-    default:
-      ret_val = false;
-      break;
+    return false;
   }
-  return ret_val;
+
+  // The parameters are packed LSB first in aci_evt_t as in the message
+  memcpy(&(p_aci_evt->params), ACIL_EVT_PARAM_PTR(buffer_in, 0), p_aci_evt->len - 1);
+  return true;
 }
@@ -30,6 +30,42 @@
 #ifndef _acilib_H_
 #define _acilib_H_
 
+/****************************************************************************/
+/* ACI command sets built into the library                                  */
+/* A set a product does not use can be left out, its lib_aci_* functions,   */
+/* encoders and command response decoders are then not compiled. With       */
+/* -ffunction-sections and --gc-sections, as the Arduino IDE builds, an     */
+/* encoder is already linked only when it is called, the sets also take out */
+/* the code that refers to all of them (acil_encode_cmd(),                  */
+/* acil_decode_evt_command_response()) and the modules built on them.       */
+/* ACI_FEATURE_DEVICE_INFO  : GetDeviceVersion, GetDeviceAddress,           */
+/*                            GetTemperature, GetBatteryLevel, aci_sampler  */
+/* ACI_FEATURE_SECURITY     : Bond, BondSecurityRequest, SetKey             */
+/* ACI_FEATURE_REMOTE_PIPES : OpenRemotePipe, CloseRemotePipe, RequestData  */
+/* ACI_FEATURE_BROADCAST    : Broadcast, OpenAdvPipe, aci_broadcast         */
+/* ACI_FEATURE_DYNAMIC_DATA : ReadDynamicData, WriteDynamicData             */
+/* ACI_FEATURE_DTM          : DtmCommand, aci_dtm                           */
+/* 1 : built (default), 0 : left out                                        */
+/****************************************************************************/
+#ifndef ACI_FEATURE_DEVICE_INFO
+#define ACI_FEATURE_DEVICE_INFO 1
+#endif
+#ifndef ACI_FEATURE_SECURITY
+#define ACI_FEATURE_SECURITY 1
+#endif
+#ifndef ACI_FEATURE_REMOTE_PIPES
+#define ACI_FEATURE_REMOTE_PIPES 1
+#endif
+#ifndef ACI_FEATURE_BROADCAST
+#define ACI_FEATURE_BROADCAST 1
+#endif
+#ifndef ACI_FEATURE_DYNAMIC_DATA
+#define ACI_FEATURE_DYNAMIC_DATA 1
+#endif
+#ifndef ACI_FEATURE_DTM
+#define ACI_FEATURE_DTM 1
+#endif
+
 #define MSG_SET_LOCAL_DATA_BASE_LEN              2
 #define MSG_CONNECT_LEN                          5
 #define MSG_BOND_LEN                             5
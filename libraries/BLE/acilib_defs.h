@@ -34,4 +34,15 @@
 
 #define ACIL_DECODE_EVT_GET_OPCODE(buffer_in) (*(buffer_in + OFFSET_ACI_EVT_T_EVT_OPCODE))
 
+/* The parameters of every event follow the length and the opcode */
+#define ACIL_EVT_PARAMS_OFFSET                2
+
+/* Fields read in place from a received event, offset is one of the OFFSET_ACI_EVT_PARAMS_* and
+   OFFSET_ACI_EVT_CMD_RSP_* values. Multi-byte fields are LSB first, offset is the one of the LSB.
+   Check the event with acil_evt_is_valid() first. */
+#define ACIL_EVT_PARAM_PTR(buffer_in, offset) ((buffer_in) + ACIL_EVT_PARAMS_OFFSET + (offset))
+#define ACIL_EVT_PARAM_U8(buffer_in, offset)  (*ACIL_EVT_PARAM_PTR(buffer_in, offset))
+#define ACIL_EVT_PARAM_U16(buffer_in, offset) ((uint16_t)ACIL_EVT_PARAM_U8(buffer_in, offset) | \
+                                               ((uint16_t)ACIL_EVT_PARAM_U8(buffer_in, (offset) + 1) << 8))
+
 #endif /* _acilib_DEFS_H_ */
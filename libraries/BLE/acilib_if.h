@@ -143,6 +143,28 @@ void acil_encode_cmd_get_address(uint8_t *buffer);
  */
 void acil_encode_cmd_send_data(uint8_t *buffer, aci_cmd_params_send_data_t *p_aci_cmd_params_send_data_t, uint8_t data_size);
 
+/** @brief Encode the ACI message for send data from a plain data buffer
+ *
+ *  @param[in,out]  buffer                        Pointer to ACI message buffer
+ *  @param[in]      pipe_number                   Pipe number to send the data on
+ *  @param[in]      p_data                        Pointer to the data to send
+ *  @param[in]      data_size                     Size of data message
+ *
+ *  @return         None
+ */
+void acil_encode_cmd_send_data_raw(uint8_t *buffer, const uint8_t pipe_number, const uint8_t *p_data, uint8_t data_size);
+
+/** @brief Encode the ACI message for send data from a data buffer in flash (PROGMEM)
+ *
+ *  @param[in,out]  buffer                        Pointer to ACI message buffer
+ *  @param[in]      pipe_number                   Pipe number to send the data on
+ *  @param[in]      p_data_P                      Pointer to the data to send, in PROGMEM
+ *  @param[in]      data_size                     Size of data message
+ *
+ *  @return         None
+ */
+void acil_encode_cmd_send_data_raw_P(uint8_t *buffer, const uint8_t pipe_number, const uint8_t *p_data_P, uint8_t data_size);
+
 /** @brief Encode the ACI message for request data
  *
  *  @param[in,out]  buffer                          Pointer to ACI message buffer
@@ -451,6 +473,10 @@ void acil_decode_evt_key_request(uint8_t *buffer_in, aci_evt_params_key_request_
 uint8_t acil_decode_evt_echo(uint8_t *buffer_in, aci_evt_params_echo_t *buffer_out);
 
 /** @brief Decode the ACI event
+ *
+ *  The event is checked against the event table and copied as is, ::aci_evt_t has the layout
+ *  of the received message. To read only some fields, use acil_evt_is_valid() and the
+ *  ACIL_EVT_PARAM_* accessors on the received message instead.
  *
  *  @param[in]      buffer_in   Pointer to message received
  *  @param[in,out]  p_aci_evt   Pointer to the decoded message in ::aci_evt_t
@@ -459,6 +485,22 @@ uint8_t acil_decode_evt_echo(uint8_t *buffer_in, aci_evt_params_echo_t *buffer_o
  */
 bool acil_decode_evt(uint8_t *buffer_in, aci_evt_t *p_aci_evt);
 
+/** @brief Get the shortest length of an ACI event, opcode and fixed parameters
+ *
+ *  @param[in]      evt_opcode  Opcode of the event
+ *
+ *  @return         uint8_t     Shortest value of the length byte, 0 for an unknown opcode
+ */
+uint8_t acil_evt_min_length(uint8_t evt_opcode);
+
+/** @brief Check that a received message is a known ACI event long enough for its fields
+ *
+ *  @param[in]      buffer_in   Pointer to message received
+ *
+ *  @return         bool         true, if the ACIL_EVT_PARAM_* accessors may be used on it
+ */
+bool acil_evt_is_valid(const uint8_t *buffer_in);
+
 /** @brief Decode the Display Key Event
  *
  *  @param[in]      buffer_in   Pointer to message received
@@ -26,11 +26,26 @@
  #ifndef BLE_ASSERT_H__
  #define BLE_ASSERT_H__
 
+#include "aci_log.h"
+
 extern void __ble_assert(const char *file, uint16_t line);
 
+/* Only the error and info log levels keep the file names in the flash */
+#if (ACI_LOG_LEVEL >= ACI_LOG_LEVEL_TRACE)
+#define ble_assert(expr)                                              \
+  ((expr)                                                             \
+  ? ((void) 0)                                                        \
+  : (aci_log_write(ACI_LOG_ID_ASSERT, __LINE__), __ble_assert ("", __LINE__)))
+#elif (ACI_LOG_LEVEL >= ACI_LOG_LEVEL_ERROR)
 #define ble_assert(expr)              \
   ((expr)                             \
   ? ((void) 0)                        \
   : __ble_assert (__FILE__, __LINE__))
+#else
+#define ble_assert(expr)              \
+  ((expr)                             \
+  ? ((void) 0)                        \
+  : __ble_assert ("", __LINE__))
+#endif
 
 #endif /* BLE_ASSERT_H__ */
\ No newline at end of file
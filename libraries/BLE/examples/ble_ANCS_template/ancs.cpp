@@ -18,31 +18,522 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
  * SOFTWARE.
  */
- 
+
 #include <hal_platform.h>
 #include "services.h"
 #include "lib_aci.h"
 #include "ancs.h"
 
+/* The attributes asked for each notification, the title and the message no longer than kept */
+#define ANCS_ATTRIBUTE_COUNT  3
+#define ANCS_UID_LEN          4
+#define ANCS_NOTIFICATION_LEN 8
+
+/* Bits (1 << attribute ID) of a set of attributes */
+#define ANCS_ATTRIBUTE_BIT(id) (1 << (id))
+#define ANCS_ATTRIBUTES_ALL    (ANCS_ATTRIBUTE_BIT(BLE_ANCS_NOTIFICATION_ATTRIBUTE_ID_APP_IDENTIFIER) | \
+                                ANCS_ATTRIBUTE_BIT(BLE_ANCS_NOTIFICATION_ATTRIBUTE_ID_TITLE) |          \
+                                ANCS_ATTRIBUTE_BIT(BLE_ANCS_NOTIFICATION_ATTRIBUTE_ID_MESSAGE))
+
+/* In the order they are asked for, and of the cache entries */
+static const uint8_t ancs_attribute_ids[ANCS_ATTRIBUTE_COUNT] =
+{
+  BLE_ANCS_NOTIFICATION_ATTRIBUTE_ID_APP_IDENTIFIER,
+  BLE_ANCS_NOTIFICATION_ATTRIBUTE_ID_TITLE,
+  BLE_ANCS_NOTIFICATION_ATTRIBUTE_ID_MESSAGE
+};
+
+#if ANCS_CACHE_SIZE
+typedef struct
+{
+  uint8_t  uid[ANCS_UID_LEN];
+  uint8_t  age;                                                  // Uses of other entries since this one was used
+  uint8_t  attributes;                                           // ANCS_ATTRIBUTE_BIT() of the attributes held, 0 for a free entry
+  uint16_t length[ANCS_ATTRIBUTE_COUNT];                         // attribute_len as the phone gave it
+  uint8_t  data[ANCS_ATTRIBUTE_COUNT][ANCS_ATTRIBUTE_DATA_MAX];
+} ancs_cache_entry_t;
+#endif
+
+typedef enum
+{
+  ANCS_PARSE_COMMAND_ID,
+  ANCS_PARSE_UID,
+  ANCS_PARSE_ATTRIBUTE_ID,
+  ANCS_PARSE_LENGTH_LSB,
+  ANCS_PARSE_LENGTH_MSB,
+  ANCS_PARSE_DATA,
+  ANCS_PARSE_DISCARD                               // To the end of the packet
+} ancs_parse_state_t;
+
+static struct
+{
+  ancs_notification_handler_t      notification_handler;
+  ancs_attribute_handler_t         attribute_handler;
+  uint8_t                          requests[ANCS_REQUEST_QUEUE_SIZE][ANCS_UID_LEN];   // Oldest first
+  uint8_t                          request_attributes[ANCS_REQUEST_QUEUE_SIZE];       // ANCS_ATTRIBUTE_BIT() of the ones to ask for
+  uint8_t                          request_count;
+  uint8_t                          pending[ANCS_RESPONSES_PENDING_MAX][ANCS_UID_LEN]; // In the order written
+  uint8_t                          pending_attributes[ANCS_RESPONSES_PENDING_MAX];    // Attributes in each response
+  uint8_t                          pending_count;
+  bool                             write_in_flight;                                   // Control Point write not acknowledged yet
+  ancs_parse_state_t               state;
+  uint8_t                          uid_index;
+  uint8_t                          attributes_left;
+  uint16_t                         data_index;
+  ble_ancs_c_evt_notif_attribute_t attribute;
+  ancs_stats_t                     stats;
+#if ANCS_CACHE_SIZE
+  ancs_cache_entry_t               cache[ANCS_CACHE_SIZE];
+#endif
+} m_ancs;
+
+static int8_t ancs_uid_find(const uint8_t uids[][ANCS_UID_LEN], uint8_t count, const uint8_t *p_uid)
+{
+  for (uint8_t i = 0; i < count; i++)
+  {
+    if (0 == memcmp(&uids[i][0], p_uid, ANCS_UID_LEN))
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void ancs_request_remove(uint8_t index)
+{
+  m_ancs.request_count--;
+  memmove(&m_ancs.requests[index][0], &m_ancs.requests[index + 1][0],
+          (m_ancs.request_count - index) * ANCS_UID_LEN);
+  memmove(&m_ancs.request_attributes[index], &m_ancs.request_attributes[index + 1],
+          m_ancs.request_count - index);
+}
+
+static void ancs_pending_pop(uint8_t count)
+{
+  m_ancs.pending_count -= count;
+  memmove(&m_ancs.pending[0][0], &m_ancs.pending[count][0], m_ancs.pending_count * ANCS_UID_LEN);
+  memmove(&m_ancs.pending_attributes[0], &m_ancs.pending_attributes[count], m_ancs.pending_count);
+}
+
+#if ANCS_CACHE_SIZE
+static int8_t ancs_cache_index(uint8_t attribute_id)
+{
+  for (uint8_t i = 0; i < ANCS_ATTRIBUTE_COUNT; i++)
+  {
+    if (ancs_attribute_ids[i] == attribute_id)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static ancs_cache_entry_t *ancs_cache_find(const uint8_t *p_uid)
+{
+  for (uint8_t i = 0; i < ANCS_CACHE_SIZE; i++)
+  {
+    if ((0 != m_ancs.cache[i].attributes) && (0 == memcmp(&m_ancs.cache[i].uid[0], p_uid, ANCS_UID_LEN)))
+    {
+      return &m_ancs.cache[i];
+    }
+  }
+  return NULL;
+}
+
+/* The entry becomes the one used last */
+static void ancs_cache_touch(ancs_cache_entry_t *p_entry)
+{
+  for (uint8_t i = 0; i < ANCS_CACHE_SIZE; i++)
+  {
+    if (m_ancs.cache[i].age < 0xFF)
+    {
+      m_ancs.cache[i].age++;
+    }
+  }
+  p_entry->age = 0;
+}
+
+/*
+  Keeps an attribute just got from the Data Source. A new notification takes a free entry, else
+  the one used least recently.
+*/
+static void ancs_cache_store(const ble_ancs_c_evt_notif_attribute_t *p_attribute)
+{
+  ancs_cache_entry_t *p_entry;
+  const int8_t        index = ancs_cache_index(p_attribute->attribute_id);
+
+  if (index < 0)
+  {
+    return;
+  }
+
+  p_entry = ancs_cache_find(&p_attribute->notification_uid[0]);
+  if (NULL == p_entry)
+  {
+    p_entry = &m_ancs.cache[0];
+    for (uint8_t i = 1; i < ANCS_CACHE_SIZE; i++)
+    {
+      if ((0 != p_entry->attributes) &&
+          ((0 == m_ancs.cache[i].attributes) || (m_ancs.cache[i].age > p_entry->age)))
+      {
+        p_entry = &m_ancs.cache[i];
+      }
+    }
+    if (0 != p_entry->attributes)
+    {
+      m_ancs.stats.cache_evictions++;
+    }
+    memcpy(&p_entry->uid[0], &p_attribute->notification_uid[0], ANCS_UID_LEN);
+    p_entry->attributes = 0;
+  }
+
+  p_entry->attributes    |= ANCS_ATTRIBUTE_BIT(p_attribute->attribute_id);
+  p_entry->length[index]  = p_attribute->attribute_len;
+  memcpy(&p_entry->data[index][0], &p_attribute->data[0], ANCS_ATTRIBUTE_DATA_MAX);
+  ancs_cache_touch(p_entry);
+}
+
+static void ancs_cache_remove(const uint8_t *p_uid)
+{
+  ancs_cache_entry_t *p_entry = ancs_cache_find(p_uid);
+
+  if (NULL != p_entry)
+  {
+    p_entry->attributes = 0;
+  }
+}
+
+/*
+  Gives the cached attributes of a notification to the handler, but those in refetch.
+  Returns the attributes still to ask for.
+*/
+static uint8_t ancs_cache_give(const uint8_t *p_uid, uint8_t refetch)
+{
+  ble_ancs_c_evt_notif_attribute_t attribute;
+  ancs_cache_entry_t              *p_entry = ancs_cache_find(p_uid);
+  uint8_t                          missing = ANCS_ATTRIBUTES_ALL;
+
+  if (NULL == p_entry)
+  {
+    return missing;
+  }
+  ancs_cache_touch(p_entry);
+
+  attribute.command_id = BLE_ANCS_COMMAND_ID_GET_NOTIFICATION_ATTRIBUTES;
+  memcpy(&attribute.notification_uid[0], p_uid, ANCS_UID_LEN);
+  for (uint8_t i = 0; i < ANCS_ATTRIBUTE_COUNT; i++)
+  {
+    const uint8_t bit = ANCS_ATTRIBUTE_BIT(ancs_attribute_ids[i]);
+
+    if ((0 == (p_entry->attributes & bit)) || (0 != (refetch & bit)))
+    {
+      continue;
+    }
+    missing &= ~bit;
+    m_ancs.stats.cached++;
+    if (NULL != m_ancs.attribute_handler)
+    {
+      attribute.attribute_id  = ancs_attribute_ids[i];
+      attribute.attribute_len = p_entry->length[i];
+      memcpy(&attribute.data[0], &p_entry->data[i][0], ANCS_ATTRIBUTE_DATA_MAX);
+      m_ancs.attribute_handler(&attribute);
+    }
+  }
+  return missing;
+}
+#else
+#define ancs_cache_store(p_attribute)
+#define ancs_cache_remove(p_uid)
+#define ancs_cache_give(p_uid, refetch)  ((uint8_t)ANCS_ATTRIBUTES_ALL)
+#endif
+
+static void ancs_notification_source_rcvd(const uint8_t *p_data, uint8_t length)
+{
+  ble_ancs_c_evt_ios_notification_t notification;
+  uint8_t missing;
+  int8_t index;
+
+  if (length < ANCS_NOTIFICATION_LEN)
+  {
+    return;
+  }
+
+  notification.event_id       = p_data[0];
+  notification.event_flags    = p_data[1];
+  notification.category_id    = p_data[2];
+  notification.category_count = p_data[3];
+  memcpy(&notification.notification_uid[0], &p_data[4], ANCS_UID_LEN);
+  m_ancs.stats.notifications++;
+
+  if (NULL != m_ancs.notification_handler)
+  {
+    m_ancs.notification_handler(&notification);
+  }
+
+  index = ancs_uid_find(m_ancs.requests, m_ancs.request_count, &notification.notification_uid[0]);
+  if (BLE_ANCS_EVENT_ID_NOTIFICATION_REMOVED == notification.event_id)
+  {
+    // Gone from the phone, its attributes are not asked for
+    ancs_cache_remove(&notification.notification_uid[0]);
+    if (index >= 0)
+    {
+      ancs_request_remove(index);
+      m_ancs.stats.requests_skipped++;
+    }
+    return;
+  }
+
+  missing = ancs_cache_give(&notification.notification_uid[0],
+                            (BLE_ANCS_EVENT_ID_NOTIFICATION_MODIFIED == notification.event_id) ?
+                            (uint8_t)ANCS_CACHE_MODIFIED_REFETCH : 0);
+  if (index >= 0)
+  {
+    m_ancs.request_attributes[index] |= missing;
+  }
+  else if (0 != missing)
+  {
+    if (ANCS_REQUEST_QUEUE_SIZE == m_ancs.request_count)
+    {
+      m_ancs.stats.requests_dropped++;
+      return;
+    }
+    memcpy(&m_ancs.requests[m_ancs.request_count][0], &notification.notification_uid[0], ANCS_UID_LEN);
+    m_ancs.request_attributes[m_ancs.request_count] = missing;
+    m_ancs.request_count++;
+  }
+}
 
-void ancs_notification_evt_rcvd(uint8_t pipe_num, uint8_t *buffer)
+static void ancs_attribute_done(void)
 {
-    Serial.print(F("PIPE_ANCS_NOTIFICATION_SOURCE_RX: "));
-      for(uint8_t counter = 0; counter <= 20; counter++)
+  m_ancs.stats.attributes++;
+  if (m_ancs.attribute.attribute_len > ANCS_ATTRIBUTE_DATA_MAX)
+  {
+    m_ancs.stats.truncated++;
+  }
+
+  ancs_cache_store(&m_ancs.attribute);
+  if (NULL != m_ancs.attribute_handler)
+  {
+    m_ancs.attribute_handler(&m_ancs.attribute);
+  }
+
+  m_ancs.attributes_left--;
+  if (0 == m_ancs.attributes_left)
+  {
+    // The response is complete, the next one starts with its command ID
+    ancs_pending_pop(1);
+    m_ancs.state = ANCS_PARSE_COMMAND_ID;
+  }
+  else
+  {
+    m_ancs.state = ANCS_PARSE_ATTRIBUTE_ID;
+  }
+}
+
+/*
+  A response is [command ID][notification UID][attribute ID][length][attribute]..., split over
+  the Data Source packets anywhere.
+*/
+static void ancs_data_source_byte(uint8_t data)
+{
+  int8_t index;
+
+  switch (m_ancs.state)
+  {
+    case ANCS_PARSE_COMMAND_ID:
+      if ((0 == m_ancs.pending_count) || (BLE_ANCS_COMMAND_ID_GET_NOTIFICATION_ATTRIBUTES != data))
       {
-        Serial.write(buffer[counter]); //uint8_t file_name[20];
+        m_ancs.stats.resyncs++;
+        m_ancs.state = ANCS_PARSE_DISCARD;
+        break;
       }
-      Serial.println();
+      m_ancs.attribute.command_id = data;
+      m_ancs.uid_index            = 0;
+      m_ancs.state                = ANCS_PARSE_UID;
+      break;
+
+    case ANCS_PARSE_UID:
+      m_ancs.attribute.notification_uid[m_ancs.uid_index++] = data;
+      if (ANCS_UID_LEN != m_ancs.uid_index)
+      {
+        break;
+      }
+      // The responses come in the order of the commands, those before it did not get one
+      index = ancs_uid_find(m_ancs.pending, m_ancs.pending_count, &m_ancs.attribute.notification_uid[0]);
+      if (index < 0)
+      {
+        m_ancs.stats.resyncs++;
+        m_ancs.state = ANCS_PARSE_DISCARD;
+        break;
+      }
+      ancs_pending_pop(index);
+      m_ancs.attributes_left = m_ancs.pending_attributes[0];
+      m_ancs.state           = ANCS_PARSE_ATTRIBUTE_ID;
+      break;
+
+    case ANCS_PARSE_ATTRIBUTE_ID:
+      m_ancs.attribute.attribute_id = data;
+      m_ancs.state                  = ANCS_PARSE_LENGTH_LSB;
+      break;
+
+    case ANCS_PARSE_LENGTH_LSB:
+      m_ancs.attribute.attribute_len = data;
+      m_ancs.state                   = ANCS_PARSE_LENGTH_MSB;
+      break;
+
+    case ANCS_PARSE_LENGTH_MSB:
+      m_ancs.attribute.attribute_len |= (uint16_t)data << 8;
+      m_ancs.data_index               = 0;
+      m_ancs.state                    = ANCS_PARSE_DATA;
+      if (0 == m_ancs.attribute.attribute_len)
+      {
+        ancs_attribute_done();
+      }
+      break;
+
+    case ANCS_PARSE_DATA:
+      if (m_ancs.data_index < ANCS_ATTRIBUTE_DATA_MAX)
+      {
+        m_ancs.attribute.data[m_ancs.data_index] = data;
+      }
+      m_ancs.data_index++;
+      if (m_ancs.data_index == m_ancs.attribute.attribute_len)
+      {
+        ancs_attribute_done();
+      }
+      break;
+
+    case ANCS_PARSE_DISCARD:
+      break;
+  }
 }
-    
-void ancs_data_evt_rcvd(uint8_t pipe_num, uint8_t *buffer)
+
+static void ancs_data_source_rcvd(const uint8_t *p_data, uint8_t length)
 {
-      Serial.print(F("PIPE_ANCS_DATA_SOURCE_RX: "));
-      for(uint8_t counter = 0; counter <= ACI_PIPE_RX_DATA_MAX_LEN; counter++)
+  for (uint8_t i = 0; i < length; i++)
+  {
+    ancs_data_source_byte(p_data[i]);
+  }
+
+  // A response that was not expected is dropped, the next one starts a packet
+  if (ANCS_PARSE_DISCARD == m_ancs.state)
+  {
+    m_ancs.state = ANCS_PARSE_COMMAND_ID;
+  }
+}
+
+static void ancs_reset(void)
+{
+  m_ancs.request_count   = 0;
+  m_ancs.pending_count   = 0;
+  m_ancs.write_in_flight = false;
+  m_ancs.state           = ANCS_PARSE_COMMAND_ID;
+#if ANCS_CACHE_SIZE
+  memset(&m_ancs.cache[0], 0, sizeof(m_ancs.cache));
+#endif
+}
+
+void ancs_init(ancs_notification_handler_t notification_handler, ancs_attribute_handler_t attribute_handler)
+{
+  memset(&m_ancs, 0, sizeof(m_ancs));
+  m_ancs.notification_handler = notification_handler;
+  m_ancs.attribute_handler    = attribute_handler;
+  ancs_reset();
+}
+
+void ancs_event(aci_state_t *aci_stat, const aci_evt_t *p_evt)
+{
+  const uint8_t *p_data;
+
+  switch (p_evt->evt_opcode)
+  {
+    case ACI_EVT_DATA_RECEIVED:
+      p_data = &p_evt->params.data_received.rx_data.aci_data[0];
+      if (PIPE_ANCS_NOTIFICATION_SOURCE_RX == p_evt->params.data_received.rx_data.pipe_number)
+      {
+        ancs_notification_source_rcvd(p_data, p_evt->len - 2);
+      }
+      else if (PIPE_ANCS_DATA_SOURCE_RX == p_evt->params.data_received.rx_data.pipe_number)
+      {
+        ancs_data_source_rcvd(p_data, p_evt->len - 2);
+      }
+      break;
+
+    case ACI_EVT_DATA_ACK:
+      if (PIPE_ANCS_CONTROL_POINT_TX_ACK == p_evt->params.data_ack.pipe_number)
       {
-        Serial.write(buffer[counter]); //uint8_t file_name[20];
+        // The phone took the command, the next one can be written while the response comes
+        m_ancs.write_in_flight = false;
+        ancs_poll(aci_stat);
       }
-      Serial.println();
+      break;
 
+    case ACI_EVT_PIPE_ERROR:
+      if ((PIPE_ANCS_CONTROL_POINT_TX_ACK == p_evt->params.pipe_error.pipe_number) && m_ancs.write_in_flight)
+      {
+        // The command was refused, e.g. the notification is gone, no response comes for it
+        m_ancs.write_in_flight = false;
+        m_ancs.pending_count--;
+      }
+      break;
+
+    case ACI_EVT_DISCONNECTED:
+      ancs_reset();
+      break;
+
+    default:
+      break;
+  }
 }
 
+void ancs_poll(aci_state_t *aci_stat)
+{
+  uint8_t command[1 + ANCS_UID_LEN + 1 + (2 * 3)];
+  uint8_t length = 0;
+  uint8_t count  = 0;
+
+  if (m_ancs.write_in_flight || (0 == m_ancs.request_count) ||
+      (ANCS_RESPONSES_PENDING_MAX == m_ancs.pending_count) ||
+      (0 == aci_stat->data_credit_available) ||
+      !lib_aci_is_pipe_available(aci_stat, PIPE_ANCS_CONTROL_POINT_TX_ACK) ||
+      !lib_aci_is_pipe_available(aci_stat, PIPE_ANCS_DATA_SOURCE_RX))
+  {
+    return;
+  }
+
+  command[length++] = BLE_ANCS_COMMAND_ID_GET_NOTIFICATION_ATTRIBUTES;
+  memcpy(&command[length], &m_ancs.requests[0][0], ANCS_UID_LEN);
+  length += ANCS_UID_LEN;
+  for (uint8_t i = 0; i < ANCS_ATTRIBUTE_COUNT; i++)
+  {
+    if (0 == (m_ancs.request_attributes[0] & ANCS_ATTRIBUTE_BIT(ancs_attribute_ids[i])))
+    {
+      continue;
+    }
+    command[length++] = ancs_attribute_ids[i];
+    if (BLE_ANCS_NOTIFICATION_ATTRIBUTE_ID_APP_IDENTIFIER != ancs_attribute_ids[i])
+    {
+      command[length++] = (uint8_t)ANCS_ATTRIBUTE_DATA_MAX;
+      command[length++] = (uint8_t)(ANCS_ATTRIBUTE_DATA_MAX >> 8);
+    }
+    count++;
+  }
+
+  lib_aci_select(aci_stat);
+  if (!lib_aci_send_data(PIPE_ANCS_CONTROL_POINT_TX_ACK, &command[0], length))
+  {
+    return;
+  }
+
+  memcpy(&m_ancs.pending[m_ancs.pending_count][0], &m_ancs.requests[0][0], ANCS_UID_LEN);
+  m_ancs.pending_attributes[m_ancs.pending_count] = count;
+  m_ancs.pending_count++;
+  ancs_request_remove(0);
+  m_ancs.write_in_flight = true;
+  m_ancs.stats.requests_sent++;
+}
+
+void ancs_stats_get(ancs_stats_t *p_stats)
+{
+  *p_stats = m_ancs.stats;
+}
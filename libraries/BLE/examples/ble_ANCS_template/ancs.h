@@ -18,11 +18,80 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
  * SOFTWARE.
  */
- 
- #include <stdint.h>
+
+/** @file
+ * @brief Apple Notification Center Service client: the notifications and their attributes.
+ *
+ * The Notification Source tells of each notification added, modified or removed. For the added
+ * and modified ones the Get Notification Attributes command is written on the Control Point and
+ * the attributes come back on the Data Source, over as many 20 byte packets as they take.
+ *
+ * ancs_event() parses both sources a byte at a time as the packets come, with a state machine,
+ * and gives each notification and each complete attribute to the handlers of ancs_init().
+ * An attribute keeps ANCS_ATTRIBUTE_DATA_MAX bytes, the title and the message are asked for
+ * no longer than that. The next command is written as soon as the previous write is acknowledged,
+ * up to ANCS_RESPONSES_PENDING_MAX responses may still be coming, so the Data Source keeps
+ * sending while the notifications come in. A notification removed before its command was written
+ * is not asked for.
+ *
+ * The attributes got are kept in a cache of the ANCS_CACHE_SIZE notifications used last. A
+ * notification added or modified again gives its cached attributes to the handler straight away,
+ * the command asks only for the ones missing and for the ones in ANCS_CACHE_MODIFIED_REFETCH when
+ * it was modified. The cache is emptied on the Disconnected event, the UIDs are those of a connection.
+ */
+
+#ifndef ANCS_H__
+#define ANCS_H__
+
+#include <stdint.h>
+#include <lib_aci.h>
 
 #define ANCS_ATTRIBUTE_DATA_MAX                     32                                   /*<< Maximium notification attribute data length. */
 
+/************************************************************************/
+/* Notifications waiting for their Get Notification Attributes command   */
+/************************************************************************/
+#ifndef ANCS_REQUEST_QUEUE_SIZE
+#define ANCS_REQUEST_QUEUE_SIZE 8
+#endif
+
+/************************************************************************/
+/* Commands written whose response is still coming on the Data Source    */
+/************************************************************************/
+#ifndef ANCS_RESPONSES_PENDING_MAX
+#define ANCS_RESPONSES_PENDING_MAX 2
+#endif
+
+/************************************************************************/
+/* Notifications whose attributes are cached, 0 to 16                    */
+/* The app identifier, the title and the message of each, up to          */
+/* ANCS_ATTRIBUTE_DATA_MAX bytes of them. A notification takes 12        */
+/* bytes and 3 * ANCS_ATTRIBUTE_DATA_MAX. The one used least recently    */
+/* is dropped for a new one. 0 compiles the cache out.                   */
+/************************************************************************/
+#ifndef ANCS_CACHE_SIZE
+#define ANCS_CACHE_SIZE 2
+#endif
+
+/************************************************************************/
+/* Attributes asked for again when a notification is modified            */
+/* Bits (1 << attribute ID) of the cached attributes. The message is     */
+/* what changes, the app identifier and the title are kept.              */
+/************************************************************************/
+#ifndef ANCS_CACHE_MODIFIED_REFETCH
+#define ANCS_CACHE_MODIFIED_REFETCH (1 << BLE_ANCS_NOTIFICATION_ATTRIBUTE_ID_MESSAGE)
+#endif
+
+#if (ANCS_REQUEST_QUEUE_SIZE < 1) || (ANCS_REQUEST_QUEUE_SIZE > 32)
+#error "ANCS_REQUEST_QUEUE_SIZE must be 1 to 32"
+#endif
+#if (ANCS_RESPONSES_PENDING_MAX < 1) || (ANCS_RESPONSES_PENDING_MAX > 8)
+#error "ANCS_RESPONSES_PENDING_MAX must be 1 to 8"
+#endif
+#if (ANCS_CACHE_SIZE < 0) || (ANCS_CACHE_SIZE > 16)
+#error "ANCS_CACHE_SIZE must be 0 to 16"
+#endif
+
 /**@brief Category IDs for iOS notifications. */
 typedef enum
 {
@@ -91,12 +160,45 @@ typedef struct {
     uint16_t                           attribute_len;
 } ble_ancs_attr_list_t;
 
- /** @brief Function to handle reception of data for ANCS.
- *  @details Call this function on the ACI_EVT_DATA_RECEIVED event. This function checks if the data received is for ANCS.
- *  If so it prints the received data to the Serial interface.
- *  @param pipe_num Pipe which has received data.
- *  @param buffer Pointer to the received data.
+typedef struct {
+    uint16_t                           notifications;    /**< Notification Source packets */
+    uint16_t                           requests_sent;    /**< Get Notification Attributes commands written */
+    uint16_t                           requests_dropped; /**< Not asked for, the request queue was full */
+    uint16_t                           requests_skipped; /**< Not asked for, removed before the command was written */
+    uint16_t                           attributes;       /**< Attributes given to the handler */
+    uint16_t                           truncated;        /**< Attributes longer than ANCS_ATTRIBUTE_DATA_MAX */
+    uint16_t                           resyncs;          /**< Data Source packets dropped, not the response expected */
+    uint16_t                           cached;           /**< Attributes given from the cache, not asked for */
+    uint16_t                           cache_evictions;  /**< Notifications dropped from the full cache */
+} ancs_stats_t;
+
+/** @brief Handler of a notification from the Notification Source. */
+typedef void (*ancs_notification_handler_t)(const ble_ancs_c_evt_ios_notification_t *p_notification);
+
+/** @brief Handler of a complete attribute from the Data Source or from the cache.
+ *  @details attribute_len is the length of the attribute, only up to ANCS_ATTRIBUTE_DATA_MAX bytes of it are in data.
+ *  The cached attributes of a notification come right after it, the ones asked for later.
+ */
+typedef void (*ancs_attribute_handler_t)(const ble_ancs_c_evt_notif_attribute_t *p_attribute);
+
+/** @brief Initializes the parser and the requests, call it once in setup().
+ *  @param notification_handler called for each notification, may be NULL.
+ *  @param attribute_handler called for each attribute, may be NULL.
+ */
+void ancs_init(ancs_notification_handler_t notification_handler, ancs_attribute_handler_t attribute_handler);
+
+/** @brief Gives an ACI event to ANCS, call it for every event taken from lib_aci_event_get().
+ *  @details Parses the data received on the Notification Source and the Data Source, and follows
+ *  the writes on the Control Point. Everything is dropped on the Disconnected event.
+ */
+void ancs_event(aci_state_t *aci_stat, const aci_evt_t *p_evt);
+
+/** @brief Writes the next Get Notification Attributes command when it can be, call it from the loop.
  */
- void ancs_notification_evt_rcvd(uint8_t pipe_num, uint8_t *buffer);
- 
-void ancs_data_evt_rcvd(uint8_t pipe_num, uint8_t *buffer);
+void ancs_poll(aci_state_t *aci_stat);
+
+/** @brief Gets the counters since ancs_init().
+ */
+void ancs_stats_get(ancs_stats_t *p_stats);
+
+#endif // ANCS_H__
@@ -63,7 +63,7 @@ Note: Pin #8 on Arduino -> PAIRING CLEAR pin: Connect to 3.3v to clear the pairi
 #include "immediate_alert.h"
 #include "link_loss.h"
 #include "ancs.h"
-#include <EEPROM.h>
+#include <aci_bond_store.h>
 
 /**
 Put the nRF8001 setup in the RAM of the nRF8001.
@@ -101,10 +101,9 @@ static hal_aci_data_t setup_msgs[NB_SETUP_MESSAGES] PROGMEM = SETUP_MESSAGES_CON
 static struct aci_state_t aci_state;
 
 /*
-Temporary buffers for sending ACI commands
+Temporary buffer for the ACI events
 */
 static hal_aci_evt_t  aci_data;
-static hal_aci_data_t aci_cmd;
 
 /*
 We will store the bonding info for the nRF8001 in the EEPROM/Flash of the MCU to recover from a power loss situation
@@ -117,6 +116,45 @@ Timing change state variable
 static bool timing_change_done = false;
 
 
+/*
+An ANCS notification from the phone, its attributes follow in ancs_attribute_rcvd()
+*/
+void ancs_notification_rcvd(const ble_ancs_c_evt_ios_notification_t *p_notification)
+{
+  Serial.print(F("ANCS Notification: Event "));
+  Serial.print(p_notification->event_id, DEC);
+  Serial.print(F(" Category "));
+  Serial.print(p_notification->category_id, DEC);
+  Serial.print(F(" UID 0x"));
+  for (int8_t i = 3; i >= 0; i--)
+  {
+    Serial.print(p_notification->notification_uid[i], HEX);
+  }
+  Serial.println();
+}
+
+/*
+An attribute of a notification: the app identifier, the title or the message
+*/
+void ancs_attribute_rcvd(const ble_ancs_c_evt_notif_attribute_t *p_attribute)
+{
+  uint16_t length = p_attribute->attribute_len;
+
+  if (length > ANCS_ATTRIBUTE_DATA_MAX)
+  {
+    length = ANCS_ATTRIBUTE_DATA_MAX;
+  }
+
+  Serial.print(F("ANCS Attribute "));
+  Serial.print(p_attribute->attribute_id, DEC);
+  Serial.print(F(": "));
+  for (uint16_t i = 0; i < length; i++)
+  {
+    Serial.write(p_attribute->data[i]);
+  }
+  Serial.println();
+}
+
 /*************NOTE**********
 Scroll to the end of the file and read the loop() and setup() functions.
 The loop/setup functions is the equivalent of the main() function
@@ -137,102 +175,27 @@ void __ble_assert(const char *file, uint16_t line)
 Read the Dymamic data from the EEPROM and send then as ACI Write Dynamic Data to the nRF8001
 This will restore the nRF8001 to the situation when the Dynamic Data was Read out
 */
-aci_status_code_t bond_data_restore(aci_state_t *aci_stat, uint8_t eeprom_status, bool *bonded_first_time_state)
+aci_status_code_t bond_data_restore(aci_state_t *aci_stat, bool *bonded_first_time_state)
 {
-  aci_evt_t *aci_evt; 
-  uint8_t eeprom_offset_read = 1;
-  uint8_t write_dyn_num_msgs = 0;
-  uint8_t len =0;
-  
-  
-  // Get the number of messages to write for the eeprom_status
-  write_dyn_num_msgs = eeprom_status & 0x7F;
-  
-  //Read from the EEPROM
-  while(1)
-  {
-    len = EEPROM.read(eeprom_offset_read);
-    eeprom_offset_read++;
-    aci_cmd.buffer[0] = len;
-    
-    for (uint8_t i=1; i<=len; i++)
-    {
-        aci_cmd.buffer[i] = EEPROM.read(eeprom_offset_read);
-        eeprom_offset_read++;
-    }
-    //Send the ACI Write Dynamic Data
-    if (!hal_aci_tl_send(&aci_cmd))
-    {
-      Serial.println(F("bond_data_restore: Cmd Q Full"));
-      return ACI_STATUS_ERROR_INTERNAL;
-    }
-  
-    //Spin in the while loop waiting for an event
-    while (1)
-    {
-      if (lib_aci_event_get(aci_stat, &aci_data))
-      {
-        aci_evt = &aci_data.evt; 
-        
-        if (ACI_EVT_CMD_RSP != aci_evt->evt_opcode)
-        {
-            //Got something other than a command response evt -> Error
-            Serial.print(F("bond_data_restore: Expected cmd rsp evt. Got: 0x"));           
-            Serial.println(aci_evt->evt_opcode, HEX);
-            return ACI_STATUS_ERROR_INTERNAL;
-        }
-        else
-        {
-          write_dyn_num_msgs--;
-          
-          //ACI Evt Command Response
-          if (ACI_STATUS_TRANSACTION_COMPLETE == aci_evt->params.cmd_rsp.cmd_status)
-          {
-            //Set the state variables correctly
-            *bonded_first_time_state = false;
-            aci_stat->bonded = ACI_BOND_STATUS_SUCCESS;
-            
-            delay(10);
-            
-            return ACI_STATUS_TRANSACTION_COMPLETE;
-          }
-          if (0 >= write_dyn_num_msgs)
-          {
-            //should have returned earlier
-            return ACI_STATUS_ERROR_INTERNAL;
-          }
-          if (ACI_STATUS_TRANSACTION_CONTINUE == aci_evt->params.cmd_rsp.cmd_status)
-          {            
-            //break and write the next ACI Write Dynamic Data
-            break;
-          }
-        }
-      }
-    }    
-  }  
-}
+  uint8_t result;
 
-
-/*
-This function is specific to the atmega328
-@params ACI Command Response Evt received from the Read Dynmaic Data
-*/
-void bond_data_store(aci_evt_t *evt)
-{
-  static int eeprom_write_offset = 1;
-  
-  //Write it to non-volatile storage
-  EEPROM.write( eeprom_write_offset, evt->len -2 );
-  eeprom_write_offset++;
-  
-  EEPROM.write( eeprom_write_offset, ACI_CMD_WRITE_DYNAMIC_DATA);
-  eeprom_write_offset++;
-  
-  for (uint8_t i=0; i< (evt->len-3); i++)
+  //Send the ACI Write Dynamic Data commands read from the EEPROM
+  //The command queue is kept filled with them, as for the setup
+  result = aci_bond_store_restore(aci_stat);
+  if (ACI_BOND_STORE_RESTORE_SUCCESS != result)
   {
-    EEPROM.write( eeprom_write_offset, evt->params.cmd_rsp.params.padding[i]);
-    eeprom_write_offset++;
+    Serial.print(F("bond_data_restore: Failed: "));
+    Serial.println(result, DEC);
+    return ACI_STATUS_ERROR_INTERNAL;
   }
+
+  //Set the state variables correctly
+  *bonded_first_time_state = false;
+  aci_stat->bonded = ACI_BOND_STATUS_SUCCESS;
+
+  delay(10);
+
+  return ACI_STATUS_TRANSACTION_COMPLETE;
 }
 
 bool bond_data_read_store(aci_state_t *aci_stat)
@@ -240,65 +203,61 @@ bool bond_data_read_store(aci_state_t *aci_stat)
   /*
   The size of the dynamic data for a specific Bluetooth Low Energy configuration
   is present in the ublue_setup.gen.out.txt generated by the nRFgo studio as "dynamic data size".
+  aci_bond_store only writes the EEPROM bytes that changed, nothing when the bond is the same.
   */
   bool status = false;
   aci_evt_t * aci_evt = NULL;
-  uint8_t read_dyn_num_msgs = 0;
- 
-  //Start reading the dynamic data 
+
+  //Start reading the dynamic data
+  aci_bond_store_save_start();
   lib_aci_read_dynamic_data();
-  read_dyn_num_msgs++;
-  
+
   while (1)
   {
     if (true == lib_aci_event_get(aci_stat, &aci_data))
     {
       aci_evt = &aci_data.evt;
-  
+
       if (ACI_EVT_CMD_RSP != aci_evt->evt_opcode )
       {
         //Got something other than a command response evt -> Error
         status = false;
         break;
       }
-      
+
       if (ACI_STATUS_TRANSACTION_COMPLETE == aci_evt->params.cmd_rsp.cmd_status)
       {
-        //Store the contents of the command response event in the EEPROM 
+        //Store the contents of the command response event in the EEPROM
         //(len, cmd, seq-no, data) : cmd ->Write Dynamic Data so it can be used directly
-        bond_data_store(aci_evt);
-        
-        //Set the flag in the EEPROM that the contents of the EEPROM is valid
-        EEPROM.write(0, 0x80|read_dyn_num_msgs );
+        //and commit the record, the last one stays in use if anything goes wrong
+        status = aci_bond_store_save_msg(aci_evt) && aci_bond_store_save_end();
         //Finished with reading the dynamic data
-        status = true;
-        
         break;
       }
-      
+
       if (!(ACI_STATUS_TRANSACTION_CONTINUE == aci_evt->params.cmd_rsp.cmd_status))
       {
         //We failed the read dymanic data
-        //Set the flag in the EEPROM that the contents of the EEPROM is invalid
-        EEPROM.write(0, 0x00);
-        
         status = false;
         break;
       }
       else
       {
-        //Store the contents of the command response event in the EEPROM 
+        //Store the contents of the command response event in the EEPROM
         // (len, cmd, seq-no, data) : cmd ->Write Dynamic Data so it can be used directly when re-storing the dynamic data
-        bond_data_store(aci_evt);
-        
+        if (!aci_bond_store_save_msg(aci_evt))
+        {
+          status = false;
+          break;
+        }
+
         //Read the next dynamic data message
         lib_aci_read_dynamic_data();
-        read_dyn_num_msgs++;
       }
-                       
+
     }
-  }  
-  return status;  
+  }
+  return status;
 }
 
 
@@ -312,6 +271,10 @@ void aci_loop()
     aci_evt_t * aci_evt;
     
     aci_evt = &aci_data.evt;    
+
+    //Parses the ANCS sources and follows the Control Point writes
+    ancs_event(&aci_state, aci_evt);
+
     switch(aci_evt->evt_opcode)
     {
         /**
@@ -343,16 +306,14 @@ void aci_loop()
               { 
                 //Manage the bond in EEPROM of the AVR
                 {
-                  uint8_t eeprom_status = 0;
-                  eeprom_status = EEPROM.read(0);
-                  if (eeprom_status != 0x00)
+                  if (0 != aci_bond_store_msg_count())
                   {
                     Serial.println(F("Previous Bond present. Restoring"));
                     Serial.println(F("Using existing bond stored in EEPROM."));
                     Serial.println(F("   To delete the bond stored in EEPROM, connect Pin 6 to 3.3v and Reset."));
                     Serial.println(F("   Make sure that the bond on the phone/PC is deleted as well."));
                     //We must have lost power and restarted and must restore the bonding infromation using the ACI Write Dynamic Data
-                    if (ACI_STATUS_TRANSACTION_COMPLETE == bond_data_restore(&aci_state, eeprom_status, &bonded_first_time))
+                    if (ACI_STATUS_TRANSACTION_COMPLETE == bond_data_restore(&aci_state, &bonded_first_time))
                     {
                       Serial.println(F("Bond restored successfully"));
                     }
@@ -484,15 +445,13 @@ void aci_loop()
         {
           if (ACI_STATUS_EXTENDED == aci_evt->params.disconnected.aci_status) //Link was disconnected
           {
-              if (bonded_first_time)
+              bonded_first_time = false;
+              //Store away the dynamic data of the nRF8001 in the Flash or EEPROM of the MCU 
+              // so we can restore the bond information of the nRF8001 in the event of power loss
+              //It is stored after every disconnect, only the bytes that changed are written to the EEPROM
+              if (bond_data_read_store(&aci_state))
               {
-                bonded_first_time = false;
-                //Store away the dynamic data of the nRF8001 in the Flash or EEPROM of the MCU 
-                // so we can restore the bond information of the nRF8001 in the event of power loss
-                if (bond_data_read_store(&aci_state))
-                {
-                  Serial.println(F("Dynamic Data read and stored successfully"));
-                }
+                Serial.println(F("Dynamic Data read and stored successfully"));
               }
               if (0x24 == aci_evt->params.disconnected.btle_status)
               {
@@ -526,19 +485,7 @@ void aci_loop()
         Serial.println(aci_evt->params.data_received.rx_data.aci_data[0], DEC);
         link_loss_pipes_updated_evt_rcvd(aci_evt->params.data_received.rx_data.pipe_number,
                                          &aci_evt->params.data_received.rx_data.aci_data[0]);
-        
-        switch (aci_evt->params.data_received.rx_data.pipe_number)
-        {
-          case PIPE_ANCS_NOTIFICATION_SOURCE_RX :
-            ancs_notification_evt_rcvd(aci_evt->params.data_received.rx_data.pipe_number,
-                          &aci_evt->params.data_received.rx_data.aci_data[0]);
-          break;
-          
-          case PIPE_ANCS_DATA_SOURCE_RX :
-            ancs_data_evt_rcvd(aci_evt->params.data_received.rx_data.pipe_number,
-                          &aci_evt->params.data_received.rx_data.aci_data[0]);
-          break;
-        }
+        //The ANCS Notification Source and Data Source are parsed by ancs_event()
        /* if (PIPE_ANCS_NOTIFICATION_SOURCE_RX==aci_evt->params.data_received.rx_data.pipe_number)
         {
           Serial.print(F("PIPE_ANCS_NOTIFICATION_SOURCE_RX: "));
@@ -560,7 +507,7 @@ void aci_loop()
         //break;
    
       case ACI_EVT_DATA_CREDIT:
-        aci_state.data_credit_available = aci_state.data_credit_available + aci_evt->params.data_credit.credit;
+        //aci_state.data_credit_available is updated by the ACI Library
         break;
       
       case ACI_EVT_PIPE_ERROR:
@@ -569,14 +516,6 @@ void aci_loop()
         Serial.print(aci_evt->params.pipe_error.pipe_number, DEC);
         Serial.print(F("  Pipe Error Code: 0x"));
         Serial.println(aci_evt->params.pipe_error.error_code, HEX);
-                
-        //Increment the credit available as the data packet was not sent.
-        //The pipe error also represents the Attribute protocol Error Response sent from the peer and that should not be counted 
-        //for the credit.
-        if (ACI_STATUS_ERROR_PEER_ATT_ERROR != aci_evt->params.pipe_error.error_code)
-        {
-          aci_state.data_credit_available++;
-        }
         break;
       
       case ACI_EVT_HW_ERROR:
@@ -591,16 +530,14 @@ void aci_loop()
         
         //Manage the bond in EEPROM of the AVR
         {
-          uint8_t eeprom_status = 0;
-          eeprom_status = EEPROM.read(0);
-          if (eeprom_status != 0x00)
+          if (0 != aci_bond_store_msg_count())
           {
             Serial.println(F("Previous Bond present. Restoring"));
             Serial.println(F("Using existing bond stored in EEPROM."));
             Serial.println(F("   To delete the bond stored in EEPROM, connect Pin 6 to 3.3v and Reset."));
             Serial.println(F("   Make sure that the bond on the phone/PC is deleted as well."));
             //We must have lost power and restarted and must restore the bonding infromation using the ACI Write Dynamic Data
-            if (ACI_STATUS_TRANSACTION_COMPLETE == bond_data_restore(&aci_state, eeprom_status, &bonded_first_time))
+            if (ACI_STATUS_TRANSACTION_COMPLETE == bond_data_restore(&aci_state, &bonded_first_time))
             {
               Serial.println(F("Bond restored successfully"));
             }
@@ -717,14 +654,17 @@ void setup(void)
   lib_aci_init(&aci_state,false);
   aci_state.bonded = ACI_BOND_STATUS_FAILED;
   
+  aci_bond_store_init();
+
+  ancs_init(ancs_notification_rcvd, ancs_attribute_rcvd);
+
   pinMode(6, INPUT); //Pin #6 on Arduino -> PAIRING CLEAR pin: Connect to 3.3v to clear the pairing
   if (0x01 == digitalRead(6))
   {
     //Clear the pairing
     Serial.println(F("Pairing/Bonding info cleared from EEPROM."));
     Serial.println(F("Remove the wire on Pin 6 and reset the board for normal operation."));
-    //Address. Value
-    EEPROM.write(0, 0);
+    aci_bond_store_clear();
     while(1) {};
   }  
 }
@@ -733,6 +673,12 @@ void setup(void)
 void loop()
 {
   aci_loop();
+
+  //Writes the bond to the EEPROM a byte at a time, when built with ACI_BOND_STORE_STAGING
+  aci_bond_store_commit_poll();
+
+  //Asks the phone for the attributes of the next notification
+  ancs_poll(&aci_state);
 }
 
 
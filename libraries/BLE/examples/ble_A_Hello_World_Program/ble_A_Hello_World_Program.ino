@@ -219,10 +219,6 @@ bool uart_tx(uint8_t *buffer, uint8_t buffer_len)
       (aci_state.data_credit_available >= 1))
   {
     status = lib_aci_send_data(PIPE_UART_OVER_BTLE_UART_TX_TX, buffer, buffer_len);
-    if (status)
-    {
-      aci_state.data_credit_available--;
-    }
   }
 
   return status;
@@ -448,7 +444,7 @@ void aci_loop()
         break;
 
       case ACI_EVT_DATA_CREDIT:
-        aci_state.data_credit_available = aci_state.data_credit_available + aci_evt->params.data_credit.credit;
+        //aci_state.data_credit_available is updated by the ACI Library
         break;
 
       case ACI_EVT_PIPE_ERROR:
@@ -457,14 +453,6 @@ void aci_loop()
         Serial.print(aci_evt->params.pipe_error.pipe_number, DEC);
         Serial.print(F("  Pipe Error Code: 0x"));
         Serial.println(aci_evt->params.pipe_error.error_code, HEX);
-
-        //Increment the credit available as the data packet was not sent.
-        //The pipe error also represents the Attribute protocol Error Response sent from the peer and that should not be counted
-        //for the credit.
-        if (ACI_STATUS_ERROR_PEER_ATT_ERROR != aci_evt->params.pipe_error.error_code)
-        {
-          aci_state.data_credit_available++;
-        }
         break;
 
       case ACI_EVT_HW_ERROR:
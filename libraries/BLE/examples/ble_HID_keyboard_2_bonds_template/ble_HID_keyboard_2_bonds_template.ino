@@ -37,6 +37,7 @@ The project will run correctly in its current state.
 This will show the Arduino board as a HID Keybaord to the Win 8.
 After HID Keyboard has been bonded with Win 8.
 The letter 'A' is sent to the Win 8 every 4 seconds.
+The text typed in the Serial Monitor is typed on the Win 8 as well, in the US layout, up to six keys in a report.
 With this project you have a starting point for adding your own application functionality.
 
 The following instructions describe the steps to be made on the Windows PC:
@@ -51,7 +52,8 @@ Note:
 Pin #6 on Arduino -> PAIRING CLEAR pin: Connect to 3.3v to clear the pairing
 Pin #2 on Arduino -> Add new bond pin: Connect to 3.3v to add a new bond.
 
-The bonding information is stored in the EEPROM of the ATmega328 in the Arduino UNO
+The bonding information is stored in the EEPROM of the ATmega328 in the Arduino UNO by aci_bond_store,
+one bond per peer, ACI_BOND_STORE_BONDS of them. A new bond with a peer already stored replaces its old bond.
 
 The setup() and the loop() functions are the equvivlent of main() .
 
@@ -61,7 +63,8 @@ The setup() and the loop() functions are the equvivlent of main() .
 
 #include <lib_aci.h>
 #include "aci_setup.h"
-#include "EEPROM.h"
+#include <aci_bond_store.h>
+#include <aci_hid_report.h>
 
 #ifdef SERVICES_PIPE_TYPE_MAPPING_CONTENT
     static services_pipe_type_mapping_t
@@ -73,8 +76,6 @@ The setup() and the loop() functions are the equvivlent of main() .
 
 static hal_aci_data_t setup_msgs[NB_SETUP_MESSAGES] PROGMEM = SETUP_MESSAGES_CONTENT;
 
-#define BYTES_PER_BOND_IN_HEADER       2
-#define BONDS_MAX                      2
 #define BOND_DOES_NOT_EXIST_AT_INDEX   0xF0
 
 
@@ -91,14 +92,13 @@ static hal_aci_data_t setup_msgs[NB_SETUP_MESSAGES] PROGMEM = SETUP_MESSAGES_CON
 // Status of the bond (R) Peer address
 static struct aci_state_t aci_state;
 static hal_aci_evt_t aci_data;
-static hal_aci_data_t aci_cmd;
 
 /*
 We will store the bonding info for the nRF8001 in the MCU to recover from a power loss situation
 */
-static uint8_t bond_number          = 0;
-static uint8_t current_bond_index   = 0xFF;
-static uint16_t eeprom_write_offset = BONDS_MAX * BYTES_PER_BOND_IN_HEADER;
+static uint8_t current_bond_index   = ACI_BOND_STORE_NO_BOND; //Bond restored in the nRF8001
+static bool    current_bond_valid   = false;
+static uint8_t peer_address[BTLE_DEVICE_ADDRESS_SIZE];      //Address of the peer of the last connection
 
 /*
 We will do the timing change for the link only once
@@ -121,8 +121,20 @@ The keyboard report is 8 bytes
 5 Keycode 4
 6 Keycode 5
 7 Keycode 6
+The reports are queued by aci_hid_report and sent as the data credits come back
 */
-uint8_t keypressA[8]={ 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00 };
+static const aci_hid_report_params_t hid_report_params =
+{
+  PIPE_HID_SERVICE_HID_REPORT_TX,
+  8,
+  0 // As many reports in a connection interval as there are data credits for
+};
+static aci_hid_report_queue_t hid_report_queue;
+
+/*
+The text of the Serial Monitor is typed by aci_hid_text, up to ACI_HID_TEXT_KEYS keys in a report
+*/
+static aci_hid_text_t hid_text;
 
 /*** FUNC
 
@@ -216,134 +228,78 @@ The loop/setup functions is the equivalent of the main() function
 Read the Dymamic data from the EEPROM and send then as ACI Write Dynamic Data to the nRF8001
 This will restore the nRF8001 to the situation when the Dynamic Data was Read out
 
-Header in the EEPROM:
-2 bytes are used in the header for each master the nRF8001 has bonded with.
-The code supports 2 masters so the header uses 4 bytes.
-
-Byte 0:
-Bit 0  :Valid
-Bit 1-7:Number of messages for restore
-Byte 1:
-Bit 0-7: Offset in EEPROM bytes to the ACI msg stored
-Byte 2:
-Bit 0  :Valid
-Bit 1-7:Number of messages for restore
-Byte 3:
-Bit 0-7: Offset in EEPROM bytes to the ACI msg stored
-
-bond_index : The index of the stored bonds in the EEPROM. Value: 0 or 1, when max 2 bonds can be stored.
+bond_index : The index of the stored bond, 0 to ACI_BOND_STORE_BONDS - 1.
+The index of aci_bond_store is in RAM, the record of the bond is read directly.
 */
 aci_status_code_t bond_data_restore(aci_state_t *aci_stat, uint8_t bond_index)
 {
-  aci_evt_t *aci_evt;
-  uint8_t eeprom_status       = 0;
-  uint16_t eeprom_offset_read = 0;
-  uint8_t write_dyn_num_msgs  = 0;
-  uint8_t len =0;
-
-  eeprom_status      = EEPROM.read(bond_index * BYTES_PER_BOND_IN_HEADER);
-  if (eeprom_status == 0xFF)
+  uint8_t result;
+
+  aci_bond_store_select(bond_index);
+  //Send the ACI Write Dynamic Data commands read from the EEPROM
+  //The command queue is kept filled with them, as for the setup
+  result = aci_bond_store_restore(aci_stat);
+  if (ACI_BOND_STORE_RESTORE_NO_BOND == result)
   {
     return (aci_status_code_t)BOND_DOES_NOT_EXIST_AT_INDEX;
   }
-
-  eeprom_offset_read = EEPROM.read((bond_index * BYTES_PER_BOND_IN_HEADER) + 1); //Offset from the start of the EEPROM
-  //Since the size of the header is 4 bytes for 2 bonds. The first bond is stored from location 4 and the offset is 4.
-
-  //Print the EEPROM header of 4 bytes
-  Serial.println(F("EEPROM Header (4 bytes):"));
-  Serial.println(EEPROM.read(0), HEX);
-  Serial.println(EEPROM.read(1), HEX);
-  Serial.println(EEPROM.read(2), HEX);
-  Serial.println(EEPROM.read(3), HEX);
-  Serial.println(F("--"));
-
-  // Get the number of messages to write for the eeprom_status
-  write_dyn_num_msgs = eeprom_status & 0x7F;
-
-  //Read from the EEPROM
-  while(1)
+  if (ACI_BOND_STORE_RESTORE_SUCCESS != result)
   {
-    len = EEPROM.read(eeprom_offset_read);
-
-    eeprom_offset_read++;
-    aci_cmd.buffer[0] = len;
-
-    for (uint8_t i=1; i<=len; i++)
-    {
-      aci_cmd.buffer[i] = EEPROM.read(eeprom_offset_read);
-      eeprom_offset_read++;
-    }
+    Serial.print(F("bond_data_restore: Failed: "));
+    Serial.println(result, DEC);
+    return ACI_STATUS_ERROR_INTERNAL;
+  }
+  return ACI_STATUS_TRANSACTION_COMPLETE;
+}
 
-    //@todo : Fix this bug that is changing this byte
-    aci_cmd.buffer[1] = ACI_CMD_WRITE_DYNAMIC_DATA;
+/*
+Next stored bond after bond_index, taken from the bitmap of aci_bond_store.
+Returns ACI_BOND_STORE_NO_BOND when no bond is stored.
+*/
+uint8_t bond_next(uint8_t bond_index)
+{
+  const uint8_t bonds = aci_bond_store_bonds();
 
-    //Send the ACI Write Dynamic Data
-    if (!hal_aci_tl_send(&aci_cmd))
+  for (uint8_t i = 1; i <= ACI_BOND_STORE_BONDS; i++)
+  {
+    uint8_t bond = (uint8_t)((bond_index + i) % ACI_BOND_STORE_BONDS);
+    if (bonds & (1 << bond))
     {
-      Serial.println(F("bond_data_restore: Cmd Q Full"));
-      return ACI_STATUS_ERROR_INTERNAL;
-    }
-
-    //Spin in the while loop waiting for an event
-    while (1)
-    {
-      if (lib_aci_event_get(aci_stat, &aci_data))
-      {
-        aci_evt = &aci_data.evt;
-
-        if (ACI_EVT_CMD_RSP != aci_evt->evt_opcode)
-        {
-          //Got something other than a command response evt -> Error
-          Serial.print(F("bond_data_restore: Expected cmd rsp evt. Got: 0x"));
-          Serial.println(aci_evt->evt_opcode, HEX);
-          return ACI_STATUS_ERROR_INTERNAL;
-        }
-        else
-        {
-          write_dyn_num_msgs--;
-
-          //ACI Evt Command Response
-          if (ACI_STATUS_TRANSACTION_COMPLETE == aci_evt->params.cmd_rsp.cmd_status)
-          {
-            return ACI_STATUS_TRANSACTION_COMPLETE;
-          }
-          if (0 >= write_dyn_num_msgs)
-          {
-            //should have returned earlier
-            return ACI_STATUS_ERROR_INTERNAL;
-          }
-          if (ACI_STATUS_TRANSACTION_CONTINUE == aci_evt->params.cmd_rsp.cmd_status)
-          {
-            //break and write the next ACI Write Dynamic Data
-            break;
-          }
-        }
-      }
+      return bond;
     }
   }
+  return ACI_BOND_STORE_NO_BOND;
 }
 
-
 /*
-This function is specific to the atmega328
-@params ACI Command Response Evt received from the Read Dynmaic Data
-Uses the global   static int eeprom_write_offset to track the EEPROM write offset
+Restores the next stored bond in the nRF8001.
+Returns false when no bond is stored.
 */
-void bond_data_store(aci_evt_t *evt)
+bool bond_restore_next(void)
 {
-  //Write it to non-volatile storage
-  EEPROM.write( eeprom_write_offset, evt->len -2 );
-  eeprom_write_offset++;
+  uint8_t bond = bond_next((ACI_BOND_STORE_NO_BOND == current_bond_index) ? (ACI_BOND_STORE_BONDS - 1) : current_bond_index);
 
-  EEPROM.write( eeprom_write_offset, ACI_CMD_WRITE_DYNAMIC_DATA);
-  eeprom_write_offset++;
+  if (ACI_BOND_STORE_NO_BOND == bond)
+  {
+    current_bond_index = ACI_BOND_STORE_NO_BOND;
+    current_bond_valid = false;
+    return false;
+  }
 
-  for (uint8_t i=0; i< (evt->len-3); i++)
+  Serial.print(F("Previous Bond present. Restoring bond "));
+  Serial.println(bond);
+  //We must have lost power and restarted and must restore the bonding infromation using the ACI Write Dynamic Data
+  current_bond_index = bond;
+  current_bond_valid = (ACI_STATUS_TRANSACTION_COMPLETE == bond_data_restore(&aci_state, bond));
+  if (current_bond_valid)
+  {
+    Serial.println(F("Bond restored successfully"));
+  }
+  else
   {
-    EEPROM.write( eeprom_write_offset, evt->params.cmd_rsp.params.padding[i]);
-    eeprom_write_offset++;
+    Serial.println(F("Bond restore failed"));
   }
+  return true;
 }
 
 bool bond_data_read_store(aci_state_t *aci_stat, uint8_t new_bond_index)
@@ -351,14 +307,16 @@ bool bond_data_read_store(aci_state_t *aci_stat, uint8_t new_bond_index)
   /*
   The size of the dynamic data for a specific Bluetooth Low Energy configuration
   is present in the ublue_setup.gen.out.txt generated by the nRFgo studio as "dynamic data size".
+  aci_bond_store only writes the EEPROM bytes that changed, nothing when the bond is the same.
   */
   bool status = false;
   aci_evt_t * aci_evt = NULL;
-  uint8_t read_dyn_num_msgs = 0;
 
   //Start reading the dynamic data
+  aci_bond_store_select(new_bond_index);
+  aci_bond_store_save_start();
+  aci_bond_store_save_peer(peer_address);
   lib_aci_read_dynamic_data();
-  read_dyn_num_msgs++;
 
   while (1)
   {
@@ -377,25 +335,15 @@ bool bond_data_read_store(aci_state_t *aci_stat, uint8_t new_bond_index)
       {
         //Store the contents of the command response event in the EEPROM
         //(len, cmd, seq-no, data) : cmd ->Write Dynamic Data so it can be used directly
-        bond_data_store(aci_evt);
-
-        //Set the flag in the EEPROM that the contents of the EEPROM is valid
-        EEPROM.write(new_bond_index * BYTES_PER_BOND_IN_HEADER, 0x80|read_dyn_num_msgs );
-        //Set the offset for the next bond as well
-        EEPROM.write(((new_bond_index+1) * BYTES_PER_BOND_IN_HEADER)+1, eeprom_write_offset);
-
+        //and commit the record, the last one of the bond stays in use if anything goes wrong
+        status = aci_bond_store_save_msg(aci_evt) && aci_bond_store_save_end();
         //Finished with reading the dynamic data
-        status = true;
-
         break;
       }
 
       if (!(ACI_STATUS_TRANSACTION_CONTINUE == aci_evt->params.cmd_rsp.cmd_status))
       {
         //We failed the read dymanic data
-        //Set the flag in the EEPROM that the contents of the EEPROM is invalid
-        EEPROM.write(new_bond_index * BYTES_PER_BOND_IN_HEADER, 0xFF);
-
         status = false;
         break;
       }
@@ -403,11 +351,14 @@ bool bond_data_read_store(aci_state_t *aci_stat, uint8_t new_bond_index)
       {
         //Store the contents of the command response event in the EEPROM
         // (len, cmd, seq-no, data) : cmd ->Write Dynamic Data so it can be used directly when re-storing the dynamic data
-        bond_data_store(aci_evt);
+        if (!aci_bond_store_save_msg(aci_evt))
+        {
+          status = false;
+          break;
+        }
 
         //Read the next dynamic data message
         lib_aci_read_dynamic_data();
-        read_dyn_num_msgs++;
       }
 
     }
@@ -426,6 +377,10 @@ void aci_loop()
     aci_evt_t * aci_evt;
     aci_evt = &aci_data.evt;
 
+    //Sends the queued HID reports as the credits come back
+    aci_hid_report_event(&hid_report_queue, &aci_state, aci_evt);
+    aci_hid_text_event(&hid_text, aci_evt);
+
     switch(aci_evt->evt_opcode)
     {
         case ACI_EVT_DEVICE_STARTED:
@@ -450,42 +405,9 @@ void aci_loop()
               }
               else
               {
-                //Manage the bond in EEPROM of the AVR
-                {
-                  uint8_t eeprom_status = 0;
-
-                  //Reset the number of bonds and count from the EEPROM header
-                  bond_number = 0;
-                  eeprom_status = EEPROM.read(0);
-                  if (eeprom_status != 0xFF)
-                  {
-                    bond_number++;
-                    //Update the write offset to the correct number
-                    eeprom_write_offset = EEPROM.read(bond_number * BYTES_PER_BOND_IN_HEADER + 1);
-                    if (EEPROM.read(2) != 0xFF)
-                    {
-                      bond_number++;
-                      //This is needed only if we wanted to add a 3rd bond
-                      eeprom_write_offset = EEPROM.read(bond_number * BYTES_PER_BOND_IN_HEADER + 1);
-                    }
-                    //bond 0
-                    current_bond_index = 0;
-                    Serial.println(F("Previous Bond present. Restoring bond 0"));
-                    //We must have lost power and restarted and must restore the bonding infromation using the ACI Write Dynamic Data
-                    if (ACI_STATUS_TRANSACTION_COMPLETE == bond_data_restore(&aci_state, current_bond_index))
-                    {
-                      Serial.println(F("Bond 0 restored successfully"));
-                      current_bond_index++;
-                    }
-                    else
-                    {
-                      Serial.println(F("Bond 0 restore failed"));
-                    }
-                  }
-                }
-
-                // Start bonding if no bonds are available
-                if (bond_number == 0)
+                //Restore the first bond stored in the EEPROM of the AVR, start bonding if there is none
+                current_bond_index = ACI_BOND_STORE_NO_BOND;
+                if (!bond_restore_next())
                 {
                   lib_aci_bond(180/* in seconds */, 0x0050 /* advertising interval 50ms*/);
                   Serial.println(F("Advertising started : Waiting to be connected and bonded"));
@@ -532,6 +454,8 @@ void aci_loop()
         */
         aci_state.data_credit_available = aci_state.data_credit_total;
         Serial.println(F("Evt Connected"));
+        //The peer address tells which bond to store after the disconnection
+        memcpy(peer_address, aci_evt->params.connected.dev_addr, BTLE_DEVICE_ADDRESS_SIZE);
         /*
          Get the Device Version of the nRF8001 and place it in the
          Hardware Revision String Characteristic of the Device Info. GATT Service
@@ -563,7 +487,7 @@ void aci_loop()
         Bluetooth Radio ack received from the peer radio for the data packet sent.
         Multiple data packets can be acked in a single aci data credit event.
         */
-        aci_state.data_credit_available = aci_state.data_credit_available + aci_evt->params.data_credit.credit;
+        //aci_state.data_credit_available is updated by the ACI Library
         break;
 
       case ACI_EVT_PIPE_ERROR:
@@ -572,14 +496,6 @@ void aci_loop()
         Serial.print(aci_evt->params.pipe_error.pipe_number, DEC);
         Serial.print(F("  Pipe Error Code: 0x"));
         Serial.println(aci_evt->params.pipe_error.error_code, HEX);
-
-        //Increment the credit available as the data packet was not sent.
-        //The pipe error also represents the Attribute protocol Error Response sent from the peer and that should not be counted
-        //for the credit.
-        if (ACI_STATUS_ERROR_PEER_ATT_ERROR != aci_evt->params.pipe_error.error_code)
-        {
-          aci_state.data_credit_available++;
-        }
         break;
 
       case ACI_EVT_BOND_STATUS:
@@ -596,62 +512,53 @@ void aci_loop()
         */
         if(ACI_STATUS_ERROR_ADVT_TIMEOUT == aci_evt->params.disconnected.aci_status)
         {
-          aci_status_code_t bond_restore_status;
-
-          Serial.print(F("Previous Bond present. Restoring bond "));
-
-          //We must have lost power and restarted and must restore the bonding infromation using the ACI Write Dynamic Data
-          //Switch to the next bond
-          Serial.println(current_bond_index);
-          if (current_bond_index >= BONDS_MAX)
-          {
-            current_bond_index = 0;
-          }
-          bond_restore_status = bond_data_restore(&aci_state, current_bond_index);
-          current_bond_index++;
-
-          if (ACI_STATUS_TRANSACTION_COMPLETE == bond_restore_status)
-          {
-            Serial.println(F("Bond restored successfully"));
-          }
-          if (BOND_DOES_NOT_EXIST_AT_INDEX == bond_restore_status)
-          {
-            Serial.println(F("Bond does not exist"));
-            current_bond_index = 0;
-          }
+          //Switch to the next bond, the bonds stored are in the bitmap of aci_bond_store
+          bond_restore_next();
         }
         else
         {
+          uint8_t bond_index = ACI_BOND_STORE_NO_BOND;
+
           if (ACI_BOND_STATUS_SUCCESS == aci_state.bonded) //Were bonded in the just disconnected connection.
           {
             aci_state.bonded = ACI_BOND_STATUS_FAILED;
+            //A new bond with a peer already stored replaces its bond, else a free bond is used
+            bond_index = aci_bond_store_find(peer_address);
+            if (ACI_BOND_STORE_NO_BOND == bond_index)
+            {
+              bond_index = aci_bond_store_free();
+            }
+          }
+          else if (current_bond_valid)
+          {
+            //Reconnected with the bond restored, e.g. the peer may have written a CCCD
+            bond_index = current_bond_index;
+          }
+
+          if (ACI_BOND_STORE_NO_BOND != bond_index)
+          {
             //Store away the dynamic data of the nRF8001 in the Flash or EEPROM of the MCU
             // so we can restore the bond information of the nRF8001 in the event of power loss
-            //Update the header offset with the previous value of the eeprom_write_offset
-            EEPROM.write((bond_number * BYTES_PER_BOND_IN_HEADER)+ 1, eeprom_write_offset );
-
-            Serial.println(F("eeprom_write_offset"));
-            Serial.println(eeprom_write_offset);
-            Serial.println(F("bond_number"));
-            Serial.println(bond_number);
-
-
-            // pass the bond_number before increment to use it as an index
-            if (bond_data_read_store(&aci_state, bond_number))
+            //It is stored after every disconnect, only the bytes that changed are written to the EEPROM
+            Serial.print(F("Storing bond "));
+            Serial.println(bond_index);
+            if (bond_data_read_store(&aci_state, bond_index))
             {
-              bond_number++;
+              current_bond_index = bond_index;
+              current_bond_valid = true;
               Serial.println(F("Dynamic Data read and stored successfully"));
             }
           }
         }
 
         //If a new bond is to be added, PIN 2 must tbe high or no bond exists
-        if (0x01 == digitalRead(2) || (0 == bond_number))
+        if (0x01 == digitalRead(2) || (0 == aci_bond_store_bonds()))
         {
           //Start bonding
-          //Less than 2 bonds. We can add one more
-          if (bond_number < BONDS_MAX)
+          //A bond is free. We can add one more
+          if (ACI_BOND_STORE_NO_BOND != aci_bond_store_free())
           {
+            current_bond_valid = false;
             // Previous bonding failed. Try to bond again.
             lib_aci_bond(180/* in seconds */, 0x0050 /* advertising interval 50ms*/);
             Serial.println(F("Advertising started : Waiting to be connected and bonded for a new bond to be added"));
@@ -691,42 +598,9 @@ void aci_loop()
         }
         Serial.println();
 
-        //Manage the bond in EEPROM of the AVR
-        {
-          uint8_t eeprom_status = 0;
-
-          //Reset the number of bonds and count from the EEPROM header
-          bond_number = 0;
-          eeprom_status = EEPROM.read(0);
-          if (eeprom_status != 0xFF)
-          {
-            bond_number++;
-            //Update the write offset to the correct number
-            eeprom_write_offset = EEPROM.read(bond_number * BYTES_PER_BOND_IN_HEADER + 1);
-            if (EEPROM.read(2) != 0xFF)
-            {
-              bond_number++;
-              //This is needed only if we wanted to add a 3rd bond
-              eeprom_write_offset = EEPROM.read(bond_number * BYTES_PER_BOND_IN_HEADER + 1);
-            }
-            //bond 0
-            current_bond_index = 0;
-            Serial.println(F("Previous Bond present. Restoring bond 0"));
-            //We must have lost power and restarted and must restore the bonding infromation using the ACI Write Dynamic Data
-            if (ACI_STATUS_TRANSACTION_COMPLETE == bond_data_restore(&aci_state, current_bond_index))
-            {
-              Serial.println(F("Bond 0 restored successfully"));
-              current_bond_index++;
-            }
-            else
-            {
-              Serial.println(F("Bond 0 restore failed"));
-            }
-          }
-        }
-
-        // Start bonding if no bonds are available
-        if (bond_number == 0)
+        //Restore the first bond stored in the EEPROM of the AVR, start bonding if there is none
+        current_bond_index = ACI_BOND_STORE_NO_BOND;
+        if (!bond_restore_next())
         {
           lib_aci_bond(180/* in seconds */, 0x0050 /* advertising interval 50ms*/);
           Serial.println(F("Advertising started : Waiting to be connected and bonded"));
@@ -822,6 +696,11 @@ void setup(void)
   //The second parameter is for turning debug printing on for the ACI Commands and Events so they be printed on the Serial
   lib_aci_init(&aci_state, false);
 
+  aci_hid_report_init(&hid_report_queue, &hid_report_params);
+  aci_hid_text_init(&hid_text, &hid_report_queue);
+
+  aci_bond_store_init();
+
   //Initialize the state variables
   aci_state.bonded   = ACI_BOND_STATUS_FAILED;
   disconnect_started = false;
@@ -833,11 +712,7 @@ void setup(void)
   {
     //Clear the pairing
     Serial.println(F("Pairing cleared. Remove the wire on Pin 6 and reset the board for normal operation."));
-    //Address. Value
-    EEPROM.write(0, 0xFF);
-    EEPROM.write(1, 0xFF);
-    EEPROM.write(2, 0xFF);
-    EEPROM.write(3, 0xFF);
+    aci_bond_store_clear();
     while(1) {};
   }
 }
@@ -849,21 +724,28 @@ void loop(void)
 
   aci_loop();
 
+  //Writes the bond to the EEPROM a byte at a time, when built with ACI_BOND_STORE_STAGING
+  aci_bond_store_commit_poll();
+
   /*
   Method for sending HID Reports
+  The keys are packed into reports by aci_hid_text, aci_hid_report sends them in order as the credits come back
   */
-  if (lib_aci_is_pipe_available(&aci_state, PIPE_HID_SERVICE_HID_REPORT_TX)
-      && (aci_state.data_credit_available == 2)
-      && (1 == timer1_f) )
+  if (lib_aci_is_pipe_available(&aci_state, PIPE_HID_SERVICE_HID_REPORT_TX))
   {
-    timer1_f = 0;
-    keypressA[2] = 0x04;
-    lib_aci_send_data(PIPE_HID_SERVICE_HID_REPORT_TX, &keypressA[0], 8);
-    aci_state.data_credit_available--;
-    keypressA[2] = 0x00;
-    lib_aci_send_data(PIPE_HID_SERVICE_HID_REPORT_TX, &keypressA[0], 8);
-    aci_state.data_credit_available--;
+    if ((1 == timer1_f) && aci_hid_text_putc(&hid_text, 'a'))
+    {
+      timer1_f = 0;
+    }
+
+    //Type the text from the Serial Monitor, as fast as the link takes it
+    while ((0 != Serial.available()) && aci_hid_text_putc(&hid_text, (char)Serial.peek()))
+    {
+      Serial.read();
+    }
   }
+  aci_hid_text_poll(&hid_text);
+  aci_hid_report_poll(&hid_report_queue, &aci_state);
   
   if (0x01 == digitalRead(2) && (disconnect_started == false))
   {
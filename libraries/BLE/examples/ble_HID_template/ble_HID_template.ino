@@ -61,6 +61,7 @@ The setup() and the loop() functions are the equvivlent of main() .
 #include "services.h"
 #include <lib_aci.h>
 #include "aci_setup.h"
+#include <aci_hid_report.h>
 #include "EEPROM.h"
 
 #ifdef SERVICES_PIPE_TYPE_MAPPING_CONTENT
@@ -100,6 +101,32 @@ Joystick
 static uint16_t x_initial;
 static uint16_t y_initial;
 
+/*
+The joystick report (Report ID 1) is 3 bytes
+0 Z axis
+1 Y axis
+2 X axis
+The axes are positions, aci_hid_motion sends the last one once per connection event.
+For a mouse report the moves would be summed instead, with absolute set to false.
+*/
+uint8_t joystick_report_encode(const aci_hid_motion_report_t *p_motion, uint8_t *p_report)
+{
+  p_report[0] = (uint8_t)p_motion->wheel; //Z axis
+  p_report[1] = (uint8_t)p_motion->y;
+  p_report[2] = (uint8_t)p_motion->x;
+  return 3;
+}
+
+static const aci_hid_motion_params_t joystick_params =
+{
+  PIPE_HID_SERVICE_HID_REPORT_ID1_TX,
+  true, // absolute
+  0,
+  0,
+  joystick_report_encode
+};
+static aci_hid_motion_t joystick;
+
 static bool timing_change_done = false;
 
 /* Define how assert should function in the BLE library */
@@ -296,6 +323,9 @@ void aci_loop()
     aci_evt_t * aci_evt;
     aci_evt = &aci_data.evt;
 
+    //Sends the joystick report as the credit comes back
+    aci_hid_motion_event(&joystick, &aci_state, aci_evt);
+
     switch(aci_evt->evt_opcode)
     {
       case ACI_EVT_DEVICE_STARTED:
@@ -429,7 +459,7 @@ void aci_loop()
         Bluetooth Radio ack received from the peer radio for the data packet sent.
         Multiple data packets can be acked in a single aci data credit event.
         */
-        aci_state.data_credit_available = aci_state.data_credit_available + aci_evt->params.data_credit.credit;
+        //aci_state.data_credit_available is updated by the ACI Library
         break;
 
       case ACI_EVT_PIPE_ERROR:
@@ -438,14 +468,6 @@ void aci_loop()
         Serial.print(aci_evt->params.pipe_error.pipe_number, DEC);
         Serial.print(F("  Pipe Error Code: 0x"));
         Serial.println(aci_evt->params.pipe_error.error_code, HEX);
-
-        //Increment the credit available as the data packet was not sent.
-        //The pipe error also represents the Attribute protocol Error Response sent from the peer and that should not be counted
-        //for the credit.
-        if (ACI_STATUS_ERROR_PEER_ATT_ERROR != aci_evt->params.pipe_error.error_code)
-        {
-          aci_state.data_credit_available++;
-        }
         break;
 
       case ACI_EVT_BOND_STATUS:
@@ -657,6 +679,8 @@ void setup(void)
   //The second parameter is for turning debug printing on for the ACI Commands and Events so they be printed on the Serial
   lib_aci_init(&aci_state, false);
 
+  aci_hid_motion_init(&joystick, &joystick_params);
+
   pinMode(6, INPUT); //Pin #6 on Arduino -> PAIRING CLEAR pin: Connect to 3.3v to clear the pairing
   if (0x01 == digitalRead(6))
   {
@@ -681,19 +705,13 @@ void loop(void)
 
   /*
   Method for sending HID Reports
+  The joystick is read on every loop, only its last position is sent, one report per connection event
   */
-  if (lib_aci_is_pipe_available(&aci_state, PIPE_HID_SERVICE_HID_REPORT_ID1_TX)
-      && (aci_state.data_credit_available > 0) )
+  if (lib_aci_is_pipe_available(&aci_state, PIPE_HID_SERVICE_HID_REPORT_ID1_TX))
   {
-    uint8_t joy[3] = {0, 0, 0};
-
-    joy[0] = 0;                  //Z axis
-    joy[1] = analogRead(1) << 4; //Y axis
-    joy[2] = analogRead(0) << 4; //X axis
-
-    lib_aci_send_data(PIPE_HID_SERVICE_HID_REPORT_ID1_TX, &joy[0], 3);
-    aci_state.data_credit_available--;
+    aci_hid_motion_position(&joystick, analogRead(0) >> 2 /* X axis */, analogRead(1) >> 2 /* Y axis */, 0);
   }
+  aci_hid_motion_poll(&joystick, &aci_state);
 
 }
 
@@ -419,7 +419,7 @@ void aci_loop()
         Bluetooth Radio ack received from the peer radio for the data packet sent.
         Multiple data packets can be acked in a single aci data credit event.
         */
-        aci_state.data_credit_available = aci_state.data_credit_available + aci_evt->params.data_credit.credit;
+        //aci_state.data_credit_available is updated by the ACI Library
         break;
 
       case ACI_EVT_PIPE_ERROR:
@@ -428,14 +428,6 @@ void aci_loop()
         Serial.print(aci_evt->params.pipe_error.pipe_number, DEC);
         Serial.print(F("  Pipe Error Code: 0x"));
         Serial.println(aci_evt->params.pipe_error.error_code, HEX);
-
-        //Increment the credit available as the data packet was not sent.
-        //The pipe error also represents the Attribute protocol Error Response sent from the peer and that should not be counted
-        //for the credit.
-        if (ACI_STATUS_ERROR_PEER_ATT_ERROR != aci_evt->params.pipe_error.error_code)
-        {
-          aci_state.data_credit_available++;
-        }
         break;
 
       case ACI_EVT_BOND_STATUS:
@@ -679,7 +671,6 @@ void loop(void)
     joy[2] = analogRead(0) << 4; //X axis
 
     lib_aci_send_data(PIPE_HEART_RATE_HEART_RATE_MEASUREMENT_TX, &joy[0], 3);
-    aci_state.data_credit_available--;
   }
 }
 
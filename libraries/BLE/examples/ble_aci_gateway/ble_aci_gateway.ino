@@ -0,0 +1,116 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Raw ACI gateway for a PC
+ */
+
+/** @defgroup my_project my_project
+@{
+@ingroup projects
+@brief The nRF8001 driven by a PC over the serial port, see aci_gateway.h
+
+@details
+The sketch does not run the nRF8001 itself: the ACI commands framed by the PC are sent as they
+come, and the ACI events are framed back, up to ACI_GATEWAY_EVTS_PER_FRAME in a frame. The serial
+port runs at GATEWAY_BAUDRATE, 1 Mbaud on a 16 MHz AVR is 0% off.
+
+The PC program starts by sending an empty frame, the CRC of nothing, and waits for the frame that
+gives its credits. The nRF8001 is reset by hal_aci_tl_init(), its DeviceStartedEvent is the first
+event to the PC, which sends the Setup when it is in Setup mode.
+
+The interrupt interface is used, so the SPI transfers run while the loop moves the serial bytes.
+ */
+
+#include <SPI.h>
+#include <lib_aci.h>
+#include <aci_gateway.h>
+
+/*
+Baud rate of the serial port to the PC
+*/
+#define GATEWAY_BAUDRATE  1000000
+
+static struct aci_state_t aci_state;
+
+static aci_gateway_t gateway;
+
+static void gateway_write(const uint8_t *p_data, uint8_t length)
+{
+  Serial.write(p_data, length);
+}
+
+static int gateway_write_room(void)
+{
+  return Serial.availableForWrite();
+}
+
+static const aci_gateway_params_t gateway_params =
+{
+  gateway_write,
+  gateway_write_room,
+};
+
+void setup(void)
+{
+  Serial.begin(GATEWAY_BAUDRATE);
+  //Wait until the serial port is available (useful only for the Leonardo)
+  //As the Leonardo board is not reseted every time you open the Serial Monitor
+  #if defined (__AVR_ATmega32U4__)
+    while(!Serial)
+    {}
+  #endif
+
+  aci_gateway_init(&gateway, &gateway_params);
+
+  /*
+  Tell the ACI library, the MCU to nRF8001 pin connections.
+  The Active pin is optional and can be marked UNUSED
+  */
+  aci_state.aci_pins.board_name = BOARD_DEFAULT; //See board.h for details REDBEARLAB_SHIELD_V1_1 or BOARD_DEFAULT
+  aci_state.aci_pins.reqn_pin   = 9; //SS for Nordic board, 9 for REDBEARLAB_SHIELD_V1_1
+  aci_state.aci_pins.rdyn_pin   = 8; //3 for Nordic board, 8 for REDBEARLAB_SHIELD_V1_1
+  aci_state.aci_pins.mosi_pin   = MOSI;
+  aci_state.aci_pins.miso_pin   = MISO;
+  aci_state.aci_pins.sck_pin    = SCK;
+
+  aci_state.aci_pins.spi_clock_divider      = SPI_CLOCK_DIV8;//SPI_CLOCK_DIV8  = 2MHz SPI speed
+                                                             //SPI_CLOCK_DIV16 = 1MHz SPI speed
+
+  aci_state.aci_pins.reset_pin              = 4; //4 for Nordic board, UNUSED for REDBEARLAB_SHIELD_V1_1
+  aci_state.aci_pins.active_pin             = UNUSED;
+  aci_state.aci_pins.optional_chip_sel_pin  = UNUSED;
+
+  aci_state.aci_pins.interface_is_interrupt = true;
+  aci_state.aci_pins.interrupt_number       = 1;
+
+  //The debug printing must stay off, the serial port carries the frames
+  hal_aci_tl_init(&(aci_state.aci_pins), false);
+}
+
+void loop()
+{
+  while (Serial.available() > 0)
+  {
+    aci_gateway_put(&gateway, (uint8_t)Serial.read());
+  }
+  aci_gateway_poll(&gateway);
+}
@@ -33,6 +33,12 @@ This project is a test project to verify the SPI/ACI.
 The data in the ACI echo command send and the data
 received in the ACI echo event should be the same.
 
+The echoes are also a latency benchmark of the transport: ECHO_ROUNDS round trips, one at a time,
+for each payload size in echo_sizes, at each SPI clock in echo_spi_clocks, in polling mode and,
+with ECHO_BENCH_INTERRUPT set to 1, in interrupt mode. A CSV line per payload size gives the
+min, median, 99th percentile and max round trip in microseconds and the payload bytes moved per
+second, both ways. The median and the 99th percentile are rounded up to ECHO_LATENCY_UNIT_US steps.
+
 
  */
 
@@ -55,10 +61,51 @@ static struct aci_state_t aci_state;
 
 static hal_aci_evt_t aci_data;
 
-static uint8_t echo_data[] = { 0x00, 0xaa, 0x55, 0xff, 0x77, 0x55, 0x33, 0x22, 0x11, 0x44, 0x66, 0x88, 0x99, 0xbb, 0xdd, 0xcc, 0x00, 0xaa, 0x55, 0xff };
-static uint8_t aci_echo_cmd = 0;
+static uint8_t echo_data[ACI_ECHO_DATA_MAX_LEN] = { 0x00, 0xaa, 0x55, 0xff, 0x77, 0x55, 0x33, 0x22, 0x11, 0x44,
+                                                    0x66, 0x88, 0x99, 0xbb, 0xdd, 0xcc, 0x00, 0xaa, 0x55, 0xff,
+                                                    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x5a };
+
+/*
+Round trips per payload size, and the resolution of the median and the 99th percentile
+*/
+#define ECHO_ROUNDS           200
+#define ECHO_LATENCY_UNIT_US  8
+
+/*
+Set to 1 to run the benchmark in interrupt mode too.
+The RDYN pin must then be the pin of interrupt_number, e.g. pin 3 for the interrupt 1 on the UNO
+*/
+#define ECHO_BENCH_INTERRUPT  0
+
+typedef struct
+{
+  uint8_t  divider;
+  uint16_t khz;  // At 16 MHz
+} echo_spi_t;
+
+static const uint8_t    echo_sizes[]      = { 1, 8, 16, 24, ACI_ECHO_DATA_MAX_LEN };
+static const echo_spi_t echo_spi_clocks[] = { { SPI_CLOCK_DIV8, 2000 }, { SPI_CLOCK_DIV16, 1000 }, { SPI_CLOCK_DIV32, 500 } };
 
-#define NUM_ECHO_CMDS 3
+#define ECHO_SIZES       (sizeof(echo_sizes) / sizeof(echo_sizes[0]))
+#define ECHO_SPI_CLOCKS  (sizeof(echo_spi_clocks) / sizeof(echo_spi_clocks[0]))
+
+typedef struct
+{
+  bool          running;
+  bool          interrupt;          // The transport runs in interrupt mode
+  uint8_t       spi;                // Index in echo_spi_clocks
+  uint8_t       size;               // Index in echo_sizes
+  uint16_t      round;
+  bool          in_flight;
+  unsigned long sent_us;
+  unsigned long start_us;           // First echo of the payload size
+  uint32_t      min_us;
+  uint32_t      max_us;
+  uint16_t      errors;             // Echoes that came back different
+  uint8_t       latency[ECHO_ROUNDS]; // In ECHO_LATENCY_UNIT_US, 255 for longer
+} echo_bench_t;
+
+static echo_bench_t echo_bench;
 
 /* Define how assert should function in the BLE library */
 void __ble_assert(const char *file, uint16_t line)
@@ -71,20 +118,12 @@ void __ble_assert(const char *file, uint16_t line)
   while(1);
 }
 
-void setup(void)
+/*
+Resets the nRF8001 and starts the transport in the mode of the benchmark, the nRF8001 is then put
+in Test mode again
+*/
+void transport_init()
 {
-  Serial.begin(115200);
-  //Wait until the serial port is available (useful only for the Leonardo)
-  //As the Leonardo board is not reseted every time you open the Serial Monitor
-  #if defined (__AVR_ATmega32U4__)
-    while(!Serial)
-    {}
-    delay(5000);  //5 seconds delay for enabling to see the start up comments on the serial board
-  #elif defined(__PIC32MX__)
-    delay(1000);
-  #endif
-  Serial.println(F("Arduino setup"));
-
   /*
   Tell the ACI library, the MCU to nRF8001 pin connections.
   The Active pin is optional and can be marked UNUSED
@@ -103,7 +142,7 @@ void setup(void)
   aci_state.aci_pins.active_pin             = UNUSED;
   aci_state.aci_pins.optional_chip_sel_pin  = UNUSED;
 
-  aci_state.aci_pins.interface_is_interrupt = false;
+  aci_state.aci_pins.interface_is_interrupt = echo_bench.interrupt;
   aci_state.aci_pins.interrupt_number       = 1;
 
   //The second parameter is for turning debug printing on for the ACI Commands and Events so they be printed on the Serial
@@ -111,6 +150,149 @@ void setup(void)
   Serial.println(F("nRF8001 Reset done"));
 }
 
+void echo_bench_header_print()
+{
+  Serial.println(F("mode,spi_khz,payload,rounds,min_us,median_us,p99_us,max_us,bytes_s,errors"));
+}
+
+void echo_bench_size_start()
+{
+  echo_bench.round     = 0;
+  echo_bench.in_flight = false;
+  echo_bench.min_us    = 0xFFFFFFFF;
+  echo_bench.max_us    = 0;
+  echo_bench.errors    = 0;
+  echo_bench.start_us  = micros();
+}
+
+void echo_bench_start()
+{
+  echo_bench.running = true;
+  echo_bench.spi     = 0;
+  echo_bench.size    = 0;
+  hal_aci_tl_spi_clock_set(echo_spi_clocks[0].divider);
+  echo_bench_size_start();
+}
+
+void echo_bench_print()
+{
+  const uint32_t elapsed_ms = (micros() - echo_bench.start_us) / 1000;
+  const uint32_t bytes = 2UL * echo_sizes[echo_bench.size] * ECHO_ROUNDS;
+  uint16_t i;
+  uint16_t j;
+
+  // Insertion sort of the latencies for the median and the 99th percentile
+  for (i = 1; i < ECHO_ROUNDS; i++)
+  {
+    const uint8_t latency = echo_bench.latency[i];
+
+    for (j = i; (j > 0) && (echo_bench.latency[j - 1] > latency); j--)
+    {
+      echo_bench.latency[j] = echo_bench.latency[j - 1];
+    }
+    echo_bench.latency[j] = latency;
+  }
+
+  Serial.print(echo_bench.interrupt ? F("interrupt,") : F("polling,"));
+  Serial.print(echo_spi_clocks[echo_bench.spi].khz);
+  Serial.print(',');
+  Serial.print(echo_sizes[echo_bench.size]);
+  Serial.print(',');
+  Serial.print(ECHO_ROUNDS);
+  Serial.print(',');
+  Serial.print(echo_bench.min_us);
+  Serial.print(',');
+  Serial.print((uint16_t)echo_bench.latency[ECHO_ROUNDS / 2] * ECHO_LATENCY_UNIT_US);
+  Serial.print(',');
+  Serial.print((uint16_t)echo_bench.latency[(ECHO_ROUNDS * 99UL) / 100] * ECHO_LATENCY_UNIT_US);
+  Serial.print(',');
+  Serial.print(echo_bench.max_us);
+  Serial.print(',');
+  Serial.print((0 == elapsed_ms) ? 0 : ((bytes * 1000) / elapsed_ms));
+  Serial.print(',');
+  Serial.println(echo_bench.errors);
+}
+
+/*
+Moves to the next payload size, SPI clock and mode
+*/
+void echo_bench_next()
+{
+  if (++echo_bench.size < ECHO_SIZES)
+  {
+    echo_bench_size_start();
+    return;
+  }
+  echo_bench.size = 0;
+
+  if (++echo_bench.spi < ECHO_SPI_CLOCKS)
+  {
+    hal_aci_tl_spi_clock_set(echo_spi_clocks[echo_bench.spi].divider);
+    echo_bench_size_start();
+    return;
+  }
+
+  echo_bench.running = false;
+  if (ECHO_BENCH_INTERRUPT && !echo_bench.interrupt)
+  {
+    // Started again from the Test mode event
+    echo_bench.interrupt = true;
+    transport_init();
+    return;
+  }
+  Serial.println(F("Echo benchmark done"));
+}
+
+void echo_received(const aci_evt_t *aci_evt)
+{
+  const uint32_t latency_us = micros() - echo_bench.sent_us;
+  const uint8_t size = echo_sizes[echo_bench.size];
+  const uint32_t latency_units = (latency_us + ECHO_LATENCY_UNIT_US - 1) / ECHO_LATENCY_UNIT_US;
+
+  echo_bench.in_flight = false;
+  if (((aci_evt->len - 1) != size) || (0 != memcmp(&echo_data[0], &(aci_evt->params.echo.echo_data[0]), size)))
+  {
+    Serial.println(F("Error: Echo loop test failed. Verify the SPI connectivity on the PCB."));
+    echo_bench.errors++;
+  }
+
+  if (latency_us < echo_bench.min_us)
+  {
+    echo_bench.min_us = latency_us;
+  }
+  if (latency_us > echo_bench.max_us)
+  {
+    echo_bench.max_us = latency_us;
+  }
+  echo_bench.latency[echo_bench.round] = (latency_units > 255) ? 255 : (uint8_t)latency_units;
+
+  if (++echo_bench.round == ECHO_ROUNDS)
+  {
+    echo_bench_print();
+    echo_bench_next();
+  }
+}
+
+void setup(void)
+{
+  Serial.begin(115200);
+  //Wait until the serial port is available (useful only for the Leonardo)
+  //As the Leonardo board is not reseted every time you open the Serial Monitor
+  #if defined (__AVR_ATmega32U4__)
+    while(!Serial)
+    {}
+    delay(5000);  //5 seconds delay for enabling to see the start up comments on the serial board
+  #elif defined(__PIC32MX__)
+    delay(1000);
+  #endif
+  Serial.println(F("Arduino setup"));
+
+  echo_bench.interrupt = false;
+  transport_init();
+}
+
+
+
 void loop()
 {
   // We enter the if statement only when there is a ACI event available to be processed
@@ -136,19 +318,15 @@ void loop()
             Serial.println(F("Evt Device Started: Standby"));
             break;
           case ACI_DEVICE_TEST:
-          {
-            uint8_t i = 0;
             Serial.println(F("Evt Device Started: Test"));
-            Serial.println(F("Started infinite Echo test"));
-            Serial.println(F("Repeat the test with all bytes in echo_data inverted."));
-            Serial.println(F("Waiting 4 seconds before the test starts...."));
-            delay(4000);
-            for(i=0; i<NUM_ECHO_CMDS; i++)
+            if (!echo_bench.interrupt)
             {
-              lib_aci_echo_msg(sizeof(echo_data), &echo_data[0]);
-              aci_echo_cmd++;
+              Serial.println(F("Started the Echo benchmark"));
+              Serial.println(F("Waiting 4 seconds before the test starts...."));
+              delay(4000);
+              echo_bench_header_print();
             }
-          }
+            echo_bench_start();
             break;
         }
       }
@@ -167,23 +345,9 @@ void loop()
         }
         break;
       case ACI_EVT_ECHO:
-        if (0 != memcmp(&echo_data[0], &(aci_evt->params.echo.echo_data[0]), sizeof(echo_data)))
-        {
-          Serial.println(F("Error: Echo loop test failed. Verify the SPI connectivity on the PCB."));
-        }
-        else
-        {
-          Serial.println(F("Echo OK"));
-        }
-        if (NUM_ECHO_CMDS == aci_echo_cmd)
+        if (echo_bench.running && echo_bench.in_flight)
         {
-          uint8_t i = 0;
-          aci_echo_cmd = 0;
-          for(i=0; i<NUM_ECHO_CMDS; i++)
-          {
-            lib_aci_echo_msg(sizeof(echo_data), &echo_data[0]);
-            aci_echo_cmd++;
-          }
+          echo_received(aci_evt);
         }
         break;
     }
@@ -194,5 +358,15 @@ void loop()
     // Arduino can go to sleep now
     // Wakeup from sleep from the RDYN line
   }
+
+  // One echo at a time, the round trip is timed from the command to the event
+  if (echo_bench.running && !echo_bench.in_flight)
+  {
+    echo_bench.sent_us = micros();
+    if (lib_aci_echo_msg(echo_sizes[echo_bench.size], &echo_data[0]))
+    {
+      echo_bench.in_flight = true;
+    }
+  }
 }
 
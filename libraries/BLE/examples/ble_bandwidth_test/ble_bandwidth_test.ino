@@ -29,8 +29,18 @@
 The project will run correctly in its current state.
 It can send data on the UART TX characteristic
 It can receive data on the UART RX characteristic.
-The bandwidth is measured with the nRF UART App in the Apple iOS app store.
-the bandwidth is controlled by the timing used on the link.
+The bandwidth is controlled by the timing used on the link.
+
+Once the peer opens the UART TX pipe the benchmark runs a matrix of connection intervals and SPI
+clocks, BENCH_RUN_MS each, and prints a CSV line per run on the Serial: uplink and downlink
+bytes/s, uplink packets per connection interval (x100), the time without credits, the loops with
+the command queue full and the time the loop was idle, in percent. Send data on the UART RX
+characteristic from the peer to measure the downlink. The queue sizes are build options, see
+aci_queue.h, the ACI_QUEUE_SIZE column tells which one was used. With HAL_ACI_TL_STATS set to 1
+the line ends with the SPI transfers and the queue high-water marks.
+The average current and the charge per byte and per connection event are estimated by aci_energy
+from the currents of ACI_ENERGY_PARAMS_DEFAULT, the bytes need HAL_ACI_TL_STATS and the connection
+events HAL_ACI_TL_ACTIVE with the active_pin connected.
 
 The following instructions describe the steps to be made on the Windows PC:
 
@@ -58,6 +68,8 @@ The following instructions describe the steps to be made on the Windows PC:
 #include <SPI.h>
 #include <lib_aci.h>
 #include <aci_setup.h>
+#include <hal_aci_tl.h>
+#include <aci_energy.h>
 
 /**
 Put the nRF8001 setup in the RAM of the nRF8001.
@@ -70,9 +82,10 @@ However this removes the need to do the setup of the nRF8001 on every reset.
 */
 
 /*
-Defining number of packets to send
+Time of each run of the benchmark, and the time to wait for the peer to change the timing
 */
-#define NUM_20BYTE_PACKETS_FOR_100KB 0x240 //0x1400 for 100Kbytes
+#define BENCH_RUN_MS          5000
+#define BENCH_TIMING_WAIT_MS  10000
 
 #ifdef SERVICES_PIPE_TYPE_MAPPING_CONTENT
     static services_pipe_type_mapping_t
@@ -105,20 +118,51 @@ static hal_aci_evt_t  aci_data;
 static hal_aci_data_t aci_cmd;
 
 /*
-Timing change state variable
+The benchmark matrix: connection intervals in 1.25 ms units and SPI clocks, the nRF8001 runs its
+SPI up to 3 MHz
 */
-static bool timing_change_done = false;
+typedef struct
+{
+  uint8_t  divider;
+  uint16_t khz;  // At 16 MHz
+} bench_spi_t;
 
-/*
-Used to test the UART TX characteristic notification
-*/
-static uint8_t uart_buffer[20];
-static uint8_t uart_buffer_len = 0;
+static const uint16_t    bench_intervals[]   = { 6, 12, 24, 40 };
+static const bench_spi_t bench_spi_clocks[]  = { { SPI_CLOCK_DIV8, 2000 }, { SPI_CLOCK_DIV16, 1000 }, { SPI_CLOCK_DIV32, 500 } };
 
+#define BENCH_INTERVALS   (sizeof(bench_intervals) / sizeof(bench_intervals[0]))
+#define BENCH_SPI_CLOCKS  (sizeof(bench_spi_clocks) / sizeof(bench_spi_clocks[0]))
+#define BENCH_CELLS       (BENCH_INTERVALS * BENCH_SPI_CLOCKS)
 
-static bool data_tx_state = false;
-static uint16_t sent_100k_data_pkt_counter = 0;
-static uint8_t app_retries = 0;
+typedef enum
+{
+  BENCH_IDLE,        // Waiting for the UART TX pipe
+  BENCH_TIMING,      // Waiting for the connection interval of the run
+  BENCH_RUN,
+  BENCH_DONE
+} bench_state_t;
+
+typedef struct
+{
+  bench_state_t state;
+  uint8_t       cell;              // Interval index * BENCH_SPI_CLOCKS + SPI clock index
+  uint16_t      interval;          // Connection interval of the link, 1.25 ms units
+  unsigned long state_ms;          // Start of the timing wait or of the run
+  uint32_t      tx_packets;
+  uint32_t      rx_packets;
+  uint32_t      rx_bytes;
+  uint32_t      loops;
+  uint32_t      tx_q_full_loops;   // Loops with a credit but the command queue full
+  uint32_t      idle_us;           // Loops with no event and nothing sent
+  uint32_t      starved_us;        // No credit available
+  unsigned long starved_since_us;
+  bool          starved;
+} bench_t;
+
+static bench_t bench;
+
+static const aci_energy_params_t energy_params = ACI_ENERGY_PARAMS_DEFAULT;
+static aci_energy_t              energy;
 /*
 Initializing data input.
 */
@@ -143,9 +187,6 @@ uint8_t data_input[]  =  {  0x61,/*20 byte packet for testing*/
                             0x00, /*Use the last 2 bytes as a packet counter*/
                             0x00};
 
-unsigned long time1;
-unsigned long time2;
-
 /* Define how assert should function in the BLE library */
 void __ble_assert(const char *file, uint16_t line)
 {
@@ -223,14 +264,13 @@ void setup(void)
   //We reset the nRF8001 here by toggling the RESET line connected to the nRF8001
   //and initialize the data structures required to setup the nRF8001
   lib_aci_init(&aci_state,false);
+  aci_energy_init(&energy, &energy_params);
 }
 
 bool data_tx_send()
 {
-//  uint16_t * p_counter_for_packet = (uint16_t *)&data_input[0x12];
-//  *p_counter_for_packet = sent_100k_data_pkt_counter;
-  data_input[0x12] = (uint8_t) ((sent_100k_data_pkt_counter >> 8));
-  data_input[0x13] = (uint8_t) (sent_100k_data_pkt_counter);
+  data_input[0x12] = (uint8_t) ((bench.tx_packets >> 8));
+  data_input[0x13] = (uint8_t) (bench.tx_packets);
 
   if(lib_aci_send_data(PIPE_UART_OVER_BTLE_UART_TX_TX, &data_input[0], 20))
   {
@@ -242,14 +282,177 @@ bool data_tx_send()
   }
 }
 
-void uart_tx()
+void bench_csv_header_print()
+{
+  Serial.print(F("interval_1_25ms,spi_khz,aci_queue_size,duration_ms,tx_bytes_s,rx_bytes_s,"
+                 "tx_packets_per_interval_x100,starved_pct,tx_q_full_pct,idle_pct,"
+                 "average_ua,nc_per_byte,nc_per_event"));
+#if HAL_ACI_TL_STATS
+  Serial.print(F(",spi_transfers,tx_q_high_water,rx_q_high_water"));
+#endif
+  Serial.println();
+}
+
+void bench_csv_print(unsigned long duration_ms)
+{
+  Serial.print(bench.interval);
+  Serial.print(',');
+  Serial.print(bench_spi_clocks[bench.cell % BENCH_SPI_CLOCKS].khz);
+  Serial.print(',');
+  Serial.print(ACI_QUEUE_SIZE);
+  Serial.print(',');
+  Serial.print(duration_ms);
+  Serial.print(',');
+  Serial.print((bench.tx_packets * 20 * 1000) / duration_ms);
+  Serial.print(',');
+  Serial.print((bench.rx_bytes * 1000) / duration_ms);
+  Serial.print(',');
+  Serial.print((bench.tx_packets * bench.interval * 125) / duration_ms);
+  Serial.print(',');
+  Serial.print(bench.starved_us / (duration_ms * 10));
+  Serial.print(',');
+  Serial.print((0 == bench.loops) ? 0 : ((bench.tx_q_full_loops * 100) / bench.loops));
+  Serial.print(',');
+  Serial.print(bench.idle_us / (duration_ms * 10));
+  {
+    aci_energy_report_t report;
+
+    aci_energy_get(&energy, &report);
+    Serial.print(',');
+    Serial.print(report.average_ua);
+    Serial.print(',');
+    Serial.print(report.nc_per_byte);
+    Serial.print(',');
+    Serial.print(report.nc_per_event);
+  }
+#if HAL_ACI_TL_STATS
+  {
+    hal_aci_tl_stats_t stats;
+
+    hal_aci_tl_stats_get(&stats);
+    Serial.print(',');
+    Serial.print(stats.spi_transfers);
+    Serial.print(',');
+    Serial.print(stats.tx_q_high_water);
+    Serial.print(',');
+    Serial.print(stats.rx_q_high_water);
+  }
+#endif
+  Serial.println();
+}
+
+void bench_run_start()
+{
+  bench.tx_packets      = 0;
+  bench.rx_packets      = 0;
+  bench.rx_bytes        = 0;
+  bench.loops           = 0;
+  bench.tx_q_full_loops = 0;
+  bench.idle_us         = 0;
+  bench.starved_us      = 0;
+  bench.starved         = false;
+#if HAL_ACI_TL_STATS
+  hal_aci_tl_stats_reset();
+#endif
+  aci_energy_reset(&energy);
+  bench.state    = BENCH_RUN;
+  bench.state_ms = millis();
+}
+
+void bench_cell_start(uint8_t cell)
+{
+  uint16_t interval;
+
+  bench.cell = cell;
+  if (cell >= BENCH_CELLS)
+  {
+    Serial.println(F("Benchmark done"));
+    bench.state = BENCH_DONE;
+    return;
+  }
+  if (0 == cell)
+  {
+    bench_csv_header_print();
+  }
+
+  hal_aci_tl_spi_clock_set(bench_spi_clocks[cell % BENCH_SPI_CLOCKS].divider);
+
+  interval = bench_intervals[cell / BENCH_SPI_CLOCKS];
+  if (interval == bench.interval)
+  {
+    bench_run_start();
+  }
+  else
+  {
+    //The peer can refuse it, the run then starts at the current interval after BENCH_TIMING_WAIT_MS
+    lib_aci_change_timing(interval, interval, 0/*Slave latency*/, 600/*6000 ms*/);
+    bench.state    = BENCH_TIMING;
+    bench.state_ms = millis();
+  }
+}
+
+/*
+Sends on the UART TX pipe for as long as there are credits and measures the loop, called once per
+loop with the micros() of the start of the loop and whether an event was handled
+*/
+void bench_loop(unsigned long loop_start_us, bool event_handled)
 {
-  lib_aci_send_data(PIPE_UART_OVER_BTLE_UART_TX_TX, (uint8_t *)&data_input[0], 20);
-  aci_state.data_credit_available--;
+  bool busy = event_handled;
+
+  if ((BENCH_TIMING == bench.state) && ((millis() - bench.state_ms) >= BENCH_TIMING_WAIT_MS))
+  {
+    bench_run_start();
+  }
+  if (BENCH_RUN != bench.state)
+  {
+    return;
+  }
+
+  if (aci_state.data_credit_available > 0)
+  {
+    if (bench.starved)
+    {
+      bench.starved     = false;
+      bench.starved_us += micros() - bench.starved_since_us;
+    }
+    if (data_tx_send())
+    {
+      bench.tx_packets++;
+      busy = true;
+    }
+    else
+    {
+      bench.tx_q_full_loops++;
+    }
+  }
+  else if (!bench.starved)
+  {
+    bench.starved          = true;
+    bench.starved_since_us = micros();
+  }
+
+  bench.loops++;
+  if (!busy)
+  {
+    bench.idle_us += micros() - loop_start_us;
+  }
+
+  if ((millis() - bench.state_ms) >= BENCH_RUN_MS)
+  {
+    if (bench.starved)
+    {
+      bench.starved     = false;
+      bench.starved_us += micros() - bench.starved_since_us;
+    }
+    bench_csv_print(millis() - bench.state_ms);
+    bench_cell_start(bench.cell + 1);
+  }
 }
 
-void aci_loop()
+bool aci_loop()
 {
+  bool event_handled = false;
+
   static bool setup_required = false;
 
   // We enter the if statement only when there is a ACI event available to be processed
@@ -257,6 +460,8 @@ void aci_loop()
   {
     aci_evt_t * aci_evt;
     aci_evt = &aci_data.evt;
+    event_handled = true;
+    aci_energy_event(&energy, aci_evt);
     switch(aci_evt->evt_opcode)
     {
       /**
@@ -316,6 +521,7 @@ void aci_loop()
 
       case ACI_EVT_CONNECTED:
         Serial.println(F("Evt Connected"));
+        bench.interval = aci_evt->params.connected.conn_rf_interval;
         aci_state.data_credit_available = aci_state.data_credit_total;
 
         /*
@@ -326,41 +532,42 @@ void aci_loop()
 
       case ACI_EVT_PIPE_STATUS:
         Serial.println(F("Evt Pipe Status"));
-        if (lib_aci_is_pipe_available(&aci_state, PIPE_UART_OVER_BTLE_UART_TX_TX) && (false == timing_change_done))
-        {
-          lib_aci_change_timing(11/*13.75ms*/, 18/*22.5ms*/, 0/*Slave latency*/, 600/*6000 ms*/); // Used to increase or decrease bandwidth
-
-          timing_change_done = true;
-        }
-        else if (lib_aci_is_pipe_available(&aci_state, PIPE_UART_OVER_BTLE_UART_TX_TX))
+        if (lib_aci_is_pipe_available(&aci_state, PIPE_UART_OVER_BTLE_UART_TX_TX) && (BENCH_IDLE == bench.state))
         {
-          data_tx_state = true;
+          bench_cell_start(0);
         }
-        else
+        else if (!lib_aci_is_pipe_available(&aci_state, PIPE_UART_OVER_BTLE_UART_TX_TX))
         {
-          sent_100k_data_pkt_counter = 0;
-          data_tx_state = false;
+          bench.state = BENCH_IDLE;
         }
         break;
 
       case ACI_EVT_TIMING:
         Serial.print(F("Evt link connection interval changed to (ms): "));
-        data_tx_state = true;
         Serial.println(aci_evt->params.timing.conn_rf_interval * 1.25);
+        bench.interval = aci_evt->params.timing.conn_rf_interval;
+        if (BENCH_TIMING == bench.state)
+        {
+          bench_run_start();
+        }
         break;
 
       case ACI_EVT_DISCONNECTED:
         Serial.println(F("Evt Disconnected/Advertising timed out"));
         //Initialize the variables used
-        sent_100k_data_pkt_counter = 0;
-        data_tx_state              = false;
-        timing_change_done         = false;
+        bench.state = BENCH_IDLE;
 
         lib_aci_connect(180/* in seconds */, 0x0100 /* advertising interval 100ms*/);
         Serial.println(F("Advertising started"));
         break;
 
       case ACI_EVT_DATA_RECEIVED:
+        if (BENCH_RUN == bench.state)
+        {
+          bench.rx_packets++;
+          bench.rx_bytes += aci_evt->len - 2;
+          break;
+        }
         Serial.print(F("UART RX: 0x"));
         Serial.print(aci_evt->params.data_received.rx_data.pipe_number, HEX);
         {
@@ -368,16 +575,14 @@ void aci_loop()
           for(int i=0; i<aci_evt->len - 2; i++)
           {
             Serial.print(aci_evt->params.data_received.rx_data.aci_data[i], HEX);
-            uart_buffer[i] = aci_evt->params.data_received.rx_data.aci_data[i];
             Serial.print(F(" "));
           }
-          uart_buffer_len = aci_evt->len - 2;
         }
         Serial.println(F(""));
         break;
 
       case ACI_EVT_DATA_CREDIT:
-        aci_state.data_credit_available = aci_state.data_credit_available + aci_evt->params.data_credit.credit;
+        //aci_state.data_credit_available is updated by the ACI Library
         break;
 
       case ACI_EVT_PIPE_ERROR:
@@ -386,14 +591,6 @@ void aci_loop()
         Serial.print(aci_evt->params.pipe_error.pipe_number, DEC);
         Serial.print(F("  Pipe Error Code: 0x"));
         Serial.println(aci_evt->params.pipe_error.error_code, HEX);
-
-        //Increment the credit available as the data packet was not sent.
-        //The pipe error also represents the Attribute protocol Error Response sent from the peer and that should not be counted
-        //for the credit.
-        if (ACI_STATUS_ERROR_PEER_ATT_ERROR != aci_evt->params.pipe_error.error_code)
-        {
-          aci_state.data_credit_available++;
-        }
         break;
       case ACI_EVT_HW_ERROR:
         Serial.println(F("HW error: "));
@@ -429,49 +626,13 @@ void aci_loop()
       setup_required = false;
     }
   }
+
+  return event_handled;
 }
 
 void loop()
 {
-  aci_loop();
-  if ((data_tx_state == true) && (aci_state.data_credit_available > 0))
-  {
-    if (data_tx_send())
-    {
-      sent_100k_data_pkt_counter++;
-      aci_state.data_credit_available--;
+  const unsigned long loop_start_us = micros();
 
-      if(1 == sent_100k_data_pkt_counter)
-      {
-        Serial.print("Time Start: ");
-        time1 = millis();
-        //prints time since program started
-        Serial.println(time1);
-      }
-
-      if (NUM_20BYTE_PACKETS_FOR_100KB == sent_100k_data_pkt_counter)
-      {
-        data_tx_state = false;
-        sent_100k_data_pkt_counter=0;
-        time2 = millis();
-        Serial.print("Time Stop: ms: ");
-        //prints time since program started
-        Serial.println(time2);
-        Serial.print("Time diff: ms: ");
-        Serial.println(time2-time1);
-
-        Serial.print(F("Number of bytes = "));
-        Serial.println(NUM_20BYTE_PACKETS_FOR_100KB);
-
-        Serial.print(F("Bandwidth from nRF8001 to peer: Bytes per second: "));
-        Serial.println( (NUM_20BYTE_PACKETS_FOR_100KB*20/((time2-time1)/1000) ) );
-      }
-    }
-    else
-    {
-      app_retries++;
-    }
-  }
-  //if credit-send as fast as possible.
+  bench_loop(loop_start_us, aci_loop());
 }
-
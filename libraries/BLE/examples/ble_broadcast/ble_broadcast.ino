@@ -42,6 +42,7 @@ The following instructions describe the steps to be made on the Windows PC:
 #include <SPI.h>
 #include <lib_aci.h>
 #include <aci_setup.h>
+#include <aci_broadcast.h>
 
 /**
 Put the nRF8001 setup in the RAM of the nRF8001.
@@ -78,6 +79,25 @@ static struct aci_state_t aci_state;
 static hal_aci_evt_t aci_data;
 static hal_aci_data_t aci_cmd;
 
+/*
+The setup of this example has no broadcast pipes. Add them in nRFgo Studio, one per payload, and
+list them here, e.g. { PIPE_MY_SERVICE_MY_CHARACTERISTIC_TX_BROADCAST }, then give each payload
+with aci_broadcast_set() whenever it changes: the payloads are rotated in the advertising
+packets, pipes_per_cycle at a time every events_per_cycle advertising events.
+*/
+static const uint8_t broadcast_pipes[] = { 0 };
+static const aci_broadcast_params_t broadcast_params =
+{
+  broadcast_pipes,
+  0      /* payloads in broadcast_pipes */,
+  1      /* pipes_per_cycle */,
+  0x0100 /* advertising interval 100ms */,
+  10     /* events_per_cycle */,
+  10     /* timeout in seconds */,
+  true   /* restart after the timeout */
+};
+static aci_broadcast_t broadcast;
+
 /* Define how assert should function in the BLE library */
 void __ble_assert(const char *file, uint16_t line)
 {
@@ -139,6 +159,7 @@ void setup(void)
   //We reset the nRF8001 here by toggling the RESET line connected to the nRF8001
   //and initialize the data structures required to setup the nRF8001
   lib_aci_init(&aci_state, false);
+  aci_broadcast_init(&broadcast, &broadcast_params);
 }
 
 void loop()
@@ -150,6 +171,7 @@ void loop()
   {
     aci_evt_t * aci_evt;
     aci_evt = &aci_data.evt;
+    aci_broadcast_event(&broadcast, &aci_state, aci_evt);
     switch(aci_evt->evt_opcode)
     {
       /**
@@ -171,8 +193,8 @@ void loop()
           case ACI_DEVICE_STANDBY:
             Serial.println(F("Evt Device Started: Standby"));
             //See ACI Broadcast in the data sheet of the nRF8001
-            lib_aci_broadcast(10/* in seconds */, 0x0100 /* advertising interval 100ms */);
             //While broadcasting (non_connectable) interval of 100ms is the minimum possible
+            aci_broadcast_start(&broadcast, &aci_state);
             Serial.println(F("Broadcasting started"));
             //To stop the broadcasting before the timeout use the
             //lib_aci_radio_reset to soft reset the radio
@@ -207,7 +229,7 @@ void loop()
         case ACI_EVT_DISCONNECTED:
         if (ACI_STATUS_ERROR_ADVT_TIMEOUT == aci_evt->params.disconnected.aci_status)
         {
-          Serial.println(F("Broadcasting timed out"));
+          Serial.println(F("Broadcasting timed out, started again"));
         }
         else
         {
@@ -252,5 +274,6 @@ void loop()
       setup_required = false;
     }
   }
-}
 
+  aci_broadcast_poll(&broadcast, &aci_state);
+}
@@ -0,0 +1,372 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Cycle counts of the BLE library on the board
+ */
+
+/** @defgroup my_project my_project
+@{
+@ingroup projects
+@brief CPU cycles of acilib, aci_queue, hal_aci_tl_send() and lib_aci_event_get()
+
+@details
+Every operation is run CYCLE_RUNS times and timed with aci_cycles.h: Timer1 on AVR, the DWT
+cycle counter on the Arduino Due, SysTick on the SAMD boards, the core timer on the ChipKit.
+The cost of an empty measure is taken off. A CSV line per operation gives its min, average and
+max in CPU cycles, the table is meant to be diffed between two versions of the library built
+with the same options.
+
+The acilib, aci_queue and platform lines need nothing but the MCU. The transport lines need the
+nRF8001: it is put in Test mode and the Echo command and event are timed, one at a time, in
+polling mode. The lib_aci_event_get() line of the Echo event includes its SPI transfer, run at
+the SPI clock of spi_clock_divider.
+
+Timer1 is taken over on AVR, do not run this with a sketch that uses it.
+ */
+
+#include <SPI.h>
+#include <lib_aci.h>
+#include <acilib_if.h>
+#include <aci_queue.h>
+#include <aci_cycles.h>
+
+static struct aci_state_t aci_state;
+
+static hal_aci_evt_t aci_data;
+
+/*
+Runs of each operation
+*/
+#define CYCLE_RUNS  16
+
+/*
+Time given to the nRF8001 to answer an Echo
+*/
+#define CYCLE_ECHO_TIMEOUT_MS  100
+
+typedef struct
+{
+  uint32_t min;
+  uint32_t max;
+  uint32_t total;
+  uint8_t  runs;
+} cycle_stat_t;
+
+static cycle_stat_t     cycle_stat;
+static volatile uint8_t cycle_sink;
+static bool             cycle_transport_done;
+
+static hal_aci_data_t   cycle_msg;
+static aci_queue_t      cycle_q;
+static uint8_t          cycle_q_storage[ACI_TX_QUEUE_BYTES];
+static hal_aci_data_t   cycle_echo_cmd;
+static const hal_aci_data_t cycle_msg_P PROGMEM = { 0x00, { 21, ACI_CMD_SEND_DATA, 1 } };
+
+static uint8_t cycle_data[ACI_ECHO_DATA_MAX_LEN] = { 0x00, 0xaa, 0x55, 0xff, 0x77, 0x55, 0x33, 0x22, 0x11, 0x44,
+                                                     0x66, 0x88, 0x99, 0xbb, 0xdd, 0xcc, 0x00, 0xaa, 0x55, 0xff,
+                                                     0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x5a };
+
+/* Events as clocked in: length, opcode, parameters */
+static uint8_t evt_device_started[] = { 4, ACI_EVT_DEVICE_STARTED, ACI_DEVICE_STANDBY, 0x00, 2 };
+static uint8_t evt_cmd_rsp[]        = { 3, ACI_EVT_CMD_RSP, ACI_CMD_CONNECT, ACI_STATUS_SUCCESS };
+static uint8_t evt_connected[]      = { 15, ACI_EVT_CONNECTED, 0x01, 1, 2, 3, 4, 5, 6, 6, 0, 0, 0, 0x58, 0x02, 0 };
+static uint8_t evt_pipe_status[]    = { 17, ACI_EVT_PIPE_STATUS, 0xFE, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0,
+                                        0, 0, 0, 0, 0, 0, 0, 0 };
+static uint8_t evt_data_credit[]    = { 2, ACI_EVT_DATA_CREDIT, 1 };
+static uint8_t evt_data_received[ACI_PACKET_MAX_LEN] = { 2 + ACI_PIPE_RX_DATA_MAX_LEN, ACI_EVT_DATA_RECEIVED, 5 };
+
+/* Define how assert should function in the BLE library */
+void __ble_assert(const char *file, uint16_t line)
+{
+  Serial.print("ERROR ");
+  Serial.print(file);
+  Serial.print(": ");
+  Serial.print(line);
+  Serial.print("\n");
+  while(1);
+}
+
+/*
+Times CYCLE_RUNS runs of op. before and after are run around every run, outside of the measure,
+to bring the state the operation needs and to take its result.
+*/
+#define CYCLE_BENCH(name, before, op, after)     \
+  do {                                           \
+    uint8_t  run;                                \
+    uint32_t start;                              \
+    cycle_start();                               \
+    for (run = 0; run < CYCLE_RUNS; run++)       \
+    {                                            \
+      before;                                    \
+      start = aci_cycles_now();                  \
+      op;                                        \
+      cycle_add(aci_cycles_since(start));        \
+      after;                                     \
+    }                                            \
+    Serial.print(F(name));                       \
+    cycle_print();                               \
+  } while (0)
+
+void cycle_start()
+{
+  cycle_stat.min   = 0xFFFFFFFF;
+  cycle_stat.max   = 0;
+  cycle_stat.total = 0;
+  cycle_stat.runs  = 0;
+}
+
+void cycle_add(uint32_t cycles)
+{
+  cycles = (cycles > aci_cycles_overhead()) ? (cycles - aci_cycles_overhead()) : 0;
+  if (cycles < cycle_stat.min)
+  {
+    cycle_stat.min = cycles;
+  }
+  if (cycles > cycle_stat.max)
+  {
+    cycle_stat.max = cycles;
+  }
+  cycle_stat.total += cycles;
+  cycle_stat.runs++;
+}
+
+void cycle_print()
+{
+  Serial.print(',');
+  Serial.print(cycle_stat.runs);
+  Serial.print(',');
+  Serial.print(cycle_stat.min);
+  Serial.print(',');
+  Serial.print(cycle_stat.total / cycle_stat.runs);
+  Serial.print(',');
+  Serial.println(cycle_stat.max);
+}
+
+void cycle_encode()
+{
+  aci_cmd_params_test_t           test;
+  aci_cmd_params_connect_t        connect;
+  aci_cmd_params_set_local_data_t local_data;
+  aci_cmd_params_echo_t           echo;
+  aci_cmd_params_change_timing_t  timing;
+
+  test.test_mode_change = ACI_TEST_MODE_DTM_UART;
+  connect.timeout       = 180;
+  connect.adv_interval  = 0x50;
+  local_data.tx_data.pipe_number = 1;
+  memcpy(&local_data.tx_data.aci_data[0], &cycle_data[0], ACI_PIPE_TX_DATA_MAX_LEN);
+  memcpy(&echo.echo_data[0], &cycle_data[0], ACI_ECHO_DATA_MAX_LEN);
+  timing.conn_params.min_conn_interval = 11;
+  timing.conn_params.max_conn_interval = 18;
+  timing.conn_params.slave_latency     = 0;
+  timing.conn_params.timeout_mult      = 600;
+
+  CYCLE_BENCH("acil_encode_cmd_set_test_mode", , acil_encode_cmd_set_test_mode(&cycle_msg.buffer[0], &test), cycle_sink = cycle_msg.buffer[2]);
+  CYCLE_BENCH("acil_encode_cmd_sleep", , acil_encode_cmd_sleep(&cycle_msg.buffer[0]), cycle_sink = cycle_msg.buffer[1]);
+  CYCLE_BENCH("acil_encode_cmd_connect", , acil_encode_cmd_connect(&cycle_msg.buffer[0], &connect), cycle_sink = cycle_msg.buffer[2]);
+  CYCLE_BENCH("acil_encode_cmd_change_timing_req", , acil_encode_cmd_change_timing_req(&cycle_msg.buffer[0], &timing), cycle_sink = cycle_msg.buffer[2]);
+  CYCLE_BENCH("acil_encode_cmd_set_local_data 20", , acil_encode_cmd_set_local_data(&cycle_msg.buffer[0], &local_data, ACI_PIPE_TX_DATA_MAX_LEN), cycle_sink = cycle_msg.buffer[3]);
+  CYCLE_BENCH("acil_encode_cmd_send_data_raw 20", , acil_encode_cmd_send_data_raw(&cycle_msg.buffer[0], 1, &cycle_data[0], ACI_PIPE_TX_DATA_MAX_LEN), cycle_sink = cycle_msg.buffer[3]);
+  CYCLE_BENCH("acil_encode_cmd_echo_msg 29", , acil_encode_cmd_echo_msg(&cycle_msg.buffer[0], &echo, ACI_ECHO_DATA_MAX_LEN), cycle_sink = cycle_msg.buffer[3]);
+  CYCLE_BENCH("acil_encode_cmd_write_dynamic_data 27", , acil_encode_cmd_write_dynamic_data(&cycle_msg.buffer[0], 1, &cycle_data[0], 27), cycle_sink = cycle_msg.buffer[3]);
+}
+
+void cycle_decode()
+{
+  aci_evt_t evt;
+
+  CYCLE_BENCH("acil_decode_evt device_started", , acil_decode_evt(evt_device_started, &evt), cycle_sink = evt.evt_opcode);
+  CYCLE_BENCH("acil_decode_evt cmd_rsp", , acil_decode_evt(evt_cmd_rsp, &evt), cycle_sink = evt.evt_opcode);
+  CYCLE_BENCH("acil_decode_evt connected", , acil_decode_evt(evt_connected, &evt), cycle_sink = evt.evt_opcode);
+  CYCLE_BENCH("acil_decode_evt pipe_status", , acil_decode_evt(evt_pipe_status, &evt), cycle_sink = evt.evt_opcode);
+  CYCLE_BENCH("acil_decode_evt data_credit", , acil_decode_evt(evt_data_credit, &evt), cycle_sink = evt.evt_opcode);
+  CYCLE_BENCH("acil_decode_evt data_received 20", , acil_decode_evt(evt_data_received, &evt), cycle_sink = evt.evt_opcode);
+  CYCLE_BENCH("acil_evt_is_valid data_received", , cycle_sink = acil_evt_is_valid(evt_data_received), );
+}
+
+/*
+The queue is left as it was found after every run, so the runs go round the ring
+*/
+void cycle_queue()
+{
+  const hal_aci_data_t *p_peek;
+  hal_aci_data_t       *p_slot;
+
+  aci_queue_init(&cycle_q, cycle_q_storage, sizeof(cycle_q_storage));
+  acil_encode_cmd_send_data_raw(&cycle_msg.buffer[0], 1, &cycle_data[0], ACI_PIPE_TX_DATA_MAX_LEN);
+  cycle_msg.status_byte = 0;
+
+  CYCLE_BENCH("aci_queue_init", , aci_queue_init(&cycle_q, cycle_q_storage, sizeof(cycle_q_storage)), );
+  CYCLE_BENCH("aci_queue_enqueue 22", , aci_queue_enqueue(&cycle_q, &cycle_msg), aci_queue_dequeue(&cycle_q, &cycle_msg));
+  CYCLE_BENCH("aci_queue_dequeue 22", aci_queue_enqueue(&cycle_q, &cycle_msg), aci_queue_dequeue(&cycle_q, &cycle_msg), );
+  CYCLE_BENCH("aci_queue_peek 22", aci_queue_enqueue(&cycle_q, &cycle_msg), aci_queue_peek(&cycle_q, &cycle_msg), aci_queue_consume(&cycle_q));
+  CYCLE_BENCH("aci_queue_peek_ptr", aci_queue_enqueue(&cycle_q, &cycle_msg), p_peek = aci_queue_peek_ptr(&cycle_q), cycle_sink = p_peek->buffer[1]; aci_queue_consume(&cycle_q));
+  CYCLE_BENCH("aci_queue_consume", aci_queue_enqueue(&cycle_q, &cycle_msg), aci_queue_consume(&cycle_q), );
+  CYCLE_BENCH("aci_queue_reserve+commit", , p_slot = aci_queue_reserve(&cycle_q); aci_queue_commit(&cycle_q), cycle_sink = (NULL != p_slot); aci_queue_consume(&cycle_q));
+  CYCLE_BENCH("aci_queue_is_empty", , cycle_sink = aci_queue_is_empty(&cycle_q), );
+  CYCLE_BENCH("aci_queue_is_full", , cycle_sink = aci_queue_is_full(&cycle_q), );
+  CYCLE_BENCH("aci_queue_bytes_used", , cycle_sink = aci_queue_bytes_used(&cycle_q), );
+  CYCLE_BENCH("aci_queue_enqueue_from_isr 22", , aci_queue_enqueue_from_isr(&cycle_q, &cycle_msg), aci_queue_dequeue_from_isr(&cycle_q, &cycle_msg));
+  CYCLE_BENCH("aci_queue_dequeue_from_isr 22", aci_queue_enqueue_from_isr(&cycle_q, &cycle_msg), aci_queue_dequeue_from_isr(&cycle_q, &cycle_msg), );
+  CYCLE_BENCH("aci_queue_peek_slot+consume_from_isr", aci_queue_enqueue(&cycle_q, &cycle_msg), p_slot = aci_queue_peek_slot_from_isr(&cycle_q); aci_queue_consume_from_isr(&cycle_q), cycle_sink = (NULL != p_slot));
+  CYCLE_BENCH("aci_queue_reserve+commit_from_isr", , p_slot = aci_queue_reserve_from_isr(&cycle_q); aci_queue_commit_from_isr(&cycle_q), cycle_sink = (NULL != p_slot); aci_queue_consume(&cycle_q));
+}
+
+void cycle_platform()
+{
+  CYCLE_BENCH("noInterrupts+interrupts", , noInterrupts(); interrupts(), );
+  CYCLE_BENCH("memcpy_P 33", , memcpy_P(&cycle_msg, &cycle_msg_P, sizeof(cycle_msg)), cycle_sink = cycle_msg.buffer[1]);
+  CYCLE_BENCH("memcpy 33", , memcpy(&cycle_echo_cmd, &cycle_msg, sizeof(cycle_msg)), cycle_sink = cycle_echo_cmd.buffer[1]);
+}
+
+/*
+Runs the transport until the nRF8001 answers the Echo in flight
+*/
+bool cycle_echo_wait()
+{
+  const unsigned long start_ms = millis();
+
+  while ((millis() - start_ms) < CYCLE_ECHO_TIMEOUT_MS)
+  {
+    if (lib_aci_event_get(&aci_state, &aci_data) && (ACI_EVT_ECHO == aci_data.evt.evt_opcode))
+    {
+      return true;
+    }
+  }
+  Serial.println(F("Error: no Echo event"));
+  return false;
+}
+
+/*
+Sends the Echo and waits with RDYN low for its event, the next lib_aci_event_get() clocks it in
+*/
+void cycle_echo_ready()
+{
+  const unsigned long start_ms = millis();
+
+  hal_aci_tl_send(&cycle_echo_cmd);
+  while (!hal_aci_tl_tx_q_empty() && ((millis() - start_ms) < CYCLE_ECHO_TIMEOUT_MS))
+  {
+    lib_aci_event_get(&aci_state, &aci_data);
+  }
+  while ((HIGH == digitalRead(aci_state.aci_pins.rdyn_pin)) && ((millis() - start_ms) < CYCLE_ECHO_TIMEOUT_MS))
+  {
+  }
+}
+
+void cycle_transport()
+{
+  aci_cmd_params_echo_t echo;
+  bool                  got;
+
+  memcpy(&echo.echo_data[0], &cycle_data[0], ACI_ECHO_DATA_MAX_LEN);
+  acil_encode_cmd_echo_msg(&cycle_echo_cmd.buffer[0], &echo, ACI_ECHO_DATA_MAX_LEN);
+  cycle_echo_cmd.status_byte = 0;
+
+  CYCLE_BENCH("hal_aci_tl_send echo 29", , hal_aci_tl_send(&cycle_echo_cmd), cycle_echo_wait());
+  CYCLE_BENCH("lib_aci_echo_msg 29", , lib_aci_echo_msg(ACI_ECHO_DATA_MAX_LEN, &cycle_data[0]), cycle_echo_wait());
+  CYCLE_BENCH("lib_aci_event_get echo 29", cycle_echo_ready(), got = lib_aci_event_get(&aci_state, &aci_data),
+              if (!got || (ACI_EVT_ECHO != aci_data.evt.evt_opcode)) { cycle_echo_wait(); });
+  CYCLE_BENCH("lib_aci_event_get none", , got = lib_aci_event_get(&aci_state, &aci_data), cycle_sink = got);
+}
+
+void setup(void)
+{
+  Serial.begin(115200);
+  //Wait until the serial port is available (useful only for the Leonardo)
+  //As the Leonardo board is not reseted every time you open the Serial Monitor
+  #if defined (__AVR_ATmega32U4__)
+    while(!Serial)
+    {}
+    delay(5000);  //5 seconds delay for enabling to see the start up comments on the serial board
+  #elif defined(__PIC32MX__)
+    delay(1000);
+  #endif
+  Serial.println(F("Arduino setup"));
+
+  aci_cycles_start();
+  Serial.print(F("F_CPU "));
+  Serial.print(F_CPU);
+  Serial.print(F(", empty measure "));
+  Serial.print(aci_cycles_overhead());
+  Serial.println(F(" cycles"));
+  Serial.println(F("operation,runs,min,avg,max"));
+
+  cycle_encode();
+  cycle_decode();
+  cycle_queue();
+  cycle_platform();
+
+  /*
+  Tell the ACI library, the MCU to nRF8001 pin connections.
+  The Active pin is optional and can be marked UNUSED
+  */
+  aci_state.aci_pins.board_name = BOARD_DEFAULT; //See board.h for details REDBEARLAB_SHIELD_V1_1 or BOARD_DEFAULT
+  aci_state.aci_pins.reqn_pin   = 9; //SS for Nordic board, 9 for REDBEARLAB_SHIELD_V1_1
+  aci_state.aci_pins.rdyn_pin   = 8; //3 for Nordic board, 8 for REDBEARLAB_SHIELD_V1_1
+  aci_state.aci_pins.mosi_pin   = MOSI;
+  aci_state.aci_pins.miso_pin   = MISO;
+  aci_state.aci_pins.sck_pin    = SCK;
+
+  aci_state.aci_pins.spi_clock_divider      = SPI_CLOCK_DIV8;//SPI_CLOCK_DIV8  = 2MHz SPI speed
+                                                             //SPI_CLOCK_DIV16 = 1MHz SPI speed
+
+  aci_state.aci_pins.reset_pin              = 4; //4 for Nordic board, UNUSED for REDBEARLAB_SHIELD_V1_1
+  aci_state.aci_pins.active_pin             = UNUSED;
+  aci_state.aci_pins.optional_chip_sel_pin  = UNUSED;
+
+  aci_state.aci_pins.interface_is_interrupt = false;
+  aci_state.aci_pins.interrupt_number       = 1;
+
+  //The second parameter is for turning debug printing on for the ACI Commands and Events so they be printed on the Serial
+  hal_aci_tl_init(&(aci_state.aci_pins), false);
+}
+
+void loop()
+{
+  if (cycle_transport_done)
+  {
+    return;
+  }
+
+  // We enter the if statement only when there is a ACI event available to be processed
+  if (lib_aci_event_get(&aci_state, &aci_data))
+  {
+    aci_evt_t * aci_evt;
+    aci_evt = &aci_data.evt;
+    if (ACI_EVT_DEVICE_STARTED == aci_evt->evt_opcode)
+    {
+      switch(aci_evt->params.device_started.device_mode)
+      {
+        case ACI_DEVICE_SETUP:
+        case ACI_DEVICE_STANDBY:
+          lib_aci_test(ACI_TEST_MODE_DTM_UART);
+          break;
+        case ACI_DEVICE_TEST:
+          cycle_transport();
+          Serial.println(F("Cycle benchmark done"));
+          cycle_transport_done = true;
+          break;
+      }
+    }
+  }
+}
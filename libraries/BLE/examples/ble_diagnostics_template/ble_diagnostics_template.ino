@@ -0,0 +1,287 @@
+/* Copyright (c) 2014, Nordic Semiconductor ASA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/** @defgroup ble_diagnostics_template ble_diagnostics_template
+@{
+@ingroup projects
+@brief The Diagnostics service, the counters of the library read over the air with aci_diag
+
+@details
+The Diagnostics service has a Request characteristic, written without response, and a Report
+characteristic that notifies. Once the peer has enabled the notifications of the Report, write
+0x01 to the Request for a report of all the counters, 0x01 and a mask for some of them, or 0x02
+to clear them. See aci_diag.h for the records of the report.
+
+The counters come from the build options of the library: HAL_ACI_TL_STATS, HAL_ACI_TL_LATENCY and
+LIB_ACI_LINK_HISTORY. Without any of them the report only has its header. The report also has
+the estimates of aci_energy, the charge per byte and per connection event, which needs
+HAL_ACI_TL_STATS and HAL_ACI_TL_ACTIVE for the bytes and the radio events.
+
+To add the service to an application copy the Diagnostics service of Diagnostics.xml to its
+nRFgo Studio project, generate services.h and call aci_diag_event() and aci_diag_poll() as below,
+aci_diag_poll() after the application has sent. DIAG_CREDITS_KEPT data credits are left to the
+application.
+ */
+#include <SPI.h>
+#include <lib_aci.h>
+#include <aci_setup.h>
+#include <hal_aci_tl.h>
+#include <aci_diag.h>
+
+/**
+Put the nRF8001 setup in the RAM of the nRF8001.
+*/
+#include "services.h"
+
+/*
+Data credits the diagnostics leave for the application
+*/
+#define DIAG_CREDITS_KEPT  1
+
+#ifdef SERVICES_PIPE_TYPE_MAPPING_CONTENT
+    static services_pipe_type_mapping_t
+        services_pipe_type_mapping[NUMBER_OF_PIPES] = SERVICES_PIPE_TYPE_MAPPING_CONTENT;
+#else
+    #define NUMBER_OF_PIPES 0
+    static services_pipe_type_mapping_t * services_pipe_type_mapping = NULL;
+#endif
+
+/* Store the setup for the nRF8001 in the flash of the AVR to save on RAM */
+static hal_aci_data_t setup_msgs[NB_SETUP_MESSAGES] PROGMEM = SETUP_MESSAGES_CONTENT;
+
+static struct aci_state_t aci_state;
+
+/*
+Temporary buffers for sending ACI commands
+*/
+static hal_aci_evt_t  aci_data;
+
+static const aci_energy_params_t energy_params = ACI_ENERGY_PARAMS_DEFAULT;
+
+static aci_energy_t energy;
+
+static const aci_diag_params_t diag_params =
+{
+  PIPE_DIAGNOSTICS_DIAGNOSTICS_REQUEST_RX,
+  PIPE_DIAGNOSTICS_DIAGNOSTICS_REPORT_TX,
+  DIAG_CREDITS_KEPT,
+  &energy,
+};
+
+static aci_diag_t diag;
+
+/* Define how assert should function in the BLE library */
+void __ble_assert(const char *file, uint16_t line)
+{
+  Serial.print("ERROR ");
+  Serial.print(file);
+  Serial.print(": ");
+  Serial.print(line);
+  Serial.print("\n");
+  while(1);
+}
+
+void setup(void)
+{
+  Serial.begin(115200);
+  //Wait until the serial port is available (useful only for the Leonardo)
+  //As the Leonardo board is not reseted every time you open the Serial Monitor
+  #if defined (__AVR_ATmega32U4__)
+    while(!Serial)
+    {}
+    delay(5000);  //5 seconds delay for enabling to see the start up comments on the serial board
+  #elif defined(__PIC32MX__)
+    delay(1000);
+  #endif
+  Serial.println(F("Arduino setup"));
+
+  /**
+  Point ACI data structures to the the setup data that the nRFgo studio generated for the nRF8001
+  */
+  if (NULL != services_pipe_type_mapping)
+  {
+    aci_state.aci_setup_info.services_pipe_type_mapping = &services_pipe_type_mapping[0];
+  }
+  else
+  {
+    aci_state.aci_setup_info.services_pipe_type_mapping = NULL;
+  }
+  aci_state.aci_setup_info.number_of_pipes    = NUMBER_OF_PIPES;
+  aci_state.aci_setup_info.setup_msgs         = setup_msgs;
+  aci_state.aci_setup_info.num_setup_msgs     = NB_SETUP_MESSAGES;
+
+  /*
+  Tell the ACI library, the MCU to nRF8001 pin connections.
+  The Active pin is optional and can be marked UNUSED
+  */
+  aci_state.aci_pins.board_name = BOARD_DEFAULT; //See board.h for details
+  aci_state.aci_pins.reqn_pin   = 9;
+  aci_state.aci_pins.rdyn_pin   = 8;
+  aci_state.aci_pins.mosi_pin   = MOSI;
+  aci_state.aci_pins.miso_pin   = MISO;
+  aci_state.aci_pins.sck_pin    = SCK;
+
+  aci_state.aci_pins.spi_clock_divider      = SPI_CLOCK_DIV8;//SPI_CLOCK_DIV8  = 2MHz SPI speed
+                                                             //SPI_CLOCK_DIV16 = 1MHz SPI speed
+
+  aci_state.aci_pins.reset_pin              = 4;
+  aci_state.aci_pins.active_pin             = UNUSED;
+  aci_state.aci_pins.optional_chip_sel_pin  = UNUSED;
+
+  aci_state.aci_pins.interface_is_interrupt = false;
+  aci_state.aci_pins.interrupt_number       = 1;
+
+  aci_energy_init(&energy, &energy_params);
+  aci_diag_init(&diag, &diag_params);
+
+  //We reset the nRF8001 here by toggling the RESET line connected to the nRF8001
+  //and initialize the data structures required to setup the nRF8001
+  lib_aci_init(&aci_state,false);
+}
+
+void aci_loop()
+{
+  static bool setup_required = false;
+
+  // We enter the if statement only when there is a ACI event available to be processed
+  if (lib_aci_event_get(&aci_state, &aci_data))
+  {
+    aci_evt_t * aci_evt;
+    aci_evt = &aci_data.evt;
+
+    aci_energy_event(&energy, aci_evt);
+    aci_diag_event(&diag, &aci_state, aci_evt);
+
+    switch(aci_evt->evt_opcode)
+    {
+      /**
+      As soon as you reset the nRF8001 you will get an ACI Device Started Event
+      */
+      case ACI_EVT_DEVICE_STARTED:
+      {
+        aci_state.data_credit_total = aci_evt->params.device_started.credit_available;
+        switch(aci_evt->params.device_started.device_mode)
+        {
+          case ACI_DEVICE_SETUP:
+            /**
+            When the device is in the setup mode
+            */
+            Serial.println(F("Evt Device Started: Setup"));
+            setup_required = true;
+            break;
+
+          case ACI_DEVICE_STANDBY:
+            Serial.println(F("Evt Device Started: Standby"));
+            if (aci_evt->params.device_started.hw_error)
+            {
+              delay(20); //Magic number used to make sure the HW error event is handled correctly.
+            }
+            else
+            {
+              lib_aci_connect(180/* in seconds */, 0x0050 /* advertising interval 100ms*/);
+              Serial.println(F("Advertising started"));
+            }
+            break;
+        }
+      }
+        break; //ACI Device Started Event
+
+      case ACI_EVT_CMD_RSP:
+        //If an ACI command response event comes with an error -> stop
+        if (ACI_STATUS_SUCCESS != aci_evt->params.cmd_rsp.cmd_status)
+        {
+          Serial.print(F("ACI Command "));
+          Serial.println(aci_evt->params.cmd_rsp.cmd_opcode, HEX);
+          Serial.println(F("Evt Cmd respone: Error. Arduino is in an while(1); loop"));
+          while (1);
+        }
+
+        if (ACI_CMD_GET_DEVICE_VERSION == aci_evt->params.cmd_rsp.cmd_opcode)
+        {
+          //Store the version and configuration information of the nRF8001 in the Hardware Revision String Characteristic
+          lib_aci_set_local_data(&aci_state, PIPE_DEVICE_INFORMATION_HARDWARE_REVISION_STRING_SET,
+            (uint8_t *)&(aci_evt->params.cmd_rsp.params.get_device_version), sizeof(aci_evt_cmd_rsp_params_get_device_version_t));
+        }
+        break;
+
+      case ACI_EVT_CONNECTED:
+        Serial.println(F("Evt Connected"));
+        aci_state.data_credit_available = aci_state.data_credit_total;
+
+        /*
+        Get the device version of the nRF8001 and store it in the Hardware Revision String
+        */
+        lib_aci_device_version();
+        break;
+
+      case ACI_EVT_DISCONNECTED:
+        Serial.println(F("Evt Disconnected/Advertising timed out"));
+        lib_aci_connect(180/* in seconds */, 0x0050 /* advertising interval 100ms*/);
+        Serial.println(F("Advertising started"));
+        break;
+
+      case ACI_EVT_PIPE_ERROR:
+        //See the appendix in the nRF8001 Product Specication for details on the error codes
+        Serial.print(F("ACI Evt Pipe Error: Pipe #:"));
+        Serial.print(aci_evt->params.pipe_error.pipe_number, DEC);
+        Serial.print(F("  Pipe Error Code: 0x"));
+        Serial.println(aci_evt->params.pipe_error.error_code, HEX);
+        break;
+
+      case ACI_EVT_HW_ERROR:
+        Serial.println(F("HW error: "));
+        Serial.println(aci_evt->params.hw_error.line_num, DEC);
+
+        for(uint8_t counter = 0; counter <= (aci_evt->len - 3); counter++)
+        {
+          Serial.write(aci_evt->params.hw_error.file_name[counter]); //uint8_t file_name[20];
+        }
+        Serial.println();
+        lib_aci_connect(180/* in seconds */, 0x0050 /* advertising interval 100ms*/);
+        Serial.println(F("Advertising started"));
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  /* setup_required is set to true when the device starts up and enters setup mode.
+   * It indicates that do_aci_setup() should be called. The flag should be cleared if
+   * do_aci_setup() returns ACI_STATUS_TRANSACTION_COMPLETE.
+   */
+  if(setup_required)
+  {
+    if (SETUP_SUCCESS == do_aci_setup(&aci_state))
+    {
+      setup_required = false;
+    }
+  }
+}
+
+void loop()
+{
+  aci_loop();
+
+  //The application sends here, the diagnostics take the credits it leaves
+  aci_diag_poll(&diag, &aci_state);
+}
@@ -0,0 +1,5 @@
+del services.h
+del services_lock.h
+del ublue_setup.gen.out.txt
+
+"%NRFGOSTUDIOPATH%\nrfgostudio.exe" -nrf8001 -g Diagnostics.xml -codeGenVersion 1 -o .
\ No newline at end of file
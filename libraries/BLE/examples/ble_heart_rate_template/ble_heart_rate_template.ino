@@ -69,7 +69,6 @@ static aci_state_t aci_state;
 static hal_aci_evt_t aci_data;
 static hal_aci_data_t aci_cmd;
 
-static bool radio_ack_pending  = false;
 static bool timing_change_done = false;
 
 /* Define how assert should function in the BLE library */
@@ -227,7 +226,6 @@ void aci_loop()
         break;
 
       case ACI_EVT_CONNECTED:
-        radio_ack_pending  = false;
         timing_change_done = false;
         aci_state.data_credit_available = aci_state.data_credit_total;
         Serial.println(F("Evt Connected"));
@@ -235,12 +233,11 @@ void aci_loop()
 
 
       case ACI_EVT_DATA_CREDIT:
-        aci_state.data_credit_available = aci_state.data_credit_available + aci_evt->params.data_credit.credit;
+        //aci_state.data_credit_available is updated by the ACI Library
         /**
         Bluetooth Radio ack received from the peer radio for the data packet sent.
         This also signals that the buffer used by the nRF8001 for the data packet is available again.
         */
-        radio_ack_pending = false;
         break;
 
       case ACI_EVT_PIPE_ERROR:
@@ -250,21 +247,12 @@ void aci_loop()
         Measurement characteristic.
         This can also happen when the link is disconnected after the data packet has been sent.
         */
-        radio_ack_pending = false;
 
         //See the appendix in the nRF8001 Product Specication for details on the error codes
         Serial.print(F("ACI Evt Pipe Error: Pipe #:"));
         Serial.print(aci_evt->params.pipe_error.pipe_number, DEC);
         Serial.print(F("  Pipe Error Code: 0x"));
         Serial.println(aci_evt->params.pipe_error.error_code, HEX);
-
-        //Increment the credit available as the data packet was not sent.
-        //The pipe error also represents the Attribute protocol Error Response sent from the peer and that should not be counted
-        //for the credit.
-        if (ACI_STATUS_ERROR_PEER_ATT_ERROR != aci_evt->params.pipe_error.error_code)
-        {
-          aci_state.data_credit_available++;
-        }
         break;
 
        case ACI_EVT_DISCONNECTED:
@@ -336,23 +324,21 @@ void hook_for_resetting_energy_expended(void)
 
 void loop()
 {
-  static uint8_t dummy_heart_rate = 65;
+  static uint8_t       dummy_heart_rate = 65;
+  static unsigned long beat_ms          = 0;
+  unsigned long        now_ms;
 
   aci_loop();
 
-  if (lib_aci_is_pipe_available(&aci_state, PIPE_HEART_RATE_HEART_RATE_MEASUREMENT_TX)
-      && (false == radio_ack_pending)
-      && (true == timing_change_done))
+  /*
+  A dummy beat every 60000 / dummy_heart_rate ms, with its RR-Interval in 1/1024 seconds.
+  The beats are sent once per connection interval, several RR-Intervals in a measurement.
+  */
+  now_ms = millis();
+  if ((now_ms - beat_ms) >= (60000UL / dummy_heart_rate))
   {
-    heart_rate_set_support_contact_bit();
-    heart_rate_set_contact_status_bit();
-    if (heart_rate_send_hr((uint8_t)dummy_heart_rate))
-    {
-      aci_state.data_credit_available--;
-      Serial.print(F("HRM sent: "));
-      Serial.println(dummy_heart_rate);
-      radio_ack_pending = true;
-    }
+    beat_ms = now_ms;
+    heart_rate_stream_beat(dummy_heart_rate, (uint16_t)((60UL * 1024) / dummy_heart_rate));
 
     dummy_heart_rate++;
     if (dummy_heart_rate == 200)
@@ -360,5 +346,14 @@ void loop()
       dummy_heart_rate = 65;
     }
   }
-}
 
+  if (true == timing_change_done)
+  {
+    heart_rate_set_support_contact_bit();
+    heart_rate_set_contact_status_bit();
+    if (heart_rate_stream_poll(&aci_state))
+    {
+      Serial.println(F("HRM sent"));
+    }
+  }
+}
@@ -32,6 +32,16 @@
 
 static uint8_t current_heart_rate_data[HR_MAX_PAYLOAD];
 
+/* The beats given to heart_rate_stream_beat() and not sent yet */
+static uint16_t      stream_rr_intervals[HEART_RATE_STREAM_RR_MAX];
+static uint8_t       stream_rr_first;
+static uint8_t       stream_rr_count;
+static uint16_t      stream_hr;
+static bool          stream_hr_pending;
+static uint16_t      stream_expended_energy;
+static bool          stream_expended_energy_pending;
+static unsigned long stream_sent_ms;
+
 void heart_rate_init()
 {
   uint8_t i;
@@ -39,6 +49,10 @@ void heart_rate_init()
   {
     current_heart_rate_data[i] = 0;
   }
+  stream_rr_first                = 0;
+  stream_rr_count                = 0;
+  stream_hr_pending              = false;
+  stream_expended_energy_pending = false;
 }
 
 void heart_rate_set_support_contact_bit()
@@ -189,6 +203,96 @@ bool heart_rate_send_hr_16bits_expended_energy_rr_interval(uint16_t meas_hr, uin
                            (uint8_t *)&current_heart_rate_data[0] ,data_index);
 }
 
+void heart_rate_stream_beat(uint16_t meas_hr, uint16_t rr_interval)
+{
+  stream_hr         = meas_hr;
+  stream_hr_pending = true;
+  if (0 == rr_interval)
+  {
+    return;
+  }
+
+  if (HEART_RATE_STREAM_RR_MAX == stream_rr_count)
+  {
+    stream_rr_first = (stream_rr_first + 1) % HEART_RATE_STREAM_RR_MAX;
+    stream_rr_count--;
+  }
+  stream_rr_intervals[(stream_rr_first + stream_rr_count) % HEART_RATE_STREAM_RR_MAX] = rr_interval;
+  stream_rr_count++;
+}
+
+void heart_rate_stream_expended_energy(uint16_t expended_energy)
+{
+  stream_expended_energy         = expended_energy;
+  stream_expended_energy_pending = true;
+}
+
+bool heart_rate_stream_poll(aci_state_t *aci_stat)
+{
+  const unsigned long now_ms = millis();
+  uint8_t data[ACI_PIPE_TX_DATA_MAX_LEN];
+  uint8_t data_index = 1;
+  uint8_t nb_intervals;
+  uint8_t i;
+  uint16_t rr_interval;
+
+  // Once per connection interval, the beats of the interval go in one measurement
+  if (!stream_hr_pending ||
+      ((now_ms - stream_sent_ms) < (((unsigned long)aci_stat->connection_interval * 5) / 4)) ||
+      (0 == aci_stat->data_credit_available) ||
+      !lib_aci_is_pipe_available(aci_stat, PIPE_HEART_RATE_HEART_RATE_MEASUREMENT_TX))
+  {
+    return false;
+  }
+
+  data[0] = current_heart_rate_data[0] &
+            (HEART_RATE_FLAGS_T_SENSOR_CONTACT_STATUS | HEART_RATE_FLAGS_T_SENSOR_CONTACT_SUPPORT);
+  if (stream_hr > 0xFF)
+  {
+    data[0] |= HEART_RATE_FLAGS_MEAS_SIZE_BIT;
+    data[data_index++] = (uint8_t)stream_hr;
+    data[data_index++] = (uint8_t)(stream_hr>>8);
+  }
+  else
+  {
+    data[data_index++] = (uint8_t)stream_hr;
+  }
+  if (stream_expended_energy_pending)
+  {
+    data[0] |= HEART_RATE_FLAGS_ENERGY_EXPENDED_STATUS_BIT;
+    data[data_index++] = (uint8_t)stream_expended_energy;
+    data[data_index++] = (uint8_t)(stream_expended_energy>>8);
+  }
+
+  nb_intervals = (ACI_PIPE_TX_DATA_MAX_LEN - data_index) / 2;
+  if (nb_intervals > stream_rr_count)
+  {
+    nb_intervals = stream_rr_count;
+  }
+  if (0 != nb_intervals)
+  {
+    data[0] |= HEART_RATE_FLAGS_RR_INTERVAL_SUPPORT_BIT;
+  }
+  for (i = 0; i < nb_intervals; i++)
+  {
+    rr_interval = stream_rr_intervals[(stream_rr_first + i) % HEART_RATE_STREAM_RR_MAX];
+    data[data_index++] = (uint8_t) (rr_interval);
+    data[data_index++] = (uint8_t)((rr_interval)>>8);
+  }
+
+  if (!lib_aci_send_data(PIPE_HEART_RATE_HEART_RATE_MEASUREMENT_TX, &data[0], data_index))
+  {
+    return false;
+  }
+
+  stream_rr_first                = (stream_rr_first + nb_intervals) % HEART_RATE_STREAM_RR_MAX;
+  stream_rr_count               -= nb_intervals;
+  stream_expended_energy_pending = false;
+  stream_hr_pending              = (0 != stream_rr_count);
+  stream_sent_ms                 = now_ms;
+  return true;
+}
+
 #ifdef PIPE_HEART_RATE_HEART_RATE_CONTROL_POINT_RX_ACK
 void heart_rate_pipes_updated_evt_rcvd(aci_state_t *aci_stat, uint8_t pipe_num, uint8_t *buffer)
 {
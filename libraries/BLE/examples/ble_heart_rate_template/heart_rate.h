@@ -43,6 +43,13 @@
 #define HR_MAX_PAYLOAD 19
 
 
+/** HEART RATE Number of RR-Intervals kept by heart_rate_stream_beat() until they are sent.
+*   Beyond it the oldest are dropped.
+*/
+#ifndef HEART_RATE_STREAM_RR_MAX
+#define HEART_RATE_STREAM_RR_MAX 16
+#endif
+
 /** HEART RATE Flags */
 /**HEART RATE FLAGS bit 0: Heart Rate Value Format bit, if 0 then Heart Rate on 8 bits; if 1 then Heart Rate on 16 bits.*/
 #define HEART_RATE_FLAGS_MEAS_SIZE_BIT                           0x01     
@@ -154,6 +161,27 @@ bool heart_rate_send_hr_expended_energy_rr_interval(uint8_t meas_hr, uint16_t ex
  */
 bool heart_rate_send_hr_16bits_expended_energy_rr_interval(uint16_t meas_hr, uint16_t expended_energy, uint16_t *p_rr_intervals, uint8_t nb_intervals);
 
+/** @brief Function to give a heart beat to the heart rate stream.
+ *  @details The measurement is sent by heart_rate_stream_poll() with the RR-Intervals of all the
+ *  beats given since the previous one.
+ *  @param meas_hr Measured heart_rate, sent on 16 bits when above 255.
+ *  @param rr_interval RR-Interval of the beat in 1/1024 seconds, 0 when it is not known.
+ */
+void heart_rate_stream_beat(uint16_t meas_hr, uint16_t rr_interval);
+
+/** @brief Function to add the expended energy to the next measurement of the heart rate stream.
+ *  @param expended_energy Measured expended energy.
+ */
+void heart_rate_stream_expended_energy(uint16_t expended_energy);
+
+/** @brief Function to send the heart rate stream, call it from the loop.
+ *  @details At most one measurement is sent per connection interval. It holds the last heart rate
+ *  and as many RR-Intervals as fit in the 20 bytes: 9, one less with a 16 bits heart rate and one
+ *  less with the expended energy. The RR-Intervals left go in the next one.
+ *  @return : True when a measurement is placed in the ACI command queue
+ */
+bool heart_rate_stream_poll(aci_state_t *aci_stat);
+
 /** @brief Function to check received data
  *  @details Call this function each time data is received (on @c ACI_EVT_DATA_RECEIVED on the control point pipe ).
  *  If the control point is received with the bits indicating to reset Expended Energy, then 
@@ -168,10 +168,7 @@ void print_battery_measurement_data(void)
 
 void send_battery_update(aci_state_t *aci_state, uint8_t percent_level)
 {
-  if (lib_aci_send_data(PIPE_BATTERY_BATTERY_LEVEL_TX, &percent_level, sizeof(percent_level)))        //Sending battery level over the air
-  {
-    aci_state->data_credit_available--;
-  }
+  lib_aci_send_data(PIPE_BATTERY_BATTERY_LEVEL_TX, &percent_level, sizeof(percent_level));        //Sending battery level over the air
 }
 
 
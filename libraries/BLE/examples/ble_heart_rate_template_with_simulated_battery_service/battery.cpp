@@ -78,10 +78,7 @@ void update_battery(aci_state_t *aci_stat, uint8_t percent_level)
     if(lib_aci_is_pipe_available(aci_stat, PIPE_BATTERY_BATTERY_LEVEL_TX))
     {
       //Serial.print(F("    Sending battery level over the air ..."));
-      if (lib_aci_send_data(PIPE_BATTERY_BATTERY_LEVEL_TX, &percent_level, sizeof(percent_level)))
-      {
-        aci_stat->data_credit_available--;
-      }
+      lib_aci_send_data(PIPE_BATTERY_BATTERY_LEVEL_TX, &percent_level, sizeof(percent_level));
     }
     previous_battery_level = percent_level;
   }  
@@ -134,10 +134,7 @@ void perform_heart_rate_simulation(void)
   {
     heart_rate_set_support_contact_bit();
     heart_rate_set_contact_status_bit();
-    if (heart_rate_send_hr((uint8_t)dummy_heart_rate))
-    {
-      aci_state.data_credit_available--;
-    }
+    heart_rate_send_hr((uint8_t)dummy_heart_rate);
     radio_ack_pending = true;
 
     dummy_heart_rate++;
@@ -361,7 +358,7 @@ void aci_loop()
 
 
       case ACI_EVT_DATA_CREDIT:
-        aci_state.data_credit_available = aci_state.data_credit_available + aci_evt->params.data_credit.credit;
+        //aci_state.data_credit_available is updated by the ACI Library
         /**
         Bluetooth Radio ack received from the peer radio for the data packet sent.
         This also signals that the buffer used by the nRF8001 for the data packet is available again.
@@ -372,13 +369,6 @@ void aci_loop()
       case ACI_EVT_PIPE_ERROR:
         //See the appendix in the nRF8001 Product Specication for details on the error codes
 
-        //Increment the credit available as the data packet was not sent.
-        //The pipe error also represents the Attribute protocol Error Response sent from the peer and that should not be counted
-        //for the credit.
-        if (ACI_STATUS_ERROR_PEER_ATT_ERROR != aci_evt->params.pipe_error.error_code)
-        {
-          aci_state.data_credit_available++;
-        }
         /**
         Send data failed. ACI_EVT_DATA_CREDIT will not come.
         This can happen if the pipe becomes unavailable by the peer unsubscribing to the Heart Rate
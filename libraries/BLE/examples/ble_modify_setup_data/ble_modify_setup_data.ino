@@ -58,6 +58,7 @@ The following instructions describe the steps to be made on the Windows PC:
 #include <SPI.h>
 #include <lib_aci.h>
 #include <aci_setup.h>
+#include <aci_crc.h>
 
 /**
 Put the nRF8001 setup in the RAM of the nRF8001.
@@ -134,24 +135,6 @@ Initialize the radio_ack. This is the ack received for every transmitted packet.
 */
 //static bool radio_ack_pending = false;
 
-/** crc function to re-calulate the CRC after making changes to the setup data.
-*/
-uint16_t crc_16_ccitt(uint16_t crc, uint8_t * data_in, uint16_t data_len) {
-
-  uint16_t i;
-
-  for(i = 0; i < data_len; i++)
-  {
-    crc  = (unsigned char)(crc >> 8) | (crc << 8);
-    crc ^= pgm_read_byte(&data_in[i]);
-    crc ^= (unsigned char)(crc & 0xff) >> 4;
-    crc ^= (crc << 8) << 4;
-    crc ^= ((crc & 0xff) << 4) << 1;
-  }
-
-  return crc;
-}
-
 
 /*
 Description:
@@ -168,7 +151,7 @@ The ACI Evt Data Credit provides the radio level ack of a transmitted packet.
 */
 void setup(void)
 {
-  uint16_t crc_seed = 0xFFFF;
+  uint16_t crc_seed = ACI_CRC16_CCITT_INIT;
   uint8_t msg_len;
   uint8_t crc_loop;
 
@@ -199,7 +182,7 @@ void setup(void)
     }
     Serial.print(F("0x"));
     Serial.println(msg_len, HEX);
-    crc_seed = crc_16_ccitt(crc_seed, &setup_msgs[crc_loop].buffer[0], msg_len);
+    crc_seed = aci_crc16_ccitt_P(crc_seed, &setup_msgs[crc_loop].buffer[0], msg_len);
   }
   Serial.print(F("0x"));
   Serial.println(crc_seed, HEX);
@@ -250,7 +233,6 @@ void setup(void)
 void uart_tx()
 {
   lib_aci_send_data(PIPE_UART_OVER_BTLE_UART_TX_TX, uart_buffer, uart_buffer_len);
-  aci_state.data_credit_available--;
 }
 
 void aci_loop()
@@ -390,7 +372,7 @@ void aci_loop()
         break;
 
       case ACI_EVT_DATA_CREDIT:
-        aci_state.data_credit_available = aci_state.data_credit_available + aci_evt->params.data_credit.credit;
+        //aci_state.data_credit_available is updated by the ACI Library
         break;
 
       case ACI_EVT_PIPE_ERROR:
@@ -399,14 +381,6 @@ void aci_loop()
         Serial.print(aci_evt->params.pipe_error.pipe_number, DEC);
         Serial.print(F("  Pipe Error Code: 0x"));
         Serial.println(aci_evt->params.pipe_error.error_code, HEX);
-
-        //Increment the credit available as the data packet was not sent.
-        //The pipe error also represents the Attribute protocol Error Response sent from the peer and that should not be counted
-        //for the credit.
-        if (ACI_STATUS_ERROR_PEER_ATT_ERROR != aci_evt->params.pipe_error.error_code)
-        {
-          aci_state.data_credit_available++;
-        }
         break;
 
       case ACI_EVT_HW_ERROR:
@@ -42,6 +42,7 @@ The following instructions describe the steps to be made on the Windows PC:
 #include <SPI.h>
 #include <lib_aci.h>
 #include <aci_setup.h>
+#include <aci_run.h>
 
 /**
 Put the nRF8001 setup in the RAM of the nRF8001.
@@ -56,7 +57,7 @@ However this removes the need to do the setup of the nRF8001 on every reset.
 
 #ifdef SERVICES_PIPE_TYPE_MAPPING_CONTENT
     static services_pipe_type_mapping_t
-        services_pipe_type_mapping[NUMBER_OF_PIPES] = SERVICES_PIPE_TYPE_MAPPING_CONTENT;
+        services_pipe_type_mapping[NUMBER_OF_PIPES] ACI_PIPE_MAP_PROGMEM = SERVICES_PIPE_TYPE_MAPPING_CONTENT;
 #else
     #define NUMBER_OF_PIPES 0
     static services_pipe_type_mapping_t * services_pipe_type_mapping = NULL;
@@ -75,8 +76,15 @@ static hal_aci_data_t setup_msgs[NB_SETUP_MESSAGES] PROGMEM = SETUP_MESSAGES_CON
 // Current State of the the GATT client (Service Discovery)
 // Status of the bond (R) Peer address
 static struct aci_state_t aci_state;
-static hal_aci_evt_t aci_data;
-//static hal_aci_data_t aci_cmd;
+
+static void aci_event_handler(aci_state_t *aci_stat, const aci_evt_t *aci_evt);
+
+/**
+aci_run() starts the advertising for 180 seconds every 100ms in Standby and after a disconnect,
+and never sleeps as the interface is polled.
+*/
+static const aci_run_params_t aci_run_params = { true, 180, 0x0100, ACI_RUN_NO_SLEEP, aci_event_handler };
+static aci_run_t aci_runner;
 
 /* Define how assert should function in the BLE library */
 void __ble_assert(const char *file, uint16_t line)
@@ -144,144 +152,97 @@ void setup(void)
   */
   //The second parameter is for turning debug printing on for the ACI Commands and Events so they be printed on the Serial
   lib_aci_init(&aci_state, false);
+  aci_run_init(&aci_runner, &aci_run_params);
 }
 
 
-void loop()
+/**
+Called by aci_run() with every ACI event, once the start up, the setup, the advertising and the
+data credits have been taken care of.
+*/
+static void aci_event_handler(aci_state_t *aci_stat, const aci_evt_t *aci_evt)
 {
-  static bool setup_required = false;
-
-  // We enter the if statement only when there is a ACI event available to be processed
-  if (lib_aci_event_get(&aci_state, &aci_data))
+  switch(aci_evt->evt_opcode)
   {
-    aci_evt_t * aci_evt;
-
-    aci_evt = &aci_data.evt;
-    switch(aci_evt->evt_opcode)
-    {
-      /**
-      As soon as you reset the nRF8001 you will get an ACI Device Started Event
-      */
-      case ACI_EVT_DEVICE_STARTED:
+    case ACI_EVT_DEVICE_STARTED:
+      switch(aci_evt->params.device_started.device_mode)
       {
-        aci_state.data_credit_available = aci_evt->params.device_started.credit_available;
-        switch(aci_evt->params.device_started.device_mode)
-        {
-          case ACI_DEVICE_SETUP:
-            /**
-            When the device is in the setup mode
-            */
-            Serial.println(F("Evt Device Started: Setup"));
-            setup_required = true;
-            break;
-
-          case ACI_DEVICE_STANDBY:
-            Serial.println(F("Evt Device Started: Standby"));
-            if (aci_evt->params.device_started.hw_error)
-            {
-              delay(20); //Magic number used to make sure the HW error event is handled correctly.
-            }
-            else
-            {
-            lib_aci_connect(180/* in seconds */, 0x0100 /* advertising interval 100ms*/);
-            Serial.println(F("Advertising started"));
-            }
-            break;
-        }
-      }
-        break; //ACI Device Started Event
-
-      case ACI_EVT_CMD_RSP:
-        //If an ACI command response event comes with an error -> stop
-        if (ACI_STATUS_SUCCESS != aci_evt->params.cmd_rsp.cmd_status)
-        {
-          //ACI ReadDynamicData and ACI WriteDynamicData will have status codes of
-          //TRANSACTION_CONTINUE and TRANSACTION_COMPLETE
-          //all other ACI commands will have status code of ACI_STATUS_SCUCCESS for a successful command
-          Serial.print(F("ACI Command "));
-          Serial.println(aci_evt->params.cmd_rsp.cmd_opcode, HEX);
-          Serial.println(F("Evt Cmd respone: Error. Arduino is in an while(1); loop"));
-          while (1);
-        }
-        break;
-
-      case ACI_EVT_CONNECTED:
-        Serial.println(F("Evt Connected"));
-        break;
+        case ACI_DEVICE_SETUP:
+          Serial.println(F("Evt Device Started: Setup"));
+          break;
 
-      case ACI_EVT_PIPE_STATUS:
-        Serial.println(F("Evt Pipe Status"));
-        break;
+        case ACI_DEVICE_STANDBY:
+          Serial.println(F("Evt Device Started: Standby"));
+          break;
+      }
+      break;
 
-      case ACI_EVT_DISCONNECTED:
-        Serial.println(F("Evt Disconnected/Advertising timed out"));
-        lib_aci_connect(180/* in seconds */, 0x0100 /* advertising interval 100ms*/);
+    case ACI_EVT_CMD_RSP:
+      //ACI ReadDynamicData and ACI WriteDynamicData will have status codes of
+      //TRANSACTION_CONTINUE and TRANSACTION_COMPLETE
+      //all other ACI commands will have status code of ACI_STATUS_SCUCCESS for a successful command
+      if (ACI_STATUS_SUCCESS != aci_evt->params.cmd_rsp.cmd_status)
+      {
+        Serial.print(F("ACI Command "));
+        Serial.print(aci_evt->params.cmd_rsp.cmd_opcode, HEX);
+        Serial.print(F(" Evt Cmd respone: Error 0x"));
+        Serial.println(aci_evt->params.cmd_rsp.cmd_status, HEX);
+      }
+      else if (ACI_CMD_CONNECT == aci_evt->params.cmd_rsp.cmd_opcode)
+      {
         Serial.println(F("Advertising started"));
-        break;
-
-      case ACI_EVT_PIPE_ERROR:
-        //See the appendix in the nRF8001 Product Specication for details on the error codes
-        Serial.print(F("ACI Evt Pipe Error: Pipe #:"));
-        Serial.print(aci_evt->params.pipe_error.pipe_number, DEC);
-        Serial.print(F("  Pipe Error Code: 0x"));
-        Serial.println(aci_evt->params.pipe_error.error_code, HEX);
-
-        //Increment the credit available as the data packet was not sent.
-        //The pipe error also represents the Attribute protocol Error Response sent from the peer and that should not be counted
-        //for the credit.
-        if (ACI_STATUS_ERROR_PEER_ATT_ERROR != aci_evt->params.pipe_error.error_code)
-        {
-          aci_state.data_credit_available++;
-        }
-        break;
-
-      case ACI_EVT_DATA_RECEIVED:
-        Serial.print(F("Pipe #: 0x"));
-        Serial.print(aci_evt->params.data_received.rx_data.pipe_number, HEX);
+      }
+      break;
+
+    case ACI_EVT_CONNECTED:
+      Serial.println(F("Evt Connected"));
+      break;
+
+    case ACI_EVT_PIPE_STATUS:
+      Serial.println(F("Evt Pipe Status"));
+      break;
+
+    case ACI_EVT_DISCONNECTED:
+      Serial.println(F("Evt Disconnected/Advertising timed out"));
+      break;
+
+    case ACI_EVT_PIPE_ERROR:
+      //See the appendix in the nRF8001 Product Specication for details on the error codes
+      Serial.print(F("ACI Evt Pipe Error: Pipe #:"));
+      Serial.print(aci_evt->params.pipe_error.pipe_number, DEC);
+      Serial.print(F("  Pipe Error Code: 0x"));
+      Serial.println(aci_evt->params.pipe_error.error_code, HEX);
+      break;
+
+    case ACI_EVT_DATA_RECEIVED:
+      Serial.print(F("Pipe #: 0x"));
+      Serial.print(aci_evt->params.data_received.rx_data.pipe_number, HEX);
+      {
+        int i=0;
+        Serial.print(F(" Data(Hex) : "));
+        for(i=0; i<aci_evt->len - 2; i++)
         {
-          int i=0;
-          Serial.print(F(" Data(Hex) : "));
-          for(i=0; i<aci_evt->len - 2; i++)
-          {
-            Serial.print(aci_evt->params.data_received.rx_data.aci_data[i], HEX);
-            Serial.print(F(" "));
-          }
+          Serial.print(aci_evt->params.data_received.rx_data.aci_data[i], HEX);
+          Serial.print(F(" "));
         }
-        Serial.println(F(""));
-        break;
+      }
+      Serial.println(F(""));
+      break;
 
-      case ACI_EVT_HW_ERROR:
-        Serial.print(F("HW error: "));
-        Serial.println(aci_evt->params.hw_error.line_num, DEC);
+    case ACI_EVT_HW_ERROR:
+      Serial.print(F("HW error: "));
+      Serial.println(aci_evt->params.hw_error.line_num, DEC);
 
-        for(uint8_t counter = 0; counter <= (aci_evt->len - 3); counter++)
-        {
-        Serial.write(aci_evt->params.hw_error.file_name[counter]); //uint8_t file_name[20];
-        }
-        Serial.println();
-        lib_aci_connect(180/* in seconds */, 0x0050 /* advertising interval 50ms*/);
-        Serial.println(F("Advertising started"));
-        break;
-    }
-  }
-  else
-  {
-    //Serial.println(F("No ACI Events available"));
-    // No event in the ACI Event queue
-    // Arduino can go to sleep now
-    // Wakeup from sleep from the RDYN line
-  }
-
-  /* setup_required is set to true when the device starts up and enters setup mode.
-   * It indicates that do_aci_setup() should be called. The flag should be cleared if
-   * do_aci_setup() returns ACI_STATUS_TRANSACTION_COMPLETE.
-   */
-  if(setup_required)
-  {
-    if (SETUP_SUCCESS == do_aci_setup(&aci_state))
-    {
-      setup_required = false;
-    }
+      for(uint8_t counter = 0; counter <= (aci_evt->len - 3); counter++)
+      {
+      Serial.write(aci_evt->params.hw_error.file_name[counter]); //uint8_t file_name[20];
+      }
+      Serial.println();
+      break;
   }
 }
 
+void loop()
+{
+  aci_run(&aci_runner, &aci_state);
+}
@@ -59,6 +59,7 @@ Note: Pin #6 on Arduino -> PAIRING CLEAR pin: Connect to 3.3v to clear the pairi
 #include <lib_aci.h>
 
 #include <aci_setup.h>
+#include <aci_dfu_handoff.h>
 #include "immediate_alert.h"
 #include "link_loss.h"
 #include <EEPROM.h>
@@ -114,6 +115,18 @@ Timing change state variable
 */
 static bool timing_change_done = false;
 
+/*
+What the bootloader needs to take over the connection
+*/
+static const aci_dfu_handoff_t dfu_handoff =
+{
+  PIPE_NORDIC_DEVICE_FIRMWARE_UPDATE_SERVICE_DFU_PACKET_RX,
+  PIPE_NORDIC_DEVICE_FIRMWARE_UPDATE_SERVICE_DFU_CONTROL_POINT_TX,
+  PIPE_NORDIC_DEVICE_FIRMWARE_UPDATE_SERVICE_DFU_CONTROL_POINT_RX_ACK_AUTO,
+  180,   /* Connection timeout in seconds */
+  0x0050 /* Advertising interval */
+};
+
 /* Define how assert should function in the BLE library */
 void __ble_assert(const char *file, uint16_t line)
 {
@@ -368,7 +381,7 @@ void aci_loop()
               }
             }
 
-            if (!bootloader_data_store(&aci_state, 180, 0x0050))
+            if (!aci_dfu_handoff_store(&aci_state, &dfu_handoff))
             {
               Serial.println(F("Unable to write connection data to EEPROM. Bootloading over BLE will not work"));
             }
@@ -511,7 +524,7 @@ void aci_loop()
         break;
 
       case ACI_EVT_DATA_CREDIT:
-        aci_state.data_credit_available = aci_state.data_credit_available + aci_evt->params.data_credit.credit;
+        //aci_state.data_credit_available is updated by the ACI Library
         break;
 
       case ACI_EVT_PIPE_ERROR:
@@ -520,14 +533,6 @@ void aci_loop()
         Serial.print(aci_evt->params.pipe_error.pipe_number, DEC);
         Serial.print(F("  Pipe Error Code: 0x"));
         Serial.println(aci_evt->params.pipe_error.error_code, HEX);
-
-        //Increment the credit available as the data packet was not sent.
-        //The pipe error also represents the Attribute protocol Error Response sent from the peer and that should not be counted
-        //for the credit.
-        if (ACI_STATUS_ERROR_PEER_ATT_ERROR != aci_evt->params.pipe_error.error_code)
-        {
-          aci_state.data_credit_available++;
-        }
         break;
 
       case ACI_EVT_HW_ERROR:
@@ -600,13 +605,18 @@ void aci_loop()
     }
   }
 
-  /* If the bootloader_jump_required flag has been set, we attempt to jump to bootloader.
-   * The bootloader_jump() function will do a series of checks before jumping.
+  /* If the bootloader_jump_required flag has been set, we jump to the bootloader
+   * as soon as all the credits are back and the DFU pipes are open.
    */
   if (bootloader_jump_required)
   {
     lib_aci_connect(180/* in seconds */, 0x0020 /* advertising interval 20ms*/);
-    bootloader_jump();
+    if (aci_dfu_handoff_is_ready(&aci_state, &dfu_handoff))
+    {
+      Serial.println(F("Jumping to bootloader"));
+      Serial.flush();
+      aci_dfu_handoff_jump(&aci_state, &dfu_handoff);
+    }
   }
 }
 
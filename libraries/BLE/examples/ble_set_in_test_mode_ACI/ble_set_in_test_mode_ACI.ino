@@ -33,11 +33,14 @@
 @details
 This project is to put the nRF8001 in test mode and enable the nRF8001 to accept DTM commands over ACI using the Arduino serial interface.
 Note: Serial Event is NOT compatible with Leonardo, Micro, Esplora
+Send the line "S" to run a sweep of receiver and transmitter tests over the 40 RF channels against a DTM tester,
+see aci_dtm.h. The packet counts are printed, one line per test.
 @todo: Test this to make sure it works with both the pyhon script and nRFgo studio: You can send the DTM commands from the nRFgo studio or from a Nordic Semiconductor supplied python script on a Windows PC.
  */
 #include <SPI.h>
 #include <hal_aci_tl.h>
 #include <lib_aci.h>
+#include <aci_dtm.h>
 
 // aci_struct that will contain
 // total initial credits
@@ -63,6 +66,24 @@ boolean stringComplete = false;  // whether the string is complete
 uint8_t stringIndex = 0;         //Initialize the index to store incoming chars
 boolean dtmMode = false;         //is the device in dtm mode
 
+static void dtm_result_print(const aci_dtm_result_t *p_result);
+static void dtm_report_print(const aci_dtm_report_t *p_report);
+
+/*
+Sweep of the 40 channels, a receiver test and a PRBS9 transmitter test of 50 ms on each
+*/
+static const aci_dtm_params_t dtm_params =
+{
+  0, 39, 1,
+  ACI_DTM_MODE_RX | ACI_DTM_MODE_TX,
+  (1 << DTM_LE_PKT_PRBS9),
+  37,
+  50,
+  dtm_result_print,
+  dtm_report_print
+};
+static aci_dtm_t dtm;
+
 /* Define how assert should function in the BLE library */
 void __ble_assert(const char *file, uint16_t line)
 {
@@ -111,6 +132,7 @@ void setup(void)
   //and initialize the data structures required to setup the nRF8001
   //The second parameter is for turning debug printing on for the ACI Commands and Events so they be printed on the Serial
   lib_aci_init(&aci_state, false);
+  aci_dtm_init(&dtm, &dtm_params);
 
   Serial.println(F("nRF8001 Reset done"));
 }
@@ -168,7 +190,7 @@ void aci_loop(void)
           Serial.println(F("Evt Cmd respone: Error. Arduino is in an while(1); loop"));
           while (1);
         }
-        else if (ACI_CMD_DTM_CMD == aci_evt->params.cmd_rsp.cmd_opcode)
+        else if ((ACI_CMD_DTM_CMD == aci_evt->params.cmd_rsp.cmd_opcode) && !aci_dtm_running(&dtm))
         {
           dtm_report[0] = aci_evt->params.cmd_rsp.params.dtm_cmd.evt_msb;
           dtm_report[1] = aci_evt->params.cmd_rsp.params.dtm_cmd.evt_lsb;
@@ -176,6 +198,8 @@ void aci_loop(void)
         }
         break;
     }
+
+    aci_dtm_event(&dtm, &aci_state, aci_evt);
   }
   else
   {
@@ -191,7 +215,18 @@ void dtm_command_loop(void)
     // print the string when a newline arrives:
     if (stringComplete) 
     {
-      if (uart_buffer_len > 2)
+      if ((1 == uart_buffer_len) && ('S' == uart_buffer[0]))
+      {
+        if (aci_dtm_start(&dtm))
+        {
+          Serial.println(F("DTM sweep started"));
+        }
+      }
+      else if (aci_dtm_running(&dtm))
+      {
+        Serial.println(F("DTM sweep running"));
+      }
+      else if (uart_buffer_len > 2)
       {
         Serial.println(F("DTM command to long")); //Not compatible with DTM tester?
       }
@@ -218,6 +253,7 @@ void loop()
 {
    //Process any ACI commands or events
   aci_loop();
+  aci_dtm_poll(&dtm);
 
   //Process any DTM command, DTM Events is processed in the aci_loop
   dtm_command_loop();
@@ -231,6 +267,38 @@ void loop()
   #endif
 }
 
+static void dtm_result_print(const aci_dtm_result_t *p_result)
+{
+  Serial.print((ACI_DTM_MODE_RX == p_result->mode) ? F("RX ") : F("TX "));
+  Serial.print(p_result->channel, DEC);
+  if (!p_result->success)
+  {
+    Serial.println(F(" failed"));
+  }
+  else
+  {
+    Serial.print(F(" "));
+    Serial.println(p_result->packets, DEC);
+  }
+}
+
+static void dtm_report_print(const aci_dtm_report_t *p_report)
+{
+  Serial.print(F("DTM sweep: "));
+  Serial.print(p_report->tests, DEC);
+  Serial.print(F(" tests, "));
+  Serial.print(p_report->failures, DEC);
+  Serial.print(F(" failed, RX packets "));
+  Serial.print(p_report->rx_packets, DEC);
+  Serial.print(F(", worst channel "));
+  Serial.print(p_report->rx_channel_min, DEC);
+  Serial.print(F(" with "));
+  Serial.print(p_report->rx_packets_min, DEC);
+  Serial.print(F(", "));
+  Serial.print(p_report->duration_ms, DEC);
+  Serial.println(F(" ms"));
+}
+
 /*
  COMMENT ONLY FOR ARDUINO
  SerialEvent occurs whenever a new data comes in the
@@ -48,6 +48,7 @@
 #include <lib_aci.h>
 
 #include <aci_setup.h>
+#include <aci_sampler.h>
 #include "health_thermometer.h"
 #include "timer1.h"
 
@@ -59,8 +60,6 @@
   static services_pipe_type_mapping_t * services_pipe_type_mapping = NULL;
 #endif
 
-#define TEMPERATURE_NUM_SAMPLES  10
-
 static hal_aci_data_t setup_msgs[NB_SETUP_MESSAGES] PROGMEM = SETUP_MESSAGES_CONTENT;
 // aci_struct that will contain
 // total initial credits
@@ -87,12 +86,15 @@ Variables used for the temperature measurement and transmission
 //static h_thermo_temp_measure_t h_temperature;
 //static h_temp_type_t current_type;
 
-static int32_t temperature = 0; // Needs to be an int32 to measure negative values
-static float temperature_f;
-static uint8_t temperature_count = TEMPERATURE_NUM_SAMPLES;
-static int32_t temperature_total = 0;
 static bool ack_temp_measure_pending = false; /* Initial value */
 
+/*
+The nRF8001 temperature is sampled every 400 ms in the background, the measurement sent every
+4 seconds is the average of about the last 8 samples
+*/
+static const aci_sampler_params_t sampler_params = { 400, 0, 3 };
+static aci_sampler_t sampler;
+
 /*
 Variables used for the timer on the AVR
 */
@@ -118,6 +120,7 @@ void aci_loop()
   {
     aci_evt_t * aci_evt;
     aci_evt = &aci_data.evt;
+    aci_sampler_event(&sampler, &aci_state, aci_evt);
 
     switch(aci_evt->evt_opcode)
     {
@@ -168,47 +171,6 @@ void aci_loop()
           Serial.println(F("Evt Cmd respone: Error. Arduino is in an while(1); loop"));
           while (1);
         }
-        else
-        {
-          switch (aci_evt->params.cmd_rsp.cmd_opcode)
-          {
-            case ACI_CMD_GET_TEMPERATURE:
-              if (0 != temperature_count)
-              {
-                temperature_total  = temperature_total +
-                                    (aci_evt->params.cmd_rsp.params.get_temperature.temperature_value);
-                Serial.print(F("Sampling Temperature "));
-                Serial.print(temperature_count);
-                Serial.print(F(" "));
-                Serial.println(aci_evt->params.cmd_rsp.params.get_temperature.temperature_value);
-                temperature_count--;
-              }
-              if (0 == temperature_count)
-              {
-                Serial.println(temperature_total);
-                temperature_count = TEMPERATURE_NUM_SAMPLES;
-                /**
-                Multiply by 100 for exp = -2 : divide by 4 -> See ACI GetTemperature in datasheet
-                */
-                temperature = temperature_total * (float)(25/(float)TEMPERATURE_NUM_SAMPLES);
-                temperature_total = 0;
-                temperature_f = (float)temperature/100.00;
-                Serial.print(F("Temperature :"));
-                Serial.print(temperature_f, 2);
-                Serial.println(" C");
-                if (lib_aci_is_pipe_available(&aci_state, PIPE_HEALTH_THERMOMETER_TEMPERATURE_MEASUREMENT_TX_ACK))
-                {
-                  Serial.println(F("Sending the temperature"));
-                  temperature &= 0x00FFFFFF; //Mask the exponent part
-                  temperature |= 0xFE000000; //Exponent is -2 since we multipled by 100
-                  health_thermometer_send_measure(temperature);
-                  //We cannot send a new temperature measurement Indiction until we get back an ACK for it.
-                  ack_temp_measure_pending = true;
-                }
-              }
-              break;
-          }
-        }
         break;
 
       case ACI_EVT_CONNECTED:
@@ -272,14 +234,6 @@ void aci_loop()
         Serial.print(aci_evt->params.pipe_error.pipe_number, DEC);
         Serial.print(F("  Pipe Error Code: 0x"));
         Serial.println(aci_evt->params.pipe_error.error_code, HEX);
-
-        //Increment the credit available as the data packet was not sent.
-        //The pipe error also represents the Attribute protocol Error Response sent from the peer and that should not be counted
-        //for the credit.
-        if (ACI_STATUS_ERROR_PEER_ATT_ERROR != aci_evt->params.pipe_error.error_code)
-        {
-          aci_state.data_credit_available++;
-        }
         break;
 
 
@@ -397,31 +351,45 @@ void setup(void)
    */
   health_thermometer_init();
   health_thermometer_set_unit_c();
+
+  aci_sampler_init(&sampler, &sampler_params);
 }
 
 void loop()
 {
   aci_loop();
+  aci_sampler_poll(&sampler, &aci_state);
 
   /**
-  Temperature sampling application that samples the temperature every 4 seconds
+  Temperature application that sends the sampled temperature every 4 seconds
   OR
   Wakes up the sleeping nRF8001 every 4 seconds
   */
   if (1 == timer1_f)
   {
-    uint8_t i = 0;
+    aci_sampler_value_t value;
     timer1_f  = 0;
 
     if((ACI_DEVICE_STANDBY == aci_state.device_state)
         && (lib_aci_is_pipe_available(&aci_state, PIPE_HEALTH_THERMOMETER_TEMPERATURE_MEASUREMENT_TX_ACK))
-        && (false == ack_temp_measure_pending))
+        && (false == ack_temp_measure_pending)
+        && aci_sampler_temperature_get(&sampler, &value))
     {
-      for(i=0; i<TEMPERATURE_NUM_SAMPLES; i++)
-      {
-        Serial.println(F("Get temperature from nRF8001 sensor"));
-        lib_aci_get_temperature();
-      }
+      int32_t temperature = value.average; // Already multiplied by 100 for exp = -2
+
+      Serial.print(F("Temperature in 0.01 C: "));
+      Serial.print(value.average);
+      Serial.print(F(" min "));
+      Serial.print(value.min);
+      Serial.print(F(" max "));
+      Serial.println(value.max);
+
+      Serial.println(F("Sending the temperature"));
+      temperature &= 0x00FFFFFF; //Mask the exponent part
+      temperature |= 0xFE000000; //Exponent is -2 since we multipled by 100
+      health_thermometer_send_measure(temperature);
+      //We cannot send a new temperature measurement Indiction until we get back an ACK for it.
+      ack_temp_measure_pending = true;
     }
 
     if(ACI_DEVICE_SLEEP == aci_state.device_state)
@@ -40,8 +40,8 @@ The following instructions describe the steps to be made on the Windows PC:
 -# You can use the nRF UART app in the Apple iOS app store and Google Play for Android 4.3 for Samsung Galaxy S4
    with this UART template app
 
--# You can send data from the Arduino serial monitor, maximum length of a string is 19 bytes
-   Set the line ending to "Newline" in the Serial monitor (The newline is also sent over the air
+-# Whatever is typed in the Arduino serial monitor is sent over the air, in packets of up to 20 bytes.
+   What the peer writes on the UART RX characteristic is printed on the serial monitor.
 
  *
  * Click on the "Serial Monitor" button on the Arduino IDE to reset the Arduino and start the application.
@@ -62,6 +62,7 @@ The following instructions describe the steps to be made on the Windows PC:
 #include <SPI.h>
 #include <lib_aci.h>
 #include <aci_setup.h>
+#include <aci_uart_bridge.h>
 #include "uart_over_ble.h"
 
 /**
@@ -116,7 +117,20 @@ Used to test the UART TX characteristic notification
 static uart_over_ble_t uart_over_ble;
 static uint8_t         uart_buffer[20];
 static uint8_t         uart_buffer_len = 0;
-static uint8_t         dummychar = 0;
+
+/*
+Carries the serial port over the UART TX and UART RX pipes
+*/
+static aci_uart_bridge_t uart_bridge;
+static const aci_uart_bridge_params_t uart_bridge_params =
+{
+  PIPE_UART_OVER_BTLE_UART_TX_TX,
+  PIPE_UART_OVER_BTLE_UART_RX_RX,
+  PIPE_UART_OVER_BTLE_UART_CONTROL_POINT_TX,
+  PIPE_UART_OVER_BTLE_UART_CONTROL_POINT_RX,
+  10,    /* Idle time in ms before a short packet is sent */
+  UNUSED /* No RTS pin on the serial port */
+};
 
 /*
 Initialize the radio_ack. This is the ack received for every transmitted packet.
@@ -161,7 +175,6 @@ void setup(void)
   #endif
 
   Serial.println(F("Arduino setup"));
-  Serial.println(F("Set line ending to newline to send data from the serial monitor"));
 
   /**
   Point ACI data structures to the the setup data that the nRFgo studio generated for the nRF8001
@@ -204,6 +217,7 @@ void setup(void)
   //then we initialize the data structures required to setup the nRF8001
   //The second parameter is for turning debug printing on for the ACI Commands and Events so they be printed on the Serial
   lib_aci_init(&aci_state, false);
+  aci_uart_bridge_init(&uart_bridge, &uart_bridge_params);
 }
 
 void uart_over_ble_init(void)
@@ -219,10 +233,6 @@ bool uart_tx(uint8_t *buffer, uint8_t buffer_len)
       (aci_state.data_credit_available >= 1))
   {
     status = lib_aci_send_data(PIPE_UART_OVER_BTLE_UART_TX_TX, buffer, buffer_len);
-    if (status)
-    {
-      aci_state.data_credit_available--;
-    }
   }
   return status;
 }
@@ -272,26 +282,15 @@ bool uart_process_control_point_rx(uint8_t *byte, uint8_t length)
         break;
 
       /*
-      Clears the RTS of the UART over BLE
+      Clears and sets the RTS of the UART over BLE, the bridge stops and starts sending
       */
       case UART_OVER_BLE_TRANSMIT_STOP:
-        /*
-        Parameters:
-        None
-        */
-        uart_over_ble.uart_rts_local = false;
-        status = true;
-        break;
-
-      /*
-      Set the RTS of the UART over BLE
-      */
       case UART_OVER_BLE_TRANSMIT_OK:
         /*
         Parameters:
         None
         */
-        uart_over_ble.uart_rts_local = true;
+        uart_over_ble.uart_rts_local = (UART_OVER_BLE_TRANSMIT_OK == *byte);
         status = true;
         break;
     }
@@ -308,6 +307,7 @@ void aci_loop()
   {
     aci_evt_t * aci_evt;
     aci_evt = &aci_data.evt;
+    aci_uart_bridge_event(&uart_bridge, &aci_state, aci_evt);
 
     switch(aci_evt->evt_opcode)
     {
@@ -406,16 +406,9 @@ void aci_loop()
         Serial.println(aci_evt->params.data_received.rx_data.pipe_number, DEC);
         if (PIPE_UART_OVER_BTLE_UART_RX_RX == aci_evt->params.data_received.rx_data.pipe_number)
         {
-          Serial.print(F(" Data(Hex) : "));
-          for(int i=0; i<aci_evt->len - 2; i++)
-          {
-            Serial.print((char)aci_evt->params.data_received.rx_data.aci_data[i]);
-            uart_buffer[i] = aci_evt->params.data_received.rx_data.aci_data[i];
-            Serial.print(F(" "));
-          }
-
+          //The data is in the bridge, it is written to the serial port from loop()
           uart_buffer_len = aci_evt->len - 2;
-          Serial.println(F(""));
+          memcpy(&uart_buffer[0], &aci_evt->params.data_received.rx_data.aci_data[0], uart_buffer_len);
           if (lib_aci_is_pipe_available(&aci_state, PIPE_UART_OVER_BTLE_UART_TX_TX))
           {
             /*Do this to test the loopback otherwise comment it out
@@ -439,7 +432,7 @@ void aci_loop()
         break;
 
       case ACI_EVT_DATA_CREDIT:
-        aci_state.data_credit_available = aci_state.data_credit_available + aci_evt->params.data_credit.credit;
+        //aci_state.data_credit_available is updated by the ACI Library
         break;
 
       case ACI_EVT_PIPE_ERROR:
@@ -448,14 +441,6 @@ void aci_loop()
         Serial.print(aci_evt->params.pipe_error.pipe_number, DEC);
         Serial.print(F("  Pipe Error Code: 0x"));
         Serial.println(aci_evt->params.pipe_error.error_code, HEX);
-
-        //Increment the credit available as the data packet was not sent.
-        //The pipe error also represents the Attribute protocol Error Response sent from the peer and that should not be counted
-        //for the credit.
-        if (ACI_STATUS_ERROR_PEER_ATT_ERROR != aci_evt->params.pipe_error.error_code)
-        {
-          aci_state.data_credit_available++;
-        }
         break;
 
       case ACI_EVT_HW_ERROR:
@@ -494,84 +479,25 @@ void aci_loop()
   }
 }
 
-bool stringComplete = false;  // whether the string is complete
-uint8_t stringIndex = 0;      //Initialize the index to store incoming chars
-
 void loop() {
 
+  int data;
+
   //Process any ACI commands or events
   aci_loop();
 
-  // print the string when a newline arrives:
-  if (stringComplete)
+  //Serial input for the peer, as much as the bridge has room for.
+  //The bridge sends it in full packets, or in a shorter one when the input stops.
+  while ((0 != aci_uart_bridge_room(&uart_bridge)) && (Serial.available() > 0))
   {
-    Serial.print(F("Sending: "));
-    Serial.println((char *)&uart_buffer[0]);
-
-    uart_buffer_len = stringIndex + 1;
-
-    if (!lib_aci_send_data(PIPE_UART_OVER_BTLE_UART_TX_TX, uart_buffer, uart_buffer_len))
-    {
-      Serial.println(F("Serial input dropped"));
-    }
-
-    // clear the uart_buffer:
-    for (stringIndex = 0; stringIndex < 20; stringIndex++)
-    {
-      uart_buffer[stringIndex] = ' ';
-    }
+    aci_uart_bridge_put(&uart_bridge, (uint8_t)Serial.read());
+  }
 
-    // reset the flag and the index in order to receive more data
-    stringIndex    = 0;
-    stringComplete = false;
+  //Data from the peer
+  while ((data = aci_uart_bridge_get(&uart_bridge)) >= 0)
+  {
+    Serial.write((uint8_t)data);
   }
 
-  //For ChipKit you have to call the function that reads from Serial
-  #if defined (__PIC32MX__)
-    if (Serial.available())
-    {
-      serialEvent();
-    }
-  #endif
+  aci_uart_bridge_poll(&uart_bridge, &aci_state);
 }
-
-/*
- COMMENT ONLY FOR ARDUINO
- SerialEvent occurs whenever a new data comes in the
- hardware serial RX.  This routine is run between each
- time loop() runs, so using delay inside loop can delay
- response.  Multiple bytes of data may be available.
- Serial Event is NOT compatible with Leonardo, Micro, Esplora
- */
-void serialEvent() {
-
-  while(Serial.available() > 0){
-    // get the new byte:
-    dummychar = (uint8_t)Serial.read();
-    if(!stringComplete)
-    {
-      if (dummychar == '\n')
-      {
-        // if the incoming character is a newline, set a flag
-        // so the main loop can do something about it
-        stringIndex--;
-        stringComplete = true;
-      }
-      else
-      {
-        if(stringIndex > 19)
-        {
-          Serial.println("Serial input truncated");
-          stringIndex--;
-          stringComplete = true;
-        }
-        else
-        {
-          // add it to the uart_buffer
-          uart_buffer[stringIndex] = dummychar;
-          stringIndex++;
-        }
-      }
-    }
-  }
-}
\ No newline at end of file
@@ -40,8 +40,8 @@ The following instructions describe the steps to be made on the Windows PC:
 -# You can use the nRF UART app in the Apple iOS app store and Google Play for Android 4.3 for Samsung Galaxy S4
    with this UART template app
 
--# You can send data from the Arduino serial monitor, maximum length of a string is 19 bytes
-   Set the line ending to "Newline" in the Serial monitor (The newline is also sent over the air
+-# Whatever is typed in the Arduino serial monitor is sent over the air, in packets of up to 20 bytes.
+   What the peer writes on the UART RX characteristic is printed on the serial monitor.
 
  *
  * Click on the "Serial Monitor" button on the Arduino IDE to reset the Arduino and start the application.
@@ -59,11 +59,12 @@ The following instructions describe the steps to be made on the Windows PC:
  * }
  *
  */
-#include <EEPROM.h>
 #include <SPI.h>
 #include <avr/pgmspace.h>
 #include <lib_aci.h>
 #include <aci_setup.h>
+#include <aci_dfu_handoff.h>
+#include <aci_uart_bridge.h>
 #include "uart_over_ble.h"
 #include <avr/io.h>
 
@@ -97,13 +98,32 @@ static hal_aci_evt_t  aci_data;
 /* Timing change state variable */
 static bool timing_change_done          = false;
 
+/* What the bootloader needs to take over the connection */
+static const aci_dfu_handoff_t dfu_handoff =
+{
+  PIPE_NORDIC_DEVICE_FIRMWARE_UPDATE_SERVICE_DFU_PACKET_RX,
+  PIPE_NORDIC_DEVICE_FIRMWARE_UPDATE_SERVICE_DFU_CONTROL_POINT_TX,
+  PIPE_NORDIC_DEVICE_FIRMWARE_UPDATE_SERVICE_DFU_CONTROL_POINT_RX_ACK_AUTO,
+  180,   /* Connection timeout in seconds */
+  0x0050 /* Advertising interval */
+};
+
 /* Used to test the UART TX characteristic notification */
 static uart_over_ble_t uart_over_ble;
 static uint8_t         uart_buffer[20];
 static uint8_t         uart_buffer_len = 0;
 
-String inputString     = "";     // a string to hold incoming data
-bool stringComplete = false;  // whether the string is complete
+/* Carries the serial port over the UART TX and UART RX pipes */
+static aci_uart_bridge_t uart_bridge;
+static const aci_uart_bridge_params_t uart_bridge_params =
+{
+  PIPE_UART_OVER_BTLE_UART_TX_TX,
+  PIPE_UART_OVER_BTLE_UART_RX_RX,
+  PIPE_UART_OVER_BTLE_UART_CONTROL_POINT_TX,
+  PIPE_UART_OVER_BTLE_UART_CONTROL_POINT_RX,
+  10,    /* Idle time in ms before a short packet is sent */
+  UNUSED /* No RTS pin on the serial port */
+};
 
 /* Define how assert should function in the BLE library */
 void __ble_assert(const char *file, uint16_t line)
@@ -178,6 +198,7 @@ void setup(void)
    * We call lib_aci_init() with debug true to enable debug printing for ACI Commands and Events
    */
   lib_aci_init(&aci_state, true);
+  aci_uart_bridge_init(&uart_bridge, &uart_bridge_params);
 }
 
 void uart_over_ble_init(void)
@@ -193,10 +214,6 @@ bool uart_tx(uint8_t *buffer, uint8_t buffer_len)
       (aci_state.data_credit_available >= 1))
   {
     status = lib_aci_send_data(PIPE_UART_OVER_BTLE_UART_TX_TX, buffer, buffer_len);
-    if (status)
-    {
-      aci_state.data_credit_available--;
-    }
   }
 
   return status;
@@ -246,17 +263,11 @@ None
         break;
 
 
-      /* Clears the RTS of the UART over BLE */
+      /* Clears and sets the RTS of the UART over BLE, the bridge stops and starts sending */
       case UART_OVER_BLE_TRANSMIT_STOP:
-        /* Parameters: None */
-        uart_over_ble.uart_rts_local = false;
-        status = true;
-        break;
-
-      /* Set the RTS of the UART over BLE */
       case UART_OVER_BLE_TRANSMIT_OK:
         /* Parameters: None */
-        uart_over_ble.uart_rts_local = true;
+        uart_over_ble.uart_rts_local = (UART_OVER_BLE_TRANSMIT_OK == *byte);
         status = true;
         break;
     }
@@ -276,6 +287,7 @@ void aci_loop()
     aci_evt_t * aci_evt;
 
     aci_evt = &aci_data.evt;
+    aci_uart_bridge_event(&uart_bridge, &aci_state, aci_evt);
     switch(aci_evt->evt_opcode)
     {
       /**
@@ -309,7 +321,7 @@ void aci_loop()
                 Serial.println(F("Advertising started"));
               }
 
-              if (!bootloader_data_store(&aci_state, 180, 0x0050))
+              if (!aci_dfu_handoff_store(&aci_state, &dfu_handoff))
               {
                 Serial.println(F("Unable to write connection data to EEPROM. Bootloading over BLE will not work"));
               }
@@ -385,15 +397,9 @@ void aci_loop()
         switch (aci_evt->params.data_received.rx_data.pipe_number)
         {
           case PIPE_UART_OVER_BTLE_UART_RX_RX:
-            Serial.print(F(" Data(Hex) : "));
-            for(int i=0; i<aci_evt->len - 2; i++)
-            {
-              Serial.print((char)aci_evt->params.data_received.rx_data.aci_data[i]);
-              uart_buffer[i] = aci_evt->params.data_received.rx_data.aci_data[i];
-              Serial.print(F(" "));
-            }
+            /* The data is in the bridge, it is written to the serial port from loop() */
             uart_buffer_len = aci_evt->len - 2;
-            Serial.println(F(""));
+            memcpy(&uart_buffer[0], &aci_evt->params.data_received.rx_data.aci_data[0], uart_buffer_len);
             if (lib_aci_is_pipe_available(&aci_state, PIPE_UART_OVER_BTLE_UART_TX_TX))
             {
 
@@ -428,7 +434,7 @@ void aci_loop()
         break;
 
       case ACI_EVT_DATA_CREDIT:
-        aci_state.data_credit_available = aci_state.data_credit_available + aci_evt->params.data_credit.credit;
+        //aci_state.data_credit_available is updated by the ACI Library
         break;
 
       case ACI_EVT_PIPE_ERROR:
@@ -437,15 +443,6 @@ void aci_loop()
         Serial.print(aci_evt->params.pipe_error.pipe_number, DEC);
         Serial.print(F("  Pipe Error Code: 0x"));
         Serial.println(aci_evt->params.pipe_error.error_code, HEX);
-
-        //Increment the credit available as the data packet was not sent.
-        //The pipe error also represents the Attribute protocol Error Response 
-        //sent from the peer and that should not be counted for the credit.
-        
-        if (ACI_STATUS_ERROR_PEER_ATT_ERROR != aci_evt->params.pipe_error.error_code)
-        {
-          aci_state.data_credit_available++;
-        }
         break;
 
       case ACI_EVT_HW_ERROR:
@@ -483,64 +480,37 @@ void aci_loop()
     }
   }
 
-  /* If the bootloader_jump_required flag has been set, we attempt to jump to bootloader.
-   * The bootloader_jump() function will do a series of checks before jumping.
+  /* If the bootloader_jump_required flag has been set, we jump to the bootloader
+   * as soon as all the credits are back and the DFU pipes are open.
    */
-  if (bootloader_jump_required)
+  if (bootloader_jump_required && aci_dfu_handoff_is_ready(&aci_state, &dfu_handoff))
   {
-    bootloader_jump();
+    Serial.println(F("Jumping to bootloader"));
+    Serial.flush();
+    aci_dfu_handoff_jump(&aci_state, &dfu_handoff);
   }
 }
 
 void loop()
 {
+  int data;
+
   //Process any ACI commands or events
   aci_loop();
 
-  // print the string when a newline arrives:
-  if (stringComplete) {
-    Serial.print(F("Sending: "));
-    Serial.println(inputString);
-    inputString.toCharArray((char*)uart_buffer,20);
-
-    if (inputString.length() > 20)
-    {
-      uart_buffer_len = 20;
-      uart_buffer[19] = '\n';
-      Serial.println(F("Serial input truncted"));
-    }
-    else
-    {
-      uart_buffer_len = inputString.length();
-    }
-
-    if (!lib_aci_send_data(PIPE_UART_OVER_BTLE_UART_TX_TX, uart_buffer, uart_buffer_len))
-    {
-      Serial.println(F("Serial input dropped"));
-    }
-    // clear the string:
-    inputString = "";
-    stringComplete = false;
+  /* Serial input for the peer, as much as the bridge has room for.
+   * The bridge sends it in full packets, or in a shorter one when the input stops.
+   */
+  while ((0 != aci_uart_bridge_room(&uart_bridge)) && (Serial.available() > 0))
+  {
+    aci_uart_bridge_put(&uart_bridge, (uint8_t)Serial.read());
   }
-}
 
-/*
-* SerialEvent occurs whenever a new data comes in the hardware serial RX.
-* This routine is run between each time loop() runs, so using delay inside
-* loop can delay response.  Multiple bytes of data may be available.  Serial
-* Event is NOT compatible with Leonardo, Micro, Esplora
-*/
-void serialEvent()
-{
-  while (Serial.available()) {
-    // get the new byte:
-    char inChar = (char)Serial.read();
-    // add it to the inputString:
-    inputString += inChar;
-    // if the incoming character is a newline, set a flag
-    // so the main loop can do something about it:
-    if (inChar == '\n') {
-      stringComplete = true;
-    }
+  /* Data from the peer */
+  while ((data = aci_uart_bridge_get(&uart_bridge)) >= 0)
+  {
+    Serial.write((uint8_t)data);
   }
+
+  aci_uart_bridge_poll(&uart_bridge, &aci_state);
 }
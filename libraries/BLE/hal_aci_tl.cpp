@@ -26,8 +26,31 @@
 #include <SPI.h>
 #include "hal_platform.h"
 #include "hal_aci_tl.h"
+#include "aci_log.h"
 #include "aci_queue.h"
-#if ( !defined(__SAM3X8E__) && !defined(__PIC32MX__) )
+#include "aci_cmds.h"
+#include "aci_evts.h"
+#include "aci_stack.h"
+
+#if ((HAL_ACI_TL_TX_LOW_WATER < 0) || (HAL_ACI_TL_TX_LOW_WATER >= ACI_TX_QUEUE_BYTES))
+#error "HAL_ACI_TL_TX_LOW_WATER must be 0 to ACI_TX_QUEUE_BYTES - 1"
+#endif
+
+#if (ACI_RX_DATA_QUEUE_BYTES && (HAL_ACI_RX_OVERFLOW_POLICY != HAL_ACI_RX_OVERFLOW_STALL))
+#error "ACI_RX_DATA_QUEUE_BYTES needs HAL_ACI_RX_OVERFLOW_STALL"
+#endif
+
+#if (HAL_ACI_SPI_TRANSACTIONS && defined(SPI_HAS_TRANSACTION))
+#define ACI_SPI_USE_TRANSACTIONS 1
+#else
+#define ACI_SPI_USE_TRANSACTIONS 0
+#endif
+#if (HAL_ACI_SPI_BLOCK_TRANSFER && (defined(__AVR__) || defined(__PIC32MX__) || defined(__arm__)))
+#define ACI_SPI_USE_BLOCK 1
+#else
+#define ACI_SPI_USE_BLOCK 0
+#endif
+#if defined(__AVR__)
 #include <avr/sleep.h>
 #endif
 /*
@@ -40,419 +63,2793 @@ The outgoing command and the incoming event needs to be converted
     //For Arduino add nothing
 #elif defined(__PIC32MX__)
     //For ChipKit as the transmission has to be reversed, the next definitions have to be added
-    #define REVERSE_BITS(byte) (((reverse_lookup[(byte & 0x0F)]) << 4) + reverse_lookup[((byte & 0xF0) >> 4)])
-    static const uint8_t reverse_lookup[] = { 0, 8,  4, 12, 2, 10, 6, 14,1, 9, 5, 13,3, 11, 7, 15 };
+    //A full byte table costs 256 bytes of flash but makes the reversal a single load
+    #define REVERSE_BITS(byte) (reverse_lookup[(uint8_t)(byte)])
+    static const uint8_t reverse_lookup[256] = {
+      0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0, 0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0,
+      0x08, 0x88, 0x48, 0xC8, 0x28, 0xA8, 0x68, 0xE8, 0x18, 0x98, 0x58, 0xD8, 0x38, 0xB8, 0x78, 0xF8,
+      0x04, 0x84, 0x44, 0xC4, 0x24, 0xA4, 0x64, 0xE4, 0x14, 0x94, 0x54, 0xD4, 0x34, 0xB4, 0x74, 0xF4,
+      0x0C, 0x8C, 0x4C, 0xCC, 0x2C, 0xAC, 0x6C, 0xEC, 0x1C, 0x9C, 0x5C, 0xDC, 0x3C, 0xBC, 0x7C, 0xFC,
+      0x02, 0x82, 0x42, 0xC2, 0x22, 0xA2, 0x62, 0xE2, 0x12, 0x92, 0x52, 0xD2, 0x32, 0xB2, 0x72, 0xF2,
+      0x0A, 0x8A, 0x4A, 0xCA, 0x2A, 0xAA, 0x6A, 0xEA, 0x1A, 0x9A, 0x5A, 0xDA, 0x3A, 0xBA, 0x7A, 0xFA,
+      0x06, 0x86, 0x46, 0xC6, 0x26, 0xA6, 0x66, 0xE6, 0x16, 0x96, 0x56, 0xD6, 0x36, 0xB6, 0x76, 0xF6,
+      0x0E, 0x8E, 0x4E, 0xCE, 0x2E, 0xAE, 0x6E, 0xEE, 0x1E, 0x9E, 0x5E, 0xDE, 0x3E, 0xBE, 0x7E, 0xFE,
+      0x01, 0x81, 0x41, 0xC1, 0x21, 0xA1, 0x61, 0xE1, 0x11, 0x91, 0x51, 0xD1, 0x31, 0xB1, 0x71, 0xF1,
+      0x09, 0x89, 0x49, 0xC9, 0x29, 0xA9, 0x69, 0xE9, 0x19, 0x99, 0x59, 0xD9, 0x39, 0xB9, 0x79, 0xF9,
+      0x05, 0x85, 0x45, 0xC5, 0x25, 0xA5, 0x65, 0xE5, 0x15, 0x95, 0x55, 0xD5, 0x35, 0xB5, 0x75, 0xF5,
+      0x0D, 0x8D, 0x4D, 0xCD, 0x2D, 0xAD, 0x6D, 0xED, 0x1D, 0x9D, 0x5D, 0xDD, 0x3D, 0xBD, 0x7D, 0xFD,
+      0x03, 0x83, 0x43, 0xC3, 0x23, 0xA3, 0x63, 0xE3, 0x13, 0x93, 0x53, 0xD3, 0x33, 0xB3, 0x73, 0xF3,
+      0x0B, 0x8B, 0x4B, 0xCB, 0x2B, 0xAB, 0x6B, 0xEB, 0x1B, 0x9B, 0x5B, 0xDB, 0x3B, 0xBB, 0x7B, 0xFB,
+      0x07, 0x87, 0x47, 0xC7, 0x27, 0xA7, 0x67, 0xE7, 0x17, 0x97, 0x57, 0xD7, 0x37, 0xB7, 0x77, 0xF7,
+      0x0F, 0x8F, 0x4F, 0xCF, 0x2F, 0xAF, 0x6F, 0xEF, 0x1F, 0x9F, 0x5F, 0xDF, 0x3F, 0xBF, 0x7F, 0xFF,
+    };
+#elif defined(__SAM3X8E__)
+    //The SAM3X SPI has no LSB first mode, the Cortex-M3 reverses a byte in one RBIT instruction
+    #define REVERSE_BITS(byte) ((uint8_t)(__RBIT((uint32_t)(byte)) >> 24))
 #endif
 
-static void m_aci_data_print(hal_aci_data_t *p_data);
+/* The debug printing of commands and events is text on the Serial */
+#define HAL_ACI_DEBUG_TEXT (!HAL_ACI_TL_TRACE && (ACI_LOG_LEVEL == ACI_LOG_LEVEL_INFO))
+
+#if HAL_ACI_DEBUG_TEXT
+static void m_aci_data_print(const hal_aci_data_t *p_data);
+#endif
+static void m_aci_debug_log(uint8_t trace_type, const hal_aci_data_t *p_data);
+static void m_aci_event_removed(bool was_full);
+static inline bool m_aci_rx_can_accept(void);
+static hal_aci_data_t *m_aci_rx_slot(void);
+static void m_aci_rx_overflow(const hal_aci_data_t *p_dropped);
+#if ACI_RX_DATA_QUEUE_BYTES
+static hal_aci_data_t *m_aci_rx_data_route(hal_aci_data_t *p_received);
+#endif
 static void m_aci_event_check(void);
 static void m_aci_isr(void);
+static bool m_aci_isr_transfer(void);
+static bool m_aci_rdyn_wait(bool level);
 static void m_aci_pins_set(aci_pins_t *a_pins_ptr);
+static void m_aci_lines_init(void);
+static void m_aci_init_start(aci_pins_t *a_pins, bool debug, bool pin_reset);
+static inline void m_aci_rdyn_irq_priority_set(void);
 static inline void m_aci_reqn_disable (void);
 static inline void m_aci_reqn_enable (void);
+static inline bool m_aci_rdyn_is_high (void);
 static void m_aci_q_flush(void);
-static bool m_aci_spi_transfer(hal_aci_data_t * data_to_send, hal_aci_data_t * received_data);
+#if HAL_ACI_RX_CREDIT_COALESCE
+static bool m_aci_rx_credit_merge(const hal_aci_data_t *received_data);
+#endif
+#if HAL_ACI_EVENT_FILTER
+static bool m_aci_rx_filter(const hal_aci_data_t *received_data);
+#endif
+#if defined(__AVR__)
+static bool m_aci_busy(void);
+#endif
+#if HAL_ACI_TL_HYBRID
+static void m_aci_hybrid_update(void);
+#endif
+static bool m_aci_spi_transfer(const hal_aci_data_t * data_to_send, hal_aci_data_t * received_data);
+static uint32_t m_aci_spi_clock_hz(uint8_t spi_clock_divider);
 
 static uint8_t        spi_readwrite(uint8_t aci_byte);
+#if ACI_SPI_USE_BLOCK
+static void           spi_readwrite_block(const uint8_t *p_tx, uint8_t tx_length, uint8_t *p_rx, uint8_t length);
+#endif
 
 static bool           aci_debug_print = false;
 
-aci_queue_t    aci_tx_q;
-aci_queue_t    aci_rx_q;
+#if HAL_ACI_TL_STATS
+static hal_aci_tl_stats_t aci_stats;
+#define HAL_ACI_STATS_ADD(field, value)  (aci_stats.field += (value))
+#define HAL_ACI_STATS_HIGH_WATER(field, aci_q)                 \
+  do {                                                         \
+    const uint8_t used = aci_queue_bytes_used(aci_q);          \
+    if (used > aci_stats.field) { aci_stats.field = used; }    \
+  } while (0)
+#else
+#define HAL_ACI_STATS_ADD(field, value)
+#define HAL_ACI_STATS_HIGH_WATER(field, aci_q)
+#endif
+
+#if (HAL_ACI_TL_LATENCY || HAL_ACI_TL_EVENT_TIME)
+/* Events in the event queue stamped with the time they were clocked in, oldest first */
+typedef struct
+{
+  uint8_t  offset;  // Offset of the event in the event queue
+  uint32_t time_us;
+} aci_event_stamp_t;
+
+static aci_event_stamp_t     aci_stamps[HAL_ACI_TL_LATENCY_DEPTH];
+static volatile uint8_t      aci_stamps_head;
+static volatile uint8_t      aci_stamps_count;
+
+static void m_aci_event_stamp(const hal_aci_data_t *p_data, uint32_t time_us);
+static void m_aci_event_stamp_take_head(void);
+
+#define HAL_ACI_STAMP_NOW(var)                 const uint32_t var = micros()
+#define HAL_ACI_STAMP(p_data, time_us)         m_aci_event_stamp(p_data, time_us)
+#define HAL_ACI_STAMP_TAKE_HEAD()              m_aci_event_stamp_take_head()
+#else
+#define HAL_ACI_STAMP_NOW(var)
+#define HAL_ACI_STAMP(p_data, time_us)
+#define HAL_ACI_STAMP_TAKE_HEAD()
+#endif
+
+#if HAL_ACI_TL_DATA_MARKS
+/* Pipe errors waiting in the event queue that are marked at a time */
+#define ACI_DATA_MARKS_DEPTH  4
+#define ACI_DATA_MARK_NONE    0xFFFF
+#endif
+
+#if HAL_ACI_TL_LATENCY
+#define ACI_LATENCY_OPCODES  (ACI_EVT_KEY_REQUEST - ACI_EVT_DEVICE_STARTED + 1)
+
+static hal_aci_tl_latency_t  aci_latency[ACI_LATENCY_OPCODES];
+#endif
 
-static aci_pins_t	 *a_pins_local_ptr;
+#if HAL_ACI_TL_EVENT_TIME
+static uint32_t              aci_event_time_us;
+#endif
 
-void m_aci_data_print(hal_aci_data_t *p_data)
+/* Steps of hal_aci_tl_init_poll() */
+typedef enum
 {
-  const uint8_t length = p_data->buffer[0];
-  uint8_t i;
-  Serial.print(length, DEC);
-  Serial.print(" :");
-  for (i=0; i<=length; i++)
-  {
-    Serial.print(p_data->buffer[i], HEX);
-    Serial.print(F(", "));
-  }
-  Serial.println(F(""));
-}
+  ACI_INIT_DONE,          // First, so an instance that was never started reads as done
+  ACI_INIT_RESET_HOLD,    // Reset held for the Power On Reset circuit of the Redbearlab shields
+  ACI_INIT_LINES_SETTLE   // Waiting for the nRF8001 to drive its lines after the reset
+} aci_init_step_t;
+
+#if HAL_ACI_RDYN_EDGE_TRIGGERED
+#define HAL_ACI_RDYN_IRQ_MODE  FALLING
+#else
+// We use the LOW level of the RDYN line as the atmega328 can wakeup from sleep only on LOW
+#define HAL_ACI_RDYN_IRQ_MODE  LOW
+#endif
+
+/* State of one nRF8001 transport instance */
+typedef struct
+{
+  aci_pins_t                *a_pins_ptr;
+  aci_queue_t                tx_q;
+  aci_queue_t                rx_q;
+  uint8_t                    tx_q_storage[ACI_TX_QUEUE_BYTES];
+  uint8_t                    rx_q_storage[ACI_RX_QUEUE_BYTES];
+#if ACI_TX_CTRL_QUEUE_BYTES
+  aci_queue_t                ctrl_q;              // Control commands, sent before the ones in tx_q
+  uint8_t                    ctrl_q_storage[ACI_TX_CTRL_QUEUE_BYTES];
+  aci_queue_t               *reserved_q;          // Queue of the slot given by hal_aci_tl_send_reserve()
+#endif
+#if ACI_TX_ISR_QUEUE_BYTES
+  aci_queue_t                isr_q;               // Commands of hal_aci_tl_send_from_isr(), the interrupts fill it
+  uint8_t                    isr_q_storage[ACI_TX_ISR_QUEUE_BYTES];
+#endif
+#if ACI_RX_DATA_QUEUE_BYTES
+  aci_queue_t                data_q;              // ACI_EVT_DATA_RECEIVED, the other events are in rx_q
+  uint8_t                    data_q_storage[ACI_RX_DATA_QUEUE_BYTES];
+  volatile uint8_t           data_count;          // Events in data_q
+  volatile uint8_t           data_stale;          // The oldest of them, received before an ACI_EVT_DISCONNECTED
+#endif
+
+  hal_aci_tl_overflow_cb_t   overflow_cb;
+  volatile uint16_t          overflow_count;
+#if HAL_ACI_TL_TX_LOW_WATER
+  hal_aci_tl_tx_space_cb_t   tx_space_cb;
+  volatile bool              tx_space_armed;      // A command was refused, or hal_aci_tl_tx_space_arm()
+  volatile bool              tx_space;            // Down to the low-water mark since armed, not taken yet
+#endif
+#if HAL_ACI_TL_SOFT_EVENTS
+  hal_aci_tl_soft_data_cb_t  soft_data_cb;
+  hal_aci_tl_soft_credit_cb_t soft_credit_cb;
+  uint8_t                    soft_pipes[(ACI_DEVICE_MAX_PIPES + 7) / 8];
+  const hal_aci_data_t      *soft_events[HAL_ACI_TL_SOFT_EVENTS];  // In the event queue, given at the end of the transfers
+  uint8_t                    soft_count;
+  uint8_t                    soft_credits;
+  uint16_t                   soft_dropped;
+#endif
+#if (HAL_ACI_RX_OVERFLOW_POLICY != HAL_ACI_RX_OVERFLOW_STALL)
+  hal_aci_data_t             rx_overflow_buffer;  // Events that do not fit in rx_q are clocked in here and dropped
+#endif
+#if (HAL_ACI_RX_OVERFLOW_POLICY == HAL_ACI_RX_OVERFLOW_DROP_CREDIT)
+  volatile uint8_t           rx_dropped_credits;  // Credits of dropped ACI_EVT_DATA_CREDIT events, still to be delivered
+#endif
+
+#if HAL_ACI_EVENT_FILTER
+  uint16_t                   filter_mask;         // HAL_ACI_EVENT_FILTER_BIT() of the events kept out of rx_q
+  hal_aci_tl_filtered_t      filtered;            // Left by them for the main context
+#endif
+
+  aci_init_step_t            init_step;
+  unsigned long              init_time_ms;
+
+#if HAL_ACI_TL_TX_HOLD
+  volatile bool              tx_hold;             // Sleep sent, only a Wakeup goes out until a Device Started
+#endif
+
+#if HAL_ACI_TL_DATA_MARKS
+  uint8_t                    data_queued;         // SendData queued, by the main context
+  volatile uint8_t           data_sent;           // SendData clocked out
+  volatile uint16_t          data_last;           // Number of the last command clocked out, ACI_DATA_MARK_NONE if not a SendData
+  uint16_t                   data_marks[ACI_DATA_MARKS_DEPTH];  // data_last of the pipe errors in the event queue, oldest first
+  volatile uint8_t           data_marks_head;
+  volatile uint8_t           data_marks_count;
+  volatile uint8_t           data_marks_lost;     // Pipe errors after data_marks, not marked
+#endif
+
+#if HAL_ACI_TL_ACTIVE
+  hal_aci_tl_active_t        active;              // ACTIVE line measurements, duty_permille left at 0
+  uint32_t                   active_rise_us;      // micros() at the last rising edge of ACTIVE
+  bool                       active_high;         // Level of ACTIVE at the last sample
+#endif
+
+#if ACI_SPI_USE_TRANSACTIONS
+  SPISettings                spi_settings;        // nRF8001 SPI settings, built once by hal_aci_tl_init()
+#endif
+#if HAL_ACI_RDYN_EDGE_TRIGGERED
+  volatile bool              rdyn_pending;        // RDYN was asserted while the event queue was full
+#endif
+#if HAL_ACI_TL_HYBRID
+  volatile uint8_t           hybrid_transfers;    // Transfers run in the current window
+  bool                       hybrid_polling;      // RDYN interrupt detached, RDYN polled by the main context
+  uint8_t                    hybrid_quiet;        // Quiet windows in a row while polling
+  unsigned long              hybrid_window_ms;    // millis() at the start of the current window
+#endif
+#if (defined(__AVR__) && !HAL_ACI_PINS_STATIC)
+  volatile uint8_t          *reqn_out_reg;        // REQN and RDYN resolved to port/mask pairs by hal_aci_tl_init()
+  uint8_t                    reqn_bit_mask;
+  volatile uint8_t          *rdyn_in_reg;
+  uint8_t                    rdyn_bit_mask;
+#elif defined(__SAM3X8E__)
+  Pio                       *reqn_pio;            // REQN and RDYN resolved to PIO controller/mask pairs
+  uint32_t                   reqn_bit_mask;
+  Pio                       *rdyn_pio;
+  uint32_t                   rdyn_bit_mask;
+#elif defined(ARDUINO_ARCH_SAMD)
+  PortGroup                 *reqn_port;           // REQN and RDYN resolved to PORT group/mask pairs
+  uint32_t                   reqn_bit_mask;
+  PortGroup                 *rdyn_port;
+  uint32_t                   rdyn_bit_mask;
+#endif
+} aci_tl_ctx_t;
+
+static aci_tl_ctx_t   aci_tl_ctx[HAL_ACI_INSTANCES];
+
+#if (HAL_ACI_INSTANCES > 1)
+/* Instance the hal_aci_tl_* calls work on, the ISR trampolines switch it for the ISR */
+static aci_tl_ctx_t  *aci_tl = &aci_tl_ctx[0];
+
+static void m_aci_isr_on(aci_tl_ctx_t *p_ctx);
+static void m_aci_isr_0(void) { m_aci_isr_on(&aci_tl_ctx[0]); }
+static void m_aci_isr_1(void) { m_aci_isr_on(&aci_tl_ctx[1]); }
+#if (HAL_ACI_INSTANCES > 2)
+static void m_aci_isr_2(void) { m_aci_isr_on(&aci_tl_ctx[2]); }
+#endif
+#if (HAL_ACI_INSTANCES > 3)
+static void m_aci_isr_3(void) { m_aci_isr_on(&aci_tl_ctx[3]); }
+#endif
+
+static void (* const m_aci_isr_table[HAL_ACI_INSTANCES])(void) =
+{
+  m_aci_isr_0,
+  m_aci_isr_1,
+#if (HAL_ACI_INSTANCES > 2)
+  m_aci_isr_2,
+#endif
+#if (HAL_ACI_INSTANCES > 3)
+  m_aci_isr_3,
+#endif
+};
+#define M_ACI_ISR  (m_aci_isr_table[aci_tl - aci_tl_ctx])
+#else
+/* A single instance lives at a fixed address, accesses compile to plain global accesses */
+#define aci_tl     (&aci_tl_ctx[0])
+#define M_ACI_ISR  m_aci_isr
+#endif
+
+#if ACI_TX_ISR_QUEUE_BYTES
+#define m_aci_tx_isr_q_is_empty()  aci_queue_is_empty_from_isr(&aci_tl->isr_q)
+#else
+#define m_aci_tx_isr_q_is_empty()  (true)
+#endif
+
+/* A fixed HAL_ACI_INTERFACE folds the checks, the other interface is left out of the build */
+#if (HAL_ACI_INTERFACE == HAL_ACI_INTERFACE_INTERRUPT)
+#define m_aci_session_is_interrupt()  (true)
+#elif (HAL_ACI_INTERFACE == HAL_ACI_INTERFACE_POLL)
+#define m_aci_session_is_interrupt()  (false)
+#else
+#define m_aci_session_is_interrupt()  (aci_tl->a_pins_ptr->interface_is_interrupt)
+#endif
+
+#if HAL_ACI_TL_HYBRID
+/* The hybrid interface polls RDYN for a while in an interrupt session */
+#define m_aci_interface_is_interrupt()  (m_aci_session_is_interrupt() && !aci_tl->hybrid_polling)
+#define HAL_ACI_HYBRID_COUNT()                                      \
+  do {                                                              \
+    if (0xFF != aci_tl->hybrid_transfers) { aci_tl->hybrid_transfers++; } \
+  } while (0)
+#else
+#define m_aci_interface_is_interrupt()  m_aci_session_is_interrupt()
+#define m_aci_hybrid_update()           do { } while (0)
+#define HAL_ACI_HYBRID_COUNT()
+#endif
 
+#if ACI_TX_CTRL_QUEUE_BYTES
 /*
-  Interrupt service routine called when the RDYN line goes low. Runs the SPI transfer.
+  Queue of a command: the answers to the peer, the timing request, the key and the disconnect go
+  to ctrl_q and do not wait behind the data. Every other command stays in tx_q, in the order it
+  was queued, e.g. a Connect behind the SetLocalData queued before it.
 */
-static void m_aci_isr(void)
+static inline aci_queue_t *m_aci_tx_q_for(uint8_t cmd_opcode)
 {
-  hal_aci_data_t data_to_send;
-  hal_aci_data_t received_data;
-
-  // Receive from queue
-  if (!aci_queue_dequeue_from_isr(&aci_tx_q, &data_to_send))
+  switch (cmd_opcode)
   {
-    /* queue was empty, nothing to send */
-    data_to_send.status_byte = 0;
-    data_to_send.buffer[0] = 0;
+    case ACI_CMD_SEND_DATA_ACK:
+    case ACI_CMD_SEND_DATA_NACK:
+    case ACI_CMD_CHANGE_TIMING:
+    case ACI_CMD_SET_KEY:
+    case ACI_CMD_DISCONNECT:
+      return &aci_tl->ctrl_q;
+    default:
+      return &aci_tl->tx_q;
   }
+}
 
-  // Receive and/or transmit data
-  m_aci_spi_transfer(&data_to_send, &received_data);
-
-  if (!aci_queue_is_full_from_isr(&aci_rx_q) && !aci_queue_is_empty_from_isr(&aci_tx_q))
+/* Next command to send, control commands first, then the ones of the interrupts. NULL when there is none. */
+static inline hal_aci_data_t *m_aci_tx_head(aci_queue_t **pp_tx_q)
+{
+  *pp_tx_q = &aci_tl->ctrl_q;
+#if ACI_TX_ISR_QUEUE_BYTES
+  if (aci_queue_is_empty_from_isr(*pp_tx_q))
   {
-    m_aci_reqn_enable();
+    *pp_tx_q = &aci_tl->isr_q;
   }
-
-  // Check if we received data
-  if (received_data.buffer[0] > 0)
+#endif
+  if (aci_queue_is_empty_from_isr(*pp_tx_q))
   {
-    if (!aci_queue_enqueue_from_isr(&aci_rx_q, &received_data))
-    {
-      /* Receive Buffer full.
-         Should never happen.
-         Spin in a while loop.
-      */
-      while(1);
-    }
-
-    // Disable ready line interrupt until we have room to store incoming messages
-    if (aci_queue_is_full_from_isr(&aci_rx_q))
-    {
-      detachInterrupt(a_pins_local_ptr->interrupt_number);
-    }
+    *pp_tx_q = &aci_tl->tx_q;
   }
-
-  return;
+  return aci_queue_peek_slot_from_isr(*pp_tx_q);
 }
 
-/*
-  Checks the RDYN line and runs the SPI transfer if required.
-*/
-static void m_aci_event_check(void)
+static inline bool m_aci_tx_is_empty(void)
 {
-  hal_aci_data_t data_to_send;
-  hal_aci_data_t received_data;
+  return aci_queue_is_empty(&aci_tl->ctrl_q) && m_aci_tx_isr_q_is_empty() && aci_queue_is_empty(&aci_tl->tx_q);
+}
+#else
+#define m_aci_tx_q_for(cmd_opcode)  (&aci_tl->tx_q)
 
-  // No room to store incoming messages
-  if (aci_queue_is_full(&aci_rx_q))
+/* Next command to send, the ones of the interrupts first. NULL when there is none. */
+static inline hal_aci_data_t *m_aci_tx_head(aci_queue_t **pp_tx_q)
+{
+  *pp_tx_q = &aci_tl->tx_q;
+#if ACI_TX_ISR_QUEUE_BYTES
+  if (!aci_queue_is_empty_from_isr(&aci_tl->isr_q))
   {
-    return;
+    *pp_tx_q = &aci_tl->isr_q;
   }
+#endif
+  return aci_queue_peek_slot_from_isr(*pp_tx_q);
+}
 
-  // If the ready line is disabled and we have pending messages outgoing we enable the request line
-  if (HIGH == digitalRead(a_pins_local_ptr->rdyn_pin))
-  {
-    if (!aci_queue_is_empty(&aci_tx_q))
-    {
-      m_aci_reqn_enable();
-    }
+static inline bool m_aci_tx_is_empty(void)
+{
+  return m_aci_tx_isr_q_is_empty() && aci_queue_is_empty(&aci_tl->tx_q);
+}
+#endif
 
-    return;
-  }
+#if HAL_ACI_TL_TX_HOLD
+/* Next command to send, NULL while the nRF8001 sleeps and the head command is not a Wakeup */
+static inline hal_aci_data_t *m_aci_tx_next(aci_queue_t **pp_tx_q)
+{
+  hal_aci_data_t *p_head = m_aci_tx_head(pp_tx_q);
 
-  // Receive from queue
-  if (!aci_queue_dequeue(&aci_tx_q, &data_to_send))
+  if (aci_tl->tx_hold && (NULL != p_head) && (ACI_CMD_WAKEUP != p_head->buffer[1]))
   {
-    /* queue was empty, nothing to send */
-    data_to_send.status_byte = 0;
-    data_to_send.buffer[0] = 0;
+    return NULL;
   }
+  return p_head;
+}
 
-  // Receive and/or transmit data
-  m_aci_spi_transfer(&data_to_send, &received_data);
+static inline bool m_aci_tx_ready(void)
+{
+  aci_queue_t *tx_q;
 
-  /* If there are messages to transmit, and we can store the reply, we request a new transfer */
-  if (!aci_queue_is_full(&aci_rx_q) && !aci_queue_is_empty(&aci_tx_q))
+  return (NULL != m_aci_tx_next(&tx_q));
+}
+
+/* The hold starts once the Sleep is sent and ends with the Device Started of the wakeup or a reset,
+   or with the command response of a refused Sleep */
+static inline void m_aci_tx_hold_update(const hal_aci_data_t *p_sent, const hal_aci_data_t *p_received)
+{
+  if ((NULL != p_sent) && (ACI_CMD_SLEEP == p_sent->buffer[1]))
   {
-    m_aci_reqn_enable();
+    aci_tl->tx_hold = true;
   }
-
-  // Check if we received data
-  if (received_data.buffer[0] > 0)
+  // The nRF8001 answers a Sleep only to refuse it
+  if ((0 != p_received->buffer[0]) &&
+      ((ACI_EVT_DEVICE_STARTED == p_received->buffer[1]) ||
+       ((ACI_EVT_CMD_RSP == p_received->buffer[1]) && (ACI_CMD_SLEEP == p_received->buffer[2]))))
   {
-    if (!aci_queue_enqueue(&aci_rx_q, &received_data))
-    {
-      /* Receive Buffer full.
-         Should never happen.
-         Spin in a while loop.
-      */
-      while(1);
-    }
+    aci_tl->tx_hold = false;
   }
-
-  return;
 }
+#else
+#define m_aci_tx_next(pp_tx_q)                    m_aci_tx_head(pp_tx_q)
+#define m_aci_tx_ready()                          (!m_aci_tx_is_empty())
+#define m_aci_tx_hold_update(p_sent, p_received)  do { } while (0)
+#endif
 
-/** @brief Point the low level library at the ACI pins specified
- *  @details
- *  The ACI pins are specified in the application and a pointer is made available for
- *  the low level library to use
- */
-static void m_aci_pins_set(aci_pins_t *a_pins_ptr)
+#if HAL_ACI_TL_DATA_MARKS
+/* Called after each transfer, the pipe error clocked in with a command is for an earlier one */
+static inline void m_aci_data_sent(const hal_aci_data_t *p_sent)
 {
-  a_pins_local_ptr = a_pins_ptr;
+  if (NULL == p_sent)
+  {
+    return;
+  }
+  if (ACI_CMD_SEND_DATA == p_sent->buffer[1])
+  {
+    aci_tl->data_last = aci_tl->data_sent++;
+  }
+  else
+  {
+    aci_tl->data_last = ACI_DATA_MARK_NONE;
+  }
 }
 
-static inline void m_aci_reqn_disable (void)
+/* Called before a pipe error is committed to aci_tl->rx_q. The marks keep the order of the
+   errors, once one could not be marked the later ones are not either until the marks are taken. */
+static void m_aci_data_mark(const hal_aci_data_t *p_received, uint16_t data_last)
 {
-  digitalWrite(a_pins_local_ptr->reqn_pin, 1);
+  if (ACI_EVT_PIPE_ERROR != p_received->buffer[1])
+  {
+    return;
+  }
+  if ((0 != aci_tl->data_marks_lost) || (aci_tl->data_marks_count >= ACI_DATA_MARKS_DEPTH))
+  {
+    aci_tl->data_marks_lost++;
+    return;
+  }
+  aci_tl->data_marks[(aci_tl->data_marks_head + aci_tl->data_marks_count) % ACI_DATA_MARKS_DEPTH] = data_last;
+  aci_tl->data_marks_count++;
 }
 
-static inline void m_aci_reqn_enable (void)
+/* The SendData flushed were never clocked out */
+static void m_aci_data_marks_flush(void)
 {
-  digitalWrite(a_pins_local_ptr->reqn_pin, 0);
+  aci_tl->data_queued      = aci_tl->data_sent;
+  aci_tl->data_last        = ACI_DATA_MARK_NONE;
+  aci_tl->data_marks_head  = 0;
+  aci_tl->data_marks_count = 0;
+  aci_tl->data_marks_lost  = 0;
 }
 
-static void m_aci_q_flush(void)
+#define HAL_ACI_DATA_LAST(var)              const uint16_t var = aci_tl->data_last
+#define HAL_ACI_DATA_SENT(p_sent)           m_aci_data_sent(p_sent)
+#define HAL_ACI_DATA_MARK(p_received, last) m_aci_data_mark(p_received, last)
+#define HAL_ACI_DATA_QUEUED(p_cmd)          do { if (ACI_CMD_SEND_DATA == (p_cmd)->buffer[1]) { aci_tl->data_queued++; } } while (0)
+#else
+#define HAL_ACI_DATA_LAST(var)
+#define HAL_ACI_DATA_SENT(p_sent)
+#define HAL_ACI_DATA_MARK(p_received, last)
+#define HAL_ACI_DATA_QUEUED(p_cmd)
+#endif
+
+#if HAL_ACI_TL_TX_LOW_WATER
+/* Raises the space once the command queue is down to the low-water mark, called after each command sent */
+static inline void m_aci_tx_space_check(void)
 {
-  noInterrupts();
-  /* re-initialize aci cmd queue and aci event queue to flush them*/
-  aci_queue_init(&aci_tx_q);
-  aci_queue_init(&aci_rx_q);
-  interrupts();
+  if (aci_tl->tx_space_armed && (aci_queue_bytes_used(&aci_tl->tx_q) <= HAL_ACI_TL_TX_LOW_WATER))
+  {
+    aci_tl->tx_space_armed = false;
+    aci_tl->tx_space       = true;
+    if (NULL != aci_tl->tx_space_cb)
+    {
+      aci_tl->tx_space_cb();
+    }
+  }
 }
 
-static bool m_aci_spi_transfer(hal_aci_data_t * data_to_send, hal_aci_data_t * received_data)
+#define m_aci_tx_space_arm()  (aci_tl->tx_space_armed = true)
+#else
+#define m_aci_tx_space_check()  do { } while (0)
+#define m_aci_tx_space_arm()    do { } while (0)
+#endif
+
+#if HAL_ACI_TL_SOFT_EVENTS
+/* Counts the credits of an event clocked in, before the filter and the coalescing take it */
+static inline void m_aci_soft_credits(const hal_aci_data_t *p_received)
 {
-  uint8_t byte_cnt;
-  uint8_t byte_sent_cnt;
-  uint8_t max_bytes;
+  if ((NULL != aci_tl->soft_credit_cb) && (ACI_EVT_DATA_CREDIT == p_received->buffer[1]))
+  {
+    aci_tl->soft_credits += p_received->buffer[2];
+  }
+}
 
-  m_aci_reqn_enable();
+/* Keeps an event committed to the event queue for the soft data handler, when its pipe is a soft one */
+static inline void m_aci_soft_event(const hal_aci_data_t *p_received)
+{
+  const uint8_t pipe = p_received->buffer[2];
 
-  // Send length, receive header
-  byte_sent_cnt = 0;
-  received_data->status_byte = spi_readwrite(data_to_send->buffer[byte_sent_cnt++]);
-  // Send first byte, receive length from slave
-  received_data->buffer[0] = spi_readwrite(data_to_send->buffer[byte_sent_cnt++]);
-  if (0 == data_to_send->buffer[0])
+  if ((NULL == aci_tl->soft_data_cb) || (ACI_EVT_DATA_RECEIVED != p_received->buffer[1]) ||
+      (pipe > ACI_DEVICE_MAX_PIPES) || !(aci_tl->soft_pipes[pipe / 8] & (0x01 << (pipe % 8))))
+  {
+    return;
+  }
+  if (aci_tl->soft_count < HAL_ACI_TL_SOFT_EVENTS)
   {
-    max_bytes = received_data->buffer[0];
+    aci_tl->soft_events[aci_tl->soft_count++] = p_received;
   }
   else
   {
-    // Set the maximum to the biggest size. One command byte is already sent
-    max_bytes = (received_data->buffer[0] > (data_to_send->buffer[0] - 1))
-                                          ? received_data->buffer[0]
-                                          : (data_to_send->buffer[0] - 1);
+    aci_tl->soft_dropped++;
   }
+}
 
-  if (max_bytes > HAL_ACI_MAX_LENGTH)
+/* Gives the soft events to their handlers, the events are still in the event queue */
+static void m_aci_soft_run(void)
+{
+  uint8_t i;
+
+  for (i = 0; i < aci_tl->soft_count; i++)
   {
-    max_bytes = HAL_ACI_MAX_LENGTH;
+    aci_tl->soft_data_cb(aci_tl->soft_events[i]);
   }
-
-  // Transmit/receive the rest of the packet
-  for (byte_cnt = 0; byte_cnt < max_bytes; byte_cnt++)
+  aci_tl->soft_count = 0;
+  if (0 != aci_tl->soft_credits)
   {
-    received_data->buffer[byte_cnt+1] =  spi_readwrite(data_to_send->buffer[byte_sent_cnt++]);
+    aci_tl->soft_credit_cb(aci_tl->soft_credits);
+    aci_tl->soft_credits = 0;
   }
+}
+#else
+#define m_aci_soft_credits(p_received)  do { } while (0)
+#define m_aci_soft_event(p_received)    do { } while (0)
+#define m_aci_soft_run()                do { } while (0)
+#endif
 
-  // RDYN should follow the REQN line in approx 100ns
-  m_aci_reqn_disable();
+#if HAL_ACI_TL_TRACE
+/* Binary trace of the ACI commands and events, see hal_aci_tl.h for the record format */
+static uint8_t   aci_trace_buf[HAL_ACI_TL_TRACE_BYTES];
+static uint16_t  aci_trace_head;
+static uint16_t  aci_trace_count;
+static uint16_t  aci_trace_dropped;
 
-  return (max_bytes > 0);
+static inline uint8_t m_aci_trace_byte(uint16_t index)
+{
+  return aci_trace_buf[(aci_trace_head + index) % HAL_ACI_TL_TRACE_BYTES];
 }
 
-void hal_aci_tl_debug_print(bool enable)
+static inline uint16_t m_aci_trace_record_length(void)
 {
-	aci_debug_print = enable;
+  return HAL_ACI_TRACE_HEADER_LENGTH + m_aci_trace_byte(HAL_ACI_TRACE_HEADER_LENGTH - 1);
 }
 
-void hal_aci_tl_pin_reset(void)
+static void m_aci_trace_drop(uint16_t length)
 {
-    if (UNUSED != a_pins_local_ptr->reset_pin)
-    {
-        pinMode(a_pins_local_ptr->reset_pin, OUTPUT);
+  aci_trace_head   = (aci_trace_head + length) % HAL_ACI_TL_TRACE_BYTES;
+  aci_trace_count -= length;
+}
 
-        if ((REDBEARLAB_SHIELD_V1_1     == a_pins_local_ptr->board_name) ||
-            (REDBEARLAB_SHIELD_V2012_07 == a_pins_local_ptr->board_name))
-        {
-            //The reset for the Redbearlab v1.1 and v2012.07 boards are inverted and has a Power On Reset
-            //circuit that takes about 100ms to trigger the reset
-            digitalWrite(a_pins_local_ptr->reset_pin, 1);
-            delay(100);
-            digitalWrite(a_pins_local_ptr->reset_pin, 0);
-        }
-        else
-        {
-            digitalWrite(a_pins_local_ptr->reset_pin, 1);
-            digitalWrite(a_pins_local_ptr->reset_pin, 0);
-            digitalWrite(a_pins_local_ptr->reset_pin, 1);
-        }
-    }
+/* Copy length bytes to the trace at offset, in at most two pieces around the end of the ring */
+static void m_aci_trace_put(uint16_t offset, const uint8_t *p_src, uint16_t length)
+{
+  const uint16_t first = ((offset + length) > HAL_ACI_TL_TRACE_BYTES) ? (HAL_ACI_TL_TRACE_BYTES - offset) : length;
+
+  memcpy(&aci_trace_buf[offset], p_src, first);
+  memcpy(&aci_trace_buf[0], p_src + first, length - first);
 }
 
-bool hal_aci_tl_event_peek(hal_aci_data_t *p_aci_data)
+static void m_aci_trace_record(uint8_t trace_type, const uint8_t *p_bytes, uint8_t length)
 {
-  if (!a_pins_local_ptr->interface_is_interrupt)
+  const uint16_t record_length = HAL_ACI_TRACE_HEADER_LENGTH + length;
+  const uint32_t time_us = micros();
+  uint8_t  header[HAL_ACI_TRACE_HEADER_LENGTH];
+  uint16_t tail;
+
+  if (record_length > HAL_ACI_TL_TRACE_BYTES)
   {
-    m_aci_event_check();
+    aci_trace_dropped++;
+    return;
   }
 
-  if (aci_queue_peek(&aci_rx_q, p_aci_data))
+  /* Make room by dropping the oldest records */
+  while ((HAL_ACI_TL_TRACE_BYTES - aci_trace_count) < record_length)
   {
-    return true;
+    m_aci_trace_drop(m_aci_trace_record_length());
+    aci_trace_dropped++;
   }
 
-  return false;
+  header[0] = trace_type;
+  header[1] = (uint8_t)(time_us);
+  header[2] = (uint8_t)(time_us >> 8);
+  header[3] = (uint8_t)(time_us >> 16);
+  header[4] = (uint8_t)(time_us >> 24);
+  header[5] = length;
+
+  tail = (aci_trace_head + aci_trace_count) % HAL_ACI_TL_TRACE_BYTES;
+  m_aci_trace_put(tail, header, HAL_ACI_TRACE_HEADER_LENGTH);
+  tail = (tail + HAL_ACI_TRACE_HEADER_LENGTH) % HAL_ACI_TL_TRACE_BYTES;
+  m_aci_trace_put(tail, p_bytes, length);
+  aci_trace_count += record_length;
 }
 
-bool hal_aci_tl_event_get(hal_aci_data_t *p_aci_data)
+uint16_t hal_aci_tl_trace_read(uint8_t *p_buffer, uint16_t max_length)
 {
-  bool was_full;
-
-  if (!a_pins_local_ptr->interface_is_interrupt && !aci_queue_is_full(&aci_rx_q))
-  {
-    m_aci_event_check();
-  }
-
-  was_full = aci_queue_is_full(&aci_rx_q);
+  uint16_t read_length = 0;
+  uint16_t record_length;
+  uint16_t i;
 
-  if (aci_queue_dequeue(&aci_rx_q, p_aci_data))
+  while (0 != aci_trace_count)
   {
-    if (aci_debug_print)
+    record_length = m_aci_trace_record_length();
+    if ((read_length + record_length) > max_length)
     {
-      Serial.print(" E");
-      m_aci_data_print(p_aci_data);
+      break;
     }
 
-    if (was_full && a_pins_local_ptr->interface_is_interrupt)
-	  {
-      /* Enable RDY line interrupt again */
-      attachInterrupt(a_pins_local_ptr->interrupt_number, m_aci_isr, LOW);
+    for (i = 0; i < record_length; i++)
+    {
+      p_buffer[read_length++] = m_aci_trace_byte(i);
     }
+    m_aci_trace_drop(record_length);
+  }
+
+  return read_length;
+}
+
+uint8_t hal_aci_tl_trace_drain(uint8_t max_records)
+{
+  uint8_t  records = 0;
+  uint16_t record_length;
+  uint16_t i;
 
-    /* Attempt to pull REQN LOW since we've made room for new messages */
-    if (!aci_queue_is_full(&aci_rx_q) && !aci_queue_is_empty(&aci_tx_q))
+  while ((0 != aci_trace_count) && (records < max_records))
+  {
+    record_length = m_aci_trace_record_length();
+    for (i = 0; i < record_length; i++)
     {
-      m_aci_reqn_enable();
+      Serial.write(m_aci_trace_byte(i));
     }
-
-    return true;
+    m_aci_trace_drop(record_length);
+    records++;
   }
 
-  return false;
+  return records;
 }
 
-void hal_aci_tl_init(aci_pins_t *a_pins, bool debug)
+uint16_t hal_aci_tl_trace_dropped(void)
 {
-  aci_debug_print = debug;
+  return aci_trace_dropped;
+}
+#elif (ACI_LOG_LEVEL >= ACI_LOG_LEVEL_TRACE)
+/* Without the trace ring the records of the trace log level are written to the Serial right away */
+static void m_aci_trace_record(uint8_t trace_type, const uint8_t *p_bytes, uint8_t length)
+{
+  const uint32_t time_us = micros();
+  uint8_t header[HAL_ACI_TRACE_HEADER_LENGTH];
+
+  header[0] = trace_type;
+  header[1] = (uint8_t)(time_us);
+  header[2] = (uint8_t)(time_us >> 8);
+  header[3] = (uint8_t)(time_us >> 16);
+  header[4] = (uint8_t)(time_us >> 24);
+  header[5] = length;
+
+  Serial.write(header, HAL_ACI_TRACE_HEADER_LENGTH);
+  Serial.write(p_bytes, length);
+}
+#endif
 
-  /* Needs to be called as the first thing for proper intialization*/
-  m_aci_pins_set(a_pins);
+#if (HAL_ACI_TL_TRACE || (ACI_LOG_LEVEL >= ACI_LOG_LEVEL_TRACE))
+void aci_log_write(uint8_t id, uint16_t value)
+{
+  uint8_t record[3];
 
-  /*
-  The SPI lines used are mapped directly to the hardware SPI
-  MISO MOSI and SCK
-  Change here if the pins are mapped differently
+  record[0] = id;
+  record[1] = (uint8_t)(value);
+  record[2] = (uint8_t)(value >> 8);
+  m_aci_trace_record(HAL_ACI_TRACE_LOG, record, sizeof(record));
+}
+#endif
 
-  The SPI library assumes that the hardware pins are used
-  */
-  SPI.begin();
-  //Board dependent defines
-  #if defined (__AVR__)
-    //For Arduino use the LSB first
-    SPI.setBitOrder(LSBFIRST);
-  #elif defined(__PIC32MX__)
-    //For ChipKit use MSBFIRST and REVERSE the bits on the SPI as LSBFIRST is not supported
-    SPI.setBitOrder(MSBFIRST);
-  #endif
-  SPI.setClockDivider(a_pins->spi_clock_divider);
-  SPI.setDataMode(SPI_MODE0);
+/*
+  Debug output of a command or an event when aci_debug_print is set: into the trace buffer
+  when it is compiled in, a binary record at the trace log level, printed on the Serial at the
+  info log level and left out below it.
+*/
+static void m_aci_debug_log(uint8_t trace_type, const hal_aci_data_t *p_data)
+{
+#if (HAL_ACI_TL_TRACE || (ACI_LOG_LEVEL >= ACI_LOG_LEVEL_TRACE))
+  m_aci_trace_record(trace_type, &p_data->buffer[1], p_data->buffer[0]);
+#elif HAL_ACI_DEBUG_TEXT
+  Serial.print((HAL_ACI_TRACE_COMMAND == trace_type) ? "C" : " E");
+  m_aci_data_print(p_data);
+#else
+  (void)trace_type;
+  (void)p_data;
+#endif
+}
 
-  /* Initialize the ACI Command queue. This must be called after the delay above. */
-  aci_queue_init(&aci_tx_q);
-  aci_queue_init(&aci_rx_q);
+#if HAL_ACI_DEBUG_TEXT
+void m_aci_data_print(const hal_aci_data_t *p_data)
+{
+  const uint8_t length = p_data->buffer[0];
+  uint8_t i;
+  Serial.print(length, DEC);
+  Serial.print(" :");
+  for (i=0; i<=length; i++)
+  {
+    Serial.print(p_data->buffer[i], HEX);
+    Serial.print(F(", "));
+  }
+  Serial.println(F(""));
+}
+#endif
 
-  //Configure the IO lines
-  pinMode(a_pins->rdyn_pin,		INPUT_PULLUP);
-  pinMode(a_pins->reqn_pin,		OUTPUT);
+/*
+  Interrupt service routine called when the RDYN line goes low. Runs the SPI transfer.
+  While commands are queued and there is room for the events, the next transfer is started
+  right away instead of waiting for another interrupt.
+*/
+static void m_aci_isr(void)
+{
+  uint8_t transfers = HAL_ACI_ISR_MAX_TRANSFERS;
 
-  if (UNUSED != a_pins->active_pin)
+#if HAL_ACI_RDYN_EDGE_TRIGGERED
+  /* A latched edge may already have been served by the previous back-to-back transfer */
+  if (m_aci_rdyn_is_high())
   {
-    pinMode(a_pins->active_pin,	INPUT);
+    return;
   }
-  /* Pin reset the nRF8001, required when the nRF8001 setup is being changed */
-  hal_aci_tl_pin_reset();
+#endif
+
+  while (m_aci_isr_transfer() && (0 != --transfers))
+  {
+    /* REQN is low again, RDYN has to go high for the end of this transfer and low for the next */
+    if (!m_aci_rdyn_wait(HIGH) || !m_aci_rdyn_wait(LOW))
+    {
+      /* The nRF8001 is busy, the RDYN level interrupt picks up the transfer */
+      break;
+    }
+  }
+  m_aci_soft_run();
+}
+
+#if (HAL_ACI_INSTANCES > 1)
+/*
+  Runs m_aci_isr on the instance of the interrupt, the main context selection is put back after.
+*/
+static void m_aci_isr_on(aci_tl_ctx_t *p_ctx)
+{
+  aci_tl_ctx_t *p_selected = aci_tl;
 
-  /* Set the nRF8001 to a known state as required by the datasheet*/
-  digitalWrite(a_pins->miso_pin, 0);
-  digitalWrite(a_pins->mosi_pin, 0);
-  digitalWrite(a_pins->reqn_pin, 1);
-  digitalWrite(a_pins->sck_pin,  0);
+  aci_tl = p_ctx;
+  m_aci_isr();
+  aci_tl = p_selected;
+}
+#endif
 
-  delay(30); //Wait for the nRF8001 to get hold of its lines - the lines float for a few ms after the reset
+/*
+  Waits up to HAL_ACI_RDYN_WAIT_LOOPS polls for RDYN to reach level.
+*/
+static bool m_aci_rdyn_wait(bool level)
+{
+  uint16_t loops = HAL_ACI_RDYN_WAIT_LOOPS;
 
-  /* Attach the interrupt to the RDYN line as requested by the caller */
-  if (a_pins->interface_is_interrupt)
+  while (m_aci_rdyn_is_high() != level)
   {
-    // We use the LOW level of the RDYN line as the atmega328 can wakeup from sleep only on LOW
-    attachInterrupt(a_pins->interrupt_number, m_aci_isr, LOW);
+    if (0 == --loops)
+    {
+      return false;
+    }
   }
+  return true;
 }
 
-bool hal_aci_tl_send(hal_aci_data_t *p_aci_cmd)
+/*
+  Runs one transfer from the ISR.
+  Returns true when REQN has been pulled low again for another queued command.
+*/
+static bool m_aci_isr_transfer(void)
 {
-  const uint8_t length = p_aci_cmd->buffer[0];
-  bool ret_val = false;
+  hal_aci_data_t *data_to_send;
+  hal_aci_data_t *received_data;
+  aci_queue_t    *tx_q;
+#if ACI_RX_DATA_QUEUE_BYTES
+  hal_aci_data_t *data_received;  // Moved to the data event queue
+#endif
 
-  if (length > HAL_ACI_MAX_LENGTH)
+  // Receive straight into the tail of the event queue
+  received_data = m_aci_rx_slot();
+  if (NULL == received_data)
   {
+    /* No room to store incoming messages, wait until hal_aci_tl_event_get() makes room */
+#if HAL_ACI_RDYN_EDGE_TRIGGERED
+    aci_tl->rdyn_pending = true;
+#else
+    detachInterrupt(aci_tl->a_pins_ptr->interrupt_number);
+#endif
+    HAL_ACI_STATS_ADD(rx_full_stalls, 1);
+    m_aci_rx_overflow(NULL);
     return false;
   }
 
-  ret_val = aci_queue_enqueue(&aci_tx_q, p_aci_cmd);
-  if (ret_val)
+  // Transmit straight from the head of the command queue, NULL when there is nothing to send
+  data_to_send = m_aci_tx_next(&tx_q);
+
+  // Receive and/or transmit data
+  HAL_ACI_STAMP_NOW(rdyn_time);
+  ACI_STACK_SAMPLE(aci_stack_isr_sp_min);
+  m_aci_spi_transfer(data_to_send, received_data);
+  HAL_ACI_STATS_ADD(isr_transfers, 1);
+  HAL_ACI_HYBRID_COUNT();
+  m_aci_tx_hold_update(data_to_send, received_data);
+  HAL_ACI_DATA_LAST(data_last);
+  HAL_ACI_DATA_SENT(data_to_send);
+
+  if (NULL != data_to_send)
+  {
+    aci_queue_consume_from_isr(tx_q);
+    m_aci_tx_space_check();
+  }
+
+  // Check if we received data
+  if (received_data->buffer[0] > 0)
   {
-    if(!aci_queue_is_full(&aci_rx_q))
+    m_aci_soft_credits(received_data);
+#if HAL_ACI_EVENT_FILTER
+    if (m_aci_rx_filter(received_data))
+    {
+      // Handled in the transport, the entry clocked into is not committed
+    }
+    else
+#endif
+#if HAL_ACI_RX_CREDIT_COALESCE
+    if (m_aci_rx_credit_merge(received_data))
+    {
+      // Merged into the queued ACI_EVT_DATA_CREDIT, the entry clocked into is not committed
+    }
+    else
+#endif
+#if ACI_RX_DATA_QUEUE_BYTES
+    if (NULL != (data_received = m_aci_rx_data_route(received_data)))
+    {
+      m_aci_soft_event(data_received);
+    }
+    else
+#endif
+#if (HAL_ACI_RX_OVERFLOW_POLICY != HAL_ACI_RX_OVERFLOW_STALL)
+    if (&aci_tl->rx_overflow_buffer == received_data)
+    {
+      m_aci_rx_overflow(received_data);
+    }
+    else
+#endif
+    {
+      HAL_ACI_STAMP(received_data, rdyn_time);
+      HAL_ACI_DATA_MARK(received_data, data_last);
+      aci_queue_commit_from_isr(&aci_tl->rx_q);
+      HAL_ACI_STATS_HIGH_WATER(rx_q_high_water, &aci_tl->rx_q);
+      m_aci_soft_event(received_data);
+    }
+
+#if (!HAL_ACI_RDYN_EDGE_TRIGGERED && (HAL_ACI_RX_OVERFLOW_POLICY == HAL_ACI_RX_OVERFLOW_STALL))
+    // Disable ready line interrupt until we have room to store incoming messages
+    if (!m_aci_rx_can_accept())
+    {
+      detachInterrupt(aci_tl->a_pins_ptr->interrupt_number);
+      HAL_ACI_STATS_ADD(rx_full_stalls, 1);
+      m_aci_rx_overflow(NULL);
+    }
+#endif
+  }
+
+  if (m_aci_rx_can_accept() && m_aci_tx_ready())
+  {
+    m_aci_reqn_enable();
+    return true;
+  }
+
+  return false;
+}
+
+/*
+  Checks the RDYN line and runs the SPI transfer if required.
+  Only used in polling mode, where the queues are not touched by the ISR, so the in-place
+  queue accessors can be used directly.
+*/
+static void m_aci_event_check(void)
+{
+  hal_aci_data_t *data_to_send;
+  hal_aci_data_t *received_data;
+  aci_queue_t    *tx_q;
+#if ACI_RX_DATA_QUEUE_BYTES
+  hal_aci_data_t *data_received;  // Moved to the data event queue
+#endif
+
+  // No room to store incoming messages
+  received_data = m_aci_rx_slot();
+  if (NULL == received_data)
+  {
+    return;
+  }
+
+  // If the ready line is disabled and we have pending messages outgoing we enable the request line
+  if (m_aci_rdyn_is_high())
+  {
+    if (m_aci_tx_ready())
     {
-      // Lower the REQN only when successfully enqueued
       m_aci_reqn_enable();
     }
 
-    if (aci_debug_print)
+    return;
+  }
+
+  data_to_send = m_aci_tx_next(&tx_q);
+
+  // Receive and/or transmit data
+  HAL_ACI_STAMP_NOW(rdyn_time);
+  ACI_STACK_SAMPLE(aci_stack_loop_sp_min);
+#if ((HAL_ACI_INSTANCES > 1) && !ACI_SPI_USE_TRANSACTIONS)
+  /* The ISR of another instance must not use the SPI in the middle of this transfer */
+  noInterrupts();
+  m_aci_spi_transfer(data_to_send, received_data);
+  interrupts();
+#else
+  m_aci_spi_transfer(data_to_send, received_data);
+#endif
+  HAL_ACI_STATS_ADD(poll_transfers, 1);
+  HAL_ACI_HYBRID_COUNT();
+  m_aci_tx_hold_update(data_to_send, received_data);
+  HAL_ACI_DATA_LAST(data_last);
+  HAL_ACI_DATA_SENT(data_to_send);
+
+  if (NULL != data_to_send)
+  {
+    aci_queue_consume_from_isr(tx_q);
+    m_aci_tx_space_check();
+  }
+
+  // Check if we received data
+  if (received_data->buffer[0] > 0)
+  {
+    m_aci_soft_credits(received_data);
+#if HAL_ACI_EVENT_FILTER
+    if (m_aci_rx_filter(received_data))
     {
-      Serial.print("C"); //ACI Command
-      m_aci_data_print(p_aci_cmd);
+      // Handled in the transport, the entry clocked into is not committed
+    }
+    else
+#endif
+#if HAL_ACI_RX_CREDIT_COALESCE
+    if (m_aci_rx_credit_merge(received_data))
+    {
+      // Merged into the queued ACI_EVT_DATA_CREDIT, the entry clocked into is not committed
+    }
+    else
+#endif
+#if ACI_RX_DATA_QUEUE_BYTES
+    if (NULL != (data_received = m_aci_rx_data_route(received_data)))
+    {
+      m_aci_soft_event(data_received);
+    }
+    else
+#endif
+#if (HAL_ACI_RX_OVERFLOW_POLICY != HAL_ACI_RX_OVERFLOW_STALL)
+    if (&aci_tl->rx_overflow_buffer == received_data)
+    {
+      m_aci_rx_overflow(received_data);
+    }
+    else
+#endif
+    {
+      HAL_ACI_STAMP(received_data, rdyn_time);
+      HAL_ACI_DATA_MARK(received_data, data_last);
+      aci_queue_commit_from_isr(&aci_tl->rx_q);
+      HAL_ACI_STATS_HIGH_WATER(rx_q_high_water, &aci_tl->rx_q);
+      m_aci_soft_event(received_data);
     }
   }
 
-  return ret_val;
+  /* If there are messages to transmit, and we can store the reply, we request a new transfer */
+  if (m_aci_rx_can_accept() && m_aci_tx_ready())
+  {
+    m_aci_reqn_enable();
+  }
+
+  m_aci_soft_run();
+  return;
 }
 
-static uint8_t spi_readwrite(const uint8_t aci_byte)
+#if HAL_ACI_RX_CREDIT_COALESCE
+/*
+  Adds the credits of an ACI_EVT_DATA_CREDIT just clocked in to the newest queued event, when that
+  one is an ACI_EVT_DATA_CREDIT too. The head event is left alone, the main context may be reading it.
+  Returns true when the credits were added.
+*/
+static bool m_aci_rx_credit_merge(const hal_aci_data_t *received_data)
 {
-	//Board dependent defines
-#if defined (__AVR__)
-    //For Arduino the transmission does not have to be reversed
-    return SPI.transfer(aci_byte);
-#elif defined(__PIC32MX__)
-    //For ChipKit the transmission has to be reversed
-    uint8_t tmp_bits;
-    tmp_bits = SPI.transfer(REVERSE_BITS(aci_byte));
-	return REVERSE_BITS(tmp_bits);
+  hal_aci_data_t *p_newest;
+
+  if ((2 != received_data->buffer[0]) || (ACI_EVT_DATA_CREDIT != received_data->buffer[1]))
+  {
+    return false;
+  }
+
+  p_newest = aci_queue_newest_from_isr(&aci_tl->rx_q);
+  if ((NULL == p_newest) || (aci_queue_peek_slot_from_isr(&aci_tl->rx_q) == p_newest) ||
+      (2 != p_newest->buffer[0]) || (ACI_EVT_DATA_CREDIT != p_newest->buffer[1]))
+  {
+    return false;
+  }
+
+  p_newest->buffer[2] += received_data->buffer[2];
+  HAL_ACI_STATS_ADD(rx_credit_coalesced, 1);
+  return true;
+}
 #endif
+
+#if HAL_ACI_EVENT_FILTER
+/*
+  Keeps an event of the filter mask out of the event queue, what it carries for the ACI Library
+  is kept in aci_tl->filtered. Returns true when the event was filtered.
+*/
+static bool m_aci_rx_filter(const hal_aci_data_t *received_data)
+{
+  const uint8_t evt_opcode = received_data->buffer[1];
+
+  if ((evt_opcode < ACI_EVT_DEVICE_STARTED) || (evt_opcode > ACI_EVT_KEY_REQUEST) ||
+      (0 == (aci_tl->filter_mask & HAL_ACI_EVENT_FILTER_BIT(evt_opcode))))
+  {
+    return false;
+  }
+
+  if (ACI_EVT_DATA_CREDIT == evt_opcode)
+  {
+    aci_tl->filtered.credits += received_data->buffer[2];
+  }
+  else if (ACI_EVT_TIMING == evt_opcode)
+  {
+    aci_tl->filtered.timing_valid          = true;
+    aci_tl->filtered.conn_rf_interval      = (uint16_t)(received_data->buffer[2] | (received_data->buffer[3] << 8));
+    aci_tl->filtered.conn_slave_rf_latency = (uint16_t)(received_data->buffer[4] | (received_data->buffer[5] << 8));
+    aci_tl->filtered.conn_rf_timeout       = (uint16_t)(received_data->buffer[6] | (received_data->buffer[7] << 8));
+  }
+  aci_tl->filtered.events++;
+  return true;
 }
+#endif
 
-bool hal_aci_tl_rx_q_empty (void)
+/*
+  True when a transfer may be started: there is room for the event, or it may be dropped.
+*/
+static inline bool m_aci_rx_can_accept(void)
 {
-  return aci_queue_is_empty(&aci_rx_q);
+#if ACI_RX_DATA_QUEUE_BYTES
+  /* The next event may be for either queue */
+  return !aci_queue_is_full_from_isr(&aci_tl->rx_q) && !aci_queue_is_full_from_isr(&aci_tl->data_q);
+#elif (HAL_ACI_RX_OVERFLOW_POLICY == HAL_ACI_RX_OVERFLOW_STALL)
+  return !aci_queue_is_full_from_isr(&aci_tl->rx_q);
+#else
+  return true;
+#endif
 }
 
-bool hal_aci_tl_rx_q_full (void)
+/*
+  Where the next event is clocked in. NULL when the transfer has to wait for room.
+*/
+static hal_aci_data_t *m_aci_rx_slot(void)
+{
+  hal_aci_data_t *p_slot = aci_queue_reserve_from_isr(&aci_tl->rx_q);
+
+#if ACI_RX_DATA_QUEUE_BYTES
+  if (aci_queue_is_full_from_isr(&aci_tl->data_q))
+  {
+    p_slot = NULL;
+  }
+#endif
+#if (HAL_ACI_RX_OVERFLOW_POLICY != HAL_ACI_RX_OVERFLOW_STALL)
+  if (NULL == p_slot)
+  {
+    p_slot = &aci_tl->rx_overflow_buffer;
+  }
+#endif
+  return p_slot;
+}
+
+#if ACI_RX_DATA_QUEUE_BYTES
+/*
+  Moves an ACI_EVT_DATA_RECEIVED clocked into the event queue slot to the data event queue, which
+  m_aci_rx_slot() made sure has room. The event queue slot is not committed and is used again.
+*/
+static hal_aci_data_t *m_aci_rx_data_route(hal_aci_data_t *p_received)
 {
-  return aci_queue_is_full(&aci_rx_q);
+  hal_aci_data_t *p_data;
+
+  if (ACI_EVT_DATA_RECEIVED != p_received->buffer[1])
+  {
+    // The data still waiting came on the link that is gone
+    if (ACI_EVT_DISCONNECTED == p_received->buffer[1])
+    {
+      aci_tl->data_stale = aci_tl->data_count;
+    }
+    return NULL;
+  }
+  p_data = aci_queue_reserve_from_isr(&aci_tl->data_q);
+  memcpy(p_data, p_received, p_received->buffer[0] + 2);
+  aci_queue_commit_from_isr(&aci_tl->data_q);
+  aci_tl->data_count++;
+  return p_data;
 }
+#endif
 
-bool hal_aci_tl_tx_q_empty (void)
+/*
+  An event did not fit in the event queue (p_dropped) or the transport stalls (NULL).
+*/
+static void m_aci_rx_overflow(const hal_aci_data_t *p_dropped)
 {
-  return aci_queue_is_empty(&aci_tx_q);
+#if (HAL_ACI_RX_OVERFLOW_POLICY == HAL_ACI_RX_OVERFLOW_DROP_CREDIT)
+  if ((NULL != p_dropped) && (ACI_EVT_DATA_CREDIT == p_dropped->buffer[1]))
+  {
+    /* Not lost, delivered later by m_aci_event_removed() */
+    aci_tl->rx_dropped_credits += p_dropped->buffer[2];
+    return;
+  }
+#endif
+
+  aci_tl->overflow_count++;
+  if (NULL != aci_tl->overflow_cb)
+  {
+    aci_tl->overflow_cb(p_dropped);
+  }
 }
 
-bool hal_aci_tl_tx_q_full (void)
+/** @brief Point the low level library at the ACI pins specified
+ *  @details
+ *  The ACI pins are specified in the application and a pointer is made available for
+ *  the low level library to use
+ */
+static void m_aci_pins_set(aci_pins_t *a_pins_ptr)
 {
-  return aci_queue_is_full(&aci_tx_q);
+  aci_tl->a_pins_ptr = a_pins_ptr;
 }
 
-void hal_aci_tl_q_flush (void)
+/*
+  Gives the RDYN interrupt the NVIC priority HAL_ACI_RDYN_IRQ_PRIORITY.
+  The interrupt is shared with the other pins of the same PIO controller (SAM3X) or the whole
+  EIC (SAMD), attachInterrupt() leaves it at the core default priority.
+*/
+static inline void m_aci_rdyn_irq_priority_set(void)
 {
-  m_aci_q_flush();
+#if (defined(HAL_ACI_RDYN_IRQ_PRIORITY) && defined(__SAM3X8E__))
+  NVIC_SetPriority((IRQn_Type)g_APinDescription[aci_tl->a_pins_ptr->rdyn_pin].ulPeripheralId, HAL_ACI_RDYN_IRQ_PRIORITY);
+#elif (defined(HAL_ACI_RDYN_IRQ_PRIORITY) && defined(ARDUINO_ARCH_SAMD))
+  NVIC_SetPriority(EIC_IRQn, HAL_ACI_RDYN_IRQ_PRIORITY);
+#endif
+}
+
+/*
+  REQN is driven from both the main context and m_aci_isr.
+  On AVR the runtime path does a read-modify-write of the port, so it runs with interrupts
+  disabled, the same way digitalWrite() protects it. The SAM3X and SAMD set/clear registers
+  are atomic.
+*/
+static inline void m_aci_reqn_disable (void)
+{
+#if (defined(__AVR__) && HAL_ACI_PINS_STATIC)
+  HAL_ACI_REQN_PORT |= _BV(HAL_ACI_REQN_BIT);
+#elif defined(__AVR__)
+  uint8_t sreg = SREG;
+  cli();
+  *aci_tl->reqn_out_reg |= aci_tl->reqn_bit_mask;
+  SREG = sreg;
+#elif defined(__SAM3X8E__)
+  aci_tl->reqn_pio->PIO_SODR = aci_tl->reqn_bit_mask;
+#elif defined(ARDUINO_ARCH_SAMD)
+  aci_tl->reqn_port->OUTSET.reg = aci_tl->reqn_bit_mask;
+#else
+  digitalWrite(aci_tl->a_pins_ptr->reqn_pin, 1);
+#endif
+}
+
+static inline void m_aci_reqn_enable (void)
+{
+#if (defined(__AVR__) && HAL_ACI_PINS_STATIC)
+  HAL_ACI_REQN_PORT &= ~_BV(HAL_ACI_REQN_BIT);
+#elif defined(__AVR__)
+  uint8_t sreg = SREG;
+  cli();
+  *aci_tl->reqn_out_reg &= ~aci_tl->reqn_bit_mask;
+  SREG = sreg;
+#elif defined(__SAM3X8E__)
+  aci_tl->reqn_pio->PIO_CODR = aci_tl->reqn_bit_mask;
+#elif defined(ARDUINO_ARCH_SAMD)
+  aci_tl->reqn_port->OUTCLR.reg = aci_tl->reqn_bit_mask;
+#else
+  digitalWrite(aci_tl->a_pins_ptr->reqn_pin, 0);
+#endif
+}
+
+static inline bool m_aci_rdyn_is_high (void)
+{
+#if (defined(__AVR__) && HAL_ACI_PINS_STATIC)
+  return (0 != (HAL_ACI_RDYN_PIN_REG & _BV(HAL_ACI_RDYN_BIT)));
+#elif defined(__AVR__)
+  return (0 != (*aci_tl->rdyn_in_reg & aci_tl->rdyn_bit_mask));
+#elif defined(__SAM3X8E__)
+  return (0 != (aci_tl->rdyn_pio->PIO_PDSR & aci_tl->rdyn_bit_mask));
+#elif defined(ARDUINO_ARCH_SAMD)
+  return (0 != (aci_tl->rdyn_port->IN.reg & aci_tl->rdyn_bit_mask));
+#else
+  return (HIGH == digitalRead(aci_tl->a_pins_ptr->rdyn_pin));
+#endif
 }
+
+static void m_aci_q_flush(void)
+{
+  noInterrupts();
+  /* re-initialize aci cmd queue and aci event queue to flush them*/
+  aci_queue_init(&aci_tl->tx_q, aci_tl->tx_q_storage, sizeof(aci_tl->tx_q_storage));
+  aci_queue_init(&aci_tl->rx_q, aci_tl->rx_q_storage, sizeof(aci_tl->rx_q_storage));
+#if ACI_RX_DATA_QUEUE_BYTES
+  aci_queue_init(&aci_tl->data_q, aci_tl->data_q_storage, sizeof(aci_tl->data_q_storage));
+  aci_tl->data_count = 0;
+  aci_tl->data_stale = 0;
+#endif
+#if ACI_TX_CTRL_QUEUE_BYTES
+  aci_queue_init(&aci_tl->ctrl_q, aci_tl->ctrl_q_storage, sizeof(aci_tl->ctrl_q_storage));
+#endif
+#if ACI_TX_ISR_QUEUE_BYTES
+  aci_queue_init(&aci_tl->isr_q, aci_tl->isr_q_storage, sizeof(aci_tl->isr_q_storage));
+#endif
+  // A producer waiting for room gets it
+  m_aci_tx_space_check();
+#if (HAL_ACI_TL_LATENCY || HAL_ACI_TL_EVENT_TIME)
+  aci_stamps_head  = 0;
+  aci_stamps_count = 0;
+#endif
+#if HAL_ACI_TL_DATA_MARKS
+  m_aci_data_marks_flush();
+#endif
+#if HAL_ACI_RDYN_EDGE_TRIGGERED
+  /* There is room again for an RDYN assertion that found the event queue full */
+  if (aci_tl->rdyn_pending && m_aci_interface_is_interrupt())
+  {
+    aci_tl->rdyn_pending = false;
+    m_aci_isr();
+  }
+#endif
+  interrupts();
+}
+
+/*
+  Runs one ACI transfer. data_to_send may be NULL when there is no command pending, zeros are
+  clocked out in that case and after the end of the command. Both packets may live in the
+  queues, nothing is copied here and nothing past the command is read.
+*/
+static bool m_aci_spi_transfer(const hal_aci_data_t * data_to_send, hal_aci_data_t * received_data)
+{
+  uint8_t byte_cnt;
+  uint8_t max_bytes;
+  const uint8_t tx_length = (NULL != data_to_send) ? data_to_send->buffer[0] : 0;
+  // Command bytes left after the length and the first byte
+  const uint8_t tx_body_length = (tx_length > 1) ? (tx_length - 1) : 0;
+
+#if ACI_SPI_USE_TRANSACTIONS
+  SPI.beginTransaction(aci_tl->spi_settings);
+#endif
+  if (UNUSED != aci_tl->a_pins_ptr->optional_chip_sel_pin)
+  {
+    digitalWrite(aci_tl->a_pins_ptr->optional_chip_sel_pin, 0);
+  }
+
+  m_aci_reqn_enable();
+
+  // Send length, receive header
+  received_data->status_byte = spi_readwrite(tx_length);
+  // Send first byte, receive length from slave
+  received_data->buffer[0] = spi_readwrite((0 != tx_length) ? data_to_send->buffer[1] : 0);
+
+  // The length is also used to store the event, never trust it past the buffer
+  if (received_data->buffer[0] > HAL_ACI_MAX_LENGTH)
+  {
+    received_data->buffer[0] = HAL_ACI_MAX_LENGTH;
+  }
+
+  // Set the maximum to the biggest size. One command byte is already sent
+  max_bytes = (received_data->buffer[0] > tx_body_length) ? received_data->buffer[0] : tx_body_length;
+
+  if (max_bytes > HAL_ACI_MAX_LENGTH)
+  {
+    max_bytes = HAL_ACI_MAX_LENGTH;
+  }
+
+  // Transmit/receive the rest of the packet
+#if ACI_SPI_USE_BLOCK
+  (void)byte_cnt;
+  spi_readwrite_block((0 != tx_body_length) ? &data_to_send->buffer[2] : NULL, tx_body_length,
+                      &received_data->buffer[1], max_bytes);
+#else
+  for (byte_cnt = 0; byte_cnt < max_bytes; byte_cnt++)
+  {
+    received_data->buffer[byte_cnt+1] =  spi_readwrite((byte_cnt < tx_body_length) ? data_to_send->buffer[byte_cnt+2] : 0);
+  }
+#endif
+
+  // RDYN should follow the REQN line in approx 100ns
+  m_aci_reqn_disable();
+
+  if (UNUSED != aci_tl->a_pins_ptr->optional_chip_sel_pin)
+  {
+    digitalWrite(aci_tl->a_pins_ptr->optional_chip_sel_pin, 1);
+  }
+#if ACI_SPI_USE_TRANSACTIONS
+  SPI.endTransaction();
+#endif
+
+  HAL_ACI_STATS_ADD(spi_transfers, 1);
+  HAL_ACI_STATS_ADD(bytes_out, (0 != tx_length) ? (tx_length + 1) : 0);
+  HAL_ACI_STATS_ADD(bytes_in, (0 != received_data->buffer[0]) ? (received_data->buffer[0] + 1) : 0);
+  HAL_ACI_STATS_ADD(empty_transfers, ((0 == tx_length) && (0 == received_data->buffer[0])) ? 1 : 0);
+
+  return (max_bytes > 0);
+}
+
+/* Fastest SPI clock of the nRF8001 */
+#define ACI_SPI_CLOCK_MAX_HZ  3000000UL
+
+/*
+  SPISettings takes a clock rate, aci_pins_t holds an SPI_CLOCK_DIVn divider.
+*/
+static uint32_t m_aci_spi_clock_hz(uint8_t spi_clock_divider)
+{
+#if defined(__arm__)
+  // The ARM cores define the SPI_CLOCK_DIVn dividers against the 16MHz of the AVR boards
+  const uint32_t base_hz = 16000000UL;
+#else
+  const uint32_t base_hz = F_CPU;
+#endif
+
+  if (SPI_CLOCK_DIV2   == spi_clock_divider) return base_hz / 2;
+  if (SPI_CLOCK_DIV4   == spi_clock_divider) return base_hz / 4;
+  if (SPI_CLOCK_DIV8   == spi_clock_divider) return base_hz / 8;
+  if (SPI_CLOCK_DIV16  == spi_clock_divider) return base_hz / 16;
+  if (SPI_CLOCK_DIV32  == spi_clock_divider) return base_hz / 32;
+  if (SPI_CLOCK_DIV64  == spi_clock_divider) return base_hz / 64;
+  if (SPI_CLOCK_DIV128 == spi_clock_divider) return base_hz / 128;
+
+  // Unknown divider, use the nRF8001 maximum of 3MHz rounded down to a common value
+  return 2000000;
+}
+
+void hal_aci_tl_spi_clock_set(uint8_t spi_clock_divider)
+{
+  noInterrupts();
+  aci_tl->a_pins_ptr->spi_clock_divider = spi_clock_divider;
+#if ACI_SPI_USE_TRANSACTIONS
+  #if defined(__PIC32MX__)
+    aci_tl->spi_settings = SPISettings(m_aci_spi_clock_hz(spi_clock_divider), MSBFIRST, SPI_MODE0);
+  #else
+    aci_tl->spi_settings = SPISettings(m_aci_spi_clock_hz(spi_clock_divider), LSBFIRST, SPI_MODE0);
+  #endif
+#else
+  SPI.setClockDivider(spi_clock_divider);
+#endif
+  interrupts();
+}
+
+bool hal_aci_tl_spi_clock_divider(uint8_t index, uint8_t *p_spi_clock_divider)
+{
+  static const uint8_t dividers[] = { SPI_CLOCK_DIV2, SPI_CLOCK_DIV4, SPI_CLOCK_DIV8, SPI_CLOCK_DIV16,
+                                      SPI_CLOCK_DIV32, SPI_CLOCK_DIV64, SPI_CLOCK_DIV128 };
+  uint8_t i;
+
+  // The dividers that clock the nRF8001 above its 3MHz are left out
+  for (i = 0; i < sizeof(dividers); i++)
+  {
+    if (m_aci_spi_clock_hz(dividers[i]) > ACI_SPI_CLOCK_MAX_HZ)
+    {
+      continue;
+    }
+    if (0 == index--)
+    {
+      *p_spi_clock_divider = dividers[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+void hal_aci_tl_debug_print(bool enable)
+{
+	aci_debug_print = enable;
+}
+
+void hal_aci_tl_pin_reset(void)
+{
+    if (UNUSED != aci_tl->a_pins_ptr->reset_pin)
+    {
+        pinMode(aci_tl->a_pins_ptr->reset_pin, OUTPUT);
+
+        if ((REDBEARLAB_SHIELD_V1_1     == aci_tl->a_pins_ptr->board_name) ||
+            (REDBEARLAB_SHIELD_V2012_07 == aci_tl->a_pins_ptr->board_name))
+        {
+            //The reset for the Redbearlab v1.1 and v2012.07 boards are inverted and has a Power On Reset
+            //circuit that takes about 100ms to trigger the reset
+            digitalWrite(aci_tl->a_pins_ptr->reset_pin, 1);
+            delay(100);
+            digitalWrite(aci_tl->a_pins_ptr->reset_pin, 0);
+        }
+        else
+        {
+            digitalWrite(aci_tl->a_pins_ptr->reset_pin, 1);
+            digitalWrite(aci_tl->a_pins_ptr->reset_pin, 0);
+            digitalWrite(aci_tl->a_pins_ptr->reset_pin, 1);
+        }
+    }
+}
+
+bool hal_aci_tl_event_peek(hal_aci_data_t *p_aci_data)
+{
+  m_aci_hybrid_update();
+  if (!m_aci_interface_is_interrupt())
+  {
+    m_aci_event_check();
+  }
+
+  if (aci_queue_peek(&aci_tl->rx_q, p_aci_data))
+  {
+    return true;
+  }
+
+  return false;
+}
+
+const hal_aci_data_t *hal_aci_tl_event_peek_ptr(void)
+{
+  m_aci_hybrid_update();
+  if (!m_aci_interface_is_interrupt())
+  {
+    m_aci_event_check();
+  }
+
+  return aci_queue_peek_ptr(&aci_tl->rx_q);
+}
+
+/*
+  Bookkeeping after an event has been taken out of the event queue by the main context.
+*/
+static void m_aci_event_removed(bool was_full)
+{
+#if (HAL_ACI_RX_OVERFLOW_POLICY == HAL_ACI_RX_OVERFLOW_DROP_CREDIT)
+  if (0 != aci_tl->rx_dropped_credits)
+  {
+    hal_aci_data_t *p_credit_evt;
+
+    /* The ISR is the producer of the event queue, it must not run while this event is added */
+    noInterrupts();
+    p_credit_evt = aci_queue_reserve_from_isr(&aci_tl->rx_q);
+    if (NULL != p_credit_evt)
+    {
+      p_credit_evt->status_byte = 0;
+      p_credit_evt->buffer[0]   = 2;
+      p_credit_evt->buffer[1]   = ACI_EVT_DATA_CREDIT;
+      p_credit_evt->buffer[2]   = aci_tl->rx_dropped_credits;
+      aci_queue_commit_from_isr(&aci_tl->rx_q);
+      aci_tl->rx_dropped_credits = 0;
+    }
+    interrupts();
+  }
+#endif
+
+#if HAL_ACI_RDYN_EDGE_TRIGGERED
+  (void)was_full;
+  if (aci_tl->rdyn_pending && m_aci_interface_is_interrupt())
+  {
+    /* Serve the RDYN assertion that found the queue full, its edge is gone */
+    noInterrupts();
+    aci_tl->rdyn_pending = false;
+    m_aci_isr();
+    interrupts();
+  }
+#else
+  if (was_full && m_aci_interface_is_interrupt())
+  {
+    /* Enable RDY line interrupt again */
+    attachInterrupt(aci_tl->a_pins_ptr->interrupt_number, M_ACI_ISR, LOW);
+    m_aci_rdyn_irq_priority_set();
+  }
+#endif
+
+  /* Attempt to pull REQN LOW since we've made room for new messages */
+  if (m_aci_rx_can_accept() && m_aci_tx_ready())
+  {
+    m_aci_reqn_enable();
+  }
+}
+
+#if HAL_ACI_TL_HYBRID
+/*
+  Switches the interface at the end of every window of HAL_ACI_TL_HYBRID_WINDOW_MS, from the
+  transfers run in it: dense windows go to polling, HAL_ACI_TL_HYBRID_QUIET_WINDOWS quiet ones in
+  a row back to the RDYN interrupt. Called by the main context only.
+*/
+static void m_aci_hybrid_update(void)
+{
+  uint8_t transfers;
+
+  if ((ACI_INIT_DONE != aci_tl->init_step) || !m_aci_session_is_interrupt() ||
+      ((millis() - aci_tl->hybrid_window_ms) < HAL_ACI_TL_HYBRID_WINDOW_MS))
+  {
+    return;
+  }
+  aci_tl->hybrid_window_ms = millis();
+
+  noInterrupts();
+  transfers = aci_tl->hybrid_transfers;
+  aci_tl->hybrid_transfers = 0;
+  interrupts();
+
+  if (!aci_tl->hybrid_polling)
+  {
+    if (transfers >= HAL_ACI_TL_HYBRID)
+    {
+      /* One interrupt per transfer costs more than polling RDYN from the main context */
+      detachInterrupt(aci_tl->a_pins_ptr->interrupt_number);
+#if HAL_ACI_RDYN_EDGE_TRIGGERED
+      /* The polling finds RDYN low by itself */
+      aci_tl->rdyn_pending = false;
+#endif
+      aci_tl->hybrid_polling = true;
+      aci_tl->hybrid_quiet   = 0;
+      HAL_ACI_STATS_ADD(hybrid_switches, 1);
+    }
+    return;
+  }
+
+  if ((2 * (uint16_t)transfers) >= HAL_ACI_TL_HYBRID)
+  {
+    aci_tl->hybrid_quiet = 0;
+    return;
+  }
+  if (aci_tl->hybrid_quiet < HAL_ACI_TL_HYBRID_QUIET_WINDOWS)
+  {
+    aci_tl->hybrid_quiet++;
+  }
+  /* The RDYN interrupt is attached with room for an event, as after a stall */
+  if ((aci_tl->hybrid_quiet < HAL_ACI_TL_HYBRID_QUIET_WINDOWS) || !m_aci_rx_can_accept())
+  {
+    return;
+  }
+
+  aci_tl->hybrid_polling = false;
+  attachInterrupt(aci_tl->a_pins_ptr->interrupt_number, M_ACI_ISR, HAL_ACI_RDYN_IRQ_MODE);
+  m_aci_rdyn_irq_priority_set();
+#if HAL_ACI_RDYN_EDGE_TRIGGERED
+  /* RDYN may already be low, there will be no edge for it */
+  noInterrupts();
+  m_aci_isr();
+  interrupts();
+#endif
+}
+
+bool hal_aci_tl_hybrid_is_polling(void)
+{
+  return aci_tl->hybrid_polling;
+}
+#endif
+
+void hal_aci_tl_event_release(void)
+{
+  const hal_aci_data_t *p_aci_data = aci_queue_peek_ptr(&aci_tl->rx_q);
+  bool was_full;
+
+  if (NULL == p_aci_data)
+  {
+    return;
+  }
+
+  if (aci_debug_print)
+  {
+    m_aci_debug_log(HAL_ACI_TRACE_EVENT, p_aci_data);
+  }
+
+  was_full = aci_queue_is_full(&aci_tl->rx_q);
+  HAL_ACI_STAMP_TAKE_HEAD();
+  aci_queue_consume(&aci_tl->rx_q);
+  m_aci_event_removed(was_full);
+}
+
+#if ACI_RX_DATA_QUEUE_BYTES
+const hal_aci_data_t *hal_aci_tl_data_peek_ptr(void)
+{
+  m_aci_hybrid_update();
+  if (!m_aci_interface_is_interrupt() && m_aci_rx_can_accept())
+  {
+    m_aci_event_check();
+  }
+
+  return aci_queue_peek_ptr(&aci_tl->data_q);
+}
+
+bool hal_aci_tl_data_peek(hal_aci_data_t *p_aci_data)
+{
+  m_aci_hybrid_update();
+  if (!m_aci_interface_is_interrupt() && m_aci_rx_can_accept())
+  {
+    m_aci_event_check();
+  }
+
+  return aci_queue_peek(&aci_tl->data_q, p_aci_data);
+}
+
+void hal_aci_tl_data_release(void)
+{
+  const hal_aci_data_t *p_aci_data = aci_queue_peek_ptr(&aci_tl->data_q);
+  bool was_full;
+
+  if (NULL == p_aci_data)
+  {
+    return;
+  }
+
+  if (aci_debug_print)
+  {
+    m_aci_debug_log(HAL_ACI_TRACE_EVENT, p_aci_data);
+  }
+
+  was_full = aci_queue_is_full(&aci_tl->data_q);
+  aci_queue_consume(&aci_tl->data_q);
+  noInterrupts();
+  aci_tl->data_count--;
+  if (0 != aci_tl->data_stale)
+  {
+    aci_tl->data_stale--;
+  }
+  interrupts();
+  m_aci_event_removed(was_full);
+}
+
+bool hal_aci_tl_data_is_stale(void)
+{
+  return (0 != aci_tl->data_stale) && !aci_queue_is_empty(&aci_tl->data_q);
+}
+#endif
+
+bool hal_aci_tl_event_get(hal_aci_data_t *p_aci_data)
+{
+  bool was_full;
+
+#if HAL_ACI_TL_ACTIVE
+  noInterrupts();
+  hal_aci_tl_active_sample();
+  interrupts();
+#endif
+  m_aci_hybrid_update();
+
+  if (!m_aci_interface_is_interrupt() && m_aci_rx_can_accept())
+  {
+    m_aci_event_check();
+  }
+
+  was_full = aci_queue_is_full(&aci_tl->rx_q);
+  HAL_ACI_STAMP_TAKE_HEAD();
+
+  if (aci_queue_dequeue(&aci_tl->rx_q, p_aci_data))
+  {
+    if (aci_debug_print)
+    {
+      m_aci_debug_log(HAL_ACI_TRACE_EVENT, p_aci_data);
+    }
+
+    m_aci_event_removed(was_full);
+
+    return true;
+  }
+
+  return false;
+}
+
+uint8_t hal_aci_tl_event_get_many(hal_aci_data_t *p_aci_data, uint8_t max_count)
+{
+  uint8_t count = 0;
+  bool was_full = false;
+
+  m_aci_hybrid_update();
+  while (count < max_count)
+  {
+    if (!m_aci_interface_is_interrupt() && m_aci_rx_can_accept())
+    {
+      m_aci_event_check();
+    }
+
+    was_full |= aci_queue_is_full(&aci_tl->rx_q);
+    HAL_ACI_STAMP_TAKE_HEAD();
+
+    if (!aci_queue_dequeue(&aci_tl->rx_q, &p_aci_data[count]))
+    {
+      break;
+    }
+
+    if (aci_debug_print)
+    {
+      m_aci_debug_log(HAL_ACI_TRACE_EVENT, &p_aci_data[count]);
+    }
+
+    count++;
+  }
+
+  /* Re-enable the RDYN interrupt and re-arm REQN once for the whole batch */
+  if (count > 0)
+  {
+    m_aci_event_removed(was_full);
+  }
+
+  return count;
+}
+
+void hal_aci_tl_init_start(aci_pins_t *a_pins, bool debug)
+{
+  m_aci_init_start(a_pins, debug, true);
+}
+
+void hal_aci_tl_init_resume(aci_pins_t *a_pins, bool debug)
+{
+  m_aci_init_start(a_pins, debug, false);
+}
+
+static void m_aci_init_start(aci_pins_t *a_pins, bool debug, bool pin_reset)
+{
+  aci_debug_print = debug;
+
+  /* Needs to be called as the first thing for proper intialization*/
+  hal_aci_tl_select(a_pins->instance);
+  m_aci_pins_set(a_pins);
+
+#if (defined(__AVR__) && !HAL_ACI_PINS_STATIC)
+  /* Resolve REQN and RDYN once, so the transfers do not go through digitalWrite/digitalRead */
+  aci_tl->reqn_out_reg  = portOutputRegister(digitalPinToPort(a_pins->reqn_pin));
+  aci_tl->reqn_bit_mask = digitalPinToBitMask(a_pins->reqn_pin);
+  aci_tl->rdyn_in_reg   = portInputRegister(digitalPinToPort(a_pins->rdyn_pin));
+  aci_tl->rdyn_bit_mask = digitalPinToBitMask(a_pins->rdyn_pin);
+#elif defined(__SAM3X8E__)
+  aci_tl->reqn_pio      = g_APinDescription[a_pins->reqn_pin].pPort;
+  aci_tl->reqn_bit_mask = g_APinDescription[a_pins->reqn_pin].ulPin;
+  aci_tl->rdyn_pio      = g_APinDescription[a_pins->rdyn_pin].pPort;
+  aci_tl->rdyn_bit_mask = g_APinDescription[a_pins->rdyn_pin].ulPin;
+#elif defined(ARDUINO_ARCH_SAMD)
+  aci_tl->reqn_port     = &PORT->Group[g_APinDescription[a_pins->reqn_pin].ulPort];
+  aci_tl->reqn_bit_mask = (1ul << g_APinDescription[a_pins->reqn_pin].ulPin);
+  aci_tl->rdyn_port     = &PORT->Group[g_APinDescription[a_pins->rdyn_pin].ulPort];
+  aci_tl->rdyn_bit_mask = (1ul << g_APinDescription[a_pins->rdyn_pin].ulPin);
+#endif
+
+  /*
+  The SPI lines used are mapped directly to the hardware SPI
+  MISO MOSI and SCK
+  Change here if the pins are mapped differently
+
+  The SPI library assumes that the hardware pins are used
+  */
+  SPI.begin();
+#if ACI_SPI_USE_TRANSACTIONS
+  //Board dependent defines
+  #if defined (__AVR__)
+    //For Arduino use the LSB first
+    aci_tl->spi_settings = SPISettings(m_aci_spi_clock_hz(a_pins->spi_clock_divider), LSBFIRST, SPI_MODE0);
+  #elif defined(__PIC32MX__)
+    //For ChipKit use MSBFIRST and REVERSE the bits on the SPI as LSBFIRST is not supported
+    aci_tl->spi_settings = SPISettings(m_aci_spi_clock_hz(a_pins->spi_clock_divider), MSBFIRST, SPI_MODE0);
+  #elif defined(__arm__)
+    //For the SAMD the LSB first is done by the SERCOM, for the SAM3X by the SPI library
+    aci_tl->spi_settings = SPISettings(m_aci_spi_clock_hz(a_pins->spi_clock_divider), LSBFIRST, SPI_MODE0);
+  #elif defined(HAL_PLATFORM_HOST)
+    //For the host build the mock SPI takes the bytes as they are
+    aci_tl->spi_settings = SPISettings(m_aci_spi_clock_hz(a_pins->spi_clock_divider), LSBFIRST, SPI_MODE0);
+  #endif
+  if (m_aci_interface_is_interrupt())
+  {
+    // Other SPI users hold the RDYN interrupt off during their transactions
+    SPI.usingInterrupt(a_pins->interrupt_number);
+  }
+#else
+  //Board dependent defines
+  #if defined (__AVR__)
+    //For Arduino use the LSB first
+    SPI.setBitOrder(LSBFIRST);
+  #elif defined(__PIC32MX__)
+    //For ChipKit use MSBFIRST and REVERSE the bits on the SPI as LSBFIRST is not supported
+    SPI.setBitOrder(MSBFIRST);
+  #elif defined(__arm__)
+    //For the SAMD the LSB first is done by the SERCOM, for the SAM3X by the SPI library
+    SPI.setBitOrder(LSBFIRST);
+  #elif defined(HAL_PLATFORM_HOST)
+    //For the host build the mock SPI takes the bytes as they are
+    SPI.setBitOrder(LSBFIRST);
+  #endif
+  SPI.setClockDivider(a_pins->spi_clock_divider);
+  SPI.setDataMode(SPI_MODE0);
+#endif
+
+  if (UNUSED != a_pins->optional_chip_sel_pin)
+  {
+    digitalWrite(a_pins->optional_chip_sel_pin, 1);
+    pinMode(a_pins->optional_chip_sel_pin, OUTPUT);
+  }
+
+  /* Initialize the ACI Command queue. This must be called after the delay above. */
+  aci_queue_init(&aci_tl->tx_q, aci_tl->tx_q_storage, sizeof(aci_tl->tx_q_storage));
+  aci_queue_init(&aci_tl->rx_q, aci_tl->rx_q_storage, sizeof(aci_tl->rx_q_storage));
+#if ACI_RX_DATA_QUEUE_BYTES
+  aci_queue_init(&aci_tl->data_q, aci_tl->data_q_storage, sizeof(aci_tl->data_q_storage));
+  aci_tl->data_count = 0;
+  aci_tl->data_stale = 0;
+#endif
+#if ACI_TX_CTRL_QUEUE_BYTES
+  aci_queue_init(&aci_tl->ctrl_q, aci_tl->ctrl_q_storage, sizeof(aci_tl->ctrl_q_storage));
+#endif
+#if ACI_TX_ISR_QUEUE_BYTES
+  aci_queue_init(&aci_tl->isr_q, aci_tl->isr_q_storage, sizeof(aci_tl->isr_q_storage));
+#endif
+  aci_tl->overflow_count = 0;
+#if HAL_ACI_TL_TX_HOLD
+  aci_tl->tx_hold = false;
+#endif
+#if HAL_ACI_TL_DATA_MARKS
+  aci_tl->data_sent = 0;
+  m_aci_data_marks_flush();
+#endif
+#if (HAL_ACI_RX_OVERFLOW_POLICY == HAL_ACI_RX_OVERFLOW_DROP_CREDIT)
+  aci_tl->rx_dropped_credits = 0;
+#endif
+#if HAL_ACI_EVENT_FILTER
+  aci_tl->filter_mask = 0;
+  memset(&aci_tl->filtered, 0, sizeof(aci_tl->filtered));
+#endif
+#if HAL_ACI_TL_SOFT_EVENTS
+  aci_tl->soft_count   = 0;
+  aci_tl->soft_credits = 0;
+  aci_tl->soft_dropped = 0;
+#endif
+#if HAL_ACI_TL_HYBRID
+  aci_tl->hybrid_transfers = 0;
+  aci_tl->hybrid_polling   = false;
+  aci_tl->hybrid_quiet     = 0;
+  aci_tl->hybrid_window_ms = millis();
+#endif
+#if HAL_ACI_TL_STATS
+  hal_aci_tl_stats_reset();
+#endif
+#if (HAL_ACI_TL_LATENCY || HAL_ACI_TL_EVENT_TIME)
+  aci_stamps_head  = 0;
+  aci_stamps_count = 0;
+#endif
+#if HAL_ACI_TL_LATENCY
+  hal_aci_tl_latency_reset();
+#endif
+
+  //Configure the IO lines
+  pinMode(a_pins->rdyn_pin,		INPUT_PULLUP);
+  pinMode(a_pins->reqn_pin,		OUTPUT);
+
+  if (UNUSED != a_pins->active_pin)
+  {
+    pinMode(a_pins->active_pin,	INPUT);
+  }
+#if HAL_ACI_TL_ACTIVE
+  aci_tl->active_high = false;
+  hal_aci_tl_active_reset();
+#endif
+  if (!pin_reset)
+  {
+    /* The nRF8001 keeps running, the reset line is only driven to its inactive level */
+    if (UNUSED != a_pins->reset_pin)
+    {
+      pinMode(a_pins->reset_pin, OUTPUT);
+      digitalWrite(a_pins->reset_pin, ((REDBEARLAB_SHIELD_V1_1     == a_pins->board_name) ||
+                                       (REDBEARLAB_SHIELD_V2012_07 == a_pins->board_name)) ? 0 : 1);
+    }
+    m_aci_lines_init();
+    aci_tl->init_step = ACI_INIT_LINES_SETTLE;
+  }
+  /* Pin reset the nRF8001, required when the nRF8001 setup is being changed */
+  else if ((UNUSED != a_pins->reset_pin) &&
+      ((REDBEARLAB_SHIELD_V1_1     == a_pins->board_name) ||
+       (REDBEARLAB_SHIELD_V2012_07 == a_pins->board_name)))
+  {
+    //The reset for the Redbearlab v1.1 and v2012.07 boards are inverted and has a Power On Reset
+    //circuit that takes about 100ms to trigger the reset, hal_aci_tl_init_poll() releases it
+    pinMode(a_pins->reset_pin, OUTPUT);
+    digitalWrite(a_pins->reset_pin, 1);
+    aci_tl->init_step = ACI_INIT_RESET_HOLD;
+  }
+  else
+  {
+    hal_aci_tl_pin_reset();
+    m_aci_lines_init();
+    aci_tl->init_step = ACI_INIT_LINES_SETTLE;
+  }
+  aci_tl->init_time_ms = millis();
+}
+
+bool hal_aci_tl_init_poll(void)
+{
+  switch (aci_tl->init_step)
+  {
+    case ACI_INIT_RESET_HOLD:
+      if ((millis() - aci_tl->init_time_ms) < 100)
+      {
+        break;
+      }
+      digitalWrite(aci_tl->a_pins_ptr->reset_pin, 0);
+      m_aci_lines_init();
+      aci_tl->init_time_ms = millis();
+      aci_tl->init_step = ACI_INIT_LINES_SETTLE;
+      break;
+
+    case ACI_INIT_LINES_SETTLE:
+      //Wait for the nRF8001 to get hold of its lines - the lines float for a few ms after the reset
+      if ((millis() - aci_tl->init_time_ms) < 30)
+      {
+        break;
+      }
+
+      /* Attach the interrupt to the RDYN line as requested by the caller */
+      if (m_aci_interface_is_interrupt())
+      {
+        attachInterrupt(aci_tl->a_pins_ptr->interrupt_number, M_ACI_ISR, HAL_ACI_RDYN_IRQ_MODE);
+        m_aci_rdyn_irq_priority_set();
+#if HAL_ACI_RDYN_EDGE_TRIGGERED
+        /* RDYN may already be low, there will be no edge for it */
+        noInterrupts();
+        m_aci_isr();
+        interrupts();
+#endif
+      }
+      aci_tl->init_step = ACI_INIT_DONE;
+      break;
+
+    case ACI_INIT_DONE:
+      break;
+  }
+
+  return (ACI_INIT_DONE == aci_tl->init_step);
+}
+
+void hal_aci_tl_init(aci_pins_t *a_pins, bool debug)
+{
+  hal_aci_tl_init_start(a_pins, debug);
+
+  while (!hal_aci_tl_init_poll())
+  {
+  }
+}
+
+/*
+  Set the nRF8001 to a known state as required by the datasheet
+*/
+static void m_aci_lines_init(void)
+{
+  digitalWrite(aci_tl->a_pins_ptr->miso_pin, 0);
+  digitalWrite(aci_tl->a_pins_ptr->mosi_pin, 0);
+  digitalWrite(aci_tl->a_pins_ptr->reqn_pin, 1);
+  digitalWrite(aci_tl->a_pins_ptr->sck_pin,  0);
+}
+
+bool hal_aci_tl_send(hal_aci_data_t *p_aci_cmd)
+{
+  const uint8_t length = p_aci_cmd->buffer[0];
+  bool ret_val = false;
+
+  if (length > HAL_ACI_MAX_LENGTH)
+  {
+    ACI_LOG_ERROR(ACI_LOG_ID_CMD_TOO_LONG, "ACI command too long: ", length);
+    return false;
+  }
+
+  ret_val = aci_queue_enqueue(m_aci_tx_q_for(p_aci_cmd->buffer[1]), p_aci_cmd);
+  if (!ret_val)
+  {
+    HAL_ACI_STATS_ADD(tx_enqueue_failures, 1);
+    m_aci_tx_space_arm();
+    ACI_LOG_TRACE(ACI_LOG_ID_CMD_QUEUE_FULL, p_aci_cmd->buffer[1]);
+  }
+  else
+  {
+    HAL_ACI_DATA_QUEUED(p_aci_cmd);
+    HAL_ACI_STATS_HIGH_WATER(tx_q_high_water, &aci_tl->tx_q);
+#if ACI_TX_CTRL_QUEUE_BYTES
+    HAL_ACI_STATS_HIGH_WATER(ctrl_q_high_water, &aci_tl->ctrl_q);
+#endif
+
+    if(m_aci_rx_can_accept() && m_aci_tx_ready())
+    {
+      // Lower the REQN only when successfully enqueued
+      m_aci_reqn_enable();
+    }
+
+    if (aci_debug_print)
+    {
+      m_aci_debug_log(HAL_ACI_TRACE_COMMAND, p_aci_cmd);
+    }
+  }
+
+  return ret_val;
+}
+
+hal_aci_data_t *hal_aci_tl_send_reserve(uint8_t cmd_opcode)
+{
+  hal_aci_data_t *p_slot = aci_queue_reserve(m_aci_tx_q_for(cmd_opcode));
+
+  if (NULL == p_slot)
+  {
+    HAL_ACI_STATS_ADD(tx_enqueue_failures, 1);
+    ACI_LOG_TRACE(ACI_LOG_ID_CMD_QUEUE_FULL, cmd_opcode);
+    m_aci_tx_space_arm();
+    return NULL;
+  }
+#if ACI_TX_CTRL_QUEUE_BYTES
+  aci_tl->reserved_q = m_aci_tx_q_for(cmd_opcode);
+#endif
+
+  p_slot->status_byte = 0;
+  return p_slot;
+}
+
+bool hal_aci_tl_send_commit(void)
+{
+#if ACI_TX_CTRL_QUEUE_BYTES
+  aci_queue_t *tx_q = aci_tl->reserved_q;
+#else
+  aci_queue_t *tx_q = &aci_tl->tx_q;
+#endif
+  hal_aci_data_t *p_slot;
+
+  if (NULL == tx_q)
+  {
+    return false;
+  }
+
+  // The m_aci_isr only frees space in the command queue, the reserved slot is still there
+  p_slot = aci_queue_reserve(tx_q);
+
+  if ((NULL == p_slot) || (p_slot->buffer[0] > HAL_ACI_MAX_LENGTH))
+  {
+    return false;
+  }
+
+  // Log before the commit, the slot may be sent and reused as soon as it is queued
+  if (aci_debug_print)
+  {
+    m_aci_debug_log(HAL_ACI_TRACE_COMMAND, p_slot);
+  }
+
+  HAL_ACI_DATA_QUEUED(p_slot);
+  aci_queue_commit(tx_q);
+#if ACI_TX_CTRL_QUEUE_BYTES
+  aci_tl->reserved_q = NULL;
+  HAL_ACI_STATS_HIGH_WATER(ctrl_q_high_water, &aci_tl->ctrl_q);
+#endif
+  HAL_ACI_STATS_HIGH_WATER(tx_q_high_water, &aci_tl->tx_q);
+
+  if(m_aci_rx_can_accept() && m_aci_tx_ready())
+  {
+    m_aci_reqn_enable();
+  }
+
+  return true;
+}
+
+bool hal_aci_tl_send_coalesce(hal_aci_data_t *p_aci_cmd, uint8_t match_length)
+{
+  const uint8_t length = p_aci_cmd->buffer[0];
+  hal_aci_data_t *p_queued;
+
+  if ((length > HAL_ACI_MAX_LENGTH) || (match_length < 2) || (match_length > (length + 1)))
+  {
+    return false;
+  }
+
+  // The m_aci_isr sends and removes the head entry, keep it out while the queue is searched
+  noInterrupts();
+  p_queued = aci_queue_find_from_isr(m_aci_tx_q_for(p_aci_cmd->buffer[1]), &p_aci_cmd->buffer[0], match_length);
+  if (NULL != p_queued)
+  {
+    memcpy(&p_queued->buffer[match_length], &p_aci_cmd->buffer[match_length], length + 1 - match_length);
+  }
+  interrupts();
+
+  if (NULL == p_queued)
+  {
+    return hal_aci_tl_send(p_aci_cmd);
+  }
+
+  HAL_ACI_STATS_ADD(tx_coalesced, 1);
+  if (aci_debug_print)
+  {
+    m_aci_debug_log(HAL_ACI_TRACE_COMMAND, p_aci_cmd);
+  }
+
+  return true;
+}
+
+#if ACI_TX_ISR_QUEUE_BYTES
+bool hal_aci_tl_send_from_isr(hal_aci_data_t *p_aci_cmd)
+{
+  // The loop never fills isr_q, the only producer is the interrupt running this
+  if ((p_aci_cmd->buffer[0] > HAL_ACI_MAX_LENGTH) || !aci_queue_enqueue_from_isr(&aci_tl->isr_q, p_aci_cmd))
+  {
+    return false;
+  }
+
+  if (m_aci_rx_can_accept() && m_aci_tx_ready())
+  {
+    m_aci_reqn_enable();
+  }
+  return true;
+}
+#endif
+
+static uint8_t spi_readwrite(const uint8_t aci_byte)
+{
+	//Board dependent defines
+#if defined (__AVR__)
+    //For Arduino the transmission does not have to be reversed
+    return SPI.transfer(aci_byte);
+#elif defined(__PIC32MX__)
+    //For ChipKit the transmission has to be reversed
+    uint8_t tmp_bits;
+    tmp_bits = SPI.transfer(REVERSE_BITS(aci_byte));
+	return REVERSE_BITS(tmp_bits);
+#elif defined(__arm__)
+    //For the SAM3X and SAMD the bit order is set in hal_aci_tl_init()
+    return SPI.transfer(aci_byte);
+#elif defined(HAL_PLATFORM_HOST)
+    //For the host build the mock SPI answers for the nRF8001
+    return SPI.transfer(aci_byte);
+#endif
+}
+
+#if ACI_SPI_USE_BLOCK
+/*
+  Clocks length bytes into p_rx without leaving the SPI idle between bytes. The first tx_length
+  bytes sent come from p_tx, zeros are sent after them.
+  The next byte to send is fetched while the current one is on the bus, and SPDR is reloaded
+  as soon as SPIF is set. The SPI must already be configured by SPI.begin() and the bit order
+  and clock divider set in hal_aci_tl_init().
+*/
+#if defined(__AVR__)
+static void spi_readwrite_block(const uint8_t *p_tx, uint8_t tx_length, uint8_t *p_rx, uint8_t length)
+{
+  uint8_t next_byte;
+
+  if (0 == length)
+  {
+    return;
+  }
+
+  if (tx_length > length)
+  {
+    tx_length = length;
+  }
+  length -= tx_length;
+
+  /* Command bytes, the first byte is loaded before the loop */
+  if (0 != tx_length)
+  {
+    SPDR = *p_tx++;
+    while (--tx_length)
+    {
+      next_byte = *p_tx++;
+      while (!(SPSR & _BV(SPIF)));
+      *p_rx++ = SPDR;
+      SPDR = next_byte;
+    }
+  }
+  else
+  {
+    SPDR = 0;
+    --length;
+  }
+
+  /* Padding while the event is still coming in */
+  while (length--)
+  {
+    while (!(SPSR & _BV(SPIF)));
+    *p_rx++ = SPDR;
+    SPDR = 0;
+  }
+
+  while (!(SPSR & _BV(SPIF)));
+  *p_rx = SPDR;
+}
+#elif defined(__PIC32MX__)
+static void spi_readwrite_block(const uint8_t *p_tx, uint8_t tx_length, uint8_t *p_rx, uint8_t length)
+{
+  uint8_t byte_cnt;
+
+  //For ChipKit the transmission has to be reversed, one table load per byte each way
+  for (byte_cnt = 0; byte_cnt < length; byte_cnt++)
+  {
+    p_rx[byte_cnt] = REVERSE_BITS(SPI.transfer((byte_cnt < tx_length) ? REVERSE_BITS(p_tx[byte_cnt]) : 0));
+  }
+}
+#elif defined(__SAM3X8E__)
+static void spi_readwrite_block(const uint8_t *p_tx, uint8_t tx_length, uint8_t *p_rx, uint8_t length)
+{
+  //SPI.transfer() uses NPCS of BOARD_SPI_DEFAULT_SS when no pin is given, do the same here
+  const uint32_t pcs = SPI_PCS(BOARD_PIN_TO_SPI_CHANNEL(BOARD_SPI_DEFAULT_SS));
+  uint8_t tx_cnt = 0;
+  uint8_t rx_cnt = 0;
+  uint32_t tdr;
+
+  //The next byte is written to TDR while the current one is shifted, so there is no gap
+  //between the bytes. A byte takes a few us at the nRF8001 clock, well within the time the
+  //CPU takes to move the received byte out of RDR before the next one is in.
+  while (rx_cnt < length)
+  {
+    if ((tx_cnt < length) && ((uint8_t)(tx_cnt - rx_cnt) < 2) && (SPI_INTERFACE->SPI_SR & SPI_SR_TDRE))
+    {
+      tdr = (tx_cnt < tx_length) ? REVERSE_BITS(p_tx[tx_cnt]) : 0;
+      tdr |= pcs;
+      if (tx_cnt == (length - 1))
+      {
+        tdr |= SPI_TDR_LASTXFER;
+      }
+      SPI_INTERFACE->SPI_TDR = tdr;
+      tx_cnt++;
+    }
+
+    if (SPI_INTERFACE->SPI_SR & SPI_SR_RDRF)
+    {
+      p_rx[rx_cnt++] = REVERSE_BITS(SPI_INTERFACE->SPI_RDR);
+    }
+  }
+}
+#elif defined(__arm__)
+static void spi_readwrite_block(const uint8_t *p_tx, uint8_t tx_length, uint8_t *p_rx, uint8_t length)
+{
+  //The receive buffer is sent in place, the SERCOM shifts LSB first in hardware
+  if (tx_length > length)
+  {
+    tx_length = length;
+  }
+  if (0 != tx_length)
+  {
+    memcpy(p_rx, p_tx, tx_length);
+  }
+  memset(&p_rx[tx_length], 0, length - tx_length);
+
+  SPI.transfer(p_rx, length);
+}
+#endif
+#endif
+
+bool hal_aci_tl_rx_q_empty (void)
+{
+  return aci_queue_is_empty(&aci_tl->rx_q);
+}
+
+bool hal_aci_tl_rx_q_full (void)
+{
+  return aci_queue_is_full(&aci_tl->rx_q);
+}
+
+bool hal_aci_tl_tx_q_empty (void)
+{
+  return m_aci_tx_is_empty();
+}
+
+bool hal_aci_tl_tx_q_full (void)
+{
+  return aci_queue_is_full(&aci_tl->tx_q);
+}
+
+#if HAL_ACI_TL_TX_HOLD
+bool hal_aci_tl_tx_held(void)
+{
+  return aci_tl->tx_hold;
+}
+#endif
+
+void hal_aci_tl_q_flush (void)
+{
+  m_aci_q_flush();
+}
+
+#if HAL_ACI_TL_DATA_MARKS
+uint8_t hal_aci_tl_data_queued(void)
+{
+  return aci_tl->data_queued;
+}
+
+bool hal_aci_tl_data_mark_take(uint8_t *p_number)
+{
+  uint16_t mark;
+
+  noInterrupts();
+  if (0 == aci_tl->data_marks_count)
+  {
+    if (0 != aci_tl->data_marks_lost)
+    {
+      aci_tl->data_marks_lost--;
+    }
+    interrupts();
+    return false;
+  }
+  mark = aci_tl->data_marks[aci_tl->data_marks_head];
+  aci_tl->data_marks_head = (aci_tl->data_marks_head + 1) % ACI_DATA_MARKS_DEPTH;
+  aci_tl->data_marks_count--;
+  interrupts();
+
+  *p_number = (uint8_t)mark;
+  return (ACI_DATA_MARK_NONE != mark);
+}
+#endif
+
+bool hal_aci_tl_event_inject(hal_aci_data_t *p_aci_evt)
+{
+  bool ret_val;
+
+  /* The ISR is the producer of the event queue, it must not run while this event is added */
+  noInterrupts();
+  ret_val = aci_queue_enqueue_from_isr(&aci_tl->rx_q, p_aci_evt);
+  interrupts();
+
+  return ret_val;
+}
+
+#if (HAL_ACI_INSTANCES > 1)
+bool hal_aci_tl_select(uint8_t instance)
+{
+  if (instance >= HAL_ACI_INSTANCES)
+  {
+    return false;
+  }
+
+  aci_tl = &aci_tl_ctx[instance];
+  return true;
+}
+
+uint8_t hal_aci_tl_selected(void)
+{
+  return (uint8_t)(aci_tl - aci_tl_ctx);
+}
+#endif
+
+uint16_t hal_aci_tl_ram_bytes(void)
+{
+  uint16_t bytes = sizeof(aci_tl_ctx);
+
+#if HAL_ACI_TL_STATS
+  bytes += sizeof(aci_stats);
+#endif
+#if (HAL_ACI_TL_LATENCY || HAL_ACI_TL_EVENT_TIME)
+  bytes += sizeof(aci_stamps);
+#endif
+#if HAL_ACI_TL_LATENCY
+  bytes += sizeof(aci_latency);
+#endif
+#if HAL_ACI_TL_TRACE
+  bytes += sizeof(aci_trace_buf);
+#endif
+  return bytes;
+}
+
+#if defined(__AVR__)
+/*
+  True when the selected instance has something queued, RDYN asserted, or cannot wake the MCU up.
+*/
+static bool m_aci_busy(void)
+{
+  return (!m_aci_interface_is_interrupt() ||
+          !aci_queue_is_empty(&aci_tl->rx_q) || m_aci_tx_ready() ||
+          !m_aci_rdyn_is_high());
+}
+#endif
+
+bool hal_aci_tl_idle(uint8_t sleep_mode)
+{
+  m_aci_hybrid_update();
+#if defined(__AVR__)
+  if (!m_aci_interface_is_interrupt())
+  {
+    /* Nothing would wake us up when the nRF8001 asserts RDYN */
+    return false;
+  }
+
+  set_sleep_mode(sleep_mode);
+
+  /* Nothing may be queued between the checks and sleep_cpu(), or the MCU could sleep on it */
+  cli();
+#if (HAL_ACI_INSTANCES > 1)
+  /* Every initialized instance has to be idle, any of them can wake the MCU up */
+  {
+    aci_tl_ctx_t *p_selected = aci_tl;
+    bool          busy       = false;
+
+    for (aci_tl = &aci_tl_ctx[0]; aci_tl < &aci_tl_ctx[HAL_ACI_INSTANCES]; aci_tl++)
+    {
+      if ((NULL != aci_tl->a_pins_ptr) && m_aci_busy())
+      {
+        busy = true;
+        break;
+      }
+    }
+    aci_tl = p_selected;
+
+    if (busy)
+    {
+      sei();
+      return false;
+    }
+  }
+#else
+  if (m_aci_busy())
+  {
+    sei();
+    return false;
+  }
+#endif
+
+  sleep_enable();
+  /* The instruction following sei is executed before any interrupt, so a wake-up can't be missed */
+  sei();
+  sleep_cpu();
+  sleep_disable();
+
+  return true;
+#else
+  (void)sleep_mode;
+  return false;
+#endif
+}
+
+void hal_aci_tl_set_overflow_callback(hal_aci_tl_overflow_cb_t overflow_cb)
+{
+  aci_tl->overflow_cb = overflow_cb;
+}
+
+uint16_t hal_aci_tl_rx_overflow_count(void)
+{
+  uint16_t count;
+
+  noInterrupts();
+  count = aci_tl->overflow_count;
+  interrupts();
+
+  return count;
+}
+
+#if HAL_ACI_TL_TX_LOW_WATER
+void hal_aci_tl_set_tx_space_callback(hal_aci_tl_tx_space_cb_t tx_space_cb)
+{
+  aci_tl->tx_space_cb = tx_space_cb;
+}
+
+void hal_aci_tl_tx_space_arm(void)
+{
+  noInterrupts();
+  aci_tl->tx_space_armed = true;
+  m_aci_tx_space_check();
+  interrupts();
+}
+
+bool hal_aci_tl_tx_space_take(void)
+{
+  bool tx_space;
+
+  noInterrupts();
+  tx_space         = aci_tl->tx_space;
+  aci_tl->tx_space = false;
+  interrupts();
+  return tx_space;
+}
+#endif
+
+#if HAL_ACI_TL_SOFT_EVENTS
+void hal_aci_tl_set_soft_handlers(hal_aci_tl_soft_data_cb_t data_cb, hal_aci_tl_soft_credit_cb_t credit_cb)
+{
+  noInterrupts();
+  aci_tl->soft_data_cb   = data_cb;
+  aci_tl->soft_credit_cb = credit_cb;
+  aci_tl->soft_count     = 0;
+  aci_tl->soft_credits   = 0;
+  interrupts();
+}
+
+bool hal_aci_tl_soft_pipe_set(uint8_t pipe, bool enable)
+{
+  if (pipe > ACI_DEVICE_MAX_PIPES)
+  {
+    return false;
+  }
+  noInterrupts();
+  if (enable)
+  {
+    aci_tl->soft_pipes[pipe / 8] |= (uint8_t)(0x01 << (pipe % 8));
+  }
+  else
+  {
+    aci_tl->soft_pipes[pipe / 8] &= (uint8_t)~(0x01 << (pipe % 8));
+  }
+  interrupts();
+  return true;
+}
+
+uint16_t hal_aci_tl_soft_dropped(void)
+{
+  uint16_t dropped;
+
+  noInterrupts();
+  dropped = aci_tl->soft_dropped;
+  interrupts();
+  return dropped;
+}
+#endif
+
+#if HAL_ACI_EVENT_FILTER
+void hal_aci_tl_event_filter_set(uint16_t evt_mask)
+{
+  aci_tl->filter_mask = evt_mask;
+}
+
+bool hal_aci_tl_event_filtered_take(hal_aci_tl_filtered_t *p_filtered)
+{
+  // The ISR adds to the filtered events as they are clocked in
+  noInterrupts();
+  *p_filtered = aci_tl->filtered;
+  memset(&aci_tl->filtered, 0, sizeof(aci_tl->filtered));
+  interrupts();
+
+  return (0 != p_filtered->events);
+}
+#endif
+
+#if HAL_ACI_TL_STATS
+void hal_aci_tl_stats_get(hal_aci_tl_stats_t *p_stats)
+{
+  noInterrupts();
+  memcpy(p_stats, &aci_stats, sizeof(aci_stats));
+  interrupts();
+}
+
+void hal_aci_tl_stats_reset(void)
+{
+  noInterrupts();
+  memset(&aci_stats, 0, sizeof(aci_stats));
+  interrupts();
+}
+#endif
+
+#if HAL_ACI_TL_ACTIVE
+void hal_aci_tl_active_sample(void)
+{
+  const uint8_t active_pin = aci_tl->a_pins_ptr->active_pin;
+  uint32_t now_us;
+  uint32_t pulse_us;
+
+  if (UNUSED == active_pin)
+  {
+    return;
+  }
+
+  now_us = micros();
+  if (HIGH == digitalRead(active_pin))
+  {
+    if (!aci_tl->active_high)
+    {
+      // The period is known once a whole pulse has been seen before this one
+      if (0 != aci_tl->active.events)
+      {
+        aci_tl->active.period_us = now_us - aci_tl->active_rise_us;
+      }
+      aci_tl->active_rise_us = now_us;
+      aci_tl->active_high    = true;
+    }
+  }
+  else if (aci_tl->active_high)
+  {
+    pulse_us = now_us - aci_tl->active_rise_us;
+    if (pulse_us > 0xFFFF)
+    {
+      pulse_us = 0xFFFF;
+    }
+    aci_tl->active_high            = false;
+    aci_tl->active.events++;
+    aci_tl->active.active_us      += pulse_us;
+    aci_tl->active.last_active_us  = (uint16_t)pulse_us;
+    if (pulse_us > aci_tl->active.max_active_us)
+    {
+      aci_tl->active.max_active_us = (uint16_t)pulse_us;
+    }
+  }
+}
+
+uint32_t hal_aci_tl_quiet_us(void)
+{
+  uint32_t rise_us;
+  uint32_t period_us;
+  uint32_t since_us;
+  uint32_t phase_us;
+  uint32_t next_us;
+  bool     high;
+
+  // A pin change interrupt may sample ACTIVE too
+  noInterrupts();
+  hal_aci_tl_active_sample();
+  rise_us   = aci_tl->active_rise_us;
+  period_us = aci_tl->active.period_us;
+  high      = aci_tl->active_high;
+  interrupts();
+
+  if (high)
+  {
+    return 0;
+  }
+  if (0 == period_us)
+  {
+    return HAL_ACI_TL_QUIET_UNKNOWN;
+  }
+
+  // Radio events that did not happen are skipped, the next one is a whole number of periods away
+  since_us = micros() - rise_us;
+  phase_us = since_us % period_us;
+  if ((since_us >= period_us) && (phase_us < HAL_ACI_TL_ACTIVE_GUARD_US))
+  {
+    // The radio event is due: it is late or its rising edge has not been sampled yet
+    return 0;
+  }
+  next_us = period_us - phase_us;
+  return (next_us > HAL_ACI_TL_ACTIVE_GUARD_US) ? (next_us - HAL_ACI_TL_ACTIVE_GUARD_US) : 0;
+}
+
+bool hal_aci_tl_quiet_window(uint32_t duration_us)
+{
+  const uint32_t quiet_us = hal_aci_tl_quiet_us();
+
+  return (0 != quiet_us) && (quiet_us >= duration_us);
+}
+
+void hal_aci_tl_active_get(hal_aci_tl_active_t *p_active)
+{
+  noInterrupts();
+  *p_active = aci_tl->active;
+  interrupts();
+
+  p_active->duty_permille = (0 != p_active->period_us) ?
+                            (uint16_t)(((uint32_t)p_active->last_active_us * 1000) / p_active->period_us) : 0;
+}
+
+void hal_aci_tl_active_reset(void)
+{
+  noInterrupts();
+  memset(&aci_tl->active, 0, sizeof(aci_tl->active));
+  interrupts();
+}
+#endif
+
+#if (HAL_ACI_TL_LATENCY || HAL_ACI_TL_EVENT_TIME)
+/*
+  Called from the ISR or the poll before an event is committed to aci_tl->rx_q.
+*/
+static void m_aci_event_stamp(const hal_aci_data_t *p_data, uint32_t time_us)
+{
+  aci_event_stamp_t *p_stamp;
+
+  if (aci_stamps_count >= HAL_ACI_TL_LATENCY_DEPTH)
+  {
+    /* Too many events waiting, this one is not stamped */
+    return;
+  }
+
+  p_stamp = &aci_stamps[(aci_stamps_head + aci_stamps_count) % HAL_ACI_TL_LATENCY_DEPTH];
+  p_stamp->offset  = (uint8_t)((const uint8_t *)p_data - aci_tl->rx_q.data);
+  p_stamp->time_us = time_us;
+  aci_stamps_count++;
+}
+#endif
+
+#if HAL_ACI_TL_LATENCY
+static void m_aci_latency_record(uint8_t evt_opcode, uint32_t latency_us)
+{
+  hal_aci_tl_latency_t *p_latency;
+  uint32_t              bound_us = 64;
+  uint8_t               bucket;
+
+  if ((evt_opcode < ACI_EVT_DEVICE_STARTED) || (evt_opcode > ACI_EVT_KEY_REQUEST))
+  {
+    return;
+  }
+  p_latency = &aci_latency[evt_opcode - ACI_EVT_DEVICE_STARTED];
+
+  if ((0 == p_latency->count) || (latency_us < p_latency->min_us))
+  {
+    p_latency->min_us = latency_us;
+  }
+  if (latency_us > p_latency->max_us)
+  {
+    p_latency->max_us = latency_us;
+  }
+  p_latency->total_us += latency_us;
+  p_latency->count++;
+
+  for (bucket = 0; bucket < (HAL_ACI_TL_LATENCY_BUCKETS - 1); bucket++)
+  {
+    if (latency_us < bound_us)
+    {
+      break;
+    }
+    bound_us <<= 2;
+  }
+  p_latency->histogram[bucket]++;
+}
+#endif
+
+#if (HAL_ACI_TL_LATENCY || HAL_ACI_TL_EVENT_TIME)
+/*
+  Called from the main context before the head event is taken out of aci_tl->rx_q.
+  Events do not carry their stamp, it is matched on the position in the queue. Events
+  that were not stamped (queue of stamps full, events injected by lib_aci) are not
+  measured and get the time they are taken as their event time.
+*/
+static void m_aci_event_stamp_take_head(void)
+{
+  const hal_aci_data_t *p_data;
+  aci_event_stamp_t    *p_stamp;
+  const uint32_t        now_us = micros();
+  uint32_t              time_us;
+
+  p_data = aci_queue_peek_ptr(&aci_tl->rx_q);
+  if (NULL == p_data)
+  {
+    return;
+  }
+
+  noInterrupts();
+  p_stamp = &aci_stamps[aci_stamps_head];
+  if ((0 == aci_stamps_count) || (p_stamp->offset != aci_tl->rx_q.head))
+  {
+    interrupts();
+#if HAL_ACI_TL_EVENT_TIME
+    aci_event_time_us = now_us;
+#endif
+    return;
+  }
+  time_us = p_stamp->time_us;
+  aci_stamps_head = (aci_stamps_head + 1) % HAL_ACI_TL_LATENCY_DEPTH;
+  aci_stamps_count--;
+  interrupts();
+
+#if HAL_ACI_TL_EVENT_TIME
+  aci_event_time_us = time_us;
+#endif
+#if HAL_ACI_TL_LATENCY
+  m_aci_latency_record(p_data->buffer[1], now_us - time_us);
+#endif
+}
+#endif
+
+#if HAL_ACI_TL_EVENT_TIME
+uint32_t hal_aci_tl_event_time_us(void)
+{
+  return aci_event_time_us;
+}
+#endif
+
+#if HAL_ACI_TL_LATENCY
+bool hal_aci_tl_latency_get(uint8_t evt_opcode, hal_aci_tl_latency_t *p_latency)
+{
+  if ((evt_opcode < ACI_EVT_DEVICE_STARTED) || (evt_opcode > ACI_EVT_KEY_REQUEST))
+  {
+    return false;
+  }
+
+  memcpy(p_latency, &aci_latency[evt_opcode - ACI_EVT_DEVICE_STARTED], sizeof(hal_aci_tl_latency_t));
+  return true;
+}
+
+void hal_aci_tl_latency_reset(void)
+{
+  memset(aci_latency, 0, sizeof(aci_latency));
+}
+#endif
@@ -50,6 +50,381 @@ and the received ACI event is placed in the tail of the event queue.
 #define HAL_ACI_MAX_LENGTH 31
 #endif
 
+/************************************************************************/
+/* Low memory configuration, for the 2 KB ATmega328 boards              */
+/* 1 : The queues hold two full size packets unless ACI_QUEUE_SIZE is   */
+/*     set. The event buffer of the library is lent to the sketch,      */
+/*     lib_aci_event_buffer(). services_pipe_type_mapping is read from  */
+/*     PROGMEM, declare it with ACI_PIPE_MAP_PROGMEM.                   */
+/* 0 : The pipe map is in RAM.                                          */
+/* lib_aci_ram_get() reports the RAM used and saved.                    */
+/************************************************************************/
+#ifndef ACI_LOW_MEMORY
+#define ACI_LOW_MEMORY 0
+#endif
+
+/************************************************************************/
+/* SPI transfer mode                                                     */
+/* 1 : The body of each ACI packet is clocked out in one block transfer. */
+/*     On AVR this is a register level loop on SPDR/SPSR, on the SAM3X  */
+/*     on SPI_TDR/SPI_RDR with the next byte written while one shifts.   */
+/* 0 : Every byte goes through its own SPI.transfer() call.              */
+/************************************************************************/
+#ifndef HAL_ACI_SPI_BLOCK_TRANSFER
+#define HAL_ACI_SPI_BLOCK_TRANSFER 1
+#endif
+
+/************************************************************************/
+/* NVIC priority of the RDYN interrupt on the SAM3X and SAMD boards      */
+/* When defined, the interrupt that attachInterrupt() uses for RDYN is   */
+/* set to this priority (0 is the highest). Left undefined the core      */
+/* default is kept. No effect on AVR and PIC32.                          */
+/*   #define HAL_ACI_RDYN_IRQ_PRIORITY  1                                */
+/************************************************************************/
+
+/************************************************************************/
+/* Back-to-back transfers in interrupt mode                              */
+/* HAL_ACI_ISR_MAX_TRANSFERS: transfers m_aci_isr may run per interrupt  */
+/*   while commands are queued and there is room for the events.         */
+/*   1 gives one transfer per interrupt.                                 */
+/* HAL_ACI_RDYN_WAIT_LOOPS: polls of RDYN allowed for each edge between  */
+/*   two transfers, the level interrupt takes over when exceeded.        */
+/************************************************************************/
+#ifndef HAL_ACI_ISR_MAX_TRANSFERS
+#define HAL_ACI_ISR_MAX_TRANSFERS 4
+#endif
+
+#ifndef HAL_ACI_RDYN_WAIT_LOOPS
+#define HAL_ACI_RDYN_WAIT_LOOPS 400
+#endif
+
+/************************************************************************/
+/* RDYN interrupt trigger in interrupt mode                              */
+/* 0 : LOW level. m_aci_isr is detached while the event queue is full    */
+/*     and attached again when an event is taken out.                    */
+/* 1 : FALLING edge. The interrupt stays attached, an RDYN assertion     */
+/*     that finds the event queue full is remembered and serviced as     */
+/*     soon as an event is taken out.                                    */
+/*     Note that on the ATmega328 only the LOW level wakes the MCU from  */
+/*     power-down, an edge only wakes it from idle.                      */
+/************************************************************************/
+#ifndef HAL_ACI_RDYN_EDGE_TRIGGERED
+#define HAL_ACI_RDYN_EDGE_TRIGGERED 0
+#endif
+
+/************************************************************************/
+/* SPI transactions                                                      */
+/* 1 : When the SPI library supports it (SPI_HAS_TRANSACTION), every ACI */
+/*     transfer runs in SPI.beginTransaction()/endTransaction() with the */
+/*     nRF8001 settings, and the RDYN interrupt is registered with       */
+/*     SPI.usingInterrupt(). Other devices can then share the SPI bus.   */
+/*     optional_chip_sel_pin, when not UNUSED, is held low during each   */
+/*     transfer.                                                         */
+/* 0 : The SPI is configured once in hal_aci_tl_init().                  */
+/************************************************************************/
+#ifndef HAL_ACI_SPI_TRANSACTIONS
+#define HAL_ACI_SPI_TRANSACTIONS 1
+#endif
+
+/************************************************************************/
+/* Optional compile-time pin path for REQN and RDYN (AVR only)           */
+/* When the port and bit of the REQN and RDYN pins are known at compile  */
+/* time they can be defined here (or on the compiler command line), e.g. */
+/*   #define HAL_ACI_REQN_PORT     PORTB                                 */
+/*   #define HAL_ACI_REQN_BIT      1                                     */
+/*   #define HAL_ACI_RDYN_PIN_REG  PINB                                  */
+/*   #define HAL_ACI_RDYN_BIT      0                                     */
+/* REQN and RDYN then compile to single sbi/cbi/sbis instructions.       */
+/* They must match reqn_pin and rdyn_pin in aci_pins_t.                  */
+/* Otherwise the pins are resolved to port/mask pairs in hal_aci_tl_init */
+/************************************************************************/
+#if (defined(HAL_ACI_REQN_PORT) && defined(HAL_ACI_REQN_BIT) && defined(HAL_ACI_RDYN_PIN_REG) && defined(HAL_ACI_RDYN_BIT))
+#define HAL_ACI_PINS_STATIC 1
+#else
+#define HAL_ACI_PINS_STATIC 0
+#endif
+
+/************************************************************************/
+/* RDYN interface fixed at compile time                                  */
+/* HAL_ACI_INTERFACE_RUNTIME   : interface_is_interrupt of aci_pins_t    */
+/*   chooses between the RDYN interrupt and the polling of RDYN.         */
+/* HAL_ACI_INTERFACE_INTERRUPT : The RDYN interrupt, the polling is left */
+/*   out of the build and interface_is_interrupt is not read.            */
+/* HAL_ACI_INTERFACE_POLL      : The polling of RDYN, the interrupt is   */
+/*   left out of the build and interface_is_interrupt is not read.       */
+/* aci_device.h sets interface_is_interrupt from its template, a fixed   */
+/* interface must match it.                                              */
+/************************************************************************/
+#define HAL_ACI_INTERFACE_RUNTIME    0
+#define HAL_ACI_INTERFACE_INTERRUPT  1
+#define HAL_ACI_INTERFACE_POLL       2
+
+#ifndef HAL_ACI_INTERFACE
+#define HAL_ACI_INTERFACE HAL_ACI_INTERFACE_RUNTIME
+#endif
+#if ((HAL_ACI_INTERFACE != HAL_ACI_INTERFACE_RUNTIME) && (HAL_ACI_INTERFACE != HAL_ACI_INTERFACE_INTERRUPT) && (HAL_ACI_INTERFACE != HAL_ACI_INTERFACE_POLL))
+#error "HAL_ACI_INTERFACE must be HAL_ACI_INTERFACE_RUNTIME, HAL_ACI_INTERFACE_INTERRUPT or HAL_ACI_INTERFACE_POLL"
+#endif
+
+/************************************************************************/
+/* Hybrid RDYN interface, in interrupt mode only                         */
+/* 0 : The interface chosen by interface_is_interrupt is kept.           */
+/* N : The transport counts its transfers over windows of                */
+/*     HAL_ACI_TL_HYBRID_WINDOW_MS. A window with N transfers or more    */
+/*     detaches the RDYN interrupt and RDYN is polled by                 */
+/*     hal_aci_tl_event_get() and the other calls of the main context,   */
+/*     which costs less than one interrupt per packet while streaming.   */
+/*     After HAL_ACI_TL_HYBRID_QUIET_WINDOWS windows in a row with less  */
+/*     than N / 2 transfers the interrupt is attached again, so the MCU  */
+/*     can sleep in hal_aci_tl_idle(). The switches are made from the    */
+/*     main context, hal_aci_tl_hybrid_is_polling() tells the current    */
+/*     interface.                                                        */
+/************************************************************************/
+#ifndef HAL_ACI_TL_HYBRID
+#define HAL_ACI_TL_HYBRID 0
+#endif
+#ifndef HAL_ACI_TL_HYBRID_WINDOW_MS
+#define HAL_ACI_TL_HYBRID_WINDOW_MS 10
+#endif
+#ifndef HAL_ACI_TL_HYBRID_QUIET_WINDOWS
+#define HAL_ACI_TL_HYBRID_QUIET_WINDOWS 3
+#endif
+#if ((HAL_ACI_TL_HYBRID < 0) || (HAL_ACI_TL_HYBRID > 255))
+#error "HAL_ACI_TL_HYBRID must be 0..255"
+#endif
+#if (HAL_ACI_TL_HYBRID && (HAL_ACI_INTERFACE == HAL_ACI_INTERFACE_POLL))
+#error "HAL_ACI_TL_HYBRID needs the RDYN interrupt, HAL_ACI_INTERFACE cannot be HAL_ACI_INTERFACE_POLL"
+#endif
+#if (HAL_ACI_TL_HYBRID && ((HAL_ACI_TL_HYBRID_WINDOW_MS < 1) || (HAL_ACI_TL_HYBRID_QUIET_WINDOWS < 1)))
+#error "HAL_ACI_TL_HYBRID_WINDOW_MS and HAL_ACI_TL_HYBRID_QUIET_WINDOWS must be at least 1"
+#endif
+
+/************************************************************************/
+/* Event queue overflow policy                                           */
+/* HAL_ACI_RX_OVERFLOW_STALL       : No transfer is run while the event  */
+/*   queue is full, REQN is not lowered and the RDYN interrupt is held   */
+/*   off. The nRF8001 keeps its events until there is room.              */
+/* HAL_ACI_RX_OVERFLOW_DROP        : Transfers keep running so queued    */
+/*   commands still go out, events that do not fit are dropped.          */
+/* HAL_ACI_RX_OVERFLOW_DROP_CREDIT : As DROP, but the credits of dropped */
+/*   ACI_EVT_DATA_CREDIT events are added up and delivered as one        */
+/*   ACI_EVT_DATA_CREDIT event as soon as there is room.                 */
+/* Every stall or dropped event is counted and reported to the callback  */
+/* set with hal_aci_tl_set_overflow_callback().                          */
+/************************************************************************/
+#define HAL_ACI_RX_OVERFLOW_STALL        0
+#define HAL_ACI_RX_OVERFLOW_DROP         1
+#define HAL_ACI_RX_OVERFLOW_DROP_CREDIT  2
+
+#ifndef HAL_ACI_RX_OVERFLOW_POLICY
+#define HAL_ACI_RX_OVERFLOW_POLICY HAL_ACI_RX_OVERFLOW_STALL
+#endif
+
+/************************************************************************/
+/* Coalescing of ACI_EVT_DATA_CREDIT in the event queue                  */
+/* 1 : An ACI_EVT_DATA_CREDIT clocked in right after another one that    */
+/*     the application has not started reading adds its credits to that */
+/*     one instead of taking a new entry. The order of the events is     */
+/*     kept. With the DROP policies, a credit that finds the queue full  */
+/*     is not lost when the newest event is a credit.                    */
+/* 0 : Every ACI_EVT_DATA_CREDIT takes its own entry.                    */
+/************************************************************************/
+#ifndef HAL_ACI_RX_CREDIT_COALESCE
+#define HAL_ACI_RX_CREDIT_COALESCE 1
+#endif
+
+/************************************************************************/
+/* Events kept out of the event queue                                    */
+/* 1 : The events of the mask given to hal_aci_tl_event_filter_set() are */
+/*     handled in the transport as they are clocked in. They take no     */
+/*     entry in the event queue, their credits and connection timing     */
+/*     are kept for hal_aci_tl_event_filtered_take().                    */
+/* 0 : Compiled out, every event goes to the event queue.                */
+/************************************************************************/
+#ifndef HAL_ACI_EVENT_FILTER
+#define HAL_ACI_EVENT_FILTER 0
+#endif
+
+/************************************************************************/
+/* Transport statistics                                                  */
+/* 1 : hal_aci_tl counts transfers, bytes, stalls and queue high-water   */
+/*     marks, read with hal_aci_tl_stats_get().                          */
+/* 0 : The counting compiles out.                                        */
+/************************************************************************/
+#ifndef HAL_ACI_TL_STATS
+#define HAL_ACI_TL_STATS 0
+#endif
+
+/************************************************************************/
+/* Event latency capture                                                 */
+/* 1 : micros() is stamped when an event is clocked in by the ISR or the */
+/*     poll and again when the application gets it. min/avg/max and a    */
+/*     histogram are kept per event opcode, read with                    */
+/*     hal_aci_tl_latency_get().                                         */
+/* 0 : The capture compiles out.                                         */
+/* HAL_ACI_TL_LATENCY_DEPTH events waiting in the queue can be stamped   */
+/* at a time, events beyond that are not measured.                       */
+/************************************************************************/
+#ifndef HAL_ACI_TL_LATENCY
+#define HAL_ACI_TL_LATENCY 0
+#endif
+
+/************************************************************************/
+/* Event timestamps                                                      */
+/* 1 : micros() is stamped when an event is clocked in, by the RDYN ISR  */
+/*     or when the poll finds RDYN low, and hal_aci_tl_event_time_us()   */
+/*     gives it for the event last taken out of the event queue.         */
+/*     lib_aci projects the connection events from it, see               */
+/*     lib_aci_conn_event_next().                                        */
+/* 0 : The stamps compile out.                                           */
+/* HAL_ACI_TL_LATENCY_DEPTH events waiting in the queue can be stamped   */
+/* at a time, as for HAL_ACI_TL_LATENCY. The others, and the events made */
+/* up by lib_aci, get the time they are taken out of the queue.          */
+/************************************************************************/
+#ifndef HAL_ACI_TL_EVENT_TIME
+#define HAL_ACI_TL_EVENT_TIME 0
+#endif
+
+#ifndef HAL_ACI_TL_LATENCY_DEPTH
+#define HAL_ACI_TL_LATENCY_DEPTH 8
+#endif
+
+/* Histogram bucket n counts latencies below (64 << 2n) us, the last bucket counts the rest */
+#define HAL_ACI_TL_LATENCY_BUCKETS 6
+
+/************************************************************************/
+/* Binary ACI trace                                                      */
+/* 1 : With debug printing enabled (hal_aci_tl_debug_print()) commands   */
+/*     and events are recorded in a RAM ring of HAL_ACI_TL_TRACE_BYTES   */
+/*     instead of being printed. The oldest records are dropped when the */
+/*     ring is full. Drain it with hal_aci_tl_trace_drain() or           */
+/*     hal_aci_tl_trace_read(), decode it with Build/DecodeAciTrace.py.  */
+/* 0 : The debug output is printed on the Serial as it happens.          */
+/*                                                                       */
+/* Record format, multi-byte fields little endian:                       */
+/*   [type 'C' or 'E'][micros() 4 bytes][length n][n bytes: opcode ...]  */
+/*   The 'L' records of aci_log_write() hold [ID][value 2 bytes].        */
+/************************************************************************/
+#ifndef HAL_ACI_TL_TRACE
+#define HAL_ACI_TL_TRACE 0
+#endif
+
+#ifndef HAL_ACI_TL_TRACE_BYTES
+#define HAL_ACI_TL_TRACE_BYTES 128
+#endif
+
+#define HAL_ACI_TRACE_COMMAND        'C'
+#define HAL_ACI_TRACE_EVENT          'E'
+#define HAL_ACI_TRACE_LOG            'L'
+#define HAL_ACI_TRACE_HEADER_LENGTH  6
+
+/************************************************************************/
+/* ACTIVE line of the nRF8001                                            */
+/* 1 : The ACTIVE pin (aci_pins_t active_pin) is sampled and its edges   */
+/*     stamped with micros(): the radio active time and the period of    */
+/*     the radio events, read with hal_aci_tl_active_get(), and the      */
+/*     quiet window before the next radio event, hal_aci_tl_quiet_us(),  */
+/*     for ADC sampling and long computations away from the radio.       */
+/*     The transport samples ACTIVE in hal_aci_tl_event_get(), call      */
+/*     hal_aci_tl_active_sample() from a pin change interrupt of ACTIVE  */
+/*     for exact stamps.                                                 */
+/* 0 : ACTIVE is not read.                                               */
+/* The quiet window ends HAL_ACI_TL_ACTIVE_GUARD_US before the radio     */
+/* event is expected.                                                    */
+/************************************************************************/
+#ifndef HAL_ACI_TL_ACTIVE
+#define HAL_ACI_TL_ACTIVE 0
+#endif
+
+#ifndef HAL_ACI_TL_ACTIVE_GUARD_US
+#define HAL_ACI_TL_ACTIVE_GUARD_US 500
+#endif
+
+/* hal_aci_tl_quiet_us() before the period of the radio events is known */
+#define HAL_ACI_TL_QUIET_UNKNOWN  0xFFFFFFFFUL
+
+/************************************************************************/
+/* Command hold while the nRF8001 sleeps                                 */
+/* 1 : Once an ACI Sleep has been sent, only an ACI Wakeup is sent from  */
+/*     the command queues. The other commands stay queued until the      */
+/*     Device Started event of the wakeup, or of a reset, comes in.      */
+/*     Needed by LIB_ACI_AUTO_WAKEUP.                                    */
+/* 0 : The commands are sent as they are queued.                         */
+/************************************************************************/
+#ifndef HAL_ACI_TL_TX_HOLD
+#define HAL_ACI_TL_TX_HOLD 0
+#endif
+
+/************************************************************************/
+/* SendData marks of the pipe errors                                     */
+/* 1 : The SendData commands are counted as they are queued and as they  */
+/*     are clocked out. Each ACI_EVT_PIPE_ERROR that goes to the event   */
+/*     queue is marked with the SendData clocked out last before it, see */
+/*     hal_aci_tl_data_mark_take(). Needed by LIB_ACI_RETRANSMIT_SLOTS.  */
+/*     The SendData queued from an interrupt are not counted.            */
+/* 0 : Compiled out.                                                     */
+/************************************************************************/
+#ifndef HAL_ACI_TL_DATA_MARKS
+#define HAL_ACI_TL_DATA_MARKS 0
+#endif
+
+/************************************************************************/
+/* Low-water mark of the command queue, in bytes                         */
+/* N : Once a command has been refused for lack of room, or after        */
+/*     hal_aci_tl_tx_space_arm(), the first transfer that leaves N bytes */
+/*     or fewer in the command queue raises hal_aci_tl_tx_space_take()   */
+/*     and calls the callback of hal_aci_tl_set_tx_space_callback().     */
+/*     1 to ACI_TX_QUEUE_BYTES - 1.                                      */
+/* 0 : Compiled out.                                                     */
+/************************************************************************/
+#ifndef HAL_ACI_TL_TX_LOW_WATER
+#define HAL_ACI_TL_TX_LOW_WATER 0
+#endif
+
+/************************************************************************/
+/* Soft events handled at the end of the ACI interrupt                   */
+/* N : Up to N ACI_EVT_DATA_RECEIVED on the pipes set by                 */
+/*     hal_aci_tl_soft_pipe_set(), and the data credits, are given to    */
+/*     the handlers of hal_aci_tl_set_soft_handlers() once the           */
+/*     transfers of an interrupt are done. The events also go to the     */
+/*     event queue as usual. 0 to 8.                                     */
+/* 0 : Compiled out.                                                     */
+/************************************************************************/
+#ifndef HAL_ACI_TL_SOFT_EVENTS
+#define HAL_ACI_TL_SOFT_EVENTS 0
+#endif
+
+#if ((HAL_ACI_TL_SOFT_EVENTS < 0) || (HAL_ACI_TL_SOFT_EVENTS > 8))
+#error "HAL_ACI_TL_SOFT_EVENTS must be 0 to 8"
+#endif
+
+/************************************************************************/
+/* Number of nRF8001 radios driven by the transport layer, 1 to 4.       */
+/* Each radio has its own aci_pins_t (select it with the instance        */
+/* field), queue pair and RDYN interrupt, they share the SPI bus.        */
+/* The hal_aci_tl_* calls work on the instance picked with               */
+/* hal_aci_tl_select(), hal_aci_tl_init() selects the one it starts.     */
+/* With 1 the selection compiles out and the instance lives at a fixed   */
+/* address, the same as a single set of globals.                         */
+/* The statistics and the trace are shared by all the instances.         */
+/************************************************************************/
+#ifndef HAL_ACI_INSTANCES
+#define HAL_ACI_INSTANCES 1
+#endif
+
+#if ((HAL_ACI_INSTANCES < 1) || (HAL_ACI_INSTANCES > 4))
+#error "HAL_ACI_INSTANCES must be between 1 and 4"
+#endif
+#if ((HAL_ACI_INSTANCES > 1) && HAL_ACI_PINS_STATIC)
+#error "HAL_ACI_REQN_PORT and HAL_ACI_RDYN_PIN_REG describe a single instance, HAL_ACI_INSTANCES must be 1"
+#endif
+#if ((HAL_ACI_INSTANCES > 1) && HAL_ACI_TL_LATENCY)
+#error "HAL_ACI_TL_LATENCY supports a single instance, HAL_ACI_INSTANCES must be 1"
+#endif
+#if ((HAL_ACI_INSTANCES > 1) && HAL_ACI_TL_EVENT_TIME)
+#error "HAL_ACI_TL_EVENT_TIME supports a single instance, HAL_ACI_INSTANCES must be 1"
+#endif
+
 /************************************************************************/
 /* Unused nRF8001 pin                                                    */
 /************************************************************************/
@@ -82,6 +457,8 @@ typedef struct aci_pins_t
 	bool	interface_is_interrupt;	//Required - true = Uses interrupt on RDYN pin. false - Uses polling on RDYN pin
 	
 	uint8_t	interrupt_number;		//Required when using interrupts, otherwise ignored
+
+	uint8_t instance;               //Optional - Transport instance, 0 to HAL_ACI_INSTANCES - 1. Leave it at 0 for a single nRF8001
 } aci_pins_t;
 
 /** @brief ACI Transport Layer initialization.
@@ -93,17 +470,85 @@ typedef struct aci_pins_t
  */
 void hal_aci_tl_init(aci_pins_t *a_pins, bool debug);
 
+/** @brief Start the ACI transport layer initialization without blocking
+ *  @details
+ *  Same as hal_aci_tl_init(), but the nRF8001 reset and line settling delays are run by
+ *  hal_aci_tl_init_poll() instead of being waited for here.
+ */
+void hal_aci_tl_init_start(aci_pins_t *a_pins, bool debug);
+
+/** @brief Start the ACI transport layer initialization without resetting the nRF8001
+ *  @details
+ *  Same as hal_aci_tl_init_start(), but the reset line is only driven to its inactive level,
+ *  so an nRF8001 that kept running through a reset of the MCU keeps its setup.
+ *  Finish with hal_aci_tl_init_poll().
+ */
+void hal_aci_tl_init_resume(aci_pins_t *a_pins, bool debug);
+
+/** @brief Advance the initialization started by hal_aci_tl_init_start()
+ *  @details
+ *  Call this function repeatedly until it returns true. The transport may not be used before.
+ *  @return True when the ACI transport layer is ready.
+ */
+bool hal_aci_tl_init_poll(void);
+
 /** @brief Sends an ACI command to the radio.
  *  @details
  *  This function sends an ACI command to the radio. This queue up the message to send and 
  *  lower the request line. When the device lowers the ready line, @ref m_aci_spi_transfer()
  *  will send the data.
+ *  With ACI_TX_CTRL_QUEUE_BYTES set, SendDataAck, SendDataNack, ChangeTimingRequest, SetKey
+ *  and Disconnect are queued apart and sent before the other commands already queued.
  *  @param aci_buffer Pointer to the message to send.
  *  @return True if the data was successfully queued for sending, 
  *  false if there is no more space to store messages to send.
  */
 bool hal_aci_tl_send(hal_aci_data_t *aci_buffer);
 
+/** @brief Get the next free slot of the command queue to encode a command in place.
+ *  @details
+ *  The command is written straight into the returned slot, length in buffer[0] and opcode in
+ *  buffer[1], and queued by hal_aci_tl_send_commit(). This saves copying it into a staging
+ *  buffer for hal_aci_tl_send(). A slot that is not committed is reused by the next command.
+ *  @param cmd_opcode Opcode of the command, picks the control or the data command queue
+ *  (ACI_TX_CTRL_QUEUE_BYTES).
+ *  @return Pointer to the slot, NULL if there is no more space to store messages to send.
+ */
+hal_aci_data_t *hal_aci_tl_send_reserve(uint8_t cmd_opcode);
+
+/** @brief Queue the command encoded in the slot returned by hal_aci_tl_send_reserve().
+ *  @return True if the command was queued, false if no slot is reserved or the length is invalid.
+ */
+bool hal_aci_tl_send_commit(void);
+
+/** @brief Sends an ACI command to the radio, replacing the same command if it is still queued.
+ *  @details
+ *  When a command whose first match_length bytes (length byte, opcode, parameters) are the same
+ *  as the ones of aci_buffer is still in the command queue, the rest of it is overwritten with
+ *  the rest of aci_buffer, so only the latest value is sent. Otherwise the command is queued
+ *  as by hal_aci_tl_send(). Use this for commands that only carry a current value,
+ *  e.g. SetLocalData with the length, opcode and pipe number as the bytes to match.
+ *  @param aci_buffer Pointer to the message to send.
+ *  @param match_length Number of bytes of buffer[] that identify the command, at least 2.
+ *  @return True if the data was successfully queued for sending or merged,
+ *  false if there is no more space to store messages to send.
+ */
+bool hal_aci_tl_send_coalesce(hal_aci_data_t *aci_buffer, uint8_t match_length);
+
+#if ACI_TX_ISR_QUEUE_BYTES
+/** @brief Sends an ACI command to the radio from an interrupt.
+ *  @details
+ *  The command is copied into a queue of its own (ACI_TX_ISR_QUEUE_BYTES) that the interrupts
+ *  are the only ones to fill, so it never races the loop filling the command queue. The
+ *  transport sends it after the control commands and before the commands of the loop.
+ *  Call it from one interrupt, or from interrupts that cannot preempt each other, and not from
+ *  the loop. The command is not printed by the debug print.
+ *  @param aci_buffer Pointer to the message to send, it can be on the stack of the interrupt.
+ *  @return True if the command was queued, false if the queue is full.
+ */
+bool hal_aci_tl_send_from_isr(hal_aci_data_t *aci_buffer);
+#endif
+
 /** @brief Process pending transactions.
  *  @details 
  *  The library code takes care of calling this function to check if the nRF8001 RDYN line indicates a
@@ -120,6 +565,15 @@ hal_aci_data_t * hal_aci_tl_poll_get(void);
  */
 bool hal_aci_tl_event_get(hal_aci_data_t *p_aci_data);
 
+/** @brief Get up to max_count ACI events from the event queue
+ *  @details
+ *  Call this function from the main context to drain a burst of events in one call. The events are
+ *  copied to p_aci_data in the order received. The RDYN interrupt and REQN are re-armed once at the end.
+ *  This is called by lib_aci_event_get_many
+ *  @return Number of events copied, 0 if the event queue is empty.
+ */
+uint8_t hal_aci_tl_event_get_many(hal_aci_data_t *p_aci_data, uint8_t max_count);
+
 /** @brief Peek an ACI event from the event queue
  *  @details
  *  Call this function from the main context to peek an event from the ACI event queue.
@@ -127,6 +581,58 @@ bool hal_aci_tl_event_get(hal_aci_data_t *p_aci_data);
  */
 bool hal_aci_tl_event_peek(hal_aci_data_t *p_aci_data);
 
+/** @brief Peek an ACI event in place in the event queue
+ *  @details
+ *  Call this function from the main context. Unlike hal_aci_tl_event_peek() the event is not copied,
+ *  the pointer stays valid until hal_aci_tl_event_release() is called.
+ *  This is called by lib_aci_event_peek_ptr
+ *  @return Pointer to the oldest event, NULL if the event queue is empty.
+ */
+const hal_aci_data_t *hal_aci_tl_event_peek_ptr(void);
+
+/** @brief Remove the event returned by hal_aci_tl_event_peek_ptr() from the event queue
+ *  @details
+ *  Call this function from the main context. The event pointer must not be used afterwards.
+ *  This is called by lib_aci_event_release
+ */
+void hal_aci_tl_event_release(void);
+
+#if ACI_RX_DATA_QUEUE_BYTES
+/** @brief Peek an ACI_EVT_DATA_RECEIVED in place in the data event queue
+ *  @details
+ *  With ACI_RX_DATA_QUEUE_BYTES the data received are kept apart from the other events,
+ *  which hal_aci_tl_event_get() returns without waiting for the data to be read. The order
+ *  of the data is kept. Same use as hal_aci_tl_event_peek_ptr().
+ *  This is called by lib_aci_data_peek_ptr
+ *  @return Pointer to the oldest data event, NULL if the data event queue is empty.
+ */
+const hal_aci_data_t *hal_aci_tl_data_peek_ptr(void);
+
+/** @brief Peek an ACI_EVT_DATA_RECEIVED from the data event queue
+ *  @details
+ *  Same as hal_aci_tl_data_peek_ptr() but the event is copied, it stays in the queue
+ *  until hal_aci_tl_data_release() is called.
+ *  This is called by lib_aci_event_get and lib_aci_event_get_many
+ *  @return True if an event was copied to p_aci_data.
+ */
+bool hal_aci_tl_data_peek(hal_aci_data_t *p_aci_data);
+
+/** @brief Remove the event returned by hal_aci_tl_data_peek_ptr() from the data event queue
+ *  @details
+ *  The transfers stalled by a full data event queue start again.
+ *  This is called by lib_aci_data_release
+ */
+void hal_aci_tl_data_release(void);
+
+/** @brief Tell if the event returned by hal_aci_tl_data_peek_ptr() came on a link that has dropped
+ *  @details
+ *  An ACI_EVT_DISCONNECTED goes ahead of the data received before it that are not read yet.
+ *  This is called by lib_aci_data_is_stale
+ *  @return True when an ACI_EVT_DISCONNECTED was received after the oldest data event.
+ */
+bool hal_aci_tl_data_is_stale(void);
+#endif
+
 /** @brief Enable debug printing of all ACI commands sent and ACI events received
  *  @details
  *  when the enable parameter is true. The debug printing is enabled on the Serial.
@@ -136,6 +642,23 @@ bool hal_aci_tl_event_peek(hal_aci_data_t *p_aci_data);
 void hal_aci_tl_debug_print(bool enable);
 
 
+/** @brief Change the SPI clock of the nRF8001
+ *  @details
+ *  Takes an SPI_CLOCK_DIVn divider as aci_pins_t spi_clock_divider, from the next transfer on.
+ *  The nRF8001 runs its SPI up to 3MHz.
+ */
+void hal_aci_tl_spi_clock_set(uint8_t spi_clock_divider);
+
+/** @brief Get the SPI clock dividers of the core, fastest first
+ *  @details
+ *  Lets the SPI clock be stepped down without knowing the SPI_CLOCK_DIVn values of the core.
+ *  Only the dividers that clock the nRF8001 at 3MHz or less are given.
+ *  @param index 0 for the fastest divider within 3MHz.
+ *  @param p_spi_clock_divider the SPI_CLOCK_DIVn divider at that index.
+ *  @return False past the slowest divider.
+ */
+bool hal_aci_tl_spi_clock_divider(uint8_t index, uint8_t *p_spi_clock_divider);
+
 /** @brief Pin reset the nRF8001
  *  @details
  *  The reset line of the nF8001 needs to kept low for 200 ns.
@@ -169,11 +692,340 @@ void hal_aci_tl_pin_reset(void);
  */
  bool hal_aci_tl_tx_q_empty(void);
 
+/** @brief Put the MCU to sleep until the nRF8001 needs it
+ *  @details
+ *  Call this function from the main context when there is nothing else to do. With interrupts
+ *  disabled it checks that both queues are empty and RDYN is high, then enters sleep_mode
+ *  (e.g. SLEEP_MODE_PWR_DOWN or SLEEP_MODE_IDLE from avr/sleep.h) and wakes on the RDYN interrupt
+ *  or any other enabled interrupt. Only the LOW level RDYN interrupt (HAL_ACI_RDYN_EDGE_TRIGGERED 0)
+ *  wakes the ATmega328 from SLEEP_MODE_PWR_DOWN.
+ *  Only available on AVR in interrupt mode, it returns false right away otherwise.
+ *  @return True if the MCU has been sleeping, false if there was work pending.
+ */
+bool hal_aci_tl_idle(uint8_t sleep_mode);
+
+#if HAL_ACI_TL_HYBRID
+/** @brief Tell whether the hybrid interface polls RDYN at the moment
+ *  @details
+ *  The RDYN interrupt is detached while the transfers are dense, see HAL_ACI_TL_HYBRID.
+ *  @return True while RDYN is polled, false while the RDYN interrupt is used.
+ */
+bool hal_aci_tl_hybrid_is_polling(void);
+#endif
+
+#if HAL_ACI_TL_TRACE
+/** @brief Write up to max_records trace records to the Serial, in binary
+ *  @details
+ *  Call this function from the main context, e.g. once per loop(), to drain the trace lazily.
+ *  @return Number of records written.
+ */
+uint8_t hal_aci_tl_trace_drain(uint8_t max_records);
+
+/** @brief Move whole trace records to p_buffer, up to max_length bytes
+ *  @details
+ *  Call this function from the main context to dump the trace on demand.
+ *  @return Number of bytes copied.
+ */
+uint16_t hal_aci_tl_trace_read(uint8_t *p_buffer, uint16_t max_length);
+
+/** @brief Number of trace records dropped because the trace ring was full
+ */
+uint16_t hal_aci_tl_trace_dropped(void);
+#endif
+
+/** @brief Event queue overflow callback
+ *  @details
+ *  p_dropped is the event that was dropped, NULL when the transport stalls
+ *  (HAL_ACI_RX_OVERFLOW_STALL). In interrupt mode this is called from the ISR.
+ */
+typedef void (*hal_aci_tl_overflow_cb_t)(const hal_aci_data_t *p_dropped);
+
+/** @brief Set the callback called on every event queue overflow, NULL for none
+ */
+void hal_aci_tl_set_overflow_callback(hal_aci_tl_overflow_cb_t overflow_cb);
+
+/** @brief Number of event queue overflows (stalls or dropped events) since hal_aci_tl_init()
+ */
+uint16_t hal_aci_tl_rx_overflow_count(void);
+
+#if HAL_ACI_TL_TX_LOW_WATER
+/** @brief Command queue space callback
+ *  @details
+ *  Called once the command queue is down to HAL_ACI_TL_TX_LOW_WATER bytes, after a
+ *  command was refused or hal_aci_tl_tx_space_arm(). In interrupt mode this is called
+ *  from the ISR, it should only set a flag or wake a task up.
+ */
+typedef void (*hal_aci_tl_tx_space_cb_t)(void);
+
+/** @brief Set the callback called when the command queue has room again, NULL for none
+ */
+void hal_aci_tl_set_tx_space_callback(hal_aci_tl_tx_space_cb_t tx_space_cb);
+
+/** @brief Wait for the command queue to go down to HAL_ACI_TL_TX_LOW_WATER bytes
+ *  @details
+ *  A refused hal_aci_tl_send() or hal_aci_tl_send_reserve() does the same. When the
+ *  queue is already down to the mark, the space is raised right away.
+ */
+void hal_aci_tl_tx_space_arm(void);
+
+/** @brief Take the space raised since the last call, for a producer that sleeps meanwhile
+ *  @return True once the command queue has been down to HAL_ACI_TL_TX_LOW_WATER bytes.
+ */
+bool hal_aci_tl_tx_space_take(void);
+#endif
+
+#if HAL_ACI_TL_SOFT_EVENTS
+/** @brief Soft handler of the data received on a pipe of hal_aci_tl_soft_pipe_set()
+ *  @details
+ *  p_event is the ACI_EVT_DATA_RECEIVED in the event queue, buffer[2] is the pipe.
+ *  Called at the end of the ACI interrupt with the interrupts disabled, in polling
+ *  mode at the end of the transfer: it should copy what it needs and return. The
+ *  event is then taken by lib_aci_event_get() as usual.
+ */
+typedef void (*hal_aci_tl_soft_data_cb_t)(const hal_aci_data_t *p_event);
+
+/** @brief Soft handler of the data credits given back by the interrupt, as the data one */
+typedef void (*hal_aci_tl_soft_credit_cb_t)(uint8_t credits);
+
+/** @brief Set the soft handlers of the selected instance, NULL for none
+ */
+void hal_aci_tl_set_soft_handlers(hal_aci_tl_soft_data_cb_t data_cb, hal_aci_tl_soft_credit_cb_t credit_cb);
+
+/** @brief Give the data received on a pipe to the soft data handler, or stop
+ *  @return False when the pipe is above ACI_DEVICE_MAX_PIPES.
+ */
+bool hal_aci_tl_soft_pipe_set(uint8_t pipe, bool enable);
+
+/** @brief Number of data events of the soft pipes not given to the soft handler
+ *  @details
+ *  More than HAL_ACI_TL_SOFT_EVENTS in one interrupt, they still are in the event queue.
+ */
+uint16_t hal_aci_tl_soft_dropped(void);
+#endif
+
+#if HAL_ACI_EVENT_FILTER
+/** Bit of an ACI event opcode in the mask of hal_aci_tl_event_filter_set() */
+#define HAL_ACI_EVENT_FILTER_BIT(evt_opcode)  ((uint16_t)1 << ((uint8_t)(evt_opcode) - ACI_EVT_DEVICE_STARTED))
+
+/** What the filtered events left since the last hal_aci_tl_event_filtered_take() */
+typedef struct
+{
+  uint16_t events;                // Events kept out of the event queue
+  uint8_t  credits;               // Credits of the ACI_EVT_DATA_CREDIT events
+  bool     timing_valid;          // An ACI_EVT_TIMING was filtered, its parameters follow
+  uint16_t conn_rf_interval;      // Of the newest ACI_EVT_TIMING
+  uint16_t conn_slave_rf_latency;
+  uint16_t conn_rf_timeout;
+} hal_aci_tl_filtered_t;
+
+/** @brief Set the events kept out of the event queue
+ *  @details
+ *  The events of the mask, built with HAL_ACI_EVENT_FILTER_BIT(), are dropped as they are clocked in,
+ *  in interrupt mode from the ISR. hal_aci_tl_event_get() never returns them. 0 lets every event through.
+ */
+void hal_aci_tl_event_filter_set(uint16_t evt_mask);
+
+/** @brief Take what the filtered events left and clear it
+ *  @return True when an event was filtered since the last call.
+ */
+bool hal_aci_tl_event_filtered_take(hal_aci_tl_filtered_t *p_filtered);
+#endif
+
+#if HAL_ACI_TL_STATS
+/** Transport statistics, counted since hal_aci_tl_init() or the last hal_aci_tl_stats_reset() */
+typedef struct
+{
+  uint32_t spi_transfers;        // SPI transactions run
+  uint32_t bytes_out;            // Command bytes sent, length byte included
+  uint32_t bytes_in;             // Event bytes received, length byte included
+  uint32_t empty_transfers;      // Transactions with neither a command nor an event
+  uint32_t isr_transfers;        // Transactions run from m_aci_isr
+  uint32_t poll_transfers;       // Transactions run from the polling path
+  uint16_t rx_full_stalls;       // Times the RDYN interrupt was held off because the event queue was full
+  uint16_t tx_enqueue_failures;  // hal_aci_tl_send() calls rejected with the command queue full
+  uint16_t tx_coalesced;         // Commands merged into a queued one by hal_aci_tl_send_coalesce()
+  uint16_t rx_credit_coalesced;  // ACI_EVT_DATA_CREDIT events added to the queued one, HAL_ACI_RX_CREDIT_COALESCE
+  uint8_t  tx_q_high_water;      // Most bytes used in the command queue
+  uint8_t  rx_q_high_water;      // Most bytes used in the event queue
+  uint8_t  ctrl_q_high_water;    // Most bytes used in the control command queue, ACI_TX_CTRL_QUEUE_BYTES
+#if HAL_ACI_TL_HYBRID
+  uint16_t hybrid_switches;      // Times the hybrid interface went from the RDYN interrupt to polling
+#endif
+} hal_aci_tl_stats_t;
+
+/** @brief Get a copy of the transport statistics
+ *  @details
+ *  The copy is taken atomically. Only available when HAL_ACI_TL_STATS is 1.
+ */
+void hal_aci_tl_stats_get(hal_aci_tl_stats_t *p_stats);
+
+/** @brief Clear the transport statistics
+ *  @details
+ *  Only available when HAL_ACI_TL_STATS is 1.
+ */
+void hal_aci_tl_stats_reset(void);
+#endif
+
+#if HAL_ACI_TL_LATENCY
+/** Latency from the transfer of an event to the application getting it, for one event opcode */
+typedef struct
+{
+  uint16_t count;                                  // Events measured
+  uint32_t min_us;
+  uint32_t max_us;
+  uint32_t total_us;                               // avg = total_us / count
+  uint16_t histogram[HAL_ACI_TL_LATENCY_BUCKETS];  // Bucket n: below (64 << 2n) us, last bucket: the rest
+} hal_aci_tl_latency_t;
+
+/** @brief Get a copy of the latency measured for an event opcode
+ *  @details
+ *  Only available when HAL_ACI_TL_LATENCY is 1.
+ *  @return False if evt_opcode is not an ACI event opcode.
+ */
+bool hal_aci_tl_latency_get(uint8_t evt_opcode, hal_aci_tl_latency_t *p_latency);
+
+/** @brief Clear the latency measurements
+ *  @details
+ *  Only available when HAL_ACI_TL_LATENCY is 1.
+ */
+void hal_aci_tl_latency_reset(void);
+#endif
+
+#if HAL_ACI_TL_EVENT_TIME
+/** @brief micros() when the event last taken out of the event queue was clocked in
+ *  @details
+ *  Only available when HAL_ACI_TL_EVENT_TIME is 1. After hal_aci_tl_event_get_many() it is
+ *  the time of the last event got.
+ */
+uint32_t hal_aci_tl_event_time_us(void);
+#endif
+
+#if HAL_ACI_TL_ACTIVE
+/** ACTIVE line measurements, since hal_aci_tl_init() or the last hal_aci_tl_active_reset() */
+typedef struct
+{
+  uint32_t events;               // ACTIVE pulses, one per radio event: connection or advertising event
+  uint32_t active_us;            // ACTIVE high time of all the pulses
+  uint16_t last_active_us;       // ACTIVE high time of the last pulse, per connection event once connected
+  uint16_t max_active_us;        // Longest pulse
+  uint32_t period_us;            // Rising edge to rising edge of the last two pulses, 0 until known
+  uint16_t duty_permille;        // last_active_us / period_us, set by hal_aci_tl_active_get()
+} hal_aci_tl_active_t;
+
+/** @brief Sample the ACTIVE pin and stamp its edges
+ *  @details
+ *  Called from hal_aci_tl_event_get() and hal_aci_tl_quiet_us(). A sketch that has a pin change
+ *  interrupt on ACTIVE calls it from the interrupt handler, the edges are then stamped when they
+ *  happen instead of when the loop gets to them. Only available when HAL_ACI_TL_ACTIVE is 1,
+ *  it does nothing when the active_pin is UNUSED.
+ */
+void hal_aci_tl_active_sample(void);
+
+/** @brief Time left before the next radio event
+ *  @details
+ *  The next rising edge of ACTIVE is expected one period_us after the last one, or a whole
+ *  number of periods after it when radio events were skipped, e.g. with slave latency.
+ *  Only available when HAL_ACI_TL_ACTIVE is 1.
+ *  @return Microseconds until HAL_ACI_TL_ACTIVE_GUARD_US before the next radio event, 0 while
+ *  ACTIVE is high or when the guard has started, HAL_ACI_TL_QUIET_UNKNOWN until two radio
+ *  events have been seen.
+ */
+uint32_t hal_aci_tl_quiet_us(void);
+
+/** @brief True when work of duration_us can run before the next radio event
+ *  @details
+ *  Use it to run noise sensitive ADC sampling or a long computation between two radio events.
+ *  Until the period of the radio events is known it is true while ACTIVE is low.
+ */
+bool hal_aci_tl_quiet_window(uint32_t duration_us);
+
+/** @brief Get a copy of the ACTIVE line measurements
+ *  @details
+ *  Only available when HAL_ACI_TL_ACTIVE is 1.
+ */
+void hal_aci_tl_active_get(hal_aci_tl_active_t *p_active);
+
+/** @brief Clear the ACTIVE line measurements, the period is measured again
+ *  @details
+ *  Call it after the connection interval has changed. Only available when HAL_ACI_TL_ACTIVE is 1.
+ */
+void hal_aci_tl_active_reset(void);
+#endif
+
+#if HAL_ACI_TL_TX_HOLD
+/** @brief True from the transfer of an ACI Sleep to the Device Started event that ends it
+ *  @details
+ *  The commands queued in the meantime, but an ACI Wakeup, are held. Only available when
+ *  HAL_ACI_TL_TX_HOLD is 1.
+ */
+bool hal_aci_tl_tx_held(void);
+#endif
+
+#if HAL_ACI_TL_DATA_MARKS
+/** @brief Number of SendData commands queued so far
+ *  @details
+ *  Read before a SendData is queued it is the number of that command, counted modulo 256.
+ *  The count starts again at hal_aci_tl_init() and drops the commands lost with a flush of the
+ *  queues. Only available when HAL_ACI_TL_DATA_MARKS is 1.
+ */
+uint8_t hal_aci_tl_data_queued(void);
+
+/** @brief Take the mark of the oldest ACI_EVT_PIPE_ERROR not taken yet
+ *  @details
+ *  Call it once for each ACI_EVT_PIPE_ERROR got from the event queue, in order. The nRF8001
+ *  answers a command before it takes the next one, so the error is for the command clocked out
+ *  last before it, unless events were already waiting in the nRF8001. Only available when
+ *  HAL_ACI_TL_DATA_MARKS is 1.
+ *  @param p_number Number of that command, as given by hal_aci_tl_data_queued()
+ *  @return False when that command was not a SendData, or the error could not be marked.
+ */
+bool hal_aci_tl_data_mark_take(uint8_t *p_number);
+#endif
+
+/** @brief Add an event to the ACI Event Queue from the main context
+ *  @details
+ *  Used to hand events made up by the library, e.g. after a board reset, to the application.
+ *  @return True if the event was queued, false when the queue is full.
+ */
+bool hal_aci_tl_event_inject(hal_aci_data_t *p_aci_evt);
+
+#if (HAL_ACI_INSTANCES > 1)
+/** @brief Select the transport instance used by the following hal_aci_tl_* calls
+ *  @details
+ *  Call this function in the main thread. The RDYN interrupt of every instance keeps running
+ *  whatever the selection, and the selection is the instance of the interrupt in the
+ *  overflow callback.
+ *  @return False if instance is not below HAL_ACI_INSTANCES, the selection is not changed.
+ */
+bool hal_aci_tl_select(uint8_t instance);
+
+/** @brief Get the transport instance used by the hal_aci_tl_* calls
+ */
+uint8_t hal_aci_tl_selected(void);
+#else
+static inline bool hal_aci_tl_select(uint8_t instance)
+{
+  return (0 == instance);
+}
+
+static inline uint8_t hal_aci_tl_selected(void)
+{
+  return 0;
+}
+#endif
+
 /** @brief Flush the ACI command Queue and the ACI Event Queue
  *  @details
  *  Call this function in the main thread
  */
 void hal_aci_tl_q_flush(void);
 
+/** @brief RAM taken by the transport
+ *  @details
+ *  Bytes of the static state of all the instances, the command and event queues included,
+ *  and of the diagnostics that are built in (HAL_ACI_TL_STATS, HAL_ACI_TL_LATENCY, HAL_ACI_TL_TRACE).
+ */
+uint16_t hal_aci_tl_ram_bytes(void);
+
 #endif // HAL_ACI_TL_H__
 /** @} */
@@ -71,6 +71,14 @@
 	
 	//Redefine the function for reading from flash in ChipKit
 	#define memcpy_P        memcpy
+#elif defined(__arm__)
+    //For the Arduino Due (SAM3X) and Zero (SAMD) the core provides the AVR flash
+    //compatibility macros, the constants are in the flash already
+    #include "Arduino.h"
+    #include <avr/pgmspace.h>
+#elif defined(HAL_PLATFORM_HOST)
+    //Host build of Build/host, the mock Arduino core provides the flash compatibility macros
+    #include "Arduino.h"
 #endif
 
 #endif /* PLATFORM_H__ */
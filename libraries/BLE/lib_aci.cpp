@@ -31,633 +31,4074 @@
 #include "acilib_defs.h"
 #include "acilib_if.h"
 #include "hal_aci_tl.h"
+#include "aci_log.h"
 #include "aci_queue.h"
 #include "lib_aci.h"
+#include "aci_setup.h"
 
 
 #define LIB_ACI_DEFAULT_CREDIT_NUMBER   1
 
+/* Time the nRF8001 is given to answer the radio reset when resuming a retained setup */
+#define LIB_ACI_RESUME_TIMEOUT_MS       100
+
+/* Time the nRF8001 is given for each event of the SPI clock calibration */
+#define LIB_ACI_CALIBRATION_TIMEOUT_MS  100
+
 /*
-Global additionally used used in aci_setup 
+  Events read by the initialization, and by the sketch with ACI_LOW_MEMORY (lib_aci_event_buffer()).
+  It belongs to the loop. The commands have no buffer of their own, see lib_aci_cmd_buffer().
 */
-hal_aci_data_t  msg_to_send;
+static hal_aci_evt_t lib_aci_evt;
 
 
-static services_pipe_type_mapping_t * p_services_pipe_type_map;
-static hal_aci_data_t *               p_setup_msgs;
+/* Steps of the non-blocking initialization */
+typedef enum
+{
+  LIB_ACI_INIT_DONE,             // First, so a state that was never started reads as done
+  LIB_ACI_INIT_TRANSPORT,        // hal_aci_tl_init_poll() not done yet
+  LIB_ACI_INIT_BOARD_RESET_WAIT, // Waiting for the board to come out of reset
+  LIB_ACI_INIT_BOARD_RESP_WAIT,  // Waiting for the response to the radio reset
+  LIB_ACI_INIT_RESUME_RESP_WAIT  // Waiting for the radio reset of a retained setup, ACI_SETUP_RETAIN
+} lib_aci_init_step_t;
+
+#if LIB_ACI_PENDING_CMDS
+/* Command waiting for its response */
+typedef struct
+{
+  lib_aci_cmd_cb_t cmd_cb;
+  unsigned long    deadline_ms;
+  uint8_t          cmd_opcode;
+  bool             timed;        // false when waiting forever
+} lib_aci_pending_cmd_t;
+#endif
+
+#if LIB_ACI_TRANSACTION_CMDS
+typedef enum
+{
+  LIB_ACI_TRANSACTION_IDLE,
+  LIB_ACI_TRANSACTION_BUILDING,  // Between lib_aci_transaction_begin() and lib_aci_transaction_end()
+  LIB_ACI_TRANSACTION_WAITING    // For the responses
+} lib_aci_transaction_state_t;
+#endif
+
+/* Pipes a data command is checked against, one bitmap each with LIB_ACI_PIPE_BITMAPS */
+typedef enum
+{
+  LIB_ACI_PIPES_SEND,            // ACI_TX and ACI_TX_ACK
+  LIB_ACI_PIPES_TX_ACK,
+  LIB_ACI_PIPES_REQ,             // Remote ACI_RX_REQ
+  LIB_ACI_PIPES_REMOTE_RX,       // Remote ACI_RX, ACI_RX_ACK_AUTO and ACI_RX_ACK
+  LIB_ACI_PIPES_LOCAL,           // ACI_STORE_LOCAL
+  LIB_ACI_PIPES_CLASSES
+} lib_aci_pipes_t;
+
+#if LIB_ACI_SHADOW_PIPES
+/*
+Last value given to the nRF8001 on a pipe of lib_aci_shadow_enable()
+*/
+typedef struct
+{
+  uint8_t  pipe;                                // 0 when the entry is free
+  uint8_t  length;                              // 0 when no value is known
+  uint16_t deadband;
+  uint8_t  value[LIB_ACI_SHADOW_VALUE_MAX];
+} lib_aci_shadow_t;
+#endif
+
+#if LIB_ACI_RETRANSMIT_SLOTS
+typedef enum
+{
+  LIB_ACI_RETRANSMIT_FREE,
+  LIB_ACI_RETRANSMIT_IN_FLIGHT,  // Queued, until its credit comes back
+  LIB_ACI_RETRANSMIT_WAITING     // Failed with a recoverable pipe error, to be sent again
+} lib_aci_retransmit_state_t;
+
+/*
+Data command holding a credit of the nRF8001, the packet kept for a SendData
+*/
+typedef struct
+{
+  uint8_t state;                              // lib_aci_retransmit_state_t
+  uint8_t seq;                                // Order of the commands queued, the credits come back in it
+  uint8_t opcode;                             // Only ACI_CMD_SEND_DATA is sent again
+  uint8_t pipe;
+  uint8_t length;
+  uint8_t tries;                              // Times sent again
+  uint8_t error_ms;                           // Low byte of millis() at the pipe error
+  uint8_t number;                             // hal_aci_tl_data_queued() of the last SendData queued
+  uint8_t data[ACI_PIPE_TX_DATA_MAX_LEN];
+} lib_aci_retransmit_slot_t;
+#endif
+
+#if LIB_ACI_STAGED_VALUES
+/*
+Value of lib_aci_stage_local_data() not queued yet
+*/
+typedef struct
+{
+  uint8_t pipe;                               // 0 when the entry is free
+  uint8_t length;
+  uint8_t value[ACI_PIPE_TX_DATA_MAX_LEN];
+} lib_aci_staged_t;
+#endif
 
+/*
+State of the ACI Library for one nRF8001, one per transport instance (HAL_ACI_INSTANCES)
+*/
+typedef struct
+{
+  const services_pipe_type_mapping_t * p_services_pipe_type_map;
+  hal_aci_data_t *               p_setup_msgs;
+
+  bool is_request_operation_pending;
+  bool is_indicate_operation_pending;
+  bool is_open_remote_pipe_pending;
+  bool is_close_remote_pipe_pending;
+
+  uint8_t request_operation_pipe;
+  uint8_t indicate_operation_pipe;
+
+#if LIB_ACI_PIPE_BITMAPS
+  uint8_t pipe_bitmaps[LIB_ACI_PIPES_CLASSES][PIPES_ARRAY_SIZE];  // From the pipe map, by lib_aci_state_init()
+#endif
+
+#if ACI_FEATURE_BROADCAST
+  // The following structure (aci_cmd_params_open_adv_pipe) will be used to store the complete command 
+  // including the pipes to be opened. 
+  aci_cmd_params_open_adv_pipe_t aci_cmd_params_open_adv_pipe; 
+#endif
+
+#if LIB_ACI_CREDIT_TRACKING
+  aci_state_t * p_aci_stat;    // Credits taken by the data commands that have no aci_state_t
+#endif
+
+#if LIB_ACI_SHADOW_PIPES
+  lib_aci_shadow_t    shadows[LIB_ACI_SHADOW_PIPES];
+  uint16_t            shadow_suppressed;
+#endif
+
+#if LIB_ACI_STAGED_VALUES
+  lib_aci_staged_t    staged[LIB_ACI_STAGED_VALUES];  // In the order they were first staged
+#endif
+
+#if LIB_ACI_STREAM_BYTES
+  uint8_t             stream_buf[LIB_ACI_STREAM_BYTES];
+  uint8_t             stream_head;   // Oldest byte not sent
+  uint8_t             stream_count;
+  uint8_t             stream_pipe;
+  lib_aci_stream_cb_t stream_cb;
+#endif
+
+#if LIB_ACI_RETRANSMIT_SLOTS
+  lib_aci_retransmit_slot_t  retransmit[LIB_ACI_RETRANSMIT_SLOTS];
+  hal_aci_data_t *           retransmit_cmd;     // Queue slot of the data command reserved last
+  uint8_t                    retransmit_resend;  // Packet being sent again, LIB_ACI_RETRANSMIT_SLOTS for none
+  uint8_t                    retransmit_seq;     // Of the next command queued
+  lib_aci_retransmit_stats_t retransmit_stats;
+#endif
+
+#if LIB_ACI_PRODUCERS
+  lib_aci_fill_cb_t   producer_cbs[LIB_ACI_PRODUCERS];
+  uint8_t             producer_pipes[LIB_ACI_PRODUCERS];  // 0 when the entry is free
+  uint8_t             producer_next;                      // Asked first by the next pump
+#endif
+
+#if LIB_ACI_PENDING_CMDS
+  lib_aci_pending_cmd_t pending_cmds[LIB_ACI_PENDING_CMDS];  // Oldest first
+  uint8_t               pending_count;
+#endif
+
+#if LIB_ACI_TRANSACTION_CMDS
+  lib_aci_transaction_cb_t     transaction_cb;
+  unsigned long                transaction_deadline_ms;
+  lib_aci_transaction_result_t transaction;
+  uint8_t                      transaction_cmds[LIB_ACI_TRANSACTION_CMDS];  // Opcodes in the order they were queued
+  uint8_t                      transaction_state;                          // lib_aci_transaction_state_t
+  bool                         transaction_timed;                          // false when waiting forever
+#endif
+
+#if LIB_ACI_ACK_WINDOW
+  uint8_t ack_pipes[LIB_ACI_ACK_WINDOW];  // ACI_TX_ACK pipes of the packets waiting for ACI_EVT_DATA_ACK, oldest first
+  uint8_t ack_count;
+#endif
+
+#if LIB_ACI_AUTO_ACK
+  uint8_t             auto_ack_bitmap[PIPES_ARRAY_SIZE];  // Pipes answered by the ACI Library
+  lib_aci_ack_check_t ack_check;
+  uint8_t             ack_retry_bitmap[PIPES_ARRAY_SIZE];   // Pipes whose answer is not queued yet
+  uint8_t             nack_retry_bitmap[PIPES_ARRAY_SIZE];  // Those of them answered with a NACK
+  uint8_t             nack_retry_error_code;                // Of the NACKs not queued yet
+#endif
+
+#if LIB_ACI_DISPATCH
+  const lib_aci_evt_handler_t * p_evt_handlers;   // In PROGMEM
+  const lib_aci_evt_handler_t * p_pipe_handlers;  // In PROGMEM
+  uint8_t                      pipe_handler_count;
+#endif
+
+#if LIB_ACI_DISPATCH_PROFILE
+  lib_aci_handler_time_t evt_times[LIB_ACI_EVT_HANDLER_COUNT];
+#if LIB_ACI_DISPATCH_PROFILE_PIPES
+  lib_aci_handler_time_t pipe_times[LIB_ACI_DISPATCH_PROFILE_PIPES];  // Pipes 0 to LIB_ACI_DISPATCH_PROFILE_PIPES - 1
+#endif
+#endif
+
+#if LIB_ACI_AUTO_WAKEUP
+  bool          asleep;        // Sleep queued, no Wakeup queued since
+#endif
+
+#if HAL_ACI_TL_EVENT_TIME
+  uint32_t      conn_anchor_us; // RDYN of an event that followed a connection event
+  bool          conn_anchored;
+#endif
+
+  uint8_t       init_step;     // lib_aci_init_step_t of lib_aci_init_poll()
+  unsigned long init_time_ms;
+#if ACI_SETUP_RETAIN
+  bool          init_debug;    // Kept for the pin reset when the resume fails
+#endif
+
+#if LIB_ACI_LINK_HISTORY
+  lib_aci_link_record_t links[LIB_ACI_LINK_HISTORY];
+  uint8_t               link_head;        // Newest record
+  uint8_t               link_count;
+  bool                  link_open;        // The newest record is the current connection
+  bool                  link_starved;     // A data command was refused, no credit came back since
+  unsigned long         link_starved_ms;  // millis() of that refusal
+#endif
+
+#if LIB_ACI_CREDIT_FORECAST
+  uint8_t               forecast_rate;      // Credits back per connection event in 1/16, 0 until measured
+  bool                  forecast_connected;
+#endif
+
+#if LIB_ACI_ADV_SCHEDULE
+  lib_aci_adv_schedule_t    adv_schedule;
+  bool                      adv_scheduled;   // adv_schedule is set
+  uint8_t                   adv_phase;       // lib_aci_adv_phase_t
+  bool                      adv_pending;     // The Connect of adv_phase did not fit in the command queue
+  bool                      adv_stopping;    // Disconnect sent to go from the slow to the fast advertising
+  bool                      adv_connected;
+#endif
+
+#if LIB_ACI_STARTUP_PROFILE
+  lib_aci_startup_profile_t profile;
+  unsigned long             profile_start_us;     // micros() at the start of the initialization
+  unsigned long             profile_setup_us;     // micros() of the setup start or last setup response
+#endif
+} lib_aci_ctx_t;
+
+static lib_aci_ctx_t lib_aci_ctx[HAL_ACI_INSTANCES];
+
+/* State of the transport instance selected by lib_aci_select() */
+#define lib_aci_cur  (&lib_aci_ctx[hal_aci_tl_selected()])
+
+/* Pipe map of the sketch, in PROGMEM with ACI_LOW_MEMORY (ChipKit keeps it in RAM) */
+#if ACI_LOW_MEMORY && !defined(__PIC32MX__)
+  #define lib_aci_pipe_map_byte(p)  pgm_read_byte_near(p)
+#else
+  #define lib_aci_pipe_map_byte(p)  (*(const uint8_t *)(p))
+#endif
+#define lib_aci_pipe_location(pipe)  lib_aci_pipe_map_byte(&lib_aci_cur->p_services_pipe_type_map[(pipe)-1].location)
+#define lib_aci_pipe_type(pipe)      ((aci_pipe_type_t)lib_aci_pipe_map_byte(&lib_aci_cur->p_services_pipe_type_map[(pipe)-1].pipe_type))
 
+/*
+  Checks if a pipe is one of the lib_aci_pipes_t of its data command, from the pipe map.
+*/
+static bool lib_aci_pipe_map_in(uint8_t pipe, uint8_t pipes)
+{
+  const aci_pipe_type_t pipe_type = lib_aci_pipe_type(pipe);
+  const uint8_t         location  = lib_aci_pipe_location(pipe);
 
+  switch (pipes)
+  {
+    case LIB_ACI_PIPES_SEND:
+      return (ACI_TX == pipe_type) || (ACI_TX_ACK == pipe_type);
+    case LIB_ACI_PIPES_TX_ACK:
+      return (ACI_TX_ACK == pipe_type);
+    case LIB_ACI_PIPES_REQ:
+      return (ACI_STORE_REMOTE == location) && (ACI_RX_REQ == pipe_type);
+    case LIB_ACI_PIPES_REMOTE_RX:
+      return (ACI_STORE_REMOTE == location) &&
+             ((ACI_RX == pipe_type) || (ACI_RX_ACK_AUTO == pipe_type) || (ACI_RX_ACK == pipe_type));
+    case LIB_ACI_PIPES_LOCAL:
+      return (ACI_STORE_LOCAL == location);
+    default:
+      return false;
+  }
+}
 
-static bool is_request_operation_pending;
-static bool is_indicate_operation_pending;
-static bool is_open_remote_pipe_pending;
-static bool is_close_remote_pipe_pending;
+#if LIB_ACI_PIPE_BITMAPS
+#define lib_aci_pipe_in(pipe, pipes)  (((pipe) <= ACI_DEVICE_MAX_PIPES) && \
+                                       (0 != (lib_aci_cur->pipe_bitmaps[pipes][(pipe) / 8] & (0x01 << ((pipe) % 8)))))
 
-static uint8_t request_operation_pipe = 0;
-static uint8_t indicate_operation_pipe = 0;
+/*
+  Reads the pipe map once into the bitmaps of the data commands.
+*/
+static void lib_aci_pipe_bitmaps_init(aci_state_t *aci_stat)
+{
+  uint8_t pipe;
+  uint8_t pipes;
 
+  memset(lib_aci_cur->pipe_bitmaps, 0, sizeof(lib_aci_cur->pipe_bitmaps));
+  if (NULL == lib_aci_cur->p_services_pipe_type_map)
+  {
+    return;
+  }
+  for (pipe = 1; (pipe <= aci_stat->aci_setup_info.number_of_pipes) && (pipe <= ACI_DEVICE_MAX_PIPES); pipe++)
+  {
+    for (pipes = 0; pipes < LIB_ACI_PIPES_CLASSES; pipes++)
+    {
+      if (lib_aci_pipe_map_in(pipe, pipes))
+      {
+        lib_aci_cur->pipe_bitmaps[pipes][pipe / 8] |= (uint8_t)(0x01 << (pipe % 8));
+      }
+    }
+  }
+}
+#else
+#define lib_aci_pipe_in(pipe, pipes)  lib_aci_pipe_map_in(pipe, pipes)
+#endif
 
-// The following structure (aci_cmd_params_open_adv_pipe) will be used to store the complete command 
-// including the pipes to be opened. 
-static aci_cmd_params_open_adv_pipe_t aci_cmd_params_open_adv_pipe; 
+#if LIB_ACI_AUTO_WAKEUP
+/*
+  A command issued while the nRF8001 sleeps sends the Wakeup first, the transport holds the command
+  until the Device Started of the wakeup. False when the Wakeup does not fit in the command queue.
+*/
+static bool lib_aci_wake_for(uint8_t cmd_opcode)
+{
+  if (!lib_aci_cur->asleep || (ACI_CMD_WAKEUP == cmd_opcode))
+  {
+    return true;
+  }
+  return lib_aci_wakeup();
+}
 
+/*
+  The nRF8001 is awake after any Device Started, and did not sleep when it refuses the Sleep.
+*/
+static void lib_aci_sleep_event(const aci_evt_t *aci_evt)
+{
+  if ((ACI_EVT_DEVICE_STARTED == aci_evt->evt_opcode) ||
+      ((ACI_EVT_CMD_RSP == aci_evt->evt_opcode) && (ACI_CMD_SLEEP == aci_evt->params.cmd_rsp.cmd_opcode)))
+  {
+    lib_aci_cur->asleep = false;
+  }
+}
+#else
+#define lib_aci_wake_for(cmd_opcode)  (true)
+#endif
 
+#if LIB_ACI_TRANSACTION_CMDS
+/*
+  Keeps the first failure of the transaction, the ones after it do not change the outcome.
+*/
+static void lib_aci_transaction_fail(uint8_t cmd_opcode, uint8_t status)
+{
+  lib_aci_transaction_result_t *p_result = &lib_aci_cur->transaction;
 
-extern aci_queue_t    aci_rx_q;
-extern aci_queue_t    aci_tx_q;
+  if (ACI_STATUS_SUCCESS == p_result->status)
+  {
+    p_result->cmd_opcode = cmd_opcode;
+    p_result->status     = status;
+  }
+}
 
-bool lib_aci_is_pipe_available(aci_state_t *aci_stat, uint8_t pipe)
+/*
+  Adds a command queued, or refused by the command queue, to the transaction being built.
+*/
+static void lib_aci_transaction_add(uint8_t cmd_opcode, bool queued)
 {
-  uint8_t byte_idx;
+  lib_aci_ctx_t *p_ctx = lib_aci_cur;
 
-  byte_idx = pipe / 8;
-  if (aci_stat->pipes_open_bitmap[byte_idx] & (0x01 << (pipe % 8)))
+  // No command response to wait for
+  if ((LIB_ACI_TRANSACTION_BUILDING != p_ctx->transaction_state) ||
+      (ACI_CMD_ECHO == cmd_opcode) || (ACI_CMD_SLEEP == cmd_opcode) || (ACI_CMD_WAKEUP == cmd_opcode))
   {
-    return(true);
+    return;
   }
-  return(false);
+
+  if (!queued || (LIB_ACI_TRANSACTION_CMDS == p_ctx->transaction.cmd_count))
+  {
+    lib_aci_transaction_fail(cmd_opcode, ACI_STATUS_ERROR_BUSY);
+    return;
+  }
+  p_ctx->transaction_cmds[p_ctx->transaction.cmd_count++] = cmd_opcode;
 }
 
+/*
+  Counts the response of the next command of the transaction. The nRF8001 answers in order, a
+  response of another opcode is for a command queued before the transaction.
+*/
+static void lib_aci_transaction_event(const aci_evt_t *aci_evt)
+{
+  lib_aci_ctx_t *p_ctx = lib_aci_cur;
+  lib_aci_transaction_result_t *p_result = &p_ctx->transaction;
+
+  if ((ACI_EVT_CMD_RSP != aci_evt->evt_opcode) || (LIB_ACI_TRANSACTION_IDLE == p_ctx->transaction_state) ||
+      (p_result->rsp_count == p_result->cmd_count) ||
+      (p_ctx->transaction_cmds[p_result->rsp_count] != (uint8_t)aci_evt->params.cmd_rsp.cmd_opcode))
+  {
+    return;
+  }
 
-bool lib_aci_is_pipe_closed(aci_state_t *aci_stat, uint8_t pipe)
+  p_result->rsp_count++;
+  // ACI_STATUS_TRANSACTION_CONTINUE and ACI_STATUS_TRANSACTION_COMPLETE are answers too
+  if (ACI_STATUS_ERROR_UNKNOWN <= (uint8_t)aci_evt->params.cmd_rsp.cmd_status)
+  {
+    lib_aci_transaction_fail((uint8_t)aci_evt->params.cmd_rsp.cmd_opcode, (uint8_t)aci_evt->params.cmd_rsp.cmd_status);
+  }
+}
+
+/*
+  Gives the outcome once every response came, or on timeout. The transaction is over before the
+  callback, so the callback may start the next one.
+*/
+static void lib_aci_transaction_poll(aci_state_t *aci_stat)
 {
-  uint8_t byte_idx;
+  lib_aci_ctx_t *p_ctx = lib_aci_cur;
+  lib_aci_transaction_result_t result;
 
-  byte_idx = pipe / 8;
-  if (aci_stat->pipes_closed_bitmap[byte_idx] & (0x01 << (pipe % 8)))
+  if (LIB_ACI_TRANSACTION_WAITING != p_ctx->transaction_state)
   {
-    return(true);
+    return;
   }
-  return(false);
+
+  result = p_ctx->transaction;
+  if (result.rsp_count < result.cmd_count)
+  {
+    if (!p_ctx->transaction_timed || ((long)(millis() - p_ctx->transaction_deadline_ms) < 0))
+    {
+      return;
+    }
+    if (ACI_STATUS_SUCCESS == result.status)
+    {
+      result.cmd_opcode = p_ctx->transaction_cmds[result.rsp_count];
+      result.status     = ACI_STATUS_ERROR_UNKNOWN;
+    }
+    result.timed_out = true;
+  }
+
+  p_ctx->transaction_state = LIB_ACI_TRANSACTION_IDLE;
+  p_ctx->transaction_cb(aci_stat, &result);
 }
+#else
+#define lib_aci_transaction_add(cmd_opcode, queued)  ((void)(cmd_opcode), (void)(queued))
+#define lib_aci_transaction_poll(aci_stat)
+#endif
 
+/*
+  Buffer a command is encoded in, sent with lib_aci_cmd_send(): the next slot of the command queue,
+  NULL when the queue is full. There is no shared staging buffer, so the commands of the loop only
+  share the command queue, reserved and committed by the loop, one command at a time. The
+  interrupts encode on their own stack into a queue of their own (ACI_TX_ISR_QUEUE_BYTES).
+*/
+static inline hal_aci_data_t *lib_aci_cmd_buffer(uint8_t cmd_opcode)
+{
+  hal_aci_data_t *p_cmd = NULL;
 
-bool lib_aci_is_discovery_finished(aci_state_t *aci_stat)
+  if (lib_aci_wake_for(cmd_opcode))
+  {
+    p_cmd = hal_aci_tl_send_reserve(cmd_opcode);
+  }
+  if (NULL == p_cmd)
+  {
+    lib_aci_transaction_add(cmd_opcode, false);
+  }
+  return p_cmd;
+}
+
+static inline bool lib_aci_cmd_send(hal_aci_data_t *p_cmd)
 {
-  return(aci_stat->pipes_open_bitmap[0]&0x01);
+  const uint8_t cmd_opcode = p_cmd->buffer[1];
+  bool queued;
+
+  queued = hal_aci_tl_send_commit();
+  lib_aci_transaction_add(cmd_opcode, queued);
+  return queued;
 }
 
-void lib_aci_board_init(aci_state_t *aci_stat)
+#if LIB_ACI_STARTUP_PROFILE
+/* Time of a startup phase, never 0 so that reached and not reached can be told apart */
+static uint32_t lib_aci_profile_now(void)
 {
-	hal_aci_evt_t *aci_data = NULL;
-	aci_data = (hal_aci_evt_t *)&msg_to_send;
-					
-	if (REDBEARLAB_SHIELD_V1_1 == aci_stat->aci_pins.board_name)
-	{
-	  /*
-	  The Bluetooth low energy Arduino shield v1.1 requires about 100ms to reset.
-	  This is not required for the nRF2740, nRF2741 modules
-	  */
-	  delay(100);
-  
-	  /*
-	  Send the soft reset command to the nRF8001 to get the nRF8001 to a known state.
-	  */
-	  lib_aci_radio_reset();
-  
-	  while (1)
-	  {
-		/*Wait for the command response of the radio reset command.
-		as the nRF8001 will be in either SETUP or STANDBY after the ACI Reset Radio is processed
-		*/
-
-			
-		if (true == lib_aci_event_get(aci_stat, aci_data))
-		{
-		  aci_evt_t * aci_evt;      
-		  aci_evt = &(aci_data->evt);
-	  
-		  if (ACI_EVT_CMD_RSP == aci_evt->evt_opcode)
-		  {
-				if (ACI_STATUS_ERROR_DEVICE_STATE_INVALID == aci_evt->params.cmd_rsp.cmd_status) //in SETUP
-				{
-					//Inject a Device Started Event Setup to the ACI Event Queue
-					msg_to_send.buffer[0] = 4;    //Length
-					msg_to_send.buffer[1] = 0x81; //Device Started Event
-					msg_to_send.buffer[2] = 0x02; //Setup
-					msg_to_send.buffer[3] = 0;    //Hardware Error -> None
-					msg_to_send.buffer[4] = 2;    //Data Credit Available
-					aci_queue_enqueue(&aci_rx_q, &msg_to_send);
-				}
-				else if (ACI_STATUS_SUCCESS == aci_evt->params.cmd_rsp.cmd_status) //We are now in STANDBY
-				{
-					//Inject a Device Started Event Standby to the ACI Event Queue
-					msg_to_send.buffer[0] = 4;    //Length
-					msg_to_send.buffer[1] = 0x81; //Device Started Event
-					msg_to_send.buffer[2] = 0x03; //Standby
-					msg_to_send.buffer[3] = 0;    //Hardware Error -> None
-					msg_to_send.buffer[4] = 2;    //Data Credit Available
-					aci_queue_enqueue(&aci_rx_q, &msg_to_send);
-				}
-				else if (ACI_STATUS_ERROR_CMD_UNKNOWN == aci_evt->params.cmd_rsp.cmd_status) //We are now in TEST
-				{
-					//Inject a Device Started Event Test to the ACI Event Queue
-					msg_to_send.buffer[0] = 4;    //Length
-					msg_to_send.buffer[1] = 0x81; //Device Started Event
-					msg_to_send.buffer[2] = 0x01; //Test
-					msg_to_send.buffer[3] = 0;    //Hardware Error -> None
-					msg_to_send.buffer[4] = 0;    //Data Credit Available
-					aci_queue_enqueue(&aci_rx_q, &msg_to_send);
-				}
-				
-				//Break out of the while loop
-				break;
-		  }
-		  else
-		  {			
-			//Serial.println(F("Discard any other ACI Events"));
-		  }
-	  
-		}
-	  }		
-	}
+  uint32_t elapsed = (uint32_t)(micros() - lib_aci_cur->profile_start_us);
+
+  return (0 == elapsed) ? 1 : elapsed;
 }
 
+static void lib_aci_profile_start(void)
+{
+  memset(&lib_aci_cur->profile, 0, sizeof(lib_aci_cur->profile));
+  lib_aci_cur->profile.setup_msg_min_us = 0xFFFF;
+  lib_aci_cur->profile_start_us = micros();
+}
 
-void lib_aci_init(aci_state_t *aci_stat, bool debug)
+#define LIB_ACI_PROFILE_MARK(field)  \
+  do { if (0 == lib_aci_cur->profile.field) { lib_aci_cur->profile.field = lib_aci_profile_now(); } } while (0)
+
+static void lib_aci_profile_setup_rsp(uint8_t cmd_status)
 {
-  uint8_t i;
+  lib_aci_startup_profile_t *p_profile = &lib_aci_cur->profile;
+  unsigned long              now       = micros();
+  unsigned long              elapsed   = now - lib_aci_cur->profile_setup_us;
+  uint16_t                   msg_us    = (elapsed > 0xFFFF) ? 0xFFFF : (uint16_t)elapsed;
 
-  for (i = 0; i < PIPES_ARRAY_SIZE; i++)
+  lib_aci_cur->profile_setup_us = now;
+  if (p_profile->setup_msgs < 0xFF)
   {
-    aci_stat->pipes_open_bitmap[i]          = 0;
-    aci_stat->pipes_closed_bitmap[i]        = 0;
-    aci_cmd_params_open_adv_pipe.pipes[i]   = 0;
+    p_profile->setup_msgs++;
   }
-  
+  if (msg_us < p_profile->setup_msg_min_us)
+  {
+    p_profile->setup_msg_min_us = msg_us;
+  }
+  if (msg_us > p_profile->setup_msg_max_us)
+  {
+    p_profile->setup_msg_max_us = msg_us;
+  }
+  if (ACI_STATUS_TRANSACTION_COMPLETE == cmd_status)
+  {
+    LIB_ACI_PROFILE_MARK(setup_complete_us);
+  }
+}
 
+/*
+  Startup phases seen in the events, before the application gets them.
+*/
+static void lib_aci_profile_event(const aci_evt_t *aci_evt)
+{
+  switch (aci_evt->evt_opcode)
+  {
+    case ACI_EVT_DEVICE_STARTED:
+      LIB_ACI_PROFILE_MARK(device_started_us);
+      if (ACI_DEVICE_STANDBY == aci_evt->params.device_started.device_mode)
+      {
+        LIB_ACI_PROFILE_MARK(standby_us);
+      }
+      break;
+
+    case ACI_EVT_CMD_RSP:
+      switch (aci_evt->params.cmd_rsp.cmd_opcode)
+      {
+        case ACI_CMD_SETUP:
+          if ((ACI_STATUS_TRANSACTION_CONTINUE == aci_evt->params.cmd_rsp.cmd_status) ||
+              (ACI_STATUS_TRANSACTION_COMPLETE == aci_evt->params.cmd_rsp.cmd_status))
+          {
+            lib_aci_profile_setup_rsp(aci_evt->params.cmd_rsp.cmd_status);
+          }
+          break;
+
+        case ACI_CMD_CONNECT:
+        case ACI_CMD_BOND:
+        case ACI_CMD_BROADCAST:
+        case ACI_CMD_CONNECT_DIRECT:
+          if (ACI_STATUS_SUCCESS == aci_evt->params.cmd_rsp.cmd_status)
+          {
+            LIB_ACI_PROFILE_MARK(advertising_us);
+          }
+          break;
 
+        default:
+          break;
+      }
+      break;
 
-  is_request_operation_pending     = false;
-  is_indicate_operation_pending    = false; 
-  is_open_remote_pipe_pending      = false;
-  is_close_remote_pipe_pending     = false;
+    default:
+      break;
+  }
+}
 
+void lib_aci_startup_profile_get(aci_state_t *aci_stat, lib_aci_startup_profile_t *p_profile)
+{
+  lib_aci_select(aci_stat);
 
+  *p_profile = lib_aci_cur->profile;
+  if (0 == p_profile->setup_msgs)
+  {
+    p_profile->setup_msg_min_us = 0;
+  }
+}
 
-  
-  
-  request_operation_pipe           = 0;
-  indicate_operation_pipe          = 0;
-  
-  
-  
-  p_services_pipe_type_map = aci_stat->aci_setup_info.services_pipe_type_mapping;
-  
-  p_setup_msgs             = aci_stat->aci_setup_info.setup_msgs;
-  
-  
-  hal_aci_tl_init(&aci_stat->aci_pins, debug);
-  
-  lib_aci_board_init(aci_stat);
+void lib_aci_startup_profile_setup_start(aci_state_t *aci_stat)
+{
+  lib_aci_select(aci_stat);
+
+  lib_aci_cur->profile.setup_start_us = lib_aci_profile_now();
+  lib_aci_cur->profile_setup_us       = micros();
 }
+#else
+#define LIB_ACI_PROFILE_MARK(field)
+#endif
 
+#if LIB_ACI_LINK_HISTORY
+/*
+  The link starves from the data command that takes the last credit to the next credit back. The
+  credits taken by the interrupts are seen at the next event.
+*/
+static void lib_aci_link_starve(aci_state_t *aci_stat)
+{
+  if (lib_aci_cur->link_open && !lib_aci_cur->link_starved && (0 == aci_stat->data_credit_available))
+  {
+    lib_aci_cur->link_starved    = true;
+    lib_aci_cur->link_starved_ms = millis();
+  }
+}
 
-uint8_t lib_aci_get_nb_available_credits(aci_state_t *aci_stat)
+static void lib_aci_link_fed(lib_aci_link_record_t *p_link)
 {
-  return aci_stat->data_credit_available;
+  unsigned long elapsed = millis() - lib_aci_cur->link_starved_ms;
+
+  lib_aci_cur->link_starved = false;
+  p_link->starved_ms += elapsed;
+  if (elapsed > p_link->starved_max_ms)
+  {
+    p_link->starved_max_ms = (elapsed > 0xFFFF) ? 0xFFFF : (uint16_t)elapsed;
+  }
+  if (p_link->starved_count < 0xFFFF)
+  {
+    p_link->starved_count++;
+  }
 }
 
-uint16_t lib_aci_get_cx_interval_ms(aci_state_t *aci_stat)
+static void lib_aci_link_timing(lib_aci_link_record_t *p_link, uint16_t interval, uint16_t slave_latency, uint16_t timeout)
 {
-  uint32_t cx_rf_interval_ms_32bits;
-  uint16_t cx_rf_interval_ms;
-  
-  cx_rf_interval_ms_32bits  = aci_stat->connection_interval;
-  cx_rf_interval_ms_32bits *= 125;                      // the connection interval is given in multiples of 0.125 milliseconds
-  cx_rf_interval_ms         = cx_rf_interval_ms_32bits / 100;
-  
-  return cx_rf_interval_ms;
+  p_link->interval            = interval;
+  p_link->slave_latency       = slave_latency;
+  p_link->supervision_timeout = timeout;
+  if (interval < p_link->interval_min)
+  {
+    p_link->interval_min = interval;
+  }
+  if (interval > p_link->interval_max)
+  {
+    p_link->interval_max = interval;
+  }
+  if (slave_latency > p_link->slave_latency_max)
+  {
+    p_link->slave_latency_max = slave_latency;
+  }
 }
 
+/*
+  Records the connection of the events, after the state of the ACI was updated from them.
+*/
+static void lib_aci_link_event(aci_state_t *aci_stat, const aci_evt_t *aci_evt)
+{
+  lib_aci_ctx_t         *p_ctx  = lib_aci_cur;
+  lib_aci_link_record_t *p_link = p_ctx->link_open ? &p_ctx->links[p_ctx->link_head] : NULL;
+
+  switch (aci_evt->evt_opcode)
+  {
+    case ACI_EVT_CONNECTED:
+      // The oldest record gives way once the history is full
+      p_ctx->link_head = (uint8_t)((p_ctx->link_head + 1) % LIB_ACI_LINK_HISTORY);
+      if (p_ctx->link_count < LIB_ACI_LINK_HISTORY)
+      {
+        p_ctx->link_count++;
+      }
+      p_link = &p_ctx->links[p_ctx->link_head];
+      memset(p_link, 0, sizeof(*p_link));
+      p_link->connected_ms = millis();
+      p_link->interval_min = 0xFFFF;
+      lib_aci_link_timing(p_link, aci_evt->params.connected.conn_rf_interval,
+                          aci_evt->params.connected.conn_slave_rf_latency,
+                          aci_evt->params.connected.conn_rf_timeout);
+      p_ctx->link_open    = true;
+      p_ctx->link_starved = false;
+      break;
+
+    case ACI_EVT_TIMING:
+      if (NULL != p_link)
+      {
+        lib_aci_link_timing(p_link, aci_evt->params.timing.conn_rf_interval,
+                            aci_evt->params.timing.conn_slave_rf_latency,
+                            aci_evt->params.timing.conn_rf_timeout);
+        if (p_link->timing_changes < 0xFF)
+        {
+          p_link->timing_changes++;
+        }
+      }
+      break;
+
+    case ACI_EVT_PIPE_ERROR:
+      if ((NULL != p_link) && (p_link->pipe_errors < 0xFF))
+      {
+        p_link->pipe_errors++;
+      }
+      break;
+
+    case ACI_EVT_DISCONNECTED:
+      if (NULL != p_link)
+      {
+        if (p_ctx->link_starved)
+        {
+          lib_aci_link_fed(p_link);
+        }
+        p_link->duration_ms = millis() - p_link->connected_ms;
+        p_link->aci_status  = (uint8_t)aci_evt->params.disconnected.aci_status;
+        p_link->btle_status = aci_evt->params.disconnected.btle_status;
+        p_ctx->link_open    = false;
+      }
+      return;
+
+    default:
+      break;
+  }
 
-uint16_t lib_aci_get_cx_interval(aci_state_t *aci_stat)
+  if (p_ctx->link_starved && (NULL != p_link) && (0 != aci_stat->data_credit_available))
+  {
+    lib_aci_link_fed(p_link);
+  }
+  lib_aci_link_starve(aci_stat);
+}
+
+uint8_t lib_aci_link_history_get(aci_state_t *aci_stat, lib_aci_link_record_t *p_records, uint8_t max_records)
 {
-  return aci_stat->connection_interval;
+  lib_aci_ctx_t *p_ctx;
+  uint8_t        count;
+  uint8_t        i;
+
+  lib_aci_select(aci_stat);
+  p_ctx = lib_aci_cur;
+
+  count = (max_records < p_ctx->link_count) ? max_records : p_ctx->link_count;
+  for (i = 0; i < count; i++)
+  {
+    p_records[i] = p_ctx->links[(p_ctx->link_head + LIB_ACI_LINK_HISTORY - i) % LIB_ACI_LINK_HISTORY];
+  }
+  return count;
 }
 
+bool lib_aci_link_history_read(aci_state_t *aci_stat, uint8_t index, lib_aci_link_record_t *p_record)
+{
+  lib_aci_ctx_t *p_ctx;
+
+  lib_aci_select(aci_stat);
+  p_ctx = lib_aci_cur;
 
-uint16_t lib_aci_get_slave_latency(aci_state_t *aci_stat)
+  if (index >= p_ctx->link_count)
+  {
+    return false;
+  }
+  *p_record = p_ctx->links[(p_ctx->link_head + LIB_ACI_LINK_HISTORY - index) % LIB_ACI_LINK_HISTORY];
+  return true;
+}
+
+void lib_aci_link_history_clear(aci_state_t *aci_stat)
 {
-  return aci_stat->slave_latency;
+  lib_aci_select(aci_stat);
+
+  lib_aci_cur->link_count   = 0;
+  lib_aci_cur->link_open    = false;
+  lib_aci_cur->link_starved = false;
 }
+#else
+#define lib_aci_link_starve(aci_stat)
+#endif
 
+#if LIB_ACI_CREDIT_FORECAST
+/* Weight of a new credit return in the average, 1/(2^LIB_ACI_FORECAST_SHIFT) */
+#define LIB_ACI_FORECAST_SHIFT  2
 
-bool lib_aci_set_app_latency(uint16_t latency, aci_app_latency_mode_t latency_mode)
+/*
+  Only the ACI_EVT_DATA_CREDIT that follow all the credits in use show what the link can carry, a
+  sender with less to send gets fewer back. Called before the credits are given back.
+*/
+static void lib_aci_forecast_event(aci_state_t *aci_stat, const aci_evt_t *aci_evt)
 {
-  aci_cmd_params_set_app_latency_t aci_set_app_latency;
-  
-  aci_set_app_latency.mode    = latency_mode;
-  aci_set_app_latency.latency = latency;  
-  acil_encode_cmd_set_app_latency(&(msg_to_send.buffer[0]), &aci_set_app_latency);
-  
-  return hal_aci_tl_send(&msg_to_send);
+  lib_aci_ctx_t *p_ctx = lib_aci_cur;
+  int16_t        sample;
+
+  switch (aci_evt->evt_opcode)
+  {
+    case ACI_EVT_CONNECTED:
+      p_ctx->forecast_rate      = 0;
+      p_ctx->forecast_connected = true;
+      break;
+
+    case ACI_EVT_DISCONNECTED:
+      p_ctx->forecast_connected = false;
+      break;
+
+    case ACI_EVT_DATA_CREDIT:
+      if ((0 != aci_stat->data_credit_available) || (0 == aci_evt->params.data_credit.credit))
+      {
+        break;
+      }
+      sample = (int16_t)aci_evt->params.data_credit.credit * 16;
+      if (0 == p_ctx->forecast_rate)
+      {
+        p_ctx->forecast_rate = (uint8_t)((sample > 0xFF) ? 0xFF : sample);
+      }
+      else
+      {
+        sample = p_ctx->forecast_rate + ((sample - p_ctx->forecast_rate) >> LIB_ACI_FORECAST_SHIFT);
+        p_ctx->forecast_rate = (uint8_t)((sample > 0xFF) ? 0xFF : ((sample < 1) ? 1 : sample));
+      }
+      break;
+
+    default:
+      break;
+  }
 }
 
+/* Credits back per connection event in 1/16, the measure or one per slave latency + 1 events */
+static uint16_t lib_aci_forecast_rate(aci_state_t *aci_stat)
+{
+  if (0 != lib_aci_cur->forecast_rate)
+  {
+    return lib_aci_cur->forecast_rate;
+  }
+  return (aci_stat->slave_latency < 16) ? (uint16_t)(16 / (aci_stat->slave_latency + 1)) : 1;
+}
 
-bool lib_aci_test(aci_test_mode_change_t enter_exit_test_mode)
+void lib_aci_throughput_get(aci_state_t *aci_stat, lib_aci_throughput_t *p_throughput)
 {
-  aci_cmd_params_test_t aci_cmd_params_test;
-  aci_cmd_params_test.test_mode_change = enter_exit_test_mode;
-  acil_encode_cmd_set_test_mode(&(msg_to_send.buffer[0]), &aci_cmd_params_test);
-  return hal_aci_tl_send(&msg_to_send);
+  uint32_t packets_per_s;
+  uint16_t rate;
+
+  lib_aci_select(aci_stat);
+  memset(p_throughput, 0, sizeof(*p_throughput));
+  if (!lib_aci_cur->forecast_connected || (0 == aci_stat->connection_interval))
+  {
+    return;
+  }
+
+  // 800 connection events per second at an interval of 1 (1.25 ms), 50 packets at 1/16 credit
+  rate          = lib_aci_forecast_rate(aci_stat);
+  packets_per_s = ((uint32_t)rate * 50) / aci_stat->connection_interval;
+
+  p_throughput->packets_per_s     = (packets_per_s > 0xFFFF) ? 0xFFFF : (uint16_t)packets_per_s;
+  p_throughput->bytes_per_s       = packets_per_s * ACI_PIPE_TX_DATA_MAX_LEN;
+  p_throughput->credits_per_event = (uint8_t)rate;
+  p_throughput->measured          = (0 != lib_aci_cur->forecast_rate);
 }
 
+uint32_t lib_aci_credit_wait_ms(aci_state_t *aci_stat, uint8_t credits)
+{
+  uint32_t missing;
+  uint32_t events;
 
-bool lib_aci_sleep()
+  lib_aci_select(aci_stat);
+  if (credits <= aci_stat->data_credit_available)
+  {
+    return 0;
+  }
+  if (!lib_aci_cur->forecast_connected || (credits > aci_stat->data_credit_total) ||
+      (0 == aci_stat->connection_interval))
+  {
+    return 0xFFFFFFFF;
+  }
+
+  missing = (uint32_t)(credits - aci_stat->data_credit_available) * 16;
+  events  = (missing + lib_aci_forecast_rate(aci_stat) - 1) / lib_aci_forecast_rate(aci_stat);
+  return (events * aci_stat->connection_interval * 5 + 3) / 4;
+}
+#endif
+
+/* Command and event queues of the default configuration, ACI_QUEUE_SIZE 4 */
+#define LIB_ACI_DEFAULT_QUEUE_BYTES  (2 * 4 * ACI_QUEUE_ENTRY_MAX)
+
+void lib_aci_ram_get(aci_state_t *aci_stat, lib_aci_ram_t *p_ram)
 {
-  acil_encode_cmd_sleep(&(msg_to_send.buffer[0]));
-  return hal_aci_tl_send(&msg_to_send);
+  const uint16_t pipe_map = aci_stat->aci_setup_info.number_of_pipes * sizeof(services_pipe_type_mapping_t);
+
+  p_ram->transport = hal_aci_tl_ram_bytes();
+  p_ram->library   = sizeof(lib_aci_ctx) + sizeof(lib_aci_evt);
+  p_ram->setup     = aci_setup_ram_bytes();
+  p_ram->state     = sizeof(aci_state_t);
+#if ACI_LOW_MEMORY
+  p_ram->pipe_map  = 0;
+  p_ram->saved     = pipe_map + sizeof(hal_aci_evt_t);
+#if ((ACI_TX_QUEUE_BYTES + ACI_RX_QUEUE_BYTES) < LIB_ACI_DEFAULT_QUEUE_BYTES)
+  p_ram->saved    += HAL_ACI_INSTANCES * (LIB_ACI_DEFAULT_QUEUE_BYTES - (ACI_TX_QUEUE_BYTES + ACI_RX_QUEUE_BYTES));
+#endif
+#else
+  p_ram->pipe_map  = pipe_map;
+  p_ram->saved     = 0;
+#endif
+  p_ram->total     = p_ram->transport + p_ram->library + p_ram->setup + p_ram->state + p_ram->pipe_map;
 }
 
+#if ACI_LOW_MEMORY
+hal_aci_evt_t *lib_aci_event_buffer(void)
+{
+  return &lib_aci_evt;
+}
+#endif
+
+#if LIB_ACI_CREDIT_TRACKING
+#if ACI_TX_ISR_QUEUE_BYTES
+/* The interrupts take credits too, the loop changes the count with them disabled */
+#define LIB_ACI_CREDIT_LOCK()    noInterrupts()
+#define LIB_ACI_CREDIT_UNLOCK()  interrupts()
+#else
+#define LIB_ACI_CREDIT_LOCK()
+#define LIB_ACI_CREDIT_UNLOCK()
+#endif
+
+static void lib_aci_credit_return(aci_state_t *aci_stat, uint8_t credits);
+#if LIB_ACI_RETRANSMIT_SLOTS
+static hal_aci_data_t *lib_aci_retransmit_reserve(uint8_t cmd_opcode);
+static uint8_t lib_aci_retransmit_keep(void);
+static void lib_aci_retransmit_queued(uint8_t index);
+#endif
 
-bool lib_aci_radio_reset()
+/*
+  Data commands use one data credit of the nRF8001 each and are encoded straight into the
+  command queue. No slot is given when all the credits are in use, they come back with
+  ACI_EVT_DATA_CREDIT.
+*/
+static hal_aci_data_t *lib_aci_data_cmd_reserve(aci_state_t *aci_stat, uint8_t cmd_opcode)
+{
+  if (0 == aci_stat->data_credit_available)
+  {
+    return NULL;
+  }
+
+#if LIB_ACI_RETRANSMIT_SLOTS
+  return lib_aci_retransmit_reserve(cmd_opcode);
+#else
+  return hal_aci_tl_send_reserve(cmd_opcode);
+#endif
+}
+
+#if ACI_TX_ISR_QUEUE_BYTES
+static bool lib_aci_data_cmd_commit(aci_state_t *aci_stat)
+{
+  // An interrupt may have taken the last credit since the slot was reserved
+  LIB_ACI_CREDIT_LOCK();
+  if (0 == aci_stat->data_credit_available)
+  {
+    LIB_ACI_CREDIT_UNLOCK();
+    return false;
+  }
+  aci_stat->data_credit_available--;
+  LIB_ACI_CREDIT_UNLOCK();
+
+  if (!hal_aci_tl_send_commit())
+  {
+    lib_aci_credit_return(aci_stat, 1);
+    return false;
+  }
+  lib_aci_link_starve(aci_stat);
+  return true;
+}
+#else
+static bool lib_aci_data_cmd_commit(aci_state_t *aci_stat)
+{
+#if LIB_ACI_RETRANSMIT_SLOTS
+  // Copied out of the queue slot before the transport may send it
+  const uint8_t index = lib_aci_retransmit_keep();
+#endif
+
+  if (!hal_aci_tl_send_commit())
+  {
+    return false;
+  }
+
+  aci_stat->data_credit_available--;
+#if LIB_ACI_RETRANSMIT_SLOTS
+  lib_aci_retransmit_queued(index);
+#endif
+  lib_aci_link_starve(aci_stat);
+  return true;
+}
+#endif
+
+/*
+  Credits given back by the nRF8001, never more than it started with.
+*/
+static void lib_aci_credit_return(aci_state_t *aci_stat, uint8_t credits)
+{
+  uint16_t available;
+
+  LIB_ACI_CREDIT_LOCK();
+  available = (uint16_t)aci_stat->data_credit_available + credits;
+  if ((0 != aci_stat->data_credit_total) && (available > aci_stat->data_credit_total))
+  {
+    available = aci_stat->data_credit_total;
+  }
+  aci_stat->data_credit_available = (uint8_t)available;
+  LIB_ACI_CREDIT_UNLOCK();
+}
+#else
+#define lib_aci_data_cmd_reserve(aci_stat, cmd_opcode)  hal_aci_tl_send_reserve(cmd_opcode)
+#define lib_aci_data_cmd_commit(aci_stat)               hal_aci_tl_send_commit()
+#endif
+
+#if LIB_ACI_RETRANSMIT_SLOTS
+/*
+  The pool mirrors the credits in use: every data command queued takes a slot, the credits that
+  come back free the oldest ones in flight and a pipe error takes the one it was marked with.
+*/
+static uint8_t lib_aci_retransmit_find(uint8_t state, uint8_t pipe)
+{
+  const lib_aci_retransmit_slot_t *p_slot;
+  uint8_t                          found = LIB_ACI_RETRANSMIT_SLOTS;
+  uint8_t                          i;
+
+  for (i = 0; i < LIB_ACI_RETRANSMIT_SLOTS; i++)
+  {
+    p_slot = &lib_aci_cur->retransmit[i];
+    if ((state != p_slot->state) || ((0 != pipe) && (pipe != p_slot->pipe)))
+    {
+      continue;
+    }
+    if ((LIB_ACI_RETRANSMIT_FREE == state) || (LIB_ACI_RETRANSMIT_SLOTS == found) ||
+        ((int8_t)(p_slot->seq - lib_aci_cur->retransmit[found].seq) < 0))
+    {
+      found = i;
+    }
+    if (LIB_ACI_RETRANSMIT_FREE == state)
+    {
+      break;
+    }
+  }
+  return found;
+}
+
+static uint8_t lib_aci_retransmit_waiting(uint8_t pipe)
+{
+  uint8_t count = 0;
+  uint8_t i;
+
+  for (i = 0; i < LIB_ACI_RETRANSMIT_SLOTS; i++)
+  {
+    if ((LIB_ACI_RETRANSMIT_WAITING == lib_aci_cur->retransmit[i].state) &&
+        ((0 == pipe) || (pipe == lib_aci_cur->retransmit[i].pipe)))
+    {
+      count++;
+    }
+  }
+  return count;
+}
+
+static void lib_aci_retransmit_drop(lib_aci_retransmit_slot_t *p_slot)
+{
+  p_slot->state = LIB_ACI_RETRANSMIT_FREE;
+  if (lib_aci_cur->retransmit_stats.dropped < 0xFFFF)
+  {
+    lib_aci_cur->retransmit_stats.dropped++;
+  }
+}
+
+/*
+  Empties the pool, the credits are all back. The packets waiting are lost when counted.
+*/
+static void lib_aci_retransmit_clear(bool counted)
+{
+  lib_aci_ctx_t *p_ctx = lib_aci_cur;
+  uint8_t        i;
+
+  for (i = 0; i < LIB_ACI_RETRANSMIT_SLOTS; i++)
+  {
+    if (counted && (LIB_ACI_RETRANSMIT_WAITING == p_ctx->retransmit[i].state))
+    {
+      lib_aci_retransmit_drop(&p_ctx->retransmit[i]);
+    }
+    p_ctx->retransmit[i].state = LIB_ACI_RETRANSMIT_FREE;
+  }
+  p_ctx->retransmit_resend = LIB_ACI_RETRANSMIT_SLOTS;
+}
+
+/*
+  A new data command needs a free slot, the packet sent again already has its own.
+*/
+static hal_aci_data_t *lib_aci_retransmit_reserve(uint8_t cmd_opcode)
+{
+  lib_aci_ctx_t *p_ctx = lib_aci_cur;
+
+  if ((LIB_ACI_RETRANSMIT_SLOTS == p_ctx->retransmit_resend) &&
+      (LIB_ACI_RETRANSMIT_SLOTS == lib_aci_retransmit_find(LIB_ACI_RETRANSMIT_FREE, 0)))
+  {
+    if (p_ctx->retransmit_stats.refused < 0xFFFF)
+    {
+      p_ctx->retransmit_stats.refused++;
+    }
+    return NULL;
+  }
+
+  p_ctx->retransmit_cmd = hal_aci_tl_send_reserve(cmd_opcode);
+  return p_ctx->retransmit_cmd;
+}
+
+/*
+  Copies the data command reserved last into its slot, the state is set once it is queued.
+*/
+static uint8_t lib_aci_retransmit_keep(void)
+{
+  lib_aci_ctx_t             *p_ctx = lib_aci_cur;
+  const uint8_t             *p_cmd = &p_ctx->retransmit_cmd->buffer[0];
+  lib_aci_retransmit_slot_t *p_slot;
+  uint8_t                    index = p_ctx->retransmit_resend;
+
+  if (LIB_ACI_RETRANSMIT_SLOTS != index)
+  {
+    p_ctx->retransmit[index].number = hal_aci_tl_data_queued();
+    return index;
+  }
+
+  index = lib_aci_retransmit_find(LIB_ACI_RETRANSMIT_FREE, 0);
+  if (LIB_ACI_RETRANSMIT_SLOTS != index)
+  {
+    p_slot         = &p_ctx->retransmit[index];
+    p_slot->number = hal_aci_tl_data_queued();
+    p_slot->opcode = p_cmd[1];
+    p_slot->pipe   = p_cmd[2];   // Pipe number of every data command
+    p_slot->tries  = 0;
+    p_slot->length = 0;
+    if ((ACI_CMD_SEND_DATA == p_cmd[1]) && (p_cmd[0] >= 2))
+    {
+      p_slot->length = p_cmd[0] - 2;
+      memcpy(&p_slot->data[0], &p_cmd[3], p_slot->length);
+    }
+  }
+  return index;
+}
+
+static void lib_aci_retransmit_queued(uint8_t index)
+{
+  if (LIB_ACI_RETRANSMIT_SLOTS != index)
+  {
+    lib_aci_cur->retransmit[index].state = LIB_ACI_RETRANSMIT_IN_FLIGHT;
+    lib_aci_cur->retransmit[index].seq   = lib_aci_cur->retransmit_seq++;
+  }
+}
+
+static void lib_aci_retransmit_credit(uint8_t credits)
+{
+  lib_aci_retransmit_slot_t *p_slot;
+  uint8_t                    index;
+
+  while (0 != credits--)
+  {
+    index = lib_aci_retransmit_find(LIB_ACI_RETRANSMIT_IN_FLIGHT, 0);
+    if (LIB_ACI_RETRANSMIT_SLOTS == index)
+    {
+      return;
+    }
+    p_slot        = &lib_aci_cur->retransmit[index];
+    p_slot->state = LIB_ACI_RETRANSMIT_FREE;
+    if ((0 != p_slot->tries) && (lib_aci_cur->retransmit_stats.recovered < 0xFFFF))
+    {
+      lib_aci_cur->retransmit_stats.recovered++;
+    }
+  }
+}
+
+/*
+  The packet a pipe error is for: the SendData the transport marked it with, none when that one
+  was not sent from the pool. Without a mark, the oldest data command of the pipe in flight.
+*/
+static uint8_t lib_aci_retransmit_failed(uint8_t pipe)
+{
+  const lib_aci_retransmit_slot_t *p_slot;
+  uint8_t                          number;
+  uint8_t                          i;
+
+  if (hal_aci_tl_data_mark_take(&number))
+  {
+    for (i = 0; i < LIB_ACI_RETRANSMIT_SLOTS; i++)
+    {
+      p_slot = &lib_aci_cur->retransmit[i];
+      if ((LIB_ACI_RETRANSMIT_IN_FLIGHT == p_slot->state) && (ACI_CMD_SEND_DATA == p_slot->opcode) &&
+          (pipe == p_slot->pipe) && (number == p_slot->number))
+      {
+        return i;
+      }
+    }
+    return LIB_ACI_RETRANSMIT_SLOTS;
+  }
+  return lib_aci_retransmit_find(LIB_ACI_RETRANSMIT_IN_FLIGHT, pipe);
+}
+
+/*
+  The errors that go away on their own: the nRF8001 had no buffer, was busy, or the pipe was not
+  open yet. The Attribute protocol errors of the peer do not take the credit back.
+*/
+static void lib_aci_retransmit_error(const aci_evt_params_pipe_error_t *p_error)
+{
+  lib_aci_retransmit_slot_t *p_slot;
+  // Each pipe error takes its mark, in order
+  const uint8_t              index = lib_aci_retransmit_failed(p_error->pipe_number);
+
+  if ((ACI_STATUS_ERROR_PEER_ATT_ERROR == p_error->error_code) || (LIB_ACI_RETRANSMIT_SLOTS == index))
+  {
+    return;
+  }
+
+  p_slot = &lib_aci_cur->retransmit[index];
+  if (ACI_CMD_SEND_DATA != p_slot->opcode)
+  {
+    p_slot->state = LIB_ACI_RETRANSMIT_FREE;
+    return;
+  }
+  if (((ACI_STATUS_ERROR_CREDIT_NOT_AVAILABLE != p_error->error_code) &&
+       (ACI_STATUS_ERROR_BUSY != p_error->error_code) &&
+       (ACI_STATUS_ERROR_PIPE_STATE_INVALID != p_error->error_code)) ||
+      (LIB_ACI_RETRANSMIT_TRIES == p_slot->tries))
+  {
+    lib_aci_retransmit_drop(p_slot);
+    return;
+  }
+  p_slot->state    = LIB_ACI_RETRANSMIT_WAITING;
+  p_slot->error_ms = (uint8_t)millis();
+}
+
+static void lib_aci_retransmit_event(const aci_evt_t *aci_evt)
+{
+  switch (aci_evt->evt_opcode)
+  {
+    case ACI_EVT_DATA_CREDIT:
+      lib_aci_retransmit_credit(aci_evt->params.data_credit.credit);
+      break;
+
+    case ACI_EVT_PIPE_ERROR:
+      lib_aci_retransmit_error(&aci_evt->params.pipe_error);
+      break;
+
+    case ACI_EVT_DISCONNECTED:
+    case ACI_EVT_DEVICE_STARTED:
+      lib_aci_retransmit_clear(true);
+      break;
+
+    default:
+      break;
+  }
+}
+
+/*
+  Sends the oldest packet waiting again, once LIB_ACI_RETRANSMIT_INTERVAL_MS have passed since
+  its error and there is a credit for it. Called from the loop by lib_aci_event_get().
+*/
+static void lib_aci_retransmit_poll(aci_state_t *aci_stat)
+{
+  lib_aci_ctx_t             *p_ctx = lib_aci_cur;
+  lib_aci_retransmit_slot_t *p_slot;
+  hal_aci_data_t            *p_cmd;
+  const uint8_t              index = lib_aci_retransmit_find(LIB_ACI_RETRANSMIT_WAITING, 0);
+
+  if (LIB_ACI_RETRANSMIT_SLOTS == index)
+  {
+    return;
+  }
+  p_slot = &p_ctx->retransmit[index];
+  if ((uint8_t)((uint8_t)millis() - p_slot->error_ms) < LIB_ACI_RETRANSMIT_INTERVAL_MS)
+  {
+    return;
+  }
+#if LIB_ACI_ACK_WINDOW
+  if (lib_aci_pipe_in(p_slot->pipe, LIB_ACI_PIPES_TX_ACK) && (LIB_ACI_ACK_WINDOW == p_ctx->ack_count))
+  {
+    return;
+  }
+#endif
+
+  p_ctx->retransmit_resend = index;
+  p_cmd = lib_aci_data_cmd_reserve(aci_stat, ACI_CMD_SEND_DATA);
+  if (NULL != p_cmd)
+  {
+    acil_encode_cmd_send_data_raw(&p_cmd->buffer[0], p_slot->pipe, &p_slot->data[0], p_slot->length);
+    if (lib_aci_data_cmd_commit(aci_stat))
+    {
+      p_slot->tries++;
+      if (p_ctx->retransmit_stats.retries < 0xFFFF)
+      {
+        p_ctx->retransmit_stats.retries++;
+      }
+#if LIB_ACI_ACK_WINDOW
+      if (lib_aci_pipe_in(p_slot->pipe, LIB_ACI_PIPES_TX_ACK))
+      {
+        p_ctx->ack_pipes[p_ctx->ack_count++] = p_slot->pipe;
+        aci_stat->confirmation_pending       = true;
+      }
+#endif
+    }
+  }
+  p_ctx->retransmit_resend = LIB_ACI_RETRANSMIT_SLOTS;
+}
+
+uint8_t lib_aci_retransmit_pending(aci_state_t *aci_stat, uint8_t pipe)
+{
+  lib_aci_select(aci_stat);
+
+  return lib_aci_retransmit_waiting(pipe);
+}
+
+void lib_aci_retransmit_stats_get(aci_state_t *aci_stat, lib_aci_retransmit_stats_t *p_stats)
+{
+  lib_aci_select(aci_stat);
+
+  *p_stats = lib_aci_cur->retransmit_stats;
+}
+#else
+#define lib_aci_retransmit_poll(aci_stat)
+#endif
+
+#if LIB_ACI_SHADOW_PIPES
+static lib_aci_shadow_t *lib_aci_shadow_find(uint8_t pipe)
+{
+  uint8_t i;
+
+  for (i = 0; i < LIB_ACI_SHADOW_PIPES; i++)
+  {
+    if (pipe == lib_aci_cur->shadows[i].pipe)
+    {
+      return &lib_aci_cur->shadows[i];
+    }
+  }
+  return NULL;
+}
+
+static uint32_t lib_aci_shadow_number(const uint8_t *p_value, uint8_t size)
+{
+  uint32_t number = 0;
+
+  while (0 != size)
+  {
+    size--;
+    number = (number << 8) | p_value[size];
+  }
+  return number;
+}
+
+/*
+  True when the value needs not be sent, being the last one sent on the pipe or within its deadband.
+*/
+static bool lib_aci_shadow_unchanged(uint8_t pipe, const uint8_t *p_value, uint8_t size)
+{
+  lib_aci_shadow_t *p_shadow = lib_aci_shadow_find(pipe);
+  uint32_t last;
+  uint32_t next;
+
+  if ((NULL == p_shadow) || (0 == size) || (size != p_shadow->length))
+  {
+    return false;
+  }
+
+  if (size <= 4)
+  {
+    last = lib_aci_shadow_number(&p_shadow->value[0], size);
+    next = lib_aci_shadow_number(p_value, size);
+    if (((next > last) ? (next - last) : (last - next)) >= ((0 == p_shadow->deadband) ? 1 : p_shadow->deadband))
+    {
+      return false;
+    }
+  }
+  else if (0 != memcmp(&p_shadow->value[0], p_value, size))
+  {
+    return false;
+  }
+
+  lib_aci_cur->shadow_suppressed++;
+  return true;
+}
+
+static void lib_aci_shadow_store(uint8_t pipe, const uint8_t *p_value, uint8_t size)
+{
+  lib_aci_shadow_t *p_shadow = lib_aci_shadow_find(pipe);
+
+  if (NULL == p_shadow)
+  {
+    return;
+  }
+
+  p_shadow->length = (size > LIB_ACI_SHADOW_VALUE_MAX) ? 0 : size;
+  memcpy(&p_shadow->value[0], p_value, p_shadow->length);
+}
+
+/*
+  The restarted nRF8001 has the values of the setup, the TX values are sent again to the next peer or
+  when the pipe opens again.
+*/
+static void lib_aci_shadow_event(aci_state_t *aci_stat, const aci_evt_t *aci_evt)
+{
+  lib_aci_shadow_t *p_shadow;
+  uint8_t i;
+
+  for (i = 0; i < LIB_ACI_SHADOW_PIPES; i++)
+  {
+    p_shadow = &lib_aci_cur->shadows[i];
+    if (0 == p_shadow->pipe)
+    {
+      continue;
+    }
+
+    switch (aci_evt->evt_opcode)
+    {
+      case ACI_EVT_DEVICE_STARTED:
+        p_shadow->length = 0;
+        break;
+
+      case ACI_EVT_DISCONNECTED:
+      case ACI_EVT_PIPE_STATUS:
+        if ((ACI_SET != lib_aci_pipe_type(p_shadow->pipe)) &&
+            !lib_aci_is_pipe_available(aci_stat, p_shadow->pipe))
+        {
+          p_shadow->length = 0;
+        }
+        break;
+
+      case ACI_EVT_PIPE_ERROR:
+        if (p_shadow->pipe == aci_evt->params.pipe_error.pipe_number)
+        {
+          p_shadow->length = 0;
+        }
+        break;
+
+      default:
+        break;
+    }
+  }
+}
+
+bool lib_aci_shadow_enable(aci_state_t *aci_stat, uint8_t pipe, uint16_t deadband)
+{
+  lib_aci_shadow_t *p_shadow;
+  aci_pipe_type_t   pipe_type;
+
+  lib_aci_select(aci_stat);
+
+  if ((0 == pipe) || (pipe > ACI_DEVICE_MAX_PIPES))
+  {
+    return false;
+  }
+  pipe_type = lib_aci_pipe_type(pipe);
+  if ((ACI_SET != pipe_type) && (ACI_TX != pipe_type) && (ACI_TX_ACK != pipe_type))
+  {
+    return false;
+  }
+
+  p_shadow = lib_aci_shadow_find(pipe);
+  if (NULL == p_shadow)
+  {
+    p_shadow = lib_aci_shadow_find(0);
+    if (NULL == p_shadow)
+    {
+      return false;
+    }
+    p_shadow->pipe   = pipe;
+    p_shadow->length = 0;
+  }
+  p_shadow->deadband = deadband;
+  return true;
+}
+
+void lib_aci_shadow_invalidate(aci_state_t *aci_stat, uint8_t pipe)
+{
+  uint8_t i;
+
+  lib_aci_select(aci_stat);
+
+  for (i = 0; i < LIB_ACI_SHADOW_PIPES; i++)
+  {
+    if ((0 == pipe) || (pipe == lib_aci_cur->shadows[i].pipe))
+    {
+      lib_aci_cur->shadows[i].length = 0;
+    }
+  }
+}
+
+uint16_t lib_aci_shadow_suppressed(aci_state_t *aci_stat)
+{
+  lib_aci_select(aci_stat);
+
+  return lib_aci_cur->shadow_suppressed;
+}
+#else
+#define lib_aci_shadow_unchanged(pipe, p_value, size)  false
+#define lib_aci_shadow_store(pipe, p_value, size)
+#endif
+
+#if LIB_ACI_STAGED_VALUES
+/*
+  Queues the staged values in order, until one does not fit in the command queue. The entries left
+  are moved to the front, so the order is kept. Used in Standby, before the commands that
+  advertise, which do not have the state of the ACI.
+*/
+static bool lib_aci_staged_send(void)
+{
+  lib_aci_staged_t *p_staged = &lib_aci_cur->staged[0];
+  aci_cmd_params_set_local_data_t aci_cmd_params_set_local_data;
+  hal_aci_data_t *p_cmd;
+  uint8_t sent;
+  uint8_t i;
+
+  for (sent = 0; (sent < LIB_ACI_STAGED_VALUES) && (0 != p_staged[sent].pipe); sent++)
+  {
+    p_cmd = lib_aci_cmd_buffer(ACI_CMD_SET_LOCAL_DATA);
+    if (NULL == p_cmd)
+    {
+      break;
+    }
+    aci_cmd_params_set_local_data.tx_data.pipe_number = p_staged[sent].pipe;
+    memcpy(&(aci_cmd_params_set_local_data.tx_data.aci_data[0]), &p_staged[sent].value[0], p_staged[sent].length);
+    acil_encode_cmd_set_local_data(&(p_cmd->buffer[0]), &aci_cmd_params_set_local_data, p_staged[sent].length);
+    if (!lib_aci_cmd_send(p_cmd))
+    {
+      break;
+    }
+    lib_aci_shadow_store(p_staged[sent].pipe, &p_staged[sent].value[0], p_staged[sent].length);
+  }
+
+  for (i = 0; i < LIB_ACI_STAGED_VALUES; i++)
+  {
+    if ((i + sent) < LIB_ACI_STAGED_VALUES)
+    {
+      p_staged[i] = p_staged[i + sent];
+    }
+    else
+    {
+      p_staged[i].pipe = 0;
+    }
+  }
+  return (0 == p_staged[0].pipe);
+}
+
+/*
+  The setup is done, or the nRF8001 came back from a reset or a sleep: the values go before the
+  application advertises.
+*/
+static void lib_aci_staged_event(const aci_evt_t *aci_evt)
+{
+  if ((ACI_EVT_DEVICE_STARTED == aci_evt->evt_opcode) &&
+      (ACI_DEVICE_STANDBY == aci_evt->params.device_started.device_mode))
+  {
+    lib_aci_staged_send();
+  }
+}
+
+bool lib_aci_stage_local_data(aci_state_t *aci_stat, uint8_t pipe, const uint8_t *p_value, uint8_t size)
+{
+  lib_aci_staged_t *p_staged = NULL;
+  uint8_t i;
+
+  lib_aci_select(aci_stat);
+
+  if (!lib_aci_pipe_in(pipe, LIB_ACI_PIPES_LOCAL) || (size > ACI_PIPE_TX_DATA_MAX_LEN))
+  {
+    return false;
+  }
+
+  // The entry of the pipe, or the first free one
+  for (i = 0; (i < LIB_ACI_STAGED_VALUES) && (NULL == p_staged); i++)
+  {
+    if ((pipe == lib_aci_cur->staged[i].pipe) || (0 == lib_aci_cur->staged[i].pipe))
+    {
+      p_staged = &lib_aci_cur->staged[i];
+    }
+  }
+  if (NULL == p_staged)
+  {
+    return false;
+  }
+
+  p_staged->pipe   = pipe;
+  p_staged->length = size;
+  memcpy(&p_staged->value[0], p_value, size);
+  return true;
+}
+
+bool lib_aci_stage_flush(aci_state_t *aci_stat)
+{
+  lib_aci_select(aci_stat);
+
+  return lib_aci_staged_send();
+}
+#else
+#define lib_aci_staged_send()  do { } while (0)
+#endif
+
+bool lib_aci_is_pipe_available(aci_state_t *aci_stat, uint8_t pipe)
+{
+  uint8_t byte_idx;
+
+  byte_idx = pipe / 8;
+  if (aci_stat->pipes_open_bitmap[byte_idx] & (0x01 << (pipe % 8)))
+  {
+    return(true);
+  }
+  return(false);
+}
+
+
+bool lib_aci_is_pipe_closed(aci_state_t *aci_stat, uint8_t pipe)
+{
+  uint8_t byte_idx;
+
+  byte_idx = pipe / 8;
+  if (aci_stat->pipes_closed_bitmap[byte_idx] & (0x01 << (pipe % 8)))
+  {
+    return(true);
+  }
+  return(false);
+}
+
+
+bool lib_aci_is_discovery_finished(aci_state_t *aci_stat)
+{
+  return(aci_stat->pipes_open_bitmap[0]&0x01);
+}
+
+void lib_aci_pipes_add(uint8_t *p_pipes, uint8_t pipe)
+{
+  if (pipe <= ACI_DEVICE_MAX_PIPES)
+  {
+    p_pipes[pipe / 8] |= (uint8_t)(0x01 << (pipe % 8));
+  }
+}
+
+bool lib_aci_pipes_all_open(aci_state_t *aci_stat, const uint8_t *p_pipes)
+{
+  uint8_t i;
+
+  for (i = 0; i < PIPES_ARRAY_SIZE; i++)
+  {
+    if (p_pipes[i] & (uint8_t)~aci_stat->pipes_open_bitmap[i])
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+  Puts a Device Started event in the event queue, as the nRF8001 would after a pin reset.
+*/
+static void lib_aci_device_started_inject(uint8_t device_mode, uint8_t credits)
+{
+  hal_aci_data_t event;
+
+  event.buffer[0] = 4;                       //Length
+  event.buffer[1] = ACI_EVT_DEVICE_STARTED;
+  event.buffer[2] = device_mode;
+  event.buffer[3] = 0;                       //Hardware Error -> None
+  event.buffer[4] = credits;                 //Data Credit Available
+  hal_aci_tl_event_inject(&event);
+}
+
+/*
+  Waits for the command response of the radio reset command sent by the board init,
+  as the nRF8001 will be in either SETUP or STANDBY after the ACI Reset Radio is processed.
+  Handles at most one event, returns true once the command response has been handled.
+*/
+static bool lib_aci_board_init_event(aci_state_t *aci_stat)
+{
+	hal_aci_evt_t *aci_data = NULL;
+	aci_data = &lib_aci_evt;
+
+	if (true == lib_aci_event_get(aci_stat, aci_data))
+	{
+	  aci_evt_t * aci_evt;
+	  aci_evt = &(aci_data->evt);
+
+	  if (ACI_EVT_CMD_RSP == aci_evt->evt_opcode)
+	  {
+			if (ACI_STATUS_ERROR_DEVICE_STATE_INVALID == aci_evt->params.cmd_rsp.cmd_status) //in SETUP
+			{
+				//Inject a Device Started Event Setup to the ACI Event Queue
+				lib_aci_device_started_inject(ACI_DEVICE_SETUP, 2);
+			}
+			else if (ACI_STATUS_SUCCESS == aci_evt->params.cmd_rsp.cmd_status) //We are now in STANDBY
+			{
+				//Inject a Device Started Event Standby to the ACI Event Queue
+				lib_aci_device_started_inject(ACI_DEVICE_STANDBY, 2);
+			}
+			else if (ACI_STATUS_ERROR_CMD_UNKNOWN == aci_evt->params.cmd_rsp.cmd_status) //We are now in TEST
+			{
+				//Inject a Device Started Event Test to the ACI Event Queue
+				lib_aci_device_started_inject(ACI_DEVICE_TEST, 0);
+			}
+
+			return true;
+	  }
+	  else
+	  {
+		ACI_LOG_TRACE(ACI_LOG_ID_BOARD_INIT_DISCARD, aci_evt->evt_opcode);
+	  }
+	}
+
+	return false;
+}
+
+void lib_aci_board_init(aci_state_t *aci_stat)
+{
+	ACI_LOG_TRACE(ACI_LOG_ID_BOARD_INIT, aci_stat->aci_pins.board_name);
+	if (REDBEARLAB_SHIELD_V1_1 == aci_stat->aci_pins.board_name)
+	{
+	  /*
+	  The Bluetooth low energy Arduino shield v1.1 requires about 100ms to reset.
+	  This is not required for the nRF2740, nRF2741 modules
+	  */
+	  delay(100);
+  
+	  /*
+	  Send the soft reset command to the nRF8001 to get the nRF8001 to a known state.
+	  */
+	  lib_aci_radio_reset();
+  
+	  while (!lib_aci_board_init_event(aci_stat))
+	  {
+	  }
+	}
+}
+
+#if LIB_ACI_SPI_CALIBRATION
+/*
+  Waits for an event of the SPI clock calibration, the other events are discarded.
+  The events are taken from the transport, the ACI Library state does not see them.
+*/
+static bool lib_aci_calibration_event_wait(uint8_t evt_opcode, hal_aci_evt_t *p_aci_data)
+{
+  const uint32_t start_ms = millis();
+
+  while ((millis() - start_ms) < LIB_ACI_CALIBRATION_TIMEOUT_MS)
+  {
+    if (hal_aci_tl_event_get((hal_aci_data_t *)p_aci_data) && (evt_opcode == p_aci_data->evt.evt_opcode))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+  Sends the echoes at the current SPI clock, true when all of them come back intact.
+  The pattern changes with each echo so each bit of the data sees both levels.
+*/
+static bool lib_aci_calibration_echoes(hal_aci_evt_t *p_aci_data)
+{
+  uint8_t pattern[ACI_ECHO_DATA_MAX_LEN];
+  uint8_t echo;
+  uint8_t i;
+
+  for (echo = 0; echo < LIB_ACI_SPI_CALIBRATION_ECHOES; echo++)
+  {
+    for (i = 0; i < ACI_ECHO_DATA_MAX_LEN; i++)
+    {
+      pattern[i] = (uint8_t)((i * 0x3B) + (echo * 0x95));
+    }
+    if (!lib_aci_echo_msg(ACI_ECHO_DATA_MAX_LEN, pattern) ||
+        !lib_aci_calibration_event_wait(ACI_EVT_ECHO, p_aci_data))
+    {
+      return false;
+    }
+    if (((ACI_ECHO_DATA_MAX_LEN + 1) != p_aci_data->evt.len) ||
+        (0 != memcmp(p_aci_data->evt.params.echo.echo_data, pattern, ACI_ECHO_DATA_MAX_LEN)))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+  Steps the SPI clock down from the fastest divider within 3MHz to the one of the sketch, in Test
+  mode, and keeps the first one that passes the echoes. The Device Started the nRF8001 came up with
+  is swallowed, leaving Test mode sends the one the sketch gets. When the nRF8001 was in Test
+  mode already, or does not enter it, the Device Started is put back as it was.
+*/
+static void lib_aci_spi_calibrate(aci_state_t *aci_stat)
+{
+  hal_aci_evt_t  aci_data;
+  hal_aci_evt_t  device_started;
+  const uint8_t  sketch_divider = aci_stat->aci_pins.spi_clock_divider;
+  uint8_t        divider        = sketch_divider;
+  uint8_t        index;
+
+  if (!lib_aci_calibration_event_wait(ACI_EVT_DEVICE_STARTED, &device_started))
+  {
+    return;
+  }
+
+  if (ACI_DEVICE_TEST != device_started.evt.params.device_started.device_mode)
+  {
+    if (!lib_aci_test(ACI_TEST_MODE_DTM_UART) ||
+        !lib_aci_calibration_event_wait(ACI_EVT_DEVICE_STARTED, &aci_data) ||
+        (ACI_DEVICE_TEST != aci_data.evt.params.device_started.device_mode))
+    {
+      hal_aci_tl_event_inject((hal_aci_data_t *)&device_started);
+      return;
+    }
+  }
+
+  for (index = 0; hal_aci_tl_spi_clock_divider(index, &divider); index++)
+  {
+    hal_aci_tl_spi_clock_set(divider);
+    if (lib_aci_calibration_echoes(&aci_data) || (sketch_divider == divider))
+    {
+      break;
+    }
+    // An echo mangled at this clock may still be on its way, it is dropped before stepping down
+    while (lib_aci_calibration_event_wait(ACI_EVT_ECHO, &aci_data))
+    {
+    }
+    hal_aci_tl_q_flush();
+  }
+  if (!hal_aci_tl_spi_clock_divider(index, &divider))
+  {
+    // The divider of the sketch is not one of the core, it is kept
+    hal_aci_tl_spi_clock_set(sketch_divider);
+  }
+
+  if (ACI_DEVICE_TEST == device_started.evt.params.device_started.device_mode)
+  {
+    hal_aci_tl_event_inject((hal_aci_data_t *)&device_started);
+  }
+  else
+  {
+    lib_aci_test(ACI_TEST_MODE_EXIT);
+  }
+}
+#endif
+
+/*
+  Resets the ACI Library state, common to the blocking and the non-blocking initialization.
+*/
+static void lib_aci_state_init(aci_state_t *aci_stat)
+{
+  uint8_t i;
+
+  for (i = 0; i < PIPES_ARRAY_SIZE; i++)
+  {
+    aci_stat->pipes_open_bitmap[i]          = 0;
+    aci_stat->pipes_closed_bitmap[i]        = 0;
+#if ACI_FEATURE_BROADCAST
+    lib_aci_cur->aci_cmd_params_open_adv_pipe.pipes[i]   = 0;
+#endif
+  }
+
+  lib_aci_cur->is_request_operation_pending     = false;
+  lib_aci_cur->is_indicate_operation_pending    = false; 
+  lib_aci_cur->is_open_remote_pipe_pending      = false;
+  lib_aci_cur->is_close_remote_pipe_pending     = false;
+
+  lib_aci_cur->request_operation_pipe           = 0;
+  lib_aci_cur->indicate_operation_pipe          = 0;
+
+  lib_aci_cur->p_services_pipe_type_map = aci_stat->aci_setup_info.services_pipe_type_mapping;
+  
+  lib_aci_cur->p_setup_msgs             = aci_stat->aci_setup_info.setup_msgs;
+#if LIB_ACI_PIPE_BITMAPS
+  lib_aci_pipe_bitmaps_init(aci_stat);
+#endif
+#if LIB_ACI_CREDIT_TRACKING
+  lib_aci_cur->p_aci_stat               = aci_stat;
+#endif
+#if LIB_ACI_STREAM_BYTES
+  lib_aci_cur->stream_head              = 0;
+  lib_aci_cur->stream_count             = 0;
+#endif
+#if LIB_ACI_RETRANSMIT_SLOTS
+  lib_aci_retransmit_clear(false);
+  memset(&lib_aci_cur->retransmit_stats, 0, sizeof(lib_aci_cur->retransmit_stats));
+#endif
+#if LIB_ACI_ADV_SCHEDULE
+  // The schedule stays set
+  lib_aci_cur->adv_phase                = LIB_ACI_ADV_IDLE;
+  lib_aci_cur->adv_pending              = false;
+  lib_aci_cur->adv_stopping             = false;
+  lib_aci_cur->adv_connected            = false;
+#endif
+#if LIB_ACI_TRANSACTION_CMDS
+  lib_aci_cur->transaction_state        = LIB_ACI_TRANSACTION_IDLE;
+#endif
+#if LIB_ACI_SHADOW_PIPES
+  // The pipes stay enabled, their values are forgotten
+  for (i = 0; i < LIB_ACI_SHADOW_PIPES; i++)
+  {
+    lib_aci_cur->shadows[i].length = 0;
+  }
+#endif
+}
+
+void lib_aci_init(aci_state_t *aci_stat, bool debug)
+{
+#if ACI_SETUP_RETAIN
+  /* A retained setup is resumed by the steps of the non-blocking initialization */
+  lib_aci_init_start(aci_stat, debug);
+  while (!lib_aci_init_poll(aci_stat))
+  {
+  }
+#else
+  lib_aci_select(aci_stat);
+
+#if LIB_ACI_STARTUP_PROFILE
+  lib_aci_profile_start();
+#endif
+  lib_aci_state_init(aci_stat);
+  
+  hal_aci_tl_init(&aci_stat->aci_pins, debug);
+  LIB_ACI_PROFILE_MARK(reset_us);
+  
+  lib_aci_board_init(aci_stat);
+#if LIB_ACI_SPI_CALIBRATION
+  lib_aci_spi_calibrate(aci_stat);
+#endif
+  LIB_ACI_PROFILE_MARK(board_init_us);
+#endif
+}
+
+void lib_aci_init_start(aci_state_t *aci_stat, bool debug)
+{
+  lib_aci_select(aci_stat);
+#if LIB_ACI_STARTUP_PROFILE
+  lib_aci_profile_start();
+#endif
+
+  lib_aci_state_init(aci_stat);
+
+#if ACI_SETUP_RETAIN
+  lib_aci_cur->init_debug = debug;
+  if (aci_setup_is_retained(aci_stat))
+  {
+    /* The nRF8001 may still hold this setup, a pin reset would lose it */
+    hal_aci_tl_init_resume(&aci_stat->aci_pins, debug);
+    lib_aci_cur->init_step = LIB_ACI_INIT_TRANSPORT;
+    return;
+  }
+#endif
+  hal_aci_tl_init_start(&aci_stat->aci_pins, debug);
+
+  lib_aci_cur->init_step = LIB_ACI_INIT_TRANSPORT;
+}
+
+#if ACI_SETUP_RETAIN
+/*
+  Waits for the command response of the radio reset sent to an nRF8001 that was not pin reset.
+  It is in STANDBY when it still holds the setup, anything else and the nRF8001 gets a pin reset
+  and the usual initialization. Handles at most one event, returns true once done either way.
+*/
+static bool lib_aci_resume_event(aci_state_t *aci_stat)
+{
+  hal_aci_evt_t *aci_data = &lib_aci_evt;
+  bool           resumed  = false;
+
+  if (lib_aci_event_get(aci_stat, aci_data))
+  {
+    if (ACI_EVT_CMD_RSP != aci_data->evt.evt_opcode)
+    {
+      //Events of the link the nRF8001 had before the radio reset are discarded
+      return false;
+    }
+    resumed = ((ACI_CMD_RADIO_RESET == aci_data->evt.params.cmd_rsp.cmd_opcode) &&
+               (ACI_STATUS_SUCCESS  == aci_data->evt.params.cmd_rsp.cmd_status));
+  }
+  else if ((millis() - lib_aci_cur->init_time_ms) < LIB_ACI_RESUME_TIMEOUT_MS)
+  {
+    return false;
+  }
+
+  if (resumed)
+  {
+    //Inject a Device Started Event Standby to the ACI Event Queue
+    lib_aci_device_started_inject(ACI_DEVICE_STANDBY, 2);
+    lib_aci_cur->init_step = LIB_ACI_INIT_DONE;
+  }
+  else
+  {
+    aci_setup_retain_clear(aci_stat);
+    hal_aci_tl_init_start(&aci_stat->aci_pins, lib_aci_cur->init_debug);
+    lib_aci_cur->init_step = LIB_ACI_INIT_TRANSPORT;
+  }
+  return true;
+}
+#endif
+
+#if (HAL_ACI_INSTANCES > 1)
+void lib_aci_select(aci_state_t *aci_stat)
+{
+  hal_aci_tl_select(aci_stat->aci_pins.instance);
+}
+#endif
+
+bool lib_aci_init_poll(aci_state_t *aci_stat)
+{
+  lib_aci_select(aci_stat);
+
+  switch (lib_aci_cur->init_step)
+  {
+    case LIB_ACI_INIT_TRANSPORT:
+      if (!hal_aci_tl_init_poll())
+      {
+        break;
+      }
+      LIB_ACI_PROFILE_MARK(reset_us);
+#if ACI_SETUP_RETAIN
+      if (aci_setup_is_retained(aci_stat))
+      {
+        /* The nRF8001 was not pin reset, the radio reset tells whether it still holds the setup */
+        lib_aci_radio_reset();
+        lib_aci_cur->init_time_ms = millis();
+        lib_aci_cur->init_step = LIB_ACI_INIT_RESUME_RESP_WAIT;
+        break;
+      }
+#endif
+      if (REDBEARLAB_SHIELD_V1_1 != aci_stat->aci_pins.board_name)
+      {
+        lib_aci_cur->init_step = LIB_ACI_INIT_DONE;
+        break;
+      }
+      /* The Bluetooth low energy Arduino shield v1.1 requires about 100ms to reset */
+      lib_aci_cur->init_time_ms = millis();
+      lib_aci_cur->init_step = LIB_ACI_INIT_BOARD_RESET_WAIT;
+      break;
+
+    case LIB_ACI_INIT_BOARD_RESET_WAIT:
+      if ((millis() - lib_aci_cur->init_time_ms) < 100)
+      {
+        break;
+      }
+      /* Send the soft reset command to the nRF8001 to get the nRF8001 to a known state */
+      lib_aci_radio_reset();
+      lib_aci_cur->init_step = LIB_ACI_INIT_BOARD_RESP_WAIT;
+      break;
+
+    case LIB_ACI_INIT_BOARD_RESP_WAIT:
+      if (lib_aci_board_init_event(aci_stat))
+      {
+        lib_aci_cur->init_step = LIB_ACI_INIT_DONE;
+      }
+      break;
+
+#if ACI_SETUP_RETAIN
+    case LIB_ACI_INIT_RESUME_RESP_WAIT:
+      lib_aci_resume_event(aci_stat);
+      break;
+#endif
+
+    case LIB_ACI_INIT_DONE:
+      break;
+  }
+
+  if (LIB_ACI_INIT_DONE != lib_aci_cur->init_step)
+  {
+    return false;
+  }
+  LIB_ACI_PROFILE_MARK(board_init_us);
+  return true;
+}
+
+
+
+uint8_t lib_aci_get_nb_available_credits(aci_state_t *aci_stat)
+{
+  return aci_stat->data_credit_available;
+}
+
+uint16_t lib_aci_get_cx_interval_ms(aci_state_t *aci_stat)
+{
+  uint32_t cx_rf_interval_ms_32bits;
+  uint16_t cx_rf_interval_ms;
+  
+  cx_rf_interval_ms_32bits  = aci_stat->connection_interval;
+  cx_rf_interval_ms_32bits *= 125;                      // the connection interval is given in multiples of 0.125 milliseconds
+  cx_rf_interval_ms         = cx_rf_interval_ms_32bits / 100;
+  
+  return cx_rf_interval_ms;
+}
+
+
+uint16_t lib_aci_get_cx_interval(aci_state_t *aci_stat)
+{
+  return aci_stat->connection_interval;
+}
+
+
+uint16_t lib_aci_get_slave_latency(aci_state_t *aci_stat)
+{
+  return aci_stat->slave_latency;
+}
+
+
+bool lib_aci_set_app_latency(uint16_t latency, aci_app_latency_mode_t latency_mode)
+{
+  hal_aci_data_t *p_cmd;
+  aci_cmd_params_set_app_latency_t aci_set_app_latency;
+  
+  aci_set_app_latency.mode    = latency_mode;
+  aci_set_app_latency.latency = latency;  
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_SET_APP_LATENCY);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_set_app_latency(&(p_cmd->buffer[0]), &aci_set_app_latency);
+  
+  return lib_aci_cmd_send(p_cmd);
+}
+
+
+bool lib_aci_test(aci_test_mode_change_t enter_exit_test_mode)
+{
+  hal_aci_data_t *p_cmd;
+  aci_cmd_params_test_t aci_cmd_params_test;
+  aci_cmd_params_test.test_mode_change = enter_exit_test_mode;
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_TEST);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_set_test_mode(&(p_cmd->buffer[0]), &aci_cmd_params_test);
+  return lib_aci_cmd_send(p_cmd);
+}
+
+
+bool lib_aci_sleep()
+{
+  hal_aci_data_t *p_cmd;
+
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_SLEEP);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_sleep(&(p_cmd->buffer[0]));
+#if LIB_ACI_AUTO_WAKEUP
+  if (!lib_aci_cmd_send(p_cmd))
+  {
+    return false;
+  }
+  lib_aci_cur->asleep = true;
+  return true;
+#else
+  return lib_aci_cmd_send(p_cmd);
+#endif
+}
+
+
+bool lib_aci_radio_reset()
+{
+  hal_aci_data_t *p_cmd;
+
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_RADIO_RESET);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_baseband_reset(&(p_cmd->buffer[0]));
+  return lib_aci_cmd_send(p_cmd);
+}
+
+
+bool lib_aci_direct_connect()
+{
+  hal_aci_data_t *p_cmd;
+
+  lib_aci_staged_send();
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_CONNECT_DIRECT);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_direct_connect(&(p_cmd->buffer[0]));
+  return lib_aci_cmd_send(p_cmd);
+}
+
+
+#if ACI_FEATURE_DEVICE_INFO
+bool lib_aci_device_version()
+{
+  hal_aci_data_t *p_cmd;
+
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_GET_DEVICE_VERSION);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_get_device_version(&(p_cmd->buffer[0]));
+  return lib_aci_cmd_send(p_cmd);
+}
+#endif
+
+
+/*
+  Encodes and queues a SetLocalData, from PROGMEM when progmem. The value is copied once, into the
+  parameters, and the shadow looks at that copy.
+*/
+static bool lib_aci_local_data_send(aci_state_t *aci_stat, uint8_t pipe, const uint8_t *p_value, uint8_t size, bool progmem)
+{
+  aci_cmd_params_set_local_data_t aci_cmd_params_set_local_data;
+  uint8_t *p_data = &aci_cmd_params_set_local_data.tx_data.aci_data[0];
+#if LIB_ACI_COALESCE_LOCAL_DATA
+  hal_aci_data_t  local_data_cmd;  // Matched against the queued commands before it is queued
+  hal_aci_data_t *p_cmd = &local_data_cmd;
+#else
+  hal_aci_data_t *p_cmd;
+#endif
+  bool queued;
+
+  lib_aci_select(aci_stat);
+
+  if (progmem)
+  {
+    memcpy_P(p_data, p_value, size);
+  }
+  else
+  {
+    memcpy(p_data, p_value, size);
+  }
+  if (lib_aci_shadow_unchanged(pipe, p_data, size))
+  {
+    return true;
+  }
+
+  aci_cmd_params_set_local_data.tx_data.pipe_number = pipe;
+#if LIB_ACI_COALESCE_LOCAL_DATA
+  acil_encode_cmd_set_local_data(&(p_cmd->buffer[0]), &aci_cmd_params_set_local_data, size);
+#if LIB_ACI_TRANSACTION_CMDS
+  // Merged into a queued command it would have no response of its own to track
+  if (LIB_ACI_TRANSACTION_BUILDING == lib_aci_cur->transaction_state)
+  {
+    queued = hal_aci_tl_send(p_cmd);
+    lib_aci_transaction_add(ACI_CMD_SET_LOCAL_DATA, queued);
+  }
+  else
+#endif
+  {
+    // Same length, opcode and pipe number
+    queued = hal_aci_tl_send_coalesce(p_cmd, OFFSET_ACI_CMD_T_SET_LOCAL_DATA + 1);
+  }
+#else
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_SET_LOCAL_DATA);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_set_local_data(&(p_cmd->buffer[0]), &aci_cmd_params_set_local_data, size);
+  queued = lib_aci_cmd_send(p_cmd);
+#endif
+  if (queued)
+  {
+    lib_aci_shadow_store(pipe, p_data, size);
+  }
+  return queued;
+}
+
+bool lib_aci_set_local_data(aci_state_t *aci_stat, uint8_t pipe, uint8_t *p_value, uint8_t size)
+{
+  lib_aci_select(aci_stat);
+
+  if (!lib_aci_pipe_in(pipe, LIB_ACI_PIPES_LOCAL) || (size > ACI_PIPE_TX_DATA_MAX_LEN))
+  {
+    return false;
+  }
+  return lib_aci_set_local_data_unchecked(aci_stat, pipe, p_value, size);
+}
+
+bool lib_aci_set_local_data_unchecked(aci_state_t *aci_stat, uint8_t pipe, const uint8_t *p_value, uint8_t size)
+{
+  return lib_aci_local_data_send(aci_stat, pipe, p_value, size, false);
+}
+
+bool lib_aci_set_local_data_P(aci_state_t *aci_stat, uint8_t pipe, const uint8_t *p_value_P, uint8_t size)
+{
+  lib_aci_select(aci_stat);
+
+  if (!lib_aci_pipe_in(pipe, LIB_ACI_PIPES_LOCAL) || (size > ACI_PIPE_TX_DATA_MAX_LEN))
+  {
+    return false;
+  }
+  return lib_aci_local_data_send(aci_stat, pipe, p_value_P, size, true);
+}
+
+bool lib_aci_connect(uint16_t run_timeout, uint16_t adv_interval)
+{
+  hal_aci_data_t *p_cmd;
+  aci_cmd_params_connect_t aci_cmd_params_connect;
+  aci_cmd_params_connect.timeout      = run_timeout;
+  aci_cmd_params_connect.adv_interval = adv_interval;
+  lib_aci_staged_send();
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_CONNECT);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_connect(&(p_cmd->buffer[0]), &aci_cmd_params_connect);
+  return lib_aci_cmd_send(p_cmd);
+}
+
+
+bool lib_aci_disconnect(aci_state_t *aci_stat, aci_disconnect_reason_t reason)
+{
+  hal_aci_data_t *p_cmd;
+  bool ret_val;
+  uint8_t i;
+  aci_cmd_params_disconnect_t aci_cmd_params_disconnect;
+
+  lib_aci_select(aci_stat);
+  aci_cmd_params_disconnect.reason = reason;
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_DISCONNECT);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_disconnect(&(p_cmd->buffer[0]), &aci_cmd_params_disconnect);
+  ret_val = lib_aci_cmd_send(p_cmd);
+  // If we have actually sent the disconnect
+  if (ret_val)
+  {
+    // Update pipes immediately so that while the disconnect is happening,
+    // the application can't attempt sending another message
+    // If the application sends another message before we updated this
+    //    a ACI Pipe Error Event will be received from nRF8001
+    for (i=0; i < PIPES_ARRAY_SIZE; i++)
+    {
+      aci_stat->pipes_open_bitmap[i] = 0;
+      aci_stat->pipes_closed_bitmap[i] = 0;
+    }
+  }
+  return ret_val;
+}
+
+
+#if ACI_FEATURE_SECURITY
+bool lib_aci_bond(uint16_t run_timeout, uint16_t adv_interval)
+{
+  hal_aci_data_t *p_cmd;
+  aci_cmd_params_bond_t aci_cmd_params_bond;
+  aci_cmd_params_bond.timeout = run_timeout;
+  aci_cmd_params_bond.adv_interval = adv_interval;
+  lib_aci_staged_send();
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_BOND);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_bond(&(p_cmd->buffer[0]), &aci_cmd_params_bond);
+  return lib_aci_cmd_send(p_cmd);
+}
+#endif
+
+
+#if LIB_ACI_ADV_SCHEDULE
+/*
+  Sends the Connect, or the Bond, of the phase of the schedule. Sent again after the next event
+  when it does not fit in the command queue.
+*/
+static bool lib_aci_adv_send(aci_state_t *aci_stat)
+{
+  lib_aci_ctx_t *p_ctx = lib_aci_cur;
+  const lib_aci_adv_schedule_t *p_schedule = &p_ctx->adv_schedule;
+  const bool fast = (LIB_ACI_ADV_FAST == p_ctx->adv_phase);
+  const uint16_t timeout_s = fast ? p_schedule->fast_timeout_s : p_schedule->slow_timeout_s;
+  const uint16_t interval  = fast ? p_schedule->fast_interval  : p_schedule->slow_interval;
+  bool sent;
+
+#if ACI_FEATURE_SECURITY
+  if (p_schedule->bond && (ACI_BOND_STATUS_SUCCESS != aci_stat->bonded))
+  {
+    sent = lib_aci_bond(timeout_s, interval);
+  }
+  else
+#else
+  (void)aci_stat;
+#endif
+  {
+    sent = lib_aci_connect(timeout_s, interval);
+  }
+  p_ctx->adv_pending = !sent;
+  return sent;
+}
+
+static void lib_aci_adv_phase_start(aci_state_t *aci_stat, uint8_t phase)
+{
+  lib_aci_cur->adv_phase    = phase;
+  lib_aci_cur->adv_stopping = false;
+  lib_aci_adv_send(aci_stat);
+}
+
+/*
+  Goes from the fast to the slow advertising when it times out, and back to the fast one on the
+  Device Started in Standby and a link loss.
+*/
+static void lib_aci_adv_event(aci_state_t *aci_stat, const aci_evt_t *aci_evt)
+{
+  lib_aci_ctx_t *p_ctx = lib_aci_cur;
+
+  switch (aci_evt->evt_opcode)
+  {
+    case ACI_EVT_CONNECTED:
+      p_ctx->adv_connected = true;
+      break;
+
+    case ACI_EVT_DEVICE_STARTED:
+    case ACI_EVT_DISCONNECTED:
+      p_ctx->adv_connected = false;
+      break;
+
+    default:
+      break;
+  }
+  if (!p_ctx->adv_scheduled)
+  {
+    return;
+  }
+
+  if (p_ctx->adv_pending && (LIB_ACI_ADV_IDLE != p_ctx->adv_phase))
+  {
+    lib_aci_adv_send(aci_stat);
+  }
+
+  switch (aci_evt->evt_opcode)
+  {
+    case ACI_EVT_DEVICE_STARTED:
+      p_ctx->adv_phase    = LIB_ACI_ADV_IDLE;
+      p_ctx->adv_pending  = false;
+      p_ctx->adv_stopping = false;
+      if ((ACI_DEVICE_STANDBY == aci_evt->params.device_started.device_mode) && p_ctx->adv_schedule.restart)
+      {
+        lib_aci_adv_phase_start(aci_stat, LIB_ACI_ADV_FAST);
+      }
+      break;
+
+    case ACI_EVT_CONNECTED:
+      p_ctx->adv_phase   = LIB_ACI_ADV_IDLE;
+      p_ctx->adv_pending = false;
+      break;
+
+    case ACI_EVT_DISCONNECTED:
+      if (p_ctx->adv_stopping)
+      {
+        lib_aci_adv_phase_start(aci_stat, LIB_ACI_ADV_FAST);
+      }
+      else if (ACI_STATUS_ERROR_ADVT_TIMEOUT == aci_evt->params.disconnected.aci_status)
+      {
+        if (LIB_ACI_ADV_FAST == p_ctx->adv_phase)
+        {
+          lib_aci_adv_phase_start(aci_stat, LIB_ACI_ADV_SLOW);
+        }
+        else
+        {
+          p_ctx->adv_phase = LIB_ACI_ADV_IDLE;
+        }
+      }
+      else if (p_ctx->adv_schedule.restart)
+      {
+        lib_aci_adv_phase_start(aci_stat, LIB_ACI_ADV_FAST);
+      }
+      break;
+
+    case ACI_EVT_CMD_RSP:
+      if (ACI_STATUS_SUCCESS == aci_evt->params.cmd_rsp.cmd_status)
+      {
+        break;
+      }
+      if ((ACI_CMD_CONNECT == aci_evt->params.cmd_rsp.cmd_opcode) ||
+          (ACI_CMD_BOND    == aci_evt->params.cmd_rsp.cmd_opcode))
+      {
+        // Refused, the sketch is advertising or connected already
+        p_ctx->adv_phase = LIB_ACI_ADV_IDLE;
+      }
+      else if (ACI_CMD_DISCONNECT == aci_evt->params.cmd_rsp.cmd_opcode)
+      {
+        // The slow advertising ended before the Disconnect
+        p_ctx->adv_stopping = false;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+void lib_aci_adv_schedule_set(aci_state_t *aci_stat, const lib_aci_adv_schedule_t *p_schedule)
+{
+  lib_aci_ctx_t *p_ctx;
+
+  lib_aci_select(aci_stat);
+  p_ctx = lib_aci_cur;
+
+  p_ctx->adv_scheduled = (NULL != p_schedule);
+  if (NULL != p_schedule)
+  {
+    p_ctx->adv_schedule = *p_schedule;
+  }
+  else
+  {
+    p_ctx->adv_phase    = LIB_ACI_ADV_IDLE;
+    p_ctx->adv_pending  = false;
+    p_ctx->adv_stopping = false;
+  }
+}
+
+bool lib_aci_adv_schedule_start(aci_state_t *aci_stat)
+{
+  lib_aci_ctx_t *p_ctx;
+
+  lib_aci_select(aci_stat);
+  p_ctx = lib_aci_cur;
+
+  if (!p_ctx->adv_scheduled || p_ctx->adv_connected)
+  {
+    return false;
+  }
+  if (LIB_ACI_ADV_FAST == p_ctx->adv_phase)
+  {
+    return true;
+  }
+  if (LIB_ACI_ADV_SLOW == p_ctx->adv_phase)
+  {
+    if (!p_ctx->adv_stopping)
+    {
+      p_ctx->adv_stopping = lib_aci_disconnect(aci_stat, ACI_REASON_TERMINATE);
+    }
+    return p_ctx->adv_stopping;
+  }
+
+  p_ctx->adv_phase = LIB_ACI_ADV_FAST;
+  if (!lib_aci_adv_send(aci_stat))
+  {
+    p_ctx->adv_phase   = LIB_ACI_ADV_IDLE;
+    p_ctx->adv_pending = false;
+    return false;
+  }
+  return true;
+}
+
+uint8_t lib_aci_adv_schedule_phase(aci_state_t *aci_stat)
+{
+  lib_aci_select(aci_stat);
+  return lib_aci_cur->adv_phase;
+}
+#endif
+
+
+bool lib_aci_wakeup()
+{
+  hal_aci_data_t *p_cmd;
+
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_WAKEUP);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_wakeup(&(p_cmd->buffer[0]));
+#if LIB_ACI_AUTO_WAKEUP
+  if (!lib_aci_cmd_send(p_cmd))
+  {
+    return false;
+  }
+  lib_aci_cur->asleep = false;
+  return true;
+#else
+  return lib_aci_cmd_send(p_cmd);
+#endif
+}
+
+
+bool lib_aci_set_tx_power(aci_device_output_power_t tx_power)
+{
+  hal_aci_data_t *p_cmd;
+  aci_cmd_params_set_tx_power_t aci_cmd_params_set_tx_power;
+  aci_cmd_params_set_tx_power.device_power = tx_power;
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_SET_TX_POWER);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_set_radio_tx_power(&(p_cmd->buffer[0]), &aci_cmd_params_set_tx_power);
+  return lib_aci_cmd_send(p_cmd);
+}
+
+
+#if ACI_FEATURE_DEVICE_INFO
+bool lib_aci_get_address()
+{
+  hal_aci_data_t *p_cmd;
+
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_GET_DEVICE_ADDRESS);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_get_address(&(p_cmd->buffer[0]));
+  return lib_aci_cmd_send(p_cmd);
+}
+
+
+bool lib_aci_get_temperature()
+{
+  hal_aci_data_t *p_cmd;
+
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_GET_TEMPERATURE);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_temparature(&(p_cmd->buffer[0]));
+  return lib_aci_cmd_send(p_cmd);
+}
+
+
+bool lib_aci_get_battery_level()
+{
+  hal_aci_data_t *p_cmd;
+
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_GET_BATTERY_LEVEL);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_battery_level(&(p_cmd->buffer[0]));
+  return lib_aci_cmd_send(p_cmd);
+}
+#endif
+
+
+#if LIB_ACI_ACK_WINDOW
+uint8_t lib_aci_ack_in_flight(aci_state_t *aci_stat, uint8_t pipe)
+{
+  lib_aci_ctx_t *p_ctx;
+  uint8_t count = 0;
+  uint8_t i;
+
+  lib_aci_select(aci_stat);
+  p_ctx = lib_aci_cur;
+
+  if (0 == pipe)
+  {
+    return p_ctx->ack_count;
+  }
+  for (i = 0; i < p_ctx->ack_count; i++)
+  {
+    if (pipe == p_ctx->ack_pipes[i])
+    {
+      count++;
+    }
+  }
+  return count;
+}
+
+/*
+  The oldest packet in flight on the pipe has been acknowledged, or has failed.
+*/
+static void lib_aci_ack_done(aci_state_t *aci_stat, uint8_t pipe)
+{
+  lib_aci_ctx_t *p_ctx = lib_aci_cur;
+  uint8_t i;
+
+  for (i = 0; i < p_ctx->ack_count; i++)
+  {
+    if (pipe == p_ctx->ack_pipes[i])
+    {
+      p_ctx->ack_count--;
+      memmove(&p_ctx->ack_pipes[i], &p_ctx->ack_pipes[i + 1], p_ctx->ack_count - i);
+      break;
+    }
+  }
+  aci_stat->confirmation_pending = (0 != p_ctx->ack_count);
+}
+#endif
+
+/*
+  Encodes a SendData into the command queue, from PROGMEM when progmem. A value from PROGMEM is
+  compared with the shadow once it is in the slot, a slot reserved and not committed is reused.
+*/
+static bool lib_aci_data_send(uint8_t pipe, const uint8_t *p_value, uint8_t size, bool progmem)
+{
+  hal_aci_data_t *p_slot;
+
+#if LIB_ACI_RETRANSMIT_SLOTS
+  // Behind the packet of the pipe waiting to be sent again
+  if (0 != lib_aci_retransmit_waiting(pipe))
+  {
+    return false;
+  }
+#endif
+  if (!progmem && lib_aci_shadow_unchanged(pipe, p_value, size))
+  {
+    return true;
+  }
+
+  // The payload is copied once, from p_value into the command queue
+  p_slot = lib_aci_data_cmd_reserve(lib_aci_cur->p_aci_stat, ACI_CMD_SEND_DATA);
+  if (NULL == p_slot)
+  {
+    return false;
+  }
+  if (progmem)
+  {
+    acil_encode_cmd_send_data_raw_P(&(p_slot->buffer[0]), pipe, p_value, size);
+    p_value = &p_slot->buffer[OFFSET_ACI_CMD_T_SEND_DATA + OFFSET_ACI_CMD_PARAMS_SEND_DATA_T_TX_DATA +
+                              OFFSET_ACI_TX_DATA_T_ACI_DATA];
+    if (lib_aci_shadow_unchanged(pipe, p_value, size))
+    {
+      return true;
+    }
+  }
+  else
+  {
+    acil_encode_cmd_send_data_raw(&(p_slot->buffer[0]), pipe, p_value, size);
+  }
+
+#if LIB_ACI_ACK_WINDOW
+  if (lib_aci_pipe_in(pipe, LIB_ACI_PIPES_TX_ACK))
+  {
+    // Nothing is queued when the window is full, the slot is reused by the next command
+    if ((LIB_ACI_ACK_WINDOW == lib_aci_cur->ack_count) || !lib_aci_data_cmd_commit(lib_aci_cur->p_aci_stat))
+    {
+      return false;
+    }
+    lib_aci_cur->ack_pipes[lib_aci_cur->ack_count++] = pipe;
+    lib_aci_cur->p_aci_stat->confirmation_pending    = true;
+    lib_aci_shadow_store(pipe, p_value, size);
+    return true;
+  }
+#endif
+
+  if (!lib_aci_data_cmd_commit(lib_aci_cur->p_aci_stat))
+  {
+    return false;
+  }
+  lib_aci_shadow_store(pipe, p_value, size);
+  return true;
+}
+
+bool lib_aci_send_data(uint8_t pipe, uint8_t *p_value, uint8_t size)
+{
+  if (!lib_aci_pipe_in(pipe, LIB_ACI_PIPES_SEND))
+  {
+    return false;
+  }
+
+  if (size > ACI_PIPE_TX_DATA_MAX_LEN)
+  {
+    return false;
+  }
+  return lib_aci_send_data_unchecked(pipe, p_value, size);
+}
+
+bool lib_aci_send_data_unchecked(uint8_t pipe, const uint8_t *p_value, uint8_t size)
+{
+  return lib_aci_data_send(pipe, p_value, size, false);
+}
+
+bool lib_aci_send_data_P(uint8_t pipe, const uint8_t *p_value_P, uint8_t size)
+{
+  if (!lib_aci_pipe_in(pipe, LIB_ACI_PIPES_SEND) || (size > ACI_PIPE_TX_DATA_MAX_LEN))
+  {
+    return false;
+  }
+  return lib_aci_data_send(pipe, p_value_P, size, true);
+}
+
+#if ACI_TX_ISR_QUEUE_BYTES
+/*
+  Queues a command encoded by an interrupt, and takes its credit for a SendData. The interrupt runs
+  with the others disabled, the loop only changes the credits with the interrupts disabled.
+*/
+static bool lib_aci_isr_cmd_send(aci_state_t *aci_stat, hal_aci_data_t *p_cmd)
+{
+#if LIB_ACI_AUTO_WAKEUP
+  if (lib_aci_cur->asleep)
+  {
+    return false;
+  }
+#endif
+#if LIB_ACI_CREDIT_TRACKING
+  if (ACI_CMD_SEND_DATA == p_cmd->buffer[1])
+  {
+    if ((0 == aci_stat->data_credit_available) || !hal_aci_tl_send_from_isr(p_cmd))
+    {
+      return false;
+    }
+    aci_stat->data_credit_available--;
+    return true;
+  }
+#else
+  (void)aci_stat;
+#endif
+  return hal_aci_tl_send_from_isr(p_cmd);
+}
+
+bool lib_aci_send_data_from_isr(aci_state_t *aci_stat, uint8_t pipe, const uint8_t *p_value, uint8_t size)
+{
+  const uint8_t  selected = hal_aci_tl_selected();
+  hal_aci_data_t cmd;  // The command queue belongs to the loop
+  bool           queued = false;
+
+  lib_aci_select(aci_stat);
+
+#if LIB_ACI_ACK_WINDOW
+  // The window of acknowledged packets is kept by the loop
+  if (lib_aci_pipe_in(pipe, LIB_ACI_PIPES_SEND) && !lib_aci_pipe_in(pipe, LIB_ACI_PIPES_TX_ACK) &&
+      (size <= ACI_PIPE_TX_DATA_MAX_LEN))
+#else
+  if (lib_aci_pipe_in(pipe, LIB_ACI_PIPES_SEND) && (size <= ACI_PIPE_TX_DATA_MAX_LEN))
+#endif
+  {
+    acil_encode_cmd_send_data_raw(&cmd.buffer[0], pipe, p_value, size);
+    queued = lib_aci_isr_cmd_send(aci_stat, &cmd);
+  }
+
+  hal_aci_tl_select(selected);
+  return queued;
+}
+
+bool lib_aci_set_local_data_from_isr(aci_state_t *aci_stat, uint8_t pipe, const uint8_t *p_value, uint8_t size)
+{
+  const uint8_t                   selected = hal_aci_tl_selected();
+  aci_cmd_params_set_local_data_t aci_cmd_params_set_local_data;
+  hal_aci_data_t                  cmd;  // The command queue belongs to the loop
+  bool                            queued = false;
+
+  lib_aci_select(aci_stat);
+
+  if (lib_aci_pipe_in(pipe, LIB_ACI_PIPES_LOCAL) && (size <= ACI_PIPE_TX_DATA_MAX_LEN))
+  {
+    aci_cmd_params_set_local_data.tx_data.pipe_number = pipe;
+    memcpy(&(aci_cmd_params_set_local_data.tx_data.aci_data[0]), p_value, size);
+    acil_encode_cmd_set_local_data(&cmd.buffer[0], &aci_cmd_params_set_local_data, size);
+    queued = lib_aci_isr_cmd_send(aci_stat, &cmd);
+  }
+
+  hal_aci_tl_select(selected);
+  return queued;
+}
+#endif
+
+
+#if ACI_FEATURE_REMOTE_PIPES
+bool lib_aci_request_data(aci_state_t *aci_stat, uint8_t pipe)
+{
+  hal_aci_data_t *p_slot;
+  aci_cmd_params_request_data_t aci_cmd_params_request_data;
+
+  lib_aci_select(aci_stat);
+
+  if (!lib_aci_pipe_in(pipe, LIB_ACI_PIPES_REQ))
+  {
+    return false;
+  }
+
+
+  p_slot = lib_aci_data_cmd_reserve(aci_stat, ACI_CMD_REQUEST_DATA);
+  if (NULL == p_slot)
+  {
+    return false;
+  }
+  aci_cmd_params_request_data.pipe_number = pipe;
+  acil_encode_cmd_request_data(&(p_slot->buffer[0]), &aci_cmd_params_request_data);
+
+  return lib_aci_data_cmd_commit(aci_stat);
+}
+#endif
+
+
+bool lib_aci_change_timing(uint16_t minimun_cx_interval, uint16_t maximum_cx_interval, uint16_t slave_latency, uint16_t timeout)
+{
+  hal_aci_data_t *p_cmd;
+  aci_cmd_params_change_timing_t aci_cmd_params_change_timing;
+  aci_cmd_params_change_timing.conn_params.min_conn_interval = minimun_cx_interval;
+  aci_cmd_params_change_timing.conn_params.max_conn_interval = maximum_cx_interval;
+  aci_cmd_params_change_timing.conn_params.slave_latency     = slave_latency;    
+  aci_cmd_params_change_timing.conn_params.timeout_mult      = timeout;     
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_CHANGE_TIMING);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_change_timing_req(&(p_cmd->buffer[0]), &aci_cmd_params_change_timing);
+  return lib_aci_cmd_send(p_cmd);
+}
+
+
+bool lib_aci_change_timing_GAP_PPCP()
+{
+  hal_aci_data_t *p_cmd;
+
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_CHANGE_TIMING);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_change_timing_req_GAP_PPCP(&(p_cmd->buffer[0]));
+  return lib_aci_cmd_send(p_cmd);
+}
+
+
+bool lib_aci_send_cmd_P(const hal_aci_data_t *p_cmd_P)
+{
+  const uint8_t length = pgm_read_byte(&p_cmd_P->buffer[OFFSET_ACI_CMD_T_LEN]);
+  hal_aci_data_t *p_slot;
+
+  if (length > HAL_ACI_MAX_LENGTH)
+  {
+    return false;
+  }
+
+  p_slot = hal_aci_tl_send_reserve(pgm_read_byte(&p_cmd_P->buffer[OFFSET_ACI_CMD_T_CMD_OPCODE]));
+  if (NULL == p_slot)
+  {
+    return false;
+  }
+  memcpy_P(&p_slot->buffer[0], &p_cmd_P->buffer[0], length + 1);
+
+  return lib_aci_cmd_send(p_slot);
+}
+
+
+#if ACI_FEATURE_REMOTE_PIPES
+bool lib_aci_open_remote_pipe(aci_state_t *aci_stat, uint8_t pipe)
+{
+  hal_aci_data_t *p_cmd;
+  bool ret_val = false;
+  aci_cmd_params_open_remote_pipe_t aci_cmd_params_open_remote_pipe;
+
+  lib_aci_select(aci_stat);
+
+  if (!lib_aci_pipe_in(pipe, LIB_ACI_PIPES_REMOTE_RX))
+  {
+    return false;
+  }
+
+  
+  {
+
+    lib_aci_cur->is_request_operation_pending = true;
+    lib_aci_cur->is_open_remote_pipe_pending = true;
+    lib_aci_cur->request_operation_pipe = pipe;
+    aci_cmd_params_open_remote_pipe.pipe_number = pipe;
+    p_cmd = lib_aci_cmd_buffer(ACI_CMD_OPEN_REMOTE_PIPE);
+    if (NULL == p_cmd)
+    {
+      return false;
+    }
+    acil_encode_cmd_open_remote_pipe(&(p_cmd->buffer[0]), &aci_cmd_params_open_remote_pipe);
+    ret_val = lib_aci_cmd_send(p_cmd);
+  }
+  return ret_val;
+}
+
+
+bool lib_aci_close_remote_pipe(aci_state_t *aci_stat, uint8_t pipe)
+{
+  hal_aci_data_t *p_cmd;
+  bool ret_val = false;
+  aci_cmd_params_close_remote_pipe_t aci_cmd_params_close_remote_pipe;
+
+  lib_aci_select(aci_stat);
+
+  if (!lib_aci_pipe_in(pipe, LIB_ACI_PIPES_REMOTE_RX))
+  {
+    return false;
+  }  
+
+
+  {
+
+    lib_aci_cur->is_request_operation_pending = true;
+    lib_aci_cur->is_close_remote_pipe_pending = true;
+    lib_aci_cur->request_operation_pipe = pipe;
+    aci_cmd_params_close_remote_pipe.pipe_number = pipe;
+    p_cmd = lib_aci_cmd_buffer(ACI_CMD_CLOSE_REMOTE_PIPE);
+    if (NULL == p_cmd)
+    {
+      return false;
+    }
+    acil_encode_cmd_close_remote_pipe(&(p_cmd->buffer[0]), &aci_cmd_params_close_remote_pipe);
+    ret_val = lib_aci_cmd_send(p_cmd);
+  }
+  return ret_val;
+}
+#endif
+
+
+#if ACI_FEATURE_SECURITY
+bool lib_aci_set_key(aci_key_type_t key_rsp_type, uint8_t *key, uint8_t len)
+{
+  hal_aci_data_t *p_cmd;
+  aci_cmd_params_set_key_t aci_cmd_params_set_key;
+  aci_cmd_params_set_key.key_type = key_rsp_type;
+  memcpy((uint8_t*)&(aci_cmd_params_set_key.key), key, len);
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_SET_KEY);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_set_key(&(p_cmd->buffer[0]), &aci_cmd_params_set_key);
+  return lib_aci_cmd_send(p_cmd);
+}
+#endif
+
+
+bool lib_aci_echo_msg(uint8_t msg_size, uint8_t *p_msg_data)
+{
+  hal_aci_data_t *p_cmd;
+  aci_cmd_params_echo_t aci_cmd_params_echo;
+  if(msg_size > (ACI_ECHO_DATA_MAX_LEN))
+  {
+    return false;
+  }
+
+  if (msg_size > (ACI_ECHO_DATA_MAX_LEN))
+  {
+    msg_size = ACI_ECHO_DATA_MAX_LEN;
+  }
+
+  memcpy(&(aci_cmd_params_echo.echo_data[0]), p_msg_data, msg_size);
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_ECHO);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_echo_msg(&(p_cmd->buffer[0]), &aci_cmd_params_echo, msg_size);
+
+  return lib_aci_cmd_send(p_cmd);
+}
+
+
+#if ACI_FEATURE_SECURITY
+bool lib_aci_bond_request()
+{
+  hal_aci_data_t *p_cmd;
+
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_BOND_SECURITY_REQUEST);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_bond_security_request(&(p_cmd->buffer[0]));
+  return lib_aci_cmd_send(p_cmd);
+}
+#endif
+
+bool lib_aci_event_peek(hal_aci_evt_t *p_aci_evt_data)
+{
+  return hal_aci_tl_event_peek((hal_aci_data_t *)p_aci_evt_data);
+}
+
+#if LIB_ACI_STREAM_BYTES
+/*
+  Sends the stream data while there are credits, ACI_PIPE_TX_DATA_MAX_LEN bytes at a time.
+*/
+static void lib_aci_stream_pump(aci_state_t *aci_stat)
+{
+  lib_aci_ctx_t *p_ctx = lib_aci_cur;
+  uint8_t packet[ACI_PIPE_TX_DATA_MAX_LEN];
+  uint8_t length;
+  uint8_t first;
+
+  while ((0 != p_ctx->stream_count) &&
+         (0 != aci_stat->data_credit_available) &&
+         lib_aci_is_pipe_available(aci_stat, p_ctx->stream_pipe))
+  {
+    length = (p_ctx->stream_count > ACI_PIPE_TX_DATA_MAX_LEN) ? ACI_PIPE_TX_DATA_MAX_LEN : p_ctx->stream_count;
+
+    // The packet may wrap around the end of the ring
+    first = LIB_ACI_STREAM_BYTES - p_ctx->stream_head;
+    if (first > length)
+    {
+      first = length;
+    }
+    memcpy(&packet[0], &p_ctx->stream_buf[p_ctx->stream_head], first);
+    memcpy(&packet[first], &p_ctx->stream_buf[0], length - first);
+
+    if (!lib_aci_send_data(p_ctx->stream_pipe, &packet[0], length))
+    {
+      // The command queue is full, the next event will try again
+      break;
+    }
+
+    p_ctx->stream_head   = (uint8_t)((p_ctx->stream_head + length) % LIB_ACI_STREAM_BYTES);
+    p_ctx->stream_count -= length;
+
+    if ((0 == p_ctx->stream_count) && (NULL != p_ctx->stream_cb))
+    {
+      p_ctx->stream_cb(p_ctx->stream_pipe);
+    }
+  }
+}
+
+/*
+  Every event may bring credits back or open the pipe, a disconnect drops the stream.
+*/
+static void lib_aci_stream_event(aci_state_t *aci_stat, uint8_t evt_opcode)
+{
+  if (ACI_EVT_DISCONNECTED == evt_opcode)
+  {
+    lib_aci_cur->stream_head  = 0;
+    lib_aci_cur->stream_count = 0;
+    return;
+  }
+
+  lib_aci_stream_pump(aci_stat);
+}
+
+uint8_t lib_aci_send_stream(aci_state_t *aci_stat, uint8_t pipe, const uint8_t *p_data, uint8_t length)
+{
+  lib_aci_ctx_t *p_ctx;
+  uint8_t taken;
+  uint8_t tail;
+  uint8_t first;
+
+  lib_aci_select(aci_stat);
+  p_ctx = lib_aci_cur;
+
+  if ((0 != p_ctx->stream_count) && (pipe != p_ctx->stream_pipe))
+  {
+    return 0;
+  }
+  p_ctx->stream_pipe = pipe;
+
+  taken = LIB_ACI_STREAM_BYTES - p_ctx->stream_count;
+  if (taken > length)
+  {
+    taken = length;
+  }
+
+  tail  = (uint8_t)((p_ctx->stream_head + p_ctx->stream_count) % LIB_ACI_STREAM_BYTES);
+  first = LIB_ACI_STREAM_BYTES - tail;
+  if (first > taken)
+  {
+    first = taken;
+  }
+  memcpy(&p_ctx->stream_buf[tail], p_data, first);
+  memcpy(&p_ctx->stream_buf[0], &p_data[first], taken - first);
+  p_ctx->stream_count += taken;
+
+  lib_aci_stream_pump(aci_stat);
+
+  return taken;
+}
+
+uint8_t lib_aci_stream_pending(aci_state_t *aci_stat)
+{
+  lib_aci_select(aci_stat);
+
+  return lib_aci_cur->stream_count;
+}
+
+void lib_aci_stream_set_callback(aci_state_t *aci_stat, lib_aci_stream_cb_t stream_cb)
+{
+  lib_aci_select(aci_stat);
+
+  lib_aci_cur->stream_cb = stream_cb;
+}
+#endif
+
+#if LIB_ACI_PRODUCERS
+/* Payload of a SendData command in its queue slot */
+#define LIB_ACI_SEND_DATA_PAYLOAD  (OFFSET_ACI_CMD_T_SEND_DATA + OFFSET_ACI_CMD_PARAMS_SEND_DATA_T_TX_DATA + OFFSET_ACI_TX_DATA_T_ACI_DATA)
+
+/*
+  Asks the producers in turn for a packet while there are credits and room in the queue, the one
+  after the last producer that sent starts the next round.
+*/
+static uint8_t lib_aci_producer_pump(aci_state_t *aci_stat)
+{
+  lib_aci_ctx_t  *p_ctx  = lib_aci_cur;
+  hal_aci_data_t *p_slot;
+  uint8_t         queued = 0;
+  uint8_t         idle   = 0;   // Producers asked in a row with nothing to send
+  uint8_t         index;
+  uint8_t         pipe;
+  uint8_t         length;
+
+  while ((idle < LIB_ACI_PRODUCERS) && (0 != aci_stat->data_credit_available))
+  {
+    index                = p_ctx->producer_next;
+    p_ctx->producer_next = (uint8_t)((index + 1) % LIB_ACI_PRODUCERS);
+    pipe                 = p_ctx->producer_pipes[index];
+    idle++;
+
+    if ((0 == pipe) || !lib_aci_is_pipe_available(aci_stat, pipe))
+    {
+      continue;
+    }
+
+    p_slot = lib_aci_data_cmd_reserve(aci_stat, ACI_CMD_SEND_DATA);
+    if (NULL == p_slot)
+    {
+      // The command queue is full, the next event will try again
+      p_ctx->producer_next = index;
+      break;
+    }
+
+    length = p_ctx->producer_cbs[index](pipe, &p_slot->buffer[LIB_ACI_SEND_DATA_PAYLOAD], ACI_PIPE_TX_DATA_MAX_LEN);
+    if ((0 == length) || (length > ACI_PIPE_TX_DATA_MAX_LEN))
+    {
+      // Nothing to send, the slot is reused by the next command
+      continue;
+    }
+    p_slot->buffer[OFFSET_ACI_CMD_T_LEN]        = MSG_SEND_DATA_BASE_LEN + length;
+    p_slot->buffer[OFFSET_ACI_CMD_T_CMD_OPCODE] = ACI_CMD_SEND_DATA;
+    p_slot->buffer[OFFSET_ACI_CMD_T_SEND_DATA + OFFSET_ACI_CMD_PARAMS_SEND_DATA_T_TX_DATA + OFFSET_ACI_TX_DATA_T_PIPE_NUMBER] = pipe;
+    if (!lib_aci_data_cmd_commit(aci_stat))
+    {
+      break;
+    }
+    queued++;
+    idle = 0;
+  }
+  return queued;
+}
+
+bool lib_aci_producer_set(aci_state_t *aci_stat, uint8_t pipe, lib_aci_fill_cb_t fill_cb)
+{
+  lib_aci_ctx_t *p_ctx;
+  uint8_t        free_index = LIB_ACI_PRODUCERS;
+  uint8_t        i;
+
+  lib_aci_select(aci_stat);
+  p_ctx = lib_aci_cur;
+
+  if ((0 == pipe) || (pipe > aci_stat->aci_setup_info.number_of_pipes) || (ACI_TX != lib_aci_pipe_type(pipe)))
+  {
+    return false;
+  }
+
+  for (i = 0; i < LIB_ACI_PRODUCERS; i++)
+  {
+    if (pipe == p_ctx->producer_pipes[i])
+    {
+      free_index = i;
+      break;
+    }
+    if ((0 == p_ctx->producer_pipes[i]) && (LIB_ACI_PRODUCERS == free_index))
+    {
+      free_index = i;
+    }
+  }
+  if (NULL == fill_cb)
+  {
+    if ((LIB_ACI_PRODUCERS != free_index) && (pipe == p_ctx->producer_pipes[free_index]))
+    {
+      p_ctx->producer_pipes[free_index] = 0;
+    }
+    return true;
+  }
+  if (LIB_ACI_PRODUCERS == free_index)
+  {
+    return false;
+  }
+
+  p_ctx->producer_cbs[free_index]   = fill_cb;
+  p_ctx->producer_pipes[free_index] = pipe;
+  return true;
+}
+
+uint8_t lib_aci_producer_kick(aci_state_t *aci_stat)
+{
+  lib_aci_select(aci_stat);
+
+  return lib_aci_producer_pump(aci_stat);
+}
+#endif
+
+#if LIB_ACI_AUTO_ACK
+bool lib_aci_auto_ack_enable(aci_state_t *aci_stat, uint8_t pipe, bool enable)
+{
+  lib_aci_select(aci_stat);
+
+  if ((0 == pipe) || (pipe > ACI_DEVICE_MAX_PIPES) ||
+      (lib_aci_pipe_type(pipe) != ACI_RX_ACK))
+  {
+    return false;
+  }
+
+  if (enable)
+  {
+    lib_aci_cur->auto_ack_bitmap[pipe / 8] |= (uint8_t)(0x01 << (pipe % 8));
+  }
+  else
+  {
+    lib_aci_cur->auto_ack_bitmap[pipe / 8] &= (uint8_t)~(0x01 << (pipe % 8));
+  }
+  return true;
+}
+
+void lib_aci_auto_ack_set_check(aci_state_t *aci_stat, lib_aci_ack_check_t ack_check)
+{
+  lib_aci_select(aci_stat);
+
+  lib_aci_cur->ack_check = ack_check;
+}
+
+static bool lib_aci_auto_ack_send(aci_state_t *aci_stat, uint8_t pipe, uint8_t error_code)
+{
+  if (0 == error_code)
+  {
+    return lib_aci_send_ack(aci_stat, pipe);
+  }
+  return lib_aci_send_nack(aci_stat, pipe, error_code);
+}
+
+/*
+  Queues the answers not queued yet, lowest pipe first. The others wait for the next event once
+  one fails, they lack the same credit or room.
+*/
+static bool lib_aci_auto_ack_retry(aci_state_t *aci_stat, lib_aci_ctx_t *p_ctx)
+{
+  uint8_t i;
+  uint8_t bit;
+  uint8_t mask;
+
+  for (i = 0; i < PIPES_ARRAY_SIZE; i++)
+  {
+    for (bit = 0; (bit < 8) && (0 != p_ctx->ack_retry_bitmap[i]); bit++)
+    {
+      mask = (uint8_t)(0x01 << bit);
+      if (p_ctx->ack_retry_bitmap[i] & mask)
+      {
+        if (!lib_aci_auto_ack_send(aci_stat, (uint8_t)(i * 8 + bit),
+                                   (p_ctx->nack_retry_bitmap[i] & mask) ? p_ctx->nack_retry_error_code : 0))
+        {
+          return false;
+        }
+        p_ctx->ack_retry_bitmap[i]  &= (uint8_t)~mask;
+        p_ctx->nack_retry_bitmap[i] &= (uint8_t)~mask;
+      }
+    }
+  }
+  return true;
+}
+
+/*
+  Answers the data received on the pipes enabled by lib_aci_auto_ack_enable().
+  An answer that could not be queued, for lack of credit or room, is kept for its pipe and
+  retried on the next events. The NACKs kept share one error code: the peer waits for the
+  answer to its write before the next one, a NACK with another code is kept with the last code.
+*/
+static void lib_aci_auto_ack_event(aci_state_t *aci_stat, const aci_evt_t *aci_evt)
+{
+  lib_aci_ctx_t *p_ctx = lib_aci_cur;
+  uint8_t pipe;
+  uint8_t error_code = 0;
+  bool    retried;
+
+  if (ACI_EVT_DISCONNECTED == aci_evt->evt_opcode)
+  {
+    memset(&p_ctx->ack_retry_bitmap[0], 0, sizeof(p_ctx->ack_retry_bitmap));
+    memset(&p_ctx->nack_retry_bitmap[0], 0, sizeof(p_ctx->nack_retry_bitmap));
+    return;
+  }
+
+  retried = lib_aci_auto_ack_retry(aci_stat, p_ctx);
+
+  if (ACI_EVT_DATA_RECEIVED != aci_evt->evt_opcode)
+  {
+    return;
+  }
+
+  pipe = aci_evt->params.data_received.rx_data.pipe_number;
+  if ((pipe > ACI_DEVICE_MAX_PIPES) || !(p_ctx->auto_ack_bitmap[pipe / 8] & (0x01 << (pipe % 8))))
+  {
+    return;
+  }
+
+  // Data of a link that is gone, the answer would go to the next one
+  if (!lib_aci_is_pipe_available(aci_stat, pipe))
+  {
+    return;
+  }
+#if ACI_RX_DATA_QUEUE_BYTES
+  if (hal_aci_tl_data_is_stale())
+  {
+    return;
+  }
+#endif
+
+  if (NULL != p_ctx->ack_check)
+  {
+    error_code = p_ctx->ack_check(aci_stat, pipe, &aci_evt->params.data_received.rx_data.aci_data[0], aci_evt->len - 2);
+  }
+
+  // Not ahead of the answers still waiting, a pipe has at most one: its peer waits for it
+  if (!retried || !lib_aci_auto_ack_send(aci_stat, pipe, error_code))
+  {
+    p_ctx->ack_retry_bitmap[pipe / 8] |= (uint8_t)(0x01 << (pipe % 8));
+    if (0 != error_code)
+    {
+      p_ctx->nack_retry_bitmap[pipe / 8] |= (uint8_t)(0x01 << (pipe % 8));
+      p_ctx->nack_retry_error_code        = error_code;
+    }
+  }
+}
+#endif
+
+/*
+  Update the state of the ACI with the
+  ACI Events -> Pipe Status, Disconnected, Connected, Bond Status, Pipe Error
+  and, with LIB_ACI_CREDIT_TRACKING, Device Started and Data Credit
+*/
+#if HAL_ACI_TL_EVENT_TIME
+/*
+  The events below are clocked in right after the connection event that caused them, their RDYN
+  time is a connection event boundary the next ones are projected from.
+*/
+static void lib_aci_conn_event_anchor(const aci_evt_t *aci_evt)
 {
-  acil_encode_baseband_reset(&(msg_to_send.buffer[0]));
-  return hal_aci_tl_send(&msg_to_send);
+  switch (aci_evt->evt_opcode)
+  {
+    case ACI_EVT_CONNECTED:
+    case ACI_EVT_TIMING:
+    case ACI_EVT_DATA_CREDIT:
+    case ACI_EVT_DATA_ACK:
+    case ACI_EVT_DATA_RECEIVED:
+    case ACI_EVT_PIPE_STATUS:
+      lib_aci_cur->conn_anchor_us = hal_aci_tl_event_time_us();
+      lib_aci_cur->conn_anchored  = true;
+      break;
+
+    case ACI_EVT_DISCONNECTED:
+      lib_aci_cur->conn_anchored = false;
+      break;
+
+    default:
+      break;
+  }
 }
 
-
-bool lib_aci_direct_connect()
+uint32_t lib_aci_event_time_us(void)
 {
-  acil_encode_direct_connect(&(msg_to_send.buffer[0]));
-  return hal_aci_tl_send(&msg_to_send);
+  return hal_aci_tl_event_time_us();
 }
 
-
-bool lib_aci_device_version()
+bool lib_aci_conn_event_next(aci_state_t *aci_stat, uint32_t *p_time_us)
 {
-  acil_encode_cmd_get_device_version(&(msg_to_send.buffer[0]));
-  return hal_aci_tl_send(&msg_to_send);
-}
-
+  lib_aci_ctx_t  *p_ctx;
+  const uint32_t  interval_us = (uint32_t)aci_stat->connection_interval * 1250;
+  uint32_t        events;
 
-bool lib_aci_set_local_data(aci_state_t *aci_stat, uint8_t pipe, uint8_t *p_value, uint8_t size)
-{
-  aci_cmd_params_set_local_data_t aci_cmd_params_set_local_data;
-  
-  if ((p_services_pipe_type_map[pipe-1].location != ACI_STORE_LOCAL)
-      ||
-      (size > ACI_PIPE_TX_DATA_MAX_LEN))
+  lib_aci_select(aci_stat);
+  p_ctx = lib_aci_cur;
+  if (!p_ctx->conn_anchored || (0 == interval_us))
   {
     return false;
   }
 
-  aci_cmd_params_set_local_data.tx_data.pipe_number = pipe;
-  memcpy(&(aci_cmd_params_set_local_data.tx_data.aci_data[0]), p_value, size);
-  acil_encode_cmd_set_local_data(&(msg_to_send.buffer[0]), &aci_cmd_params_set_local_data, size);
-  return hal_aci_tl_send(&msg_to_send);
-}
+  // Move the anchor up to the last boundary, it stays in range of micros() between the events
+  events = (micros() - p_ctx->conn_anchor_us) / interval_us;
+  p_ctx->conn_anchor_us += events * interval_us;
 
-bool lib_aci_connect(uint16_t run_timeout, uint16_t adv_interval)
-{
-  aci_cmd_params_connect_t aci_cmd_params_connect;
-  aci_cmd_params_connect.timeout      = run_timeout;
-  aci_cmd_params_connect.adv_interval = adv_interval;
-  acil_encode_cmd_connect(&(msg_to_send.buffer[0]), &aci_cmd_params_connect);
-  return hal_aci_tl_send(&msg_to_send);
+  *p_time_us = p_ctx->conn_anchor_us + interval_us;
+  return true;
 }
+#endif
 
-
-bool lib_aci_disconnect(aci_state_t *aci_stat, aci_disconnect_reason_t reason)
+static void lib_aci_state_update(aci_state_t *aci_stat, const aci_evt_t *aci_evt)
 {
-  bool ret_val;
-  uint8_t i;
-  aci_cmd_params_disconnect_t aci_cmd_params_disconnect;
-  aci_cmd_params_disconnect.reason = reason;
-  acil_encode_cmd_disconnect(&(msg_to_send.buffer[0]), &aci_cmd_params_disconnect);
-  ret_val = hal_aci_tl_send(&msg_to_send);
-  // If we have actually sent the disconnect
-  if (ret_val)
+#if LIB_ACI_STARTUP_PROFILE
+  lib_aci_profile_event(aci_evt);
+#endif
+#if LIB_ACI_CREDIT_FORECAST
+  lib_aci_forecast_event(aci_stat, aci_evt);
+#endif
+
+  switch(aci_evt->evt_opcode)
   {
-    // Update pipes immediately so that while the disconnect is happening,
-    // the application can't attempt sending another message
-    // If the application sends another message before we updated this
-    //    a ACI Pipe Error Event will be received from nRF8001
-    for (i=0; i < PIPES_ARRAY_SIZE; i++)
-    {
-      aci_stat->pipes_open_bitmap[i] = 0;
-      aci_stat->pipes_closed_bitmap[i] = 0;
-    }
+#if LIB_ACI_CREDIT_TRACKING
+      case ACI_EVT_DEVICE_STARTED:
+              aci_stat->data_credit_total     = aci_evt->params.device_started.credit_available;
+              aci_stat->data_credit_available = aci_evt->params.device_started.credit_available;
+          break;
+
+      case ACI_EVT_DATA_CREDIT:
+              lib_aci_credit_return(aci_stat, aci_evt->params.data_credit.credit);
+          break;
+
+      case ACI_EVT_PIPE_ERROR:
+              //The data packet was not sent, its credit is given back.
+              //The pipe error also represents the Attribute protocol Error Response sent from the peer and that should not be counted
+              //for the credit.
+              if (ACI_STATUS_ERROR_PEER_ATT_ERROR != aci_evt->params.pipe_error.error_code)
+              {
+                lib_aci_credit_return(aci_stat, 1);
+              }
+#if LIB_ACI_ACK_WINDOW
+              lib_aci_ack_done(aci_stat, aci_evt->params.pipe_error.pipe_number);
+#endif
+          break;
+#endif
+
+#if LIB_ACI_ACK_WINDOW
+      case ACI_EVT_DATA_ACK:
+              lib_aci_ack_done(aci_stat, aci_evt->params.data_ack.pipe_number);
+          break;
+#endif
+
+      case ACI_EVT_PIPE_STATUS:
+          {
+              uint8_t i=0;
+              
+              for (i=0; i < PIPES_ARRAY_SIZE; i++)
+              {
+                aci_stat->pipes_open_bitmap[i]   = aci_evt->params.pipe_status.pipes_open_bitmap[i];
+                aci_stat->pipes_closed_bitmap[i] = aci_evt->params.pipe_status.pipes_closed_bitmap[i];
+              }
+          }
+          break;
+      
+      case ACI_EVT_DISCONNECTED:
+          {
+              uint8_t i=0;
+              
+              for (i=0; i < PIPES_ARRAY_SIZE; i++)
+              {
+                aci_stat->pipes_open_bitmap[i] = 0;
+                aci_stat->pipes_closed_bitmap[i] = 0;
+              }
+              aci_stat->confirmation_pending = false;
+              aci_stat->data_credit_available = aci_stat->data_credit_total;
+#if LIB_ACI_ACK_WINDOW
+              lib_aci_cur->ack_count = 0;
+#endif
+              
+          }
+          break;
+          
+      case ACI_EVT_TIMING:            
+              aci_stat->connection_interval = aci_evt->params.timing.conn_rf_interval;
+              aci_stat->slave_latency       = aci_evt->params.timing.conn_slave_rf_latency;
+              aci_stat->supervision_timeout = aci_evt->params.timing.conn_rf_timeout;
+          break;
+
+      case ACI_EVT_CONNECTED:
+              aci_stat->connection_interval = aci_evt->params.connected.conn_rf_interval;
+              aci_stat->slave_latency       = aci_evt->params.connected.conn_slave_rf_latency;
+              aci_stat->supervision_timeout = aci_evt->params.connected.conn_rf_timeout;
+          break;
+
+      default:
+          /* Need default case to avoid compiler warnings about missing enum
+           * values on some platforms.
+           */
+          break;
   }
-  return ret_val;
+
+#if LIB_ACI_AUTO_WAKEUP
+  lib_aci_sleep_event(aci_evt);
+#endif
+#if HAL_ACI_TL_EVENT_TIME
+  lib_aci_conn_event_anchor(aci_evt);
+#endif
+#if LIB_ACI_LINK_HISTORY
+  // Before the answers and the stream below take the credits back
+  lib_aci_link_event(aci_stat, aci_evt);
+#endif
+#if LIB_ACI_RETRANSMIT_SLOTS
+  // Frees the slots before the answers and the stream below take them
+  lib_aci_retransmit_event(aci_evt);
+#endif
+#if LIB_ACI_AUTO_ACK
+  lib_aci_auto_ack_event(aci_stat, aci_evt);
+#endif
+#if LIB_ACI_SHADOW_PIPES
+  lib_aci_shadow_event(aci_stat, aci_evt);
+#endif
+#if LIB_ACI_STREAM_BYTES
+  lib_aci_stream_event(aci_stat, aci_evt->evt_opcode);
+#endif
+#if LIB_ACI_ADV_SCHEDULE
+  lib_aci_adv_event(aci_stat, aci_evt);
+#endif
+#if LIB_ACI_TRANSACTION_CMDS
+  lib_aci_transaction_event(aci_evt);
+#endif
+#if LIB_ACI_STAGED_VALUES
+  lib_aci_staged_event(aci_evt);
+#endif
+#if LIB_ACI_PRODUCERS
+  lib_aci_producer_pump(aci_stat);
+#endif
 }
 
+#if LIB_ACI_DISPATCH
+#if defined(__AVR__)
+#define lib_aci_handler_read(p_handler)  ((lib_aci_evt_handler_t)(uintptr_t)pgm_read_word(p_handler))
+#else
+#define lib_aci_handler_read(p_handler)  (*(p_handler))
+#endif
 
-bool lib_aci_bond(uint16_t run_timeout, uint16_t adv_interval)
+void lib_aci_dispatch_set(aci_state_t *aci_stat, const lib_aci_evt_handler_t *p_evt_handlers,
+                          const lib_aci_evt_handler_t *p_pipe_handlers, uint8_t pipe_handler_count)
 {
-  aci_cmd_params_bond_t aci_cmd_params_bond;
-  aci_cmd_params_bond.timeout = run_timeout;
-  aci_cmd_params_bond.adv_interval = adv_interval;
-  acil_encode_cmd_bond(&(msg_to_send.buffer[0]), &aci_cmd_params_bond);
-  return hal_aci_tl_send(&msg_to_send);
-}
+  lib_aci_select(aci_stat);
 
+  lib_aci_cur->p_evt_handlers     = p_evt_handlers;
+  lib_aci_cur->p_pipe_handlers    = p_pipe_handlers;
+  lib_aci_cur->pipe_handler_count = (NULL == p_pipe_handlers) ? 0 : pipe_handler_count;
+}
 
-bool lib_aci_wakeup()
+#if LIB_ACI_DISPATCH_PROFILE
+/*
+  Entry of the time of a handler, the pipe ones past LIB_ACI_DISPATCH_PROFILE_PIPES go with their opcode.
+*/
+static lib_aci_handler_time_t *lib_aci_handler_time(uint8_t index, uint8_t pipe)
 {
-  acil_encode_cmd_wakeup(&(msg_to_send.buffer[0]));
-  return hal_aci_tl_send(&msg_to_send);
+#if LIB_ACI_DISPATCH_PROFILE_PIPES
+  if ((0 != pipe) && (pipe < LIB_ACI_DISPATCH_PROFILE_PIPES))
+  {
+    return &lib_aci_cur->pipe_times[pipe];
+  }
+#else
+  (void)pipe;
+#endif
+  return &lib_aci_cur->evt_times[index];
 }
 
-
-bool lib_aci_set_tx_power(aci_device_output_power_t tx_power)
+static void lib_aci_handler_time_add(lib_aci_handler_time_t *p_time, uint32_t elapsed_us)
 {
-  aci_cmd_params_set_tx_power_t aci_cmd_params_set_tx_power;
-  aci_cmd_params_set_tx_power.device_power = tx_power;
-  acil_encode_cmd_set_radio_tx_power(&(msg_to_send.buffer[0]), &aci_cmd_params_set_tx_power);
-  return hal_aci_tl_send(&msg_to_send);
+  if (0xFFFF != p_time->count)
+  {
+    p_time->count++;
+  }
+  p_time->total_us = ((0xFFFFFFFFUL - p_time->total_us) < elapsed_us) ? 0xFFFFFFFFUL : (p_time->total_us + elapsed_us);
+  if (elapsed_us > p_time->max_us)
+  {
+    p_time->max_us = elapsed_us;
+  }
 }
 
-
-bool lib_aci_get_address()
+bool lib_aci_handler_time_get(aci_state_t *aci_stat, uint8_t evt_opcode, uint8_t pipe, lib_aci_handler_time_t *p_time)
 {
-  acil_encode_cmd_get_address(&(msg_to_send.buffer[0]));
-  return hal_aci_tl_send(&msg_to_send);
-}
+  const uint8_t index = (uint8_t)LIB_ACI_EVT_HANDLER_INDEX(evt_opcode);
 
+  lib_aci_select(aci_stat);
 
-bool lib_aci_get_temperature()
-{
-  acil_encode_cmd_temparature(&(msg_to_send.buffer[0]));
-  return hal_aci_tl_send(&msg_to_send);
+  if ((index >= LIB_ACI_EVT_HANDLER_COUNT) ||
+      ((0 != pipe) && ((ACI_EVT_DATA_RECEIVED != evt_opcode) || (pipe >= LIB_ACI_DISPATCH_PROFILE_PIPES))))
+  {
+    return false;
+  }
+  *p_time = *lib_aci_handler_time(index, pipe);
+  return true;
 }
 
-
-bool lib_aci_get_battery_level()
+void lib_aci_handler_time_reset(aci_state_t *aci_stat)
 {
-  acil_encode_cmd_battery_level(&(msg_to_send.buffer[0]));
-  return hal_aci_tl_send(&msg_to_send);
-}
+  lib_aci_select(aci_stat);
 
+  memset(&lib_aci_cur->evt_times[0], 0, sizeof(lib_aci_cur->evt_times));
+#if LIB_ACI_DISPATCH_PROFILE_PIPES
+  memset(&lib_aci_cur->pipe_times[0], 0, sizeof(lib_aci_cur->pipe_times));
+#endif
+}
+#endif
 
-bool lib_aci_send_data(uint8_t pipe, uint8_t *p_value, uint8_t size)
+/*
+  Calls the handler of the pipe for received data, else the handler of the opcode.
+*/
+static void lib_aci_event_dispatch(aci_state_t *aci_stat, const aci_evt_t *p_evt)
 {
-  bool ret_val = false;
-  aci_cmd_params_send_data_t aci_cmd_params_send_data;
+  lib_aci_ctx_t *p_ctx = lib_aci_cur;
+  lib_aci_evt_handler_t handler = NULL;
+  uint8_t pipe = 0;
+  uint8_t index;
 
-  
-  if(!((p_services_pipe_type_map[pipe-1].pipe_type == ACI_TX) ||
-      (p_services_pipe_type_map[pipe-1].pipe_type == ACI_TX_ACK)))
+  if ((ACI_EVT_DATA_RECEIVED == p_evt->evt_opcode) &&
+      (p_evt->params.data_received.rx_data.pipe_number < p_ctx->pipe_handler_count))
   {
-    return false;
+    handler = lib_aci_handler_read(&p_ctx->p_pipe_handlers[p_evt->params.data_received.rx_data.pipe_number]);
+    pipe    = (NULL == handler) ? 0 : p_evt->params.data_received.rx_data.pipe_number;
   }
 
-  if (size > ACI_PIPE_TX_DATA_MAX_LEN)
+  index = (uint8_t)LIB_ACI_EVT_HANDLER_INDEX(p_evt->evt_opcode);
+  if ((NULL == handler) && (NULL != p_ctx->p_evt_handlers) && (index < LIB_ACI_EVT_HANDLER_COUNT))
   {
-    return false;
+    handler = lib_aci_handler_read(&p_ctx->p_evt_handlers[index]);
   }
+
+  if (NULL != handler)
   {
-      aci_cmd_params_send_data.tx_data.pipe_number = pipe;
-      memcpy(&(aci_cmd_params_send_data.tx_data.aci_data[0]), p_value, size);
-      acil_encode_cmd_send_data(&(msg_to_send.buffer[0]), &aci_cmd_params_send_data, size);
-      
-      ret_val = hal_aci_tl_send(&msg_to_send);          
+#if LIB_ACI_DISPATCH_PROFILE
+    // Taken before the call, the handler may select another instance
+    lib_aci_handler_time_t *p_time   = lib_aci_handler_time(index, pipe);
+    unsigned long           start_us = micros();
+
+    handler(aci_stat, p_evt);
+    lib_aci_handler_time_add(p_time, micros() - start_us);
+#else
+    (void)pipe;
+    handler(aci_stat, p_evt);
+#endif
   }
-  return ret_val;
 }
+#else
+#define lib_aci_event_dispatch(aci_stat, p_evt)
+#endif
 
-
-bool lib_aci_request_data(aci_state_t *aci_stat, uint8_t pipe)
+#if LIB_ACI_PENDING_CMDS
+bool lib_aci_cmd_expect(aci_state_t *aci_stat, uint8_t cmd_opcode, lib_aci_cmd_cb_t cmd_cb, uint16_t timeout_ms)
 {
-  bool ret_val = false;
-  aci_cmd_params_request_data_t aci_cmd_params_request_data;
+  lib_aci_ctx_t *p_ctx;
+  lib_aci_pending_cmd_t *p_cmd;
+
+  lib_aci_select(aci_stat);
+  p_ctx = lib_aci_cur;
 
-  if(!((p_services_pipe_type_map[pipe-1].location == ACI_STORE_REMOTE)&&(p_services_pipe_type_map[pipe-1].pipe_type == ACI_RX_REQ)))
+  if ((NULL == cmd_cb) || (LIB_ACI_PENDING_CMDS == p_ctx->pending_count))
   {
     return false;
   }
 
+  p_cmd = &p_ctx->pending_cmds[p_ctx->pending_count++];
+  p_cmd->cmd_cb      = cmd_cb;
+  p_cmd->cmd_opcode  = cmd_opcode;
+  p_cmd->timed       = (0 != timeout_ms);
+  p_cmd->deadline_ms = millis() + timeout_ms;
+  return true;
+}
 
-  {
+uint8_t lib_aci_cmd_pending(aci_state_t *aci_stat)
+{
+  lib_aci_select(aci_stat);
 
-    {
+  return lib_aci_cur->pending_count;
+}
+
+/*
+  Removes a pending command, keeping the others oldest first, and returns its callback.
+*/
+static lib_aci_cmd_cb_t lib_aci_cmd_remove(lib_aci_ctx_t *p_ctx, uint8_t index)
+{
+  lib_aci_cmd_cb_t cmd_cb = p_ctx->pending_cmds[index].cmd_cb;
 
+  p_ctx->pending_count--;
+  memmove(&p_ctx->pending_cmds[index], &p_ctx->pending_cmds[index + 1],
+          (p_ctx->pending_count - index) * sizeof(lib_aci_pending_cmd_t));
+  return cmd_cb;
+}
 
+/*
+  Gives a command response to the oldest command waiting for it.
+  The callback is called after the removal, so it may wait for another command.
+*/
+static void lib_aci_cmd_rsp_match(aci_state_t *aci_stat, const aci_evt_t *p_evt)
+{
+  lib_aci_ctx_t *p_ctx = lib_aci_cur;
+  uint8_t i;
 
-      aci_cmd_params_request_data.pipe_number = pipe;
-      acil_encode_cmd_request_data(&(msg_to_send.buffer[0]), &aci_cmd_params_request_data);
+  if (ACI_EVT_CMD_RSP != p_evt->evt_opcode)
+  {
+    return;
+  }
 
-      ret_val = hal_aci_tl_send(&msg_to_send);
+  for (i = 0; i < p_ctx->pending_count; i++)
+  {
+    if (p_ctx->pending_cmds[i].cmd_opcode == (uint8_t)p_evt->params.cmd_rsp.cmd_opcode)
+    {
+      lib_aci_cmd_remove(p_ctx, i)(aci_stat, (uint8_t)p_evt->params.cmd_rsp.cmd_opcode, &p_evt->params.cmd_rsp);
+      return;
     }
   }
-  return ret_val;
 }
 
-
-bool lib_aci_change_timing(uint16_t minimun_cx_interval, uint16_t maximum_cx_interval, uint16_t slave_latency, uint16_t timeout)
+/*
+  Calls back the commands whose response did not come in time.
+*/
+static void lib_aci_cmd_timeouts(aci_state_t *aci_stat)
 {
-  aci_cmd_params_change_timing_t aci_cmd_params_change_timing;
-  aci_cmd_params_change_timing.conn_params.min_conn_interval = minimun_cx_interval;
-  aci_cmd_params_change_timing.conn_params.max_conn_interval = maximum_cx_interval;
-  aci_cmd_params_change_timing.conn_params.slave_latency     = slave_latency;    
-  aci_cmd_params_change_timing.conn_params.timeout_mult      = timeout;     
-  acil_encode_cmd_change_timing_req(&(msg_to_send.buffer[0]), &aci_cmd_params_change_timing);
-  return hal_aci_tl_send(&msg_to_send);
-}
-
+  lib_aci_ctx_t *p_ctx = lib_aci_cur;
+  unsigned long now_ms = millis();
+  uint8_t cmd_opcode;
+  uint8_t i = 0;
 
-bool lib_aci_change_timing_GAP_PPCP()
-{
-  acil_encode_cmd_change_timing_req_GAP_PPCP(&(msg_to_send.buffer[0]));
-  return hal_aci_tl_send(&msg_to_send);
+  while (i < p_ctx->pending_count)
+  {
+    if (p_ctx->pending_cmds[i].timed && ((long)(now_ms - p_ctx->pending_cmds[i].deadline_ms) >= 0))
+    {
+      cmd_opcode = p_ctx->pending_cmds[i].cmd_opcode;
+      lib_aci_cmd_remove(p_ctx, i)(aci_stat, cmd_opcode, NULL);
+    }
+    else
+    {
+      i++;
+    }
+  }
 }
+#else
+#define lib_aci_cmd_rsp_match(aci_stat, p_evt)
+#define lib_aci_cmd_timeouts(aci_stat)
+#endif
 
-
-bool lib_aci_open_remote_pipe(aci_state_t *aci_stat, uint8_t pipe)
+#if LIB_ACI_TRANSACTION_CMDS
+bool lib_aci_transaction_begin(aci_state_t *aci_stat)
 {
-  bool ret_val = false;
-  aci_cmd_params_open_remote_pipe_t aci_cmd_params_open_remote_pipe;
+  lib_aci_ctx_t *p_ctx;
 
-  if(!((p_services_pipe_type_map[pipe-1].location == ACI_STORE_REMOTE)&&
-                ((p_services_pipe_type_map[pipe-1].pipe_type == ACI_RX)||
-                (p_services_pipe_type_map[pipe-1].pipe_type == ACI_RX_ACK_AUTO)||
-                (p_services_pipe_type_map[pipe-1].pipe_type == ACI_RX_ACK))))
+  lib_aci_select(aci_stat);
+  p_ctx = lib_aci_cur;
+
+  if (LIB_ACI_TRANSACTION_IDLE != p_ctx->transaction_state)
   {
     return false;
   }
 
-  
-  {
+  memset(&p_ctx->transaction, 0, sizeof(p_ctx->transaction));
+  p_ctx->transaction_state = LIB_ACI_TRANSACTION_BUILDING;
+  return true;
+}
 
-    is_request_operation_pending = true;
-    is_open_remote_pipe_pending = true;
-    request_operation_pipe = pipe;
-    aci_cmd_params_open_remote_pipe.pipe_number = pipe;
-    acil_encode_cmd_open_remote_pipe(&(msg_to_send.buffer[0]), &aci_cmd_params_open_remote_pipe);
-    ret_val = hal_aci_tl_send(&msg_to_send);
+bool lib_aci_transaction_end(aci_state_t *aci_stat, lib_aci_transaction_cb_t transaction_cb, uint16_t timeout_ms)
+{
+  lib_aci_ctx_t *p_ctx;
+
+  lib_aci_select(aci_stat);
+  p_ctx = lib_aci_cur;
+
+  if ((NULL == transaction_cb) || (LIB_ACI_TRANSACTION_BUILDING != p_ctx->transaction_state))
+  {
+    return false;
   }
-  return ret_val;
-}
 
+  p_ctx->transaction_cb          = transaction_cb;
+  p_ctx->transaction_timed       = (0 != timeout_ms);
+  p_ctx->transaction_deadline_ms = millis() + timeout_ms;
+  p_ctx->transaction_state       = LIB_ACI_TRANSACTION_WAITING;
+  return true;
+}
 
-bool lib_aci_close_remote_pipe(aci_state_t *aci_stat, uint8_t pipe)
+bool lib_aci_transaction_busy(aci_state_t *aci_stat)
 {
-  bool ret_val = false;
-  aci_cmd_params_close_remote_pipe_t aci_cmd_params_close_remote_pipe;
+  lib_aci_select(aci_stat);
 
-  if(!((p_services_pipe_type_map[pipe-1].location == ACI_STORE_REMOTE)&&
-        ((p_services_pipe_type_map[pipe-1].pipe_type == ACI_RX)||
-         (p_services_pipe_type_map[pipe-1].pipe_type == ACI_RX_ACK_AUTO)||
-         (p_services_pipe_type_map[pipe-1].pipe_type == ACI_RX_ACK))))
+  return (LIB_ACI_TRANSACTION_IDLE != lib_aci_cur->transaction_state);
+}
+#endif
+
+#if HAL_ACI_EVENT_FILTER
+bool lib_aci_event_filter_set(aci_state_t *aci_stat, uint16_t evt_mask)
+{
+  uint16_t allowed = HAL_ACI_EVENT_FILTER_BIT(ACI_EVT_ECHO) | HAL_ACI_EVENT_FILTER_BIT(ACI_EVT_TIMING);
+
+#if LIB_ACI_CREDIT_TRACKING
+  allowed |= HAL_ACI_EVENT_FILTER_BIT(ACI_EVT_DATA_CREDIT);
+#endif
+#if !LIB_ACI_ACK_WINDOW
+  allowed |= HAL_ACI_EVENT_FILTER_BIT(ACI_EVT_DATA_ACK);
+#endif
+  if (0 != (evt_mask & ~allowed))
   {
     return false;
-  }  
+  }
+
+  lib_aci_select(aci_stat);
+  hal_aci_tl_event_filter_set(evt_mask);
+  return true;
+}
 
+/*
+  Updates the ACI state from the events the transport kept out of the event queue. Runs before
+  the state update of the event returned, so a Disconnected still resets the credits after it.
+*/
+static void lib_aci_filtered_update(aci_state_t *aci_stat)
+{
+  hal_aci_tl_filtered_t filtered;
 
+  if (!hal_aci_tl_event_filtered_take(&filtered))
   {
+    return;
+  }
 
-    is_request_operation_pending = true;
-    is_close_remote_pipe_pending = true;
-    request_operation_pipe = pipe;
-    aci_cmd_params_close_remote_pipe.pipe_number = pipe;
-    acil_encode_cmd_close_remote_pipe(&(msg_to_send.buffer[0]), &aci_cmd_params_close_remote_pipe);
-    ret_val = hal_aci_tl_send(&msg_to_send);
+  if (filtered.timing_valid)
+  {
+    aci_stat->connection_interval = filtered.conn_rf_interval;
+    aci_stat->slave_latency       = filtered.conn_slave_rf_latency;
+    aci_stat->supervision_timeout = filtered.conn_rf_timeout;
   }
-  return ret_val;
+#if LIB_ACI_CREDIT_TRACKING
+  if (0 != filtered.credits)
+  {
+    lib_aci_credit_return(aci_stat, filtered.credits);
+#if LIB_ACI_RETRANSMIT_SLOTS
+    lib_aci_retransmit_credit(filtered.credits);
+#endif
+#if LIB_ACI_STREAM_BYTES
+    lib_aci_stream_pump(aci_stat);
+#endif
+#if LIB_ACI_PRODUCERS
+    lib_aci_producer_pump(aci_stat);
+#endif
+  }
+#endif
 }
+#else
+#define lib_aci_filtered_update(aci_stat)
+#endif
 
-
-bool lib_aci_set_key(aci_key_type_t key_rsp_type, uint8_t *key, uint8_t len)
+bool lib_aci_event_get(aci_state_t *aci_stat, hal_aci_evt_t *p_aci_evt_data)
 {
-  aci_cmd_params_set_key_t aci_cmd_params_set_key;
-  aci_cmd_params_set_key.key_type = key_rsp_type;
-  memcpy((uint8_t*)&(aci_cmd_params_set_key.key), key, len);
-  acil_encode_cmd_set_key(&(msg_to_send.buffer[0]), &aci_cmd_params_set_key);
-  return hal_aci_tl_send(&msg_to_send);
-}
+  bool status = false;
+#if ACI_RX_DATA_QUEUE_BYTES
+  bool is_data;
+#endif
 
+  lib_aci_select(aci_stat);
+  
+#if ACI_RX_DATA_QUEUE_BYTES
+  // The data of a link that is gone go ahead of its ACI_EVT_DISCONNECTED, the others after the other events
+  is_data = hal_aci_tl_data_is_stale() && hal_aci_tl_data_peek((hal_aci_data_t *)p_aci_evt_data);
+  status  = is_data || hal_aci_tl_event_get((hal_aci_data_t *)p_aci_evt_data);
+  if (!status)
+  {
+    is_data = hal_aci_tl_data_peek((hal_aci_data_t *)p_aci_evt_data);
+    status  = is_data;
+  }
+#else
+  status = hal_aci_tl_event_get((hal_aci_data_t *)p_aci_evt_data);
+#endif
+  lib_aci_filtered_update(aci_stat);
+  
+  if (true == status)
+  {
+    lib_aci_state_update(aci_stat, &p_aci_evt_data->evt);
+    lib_aci_cmd_rsp_match(aci_stat, &p_aci_evt_data->evt);
+    lib_aci_event_dispatch(aci_stat, &p_aci_evt_data->evt);
+  }
+#if ACI_RX_DATA_QUEUE_BYTES
+  // Released once dispatched, the automatic acknowledgement still sees if it is stale
+  if (is_data)
+  {
+    hal_aci_tl_data_release();
+  }
+#endif
+  lib_aci_cmd_timeouts(aci_stat);
+  lib_aci_retransmit_poll(aci_stat);
+  lib_aci_transaction_poll(aci_stat);
+  return status;
+}
 
-bool lib_aci_echo_msg(uint8_t msg_size, uint8_t *p_msg_data)
+uint8_t lib_aci_event_get_many(aci_state_t *aci_stat, hal_aci_evt_t *p_aci_evt_data, uint8_t max_count)
 {
-  aci_cmd_params_echo_t aci_cmd_params_echo;
-  if(msg_size > (ACI_ECHO_DATA_MAX_LEN))
+  uint8_t count;
+  uint8_t i;
+
+  lib_aci_select(aci_stat);
+
+  count = 0;
+#if ACI_RX_DATA_QUEUE_BYTES
+  // Same order as lib_aci_event_get()
+  while ((count < max_count) && hal_aci_tl_data_is_stale() &&
+         hal_aci_tl_data_peek((hal_aci_data_t *)&p_aci_evt_data[count]))
   {
-    return false;
+    lib_aci_state_update(aci_stat, &p_aci_evt_data[count].evt);
+    lib_aci_event_dispatch(aci_stat, &p_aci_evt_data[count].evt);
+    hal_aci_tl_data_release();
+    count++;
   }
+#endif
+  i      = count;
+  count += hal_aci_tl_event_get_many((hal_aci_data_t *)&p_aci_evt_data[count], max_count - count);
+  lib_aci_filtered_update(aci_stat);
 
-  if (msg_size > (ACI_ECHO_DATA_MAX_LEN))
+  for (; i < count; i++)
   {
-    msg_size = ACI_ECHO_DATA_MAX_LEN;
+    lib_aci_state_update(aci_stat, &p_aci_evt_data[i].evt);
+    lib_aci_cmd_rsp_match(aci_stat, &p_aci_evt_data[i].evt);
+    lib_aci_event_dispatch(aci_stat, &p_aci_evt_data[i].evt);
   }
+#if ACI_RX_DATA_QUEUE_BYTES
+  while ((count < max_count) && hal_aci_tl_data_peek((hal_aci_data_t *)&p_aci_evt_data[count]))
+  {
+    lib_aci_state_update(aci_stat, &p_aci_evt_data[count].evt);
+    lib_aci_event_dispatch(aci_stat, &p_aci_evt_data[count].evt);
+    hal_aci_tl_data_release();
+    count++;
+  }
+#endif
+  lib_aci_cmd_timeouts(aci_stat);
+  lib_aci_retransmit_poll(aci_stat);
+  lib_aci_transaction_poll(aci_stat);
+  return count;
+}
 
-  memcpy(&(aci_cmd_params_echo.echo_data[0]), p_msg_data, msg_size);
-  acil_encode_cmd_echo_msg(&(msg_to_send.buffer[0]), &aci_cmd_params_echo, msg_size);
-
-  return hal_aci_tl_send(&msg_to_send);
+const hal_aci_evt_t *lib_aci_event_peek_ptr(void)
+{
+  return (const hal_aci_evt_t *)hal_aci_tl_event_peek_ptr();
 }
 
+void lib_aci_event_release(aci_state_t *aci_stat)
+{
+  const hal_aci_evt_t *p_aci_evt_data;
+
+  lib_aci_select(aci_stat);
 
-bool lib_aci_bond_request()
+  p_aci_evt_data = lib_aci_event_peek_ptr();
+  lib_aci_filtered_update(aci_stat);
+  if (NULL != p_aci_evt_data)
+  {
+    lib_aci_state_update(aci_stat, &p_aci_evt_data->evt);
+    lib_aci_cmd_rsp_match(aci_stat, &p_aci_evt_data->evt);
+    lib_aci_event_dispatch(aci_stat, &p_aci_evt_data->evt);
+    hal_aci_tl_event_release();
+  }
+  lib_aci_cmd_timeouts(aci_stat);
+  lib_aci_retransmit_poll(aci_stat);
+  lib_aci_transaction_poll(aci_stat);
+}
+
+#if ACI_RX_DATA_QUEUE_BYTES
+const hal_aci_evt_t *lib_aci_data_peek_ptr(void)
 {
-  acil_encode_cmd_bond_security_request(&(msg_to_send.buffer[0]));
-  return hal_aci_tl_send(&msg_to_send);
+  return (const hal_aci_evt_t *)hal_aci_tl_data_peek_ptr();
 }
 
-bool lib_aci_event_peek(hal_aci_evt_t *p_aci_evt_data)
+bool lib_aci_data_is_stale(void)
 {
-  return hal_aci_tl_event_peek((hal_aci_data_t *)p_aci_evt_data);
+  return hal_aci_tl_data_is_stale();
 }
 
-bool lib_aci_event_get(aci_state_t *aci_stat, hal_aci_evt_t *p_aci_evt_data)
+void lib_aci_data_release(aci_state_t *aci_stat)
 {
-  bool status = false;
-  
-  status = hal_aci_tl_event_get((hal_aci_data_t *)p_aci_evt_data);
-  
-  /**
-  Update the state of the ACI with the 
-  ACI Events -> Pipe Status, Disconnected, Connected, Bond Status, Pipe Error
-  */
-  if (true == status)
-  {
-    aci_evt_t * aci_evt;
-    
-    aci_evt = &p_aci_evt_data->evt;  
-    
-    switch(aci_evt->evt_opcode)
-    {
-        case ACI_EVT_PIPE_STATUS:
-            {
-                uint8_t i=0;
-                
-                for (i=0; i < PIPES_ARRAY_SIZE; i++)
-                {
-                  aci_stat->pipes_open_bitmap[i]   = aci_evt->params.pipe_status.pipes_open_bitmap[i];
-                  aci_stat->pipes_closed_bitmap[i] = aci_evt->params.pipe_status.pipes_closed_bitmap[i];
-                }
-            }
-            break;
-        
-        case ACI_EVT_DISCONNECTED:
-            {
-                uint8_t i=0;
-                
-                for (i=0; i < PIPES_ARRAY_SIZE; i++)
-                {
-                  aci_stat->pipes_open_bitmap[i] = 0;
-                  aci_stat->pipes_closed_bitmap[i] = 0;
-                }
-                aci_stat->confirmation_pending = false;
-                aci_stat->data_credit_available = aci_stat->data_credit_total;
-                
-            }
-            break;
-            
-        case ACI_EVT_TIMING:            
-                aci_stat->connection_interval = aci_evt->params.timing.conn_rf_interval;
-                aci_stat->slave_latency       = aci_evt->params.timing.conn_slave_rf_latency;
-                aci_stat->supervision_timeout = aci_evt->params.timing.conn_rf_timeout;
-            break;
-
-        case ACI_EVT_CONNECTED:
-                aci_stat->connection_interval = aci_evt->params.connected.conn_rf_interval;
-                aci_stat->slave_latency       = aci_evt->params.connected.conn_slave_rf_latency;
-                aci_stat->supervision_timeout = aci_evt->params.connected.conn_rf_timeout;
-            break;
+  const hal_aci_evt_t *p_aci_evt_data;
 
-        default:
-            /* Need default case to avoid compiler warnings about missing enum
-             * values on some platforms.
-             */
-            break;
+  lib_aci_select(aci_stat);
 
-			
-			
-    }
+  p_aci_evt_data = lib_aci_data_peek_ptr();
+  if (NULL != p_aci_evt_data)
+  {
+    lib_aci_state_update(aci_stat, &p_aci_evt_data->evt);
+    lib_aci_event_dispatch(aci_stat, &p_aci_evt_data->evt);
+    hal_aci_tl_data_release();
   }
-  return status;
 }
+#endif
 
 
 bool lib_aci_send_ack(aci_state_t *aci_stat, const uint8_t pipe)
 {
-  bool ret_val = false;
+  hal_aci_data_t *p_slot;
+
+  lib_aci_select(aci_stat);
+
+  p_slot = lib_aci_data_cmd_reserve(aci_stat, ACI_CMD_SEND_DATA_ACK);
+  if (NULL == p_slot)
   {
-    acil_encode_cmd_send_data_ack(&(msg_to_send.buffer[0]), pipe);
-    
-    ret_val = hal_aci_tl_send(&msg_to_send);
+    return false;
   }
-  return ret_val;
+  acil_encode_cmd_send_data_ack(&(p_slot->buffer[0]), pipe);
+
+  return lib_aci_data_cmd_commit(aci_stat);
 }
 
 
 bool lib_aci_send_nack(aci_state_t *aci_stat, const uint8_t pipe, const uint8_t error_code)
 {
-  bool ret_val = false;
-  
+  hal_aci_data_t *p_slot;
+
+  lib_aci_select(aci_stat);
+
+  p_slot = lib_aci_data_cmd_reserve(aci_stat, ACI_CMD_SEND_DATA_NACK);
+  if (NULL == p_slot)
   {
-    
-    acil_encode_cmd_send_data_nack(&(msg_to_send.buffer[0]), pipe, error_code);
-    ret_val = hal_aci_tl_send(&msg_to_send);
+    return false;
   }
-  return ret_val;
+  acil_encode_cmd_send_data_nack(&(p_slot->buffer[0]), pipe, error_code);
+
+  return lib_aci_data_cmd_commit(aci_stat);
 }
 
 
+#if ACI_FEATURE_BROADCAST
 bool lib_aci_broadcast(const uint16_t timeout, const uint16_t adv_interval)
 {
+  hal_aci_data_t *p_cmd;
   aci_cmd_params_broadcast_t aci_cmd_params_broadcast;
   if (timeout > 16383)
   {
@@ -673,55 +4114,98 @@ bool lib_aci_broadcast(const uint16_t timeout, const uint16_t adv_interval)
 
   aci_cmd_params_broadcast.timeout = timeout;
   aci_cmd_params_broadcast.adv_interval = adv_interval;
-  acil_encode_cmd_broadcast(&(msg_to_send.buffer[0]), &aci_cmd_params_broadcast);
-  return hal_aci_tl_send(&msg_to_send);
+  lib_aci_staged_send();
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_BROADCAST);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_broadcast(&(p_cmd->buffer[0]), &aci_cmd_params_broadcast);
+  return lib_aci_cmd_send(p_cmd);
 }
 
 
 bool lib_aci_open_adv_pipes(const uint8_t * const adv_service_data_pipes)
 {
+  hal_aci_data_t *p_cmd;
   uint8_t i;
     
   for (i = 0; i < PIPES_ARRAY_SIZE; i++)
   {
-    aci_cmd_params_open_adv_pipe.pipes[i] = adv_service_data_pipes[i];
+    lib_aci_cur->aci_cmd_params_open_adv_pipe.pipes[i] = adv_service_data_pipes[i];
   }
 
-  acil_encode_cmd_open_adv_pipes(&(msg_to_send.buffer[0]), &aci_cmd_params_open_adv_pipe);
-  return hal_aci_tl_send(&msg_to_send);
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_OPEN_ADV_PIPE);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_open_adv_pipes(&(p_cmd->buffer[0]), &lib_aci_cur->aci_cmd_params_open_adv_pipe);
+  return lib_aci_cmd_send(p_cmd);
 }
 
 bool lib_aci_open_adv_pipe(const uint8_t pipe)
 {
+  hal_aci_data_t *p_cmd;
   uint8_t byte_idx = pipe / 8;
   
-  aci_cmd_params_open_adv_pipe.pipes[byte_idx] |= (0x01 << (pipe % 8));
-  acil_encode_cmd_open_adv_pipes(&(msg_to_send.buffer[0]), &aci_cmd_params_open_adv_pipe);
-  return hal_aci_tl_send(&msg_to_send);
+  lib_aci_cur->aci_cmd_params_open_adv_pipe.pipes[byte_idx] |= (0x01 << (pipe % 8));
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_OPEN_ADV_PIPE);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_open_adv_pipes(&(p_cmd->buffer[0]), &lib_aci_cur->aci_cmd_params_open_adv_pipe);
+  return lib_aci_cmd_send(p_cmd);
 }
+#endif
 
 
+#if ACI_FEATURE_DYNAMIC_DATA
 bool lib_aci_read_dynamic_data()
 {
-  acil_encode_cmd_read_dynamic_data(&(msg_to_send.buffer[0]));
-  return hal_aci_tl_send(&msg_to_send);
+  hal_aci_data_t *p_cmd;
+
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_READ_DYNAMIC_DATA);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_read_dynamic_data(&(p_cmd->buffer[0]));
+  return lib_aci_cmd_send(p_cmd);
 }
 
 
 bool lib_aci_write_dynamic_data(uint8_t sequence_number, uint8_t* dynamic_data, uint8_t length)
 {
-  acil_encode_cmd_write_dynamic_data(&(msg_to_send.buffer[0]), sequence_number, dynamic_data, length);
-  return hal_aci_tl_send(&msg_to_send);
+  hal_aci_data_t *p_cmd;
+
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_WRITE_DYNAMIC_DATA);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_write_dynamic_data(&(p_cmd->buffer[0]), sequence_number, dynamic_data, length);
+  return lib_aci_cmd_send(p_cmd);
 }
+#endif
 
+#if ACI_FEATURE_DTM
 bool lib_aci_dtm_command(uint8_t dtm_command_msbyte, uint8_t dtm_command_lsbyte)
 {
+  hal_aci_data_t *p_cmd;
   aci_cmd_params_dtm_cmd_t aci_cmd_params_dtm_cmd;
   aci_cmd_params_dtm_cmd.cmd_msb = dtm_command_msbyte;
   aci_cmd_params_dtm_cmd.cmd_lsb = dtm_command_lsbyte;
-  acil_encode_cmd_dtm_cmd(&(msg_to_send.buffer[0]), &aci_cmd_params_dtm_cmd);
-  return hal_aci_tl_send(&msg_to_send);
+  p_cmd = lib_aci_cmd_buffer(ACI_CMD_DTM_CMD);
+  if (NULL == p_cmd)
+  {
+    return false;
+  }
+  acil_encode_cmd_dtm_cmd(&(p_cmd->buffer[0]), &aci_cmd_params_dtm_cmd);
+  return lib_aci_cmd_send(p_cmd);
 }
+#endif
 
 void lib_aci_flush(void)
 {
@@ -757,4 +4241,9 @@ bool lib_aci_command_queue_empty(void)
 bool lib_aci_command_queue_full(void)
 {
   return hal_aci_tl_tx_q_full();
+}
+
+bool lib_aci_idle(uint8_t sleep_mode)
+{
+  return hal_aci_tl_idle(sleep_mode);
 }
\ No newline at end of file
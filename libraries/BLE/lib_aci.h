@@ -37,12 +37,374 @@
 #include "aci.h"
 #include "aci_cmds.h"
 #include "aci_evts.h"
+#include "acilib.h"
 
 
 #define EVT_CMD_RESPONSE_MIN_LENGTH              3
 
 #define PIPES_ARRAY_SIZE                ((ACI_DEVICE_MAX_PIPES + 7)/8)
 
+/************************************************************************/
+/* Data credit accounting                                                */
+/* 1 : aci_state_t.data_credit_available is kept up to date by the ACI   */
+/*     Library. The data commands (lib_aci_send_data(),                  */
+/*     lib_aci_request_data(), lib_aci_send_ack(), lib_aci_send_nack())  */
+/*     take a credit and fail without sending when there is none left.   */
+/*     ACI_EVT_DEVICE_STARTED, ACI_EVT_DATA_CREDIT, ACI_EVT_PIPE_ERROR   */
+/*     and ACI_EVT_DISCONNECTED give them back. The application must     */
+/*     not change data_credit_available itself.                          */
+/* 0 : The application does the accounting, as in earlier releases.      */
+/************************************************************************/
+#ifndef LIB_ACI_CREDIT_TRACKING
+#define LIB_ACI_CREDIT_TRACKING 1
+#endif
+
+/************************************************************************/
+/* Stream buffer of lib_aci_send_stream()                                */
+/* Bytes of the ring that holds the stream data until there are credits  */
+/* to send it, one per nRF8001. 0 compiles lib_aci_send_stream() out.    */
+/* At least 2 x ACI_PIPE_TX_DATA_MAX_LEN keeps both nRF8001 buffers busy */
+/* in each connection event. At most 255.                                */
+/************************************************************************/
+#ifndef LIB_ACI_STREAM_BYTES
+#define LIB_ACI_STREAM_BYTES 0
+#endif
+
+#if (LIB_ACI_STREAM_BYTES > 255)
+#error "LIB_ACI_STREAM_BYTES must be at most 255"
+#endif
+#if (LIB_ACI_STREAM_BYTES && !LIB_ACI_CREDIT_TRACKING)
+#error "lib_aci_send_stream() needs LIB_ACI_CREDIT_TRACKING"
+#endif
+
+/************************************************************************/
+/* Event dispatch tables of lib_aci_dispatch_set()                       */
+/* 1 : lib_aci_event_get() and the other event functions call the        */
+/*     handler registered for the event opcode, or for the pipe of a     */
+/*     ACI_EVT_DATA_RECEIVED, after updating the aci_state_t.            */
+/* 0 : Compiled out, the events are only returned to the application.    */
+/************************************************************************/
+#ifndef LIB_ACI_DISPATCH
+#define LIB_ACI_DISPATCH 1
+#endif
+
+/************************************************************************/
+/* Time spent in the handlers of lib_aci_dispatch_set()                  */
+/* 1 : Every handler call is timed with micros(), count, total and       */
+/*     longest time by event opcode, and by pipe for the first           */
+/*     LIB_ACI_DISPATCH_PROFILE_PIPES pipes, for                         */
+/*     lib_aci_handler_time_get(). Takes 10 bytes per entry.             */
+/* 0 : Compiled out.                                                     */
+/************************************************************************/
+#ifndef LIB_ACI_DISPATCH_PROFILE
+#define LIB_ACI_DISPATCH_PROFILE 0
+#endif
+
+/************************************************************************/
+/* Pipes of the handler times                                            */
+/* The ACI_EVT_DATA_RECEIVED of the pipes 0 to N - 1 are timed apart,    */
+/* the ones of the other pipes with their opcode.                        */
+/************************************************************************/
+#ifndef LIB_ACI_DISPATCH_PROFILE_PIPES
+#define LIB_ACI_DISPATCH_PROFILE_PIPES 8
+#endif
+
+#if (LIB_ACI_DISPATCH_PROFILE && !LIB_ACI_DISPATCH)
+#error "LIB_ACI_DISPATCH_PROFILE needs LIB_ACI_DISPATCH"
+#endif
+#if ((LIB_ACI_DISPATCH_PROFILE_PIPES < 0) || (LIB_ACI_DISPATCH_PROFILE_PIPES > (ACI_DEVICE_MAX_PIPES + 1)))
+#error "LIB_ACI_DISPATCH_PROFILE_PIPES must be 0 to ACI_DEVICE_MAX_PIPES + 1"
+#endif
+
+/************************************************************************/
+/* Commands in flight of lib_aci_cmd_expect()                            */
+/* Number of command responses that can be waited for at the same time, */
+/* per nRF8001. Each takes 8 bytes of RAM. 0 compiles it out.            */
+/************************************************************************/
+#ifndef LIB_ACI_PENDING_CMDS
+#define LIB_ACI_PENDING_CMDS 0
+#endif
+
+#if (LIB_ACI_PENDING_CMDS > 255)
+#error "LIB_ACI_PENDING_CMDS must be at most 255"
+#endif
+
+/************************************************************************/
+/* Latest value coalescing of lib_aci_set_local_data()                   */
+/* 1 : A SetLocalData still in the command queue for the same pipe and   */
+/*     size is overwritten with the new value instead of queuing another */
+/*     one. Only the freshest value is sent when the values come faster */
+/*     than the nRF8001 takes them.                                      */
+/* 0 : Every call queues a SetLocalData.                                 */
+/************************************************************************/
+#ifndef LIB_ACI_COALESCE_LOCAL_DATA
+#define LIB_ACI_COALESCE_LOCAL_DATA 0
+#endif
+
+/************************************************************************/
+/* Shadow of the local values of lib_aci_shadow_enable()                 */
+/* Number of SET and TX pipes, per nRF8001, for which the last value     */
+/* given to the nRF8001 is kept. lib_aci_set_local_data() and            */
+/* lib_aci_send_data() on these pipes return true without queuing a      */
+/* command when the value is the same, or within the deadband of the     */
+/* pipe. Each takes LIB_ACI_SHADOW_VALUE_MAX + 4 bytes of RAM.           */
+/* 0 compiles it out.                                                    */
+/************************************************************************/
+#ifndef LIB_ACI_SHADOW_PIPES
+#define LIB_ACI_SHADOW_PIPES 0
+#endif
+
+/************************************************************************/
+/* Longest value kept by the shadow                                      */
+/* Longer values on a shadowed pipe are always sent. At most             */
+/* ACI_PIPE_TX_DATA_MAX_LEN.                                             */
+/************************************************************************/
+#ifndef LIB_ACI_SHADOW_VALUE_MAX
+#define LIB_ACI_SHADOW_VALUE_MAX 8
+#endif
+
+#if (LIB_ACI_SHADOW_PIPES > 255)
+#error "LIB_ACI_SHADOW_PIPES must be at most 255"
+#endif
+#if (LIB_ACI_SHADOW_VALUE_MAX > ACI_PIPE_TX_DATA_MAX_LEN)
+#error "LIB_ACI_SHADOW_VALUE_MAX must be at most ACI_PIPE_TX_DATA_MAX_LEN"
+#endif
+
+/************************************************************************/
+/* Automatic ACK/NACK of lib_aci_auto_ack_enable()                       */
+/* 1 : The ACI Library can answer the data received on ACI_RX_ACK pipes  */
+/*     itself, as soon as the ACI_EVT_DATA_RECEIVED is taken.            */
+/* 0 : Compiled out, the application calls lib_aci_send_ack().           */
+/************************************************************************/
+#ifndef LIB_ACI_AUTO_ACK
+#define LIB_ACI_AUTO_ACK 1
+#endif
+
+/************************************************************************/
+/* Indications in flight on the ACI_TX_ACK pipes                         */
+/* Number of lib_aci_send_data() on ACI_TX_ACK pipes that may wait for   */
+/* their ACI_EVT_DATA_ACK at the same time, per nRF8001, also bound by   */
+/* the data credits. Each ACI_EVT_DATA_ACK or ACI_EVT_PIPE_ERROR is      */
+/* matched back to its pipe. confirmation_pending is true while any is   */
+/* in flight. 0 compiles the tracking out.                               */
+/************************************************************************/
+#ifndef LIB_ACI_ACK_WINDOW
+#define LIB_ACI_ACK_WINDOW 0
+#endif
+
+#if (LIB_ACI_ACK_WINDOW && !LIB_ACI_CREDIT_TRACKING)
+#error "LIB_ACI_ACK_WINDOW needs LIB_ACI_CREDIT_TRACKING"
+#endif
+
+/************************************************************************/
+/* Startup profile of lib_aci_startup_profile_get()                      */
+/* 1 : The time from lib_aci_init() to the reset, the board init, the    */
+/*     setup messages, the end of the setup and the first advertising    */
+/*     are recorded with micros(), per nRF8001.                          */
+/* 0 : Compiled out.                                                     */
+/************************************************************************/
+#ifndef LIB_ACI_STARTUP_PROFILE
+#define LIB_ACI_STARTUP_PROFILE 0
+#endif
+
+/************************************************************************/
+/* Connection history of lib_aci_link_history_get()                      */
+/* N : The last N connections are recorded: their timing, the time with  */
+/*     every data credit in use, the pipe errors, the disconnect reason  */
+/*     and the connection duration. Kept across lib_aci_init(), about 32 */
+/*     bytes per connection.                                             */
+/* 0 : Compiled out.                                                     */
+/************************************************************************/
+#ifndef LIB_ACI_LINK_HISTORY
+#define LIB_ACI_LINK_HISTORY 0
+#endif
+
+#if ((LIB_ACI_LINK_HISTORY < 0) || (LIB_ACI_LINK_HISTORY > 32))
+#error "LIB_ACI_LINK_HISTORY must be 0 to 32"
+#endif
+
+/************************************************************************/
+/* Throughput estimate of lib_aci_throughput_get()                       */
+/* 1 : The credits the nRF8001 gives back per connection event while     */
+/*     every credit was in use are averaged. With the connection         */
+/*     interval they give the sustainable data rate, and the wait until  */
+/*     a number of credits is back (lib_aci_credit_wait_ms()).           */
+/* 0 : Compiled out.                                                     */
+/************************************************************************/
+#ifndef LIB_ACI_CREDIT_FORECAST
+#define LIB_ACI_CREDIT_FORECAST 0
+#endif
+
+#if (LIB_ACI_CREDIT_FORECAST && !LIB_ACI_CREDIT_TRACKING)
+#error "LIB_ACI_CREDIT_FORECAST needs LIB_ACI_CREDIT_TRACKING"
+#endif
+
+/************************************************************************/
+/* Producers of lib_aci_producer_set()                                   */
+/* N : Up to N pipes have a fill function, called by lib_aci as soon as  */
+/*     there is a credit and room in the command queue. It writes the    */
+/*     packet straight into the queue, so the data is taken as late as   */
+/*     possible and the link does not idle while a producer has data.    */
+/* 0 : Compiled out.                                                     */
+/************************************************************************/
+#ifndef LIB_ACI_PRODUCERS
+#define LIB_ACI_PRODUCERS 0
+#endif
+
+#if ((LIB_ACI_PRODUCERS < 0) || (LIB_ACI_PRODUCERS > 8))
+#error "LIB_ACI_PRODUCERS must be 0 to 8"
+#endif
+#if (LIB_ACI_PRODUCERS && !LIB_ACI_CREDIT_TRACKING)
+#error "LIB_ACI_PRODUCERS needs LIB_ACI_CREDIT_TRACKING"
+#endif
+
+/************************************************************************/
+/* SPI clock calibration of lib_aci_init()                               */
+/* 1 : lib_aci_init() puts the nRF8001 in Test mode and sends            */
+/*     LIB_ACI_SPI_CALIBRATION_ECHOES full length ACI Echo commands at   */
+/*     each SPI clock divider, from the fastest one within the 3MHz of   */
+/*     the nRF8001 down to the spi_clock_divider of aci_pins_t. The      */
+/*     dividers above 3MHz are never tried, an echo that passes there    */
+/*     does not make the clock reliable. The first divider with every    */
+/*     echo returned intact is kept in aci_pins_t spi_clock_divider,     */
+/*     and the nRF8001 leaves Test mode with the usual Device Started.   */
+/* 0 : Compiled out, the spi_clock_divider of the sketch is used as is.  */
+/************************************************************************/
+#ifndef LIB_ACI_SPI_CALIBRATION
+#define LIB_ACI_SPI_CALIBRATION 0
+#endif
+
+#ifndef LIB_ACI_SPI_CALIBRATION_ECHOES
+#define LIB_ACI_SPI_CALIBRATION_ECHOES 4
+#endif
+
+#if (LIB_ACI_SPI_CALIBRATION && ((LIB_ACI_SPI_CALIBRATION_ECHOES < 1) || (LIB_ACI_SPI_CALIBRATION_ECHOES > 255)))
+#error "LIB_ACI_SPI_CALIBRATION_ECHOES must be 1 to 255"
+#endif
+
+/************************************************************************/
+/* Automatic wakeup of the nRF8001                                       */
+/* 1 : A command issued after lib_aci_sleep() sends an ACI Wakeup first. */
+/*     The transport holds the command until the Device Started of the   */
+/*     wakeup, so the commands issued while the nRF8001 sleeps are sent  */
+/*     once it is back in Standby. Needs HAL_ACI_TL_TX_HOLD.             */
+/* 0 : The application wakes the nRF8001 before sending commands.        */
+/************************************************************************/
+#ifndef LIB_ACI_AUTO_WAKEUP
+#define LIB_ACI_AUTO_WAKEUP 0
+#endif
+
+#if (LIB_ACI_AUTO_WAKEUP && !HAL_ACI_TL_TX_HOLD)
+#error "LIB_ACI_AUTO_WAKEUP needs HAL_ACI_TL_TX_HOLD"
+#endif
+
+/************************************************************************/
+/* Advertising schedule of lib_aci_adv_schedule_set()                    */
+/* 1 : lib_aci advertises at a fast interval for a few seconds after the */
+/*     Device Started in Standby, a link loss or lib_aci_adv_schedule_   */
+/*     start(), then at a slow interval, without the application.        */
+/* 0 : Compiled out.                                                     */
+/************************************************************************/
+#ifndef LIB_ACI_ADV_SCHEDULE
+#define LIB_ACI_ADV_SCHEDULE 0
+#endif
+
+/************************************************************************/
+/* Pipe bitmaps of lib_aci_init()                                        */
+/* 1 : The pipe map is read once by lib_aci_init() into bitmaps of the   */
+/*     TX, TX_ACK, remote RX_REQ, remote RX and local pipes, and the     */
+/*     checks of the data commands are a single AND. Takes               */
+/*     5 * PIPES_ARRAY_SIZE bytes, with ACI_LOW_MEMORY the map itself    */
+/*     stays in flash.                                                   */
+/* 0 : The pipe map is read by every data command.                       */
+/************************************************************************/
+#ifndef LIB_ACI_PIPE_BITMAPS
+#define LIB_ACI_PIPE_BITMAPS 0
+#endif
+
+/************************************************************************/
+/* Commands of a transaction of lib_aci_transaction_begin()              */
+/* N : Up to N commands queued between lib_aci_transaction_begin() and   */
+/*     lib_aci_transaction_end() have their responses tracked, and one   */
+/*     callback reports the first failure or the success of them all.    */
+/*     Takes N + 12 bytes of RAM per nRF8001. 1 to 32.                   */
+/* 0 : Compiled out.                                                     */
+/************************************************************************/
+#ifndef LIB_ACI_TRANSACTION_CMDS
+#define LIB_ACI_TRANSACTION_CMDS 0
+#endif
+
+#if ((LIB_ACI_TRANSACTION_CMDS < 0) || (LIB_ACI_TRANSACTION_CMDS > 32))
+#error "LIB_ACI_TRANSACTION_CMDS must be 0 to 32"
+#endif
+
+/************************************************************************/
+/* Values staged with lib_aci_stage_local_data()                         */
+/* N : Up to N SET pipe values are kept, and queued in one batch in      */
+/*     Standby: at the Device Started in Standby and before the Connect, */
+/*     Bond, Connect Direct or Broadcast that starts the advertising.    */
+/*     Each takes ACI_PIPE_TX_DATA_MAX_LEN + 2 bytes. 1 to 16.           */
+/* 0 : Compiled out.                                                     */
+/************************************************************************/
+#ifndef LIB_ACI_STAGED_VALUES
+#define LIB_ACI_STAGED_VALUES 0
+#endif
+
+#if ((LIB_ACI_STAGED_VALUES < 0) || (LIB_ACI_STAGED_VALUES > 16))
+#error "LIB_ACI_STAGED_VALUES must be 0 to 16"
+#endif
+
+/************************************************************************/
+/* Retransmit pool of the SendData commands                              */
+/* N : Each packet sent is kept in one of N slots until its credit       */
+/*     comes back in ACI_EVT_DATA_CREDIT. A packet that failed with a    */
+/*     recoverable ACI_EVT_PIPE_ERROR (no credit, busy, pipe not open)   */
+/*     is sent again by lib_aci_event_get(),                             */
+/*     LIB_ACI_RETRANSMIT_INTERVAL_MS after the error, up to             */
+/*     LIB_ACI_RETRANSMIT_TRIES times. The other data commands take a    */
+/*     slot too, with every slot in use they are refused as without a    */
+/*     credit. N at least the credits of the nRF8001 (2) keeps them all  */
+/*     usable. Each slot takes ACI_PIPE_TX_DATA_MAX_LEN + 8 bytes.       */
+/*     Needs HAL_ACI_TL_DATA_MARKS, which tells the packet an error is   */
+/*     for. 1 to 8.                                                      */
+/* 0 : Compiled out, a packet that fails is lost.                        */
+/************************************************************************/
+#ifndef LIB_ACI_RETRANSMIT_SLOTS
+#define LIB_ACI_RETRANSMIT_SLOTS 0
+#endif
+
+/************************************************************************/
+/* Retransmit timing of LIB_ACI_RETRANSMIT_SLOTS                         */
+/* Milliseconds from a pipe error to the packet sent again, and the      */
+/* times it is sent again before it is given up. 1 to 255 each.          */
+/************************************************************************/
+#ifndef LIB_ACI_RETRANSMIT_INTERVAL_MS
+#define LIB_ACI_RETRANSMIT_INTERVAL_MS 10
+#endif
+
+#ifndef LIB_ACI_RETRANSMIT_TRIES
+#define LIB_ACI_RETRANSMIT_TRIES 3
+#endif
+
+#if ((LIB_ACI_RETRANSMIT_SLOTS < 0) || (LIB_ACI_RETRANSMIT_SLOTS > 8))
+#error "LIB_ACI_RETRANSMIT_SLOTS must be 0 to 8"
+#endif
+#if (LIB_ACI_RETRANSMIT_SLOTS && !LIB_ACI_CREDIT_TRACKING)
+#error "LIB_ACI_RETRANSMIT_SLOTS needs LIB_ACI_CREDIT_TRACKING"
+#endif
+#if (LIB_ACI_RETRANSMIT_SLOTS && !HAL_ACI_TL_DATA_MARKS)
+#error "LIB_ACI_RETRANSMIT_SLOTS needs HAL_ACI_TL_DATA_MARKS"
+#endif
+#if (LIB_ACI_RETRANSMIT_SLOTS && ACI_TX_ISR_QUEUE_BYTES)
+#error "LIB_ACI_RETRANSMIT_SLOTS does not keep the packets of lib_aci_send_data_from_isr(), ACI_TX_ISR_QUEUE_BYTES must be 0"
+#endif
+#if ((LIB_ACI_RETRANSMIT_INTERVAL_MS < 1) || (LIB_ACI_RETRANSMIT_INTERVAL_MS > 255))
+#error "LIB_ACI_RETRANSMIT_INTERVAL_MS must be 1 to 255"
+#endif
+#if ((LIB_ACI_RETRANSMIT_TRIES < 1) || (LIB_ACI_RETRANSMIT_TRIES > 255))
+#error "LIB_ACI_RETRANSMIT_TRIES must be 1 to 255"
+#endif
+
 /* Same size as a hal_aci_data_t */
 typedef struct {
   uint8_t   debug_byte;
@@ -57,12 +419,21 @@ typedef struct
   aci_pipe_type_t   pipe_type;
 } services_pipe_type_mapping_t;
 
+/* Storage of the sketch's services_pipe_type_mapping, read from PROGMEM with ACI_LOW_MEMORY */
+#if ACI_LOW_MEMORY
+#define ACI_PIPE_MAP_PROGMEM  PROGMEM
+#else
+#define ACI_PIPE_MAP_PROGMEM
+#endif
+
 typedef struct aci_setup_info_t
 {
   services_pipe_type_mapping_t *services_pipe_type_mapping;
   uint8_t                       number_of_pipes;
   hal_aci_data_t               *setup_msgs;
   uint8_t                       num_setup_msgs;
+  const uint8_t                *setup_msgs_compressed;  /* SETUP_MESSAGES_COMPRESSED_CONTENT in place of setup_msgs, ACI_SETUP_COMPRESSED */
+  const hal_aci_data_t * const *setup_msg_table;       /* Pointers to the setup messages in place of setup_msgs, ACI_SETUP_PROFILES */
 } aci_setup_info_t;
 
 
@@ -130,11 +501,140 @@ void lib_aci_pin_reset(void);
  *  @details This function shall be used to initialize/reset ACI Library and also Resets the 
  *           nRF8001 by togging the reset pin of the nRF8001. This function will reset 
  *           all the variables locally used by ACI library to their respective default values.
+ *           With LIB_ACI_SPI_CALIBRATION it also picks the fastest SPI clock, of 3MHz at most,
+ *           that passes the ACI Echo loopback and stores it in aci_stat->aci_pins.spi_clock_divider, the
+ *           ACI_EVT_DEVICE_STARTED that follows is the one the sketch expects.
  *  @param bool True if the data was successfully queued for sending, 
  *  false if there is no more space to store messages to send.
  */
 void lib_aci_init(aci_state_t *aci_stat, bool debug);
 
+/** @brief Non-blocking initialization function.
+ *  @details Starts the same initialization as lib_aci_init() but returns right away. The
+ *           reset, line settling and board initialization delays are then run by calling
+ *           lib_aci_init_poll() until it returns true, so other peripherals can be brought up
+ *           in the meantime. No other ACI Library function may be called until then.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param debug true to enable the debug printing of the ACI commands and events.
+ */
+void lib_aci_init_start(aci_state_t *aci_stat, bool debug);
+
+/** @brief Advances the initialization started by lib_aci_init_start().
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @return True when the initialization is complete.
+ */
+bool lib_aci_init_poll(aci_state_t *aci_stat);
+
+#if LIB_ACI_STARTUP_PROFILE
+/* Startup phases in us from the start of lib_aci_init() or lib_aci_init_start(), 0 until reached */
+typedef struct
+{
+  uint32_t reset_us;           // nRF8001 out of reset and lines settled, the transport is up
+  uint32_t board_init_us;      // Initialization done, with the radio reset of the boards that need it
+  uint32_t device_started_us;  // First ACI_EVT_DEVICE_STARTED
+  uint32_t setup_start_us;     // do_aci_setup() or aci_setup_poll() started the setup
+  uint32_t setup_complete_us;  // ACI_STATUS_TRANSACTION_COMPLETE of the setup
+  uint32_t standby_us;         // First ACI_EVT_DEVICE_STARTED in STANDBY
+  uint32_t advertising_us;     // Command response to the first Connect, Bond, Broadcast or ConnectDirect
+  uint8_t  setup_msgs;         // Setup messages answered
+  uint16_t setup_msg_min_us;   // Shortest and longest time from one setup response to the next,
+  uint16_t setup_msg_max_us;   // from the setup start for the first one
+} lib_aci_startup_profile_t;
+
+/** @brief Startup profile of the nRF8001.
+ *  @details Reset by lib_aci_init() and lib_aci_init_start(). The mean time of a setup message
+ *           is (setup_complete_us - setup_start_us) / setup_msgs.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param p_profile filled with the times recorded so far.
+ */
+void lib_aci_startup_profile_get(aci_state_t *aci_stat, lib_aci_startup_profile_t *p_profile);
+
+/** @brief Records the start of the setup, called by aci_setup.
+ */
+void lib_aci_startup_profile_setup_start(aci_state_t *aci_stat);
+#endif
+
+#if LIB_ACI_LINK_HISTORY
+/* One connection of lib_aci_link_history_get(), the timing in the units of ACI_EVT_TIMING */
+typedef struct
+{
+  uint32_t connected_ms;        // millis() at ACI_EVT_CONNECTED
+  uint32_t duration_ms;         // Connected to disconnected, 0 while connected
+  uint32_t starved_ms;          // Total time with every data credit in use, from the data command
+  uint16_t starved_max_ms;      // taking the last one to the next credit back, and the longest
+  uint16_t starved_count;
+  uint16_t interval;            // Connection interval (1.25 ms) at the connect, then after
+  uint16_t interval_min;        // each ACI_EVT_TIMING, with the smallest and largest seen
+  uint16_t interval_max;
+  uint16_t slave_latency;       // Last slave latency, and the largest seen
+  uint16_t slave_latency_max;
+  uint16_t supervision_timeout; // Last supervision timeout (10 ms)
+  uint8_t  timing_changes;      // ACI_EVT_TIMING events, saturated at 255
+  uint8_t  pipe_errors;         // ACI_EVT_PIPE_ERROR events, saturated at 255
+  uint8_t  aci_status;          // aci_status_code_t of ACI_EVT_DISCONNECTED, 0 while connected
+  uint8_t  btle_status;         // Disconnect reason, DISCONNECT_REASON_CX_TIMEOUT and the others
+} lib_aci_link_record_t;
+
+/** @brief Connections recorded, newest first.
+ *  @details The first record is the current connection while connected. Records are only
+ *           started by ACI_EVT_CONNECTED, the advertising timeouts are not recorded.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param p_records filled with up to max_records records.
+ *  @param max_records size of p_records.
+ *  @return Number of records copied.
+ */
+uint8_t lib_aci_link_history_get(aci_state_t *aci_stat, lib_aci_link_record_t *p_records, uint8_t max_records);
+
+/** @brief One connection recorded, without copying the others.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param index 0 for the newest, as the records of lib_aci_link_history_get().
+ *  @param p_record filled with the record.
+ *  @return False when fewer than index + 1 connections are recorded.
+ */
+bool lib_aci_link_history_read(aci_state_t *aci_stat, uint8_t index, lib_aci_link_record_t *p_record);
+
+/** @brief Forgets the connections recorded, the current one included.
+ *  @param aci_stat pointer to the state of the ACI.
+ */
+void lib_aci_link_history_clear(aci_state_t *aci_stat);
+#endif
+
+/* RAM of the BLE library, from lib_aci_ram_get() */
+typedef struct
+{
+  uint16_t transport;  // hal_aci_tl of all the instances, the command and event queues included
+  uint16_t library;    // lib_aci of all the instances and its event buffer
+  uint16_t setup;      // aci_setup of all the instances
+  uint16_t state;      // The aci_state_t of the sketch
+  uint16_t pipe_map;   // services_pipe_type_mapping of the sketch, 0 in PROGMEM (ACI_LOW_MEMORY)
+  uint16_t total;
+  uint16_t saved;      // By ACI_LOW_MEMORY: the smaller queues, the pipe map and the hal_aci_evt_t
+                       // given up for lib_aci_event_buffer(). 0 without ACI_LOW_MEMORY.
+} lib_aci_ram_t;
+
+/** @brief RAM used by the BLE library and saved by ACI_LOW_MEMORY.
+ *  @details Static RAM only, from the sizes of the buffers and states as they are built.
+ *           The queue saving is against the default of ACI_QUEUE_SIZE 4.
+ *  @param aci_stat pointer to the state of the ACI, for the number of pipes.
+ *  @param p_ram filled with the byte counts.
+ */
+void lib_aci_ram_get(aci_state_t *aci_stat, lib_aci_ram_t *p_ram);
+
+#if (HAL_ACI_INSTANCES > 1)
+/** @brief Selects the nRF8001 used by the ACI Library functions.
+ *  @details With more than one nRF8001 (HAL_ACI_INSTANCES), the nRF8001 is picked by
+ *           aci_stat->aci_pins.instance. The functions that take an aci_state_t select it
+ *           themselves, call this function before the ones that do not, e.g. lib_aci_send_data().
+ *  @param aci_stat pointer to the state of the ACI of the nRF8001.
+ */
+void lib_aci_select(aci_state_t *aci_stat);
+#else
+static inline void lib_aci_select(aci_state_t *aci_stat)
+{
+  (void)aci_stat;
+}
+#endif
+
 
 /** @brief Gets the number of currently available ACI credits.
  *  @return Number of ACI credits.
@@ -151,11 +651,61 @@ uint16_t lib_aci_get_cx_interval_ms(aci_state_t *aci_stat);
  */
 uint16_t lib_aci_get_cx_interval(aci_state_t *aci_stat);
 
+#if HAL_ACI_TL_EVENT_TIME
+/** @brief micros() when the event last got was clocked in, see hal_aci_tl_event_time_us().
+ *  @details Only available when HAL_ACI_TL_EVENT_TIME is 1. In place of the time the loop gets
+ *  to the event, e.g. to timestamp the data of an ACI_EVT_DATA_RECEIVED.
+ */
+uint32_t lib_aci_event_time_us(void);
+
+/** @brief Projects the next connection event.
+ *  @details Only available when HAL_ACI_TL_EVENT_TIME is 1. ACI_EVT_CONNECTED, ACI_EVT_TIMING,
+ *  ACI_EVT_DATA_CREDIT, ACI_EVT_DATA_ACK, ACI_EVT_DATA_RECEIVED and ACI_EVT_PIPE_STATUS are
+ *  clocked in right after a connection event, their time is taken as a boundary and moved on by
+ *  the connection interval. Data sent a little before the time given goes out in that connection
+ *  event, data sampled at that time is aligned with it. With slave latency the nRF8001 may skip
+ *  connection events it has nothing to send in, the boundaries stay on the same grid.
+ *  With lib_aci_event_get_many() every event of the batch takes the time of the last one.
+ *  @param p_time_us micros() at which the events of the next connection event are expected.
+ *  @return False when not connected, or no such event has come since the connection.
+ */
+bool lib_aci_conn_event_next(aci_state_t *aci_stat, uint32_t *p_time_us);
+#endif
+
 /** @brief Gets the current slave latency.
  *  @return Current slave latency.
  */
 uint16_t lib_aci_get_slave_latency(aci_state_t *aci_stat);
 
+#if LIB_ACI_CREDIT_FORECAST
+/* Data rate the link sustains, from lib_aci_throughput_get() */
+typedef struct
+{
+  uint32_t bytes_per_s;       // Full ACI_PIPE_TX_DATA_MAX_LEN packets, one per credit
+  uint16_t packets_per_s;
+  uint8_t  credits_per_event; // Credits back per connection event, in 1/16
+  bool     measured;          // False until the credits ran out once on this link, the estimate
+                              // is then one packet per slave latency + 1 connection events
+} lib_aci_throughput_t;
+
+/** @brief Estimates the data rate the link sustains.
+ *  @details Only available when LIB_ACI_CREDIT_FORECAST is 1. The credits given back by the
+ *  ACI_EVT_DATA_CREDIT that follow all the credits in use are averaged, so the estimate is that
+ *  of a sender that keeps the nRF8001 busy. A producer sizes its batches or its sampling rate to
+ *  it instead of overrunning the credits. All 0 when not connected.
+ *  @param p_throughput filled with the estimate.
+ */
+void lib_aci_throughput_get(aci_state_t *aci_stat, lib_aci_throughput_t *p_throughput);
+
+/** @brief Expected wait until a number of credits is available.
+ *  @details Only available when LIB_ACI_CREDIT_FORECAST is 1. From the estimate of
+ *  lib_aci_throughput_get(), in whole connection events.
+ *  @param credits credits wanted.
+ *  @return 0 when they are available now, 0xFFFFFFFF when not connected or above the total.
+ */
+uint32_t lib_aci_credit_wait_ms(aci_state_t *aci_stat, uint8_t credits);
+#endif
+
 /** @brief Checks if a given pipe is available.
  *  @param pipe Pipe to check.
  *  @return True if the pipe is available, otherwise false.
@@ -173,6 +723,18 @@ bool lib_aci_is_pipe_closed(aci_state_t *aci_stat, uint8_t pipe);
  */
 bool lib_aci_is_discovery_finished(aci_state_t *aci_stat);
 
+/** @brief Adds a pipe to a bitmap of pipes, for lib_aci_pipes_all_open().
+ *  @param p_pipes bitmap of PIPES_ARRAY_SIZE bytes, cleared by the caller.
+ *  @param pipe pipe to add.
+ */
+void lib_aci_pipes_add(uint8_t *p_pipes, uint8_t pipe);
+
+/** @brief Checks if all the pipes of a bitmap are open, such as the pipes the application needs.
+ *  @param p_pipes bitmap of PIPES_ARRAY_SIZE bytes.
+ *  @return True if every pipe of the bitmap is in pipes_open_bitmap.
+ */
+bool lib_aci_pipes_all_open(aci_state_t *aci_stat, const uint8_t *p_pipes);
+
 
 
 //@}
@@ -184,6 +746,7 @@ bool lib_aci_is_discovery_finished(aci_state_t *aci_stat);
  *  @details The function sends a @c sleep command to the radio.
  *  If the radio is advertising or connected, it sends back an error, then use lib_aci_radio_reset 
  *  if advertising or disconnect if in a connection.
+ *  With LIB_ACI_AUTO_WAKEUP the next command sends a @c Wakeup first.
  *  @return True if the transaction is successfully initiated.
  */
 bool lib_aci_sleep(void);
@@ -200,6 +763,7 @@ bool lib_aci_radio_reset(void);
  */
 bool lib_aci_direct_connect(void);
 
+#if ACI_FEATURE_DEVICE_INFO
 /** @brief Gets the radio's version.
  *  @details This function sends a @c GetDeviceVersion command.
  *  @return True if the transaction is successfully initiated.
@@ -224,6 +788,7 @@ bool lib_aci_get_temperature(void);
  *  @return True if the transaction is successfully initiated.
  */
 bool lib_aci_get_battery_level(void);
+#endif
 
 //@}
 
@@ -270,6 +835,7 @@ bool lib_aci_set_tx_power(aci_device_output_power_t tx_power);
  */
 bool lib_aci_connect(uint16_t run_timeout, uint16_t adv_interval);
 
+#if ACI_FEATURE_SECURITY
 /** @brief Tries to bond with a peer device.
  *  @details This function sends a @c Bond command to the radio.
  *  @param run_timeout Maximum advertising time in seconds (0 means infinite).
@@ -277,6 +843,7 @@ bool lib_aci_connect(uint16_t run_timeout, uint16_t adv_interval);
  *  @return True if the transaction is successfully initiated.
  */
 bool lib_aci_bond(uint16_t run_timeout, uint16_t adv_interval);
+#endif
 
 /** @brief Disconnects from peer device.
  *  @details This function sends a @c Disconnect command to the radio.
@@ -297,6 +864,51 @@ bool lib_aci_disconnect(aci_state_t *aci_stat, aci_disconnect_reason_t reason);
 */
 bool lib_aci_set_local_data(aci_state_t *aci_stat, uint8_t pipe, uint8_t *value, uint8_t size);
 
+/**@brief Sets Local Data without checking the pipe and the size.
+ *  @details
+ *  As lib_aci_set_local_data(), for a pipe stored locally and a size that fits it, known at compile
+ *  time. The accessors generated by Build/PipeAccessors.py from services.h call it, the size is
+ *  checked against PIPE_<name>_MAX_SIZE with a static_assert.
+ *  @param ACI state structure
+ *  @param pipe Pipe number on which the data should be set, must be stored locally.
+ *  @param value Pointer to the data to set.
+ *  @param size Size of the data to set, at most ACI_PIPE_TX_DATA_MAX_LEN.
+ *  @return True if the transaction is successfully initiated.
+*/
+bool lib_aci_set_local_data_unchecked(aci_state_t *aci_stat, uint8_t pipe, const uint8_t *value, uint8_t size);
+
+/**@brief Sets Local Data from a constant in flash.
+ *  @details
+ *  As lib_aci_set_local_data(), for a value in PROGMEM such as a fixed device information string:
+ *  @code
+ *  static const uint8_t model_number[] PROGMEM = "nRF8001 sensor";
+ *
+ *  lib_aci_set_local_data_P(&aci_state, PIPE_DEVICE_INFORMATION_MODEL_NUMBER_STRING_SET,
+ *                           model_number, sizeof(model_number) - 1);
+ *  @endcode
+ *  The value is read from flash into the command, it needs no buffer in RAM.
+ *  @param ACI state structure
+ *  @param pipe Pipe number on which the data should be set.
+ *  @param value_P Pointer to the data to set, in PROGMEM.
+ *  @param size Size of the data to set.
+ *  @return True if the transaction is successfully initiated.
+*/
+bool lib_aci_set_local_data_P(aci_state_t *aci_stat, uint8_t pipe, const uint8_t *value_P, uint8_t size);
+
+#if ACI_TX_ISR_QUEUE_BYTES
+/**@brief Sets Local Data from an interrupt.
+ *  @details
+ *  As lib_aci_set_local_data(), for a sensor or key interrupt that hands its value to the radio
+ *  without waiting for the loop. The command is encoded on the stack of the interrupt and queued
+ *  with hal_aci_tl_send_from_isr(), see there for the interrupts it can be called from. The value
+ *  is not coalesced nor checked against LIB_ACI_SHADOW_PIPES, set a pipe either from the loop or
+ *  from the interrupt. Nothing is queued while the nRF8001 sleeps (LIB_ACI_AUTO_WAKEUP).
+ *  @return True if the command was queued.
+*/
+bool lib_aci_set_local_data_from_isr(aci_state_t *aci_stat, uint8_t pipe, const uint8_t *value, uint8_t size);
+#endif
+
+#if ACI_FEATURE_BROADCAST
 /** @brief Sends Broadcast message to the radio.
  *  @details The Broadcast message starts advertisement procedure 
  *  using the given interval with the intention of broadcasting data to a peer device.
@@ -307,9 +919,11 @@ bool lib_aci_set_local_data(aci_state_t *aci_stat, uint8_t pipe, uint8_t *value,
  *  @return True if the broadcast message is sent successfully to the radio. 
 */
 bool lib_aci_broadcast(const uint16_t timeout, const uint16_t adv_interval);
+#endif
 
 /** @name Open Advertising Pipes.  */
 
+#if ACI_FEATURE_BROADCAST
 /** @brief Sends a command to the radio to set the input pipe to be placed in Advertisement Service Data.
  *  @details This function sends a command to the radio that places the pipe in 
  *  advertisement service data.  To start advertising service data, call this function before
@@ -320,10 +934,12 @@ bool lib_aci_broadcast(const uint16_t timeout, const uint16_t adv_interval);
  *  @return True if the Open Adv Pipe message is sent successfully to the radio. 
 */
 bool lib_aci_open_adv_pipe(const uint8_t pipe);
+#endif
 
 
 /** @name Open Advertising Pipes  */
 
+#if ACI_FEATURE_BROADCAST
 /** @brief Sends a command to the radio to set the pipes to be placed in Advertisement Service Data.
  *  @details This function will send a command to the radio that will set the pipes to be placed in 
  *  advertisement Service Data.  To start advertising service data, this function should be called before
@@ -336,6 +952,7 @@ bool lib_aci_open_adv_pipe(const uint8_t pipe);
  *  @return true if the Open Adv Pipe message was sent successfully to the radio. 
 */
 bool lib_aci_open_adv_pipes(const uint8_t * const adv_service_data_pipes);
+#endif
 
 
 //@}
@@ -350,6 +967,7 @@ bool lib_aci_open_adv_pipes(const uint8_t * const adv_service_data_pipes);
  */
 bool lib_aci_set_app_latency(uint16_t latency, aci_app_latency_mode_t latency_mode);
 
+#if ACI_FEATURE_REMOTE_PIPES
 /** @brief Opens a remote pipe.
  *  @details This function sends an @c OpenRemotePipe command.
  *  @param pipe Number of the pipe to open.
@@ -363,11 +981,12 @@ bool lib_aci_open_remote_pipe(aci_state_t *aci_stat, uint8_t pipe);
  *  @return True if the transaction is successfully initiated.
  */
 bool lib_aci_close_remote_pipe(aci_state_t *aci_stat, uint8_t pipe);
+#endif
 
 /** @brief Sends data on a given pipe.
  *  @details This function sends a @c SendData command with application data to
  *  the radio. This function memorizes credit use, and checks that
- *  enough credits are available.
+ *  enough credits are available (LIB_ACI_CREDIT_TRACKING).
  *  @param pipe Pipe number on which the data should be sent.
  *  @param value Pointer to the data to send.
  *  @param size Size of the data to send.
@@ -375,15 +994,238 @@ bool lib_aci_close_remote_pipe(aci_state_t *aci_stat, uint8_t pipe);
  */
 bool lib_aci_send_data(uint8_t pipe, uint8_t *value, uint8_t size);
 
+/** @brief Sends data on a given pipe without checking the pipe and the size.
+ *  @details As lib_aci_send_data(), for an ACI_TX or ACI_TX_ACK pipe and a size that fits it,
+ *  known at compile time. The accessors generated by Build/PipeAccessors.py from services.h call
+ *  it, the size is checked against PIPE_<name>_MAX_SIZE with a static_assert.
+ *  @param pipe Pipe number on which the data should be sent, must be a transmit pipe.
+ *  @param value Pointer to the data to send.
+ *  @param size Size of the data to send, at most ACI_PIPE_TX_DATA_MAX_LEN.
+ *  @return True if the transaction is successfully initiated.
+ */
+bool lib_aci_send_data_unchecked(uint8_t pipe, const uint8_t *value, uint8_t size);
+
+/** @brief Sends data from a constant in flash on a given pipe.
+ *  @details As lib_aci_send_data(), for a payload in PROGMEM such as a fixed HID report or a test
+ *  pattern. The payload is read from flash straight into the slot of the command queue. With
+ *  LIB_ACI_SHADOW_PIPES the slot is compared with the value sent before, so an unchanged value
+ *  still needs a data credit and a free slot to be found unchanged.
+ *  @param pipe Pipe number on which the data should be sent.
+ *  @param value_P Pointer to the data to send, in PROGMEM.
+ *  @param size Size of the data to send.
+ *  @return True if the transaction is successfully initiated.
+ */
+bool lib_aci_send_data_P(uint8_t pipe, const uint8_t *value_P, uint8_t size);
+
+#if ACI_TX_ISR_QUEUE_BYTES
+/** @brief Sends data on a given pipe from an interrupt.
+ *  @details As lib_aci_send_data(), the command is encoded on the stack of the interrupt and
+ *  queued with hal_aci_tl_send_from_isr(), see there for the interrupts it can be called from.
+ *  The credit is taken the same way (LIB_ACI_CREDIT_TRACKING), the loop then changes the count of
+ *  credits with the interrupts disabled. With LIB_ACI_ACK_WINDOW only ACI_TX pipes can be used.
+ *  The data is not checked against LIB_ACI_SHADOW_PIPES. Nothing is queued while the nRF8001
+ *  sleeps (LIB_ACI_AUTO_WAKEUP).
+ *  @return True if the command was queued.
+ */
+bool lib_aci_send_data_from_isr(aci_state_t *aci_stat, uint8_t pipe, const uint8_t *value, uint8_t size);
+#endif
+
+#if LIB_ACI_ACK_WINDOW
+/** @brief Gets the number of packets sent on an ACI_TX_ACK pipe still waiting for their ACI_EVT_DATA_ACK.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param pipe Pipe number, 0 for all the pipes.
+ */
+uint8_t lib_aci_ack_in_flight(aci_state_t *aci_stat, uint8_t pipe);
+#endif
+
+#if LIB_ACI_RETRANSMIT_SLOTS
+/* From lib_aci_retransmit_stats_get() */
+typedef struct
+{
+  uint16_t retries;    // Packets sent again after a recoverable ACI_EVT_PIPE_ERROR
+  uint16_t recovered;  // Packets sent again whose credit came back
+  uint16_t dropped;    // Packets given up: error not recoverable, LIB_ACI_RETRANSMIT_TRIES used, or disconnected
+  uint16_t refused;    // Data commands refused with every slot in use
+} lib_aci_retransmit_stats_t;
+
+/** @brief Gets the number of packets waiting to be sent again after a pipe error.
+ *  @details lib_aci_send_data() refuses the packets of a pipe that has one waiting, so they stay
+ *           in order behind it. The packets already in flight behind the failed one are not held back.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param pipe Pipe number, 0 for all the pipes.
+ */
+uint8_t lib_aci_retransmit_pending(aci_state_t *aci_stat, uint8_t pipe);
+
+/** @brief Gets the counters of the retransmit pool, since lib_aci_init().
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param p_stats filled with the counters.
+ */
+void lib_aci_retransmit_stats_get(aci_state_t *aci_stat, lib_aci_retransmit_stats_t *p_stats);
+#endif
+
+#if LIB_ACI_SHADOW_PIPES
+/** @brief Keeps the last value given to the nRF8001 on a pipe, so the same value is not sent again.
+ *  @details The pipe is a SET pipe of lib_aci_set_local_data() or a TX or TX_ACK pipe of
+ *  lib_aci_send_data(). A value of up to 4 bytes is read as an unsigned integer, LSB first:
+ *  it is only sent when it differs from the last one sent by deadband or more. Longer values
+ *  are only sent when they differ. The value is forgotten when the nRF8001 restarts, for a TX
+ *  pipe also on a pipe error, on disconnect and when the peer closes the pipe, so the next value
+ *  is always sent.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param pipe Pipe number, enabled again to change the deadband.
+ *  @param deadband Smallest change sent, 0 or 1 for any change.
+ *  @return False if the pipe is not a SET or TX pipe, or if LIB_ACI_SHADOW_PIPES are in use.
+ */
+bool lib_aci_shadow_enable(aci_state_t *aci_stat, uint8_t pipe, uint16_t deadband);
+
+/** @brief Forgets the last value of a pipe, the next one is sent whatever it is.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param pipe Pipe number, 0 for all the shadowed pipes.
+ */
+void lib_aci_shadow_invalidate(aci_state_t *aci_stat, uint8_t pipe);
+
+/** @brief Gets the number of values that were not sent, being the same as the last one.
+ */
+uint16_t lib_aci_shadow_suppressed(aci_state_t *aci_stat);
+#endif
+
+#if LIB_ACI_STAGED_VALUES
+/** @brief Records the value a local pipe should have, to be sent before the next advertising.
+ *  @details
+ *  The value can be staged at any time after lib_aci_init(), e.g. when it changes during a
+ *  connection. It replaces the value staged before on the same pipe. The staged values are
+ *  queued as SetLocalData at the Device Started in Standby and before the command that starts
+ *  the advertising, so the first connection events carry the data of the application.
+ *  Use lib_aci_set_local_data() for a value needed during the connection.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param pipe local pipe, as for lib_aci_set_local_data().
+ *  @param p_value the value, copied.
+ *  @param size length of the value.
+ *  @return False if the pipe is not a local pipe, the value is too long or the
+ *  LIB_ACI_STAGED_VALUES entries hold other pipes.
+ */
+bool lib_aci_stage_local_data(aci_state_t *aci_stat, uint8_t pipe, const uint8_t *p_value, uint8_t size);
+
+/** @brief Queues the staged values now, in the order they were first staged.
+ *  @details
+ *  A value that does not fit in the command queue stays staged for the next time.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @return True if no value is left staged.
+ */
+bool lib_aci_stage_flush(aci_state_t *aci_stat);
+#endif
+
+#if LIB_ACI_STREAM_BYTES
+/** Called when all the data given to lib_aci_send_stream() has been sent to the nRF8001 */
+typedef void (*lib_aci_stream_cb_t)(uint8_t pipe);
+
+/** @brief Sends a buffer of any length on a given pipe.
+ *  @details The data is copied to the stream buffer (LIB_ACI_STREAM_BYTES) and sent in
+ *  @c SendData commands of up to ACI_PIPE_TX_DATA_MAX_LEN bytes as data credits come back,
+ *  from ACI_EVT_DATA_CREDIT and the other events taken with lib_aci_event_get().
+ *  While the credits are in use the data adds up, so the packets are full when it streams.
+ *  Only one pipe can be streamed at a time. The stream buffer is emptied on disconnect.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param pipe Pipe number on which the data should be sent.
+ *  @param p_data Pointer to the data to send.
+ *  @param length Size of the data to send.
+ *  @return Number of bytes taken, less than length when the stream buffer is full.
+ *  0 when another pipe is being streamed.
+ */
+uint8_t lib_aci_send_stream(aci_state_t *aci_stat, uint8_t pipe, const uint8_t *p_data, uint8_t length);
+
+/** @brief Gets the number of stream bytes not sent to the nRF8001 yet.
+ */
+uint8_t lib_aci_stream_pending(aci_state_t *aci_stat);
+
+/** @brief Sets the function called when the stream buffer has been sent, NULL for none.
+ */
+void lib_aci_stream_set_callback(aci_state_t *aci_stat, lib_aci_stream_cb_t stream_cb);
+#endif
+
+#if LIB_ACI_PRODUCERS
+/** Writes the next packet of a pipe, called when it can be sent right away.
+ *  @param pipe the pipe of lib_aci_producer_set().
+ *  @param p_data the payload of the SendData command in the command queue.
+ *  @param max_length ACI_PIPE_TX_DATA_MAX_LEN.
+ *  @return Bytes written, 0 when there is nothing to send now.
+ */
+typedef uint8_t (*lib_aci_fill_cb_t)(uint8_t pipe, uint8_t *p_data, uint8_t max_length);
+
+/** @brief Sets the function that fills the packets of an ACI_TX pipe, NULL to remove it.
+ *  @details Only available when LIB_ACI_PRODUCERS is not 0. The fill functions are called in
+ *  turn after each event taken with lib_aci_event_get() and by lib_aci_producer_kick(), while the
+ *  pipe is open and there is a credit and room for the command. They must not send ACI commands.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param pipe an ACI_TX pipe.
+ *  @param fill_cb the fill function.
+ *  @return False when the pipe is not an ACI_TX pipe or all the LIB_ACI_PRODUCERS are in use.
+ */
+bool lib_aci_producer_set(aci_state_t *aci_stat, uint8_t pipe, lib_aci_fill_cb_t fill_cb);
+
+/** @brief Calls the fill functions now, when a producer has new data between events.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @return Number of packets queued.
+ */
+uint8_t lib_aci_producer_kick(aci_state_t *aci_stat);
+#endif
+
+#if LIB_ACI_ADV_SCHEDULE
+/* Advertising of lib_aci_adv_schedule_set(), the intervals in 0.625 ms units (0x0020 to 0x4000) */
+typedef struct
+{
+  uint16_t fast_interval;
+  uint16_t fast_timeout_s;      // 1 or more, the slow advertising starts when it times out
+  uint16_t slow_interval;
+  uint16_t slow_timeout_s;      // 0 to advertise until connected
+  bool     bond;                // lib_aci_bond() while aci_stat->bonded is not ACI_BOND_STATUS_SUCCESS
+  bool     restart;             // Started by the Device Started in Standby and a link loss
+} lib_aci_adv_schedule_t;
+
+typedef enum
+{
+  LIB_ACI_ADV_IDLE,             // Not advertising for the schedule, or connected
+  LIB_ACI_ADV_FAST,
+  LIB_ACI_ADV_SLOW
+} lib_aci_adv_phase_t;
+
+/** @brief Sets the advertising schedule, NULL to stop scheduling.
+ *  @details Only available when LIB_ACI_ADV_SCHEDULE is 1. lib_aci sends the Connect (or the Bond)
+ *  at fast_interval for fast_timeout_s, and when it times out at slow_interval for slow_timeout_s.
+ *  With restart, the fast advertising is started by the Device Started in Standby and by a
+ *  disconnect other than an advertising timeout. A command that does not fit in the command queue
+ *  is sent after the next event. The sketch does not send its own Connect or Bond meanwhile.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param p_schedule the schedule, copied, kept across lib_aci_init().
+ */
+void lib_aci_adv_schedule_set(aci_state_t *aci_stat, const lib_aci_adv_schedule_t *p_schedule);
+
+/** @brief Starts the fast advertising now, on a button press.
+ *  @details In the slow advertising, a Disconnect stops it first and the fast advertising starts
+ *  with the ACI_EVT_DISCONNECTED.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @return False when there is no schedule, the nRF8001 is connected or the command does not fit
+ *  in the command queue.
+ */
+bool lib_aci_adv_schedule_start(aci_state_t *aci_stat);
+
+/** @brief Gets the lib_aci_adv_phase_t of the schedule.
+ */
+uint8_t lib_aci_adv_schedule_phase(aci_state_t *aci_stat);
+#endif
+
+#if ACI_FEATURE_REMOTE_PIPES
 /** @brief Requests data from a given pipe.
  *  @details This function sends a @c RequestData command to the radio. This
- *  function memorizes credit uses, and check that enough credits are available.
+ *  function memorizes credit uses, and check that enough credits are available
+ *  (LIB_ACI_CREDIT_TRACKING).
  *  After this command, the radio sends back either a @c DataReceivedEvent
  *  or a @c PipeErrorEvent.
  *  @param pipe Pipe number on which the data is requested.
  *  @return True if the transaction is successfully initiated.
  */
 bool lib_aci_request_data(aci_state_t *aci_stat, uint8_t pipe);
+#endif
 
 /** @brief Sends a L2CAP change connection parameters request.
  *  @details This function sends a @c ChangeTiming command to the radio.  This command triggers a "L2CAP change connection parameters" request 
@@ -413,6 +1255,55 @@ bool lib_aci_change_timing(uint16_t minimun_cx_interval, uint16_t maximum_cx_int
  */
 bool lib_aci_change_timing_GAP_PPCP(void);
 
+/** @name Prebuilt commands
+ *  @details Commands with parameters that are known when the sketch is compiled can be built
+ *  by the compiler into a ::hal_aci_data_t in flash and queued with lib_aci_send_cmd_P(), e.g.
+ *  @code
+ *  static const hal_aci_data_t timing_cmd PROGMEM = LIB_ACI_CMD_CHANGE_TIMING(11, 18, 0, 600);
+ *  lib_aci_send_cmd_P(&timing_cmd);
+ *  @endcode
+ *  The parameters are not range checked, use the same values as for the lib_aci_* functions.
+ *  aci_cmd_builder.h builds the same commands with the ranges checked by the compiler, for
+ *  the sketches compiled as C++11.
+ */
+#define LIB_ACI_CMD_U16(value) (uint8_t)((uint16_t)(value) & 0xFF), (uint8_t)((uint16_t)(value) >> 8)
+
+#define LIB_ACI_CMD_CONNECT(run_timeout, adv_interval) \
+  { 0, { MSG_CONNECT_LEN, ACI_CMD_CONNECT, LIB_ACI_CMD_U16(run_timeout), LIB_ACI_CMD_U16(adv_interval) } }
+
+#define LIB_ACI_CMD_BOND(run_timeout, adv_interval) \
+  { 0, { MSG_BOND_LEN, ACI_CMD_BOND, LIB_ACI_CMD_U16(run_timeout), LIB_ACI_CMD_U16(adv_interval) } }
+
+#define LIB_ACI_CMD_BROADCAST(timeout, adv_interval) \
+  { 0, { MSG_BROADCAST_LEN, ACI_CMD_BROADCAST, LIB_ACI_CMD_U16(timeout), LIB_ACI_CMD_U16(adv_interval) } }
+
+#define LIB_ACI_CMD_CHANGE_TIMING(min_cx_interval, max_cx_interval, slave_latency, timeout) \
+  { 0, { MSG_CHANGE_TIMING_LEN, ACI_CMD_CHANGE_TIMING, LIB_ACI_CMD_U16(min_cx_interval), \
+         LIB_ACI_CMD_U16(max_cx_interval), LIB_ACI_CMD_U16(slave_latency), LIB_ACI_CMD_U16(timeout) } }
+
+#define LIB_ACI_CMD_SET_APP_LATENCY(latency, latency_mode) \
+  { 0, { MSG_SET_APP_LATENCY_LEN, ACI_CMD_SET_APP_LATENCY, (uint8_t)(latency_mode), LIB_ACI_CMD_U16(latency) } }
+
+#define LIB_ACI_CMD_SET_TX_POWER(tx_power) \
+  { 0, { MSG_SET_RADIO_TX_POWER_LEN, ACI_CMD_SET_TX_POWER, (uint8_t)(tx_power) } }
+
+/* Bit of the pipe in byte byte_idx of a pipe bitmap */
+#define LIB_ACI_CMD_PIPE_BIT(pipe, byte_idx) (uint8_t)((((pipe) / 8) == (byte_idx)) ? (1 << ((pipe) % 8)) : 0)
+
+/* Opens a single advertising pipe, the pipes opened by lib_aci_open_adv_pipe() are not kept */
+#define LIB_ACI_CMD_OPEN_ADV_PIPE(pipe) \
+  { 0, { MSG_OPEN_ADV_PIPES_LEN, ACI_CMD_OPEN_ADV_PIPE, \
+         LIB_ACI_CMD_PIPE_BIT(pipe, 0), LIB_ACI_CMD_PIPE_BIT(pipe, 1), LIB_ACI_CMD_PIPE_BIT(pipe, 2), \
+         LIB_ACI_CMD_PIPE_BIT(pipe, 3), LIB_ACI_CMD_PIPE_BIT(pipe, 4), LIB_ACI_CMD_PIPE_BIT(pipe, 5), \
+         LIB_ACI_CMD_PIPE_BIT(pipe, 6), LIB_ACI_CMD_PIPE_BIT(pipe, 7) } }
+
+/** @brief Queues a command built in flash by one of the LIB_ACI_CMD_* initializers.
+ *  @details The command is copied straight from flash into the command queue.
+ *  @param p_cmd_P Pointer to the command in PROGMEM.
+ *  @return True if the command was queued, false if the command queue is full.
+ */
+bool lib_aci_send_cmd_P(const hal_aci_data_t *p_cmd_P);
+
 /** @brief Sends acknowledgement message to peer.
  *  @details This function sends @c SendDataAck command to radio. The radio is expected 
  *  to send either Handle Value Confirmation or Write response depending
@@ -431,6 +1322,33 @@ bool lib_aci_send_ack(aci_state_t *aci_stat, const uint8_t pipe);
 */
 bool lib_aci_send_nack(aci_state_t *aci_stat, const uint8_t pipe, const uint8_t error_code);
 
+#if LIB_ACI_AUTO_ACK
+/** @brief Checks the data received on a pipe answered by the ACI Library.
+ *  @return 0 to send an ACK, else the error code of the NACK.
+ */
+typedef uint8_t (*lib_aci_ack_check_t)(aci_state_t *aci_stat, uint8_t pipe, const uint8_t *p_data, uint8_t length);
+
+/** @brief Lets the ACI Library answer the data received on an ACI_RX_ACK pipe.
+ *  @details The @c SendDataAck, or the @c SendDataNack asked for by the check function, is
+ *  queued when lib_aci_event_get(), lib_aci_event_get_many() or lib_aci_event_release()
+ *  takes the ACI_EVT_DATA_RECEIVED, before the event reaches the application.
+ *  The application must not call lib_aci_send_ack() for this pipe. When the answer cannot be
+ *  queued, e.g. when no data credit is left, it is kept for its pipe and sent from the next
+ *  events, for every pipe waiting.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param pipe ACI_RX_ACK pipe number.
+ *  @param enable true to answer the pipe, false to leave it to the application.
+ *  @return False if the pipe is not an ACI_RX_ACK pipe.
+ */
+bool lib_aci_auto_ack_enable(aci_state_t *aci_stat, uint8_t pipe, bool enable);
+
+/** @brief Sets the function that checks the data before it is answered, NULL to always ACK.
+ *  @details The function is called for each pipe answered by the ACI Library, with the pipe number.
+ */
+void lib_aci_auto_ack_set_check(aci_state_t *aci_stat, lib_aci_ack_check_t ack_check);
+#endif
+
+#if ACI_FEATURE_DYNAMIC_DATA
 /** @brief Sends ReadDynamicData command to the host. 
  *  @details This function sends @c ReadDynamicData command to host. The host is expected 
  *  to send @c CommandResponse back with the dynamic data. The application is expected to 
@@ -457,11 +1375,13 @@ bool lib_aci_read_dynamic_data(void);
  *  @return True if the command was sent successfully through the ACI. False otherwise.
 */
 bool lib_aci_write_dynamic_data(uint8_t sequence_number, uint8_t* dynamic_data, uint8_t length);
+#endif
 //@}
 
 /** @name ACI commands available while connected in Bond mode */
 //@{
 
+#if ACI_FEATURE_SECURITY
 /** @brief Sends a SMP Security Request.
  *  @details This function send a @c BondRequest command to the radio.
  *  This command triggers a SMP Security Request to the master. If the
@@ -478,6 +1398,7 @@ bool lib_aci_bond_request(void);
  *  @return True if the transaction is successfully initiated.
 */
 bool lib_aci_set_key(aci_key_type_t key_rsp_type, uint8_t *key, uint8_t len);
+#endif
 
 //@}
 
@@ -495,6 +1416,7 @@ bool lib_aci_set_key(aci_key_type_t key_rsp_type, uint8_t *key, uint8_t len);
 */
 bool lib_aci_echo_msg(uint8_t message_size, uint8_t *message_data);
 
+#if ACI_FEATURE_DTM
 /** @brief Sends an DTM command
  *  @details This function sends an @c DTM command to the radio. 
  *  @param dtm_command_msbyte Most significant byte of the DTM command.
@@ -502,16 +1424,178 @@ bool lib_aci_echo_msg(uint8_t message_size, uint8_t *message_data);
  *  @return True if the transaction is successfully initiated.
 */
 bool lib_aci_dtm_command(uint8_t dtm_command_msbyte, uint8_t dtm_command_lsbyte);
+#endif
+
+#if LIB_ACI_DISPATCH
+/** Handler of an ACI event, the event must not be modified */
+typedef void (*lib_aci_evt_handler_t)(aci_state_t *aci_stat, const aci_evt_t *p_evt);
+
+/** Entries of the opcode table, one per event from ACI_EVT_DEVICE_STARTED to ACI_EVT_KEY_REQUEST */
+#define LIB_ACI_EVT_HANDLER_COUNT       (ACI_EVT_KEY_REQUEST - ACI_EVT_DEVICE_STARTED + 1)
+
+/** Index of the handler of evt_opcode in the opcode table */
+#define LIB_ACI_EVT_HANDLER_INDEX(evt_opcode)  ((evt_opcode) - ACI_EVT_DEVICE_STARTED)
+
+/** @brief Registers the tables of the event handlers.
+ *  @details Every event taken with lib_aci_event_get(), lib_aci_event_get_many() or
+ *  lib_aci_event_release() is given to its handler, found by a table lookup. An
+ *  ACI_EVT_DATA_RECEIVED goes to the handler of its pipe in p_pipe_handlers, or to the opcode
+ *  handler when the pipe has none. NULL entries are skipped.
+ *  The events are still returned to the application, which only has to handle the ones that
+ *  have no handler. A handler may send commands but must not take events.
+ *  Both tables must be in PROGMEM, e.g.
+ *  @code
+ *  static const lib_aci_evt_handler_t evt_handlers[LIB_ACI_EVT_HANDLER_COUNT] PROGMEM = { ... };
+ *  @endcode
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param p_evt_handlers LIB_ACI_EVT_HANDLER_COUNT handlers in opcode order, NULL for none.
+ *  @param p_pipe_handlers handlers indexed by pipe number, entry 0 is not used. NULL for none.
+ *  @param pipe_handler_count number of entries in p_pipe_handlers.
+ */
+void lib_aci_dispatch_set(aci_state_t *aci_stat, const lib_aci_evt_handler_t *p_evt_handlers,
+                          const lib_aci_evt_handler_t *p_pipe_handlers, uint8_t pipe_handler_count);
+
+#if LIB_ACI_DISPATCH_PROFILE
+/** Time spent in the handler of an opcode or a pipe, from lib_aci_handler_time_get() */
+typedef struct
+{
+  uint16_t count;     /**< Calls of the handler, stops at 0xFFFF */
+  uint32_t total_us;  /**< Time in the handler, stops at 0xFFFFFFFF */
+  uint32_t max_us;    /**< Longest call */
+} lib_aci_handler_time_t;
+
+/** @brief Gets the time spent in the handler of an event opcode, or of a pipe.
+ *  @details
+ *  The time of a handler that sends commands includes the time to queue them. Call it from
+ *  the loop and print the figures, e.g. on a key press, to find the handlers that take too long.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param evt_opcode opcode of the event, ACI_EVT_DEVICE_STARTED to ACI_EVT_KEY_REQUEST.
+ *  @param pipe with ACI_EVT_DATA_RECEIVED, the pipe whose handler is asked for, below
+ *  LIB_ACI_DISPATCH_PROFILE_PIPES. 0 for the opcode handler, which also has the data of the
+ *  other pipes.
+ *  @param p_time filled with the figures.
+ *  @return False if the opcode or the pipe is out of range.
+ */
+bool lib_aci_handler_time_get(aci_state_t *aci_stat, uint8_t evt_opcode, uint8_t pipe, lib_aci_handler_time_t *p_time);
+
+/** @brief Clears the handler times of lib_aci_handler_time_get()
+ */
+void lib_aci_handler_time_reset(aci_state_t *aci_stat);
+#endif
+#endif
+
+#if LIB_ACI_PENDING_CMDS
+/** @brief Called with the command response of a command given to lib_aci_cmd_expect().
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param cmd_opcode opcode of the command.
+ *  @param p_rsp the command response, NULL when it did not come in time.
+ */
+typedef void (*lib_aci_cmd_cb_t)(aci_state_t *aci_stat, uint8_t cmd_opcode, const aci_evt_params_cmd_rsp_t *p_rsp);
+
+/** @brief Waits for the response of a queued command without blocking.
+ *  @details Call this after the command has been queued, e.g. after lib_aci_get_temperature()
+ *  returned true. The nRF8001 answers the commands in order, so the next ACI_EVT_CMD_RSP
+ *  for cmd_opcode not matched yet goes to cmd_cb. Several commands, also with the same opcode,
+ *  can be in flight, up to LIB_ACI_PENDING_CMDS.
+ *  The responses are matched and the timeouts checked by lib_aci_event_get(),
+ *  lib_aci_event_get_many() and lib_aci_event_release(). The events are still returned.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param cmd_opcode opcode of the command, aci_cmd_opcode_t.
+ *  @param cmd_cb function called with the response or on timeout.
+ *  @param timeout_ms time to wait for the response in milliseconds, 0 to wait forever.
+ *  @return False if LIB_ACI_PENDING_CMDS commands are already waited for.
+ */
+bool lib_aci_cmd_expect(aci_state_t *aci_stat, uint8_t cmd_opcode, lib_aci_cmd_cb_t cmd_cb, uint16_t timeout_ms);
+
+/** @brief Gets the number of command responses waited for.
+ */
+uint8_t lib_aci_cmd_pending(aci_state_t *aci_stat);
+#endif
+
+#if LIB_ACI_TRANSACTION_CMDS
+/** Outcome of a transaction, given once to its lib_aci_transaction_cb_t */
+typedef struct
+{
+  uint8_t cmd_count;   /**< Commands of the transaction */
+  uint8_t rsp_count;   /**< Command responses received */
+  uint8_t cmd_opcode;  /**< aci_cmd_opcode_t of the first command that failed, 0 when none did */
+  uint8_t status;      /**< aci_status_code_t of it, ACI_STATUS_SUCCESS when every command succeeded,
+                            ACI_STATUS_ERROR_BUSY when it did not fit in the command queue or
+                            was one too many, ACI_STATUS_ERROR_UNKNOWN when its response did
+                            not come in time */
+  bool    timed_out;   /**< Not every response came before the timeout of lib_aci_transaction_end() */
+} lib_aci_transaction_result_t;
+
+/** @brief Called once when every command of a transaction has its response, or on timeout.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param p_result the outcome, valid during the call.
+ */
+typedef void (*lib_aci_transaction_cb_t)(aci_state_t *aci_stat, const lib_aci_transaction_result_t *p_result);
+
+/** @brief Starts a transaction, the commands queued next are part of it.
+ *  @details
+ *  The commands queued by the lib_aci functions until lib_aci_transaction_end(), e.g. the
+ *  lib_aci_set_local_data(), lib_aci_change_timing() and lib_aci_open_remote_pipe() of the
+ *  connection setup, are queued back to back and their responses are tracked in order.
+ *  A command that does not fit in the command queue, or past LIB_ACI_TRANSACTION_CMDS, fails
+ *  the transaction, the commands queued before it are still sent. lib_aci_echo(), lib_aci_sleep(), lib_aci_wakeup() and
+ *  the data commands have no command response and are not tracked.
+ *  The responses are matched in order of the commands, by opcode: the commands queued before
+ *  the transaction should not be of the same opcodes and still waiting for their responses.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @return False if a transaction is already being built or waiting for its responses.
+ */
+bool lib_aci_transaction_begin(aci_state_t *aci_stat);
+
+/** @brief Ends the building of the transaction of lib_aci_transaction_begin().
+ *  @details
+ *  transaction_cb is called by lib_aci_event_get(), lib_aci_event_get_many() or
+ *  lib_aci_event_release() once every command has its response, the first failure is
+ *  reported, or when timeout_ms is over. It may start another transaction.
+ *  The events are still returned to the application.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param transaction_cb function called with the outcome.
+ *  @param timeout_ms time to wait for the responses in milliseconds, 0 to wait forever.
+ *  @return False if no transaction is being built, or transaction_cb is NULL.
+ */
+bool lib_aci_transaction_end(aci_state_t *aci_stat, lib_aci_transaction_cb_t transaction_cb, uint16_t timeout_ms);
+
+/** @brief True from lib_aci_transaction_begin() until the transaction_cb of the transaction
+ */
+bool lib_aci_transaction_busy(aci_state_t *aci_stat);
+#endif
 
 /** @brief Gets an ACI event from the ACI Event Queue
  *  @details This function gets an ACI event from the ACI event queue. 
  *  The queue is updated by the SPI driver for the ACI running in the interrupt context
+ *  With ACI_RX_DATA_QUEUE_BYTES the data received are returned from the data event queue once
+ *  the other events are read, see lib_aci_data_peek_ptr().
  *  @param aci_stat pointer to the state of the ACI.
  *  @param p_aci_data pointer to the ACI Event. The ACI Event received will be copied into this pointer.
  *  @return True if an ACI Event was copied to the pointer.
 */
 bool lib_aci_event_get(aci_state_t *aci_stat, hal_aci_evt_t * aci_evt);
 
+#if ACI_LOW_MEMORY
+/** @brief Event buffer shared with the ACI Library
+ *  @details With ACI_LOW_MEMORY the buffer the library reads the events of its initialization
+ *  into is given to the sketch for lib_aci_event_get(), in place of a hal_aci_evt_t of its own. The event stays valid until the next event is fetched into it.
+ *  lib_aci_init() and lib_aci_init_poll() use it too, keep no event in it across them.
+ */
+hal_aci_evt_t *lib_aci_event_buffer(void);
+#endif
+
+/** @brief Gets up to max_count ACI events from the ACI Event Queue
+ *  @details Same as calling lib_aci_event_get() until the queue is empty, but in one call.
+ *  The state of the ACI is updated for every event, in order. Use this to keep up with bursts
+ *  of received data.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @param p_aci_evt_data array of at least max_count ACI Events. The events received are copied into it.
+ *  @param max_count maximum number of events to get.
+ *  @return Number of ACI Events copied to the array.
+*/
+uint8_t lib_aci_event_get_many(aci_state_t *aci_stat, hal_aci_evt_t *p_aci_evt_data, uint8_t max_count);
+
 /** @brief Peeks an ACI event from the ACI Event Queue
  * @details This function peeks at the top event in the ACI event queue.
  * In polling mode, this function will query the nRF8001 for pending events, but unlike
@@ -521,6 +1605,62 @@ bool lib_aci_event_get(aci_state_t *aci_stat, hal_aci_evt_t * aci_evt);
 */
 bool lib_aci_event_peek(hal_aci_evt_t *p_aci_evt_data);
 
+/** @brief Peeks an ACI event in place in the ACI Event Queue
+ * @details Same as lib_aci_event_peek() but the event is not copied. The event stays
+ * valid until lib_aci_event_release() is called and must not be modified. Its fields can
+ * be read in place with ACI_EVT_VIEW() and the aci_evt_*_view_t overlays.
+ * @return Pointer to the top event, NULL if there is no ACI Event.
+*/
+const hal_aci_evt_t *lib_aci_event_peek_ptr(void);
+
+/** @brief Removes the event returned by lib_aci_event_peek_ptr() from the ACI Event Queue
+ * @details The state of the ACI is updated from the event the same way lib_aci_event_get() does.
+ * @param aci_stat pointer to the state of the ACI.
+*/
+void lib_aci_event_release(aci_state_t *aci_stat);
+
+#if ACI_RX_DATA_QUEUE_BYTES
+/** @brief Peeks an ACI_EVT_DATA_RECEIVED in place in the data event queue
+ * @details With ACI_RX_DATA_QUEUE_BYTES the data received do not go through the ACI Event Queue,
+ * they wait in the data event queue, in the order they came, and the transfers only wait when it
+ * is full. lib_aci_event_get() returns them once the other events are read, except the data received
+ * before an ACI_EVT_DISCONNECTED that are returned ahead of it. They can also be read here, ahead of
+ * the other events. The event stays valid until lib_aci_data_release() is called and must not be modified.
+ * @return Pointer to the oldest data event, NULL if there is none.
+*/
+const hal_aci_evt_t *lib_aci_data_peek_ptr(void);
+
+/** @brief Tells if the event returned by lib_aci_data_peek_ptr() came on a link that has dropped
+ * @details The data are still given, they were received, but the peer that sent them is gone:
+ * they are not acknowledged by lib_aci_auto_ack_enable() and a reply would be for the next link.
+ * The ACI_EVT_DISCONNECTED is still waiting in the ACI Event Queue when this is true.
+ * @return True when an ACI_EVT_DISCONNECTED was received after the oldest data event.
+*/
+bool lib_aci_data_is_stale(void);
+
+/** @brief Removes the event returned by lib_aci_data_peek_ptr() from the data event queue
+ * @details The state of the ACI is updated from the event and it is dispatched the same way
+ * lib_aci_event_release() does.
+ * @param aci_stat pointer to the state of the ACI.
+*/
+void lib_aci_data_release(aci_state_t *aci_stat);
+#endif
+
+#if HAL_ACI_EVENT_FILTER
+/** @brief Keeps events the sketch does not act on out of the ACI Event Queue
+ * @details The events of the mask, built with HAL_ACI_EVENT_FILTER_BIT(), are dropped by the
+ * transport as they are clocked in. They are not returned nor dispatched, but the ACI state is still
+ * updated from them by the next lib_aci_event_get(), lib_aci_event_get_many() or lib_aci_event_release().
+ * ACI_EVT_ECHO and ACI_EVT_TIMING can be filtered, ACI_EVT_DATA_CREDIT with LIB_ACI_CREDIT_TRACKING,
+ * and ACI_EVT_DATA_ACK without LIB_ACI_ACK_WINDOW, in which case confirmation_pending is no longer cleared.
+ * Call it after lib_aci_init(), which lets every event through.
+ * @param aci_stat pointer to the state of the ACI.
+ * @param evt_mask events to filter, 0 for none.
+ * @return False if the mask holds an event that cannot be filtered, the filter is then not changed.
+*/
+bool lib_aci_event_filter_set(aci_state_t *aci_stat, uint16_t evt_mask);
+#endif
+
 /** @brief Flushes the events in the ACI command queues and ACI Event queue
  *
 */
@@ -550,6 +1690,14 @@ void lib_aci_flush(void);
  */
  bool lib_aci_command_queue_empty(void);
 
+/** @brief Sleep until the nRF8001 asserts RDYN
+ *  @details Puts the MCU in sleep_mode (e.g. SLEEP_MODE_PWR_DOWN) when the ACI command queue
+ *  and the ACI event queue are empty. Call it at the end of the ACI loop in interrupt mode.
+ *  See hal_aci_tl_idle().
+ *  @return True if the MCU has been sleeping, false if there was work pending.
+ */
+bool lib_aci_idle(uint8_t sleep_mode);
+
 //@}
 
 /** @} */